@@ -0,0 +1,12 @@
+# array growth (mrb_ary_push) and element access
+i = 0
+while i < 200_000
+  a = []
+  j = 0
+  while j < 32
+    a << j
+    j += 1
+  end
+  a[0]; a[31]
+  i += 1
+end
@@ -0,0 +1,7 @@
+# fiber context switches
+f = Fiber.new { while true; Fiber.yield; end }
+i = 0
+while i < 300_000
+  f.resume
+  i += 1
+end
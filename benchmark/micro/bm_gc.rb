@@ -0,0 +1,8 @@
+# collector cycles over a retained graph plus churn
+$keep = (1..5000).map { |i| [i.to_s, {i => i}] }
+i = 0
+while i < 200_000
+  [i.to_s]
+  i += 1
+end
+50.times { GC.start }
@@ -0,0 +1,12 @@
+# khash probing at small, medium and large sizes
+[8, 256, 8192].each do |size|
+  h = {}
+  size.times { |k| h[k] = k }
+  n = 4_000_000 / size > 1000 ? 1_000_000 : 4_000_000 / size * 1000
+  i = 0
+  while i < n
+    h[i % size]
+    h[i % size] = i
+    i += 1
+  end
+end
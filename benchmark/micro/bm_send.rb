@@ -0,0 +1,10 @@
+# method dispatch: monomorphic sends in a tight loop
+class MicroSend
+  def m; nil; end
+end
+o = MicroSend.new
+i = 0
+while i < 3_000_000
+  o.m; o.m; o.m; o.m
+  i += 1
+end
@@ -0,0 +1,12 @@
+# string building and hashing (mrb_str_cat, mrb_str_hash)
+i = 0
+while i < 200_000
+  s = ""
+  j = 0
+  while j < 16
+    s << "01234567"
+    j += 1
+  end
+  s.hash
+  i += 1
+end
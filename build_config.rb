@@ -120,6 +120,8 @@ MRuby::Build.new('test') do |conf|
   conf.enable_test
 
   conf.gembox 'default'
+  conf.gem :core => "mruby-eval"
+  conf.gem :core => "mruby-error"
 end
 
 MRuby::Build.new('bench') do |conf|
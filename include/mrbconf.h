@@ -38,8 +38,13 @@
 /* use segmented list for IV table */
 //#define MRB_USE_IV_SEGLIST
 
-/* initial size for IV khash; ignored when MRB_USE_IV_SEGLIST is set */
-//#define MRB_IVHASH_INIT_SIZE 8
+/* initial slot capacity of an ivar table; ignored when MRB_USE_IV_SEGLIST is set */
+//#define MRB_IV_INITIAL_CAPA 4
+
+/* share one process-wide symbol table across all mrb_states; interning is
+   done once per process and per-state symbol memory goes away.  Requires
+   pthreads and GCC/Clang atomic builtins */
+//#define MRB_USE_SHARED_SYMBOLS
 
 /* if _etext and _edata available, mruby can reduce memory used by symbols */
 //#define MRB_USE_ETEXT_EDATA
@@ -81,6 +86,11 @@
 /* -DMRB_ENABLE_XXXX to enable following features */
 //#define MRB_ENABLE_DEBUG_HOOK	/* hooks for debugger */
 
+/* count executions and accumulated cycles per VM opcode and per
+   opcode-pair transition; the table is printed to stderr by mrb_close.
+   Measurement itself costs cycles, so only ratios are meaningful */
+//#define MRB_VM_OPCODE_PROFILE
+
 /* end of configuration */
 
 /* define MRB_DISABLE_XXXX from DISABLE_XXX (for compatibility) */
@@ -37,6 +37,7 @@
 #include <mruby/value.h>
 #include <mruby/gc.h>
 #include <mruby/version.h>
+#include <mruby/presym.h>
 
 /**
  * MRuby C API entry point
@@ -82,6 +83,9 @@ typedef struct {
   int argc;
   int acc;
   struct RClass *target_class;
+  int ciidx;                    /* depth of this record in the callinfo stack */
+  int arena_idx;                /* GC arena index captured when the frame was
+                                   pushed; popping the frame restores it */
 } mrb_callinfo;
 
 enum mrb_fiber_state {
@@ -100,7 +104,12 @@ struct mrb_context {
   mrb_value *stbase, *stend;
 
   mrb_callinfo *ci;
-  mrb_callinfo *cibase, *ciend;
+  mrb_callinfo **ciseg;                   /* segmented callinfo stack */
+  int cisegs;                             /* number of allocated segments */
+  int ci_clean;                           /* highest callinfo index verified
+                                             free of C-function boundaries;
+                                             lowered on pops so fiber switch
+                                             checks only frames above it */
 
   mrb_code **rescue;                      /* exception handler stack */
   int rsize;
@@ -112,11 +121,27 @@ struct mrb_context {
   struct RFiber *fib;
 };
 
+/* The callinfo stack is segmented so that pushes never move existing
+   records; each record is addressed by its depth index (ci->ciidx). */
+#ifndef MRB_CALLINFO_SEG_SIZE
+#define MRB_CALLINFO_SEG_SIZE 32
+#endif
+
+static inline mrb_callinfo*
+mrb_ci_at(struct mrb_context *c, int idx)
+{
+  return &c->ciseg[idx / MRB_CALLINFO_SEG_SIZE][idx % MRB_CALLINFO_SEG_SIZE];
+}
+
 struct mrb_jmpbuf;
 
+/* raw snapshot of one call frame, taken when an exception is raised;
+   file and line are resolved from the irep's debug info only when the
+   backtrace is actually printed or asked for.  The irep is kept alive
+   by a reference count while the snapshot holds it. */
 typedef struct {
-  const char *filename;
-  int lineno;
+  struct mrb_irep *irep;
+  uint32_t pc_off;
   struct RClass *klass;
   char sep;
   mrb_sym method_id;
@@ -127,6 +152,29 @@ typedef void (*mrb_atexit_func)(struct mrb_state*);
 #define MRB_STATE_NO_REGEXP 1
 #define MRB_STATE_REGEXP    2
 
+/* number of entries in the global method cache (must be a power of 2) */
+#ifndef MRB_METHOD_CACHE_SIZE
+#define MRB_METHOD_CACHE_SIZE 256
+#endif
+
+/* global method cache entry, hashed by (class, method-id);
+   valid while its generation matches mrb->cache_gen */
+struct mrb_method_cache_entry {
+  struct RClass *c;             /* lookup origin class */
+  struct RClass *tc;            /* class the method was found in */
+  mrb_sym mid;
+  struct RProc *m;
+  uint32_t gen;
+};
+
+/* optional JIT backend; `call` dispatches a method to compiled code and
+   returns TRUE when it handled the call (FALSE falls back to the
+   interpreter), `irep_free` releases the per-irep compiled code */
+struct mrb_jit_hooks {
+  int (*call)(struct mrb_state *mrb, struct RProc *proc, mrb_value *argv, int argc, mrb_value *result);
+  void (*irep_free)(struct mrb_state *mrb, struct mrb_irep *irep);
+};
+
 typedef struct mrb_state {
   struct mrb_jmpbuf *jmp;
 
@@ -138,6 +186,10 @@ typedef struct mrb_state {
   struct mrb_context *root_c;
 
   struct RObject *exc;                    /* exception */
+  struct RProc *break_proc;               /* block whose `break` stopped at a
+                                             C boundary instead of unwinding;
+                                             consumed by C loops that drive
+                                             blocks with mrb_yield */
   struct {
     struct RObject *exc;
     int n;
@@ -145,6 +197,8 @@ typedef struct mrb_state {
     mrb_backtrace_entry *entries;
   } backtrace;
   struct iv_tbl *globals;                 /* global variable table */
+  struct iv_shape *iv_shapes;             /* root of the interned ivar
+                                             shape tree (see variable.c) */
 
   struct RObject *top_self;
   struct RClass *object_class;            /* Object class */
@@ -164,22 +218,68 @@ typedef struct mrb_state {
   struct RClass *kernel_module;
 
   struct alloca_header *mems;
+  struct mrb_pool *pool_cache;            /* one recycled compiler memory
+                                             pool; refilled by mrb_pool_close
+                                             so REPL-style callers do not pay
+                                             a pool malloc per statement */
+  struct mrb_context *cxt_cache;          /* recycled fiber contexts with
+                                             stack and callinfo segment kept
+                                             warm, linked through ->prev
+                                             (see mrb_context_recycle) */
+  int cxt_cache_len;
   mrb_gc gc;
 
+  uint32_t cache_gen;           /* bumped whenever a method table changes;
+                                   invalidates all inline method caches */
+  uint32_t const_gen;           /* bumped whenever a constant table (or the
+                                   ancestry constants are found through)
+                                   changes; invalidates per-site constant
+                                   caches without touching method caches */
+  struct mrb_method_cache_entry method_cache[MRB_METHOD_CACHE_SIZE];
+
+#ifndef MRB_USE_SHARED_SYMBOLS
   mrb_sym symidx;
   struct kh_n2s *name2sym;      /* symbol hash */
   struct symbol_name *symtbl;   /* symbol table */
   size_t symcapa;
+  struct mrb_pool *sympool;     /* packed storage for interned names */
+#endif
 
 #ifdef MRB_ENABLE_DEBUG_HOOK
   void (*code_fetch_hook)(struct mrb_state* mrb, struct mrb_irep *irep, mrb_code *pc, mrb_value *regs);
   void (*debug_op_hook)(struct mrb_state* mrb, struct mrb_irep *irep, mrb_code *pc, mrb_value *regs);
+  /* called when OP_TRAP is dispatched; returns the instruction the trap
+     displaced, which the VM then executes at the same pc */
+  mrb_code (*breakpoint_hook)(struct mrb_state* mrb, struct mrb_irep *irep, mrb_code *pc, mrb_value *regs);
+#endif
+
+  struct mrb_profile *prof;     /* sampling profiler state; NULL unless
+                                   started (see mruby/profile.h) */
+  struct mrb_latency *lat;      /* entry-point latency histograms; NULL
+                                   unless started (see mruby/latency.h) */
+#ifdef MRB_VM_OPCODE_PROFILE
+  struct mrb_opprof *opprof;    /* per-opcode execution and cycle counters,
+                                   allocated by the first dispatch (vm.c) */
 #endif
 
+  struct mrb_trace *trace;      /* chrome-trace event buffer; NULL unless
+                                   started (see mruby/trace.h) */
+
+  const struct mrb_jit_hooks *jit;      /* optional JIT backend
+                                           (installed by the mruby-jit gem) */
+
+  struct mrb_eval_cache *eval_cache;    /* compiled-string cache
+                                           (installed by the mruby-eval gem) */
+
   struct RClass *eException_class;
   struct RClass *eStandardError_class;
   struct RObject *nomem_err;              /* pre-allocated NoMemoryError */
 
+  struct mrb_lazy_const *lazy_consts;     /* gem initializers deferred until
+                                             their constant is first looked
+                                             up (see mrb_define_lazy_const) */
+  mrb_int lazy_const_len;
+
   void *ud; /* auxiliary data */
 
 #ifdef MRB_FIXED_STATE_ATEXIT_STACK
@@ -362,6 +462,26 @@ MRB_API void mrb_define_module_function(mrb_state*, struct RClass*, const char*,
  */
 MRB_API void mrb_define_const(mrb_state*, struct RClass*, const char *name, mrb_value);
 
+/**
+ * Registers an initializer to run the first time constant lookup for
+ * `name` misses at top level.  Gems whose whole surface hangs off one
+ * constant (Math, Struct, Time) register themselves here instead of
+ * initializing inside mrb_open, so startup cost scales with what the
+ * script actually uses; see the `lazy_init_const` gem option.
+ *
+ *  @param [mrb_state *] mrb_state* The MRuby state reference.
+ *  @param [const char *] name The top-level constant name to watch.
+ *  @param init The initializer; expected to define `name`.
+ */
+MRB_API void mrb_define_lazy_const(mrb_state *mrb, const char *name, void (*init)(mrb_state*));
+
+/**
+ * Returns TRUE while an initializer registered with
+ * mrb_define_lazy_const has not run yet (used by generated gem
+ * finalizers to skip finalizing a gem that was never initialized).
+ */
+MRB_API mrb_bool mrb_lazy_const_pending(mrb_state *mrb, const char *name);
+
 /**
  * Undefines a method.
  *
@@ -750,6 +870,42 @@ typedef const char *mrb_args_format;
  */
 MRB_API mrb_int mrb_get_args(mrb_state *mrb, mrb_args_format format, ...);
 
+/** Maximum number of specifiers a compiled argument spec can hold. */
+#define MRB_ARG_SPEC_MAX 16
+
+/**
+ * Compiled form of an {mrb_args_format} string.
+ *
+ * Filled in by mrb_get_args_spec on first use; treat the members as
+ * opaque.  `format` doubles as the "already compiled" marker, so a
+ * zero-initialized spec is a valid empty one.
+ */
+typedef struct mrb_arg_spec {
+  mrb_args_format format;         /* format this spec was compiled from */
+  uint8_t nreq;                   /* required arguments */
+  uint8_t nopt;                   /* optional arguments */
+  uint8_t rest;                   /* format contains '*' */
+  uint8_t nent;                   /* compiled entries below */
+  uint8_t ent[MRB_ARG_SPEC_MAX];  /* specifier chars; high bit set when '!' follows */
+} mrb_arg_spec;
+
+/**
+ * As mrb_get_args, but the format string is parsed only once.
+ *
+ * The caller passes a `static mrb_arg_spec` handle; on the first call the
+ * format is compiled into it, and later calls validate the argument count
+ * against the precomputed arity and scatter the arguments with a tight
+ * loop over the compiled entries, skipping the per-character parse.
+ *
+ *      static mrb_arg_spec spec;
+ *      mrb_get_args_spec(mrb, &spec, "o|i", &obj, &n);
+ *
+ * The handle must always be used with the same format string.
+ *
+ * @see mrb_get_args
+ */
+MRB_API mrb_int mrb_get_args_spec(mrb_state *mrb, mrb_arg_spec *spec, mrb_args_format format, ...);
+
 static inline mrb_sym
 mrb_get_mid(mrb_state *mrb) /* get method symbol */
 {
@@ -832,6 +988,36 @@ MRB_API mrb_value mrb_funcall_argv(mrb_state*, mrb_value, mrb_sym, mrb_int, cons
  * Call existing ruby functions with a block.
  */
 MRB_API mrb_value mrb_funcall_with_block(mrb_state*, mrb_value, mrb_sym, mrb_int, const mrb_value*, mrb_value);
+
+/**
+ * Prepared call handle for C code that invokes the same method
+ * repeatedly. The resolved method is cached in the handle and
+ * revalidated against the method cache generation, so repeat
+ * invocations skip name interning and method lookup and only copy
+ * the argument values. The handle is caller-owned; prepare it once
+ * per (receiver class, method, argc) and reuse it freely.
+ *
+ *      mrb_prepared_call call;
+ *      mrb_value argv[1];
+ *
+ *      mrb_funcall_prepare(mrb, &call, mrb_obj_class(mrb, obj),
+ *                          mrb_intern_lit(mrb, "on_event"), 1);
+ *      for (;;) {
+ *        argv[0] = next_event(mrb);
+ *        mrb_funcall_prepared(mrb, &call, obj, argv);
+ *      }
+ */
+typedef struct mrb_prepared_call {
+  struct RClass *c;             /* receiver class the handle is prepared for */
+  struct RClass *tc;            /* class the method was found in */
+  struct RProc *proc;           /* resolved method, NULL if missing */
+  mrb_sym mid;
+  mrb_int argc;
+  uint32_t gen;                 /* mrb->cache_gen at resolve time */
+} mrb_prepared_call;
+
+MRB_API void mrb_funcall_prepare(mrb_state*, mrb_prepared_call*, struct RClass*, mrb_sym, mrb_int);
+MRB_API mrb_value mrb_funcall_prepared(mrb_state*, mrb_prepared_call*, mrb_value, const mrb_value*);
 /**
  * Create a symbol
  *
@@ -928,6 +1114,21 @@ MRB_API mrb_state* mrb_open_core(mrb_allocf f, void *ud);
  */
 MRB_API void mrb_close(mrb_state *mrb);
 
+/**
+ * Closes a mrb_state without freeing individual objects.
+ *
+ * Runs only teardown with effects outside the state's allocator
+ * (atexit handlers, RData dfree finalizers) and releases whole heap
+ * pages; everything else is left for the embedder to reclaim by
+ * dropping the allocator's memory en masse, e.g. with
+ * mrb_alloc_arena_free.  Requires a state opened via mrb_open_allocf
+ * on such an allocator -- with the default allocator this leaks.
+ *
+ * @param mrb
+ *      Pointer to the mrb_state to be closed.
+ */
+MRB_API void mrb_close_fast(mrb_state *mrb);
+
 /**
  * The default allocation function.
  *
@@ -968,10 +1169,19 @@ MRB_API void mrb_gc_mark(mrb_state*,struct RBasic*);
   if (!mrb_immediate_p(val)) mrb_gc_mark((mrb), mrb_basic_ptr(val)); \
 } while (0)
 MRB_API void mrb_field_write_barrier(mrb_state *, struct RBasic*, struct RBasic*);
+MRB_API void mrb_write_barrier(mrb_state *, struct RBasic*);
+/* a write barrier only has work to do when the receiver is black; once a
+   barrier has painted it gray every further store into it is filtered
+   here, by a single bit test, without calling into the collector */
+#define mrb_field_write_barrier(mrb, obj, value) do{\
+  if ((obj)->color & MRB_GC_COLOR_BLACK) (mrb_field_write_barrier)((mrb), (obj), (value)); \
+} while (0)
 #define mrb_field_write_barrier_value(mrb, obj, val) do{\
   if (!mrb_immediate_p(val)) mrb_field_write_barrier((mrb), (obj), mrb_basic_ptr(val)); \
 } while (0)
-MRB_API void mrb_write_barrier(mrb_state *, struct RBasic*);
+#define mrb_write_barrier(mrb, obj) do{\
+  if ((obj)->color & MRB_GC_COLOR_BLACK) (mrb_write_barrier)((mrb), (obj)); \
+} while (0)
 
 MRB_API mrb_value mrb_check_convert_type(mrb_state *mrb, mrb_value val, enum mrb_vtype type, const char *tname, const char *method);
 MRB_API mrb_value mrb_any_to_s(mrb_state *mrb, mrb_value obj);
@@ -1003,6 +1213,10 @@ MRB_API mrb_value mrb_exc_new(mrb_state *mrb, struct RClass *c, const char *ptr,
 MRB_API mrb_noreturn void mrb_exc_raise(mrb_state *mrb, mrb_value exc);
 
 MRB_API mrb_noreturn void mrb_raise(mrb_state *mrb, struct RClass *c, const char *msg);
+/* like mrb_raise, but reuses one preallocated instance per class and
+   message with no backtrace; for control-flow exceptions raised often
+   and usually discarded (StopIteration, FiberError, ...) */
+MRB_API mrb_noreturn void mrb_control_raise(mrb_state *mrb, struct RClass *c, const char *msg);
 MRB_API mrb_noreturn void mrb_raisef(mrb_state *mrb, struct RClass *c, const char *fmt, ...);
 MRB_API mrb_noreturn void mrb_name_error(mrb_state *mrb, mrb_sym id, const char *fmt, ...);
 MRB_API void mrb_warn(mrb_state *mrb, const char *fmt, ...);
@@ -1079,6 +1293,14 @@ MRB_API mrb_value mrb_fiber_resume(mrb_state *mrb, mrb_value fib, mrb_int argc,
  */
 MRB_API mrb_value mrb_fiber_yield(mrb_state *mrb, mrb_int argc, const mrb_value *argv);
 
+/*
+ * Transfer control to a Fiber without pushing it on the fiber call
+ * stack (C-level equivalent of Fiber#transfer)
+ *
+ * @mrbgem mruby-fiber
+ */
+MRB_API mrb_value mrb_fiber_transfer(mrb_state *mrb, mrb_value fib, mrb_int argc, const mrb_value *argv);
+
 /*
  * FiberError reference
  *
@@ -1091,6 +1313,7 @@ typedef struct mrb_pool mrb_pool;
 MRB_API struct mrb_pool* mrb_pool_open(mrb_state*);
 MRB_API void mrb_pool_close(struct mrb_pool*);
 MRB_API void* mrb_pool_alloc(struct mrb_pool*, size_t);
+void mrb_pool_cache_clear(mrb_state*);
 MRB_API void* mrb_pool_realloc(struct mrb_pool*, void*, size_t oldlen, size_t newlen);
 MRB_API mrb_bool mrb_pool_can_realloc(struct mrb_pool*, void*, size_t);
 MRB_API void* mrb_alloca(mrb_state *mrb, size_t);
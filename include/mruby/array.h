@@ -21,26 +21,61 @@ typedef struct mrb_shared_array {
   mrb_value *ptr;
 } mrb_shared_array;
 
+/* Small arrays are stored inside the RArray cell itself (like short
+   strings in RString): the embed union member overlays the heap
+   bookkeeping and holds up to MRB_ARY_EMBED_LEN_MAX values, with the
+   length kept in the flags.  Growing past that promotes the array to
+   the heap representation transparently. */
 struct RArray {
   MRB_OBJECT_HEADER;
-  mrb_int len;
   union {
-    mrb_int capa;
-    mrb_shared_array *shared;
-  } aux;
-  mrb_value *ptr;
+    struct {
+      mrb_int len;
+      union {
+        mrb_int capa;
+        mrb_shared_array *shared;
+      } aux;
+      mrb_value *ptr;
+    } heap;
+    mrb_value embed[2];
+  } as;
 };
 
+#define MRB_ARY_EMBED_LEN_MAX ((mrb_int)(sizeof(((struct RArray*)0)->as)/sizeof(mrb_value)))
+
 #define mrb_ary_ptr(v)    ((struct RArray*)(mrb_ptr(v)))
 #define mrb_ary_value(p)  mrb_obj_value((void*)(p))
 #define RARRAY(v)  ((struct RArray*)(mrb_ptr(v)))
 
-#define RARRAY_LEN(a) (RARRAY(a)->len)
-#define RARRAY_PTR(a) ((const mrb_value*)RARRAY(a)->ptr)
 #define MRB_ARY_SHARED      256
+#define MRB_ARY_EMBED       512
+#define MRB_ARY_EMBED_LEN_MASK 0x7c00
+#define MRB_ARY_EMBED_LEN_SHIFT 10
 #define ARY_SHARED_P(a) ((a)->flags & MRB_ARY_SHARED)
 #define ARY_SET_SHARED_FLAG(a) ((a)->flags |= MRB_ARY_SHARED)
 #define ARY_UNSET_SHARED_FLAG(a) ((a)->flags &= ~MRB_ARY_SHARED)
+#define ARY_EMBED_P(a) ((a)->flags & MRB_ARY_EMBED)
+#define ARY_EMBED_LEN(a)\
+  (mrb_int)(((a)->flags & MRB_ARY_EMBED_LEN_MASK) >> MRB_ARY_EMBED_LEN_SHIFT)
+#define ARY_SET_EMBED_LEN(a,n) do {\
+  mrb_int tmp_n = (n);\
+  (a)->flags &= ~MRB_ARY_EMBED_LEN_MASK;\
+  (a)->flags |= (uint32_t)(tmp_n) << MRB_ARY_EMBED_LEN_SHIFT;\
+} while (0)
+#define ARY_LEN(a) (ARY_EMBED_P(a) ? ARY_EMBED_LEN(a) : (a)->as.heap.len)
+#define ARY_PTR(a) (ARY_EMBED_P(a) ? (a)->as.embed : (a)->as.heap.ptr)
+#define ARY_SET_LEN(a,n) do {\
+  if (ARY_EMBED_P(a)) {\
+    mrb_assert((n) <= MRB_ARY_EMBED_LEN_MAX);\
+    ARY_SET_EMBED_LEN(a,n);\
+  }\
+  else\
+    (a)->as.heap.len = (n);\
+} while (0)
+#define ARY_CAPA(a) (ARY_EMBED_P(a) ? MRB_ARY_EMBED_LEN_MAX : (a)->as.heap.aux.capa)
+
+#define RARRAY_LEN(a) ARY_LEN(RARRAY(a))
+#define RARRAY_PTR(a) ((const mrb_value*)ARY_PTR(RARRAY(a)))
 
 void mrb_ary_decref(mrb_state*, mrb_shared_array*);
 MRB_API void mrb_ary_modify(mrb_state*, struct RArray*);
@@ -60,6 +95,18 @@ MRB_API mrb_value mrb_ary_new(mrb_state *mrb);
 
 MRB_API mrb_value mrb_ary_new_from_values(mrb_state *mrb, mrb_int size, const mrb_value *vals);
 MRB_API mrb_value mrb_assoc_new(mrb_state *mrb, mrb_value car, mrb_value cdr);
+
+/*
+ * Ensures the array has capacity for at least capa elements, so that a
+ * sequence of pushes up to that size never reallocates.
+ */
+MRB_API void mrb_ary_reserve(mrb_state *mrb, mrb_value ary, mrb_int capa);
+
+/*
+ * Appends n values to the array with a single capacity check and copy.
+ */
+MRB_API void mrb_ary_cat(mrb_state *mrb, mrb_value ary, const mrb_value *vals, mrb_int n);
+
 MRB_API void mrb_ary_concat(mrb_state*, mrb_value, mrb_value);
 MRB_API mrb_value mrb_ary_splat(mrb_state*, mrb_value);
 
@@ -11,6 +11,17 @@
 # error MRB_INT16 is too small for MRB_WORD_BOXING.
 #endif
 
+/*
+ * On 64-bit words there is room to pack most doubles into the value
+ * itself (CRuby-style flonums): the exponent range that covers every
+ * number programs normally compute with is re-tagged into the low two
+ * bits, so float arithmetic allocates no heap objects.  Doubles outside
+ * that range still fall back to a heap RFloat.
+ */
+#if !defined(MRB_USE_FLOAT) && defined(ULONG_MAX) && (ULONG_MAX >> 62) > 0
+# define MRB_WORD_BOXING_FLONUM
+#endif
+
 struct RFloat {
   MRB_OBJECT_HEADER;
   mrb_float f;
@@ -24,6 +35,24 @@ struct RCptr {
 #define MRB_FIXNUM_SHIFT 1
 #define MRB_TT_HAS_BASIC MRB_TT_FLOAT
 
+#ifdef MRB_WORD_BOXING_FLONUM
+
+/* the (w & 3) == 2 lane belongs to flonums, so the special constants
+   and the symbol tag live in patterns with both low bits clear that can
+   never be an 8-byte-aligned heap pointer */
+enum mrb_special_consts {
+  MRB_Qnil    = 0,
+  MRB_Qfalse  = 0x04,
+  MRB_Qtrue   = 0x14,
+  MRB_Qundef  = 0x24,
+};
+
+#define MRB_FIXNUM_FLAG   0x01
+#define MRB_FLONUM_FLAG   0x02
+#define MRB_SYMBOL_FLAG   0x0c
+
+#else  /* no flonums */
+
 enum mrb_special_consts {
   MRB_Qnil    = 0,
   MRB_Qfalse  = 2,
@@ -33,6 +62,9 @@ enum mrb_special_consts {
 
 #define MRB_FIXNUM_FLAG   0x01
 #define MRB_SYMBOL_FLAG   0x0e
+
+#endif  /* MRB_WORD_BOXING_FLONUM */
+
 #define MRB_SPECIAL_SHIFT 8
 
 typedef union mrb_value {
@@ -61,10 +93,66 @@ MRB_API mrb_value mrb_word_boxing_float_pool(struct mrb_state*, mrb_float);
 
 #define mrb_ptr(o)     (o).value.p
 #define mrb_cptr(o)    (o).value.vp->p
-#define mrb_float(o)   (o).value.fp->f
 #define mrb_fixnum(o)  (o).value.i
 #define mrb_symbol(o)  (o).value.sym
 
+#ifdef MRB_WORD_BOXING_FLONUM
+
+#define mrb_flonum_p(o) (((o).w & 0x03) == MRB_FLONUM_FLAG)
+
+/*
+ * Flonum encoding (borrowed from CRuby): doubles whose top exponent
+ * bits are 011 or 100 are rotated left by 3 so that those bits land in
+ * the tag position, then tagged with MRB_FLONUM_FLAG.  +0.0 gets a
+ * reserved pattern of its own, and the one double whose rotation would
+ * collide with it stays on the heap.
+ */
+#define MRB_FLONUM_ZERO 0x8000000000000002UL
+
+static inline mrb_bool
+mrb_flonum_pack(mrb_float f, mrb_value *v)
+{
+  union { mrb_float f; unsigned long w; } t;
+
+  t.f = f;
+  if (t.w != 0x3000000000000000UL &&
+      !((((int)(t.w >> 60) & 0x7) - 3) & ~0x01)) {
+    v->w = (((t.w << 3) | (t.w >> 61)) & ~0x01UL) | MRB_FLONUM_FLAG;
+    return TRUE;
+  }
+  if (t.w == 0) {  /* +0.0 */
+    v->w = MRB_FLONUM_ZERO;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static inline mrb_float
+mrb_flonum_unpack(mrb_value v)
+{
+  union { mrb_float f; unsigned long w; } t;
+
+  if (v.w == MRB_FLONUM_ZERO) return 0.0;
+  t.w = (2 - (v.w >> 63)) | (v.w & ~0x03UL);
+  t.w = (t.w >> 3) | (t.w << 61);
+  return t.f;
+}
+
+static inline mrb_float
+mrb_word_boxing_value_float(mrb_value v)
+{
+  if (mrb_flonum_p(v)) return mrb_flonum_unpack(v);
+  return v.value.fp->f;
+}
+
+#define mrb_float(o)   mrb_word_boxing_value_float(o)
+
+#else  /* no flonums */
+
+#define mrb_float(o)   (o).value.fp->f
+
+#endif  /* MRB_WORD_BOXING_FLONUM */
+
 static inline enum mrb_vtype
 mrb_type(mrb_value o)
 {
@@ -80,6 +168,11 @@ mrb_type(mrb_value o)
   if (o.value.i_flag == MRB_FIXNUM_FLAG) {
     return MRB_TT_FIXNUM;
   }
+#ifdef MRB_WORD_BOXING_FLONUM
+  if (mrb_flonum_p(o)) {
+    return MRB_TT_FLOAT;
+  }
+#endif
   if (o.value.sym_flag == MRB_SYMBOL_FLAG) {
     return MRB_TT_SYMBOL;
   }
@@ -102,7 +195,16 @@ mrb_type(mrb_value o)
   }\
 } while (0)
 
+#ifdef MRB_WORD_BOXING_FLONUM
+#define SET_FLOAT_VALUE(mrb,r,v) do {\
+  mrb_float boxword_float_ = (v);\
+  if (!mrb_flonum_pack(boxword_float_, &(r))) {\
+    (r) = mrb_word_boxing_float_value(mrb, boxword_float_);\
+  }\
+} while (0)
+#else
 #define SET_FLOAT_VALUE(mrb,r,v) r = mrb_word_boxing_float_value(mrb, v)
+#endif
 #define SET_CPTR_VALUE(mrb,r,v) r = mrb_word_boxing_cptr_value(mrb, v)
 #define SET_NIL_VALUE(r) BOXWORD_SET_VALUE(r, MRB_TT_FALSE, value.i, 0)
 #define SET_FALSE_VALUE(r) BOXWORD_SET_VALUE(r, MRB_TT_FALSE, value.i, 1)
@@ -113,4 +215,13 @@ mrb_type(mrb_value o)
 #define SET_OBJ_VALUE(r,v) BOXWORD_SET_VALUE(r, (((struct RObject*)(v))->tt), value.p, (v))
 #define SET_UNDEF_VALUE(r) BOXWORD_SET_VALUE(r, MRB_TT_UNDEF, value.i, 0)
 
+#ifdef MRB_WORD_BOXING_FLONUM
+/* mruby/object.h is processed before this header, so its definition of
+   mrb_immediate_p must be replaced here: a float may be either a packed
+   flonum (immediate) or a heap RFloat, and the type tag alone cannot
+   decide whether there is a pointer behind the value */
+#undef mrb_immediate_p
+#define mrb_immediate_p(x) (mrb_type(x) < MRB_TT_HAS_BASIC || mrb_flonum_p(x))
+#endif
+
 #endif  /* MRUBY_BOXING_WORD_H */
@@ -82,7 +82,11 @@ MRB_API struct RClass* mrb_class_real(struct RClass* cl);
 
 void mrb_gc_mark_mt(mrb_state*, struct RClass*);
 size_t mrb_gc_mark_mt_size(mrb_state*, struct RClass*);
+size_t mrb_gc_mt_memsize(mrb_state*, struct RClass*);
 void mrb_gc_free_mt(mrb_state*, struct RClass*);
+void mrb_method_cache_clear(mrb_state*);
+void mrb_const_cache_clear(mrb_state*);
+mrb_value mrb_bob_init(mrb_state*, mrb_value);
 
 MRB_END_DECL
 
@@ -0,0 +1,33 @@
+/*
+** mruby/compar.h - Comparable module
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_COMPAR_H
+#define MRUBY_COMPAR_H
+
+#include "common.h"
+
+MRB_BEGIN_DECL
+
+/* mrb_cmp could not order the two values (`<=>` returned nil) */
+#define MRB_CMP_FAILED (-2)
+
+/*
+ * Compare two values, returning -1, 0 or 1, or MRB_CMP_FAILED if they
+ * do not order.  Fixnum, Float and String pairs are compared directly
+ * in C; everything else dispatches `<=>`.
+ */
+MRB_API mrb_int mrb_cmp(mrb_state *mrb, mrb_value obj1, mrb_value obj2);
+
+/*
+ * As mrb_cmp, but resolving `<=>` through a caller-owned prepared
+ * call handle (zero-initialize it before first use), so loops that
+ * compare many values of the same class look the method up once.
+ */
+MRB_API mrb_int mrb_cmp_prepared(mrb_state *mrb, mrb_prepared_call *call, mrb_value obj1, mrb_value obj2);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_COMPAR_H */
@@ -27,18 +27,49 @@ typedef struct mrb_data_type {
   void (*dfree)(mrb_state *mrb, void*);
 } mrb_data_type;
 
+/* payload bytes that fit directly in the GC cell without growing it
+   (an RData with inline storage is exactly as large as the biggest
+   existing cell member) */
+#define MRB_DATA_INLINE_MAX (sizeof(void*) * 3)
+
+/* flags: payload lives in as.buf; no dfree, and no instance
+   variables (the buffer overlays the iv slot) */
+#define MRB_DATA_INLINE 1
+
 struct RData {
   MRB_OBJECT_HEADER;
-  struct iv_tbl *iv;
+  union {
+    struct {
+      struct iv_tbl *iv;      /* must stay at the RObject iv offset */
+      void *ptr;
+    } heap;
+    char buf[MRB_DATA_INLINE_MAX];
+  } as;
   const mrb_data_type *type;
-  void *data;
 };
 
 MRB_API struct RData *mrb_data_object_alloc(mrb_state *mrb, struct RClass* klass, void *datap, const mrb_data_type *type);
 
+/**
+ * As mrb_data_object_alloc, but payloads of up to MRB_DATA_INLINE_MAX
+ * bytes are stored inside the GC cell itself: one allocation instead
+ * of two, no dfree at collection time, and field access stays on the
+ * object's cache line.  The payload (copied from `datap` when given,
+ * zeroed otherwise) must not hold mrb_values and the object cannot
+ * carry instance variables.  Larger payloads fall back to a heap
+ * allocation released through the type's dfree, which must then be
+ * set.
+ */
+MRB_API struct RData *mrb_data_object_alloc_inline(mrb_state *mrb, struct RClass *klass, const void *datap, size_t size, const mrb_data_type *type);
+
+#define mrb_data_inline_p(d) (RDATA(d)->flags & MRB_DATA_INLINE)
+
 #define Data_Wrap_Struct(mrb,klass,type,ptr)\
   mrb_data_object_alloc(mrb,klass,ptr,type)
 
+#define Data_Wrap_Struct_Inline(mrb,klass,strct,type,ptr)\
+  mrb_data_object_alloc_inline(mrb,klass,ptr,sizeof(strct),type)
+
 #define Data_Make_Struct(mrb,klass,strct,type,sval,data) do { \
   sval = mrb_malloc(mrb, sizeof(strct));                     \
   { static const strct zero = { 0 }; *sval = zero; };\
@@ -46,7 +77,7 @@ MRB_API struct RData *mrb_data_object_alloc(mrb_state *mrb, struct RClass* klass
 } while (0)
 
 #define RDATA(obj)         ((struct RData *)(mrb_ptr(obj)))
-#define DATA_PTR(d)        (RDATA(d)->data)
+#define DATA_PTR(d)        (RDATA(d)->as.heap.ptr)
 #define DATA_TYPE(d)       (RDATA(d)->type)
 MRB_API void mrb_data_check_type(mrb_state *mrb, mrb_value, const mrb_data_type*);
 MRB_API void *mrb_data_get_ptr(mrb_state *mrb, mrb_value, const mrb_data_type*);
@@ -66,6 +97,7 @@ static inline void
 mrb_data_init(mrb_value v, void *ptr, const mrb_data_type *type)
 {
   mrb_assert(mrb_type(v) == MRB_TT_DATA);
+  mrb_assert(!mrb_data_inline_p(v));
   DATA_PTR(v) = ptr;
   DATA_TYPE(v) = type;
 }
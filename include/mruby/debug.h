@@ -61,6 +61,12 @@ MRB_API mrb_irep_debug_info_file *mrb_debug_info_append_file(
 MRB_API mrb_irep_debug_info *mrb_debug_info_alloc(mrb_state *mrb, mrb_irep *irep);
 MRB_API void mrb_debug_info_free(mrb_state *mrb, mrb_irep_debug_info *d);
 
+/*
+ * decode the irep's debug record if it was loaded lazily (see load.c);
+ * call before mrb_debug_get_line/mrb_debug_get_filename
+ */
+MRB_API void mrb_debug_info_materialize(mrb_state *mrb, mrb_irep *irep);
+
 MRB_END_DECL
 
 #endif /* MRUBY_DEBUG_H */
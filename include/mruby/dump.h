@@ -21,16 +21,33 @@ MRB_BEGIN_DECL
 #define DUMP_ENDIAN_LIL 4
 #define DUMP_ENDIAN_NAT 6
 #define DUMP_ENDIAN_MASK 6
+#define DUMP_COMPACT 8
 
 int mrb_dump_irep(mrb_state *mrb, mrb_irep *irep, uint8_t flags, uint8_t **bin, size_t *bin_size);
 #ifndef MRB_DISABLE_STDIO
 int mrb_dump_irep_binary(mrb_state*, mrb_irep*, uint8_t, FILE*);
 int mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep*, uint8_t flags, FILE *f, const char *initname);
+/* emits fully-constructed mrb_irep structs as C source for
+   execute-in-place; run the result with mrb_load_irep_struct */
+int mrb_dump_irep_struct(mrb_state *mrb, mrb_irep*, uint8_t flags, FILE *f, const char *initname);
 mrb_irep *mrb_read_irep_file(mrb_state*, FILE*);
+/* as mrb_read_irep_file, but parses the (seekable) file section by
+   section through a reused window buffer instead of reading the whole
+   binary up front; peak transient memory is bounded by the largest
+   single irep record */
+MRB_API mrb_irep *mrb_read_irep_file_stream(mrb_state*, FILE*);
 MRB_API mrb_value mrb_load_irep_file(mrb_state*,FILE*);
+MRB_API mrb_value mrb_load_irep_file_stream(mrb_state*, FILE*);
 MRB_API mrb_value mrb_load_irep_file_cxt(mrb_state*, FILE*, mrbc_context*);
 #endif
 MRB_API mrb_irep *mrb_read_irep(mrb_state*, const uint8_t*);
+/* for binaries that outlive the mrb_state (memory-mapped files, flash);
+   loads without copying iseq/pool/symbol bytes when the byte order of
+   the binary matches */
+MRB_API mrb_irep *mrb_read_irep_static(mrb_state*, const uint8_t*);
+/* for buffers the embedder has already verified (signature check,
+   secure boot); skips the CRC pass */
+MRB_API mrb_irep *mrb_read_irep_trusted(mrb_state*, const uint8_t*);
 
 /* dump/load error code
  *
@@ -60,6 +77,8 @@ MRB_API mrb_irep *mrb_read_irep(mrb_state*, const uint8_t*);
 
 #define RITE_BINARY_EOF                "END\0"
 #define RITE_SECTION_IREP_IDENT        "IREP"
+#define RITE_SECTION_COMPACT_IREP_IDENT "CPIR"
+#define RITE_SECTION_SYMTAB_IDENT      "SYMT"
 #define RITE_SECTION_LINENO_IDENT      "LINE"
 #define RITE_SECTION_DEBUG_IDENT       "DBG\0"
 #define RITE_SECTION_LV_IDENT          "LVAR"
@@ -187,6 +206,60 @@ bin_to_uint8(const uint8_t *bin)
   return (uint8_t)bin[0];
 }
 
+/* unsigned LEB128; lengths and operands of the compact irep section */
+static inline size_t
+varint_size(uint32_t v)
+{
+  size_t n = 1;
+
+  while (v >= 0x80) {
+    v >>= 7;
+    n++;
+  }
+  return n;
+}
+
+static inline size_t
+varint_to_bin(uint32_t v, uint8_t *bin)
+{
+  size_t n = 0;
+
+  while (v >= 0x80) {
+    bin[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  bin[n++] = (uint8_t)v;
+  return n;
+}
+
+static inline uint32_t
+bin_to_varint(const uint8_t **bin)
+{
+  const uint8_t *p = *bin;
+  uint32_t v = 0;
+  int shift = 0;
+
+  while (*p & 0x80) {
+    v |= (uint32_t)(*p++ & 0x7f) << shift;
+    shift += 7;
+  }
+  v |= (uint32_t)*p++ << shift;
+  *bin = p;
+  return v;
+}
+
+/* operand layouts of the compact irep section.  Any layout round-trips
+   (A, B and C together cover every operand bit of an instruction); the
+   per-opcode choice only affects how small the common case encodes. */
+enum mrb_compact_fmt {
+  CPIR_FMT_ABC,   /* varints A, B, C */
+  CPIR_FMT_ABX,   /* varints A, Bx */
+  CPIR_FMT_ASBX,  /* varints A, zigzag(sBx) */
+};
+
+/** @internal dump.c; writer and loader must agree on one layout per opcode */
+int mrb_compact_op_fmt(int op);
+
 MRB_END_DECL
 
 /** @internal crc.c */
@@ -39,6 +39,15 @@ MRB_API mrb_value mrb_f_raise(mrb_state*, mrb_value);
  */
 MRB_API mrb_value mrb_protect(mrb_state *mrb, mrb_func_t body, mrb_value data, mrb_bool *state);
 
+/**
+ * Protect a batch of calls under one jmpbuf; only raising bodies re-arm it.
+ * Returns the number of bodies that raised.  results/states may be NULL.
+ *
+ * @mrbgem mruby-error
+ */
+MRB_API mrb_int mrb_protect_each(mrb_state *mrb, mrb_func_t body, mrb_int len, const mrb_value *data,
+                                 mrb_value *results, mrb_bool *states);
+
 /**
  * Ensure
  *
@@ -0,0 +1,68 @@
+/*
+** mruby/foreach.h - C-level internal iteration over built-in collections
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_FOREACH_H
+#define MRUBY_FOREACH_H
+
+#include "common.h"
+
+/**
+ * Internal iteration protocol.
+ *
+ * Built-in collections expose a foreach entry point that walks their
+ * elements with a plain C callback, so reductions written in C never
+ * allocate an intermediate block object or dispatch `each` per element.
+ * Enumerable's hot methods (src/enum.c) are built on top of it.
+ */
+MRB_BEGIN_DECL
+
+/**
+ * Per-element callback.  `val` is the element as `each` would yield it
+ * (a `[key, value]` pair for hashes).  Return zero to continue, any
+ * other value to stop; that value is handed back by the foreach call.
+ */
+typedef int (*mrb_foreach_func)(mrb_state *mrb, mrb_value val, void *data);
+
+/* per-class entry points; the GC arena is restored around each callback,
+   so anything the callback wants to keep must be reachable from outside
+   the arena (e.g. pushed into a result array created beforehand) */
+MRB_API int mrb_ary_foreach(mrb_state *mrb, mrb_value ary, mrb_foreach_func func, void *data);
+/* yields [key, value] pairs; for a raw key/value table walk without the
+   pair allocation see mrb_hash_foreach in mruby/hash.h */
+MRB_API int mrb_hash_pair_foreach(mrb_state *mrb, mrb_value hash, mrb_foreach_func func, void *data);
+MRB_API int mrb_range_foreach(mrb_state *mrb, mrb_value range, mrb_foreach_func func, void *data);
+
+/**
+ * Dispatch to the entry point matching `obj`'s class.  `obj` must
+ * satisfy mrb_foreach_supported_p.
+ */
+MRB_API int mrb_foreach(mrb_state *mrb, mrb_value obj, mrb_foreach_func func, void *data);
+
+#define mrb_foreach_supported_p(obj) \
+  (mrb_array_p(obj) || mrb_hash_p(obj) || mrb_type(obj) == MRB_TT_RANGE)
+
+/**
+ * TRUE when `blk` can be yielded from inside a C loop: a real block on
+ * the root fiber, with a live env, and without a block-`return` that
+ * would have to unwind across the C frame.  Native Enumerable methods
+ * decline to the generic Ruby path otherwise.
+ */
+MRB_API mrb_bool mrb_enum_yieldable_p(mrb_state *mrb, mrb_value blk);
+
+/* mrb_enum_yield result codes */
+#define MRB_ENUM_YIELD_OK    0  /* *out is the block's value */
+#define MRB_ENUM_YIELD_BREAK 1  /* `break` aimed at blk; *out is its value */
+#define MRB_ENUM_YIELD_OUTER 2  /* an outer block's break; return *out with
+                                   mrb->break_proc left set for the VM */
+
+/**
+ * Yield `blk` with break handling for C iteration loops.
+ */
+MRB_API int mrb_enum_yield(mrb_state *mrb, mrb_value blk, mrb_int argc, const mrb_value *argv, mrb_value *out);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_FOREACH_H */
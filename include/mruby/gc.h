@@ -20,6 +20,12 @@ struct mrb_state;
 typedef void (mrb_each_object_callback)(struct mrb_state *mrb, struct RBasic *obj, void *data);
 void mrb_objspace_each_objects(struct mrb_state *mrb, mrb_each_object_callback *callback, void *data);
 MRB_API void mrb_free_context(struct mrb_state *mrb, struct mrb_context *c);
+/* internal: per-state pool of recycled fiber contexts; recycle returns a
+   context to the pool (or frees it when the pool is full), get pops one
+   with its stack and first callinfo segment already allocated */
+struct mrb_context *mrb_context_cache_get(struct mrb_state *mrb);
+void mrb_context_recycle(struct mrb_state *mrb, struct mrb_context *c);
+void mrb_context_cache_clear(struct mrb_state *mrb);
 
 #ifndef MRB_GC_ARENA_SIZE
 #define MRB_GC_ARENA_SIZE 100
@@ -31,6 +37,25 @@ typedef enum {
   MRB_GC_STATE_SWEEP
 } mrb_gc_state;
 
+/* object color bit tested by the write-barrier fast path in mruby.h;
+   must match GC_BLACK in src/gc.c */
+#define MRB_GC_COLOR_BLACK (1 << 2)
+
+/* size-class segregated slabs for small GC-owned buffers (khash
+   tables, environment stacks); chunk sizes are powers of two between
+   1<<MRB_SLAB_MIN_SHIFT and 1<<MRB_SLAB_MAX_SHIFT bytes, larger
+   requests fall through to mrb_malloc (see mrb_slab_alloc in gc.c) */
+#define MRB_SLAB_MIN_SHIFT 4
+#define MRB_SLAB_MAX_SHIFT 9
+#define MRB_SLAB_CLASSES (MRB_SLAB_MAX_SHIFT - MRB_SLAB_MIN_SHIFT + 1)
+
+typedef struct mrb_slab_page {
+  union {
+    struct mrb_slab_page *next;
+    double align_;              /* chunks must hold doubles */
+  } h;
+} mrb_slab_page;
+
 typedef struct mrb_heap_page {
   struct RBasic *freelist;
   struct mrb_heap_page *prev;
@@ -41,10 +66,63 @@ typedef struct mrb_heap_page {
   void *objects[];
 } mrb_heap_page;
 
+/* sampled allocation tracing; one record per sampled mrb_obj_alloc
+   (see ObjectSpace.trace_allocations_start in mruby-objectspace) */
+typedef struct mrb_alloc_trace_rec {
+  mrb_sym cname;              /* class name at allocation, 0 if anonymous */
+  mrb_sym mid;                /* method active at the allocation, 0 at toplevel */
+  uint8_t tt;                 /* type tag of the allocated object */
+} mrb_alloc_trace_rec;
+
+typedef struct mrb_alloc_trace {
+  uint32_t interval;          /* record 1 in `interval` allocations */
+  uint32_t countdown;
+  mrb_alloc_trace_rec *samples;  /* ring buffer; newest overwrites oldest */
+  size_t capacity;
+  size_t head;
+  size_t count;
+} mrb_alloc_trace;
+
+MRB_API void mrb_alloc_trace_start(struct mrb_state*, int32_t interval, int32_t capacity);
+MRB_API void mrb_alloc_trace_stop(struct mrb_state*);
+
+/* per-class live object and byte accounting (see
+   ObjectSpace.count_objects_size in mruby-objectspace); counters move
+   at allocation and are rebuilt with freshly measured buffer sizes by
+   every completed full collection, so queries never walk the heap */
+typedef void (mrb_census_callback)(struct mrb_state*, struct RClass *cls, mrb_int count, mrb_int bytes, void *data);
+MRB_API void mrb_census_start(struct mrb_state*);
+MRB_API void mrb_census_stop(struct mrb_state*);
+MRB_API void mrb_census_each(struct mrb_state*, mrb_census_callback*, void *data);
+
+#ifndef MRB_DISABLE_STDIO
+#include <stdio.h>
+/* writes one JSON line per live object (address, type tag, class,
+   size including auxiliary buffers, outgoing references) preceded by
+   a roots record; GC.dump_heap(path) wraps this from Ruby and
+   tools/heap_graph.rb turns the output into retention graphs */
+MRB_API void mrb_heap_dump(struct mrb_state*, FILE*);
+#endif
+
+/* collector telemetry, readable through mrb->gc.stats from C and
+   GC.stat from Ruby; counters accumulate from mrb_open */
+typedef struct mrb_gc_stats {
+  uint32_t minor_count;       /* completed minor collections */
+  uint32_t major_count;       /* completed major/full collections */
+  uint32_t step_count;        /* incremental steps executed */
+  double mark_time;           /* cumulative seconds in mark steps */
+  double sweep_time;          /* cumulative seconds in sweep steps */
+  double max_pause;           /* longest single collector invocation */
+  size_t promoted;            /* objects aged old by minor collections */
+  size_t total_allocated;     /* objects allocated over the state's life */
+  int arena_peak;             /* GC arena high-water mark */
+} mrb_gc_stats;
+
 typedef struct mrb_gc {
   mrb_heap_page *heaps;                /* heaps for GC */
   mrb_heap_page *sweeps;
   mrb_heap_page *free_heaps;
+  mrb_heap_page *free_heaps_tail;
   size_t live; /* count of live objects */
 #ifdef MRB_GC_FIXED_ARENA
   struct RBasic *arena[MRB_GC_ARENA_SIZE]; /* GC protection array */
@@ -66,9 +144,55 @@ typedef struct mrb_gc {
   mrb_bool full          :1;
   mrb_bool generational  :1;
   mrb_bool out_of_memory :1;
+  mrb_bool autotune      :1;
   size_t majorgc_old_threshold;
+
+  /* allocation-rate feedback (mrb_gc_autotune): step_ratio and the
+     major-GC ratio are retuned after each cycle within these bounds */
+  int step_ratio_min;
+  int step_ratio_max;
+  int majorgc_inc_ratio;
+  size_t live_at_cycle_start;
+  size_t tune_prev_promoted;
+
+  mrb_slab_page *slab_pages;
+  void *slab_freelist[MRB_SLAB_CLASSES];
+
+  mrb_gc_stats stats;
+  mrb_alloc_trace *alloc_trace; /* allocation tracing, NULL unless started */
+
+  struct kh_census *census;      /* per-class live counters, NULL unless started */
+  struct kh_census *census_next; /* rebuild target while a full sweep runs */
+
+  mrb_value **weak_slots;       /* registered weak reference cells */
+  size_t weak_count;
+  size_t weak_capa;
+
+  /* pause-budget pacing: when max_pause_us is non-zero, incremental
+     steps are driven by wall time instead of step_ratio and an
+     overrunning slice is charged against the next one (pause_debt) */
+  uint32_t max_pause_us;
+  double pause_debt;
 } mrb_gc;
 
+MRB_API void mrb_gc_set_max_pause(struct mrb_state*, int32_t us);
+
+/* enables or disables the allocation-rate feedback controller; pass 0
+   for either bound to keep its current value */
+MRB_API void mrb_gc_autotune(struct mrb_state*, mrb_bool enable, int step_ratio_min, int step_ratio_max);
+
+/* weak reference cells; a registered cell does not keep the object it
+   holds alive and is set to nil by the collector once that object is
+   about to be swept. The cell's address must stay valid until it is
+   unregistered. */
+MRB_API void mrb_gc_register_weak(struct mrb_state*, mrb_value *cell);
+MRB_API void mrb_gc_unregister_weak(struct mrb_state*, mrb_value *cell);
+
+/* sized small-object allocator; the same size must be passed to
+   mrb_slab_free that was passed to mrb_slab_alloc */
+void *mrb_slab_alloc(struct mrb_state*, size_t);
+void mrb_slab_free(struct mrb_state*, void*, size_t);
+
 MRB_API mrb_bool
 mrb_object_dead_p(struct mrb_state *mrb, struct RBasic *object);
 
@@ -31,6 +31,13 @@ MRB_API mrb_value mrb_hash_new_capa(mrb_state*, int);
  */
 MRB_API mrb_value mrb_hash_new(mrb_state *mrb);
 
+/*
+ * Initializes a new hash from a flat key/value array: vals[0] => vals[1],
+ * vals[2] => vals[3], ...  The table is sized for argc/2 pairs up front
+ * so the build never rehashes.
+ */
+MRB_API mrb_value mrb_hash_new_from_values(mrb_state *mrb, mrb_int argc, const mrb_value *vals);
+
 /*
  * Sets a keys and values to hashes.
  */
@@ -60,14 +67,17 @@ MRB_API mrb_value mrb_hash_empty_p(mrb_state *mrb, mrb_value self);
  */
 MRB_API mrb_value mrb_hash_clear(mrb_state *mrb, mrb_value hash);
 
-/* declaration of struct kh_ht */
-/* be careful when you touch the internal */
-typedef struct {
-  mrb_value v;
-  mrb_int n;
-} mrb_hash_value;
+/*
+ * Merges two hashes in one pass: every pair of hash2 is inserted into
+ * hash1, values of hash2 winning on duplicate keys.  The destination is
+ * presized for the combined pair count, so no insert rehashes.
+ */
+MRB_API void mrb_hash_merge(mrb_state *mrb, mrb_value hash1, mrb_value hash2);
 
-KHASH_DECLARE(ht, mrb_value, mrb_hash_value, TRUE)
+/* declaration of struct kh_ht: the key index of a hash, mapping each
+   key to its offset in the dense entries array (see src/hash.c) */
+/* be careful when you touch the internal */
+KHASH_DECLARE(ht, mrb_value, mrb_int, TRUE)
 
 /* RHASH_TBL allocates st_table if not available. */
 #define RHASH(obj)   ((struct RHash*)(mrb_ptr(obj)))
@@ -78,12 +88,31 @@ MRB_API struct kh_ht * mrb_hash_tbl(mrb_state *mrb, mrb_value hash);
 
 #define MRB_HASH_DEFAULT      1
 #define MRB_HASH_PROC_DEFAULT 2
+/* the ht field holds a flat small table, not a khash (see src/hash.c) */
+#define MRB_HASH_SMALL        4
+/* set while every key is a symbol (the common options-hash shape);
+   cleared for good when a non-symbol key is inserted */
+#define MRB_HASH_ALL_SYM      8
 #define MRB_RHASH_DEFAULT_P(h) (RHASH(h)->flags & MRB_HASH_DEFAULT)
 #define MRB_RHASH_PROCDEFAULT_P(h) (RHASH(h)->flags & MRB_HASH_PROC_DEFAULT)
+#define MRB_RHASH_SMALL_P(h) (RHASH(h)->flags & MRB_HASH_SMALL)
+#define MRB_RHASH_ALL_SYM_P(h) (RHASH(h)->flags & MRB_HASH_ALL_SYM)
+
+/* single-lookup access to the value slot of an existing key, for the
+   in-place index-update fast path (OP_UPDIDX in vm.c); NULL when the
+   key is absent, and only immediates may be stored through it */
+mrb_value *mrb_hash_value_slot(mrb_state*, mrb_value hash, mrb_value key);
+
+/* method body behind Hash#merge! and Hash#update, registered by
+   mruby-hash-ext; takes the other hash and an optional conflict block */
+mrb_value mrb_hash_update_m(mrb_state*, mrb_value self);
 
 /* GC functions */
 void mrb_gc_mark_hash(mrb_state*, struct RHash*);
+typedef int (mrb_hash_foreach_func)(mrb_state *mrb, mrb_value key, mrb_value val, void *data);
+MRB_API void mrb_hash_foreach(mrb_state*, struct RHash*, mrb_hash_foreach_func*, void*);
 size_t mrb_gc_mark_hash_size(mrb_state*, struct RHash*);
+size_t mrb_gc_hash_memsize(mrb_state*, struct RHash*);
 void mrb_gc_free_hash(mrb_state*, struct RHash*);
 
 MRB_END_DECL
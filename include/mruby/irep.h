@@ -26,18 +26,87 @@ struct mrb_locals {
   uint16_t r;
 };
 
+/* Per-call-site method cache entry (runtime only, never serialized).
+   An entry is valid while its generation matches mrb->cache_gen. */
+typedef struct mrb_callsite_cache {
+  struct RClass *c;             /* receiver class at fill time */
+  struct RClass *tc;            /* class the method was found in */
+  struct RProc *m;              /* cached method */
+  uint32_t gen;                 /* mrb->cache_gen at fill time */
+} mrb_callsite_cache;
+
+/* Per-site constant cache entry (runtime only, never serialized).
+   `key` is the proc for OP_GETCONST (lexical scope identity) or the
+   receiver class for OP_GETMCNST; an entry is valid while its
+   generation matches mrb->const_gen, which is bumped on every
+   constant table modification. */
+typedef struct mrb_constsite_cache {
+  mrb_value v;                  /* cached constant value */
+  void *key;                    /* proc or receiver class at fill time */
+  uint32_t gen;                 /* mrb->cache_gen at fill time */
+} mrb_constsite_cache;
+
+/* Per-site instance variable cache entry (runtime only, never
+   serialized).  Ivar shapes (see variable.c) are interned and
+   immutable, so no generation is needed: matching the table's shape
+   pointer proves the cached slot is still right. */
+#define MRB_IVCACHE_NONE UINT32_MAX
+typedef struct mrb_ivsite_cache {
+  struct iv_shape *shape;       /* ivar table shape at fill time */
+  struct iv_shape *tshape;      /* shape after a transitioning set, else NULL */
+  uint32_t slot;                /* slot, or MRB_IVCACHE_NONE for a cached miss */
+} mrb_ivsite_cache;
+
+/* per-binary symbol table resolved once at load time (SYMT section);
+   shared by every lazily loaded irep of the tree (see load.c) */
+struct mrb_irep_symtab {
+  mrb_sym *syms;
+  uint32_t len;
+  uint32_t refcnt;
+};
+
 /* Program data array struct */
 typedef struct mrb_irep {
   uint16_t nlocals;        /* Number of local variables */
   uint16_t nregs;          /* Number of register variables */
+  /* leading frame slots a closure over this irep can reach, i.e. one
+     past the highest local any descendant block reads or writes
+     through the env chain; 0 until computed (see mrb_irep_env_len) */
+  uint16_t clen;
   uint8_t flags;
 
   mrb_code *iseq;
   mrb_value *pool;
   mrb_sym *syms;
   struct mrb_irep **reps;
+  /* positions of child irep records not yet read from a lazily loaded
+     static binary; entry i is consumed when reps[i] is read (load.c) */
+  const uint8_t **lazy_reps;
+  uint8_t lazy_flags;
+  /* held while lazy children still need their symbol indices resolved */
+  struct mrb_irep_symtab *symtab;
+  /* unread debug record of a statically loaded binary, decoded on first
+     use (see mrb_debug_info_materialize in load.c) */
+  const uint8_t *lazy_debug;
+  /* the debug section's filename table, shared by the whole tree */
+  struct mrb_irep_symtab *debug_files;
 
   struct mrb_locals *lv;
+  /* inline method caches, one per instruction; allocated lazily on
+     first execution (see OP_SEND in vm.c) */
+  mrb_callsite_cache *ccache;
+  /* constant caches, one per instruction; allocated lazily on first
+     execution of OP_GETCONST/OP_GETMCNST (see vm.c) */
+  mrb_constsite_cache *kcache;
+  /* deduplicated frozen literals, one per instruction; created on first
+     execution of OP_FROZSTR and rooted for the life of the state */
+  mrb_value *lcache;
+  /* ivar shape caches, one per instruction; allocated lazily on first
+     execution of OP_GETIV/OP_SETIV (see vm.c) */
+  mrb_ivsite_cache *icache;
+  /* invocation counter and compiled code, owned by the JIT backend
+     (see mrb_jit_hooks in mruby.h) */
+  void *jit;
   /* debug info */
   const char *filename;
   uint16_t *lines;
@@ -47,10 +116,34 @@ typedef struct mrb_irep {
 } mrb_irep;
 
 #define MRB_ISEQ_NO_FREE 1
+/* trivial leaf body, executable without a frame (analyzed lazily in the
+   VM; see leaf_irep_p in vm.c) */
+#define MRB_IREP_LEAF_CHECKED 2
+#define MRB_IREP_LEAF 4
+/* irep linked into the executable (mrbc -R); never freed, only its
+   per-state runtime caches are released */
+#define MRB_IREP_STATIC 8
 
 MRB_API mrb_irep *mrb_add_irep(mrb_state *mrb);
+/* env capture width for closures over this irep's frame (vm.c) */
+int mrb_irep_env_len(mrb_state *mrb, mrb_irep *irep);
 MRB_API mrb_value mrb_load_irep(mrb_state*, const uint8_t*);
 MRB_API mrb_value mrb_load_irep_cxt(mrb_state*, const uint8_t*, mrbc_context*);
+/* as mrb_load_irep, for binaries that outlive the mrb_state */
+MRB_API mrb_value mrb_load_irep_static(mrb_state*, const uint8_t*);
+/* as mrb_load_irep, for embedder-verified binaries; skips the CRC pass */
+MRB_API mrb_value mrb_load_irep_trusted(mrb_state*, const uint8_t*);
+/* runs an irep image read once with mrb_read_irep_static in another
+   state; requires MRB_USE_SHARED_SYMBOLS (see load.c) */
+MRB_API mrb_value mrb_load_irep_shared(mrb_state*, struct mrb_irep*);
+/* runs an irep linked into the executable by mrbc -R; pass the result
+   of the generated entry point */
+MRB_API mrb_value mrb_load_irep_struct(mrb_state*, struct mrb_irep*);
+
+/* reads the lazily noted child record i of a statically loaded irep;
+   call when reps[i] is NULL (see load.c) */
+mrb_irep *mrb_irep_read_rep(mrb_state*, mrb_irep*, size_t);
+void mrb_irep_symtab_decref(mrb_state*, struct mrb_irep_symtab*);
 void mrb_irep_free(mrb_state*, struct mrb_irep*);
 void mrb_irep_incref(mrb_state*, struct mrb_irep*);
 void mrb_irep_decref(mrb_state*, struct mrb_irep*);
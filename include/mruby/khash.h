@@ -27,17 +27,71 @@ typedef khint_t khiter_t;
 
 #define UPPER_BOUND(x) ((x)>>2|(x)>>1)
 
-/* extern uint8_t __m[]; */
+/* One metadata byte per bucket, swiss-table style: 0x80 marks an empty
+   bucket, 0xff a deleted one, and a full bucket stores the top 7 bits
+   of the mixed hash.  A group of 8 buckets is sieved with a single
+   word load before any key is compared, so probing touches one or two
+   cache lines instead of scattering like the old secondary probing. */
+#define KH_META_EMPTY 0x80
+#define KH_META_DEL   0xff
+#define KH_GROUP 8
 
-/* mask for flags */
-static const uint8_t __m_empty[]  = {0x02, 0x08, 0x20, 0x80};
-static const uint8_t __m_del[]    = {0x01, 0x04, 0x10, 0x40};
-static const uint8_t __m_either[] = {0x03, 0x0c, 0x30, 0xc0};
+#define __ac_isempty(ed_flag, i) ((ed_flag)[i] == KH_META_EMPTY)
+#define __ac_isdel(ed_flag, i) ((ed_flag)[i] == KH_META_DEL)
+#define __ac_iseither(ed_flag, i) ((ed_flag)[i] & 0x80)
 
+/* khash key hashes (small symbol numbers in particular) can be weak in
+   the bits the bucket group and the metadata byte are carved from, so
+   mix them first; this is the murmur3 finalizer less one round */
+static inline khint_t
+kh_mix32(khint_t h)
+{
+  h ^= h >> 16;
+  h *= 0x85ebca6bU;
+  h ^= h >> 13;
+  return h;
+}
+
+#define kh_rep8(x) ((uint64_t)(x) * 0x0101010101010101ULL)
+#define kh_meta_h2(hv) ((uint8_t)(((hv) >> 25) & 0x7f))
+
+/* one bit (the 0x80 of the lane) set for every metadata byte equal to
+   b; exact per lane, no cross-lane carries */
+static inline uint64_t
+kh_meta_match(uint64_t w, uint8_t b)
+{
+  uint64_t t = w ^ kh_rep8(b);
+  return ~((((t & kh_rep8(0x7f)) + kh_rep8(0x7f)) | t) | kh_rep8(0x7f));
+}
+
+/* lane index of the lowest match bit */
+#ifndef __has_builtin
+  #define __has_builtin(x) 0
+#endif
+#if (defined(__GNUC__) && __GNUC__ >= 4) || __has_builtin(__builtin_ctzll)
+# define kh_match_idx(m) ((khint_t)((unsigned)__builtin_ctzll(m) >> 3))
+#else
+static inline khint_t
+kh_match_idx(uint64_t m)
+{
+  khint_t i = 0;
+  while (!(m & 0xff)) { m >>= 8; i++; }
+  return i;
+}
+#endif
+/* Incremental rehash: a one-shot kh_resize of a very large table stalls
+   the put that triggers it for the full O(n) migration.  Tables that
+   opt in (h->incremental, set by the owner right after kh_init) instead
+   park the old bucket array when they grow past KH_INCREMENTAL_MIN
+   buckets and drain KH_MIGRATE_STEP old buckets per subsequent put;
+   lookups that miss the new array fall back to the old one and move
+   what they find, so returned iterators always index the live arrays.
+   Entries parked in the old array are invisible to kh_begin/kh_end
+   iteration until drained, so only tables that are never iterated
+   externally (including by the GC) may opt in. */
+#define KH_INCREMENTAL_MIN 4096
+#define KH_MIGRATE_STEP 16
 
-#define __ac_isempty(ed_flag, i) (ed_flag[(i)/4]&__m_empty[(i)%4])
-#define __ac_isdel(ed_flag, i) (ed_flag[(i)/4]&__m_del[(i)%4])
-#define __ac_iseither(ed_flag, i) (ed_flag[(i)/4]&__m_either[(i)%4])
 #define khash_power2(v) do { \
   v--;\
   v |= v >> 1;\
@@ -65,6 +119,17 @@ static const uint8_t __m_either[] = {0x03, 0x0c, 0x30, 0xc0};
     uint8_t *ed_flags;                                                  \
     khkey_t *keys;                                                      \
     khval_t *vals;                                                      \
+    /* incremental rehash: while old_n_buckets != 0 a retired bucket    \
+       array is still live and entries drain from it a few per          \
+       operation instead of all at once inside one put (opt-in via      \
+       the incremental flag; see the comment above KH_MIGRATE_STEP) */  \
+    uint8_t incremental;                                                \
+    khint_t old_n_buckets;                                              \
+    khint_t old_pending;                                                \
+    khint_t migrate_pos;                                                \
+    uint8_t *old_ed_flags;                                              \
+    khkey_t *old_keys;                                                  \
+    khval_t *old_vals;                                                  \
   } kh_##name##_t;                                                      \
   void kh_alloc_##name(mrb_state *mrb, kh_##name##_t *h);               \
   kh_##name##_t *kh_init_##name##_size(mrb_state *mrb, khint_t size);   \
@@ -99,15 +164,16 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
   {                                                                     \
     khint_t sz = h->n_buckets;                                          \
     size_t len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0);   \
-    uint8_t *p = (uint8_t*)mrb_malloc(mrb, sizeof(uint8_t)*sz/4+len*sz); \
+    uint8_t *p = (uint8_t*)mrb_slab_alloc(mrb, sizeof(uint8_t)*sz+len*sz); \
     h->size = h->n_occupied = 0;                                        \
     h->keys = (khkey_t *)p;                                             \
     h->vals = kh_is_map ? (khval_t *)(p+sizeof(khkey_t)*sz) : NULL;     \
     h->ed_flags = p+len*sz;                                             \
-    kh_fill_flags(h->ed_flags, 0xaa, sz/4);                             \
+    kh_fill_flags(h->ed_flags, KH_META_EMPTY, sz);                      \
   }                                                                     \
   kh_##name##_t *kh_init_##name##_size(mrb_state *mrb, khint_t size) {  \
-    kh_##name##_t *h = (kh_##name##_t*)mrb_calloc(mrb, 1, sizeof(kh_##name##_t)); \
+    kh_##name##_t *h = (kh_##name##_t*)mrb_slab_alloc(mrb, sizeof(kh_##name##_t)); \
+    memset(h, 0, sizeof(kh_##name##_t));                                \
     if (size < KHASH_MIN_SIZE)                                          \
       size = KHASH_MIN_SIZE;                                            \
     khash_power2(size);                                                 \
@@ -118,38 +184,177 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
   kh_##name##_t *kh_init_##name(mrb_state *mrb) {                       \
     return kh_init_##name##_size(mrb, KHASH_DEFAULT_SIZE);              \
   }                                                                     \
+  static void kh_free_old_##name(mrb_state *mrb, kh_##name##_t *h)      \
+  {                                                                     \
+    khint_t sz = h->old_n_buckets;                                      \
+    size_t len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0);   \
+    mrb_slab_free(mrb, h->old_keys, sizeof(uint8_t)*sz+len*sz);         \
+    h->old_n_buckets = h->old_pending = h->migrate_pos = 0;             \
+    h->old_ed_flags = NULL;                                             \
+    h->old_keys = NULL;                                                 \
+    h->old_vals = NULL;                                                 \
+  }                                                                     \
   void kh_destroy_##name(mrb_state *mrb, kh_##name##_t *h)              \
   {                                                                     \
     if (h) {                                                            \
-      mrb_free(mrb, h->keys);                                           \
-      mrb_free(mrb, h);                                                 \
+      khint_t sz = h->n_buckets;                                        \
+      size_t len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0); \
+      if (h->old_n_buckets) kh_free_old_##name(mrb, h);                 \
+      mrb_slab_free(mrb, h->keys, sizeof(uint8_t)*sz+len*sz);           \
+      mrb_slab_free(mrb, h, sizeof(kh_##name##_t));                     \
     }                                                                   \
   }                                                                     \
   void kh_clear_##name(mrb_state *mrb, kh_##name##_t *h)                \
   {                                                                     \
     (void)mrb;                                                          \
     if (h && h->ed_flags) {                                             \
-      kh_fill_flags(h->ed_flags, 0xaa, h->n_buckets/4);                 \
+      if (h->old_n_buckets) kh_free_old_##name(mrb, h);                 \
+      kh_fill_flags(h->ed_flags, KH_META_EMPTY, h->n_buckets);          \
       h->size = h->n_occupied = 0;                                      \
     }                                                                   \
   }                                                                     \
+  /* probe the current bucket arrays only; no resize check and no       \
+     consultation of a parked old array */                              \
+  static khint_t kh_put_simple_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key, int *ret) \
+  {                                                                     \
+    khint_t hv, g, del_k;                                               \
+    uint8_t h2;                                                         \
+    hv = kh_mix32((khint_t)__hash_func(mrb,key));                       \
+    h2 = kh_meta_h2(hv);                                                \
+    g = hv & khash_mask(h) & ~(khint_t)(KH_GROUP-1);                    \
+    del_k = kh_end(h);                                                  \
+    for (;;) {                                                          \
+      uint64_t w, m;                                                    \
+      memcpy(&w, h->ed_flags+g, KH_GROUP);                              \
+      m = kh_meta_match(w, h2);                                         \
+      while (m) {                                                       \
+        khint_t k = g + kh_match_idx(m);                                \
+        if (__hash_equal(mrb,h->keys[k], key)) {                        \
+          if (ret) *ret = 0;                                            \
+          return k;                                                     \
+        }                                                               \
+        m &= m-1;                                                       \
+      }                                                                 \
+      if (del_k == kh_end(h)) {                                         \
+        m = kh_meta_match(w, KH_META_DEL);                               \
+        if (m) del_k = g + kh_match_idx(m);                             \
+      }                                                                 \
+      m = kh_meta_match(w, KH_META_EMPTY);                              \
+      if (m) {                                                          \
+        khint_t k;                                                      \
+        if (del_k != kh_end(h)) {                                       \
+          /* put at del */                                              \
+          k = del_k;                                                    \
+          h->keys[k] = key;                                             \
+          h->ed_flags[k] = h2;                                          \
+          h->size++;                                                    \
+          if (ret) *ret = 2;                                            \
+        }                                                               \
+        else {                                                          \
+          /* put at empty */                                            \
+          k = g + kh_match_idx(m);                                      \
+          h->keys[k] = key;                                             \
+          h->ed_flags[k] = h2;                                          \
+          h->size++;                                                    \
+          h->n_occupied++;                                              \
+          if (ret) *ret = 1;                                            \
+        }                                                               \
+        return k;                                                       \
+      }                                                                 \
+      g = (g + KH_GROUP) & khash_mask(h);                               \
+    }                                                                   \
+  }                                                                     \
+  /* probe the parked old arrays; returns old_n_buckets on miss */      \
+  static khint_t kh_getold_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key) \
+  {                                                                     \
+    khint_t mask = h->old_n_buckets-1;                                  \
+    khint_t hv = kh_mix32((khint_t)__hash_func(mrb,key));               \
+    uint8_t h2 = kh_meta_h2(hv);                                        \
+    khint_t g = hv & mask & ~(khint_t)(KH_GROUP-1);                     \
+    for (;;) {                                                          \
+      uint64_t w, m;                                                    \
+      memcpy(&w, h->old_ed_flags+g, KH_GROUP);                          \
+      m = kh_meta_match(w, h2);                                         \
+      while (m) {                                                       \
+        khint_t k = g + kh_match_idx(m);                                \
+        if (__hash_equal(mrb,h->old_keys[k], key)) return k;            \
+        m &= m-1;                                                       \
+      }                                                                 \
+      if (kh_meta_match(w, KH_META_EMPTY)) return h->old_n_buckets;     \
+      g = (g + KH_GROUP) & mask;                                        \
+    }                                                                   \
+  }                                                                     \
+  /* move one found old entry into the current arrays so the returned   \
+     iterator indexes live storage */                                   \
+  static khint_t kh_moveold_##name(mrb_state *mrb, kh_##name##_t *h, khint_t i) \
+  {                                                                     \
+    khint_t k = kh_put_simple_##name(mrb, h, h->old_keys[i], NULL);     \
+    if (kh_is_map) h->vals[k] = h->old_vals[i];                         \
+    h->old_ed_flags[i] = KH_META_DEL;                                   \
+    h->size--;     /* the move is not a fresh insert */                 \
+    if (--h->old_pending == 0) kh_free_old_##name(mrb, h);              \
+    return k;                                                           \
+  }                                                                     \
+  static void kh_migrate_##name(mrb_state *mrb, kh_##name##_t *h, khint_t limit) \
+  {                                                                     \
+    while (h->old_n_buckets && limit-- > 0) {                           \
+      khint_t i = h->migrate_pos;                                       \
+      if (!__ac_iseither(h->old_ed_flags, i)) {                         \
+        kh_moveold_##name(mrb, h, i);                                   \
+        if (!h->old_n_buckets) break;                                   \
+      }                                                                 \
+      if (++h->migrate_pos >= h->old_n_buckets) {                       \
+        kh_free_old_##name(mrb, h);                                     \
+      }                                                                 \
+    }                                                                   \
+  }                                                                     \
   khint_t kh_get_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key)  \
   {                                                                     \
-    khint_t k = __hash_func(mrb,key) & khash_mask(h), step = 0;         \
+    khint_t hv = kh_mix32((khint_t)__hash_func(mrb,key));               \
+    uint8_t h2 = kh_meta_h2(hv);                                        \
+    khint_t g = hv & khash_mask(h) & ~(khint_t)(KH_GROUP-1);            \
     (void)mrb;                                                          \
-    while (!__ac_isempty(h->ed_flags, k)) {                             \
-      if (!__ac_isdel(h->ed_flags, k)) {                                \
+    for (;;) {                                                          \
+      uint64_t w, m;                                                    \
+      memcpy(&w, h->ed_flags+g, KH_GROUP);                              \
+      m = kh_meta_match(w, h2);                                         \
+      while (m) {                                                       \
+        khint_t k = g + kh_match_idx(m);                                \
         if (__hash_equal(mrb,h->keys[k], key)) return k;                \
+        m &= m-1;                                                       \
+      }                                                                 \
+      if (kh_meta_match(w, KH_META_EMPTY)) break;                       \
+      g = (g + KH_GROUP) & khash_mask(h);                               \
+    }                                                                   \
+    if (h->old_n_buckets) {                                             \
+      khint_t i = kh_getold_##name(mrb, h, key);                        \
+      if (i != h->old_n_buckets) {                                      \
+        return kh_moveold_##name(mrb, h, i);                            \
       }                                                                 \
-      k = (k+(++step)) & khash_mask(h);                                 \
     }                                                                   \
     return kh_end(h);                                                   \
   }                                                                     \
   void kh_resize_##name(mrb_state *mrb, kh_##name##_t *h, khint_t new_n_buckets) \
   {                                                                     \
+    if (h->old_n_buckets) kh_migrate_##name(mrb, h, ~(khint_t)0);       \
     if (new_n_buckets < KHASH_MIN_SIZE)                                 \
       new_n_buckets = KHASH_MIN_SIZE;                                   \
     khash_power2(new_n_buckets);                                        \
+    if (h->incremental && new_n_buckets > h->n_buckets &&               \
+        h->n_buckets >= KH_INCREMENTAL_MIN) {                           \
+      /* park the current arrays; later operations drain them */        \
+      h->old_n_buckets = h->n_buckets;                                  \
+      h->old_pending = h->size;                                         \
+      h->migrate_pos = 0;                                               \
+      h->old_ed_flags = h->ed_flags;                                    \
+      h->old_keys = h->keys;                                            \
+      h->old_vals = h->vals;                                            \
+      h->n_buckets = new_n_buckets;                                     \
+      kh_alloc_##name(mrb, h);                                          \
+      h->size = h->old_pending;                                         \
+      if (h->old_pending == 0) kh_free_old_##name(mrb, h);              \
+      return;                                                           \
+    }                                                                   \
     {                                                                   \
       kh_##name##_t hh;                                                 \
       uint8_t *old_ed_flags = h->ed_flags;                              \
@@ -157,63 +362,54 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
       khval_t *old_vals = h->vals;                                      \
       khint_t old_n_buckets = h->n_buckets;                             \
       khint_t i;                                                        \
+      memset(&hh, 0, sizeof(hh));                                       \
+      hh.incremental = h->incremental;                                  \
       hh.n_buckets = new_n_buckets;                                     \
       kh_alloc_##name(mrb, &hh);                                        \
       /* relocate */                                                    \
       for (i=0 ; i<old_n_buckets ; i++) {                               \
         if (!__ac_iseither(old_ed_flags, i)) {                          \
-          khint_t k = kh_put_##name(mrb, &hh, old_keys[i], NULL);       \
+          khint_t k = kh_put_simple_##name(mrb, &hh, old_keys[i], NULL); \
           if (kh_is_map) kh_value(&hh,k) = old_vals[i];                 \
         }                                                               \
       }                                                                 \
       /* copy hh to h */                                                \
       *h = hh;                                                          \
-      mrb_free(mrb, old_keys);                                          \
+      {                                                                 \
+        size_t len = sizeof(khkey_t) + (kh_is_map ? sizeof(khval_t) : 0); \
+        mrb_slab_free(mrb, old_keys, sizeof(uint8_t)*old_n_buckets+len*old_n_buckets); \
+      }                                                                 \
     }                                                                   \
   }                                                                     \
   khint_t kh_put_##name(mrb_state *mrb, kh_##name##_t *h, khkey_t key, int *ret) \
   {                                                                     \
-    khint_t k, del_k, step = 0;                                         \
+    if (h->old_n_buckets) {                                             \
+      kh_migrate_##name(mrb, h, KH_MIGRATE_STEP);                       \
+      /* never let the live array fill up while old entries are still   \
+         pending: draining inserts must always find an empty bucket */  \
+      if (h->old_n_buckets &&                                           \
+          h->n_occupied + h->old_pending + 1 >= khash_upper_bound(h)) { \
+        kh_migrate_##name(mrb, h, ~(khint_t)0);                         \
+      }                                                                 \
+    }                                                                   \
     if (h->n_occupied >= khash_upper_bound(h)) {                        \
       kh_resize_##name(mrb, h, h->n_buckets*2);                         \
     }                                                                   \
-    k = __hash_func(mrb,key) & khash_mask(h);                           \
-    del_k = kh_end(h);                                                  \
-    while (!__ac_isempty(h->ed_flags, k)) {                             \
-      if (!__ac_isdel(h->ed_flags, k)) {                                \
-        if (__hash_equal(mrb,h->keys[k], key)) {                        \
-          if (ret) *ret = 0;                                            \
-          return k;                                                     \
-        }                                                               \
+    if (h->old_n_buckets) {                                             \
+      khint_t i = kh_getold_##name(mrb, h, key);                        \
+      if (i != h->old_n_buckets) {                                      \
+        khint_t k = kh_moveold_##name(mrb, h, i);                       \
+        if (ret) *ret = 0;                                              \
+        return k;                                                       \
       }                                                                 \
-      else if (del_k == kh_end(h)) {                                    \
-        del_k = k;                                                      \
-      }                                                                 \
-      k = (k+(++step)) & khash_mask(h);                                 \
-    }                                                                   \
-    if (del_k != kh_end(h)) {                                           \
-      /* put at del */                                                  \
-      h->keys[del_k] = key;                                             \
-      h->ed_flags[del_k/4] &= ~__m_del[del_k%4];                        \
-      h->size++;                                                        \
-      if (ret) *ret = 2;                                                \
-      return del_k;                                                     \
-    }                                                                   \
-    else {                                                              \
-      /* put at empty */                                                \
-      h->keys[k] = key;                                                 \
-      h->ed_flags[k/4] &= ~__m_empty[k%4];                              \
-      h->size++;                                                        \
-      h->n_occupied++;                                                  \
-      if (ret) *ret = 1;                                                \
-      return k;                                                         \
     }                                                                   \
+    return kh_put_simple_##name(mrb, h, key, ret);                      \
   }                                                                     \
   void kh_del_##name(mrb_state *mrb, kh_##name##_t *h, khint_t x)       \
   {                                                                     \
     (void)mrb;                                                          \
     mrb_assert(x != h->n_buckets && !__ac_iseither(h->ed_flags, x));    \
-    h->ed_flags[x/4] |= __m_del[x%4];                                   \
+    h->ed_flags[x] = KH_META_DEL;                                       \
     h->size--;                                                          \
   }                                                                     \
   kh_##name##_t *kh_copy_##name(mrb_state *mrb, kh_##name##_t *h)       \
@@ -221,6 +417,7 @@ kh_fill_flags(uint8_t *p, uint8_t c, size_t len)
     kh_##name##_t *h2;                                                  \
     khiter_t k, k2;                                                     \
                                                                         \
+    if (h->old_n_buckets) kh_migrate_##name(mrb, h, ~(khint_t)0);       \
     h2 = kh_init_##name(mrb);                                           \
     for (k = kh_begin(h); k != kh_end(h); k++) {                        \
       if (kh_exist(h, k)) {                                             \
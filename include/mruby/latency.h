@@ -0,0 +1,84 @@
+/*
+** mruby/latency.h - latency histograms around VM entry points
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_LATENCY_H
+#define MRUBY_LATENCY_H
+
+#include "common.h"
+
+/**
+ * Percentile latency recording for Ruby entered from C.
+ *
+ * While recording is started, every mrb_funcall_with_block dispatch and
+ * every outermost mrb_vm_run records its wall-clock duration into a
+ * log-bucketed histogram of fixed size, one histogram per entry symbol
+ * (0 stands for toplevel runs).  Because the measurement sits inside
+ * the VM boundary it includes GC pauses taken during the call, which
+ * wrappers around the public API cannot see.  Calls unwound by an
+ * exception are not recorded.
+ */
+MRB_BEGIN_DECL
+
+/* sub-bucket resolution: each power-of-two octave splits into
+   1 << MRB_LATENCY_SUB_BITS buckets, bounding the quantization error
+   of a recorded value to about 12% */
+#define MRB_LATENCY_SUB_BITS 3
+
+/* durations at or above 2^(MRB_LATENCY_MAX_OCTAVE+1) nanoseconds
+   (about 4.8 hours) land in the last bucket */
+#define MRB_LATENCY_MAX_OCTAVE 43
+
+#define MRB_LATENCY_BUCKETS \
+  (((MRB_LATENCY_MAX_OCTAVE - MRB_LATENCY_SUB_BITS + 1) << MRB_LATENCY_SUB_BITS) \
+   + (1 << MRB_LATENCY_SUB_BITS))
+
+typedef struct mrb_latency_hist {
+  uint64_t count;
+  uint64_t total;               /* sum of recorded durations, ns */
+  uint64_t min;                 /* exact, not bucketed */
+  uint64_t max;
+  uint32_t buckets[MRB_LATENCY_BUCKETS];
+} mrb_latency_hist;
+
+typedef struct mrb_latency {
+  struct kh_lat *tbl;           /* entry symbol => mrb_latency_hist* */
+} mrb_latency;
+
+/*
+ * start recording; histograms are created lazily per entry symbol
+ */
+MRB_API void mrb_latency_start(mrb_state *mrb);
+
+/*
+ * stop recording and release all histograms
+ */
+MRB_API void mrb_latency_stop(mrb_state *mrb);
+
+/*
+ * snapshot: invoke `cb` once per entry symbol with its histogram; the
+ * pointer is only valid during the call (reset or stop invalidate it)
+ */
+typedef void (mrb_latency_callback)(mrb_state *mrb, mrb_sym mid, const mrb_latency_hist *hist, void *data);
+MRB_API void mrb_latency_each(mrb_state *mrb, mrb_latency_callback *cb, void *data);
+
+/*
+ * zero all histograms, keeping their allocations
+ */
+MRB_API void mrb_latency_reset(mrb_state *mrb);
+
+/*
+ * read the given percentile (0 < pct <= 100) out of a histogram, in
+ * nanoseconds; returns the bucket midpoint, 0 for an empty histogram
+ */
+MRB_API uint64_t mrb_latency_percentile(const mrb_latency_hist *hist, double pct);
+
+/* internal: callers check mrb->lat first */
+uint64_t mrb_latency_now(void);
+void mrb_latency_record(mrb_state *mrb, mrb_sym mid, uint64_t ns);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_LATENCY_H */
@@ -140,11 +140,49 @@ enum {
   OP_STOP,/*              stop VM                                         */
   OP_ERR,/*       Bx      raise RuntimeError with message Lit(Bx)         */
 
-  OP_RSVD1,/*             reserved instruction #1                         */
+  OP_SENDC,/*     A B C   R(A) := call(R(A),Syms(B),R(A+1),...,R(A+C))
+                          quickened OP_SEND resolved to a C function     */
+
+  /* fused superinstructions; the original second instruction is kept in
+     the iseq (so it stays a valid jump target) and executed without an
+     extra dispatch */
+  OP_SELFSEND,/*  A       R(A) := self; then the following OP_SEND       */
+  OP_MOVESEND,/*  A B     R(A) := R(B); then the following OP_SEND       */
+  OP_IVSEND,/*    A Bx    R(A) := ivget(Bx); then the following OP_SEND  */
+
+  OP_FROZSTR,/*   A Bx    R(A) := frozen_str_dedup(Lit(Bx))               */
+
+  /* fused compare-and-branch (OP_LT..OP_EQ feeding an OP_JMPIF/OP_JMPNOT,
+     rewritten in genop_peep); branch polarity and offset come from the
+     following jump, which stays in the iseq as the resume point of the
+     method-dispatch fallback */
+  OP_JMPLT,/*     A B C   branch per next jump on R(A)<R(A+1)  (as OP_LT) */
+  OP_JMPLE,/*     A B C   branch per next jump on R(A)<=R(A+1) (as OP_LE) */
+  OP_JMPGT,/*     A B C   branch per next jump on R(A)>R(A+1)  (as OP_GT) */
+  OP_JMPGE,/*     A B C   branch per next jump on R(A)>=R(A+1) (as OP_GE) */
+  OP_JMPEQ,/*     A B C   branch per next jump on R(A)==R(A+1) (as OP_EQ) */
+
+  OP_SENDL,/*     A B C   R(A) := call(R(A),Syms(B),R(A+1),...,R(A+C))
+                          quickened OP_SEND resolved to a trivial leaf
+                          method, executed without pushing a frame       */
+
+  OP_UPDIDX,/*    A B     R(A) := R(A)[R(A+1)].send(Syms(B),R(A+2)),
+                          stored back with []=; emitted for index
+                          operator-assignment with a pure operand        */
+
+  OP_TRAP,/*      Ax      breakpoint trap; a debugger patched this word
+                          over a live instruction and keeps the original.
+                          mrb->breakpoint_hook returns the displaced
+                          instruction, which is then dispatched in place;
+                          without a hook the trap behaves like OP_NOP.
+                          Ax carries the owner's breakpoint number       */
+
   OP_RSVD2,/*             reserved instruction #2                         */
   OP_RSVD3,/*             reserved instruction #3                         */
   OP_RSVD4,/*             reserved instruction #4                         */
   OP_RSVD5,/*             reserved instruction #5                         */
+
+  OP_MAXOPCODE/*          sentinel: number of opcodes, not an instruction */
 };
 
 #define OP_L_STRICT  1
@@ -0,0 +1,474 @@
+/*
+** mruby/presym.h - build-time interned symbols
+**
+** Generated by tasks/gen_presym.rb; do not edit by hand.
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_PRESYM_H
+#define MRUBY_PRESYM_H
+
+/* Compile-time mrb_sym values for the symbols preloaded by
+   mrb_open (see mrb_init_symtbl in src/symbol.c); usable wherever
+   an interned symbol is needed, without a runtime mrb_intern. */
+#define MRB_SYM(x)   MRB_PRESYM__##x
+#define MRB_SYM_Q(x) MRB_PRESYM_Q__##x   /* x? */
+#define MRB_SYM_B(x) MRB_PRESYM_B__##x   /* x! */
+#define MRB_SYM_E(x) MRB_PRESYM_E__##x   /* x= */
+#define MRB_IVSYM(x) MRB_PRESYM_IV__##x  /* @x */
+#define MRB_CVSYM(x) MRB_PRESYM_CV__##x  /* @@x */
+#define MRB_OPSYM(x) MRB_PRESYM_OP__##x  /* spelled-out operator */
+
+#define MRB_PRESYM_MAX 453
+
+enum mruby_presym {
+  MRB_PRESYM_OP__not = 1,
+  MRB_PRESYM_OP__neq = 2,
+  MRB_PRESYM_OP__mod = 9,
+  MRB_PRESYM_OP__and = 10,
+  MRB_PRESYM_OP__mul = 11,
+  MRB_PRESYM_OP__pow = 12,
+  MRB_PRESYM_OP__add = 13,
+  MRB_PRESYM_OP__sub = 14,
+  MRB_PRESYM_OP__div = 15,
+  MRB_PRESYM_OP__lshift = 16,
+  MRB_PRESYM_OP__cmp = 17,
+  MRB_PRESYM_OP__eq = 18,
+  MRB_PRESYM_OP__eqq = 19,
+  MRB_PRESYM_OP__rshift = 20,
+  MRB_PRESYM_IV__buf = 21,
+  MRB_PRESYM_IV__cursor_keys = 22,
+  MRB_PRESYM_IV__obj = 23,
+  MRB_PRESYM_IV__ready = 24,
+  MRB_PRESYM_IV__scheduler = 25,
+  MRB_PRESYM_IV__timers = 26,
+  MRB_PRESYM_IV__waiting = 27,
+  MRB_PRESYM__AGE = 28,
+  MRB_PRESYM__ARGV = 29,
+  MRB_PRESYM__ArenaAlloc = 30,
+  MRB_PRESYM__ArenaAllocTest = 31,
+  MRB_PRESYM__Array = 32,
+  MRB_PRESYM__BasicObject = 33,
+  MRB_PRESYM__Channel = 34,
+  MRB_PRESYM__Class = 35,
+  MRB_PRESYM__Comparable = 36,
+  MRB_PRESYM__DEFAULT = 37,
+  MRB_PRESYM__DebuggerExit = 38,
+  MRB_PRESYM__DebuggerRestart = 39,
+  MRB_PRESYM__DomainError = 40,
+  MRB_PRESYM__E = 41,
+  MRB_PRESYM__Enumerable = 42,
+  MRB_PRESYM__Enumerator = 43,
+  MRB_PRESYM__ExampleClass = 44,
+  MRB_PRESYM__ExampleClassA = 45,
+  MRB_PRESYM__ExampleClassB = 46,
+  MRB_PRESYM__ExampleClassC = 47,
+  MRB_PRESYM__Example_Class = 48,
+  MRB_PRESYM__Exception = 49,
+  MRB_PRESYM__ExceptionTest = 50,
+  MRB_PRESYM__FIXNUM_BIT = 51,
+  MRB_PRESYM__FIXNUM_MAX = 52,
+  MRB_PRESYM__FIXNUM_MIN = 53,
+  MRB_PRESYM__FREE = 54,
+  MRB_PRESYM__FalseClass = 55,
+  MRB_PRESYM__Fiber = 56,
+  MRB_PRESYM__FiberError = 57,
+  MRB_PRESYM__Fixnum = 58,
+  MRB_PRESYM__Float = 59,
+  MRB_PRESYM__Foo = 60,
+  MRB_PRESYM__GC = 61,
+  MRB_PRESYM__Hash = 62,
+  MRB_PRESYM__INFINITY = 63,
+  MRB_PRESYM__Integer = 64,
+  MRB_PRESYM__Kernel = 65,
+  MRB_PRESYM__Lazy = 66,
+  MRB_PRESYM__MRUBY_COPYRIGHT = 67,
+  MRB_PRESYM__MRUBY_DESCRIPTION = 68,
+  MRB_PRESYM__MRUBY_RELEASE_DATE = 69,
+  MRB_PRESYM__MRUBY_RELEASE_NO = 70,
+  MRB_PRESYM__MRUBY_VERSION = 71,
+  MRB_PRESYM__Math = 72,
+  MRB_PRESYM__Module = 73,
+  MRB_PRESYM__Mrbtest = 74,
+  MRB_PRESYM__NAN = 75,
+  MRB_PRESYM__NilClass = 76,
+  MRB_PRESYM__Numeric = 77,
+  MRB_PRESYM__Object = 78,
+  MRB_PRESYM__ObjectSpace = 79,
+  MRB_PRESYM__PI = 80,
+  MRB_PRESYM__Proc = 81,
+  MRB_PRESYM__ProcExtTest = 82,
+  MRB_PRESYM__RUBY_ENGINE = 83,
+  MRB_PRESYM__RUBY_ENGINE_VERSION = 84,
+  MRB_PRESYM__RUBY_VERSION = 85,
+  MRB_PRESYM__Random = 86,
+  MRB_PRESYM__Range = 87,
+  MRB_PRESYM__RuntimeError = 88,
+  MRB_PRESYM__Scheduler = 89,
+  MRB_PRESYM__ScriptError = 90,
+  MRB_PRESYM__StandardError = 91,
+  MRB_PRESYM__StateChannel = 92,
+  MRB_PRESYM__String = 93,
+  MRB_PRESYM__Struct = 94,
+  MRB_PRESYM__Symbol = 95,
+  MRB_PRESYM__SyntaxError = 96,
+  MRB_PRESYM__SystemStackError = 97,
+  MRB_PRESYM__TOLERANCE = 98,
+  MRB_PRESYM__TOTAL = 99,
+  MRB_PRESYM__Time = 100,
+  MRB_PRESYM__TrueClass = 101,
+  MRB_PRESYM__WeakRef = 102,
+  MRB_PRESYM_OP__aref = 103,
+  MRB_PRESYM_OP__aset = 104,
+  MRB_PRESYM_OP__xor = 105,
+  MRB_PRESYM____apply_stages = 106,
+  MRB_PRESYM____ary_cmp = 107,
+  MRB_PRESYM____ary_eq = 108,
+  MRB_PRESYM____ary_index = 109,
+  MRB_PRESYM____attached__ = 110,
+  MRB_PRESYM____case_eqq = 111,
+  MRB_PRESYM____classid__ = 112,
+  MRB_PRESYM____classpath__ = 113,
+  MRB_PRESYM____control_exc__ = 114,
+  MRB_PRESYM____current__ = 115,
+  MRB_PRESYM____cursor_fetch = 116,
+  MRB_PRESYM____delete = 117,
+  MRB_PRESYM____each_int = 118,
+  MRB_PRESYM____id__ = 119,
+  MRB_PRESYM_Q____indexable = 120,
+  MRB_PRESYM____members__ = 121,
+  MRB_PRESYM____method__ = 122,
+  MRB_PRESYM____outer__ = 123,
+  MRB_PRESYM____printstr__ = 124,
+  MRB_PRESYM____send__ = 125,
+  MRB_PRESYM____t_printstr__ = 126,
+  MRB_PRESYM____times_int = 127,
+  MRB_PRESYM___sprintf_cache_ = 128,
+  MRB_PRESYM___sys_fail = 129,
+  MRB_PRESYM__acos = 130,
+  MRB_PRESYM__acosh = 131,
+  MRB_PRESYM__alias_method = 132,
+  MRB_PRESYM_Q__alive = 133,
+  MRB_PRESYM__all_symbols = 134,
+  MRB_PRESYM__allocation_samples = 135,
+  MRB_PRESYM__ancestors = 136,
+  MRB_PRESYM__append_features = 137,
+  MRB_PRESYM__arena_peak = 138,
+  MRB_PRESYM__arity = 139,
+  MRB_PRESYM__asctime = 140,
+  MRB_PRESYM__asin = 141,
+  MRB_PRESYM__asinh = 142,
+  MRB_PRESYM__assoc = 143,
+  MRB_PRESYM__at = 144,
+  MRB_PRESYM__atan = 145,
+  MRB_PRESYM__atan2 = 146,
+  MRB_PRESYM__atanh = 147,
+  MRB_PRESYM__attr_reader = 148,
+  MRB_PRESYM__attr_writer = 149,
+  MRB_PRESYM_E__autotune = 150,
+  MRB_PRESYM_Q__autotune = 151,
+  MRB_PRESYM__backtrace = 152,
+  MRB_PRESYM__bar = 153,
+  MRB_PRESYM__begin = 154,
+  MRB_PRESYM_Q__block_given = 155,
+  MRB_PRESYM__bytes = 156,
+  MRB_PRESYM__bytesize = 157,
+  MRB_PRESYM__byteslice = 158,
+  MRB_PRESYM__call = 159,
+  MRB_PRESYM__capacity = 160,
+  MRB_PRESYM__capitalize = 161,
+  MRB_PRESYM_B__capitalize = 162,
+  MRB_PRESYM__cbrt = 163,
+  MRB_PRESYM__ceil = 164,
+  MRB_PRESYM__cfunc_without_env = 165,
+  MRB_PRESYM__chomp = 166,
+  MRB_PRESYM_B__chomp = 167,
+  MRB_PRESYM__chop = 168,
+  MRB_PRESYM_B__chop = 169,
+  MRB_PRESYM__chr = 170,
+  MRB_PRESYM__ciidx = 171,
+  MRB_PRESYM__class = 172,
+  MRB_PRESYM__class_eval = 173,
+  MRB_PRESYM_Q__class_variable_defined = 174,
+  MRB_PRESYM__class_variable_get = 175,
+  MRB_PRESYM__class_variable_set = 176,
+  MRB_PRESYM__class_variables = 177,
+  MRB_PRESYM__clear = 178,
+  MRB_PRESYM__clone = 179,
+  MRB_PRESYM__concat = 180,
+  MRB_PRESYM_Q__const_defined = 181,
+  MRB_PRESYM__const_get = 182,
+  MRB_PRESYM__const_missing = 183,
+  MRB_PRESYM__const_set = 184,
+  MRB_PRESYM__constants = 185,
+  MRB_PRESYM__cos = 186,
+  MRB_PRESYM__cosh = 187,
+  MRB_PRESYM__count_objects = 188,
+  MRB_PRESYM_Q__cover = 189,
+  MRB_PRESYM__ctime = 190,
+  MRB_PRESYM__current = 191,
+  MRB_PRESYM__day = 192,
+  MRB_PRESYM__default = 193,
+  MRB_PRESYM_E__default = 194,
+  MRB_PRESYM__default_proc = 195,
+  MRB_PRESYM_E__default_proc = 196,
+  MRB_PRESYM__define_method = 197,
+  MRB_PRESYM__define_singleton_method = 198,
+  MRB_PRESYM__delete_at = 199,
+  MRB_PRESYM__disable = 200,
+  MRB_PRESYM__divmod = 201,
+  MRB_PRESYM__downcase = 202,
+  MRB_PRESYM_B__downcase = 203,
+  MRB_PRESYM__drop = 204,
+  MRB_PRESYM__drop_while = 205,
+  MRB_PRESYM_Q__dst = 206,
+  MRB_PRESYM__dump = 207,
+  MRB_PRESYM__dup = 208,
+  MRB_PRESYM__each = 209,
+  MRB_PRESYM__each_object = 210,
+  MRB_PRESYM_Q__empty = 211,
+  MRB_PRESYM__enable = 212,
+  MRB_PRESYM__end = 213,
+  MRB_PRESYM_Q__end_with = 214,
+  MRB_PRESYM_Q__eql = 215,
+  MRB_PRESYM_Q__equal = 216,
+  MRB_PRESYM__erf = 217,
+  MRB_PRESYM__erfc = 218,
+  MRB_PRESYM__eval = 219,
+  MRB_PRESYM__example_method = 220,
+  MRB_PRESYM__exception = 221,
+  MRB_PRESYM_Q__exclude_end = 222,
+  MRB_PRESYM__exit = 223,
+  MRB_PRESYM__exp = 224,
+  MRB_PRESYM__extend = 225,
+  MRB_PRESYM__extend_object = 226,
+  MRB_PRESYM__extended = 227,
+  MRB_PRESYM__fail = 228,
+  MRB_PRESYM__file = 229,
+  MRB_PRESYM_Q__finite = 230,
+  MRB_PRESYM__first = 231,
+  MRB_PRESYM__flat_map = 232,
+  MRB_PRESYM__floats = 233,
+  MRB_PRESYM__floor = 234,
+  MRB_PRESYM__format = 235,
+  MRB_PRESYM__freeze = 236,
+  MRB_PRESYM__frexp = 237,
+  MRB_PRESYM__from_a = 238,
+  MRB_PRESYM__generational_mode = 239,
+  MRB_PRESYM_E__generational_mode = 240,
+  MRB_PRESYM__getbyte = 241,
+  MRB_PRESYM__getgm = 242,
+  MRB_PRESYM__getlocal = 243,
+  MRB_PRESYM__getutc = 244,
+  MRB_PRESYM__global_variables = 245,
+  MRB_PRESYM__gm = 246,
+  MRB_PRESYM_Q__gmt = 247,
+  MRB_PRESYM__gmtime = 248,
+  MRB_PRESYM__grep = 249,
+  MRB_PRESYM_Q__has_key = 250,
+  MRB_PRESYM_Q__has_value = 251,
+  MRB_PRESYM__hash = 252,
+  MRB_PRESYM__hex = 253,
+  MRB_PRESYM__hour = 254,
+  MRB_PRESYM__hypot = 255,
+  MRB_PRESYM__id2name = 256,
+  MRB_PRESYM__ifnone = 257,
+  MRB_PRESYM__include = 258,
+  MRB_PRESYM_Q__include = 259,
+  MRB_PRESYM__included = 260,
+  MRB_PRESYM__included_modules = 261,
+  MRB_PRESYM__index = 262,
+  MRB_PRESYM_Q__infinite = 263,
+  MRB_PRESYM__inherited = 264,
+  MRB_PRESYM__initialize = 265,
+  MRB_PRESYM__initialize_copy = 266,
+  MRB_PRESYM__inspect = 267,
+  MRB_PRESYM__instance_eval = 268,
+  MRB_PRESYM__instance_exec = 269,
+  MRB_PRESYM__instance_methods = 270,
+  MRB_PRESYM_Q__instance_of = 271,
+  MRB_PRESYM_Q__instance_variable_defined = 272,
+  MRB_PRESYM__instance_variable_get = 273,
+  MRB_PRESYM__instance_variable_set = 274,
+  MRB_PRESYM__instance_variables = 275,
+  MRB_PRESYM__intern = 276,
+  MRB_PRESYM__interval_ratio = 277,
+  MRB_PRESYM_E__interval_ratio = 278,
+  MRB_PRESYM_Q__is_a = 279,
+  MRB_PRESYM_Q__iterator = 280,
+  MRB_PRESYM__join = 281,
+  MRB_PRESYM_Q__key = 282,
+  MRB_PRESYM__keys = 283,
+  MRB_PRESYM_Q__kind_of = 284,
+  MRB_PRESYM__lambda = 285,
+  MRB_PRESYM_Q__lambda = 286,
+  MRB_PRESYM__last = 287,
+  MRB_PRESYM__lastpc = 288,
+  MRB_PRESYM__ldexp = 289,
+  MRB_PRESYM__length = 290,
+  MRB_PRESYM__line = 291,
+  MRB_PRESYM__lines = 292,
+  MRB_PRESYM__live = 293,
+  MRB_PRESYM__live_by_type = 294,
+  MRB_PRESYM__local = 295,
+  MRB_PRESYM__local_variables = 296,
+  MRB_PRESYM__localtime = 297,
+  MRB_PRESYM__log = 298,
+  MRB_PRESYM__log10 = 299,
+  MRB_PRESYM__log2 = 300,
+  MRB_PRESYM__major_count = 301,
+  MRB_PRESYM__map = 302,
+  MRB_PRESYM__mark_time = 303,
+  MRB_PRESYM__max_pause = 304,
+  MRB_PRESYM_E__max_pause = 305,
+  MRB_PRESYM__mday = 306,
+  MRB_PRESYM_Q__member = 307,
+  MRB_PRESYM__members = 308,
+  MRB_PRESYM__mesg = 309,
+  MRB_PRESYM__message = 310,
+  MRB_PRESYM_Q__method_defined = 311,
+  MRB_PRESYM__method_missing = 312,
+  MRB_PRESYM__method_name = 313,
+  MRB_PRESYM__method_removed = 314,
+  MRB_PRESYM__methods = 315,
+  MRB_PRESYM__min = 316,
+  MRB_PRESYM__minor_count = 317,
+  MRB_PRESYM__mktime = 318,
+  MRB_PRESYM__module_eval = 319,
+  MRB_PRESYM__module_function = 320,
+  MRB_PRESYM__mon = 321,
+  MRB_PRESYM__month = 322,
+  MRB_PRESYM__mrb_cfunc_env_get = 323,
+  MRB_PRESYM__mrb_ensure = 324,
+  MRB_PRESYM__mrb_proc_new_cfunc_with_env = 325,
+  MRB_PRESYM__mrb_protect = 326,
+  MRB_PRESYM__mrb_protect_each = 327,
+  MRB_PRESYM__mrb_rescue = 328,
+  MRB_PRESYM__mrb_rescue_exceptions = 329,
+  MRB_PRESYM_Q__nan = 330,
+  MRB_PRESYM__new = 331,
+  MRB_PRESYM__next = 332,
+  MRB_PRESYM_B__next = 333,
+  MRB_PRESYM_Q__nil = 334,
+  MRB_PRESYM__now = 335,
+  MRB_PRESYM__object_id = 336,
+  MRB_PRESYM__oct = 337,
+  MRB_PRESYM__on_event = 338,
+  MRB_PRESYM__ord = 339,
+  MRB_PRESYM__parameters = 340,
+  MRB_PRESYM__pass = 341,
+  MRB_PRESYM__pop = 342,
+  MRB_PRESYM__prepend = 343,
+  MRB_PRESYM__prepend_features = 344,
+  MRB_PRESYM__prepended = 345,
+  MRB_PRESYM__private = 346,
+  MRB_PRESYM__private_methods = 347,
+  MRB_PRESYM__proc = 348,
+  MRB_PRESYM__promoted = 349,
+  MRB_PRESYM__protected = 350,
+  MRB_PRESYM__protected_methods = 351,
+  MRB_PRESYM__public = 352,
+  MRB_PRESYM__public_methods = 353,
+  MRB_PRESYM__push = 354,
+  MRB_PRESYM__quo = 355,
+  MRB_PRESYM__raise = 356,
+  MRB_PRESYM__rand = 357,
+  MRB_PRESYM__rassoc = 358,
+  MRB_PRESYM__receive = 359,
+  MRB_PRESYM__reject = 360,
+  MRB_PRESYM__remote_free = 361,
+  MRB_PRESYM__remove_class_variable = 362,
+  MRB_PRESYM__remove_const = 363,
+  MRB_PRESYM__remove_instance_variable = 364,
+  MRB_PRESYM__remove_method = 365,
+  MRB_PRESYM__replace = 366,
+  MRB_PRESYM__report = 367,
+  MRB_PRESYM__reserve = 368,
+  MRB_PRESYM_Q__respond_to = 369,
+  MRB_PRESYM_Q__respond_to_missing = 370,
+  MRB_PRESYM__resume = 371,
+  MRB_PRESYM__reverse = 372,
+  MRB_PRESYM_B__reverse = 373,
+  MRB_PRESYM__rindex = 374,
+  MRB_PRESYM__round = 375,
+  MRB_PRESYM__roundtrip = 376,
+  MRB_PRESYM__run = 377,
+  MRB_PRESYM__sample = 378,
+  MRB_PRESYM__schedule = 379,
+  MRB_PRESYM__sec = 380,
+  MRB_PRESYM__select = 381,
+  MRB_PRESYM__send = 382,
+  MRB_PRESYM__set_backtrace = 383,
+  MRB_PRESYM__setbyte = 384,
+  MRB_PRESYM__shift = 385,
+  MRB_PRESYM__shuffle = 386,
+  MRB_PRESYM_B__shuffle = 387,
+  MRB_PRESYM__sin = 388,
+  MRB_PRESYM__singleton_class = 389,
+  MRB_PRESYM__singleton_methods = 390,
+  MRB_PRESYM__sinh = 391,
+  MRB_PRESYM__size = 392,
+  MRB_PRESYM__sleep = 393,
+  MRB_PRESYM__slice = 394,
+  MRB_PRESYM__sort = 395,
+  MRB_PRESYM__source_location = 396,
+  MRB_PRESYM__split = 397,
+  MRB_PRESYM__sprintf = 398,
+  MRB_PRESYM__sqrt = 399,
+  MRB_PRESYM__srand = 400,
+  MRB_PRESYM__start = 401,
+  MRB_PRESYM_Q__start_with = 402,
+  MRB_PRESYM__stat = 403,
+  MRB_PRESYM__stats = 404,
+  MRB_PRESYM__step_count = 405,
+  MRB_PRESYM__step_ratio = 406,
+  MRB_PRESYM_E__step_ratio = 407,
+  MRB_PRESYM__store = 408,
+  MRB_PRESYM__succ = 409,
+  MRB_PRESYM_B__succ = 410,
+  MRB_PRESYM__superclass = 411,
+  MRB_PRESYM__swapcase = 412,
+  MRB_PRESYM_B__swapcase = 413,
+  MRB_PRESYM__sweep_time = 414,
+  MRB_PRESYM__take = 415,
+  MRB_PRESYM__take_while = 416,
+  MRB_PRESYM__tan = 417,
+  MRB_PRESYM__tanh = 418,
+  MRB_PRESYM__target = 419,
+  MRB_PRESYM__test = 420,
+  MRB_PRESYM__to_a = 421,
+  MRB_PRESYM__to_f = 422,
+  MRB_PRESYM__to_h = 423,
+  MRB_PRESYM__to_hash = 424,
+  MRB_PRESYM__to_i = 425,
+  MRB_PRESYM__to_int = 426,
+  MRB_PRESYM__to_s = 427,
+  MRB_PRESYM__to_str = 428,
+  MRB_PRESYM__to_sym = 429,
+  MRB_PRESYM__total_allocated = 430,
+  MRB_PRESYM__trace_allocations_start = 431,
+  MRB_PRESYM__trace_allocations_stop = 432,
+  MRB_PRESYM__transfer = 433,
+  MRB_PRESYM__truncate = 434,
+  MRB_PRESYM__undef_method = 435,
+  MRB_PRESYM_B__uniq = 436,
+  MRB_PRESYM__unshift = 437,
+  MRB_PRESYM__upcase = 438,
+  MRB_PRESYM_B__upcase = 439,
+  MRB_PRESYM__usec = 440,
+  MRB_PRESYM__utc = 441,
+  MRB_PRESYM_Q__utc = 442,
+  MRB_PRESYM_Q__value = 443,
+  MRB_PRESYM__values = 444,
+  MRB_PRESYM__values_at = 445,
+  MRB_PRESYM__wday = 446,
+  MRB_PRESYM__yday = 447,
+  MRB_PRESYM__year = 448,
+  MRB_PRESYM__yield = 449,
+  MRB_PRESYM__zip = 450,
+  MRB_PRESYM__zone = 451,
+  MRB_PRESYM_OP__or = 452,
+  MRB_PRESYM_OP__neg = 453,
+};
+
+#endif  /* MRUBY_PRESYM_H */
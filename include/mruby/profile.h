@@ -0,0 +1,70 @@
+/*
+** mruby/profile.h - sampling profiler
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_PROFILE_H
+#define MRUBY_PROFILE_H
+
+#include "common.h"
+
+/**
+ * MRuby sampling profiler.
+ *
+ * Unlike the code fetch hook (MRB_ENABLE_DEBUG_HOOK), which fires on
+ * every instruction, the profiler samples the callinfo chain once every
+ * N method dispatches into a preallocated ring buffer, so it is cheap
+ * enough to leave running on live devices.
+ */
+MRB_BEGIN_DECL
+
+/* maximum number of frames recorded per sample; deeper stacks are
+   truncated below this depth */
+#ifndef MRB_PROFILE_MAX_DEPTH
+#define MRB_PROFILE_MAX_DEPTH 32
+#endif
+
+struct mrb_profile_frame {
+  mrb_sym mid;                  /* method symbol; 0 for top-level code */
+  int32_t lineno;               /* line at the sampled position, or -1 */
+};
+
+struct mrb_profile_sample {
+  uint16_t depth;               /* valid frames, innermost first */
+  struct mrb_profile_frame frames[MRB_PROFILE_MAX_DEPTH];
+};
+
+typedef struct mrb_profile {
+  uint32_t interval;            /* method dispatches between samples */
+  uint32_t countdown;           /* dispatches until the next sample */
+  struct mrb_profile_sample *samples;   /* ring buffer of `capacity` */
+  uint32_t capacity;
+  uint32_t head;                /* next slot to overwrite */
+  uint32_t count;               /* valid samples (<= capacity) */
+} mrb_profile;
+
+/*
+ * start sampling; takes one sample every `interval` method dispatches
+ * into a ring buffer of `capacity` samples (the oldest are overwritten)
+ */
+MRB_API void mrb_profile_start(mrb_state *mrb, uint32_t interval, uint32_t capacity);
+
+/*
+ * stop sampling and release the ring buffer
+ */
+MRB_API void mrb_profile_stop(mrb_state *mrb);
+
+/*
+ * aggregate the collected samples into folded stack lines
+ * ("outer;inner:lineno count\n"), the input format of flamegraph tools
+ * @return a String, empty if nothing was sampled
+ */
+MRB_API mrb_value mrb_profile_dump(mrb_state *mrb);
+
+/* internal: called from the VM on method dispatch */
+void mrb_profile_sample_stack(mrb_state *mrb, mrb_code *pc);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_PROFILE_H */
@@ -0,0 +1,75 @@
+/*
+** mruby/snapshot.h - boot-state snapshot and restore
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_SNAPSHOT_H
+#define MRUBY_SNAPSHOT_H
+
+#include "common.h"
+
+/**
+ * MRuby boot-state snapshots.
+ *
+ * mrb_init_core rebuilds every core class and mrblib method on each
+ * mrb_open, which dominates startup on short-lived processes.  A
+ * snapshotable state keeps all of its allocations inside one
+ * contiguous anonymous mapping, so the booted state can be written out
+ * as-is and mapped back at the same address by a later process of the
+ * same executable, skipping boot entirely.
+ *
+ * Because the image is restored without pointer rewriting, a snapshot
+ * is only valid in a process whose code sits at the same addresses:
+ * the same executable, built without PIE or run with ASLR disabled (or
+ * the restoring process is the one that wrote the snapshot).  The
+ * image records a probe address and restore refuses anything else.
+ * OS resources (descriptors, JIT-compiled code pages) are not part of
+ * the region; take snapshots after boot and app load, before opening
+ * files or warming the JIT.
+ */
+MRB_BEGIN_DECL
+
+/* region size used when mrb_open_snapshotable is passed 0 */
+#ifndef MRB_SNAPSHOT_REGION_SIZE
+#define MRB_SNAPSHOT_REGION_SIZE (16 << 20)
+#endif
+
+/*
+ * open a state whose every allocation lives inside one mapping of
+ * `region_size` bytes (0 for the default).  The state is a normal
+ * mrb_state; allocation fails once the region is exhausted.
+ * @return NULL if the mapping or boot fails, or when symbols are
+ *         process-global (MRB_USE_SHARED_SYMBOLS)
+ */
+MRB_API mrb_state *mrb_open_snapshotable(size_t region_size);
+
+/*
+ * write the state's region to `fp`; the state keeps working afterwards.
+ * Runs a full GC first so dead boot garbage is not carried along.
+ * @return MRB_SNAPSHOT_OK, or MRB_SNAPSHOT_ERROR if the state was not
+ *         opened with mrb_open_snapshotable or the write fails
+ */
+MRB_API int mrb_snapshot_write(mrb_state *mrb, FILE *fp);
+
+/*
+ * map a snapshot written by mrb_snapshot_write back at its original
+ * address and return the restored state
+ * @return NULL if the address range is taken, the executable layout
+ *         differs from the snapshotting process, or the read fails
+ */
+MRB_API mrb_state *mrb_snapshot_restore(FILE *fp);
+
+/*
+ * unmap a snapshotable state's region in one go, without running
+ * finalizers or atexit handlers; suited to throwaway sandbox states.
+ * Use mrb_close instead when the app holds OS resources.
+ */
+MRB_API void mrb_snapshot_discard(mrb_state *mrb);
+
+#define MRB_SNAPSHOT_OK      0
+#define MRB_SNAPSHOT_ERROR (-1)
+
+MRB_END_DECL
+
+#endif  /* MRUBY_SNAPSHOT_H */
@@ -87,6 +87,7 @@ mrb_int mrb_str_strlen(mrb_state*, struct RString*);
 #define MRB_STR_EMBED_LEN_SHIFT 5
 
 void mrb_gc_free_str(mrb_state*, struct RString*);
+size_t mrb_gc_str_memsize(mrb_state*, struct RString*);
 MRB_API void mrb_str_modify(mrb_state*, struct RString*);
 MRB_API void mrb_str_concat(mrb_state*, mrb_value, mrb_value);
 
@@ -110,11 +111,22 @@ MRB_API mrb_value mrb_obj_as_string(mrb_state *mrb, mrb_value obj);
  */
 MRB_API mrb_value mrb_str_resize(mrb_state *mrb, mrb_value str, mrb_int len);
 
+/*
+ * Reserves buffer capacity without changing the string's length.
+ */
+MRB_API mrb_value mrb_str_reserve(mrb_state *mrb, mrb_value str, mrb_int capa);
+
 /*
  * Returns a sub string.
  */
 MRB_API mrb_value mrb_str_substr(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len);
 
+/*
+ * Returns a byte range of the string as a zero-copy shared view when
+ * the receiver is a heap string.
+ */
+MRB_API mrb_value mrb_str_byte_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len);
+
 /*
  * Returns a Ruby string type.
  */
@@ -194,6 +206,8 @@ MRB_API int mrb_str_cmp(mrb_state *mrb, mrb_value str1, mrb_value str2);
 MRB_API char *mrb_str_to_cstr(mrb_state *mrb, mrb_value str);
 
 mrb_value mrb_str_pool(mrb_state *mrb, mrb_value str);
+mrb_value mrb_str_pool_static(mrb_state *mrb, const char *p, size_t len);
+mrb_value mrb_str_pool_share(mrb_state *mrb, mrb_value pooled);
 mrb_int mrb_str_hash(mrb_state *mrb, mrb_value str);
 mrb_value mrb_str_dump(mrb_state *mrb, mrb_value str);
 
@@ -20,7 +20,9 @@ typedef mrb_int mrb_jmpbuf_impl;
 
 #include <setjmp.h>
 
-#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+/* prefer _setjmp where it exists: it never touches the signal mask, so
+   arming a jmpbuf on the C boundary stays a plain register save */
+#if defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__) || defined(__GLIBC__)
 #define MRB_SETJMP _setjmp
 #define MRB_LONGJMP _longjmp
 #else
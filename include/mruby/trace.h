@@ -0,0 +1,72 @@
+/*
+** mruby/trace.h - Trace Event Format export
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_TRACE_H
+#define MRUBY_TRACE_H
+
+#include "common.h"
+
+/**
+ * Chrome Trace Event export.
+ *
+ * While tracing is started, collector phases (root scan, mark and
+ * sweep slices), fiber switches and bytecode loading record events
+ * with monotonic timestamps into a bounded in-memory ring buffer.
+ * mrb_trace_dump converts the buffer into Trace Event Format JSON
+ * (chrome://tracing and perfetto compatible) and clears it; the
+ * embedder decides when and where to flush, e.g. once per host frame.
+ */
+MRB_BEGIN_DECL
+
+/* deepest nesting of in-flight duration events tracked; deeper phases
+   are timed but not recorded */
+#ifndef MRB_TRACE_MAX_DEPTH
+#define MRB_TRACE_MAX_DEPTH 16
+#endif
+
+struct mrb_trace_event {
+  const char *name;             /* static string naming the phase */
+  double ts;                    /* start, seconds on the monotonic clock */
+  double dur;                   /* duration in seconds; 0 for instants */
+  char ph;                      /* 'X' complete, 'i' instant */
+};
+
+typedef struct mrb_trace {
+  struct mrb_trace_event *events;      /* ring buffer of `capacity` */
+  uint32_t capacity;
+  uint32_t head;                /* next slot to overwrite */
+  uint32_t count;               /* valid events (<= capacity) */
+  int depth;                    /* in-flight duration events */
+  const char *names[MRB_TRACE_MAX_DEPTH];
+  double begins[MRB_TRACE_MAX_DEPTH];
+} mrb_trace;
+
+/*
+ * start tracing into a ring buffer of `capacity` events (the oldest
+ * are overwritten; 0 selects a default of 4096)
+ */
+MRB_API void mrb_trace_start(mrb_state *mrb, uint32_t capacity);
+
+/*
+ * stop tracing and release the ring buffer
+ */
+MRB_API void mrb_trace_stop(mrb_state *mrb);
+
+/*
+ * render the buffered events as a Trace Event Format JSON array, in
+ * microseconds as the format expects, and clear the buffer
+ * @return a String, "[]" if nothing was recorded
+ */
+MRB_API mrb_value mrb_trace_dump(mrb_state *mrb);
+
+/* internal: phase markers; callers check mrb->trace first */
+void mrb_trace_phase_begin(mrb_state *mrb, const char *name);
+void mrb_trace_phase_end(mrb_state *mrb);
+void mrb_trace_instant(mrb_state *mrb, const char *name);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_TRACE_H */
@@ -29,10 +29,14 @@ struct global_entry {
   mrb_sym id;
 };
 
+struct mrb_ivsite_cache;
+
 mrb_value mrb_vm_special_get(mrb_state*, mrb_sym);
 void mrb_vm_special_set(mrb_state*, mrb_sym, mrb_value);
 mrb_value mrb_vm_iv_get(mrb_state*, mrb_sym);
 void mrb_vm_iv_set(mrb_state*, mrb_sym, mrb_value);
+mrb_value mrb_vm_iv_get_cached(mrb_state*, mrb_sym, struct mrb_ivsite_cache*);
+void mrb_vm_iv_set_cached(mrb_state*, mrb_sym, mrb_value, struct mrb_ivsite_cache*);
 mrb_value mrb_vm_cv_get(mrb_state*, mrb_sym);
 void mrb_vm_cv_set(mrb_state*, mrb_sym, mrb_value);
 mrb_value mrb_vm_const_get(mrb_state*, mrb_sym);
@@ -74,7 +78,11 @@ mrb_sym mrb_class_sym(mrb_state *mrb, struct RClass *c, struct RClass *outer);
 void mrb_gc_mark_gv(mrb_state*);
 void mrb_gc_free_gv(mrb_state*);
 void mrb_gc_mark_iv(mrb_state*, struct RObject*);
+typedef int (mrb_iv_foreach_func)(mrb_state *mrb, mrb_sym sym, mrb_value val, void *data);
+MRB_API void mrb_iv_foreach(mrb_state*, mrb_value obj, mrb_iv_foreach_func*, void*);
+MRB_API void mrb_gv_foreach(mrb_state*, mrb_iv_foreach_func*, void*);
 size_t mrb_gc_mark_iv_size(mrb_state*, struct RObject*);
+size_t mrb_gc_iv_memsize(mrb_state*, struct RObject*);
 void mrb_gc_free_iv(mrb_state*, struct RObject*);
 
 MRB_END_DECL
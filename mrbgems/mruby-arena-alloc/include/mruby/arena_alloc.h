@@ -0,0 +1,70 @@
+/*
+** mruby/arena_alloc.h - size-classed per-state allocator arena
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_ARENA_ALLOC_H
+#define MRUBY_ARENA_ALLOC_H
+
+#include <mruby.h>
+
+MRB_BEGIN_DECL
+
+/*
+ * An mrb_alloc_arena sits between a state and the system allocator:
+ * allocations up to 256 bytes (iv segments, khash blocks, small string
+ * capacities) are served from per-arena size-class free lists carved
+ * out of 16KB pages, so the hot allocation path of a state never takes
+ * the malloc lock.  One arena belongs to one state:
+ *
+ *     mrb_alloc_arena *arena = mrb_alloc_arena_new(NULL, NULL);
+ *     mrb_state *mrb = mrb_open_allocf(mrb_alloc_arena_allocf, arena);
+ *     ...
+ *     mrb_close(mrb);
+ *     mrb_alloc_arena_free(arena);
+ *
+ * A block freed by a state other than its owner (a channel-passed
+ * string buffer, for example) is pushed onto the owner's remote-free
+ * list with a single atomic exchange and reclaimed the next time the
+ * owner allocates, so cross-thread frees do not contend either.
+ *
+ * Every block the arena ever handed out -- including large requests
+ * served by the fallback -- is tracked and released by
+ * mrb_alloc_arena_free, so the state may be torn down with
+ * mrb_close_fast and the arena dropped afterwards without leaking.
+ */
+typedef struct mrb_alloc_arena mrb_alloc_arena;
+
+/* number of size classes (16..256 bytes); larger requests fall through
+   to the backing allocator with a small ownership header */
+#define MRB_ALLOC_ARENA_CLASSES 8
+
+typedef struct mrb_alloc_arena_stat {
+  size_t block_size;      /* payload bytes per block in this class */
+  size_t bytes_live;      /* payload bytes currently handed out */
+  size_t bytes_capacity;  /* payload bytes carved into this class */
+} mrb_alloc_arena_stat;
+
+/* create an arena drawing pages from `fallback` (mrb_default_allocf
+   when NULL); returns NULL when out of memory */
+mrb_alloc_arena *mrb_alloc_arena_new(mrb_allocf fallback, void *fallback_ud);
+
+/* release every page, every outstanding large block and the arena
+   itself; only valid after the state using the arena has been closed
+   (mrb_close or mrb_close_fast) */
+void mrb_alloc_arena_free(mrb_alloc_arena *arena);
+
+/* the mrb_allocf to pass to mrb_open_allocf, with the arena as ud */
+void *mrb_alloc_arena_allocf(mrb_state *mrb, void *p, size_t size, void *ud);
+
+/* the arena a state was opened with, or NULL */
+mrb_alloc_arena *mrb_alloc_arena_of(mrb_state *mrb);
+
+/* fill `stats` with the per-class byte counts of `arena`; blocks on the
+   remote-free list still count as live until the owner reclaims them */
+void mrb_alloc_arena_stats(mrb_alloc_arena *arena, mrb_alloc_arena_stat stats[MRB_ALLOC_ARENA_CLASSES]);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_ARENA_ALLOC_H */
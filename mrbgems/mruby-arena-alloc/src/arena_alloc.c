@@ -0,0 +1,347 @@
+/*
+** arena_alloc.c - size-classed per-state allocator arena
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stddef.h>
+#include <string.h>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/arena_alloc.h>
+
+/* foreign states free into our remote list; use compiler atomics where
+   we have them, plain accesses otherwise (single-threaded embedders) */
+#if defined(__GNUC__) || defined(__clang__)
+#define ARENA_XCHG(p, v)     __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define ARENA_CAS(p, o, v)   __atomic_compare_exchange_n((p), (o), (v), FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#else
+#define ARENA_XCHG(p, v)     arena_plain_xchg((void**)(p), (v))
+#define ARENA_CAS(p, o, v)   (*(p) == *(o) ? (*(p) = (v), TRUE) : (*(o) = *(p), FALSE))
+static void*
+arena_plain_xchg(void **p, void *v)
+{
+  void *old = *p;
+  *p = v;
+  return old;
+}
+#endif
+
+#define ARENA_PAGE_SIZE (16 * 1024)
+
+static const size_t class_sizes[MRB_ALLOC_ARENA_CLASSES] = {
+  16, 32, 48, 64, 96, 128, 192, 256
+};
+
+/* precedes every payload handed out by the arena allocf; keeps the
+   payload aligned for doubles on both 32 and 64 bit targets */
+typedef struct ablock {
+  mrb_alloc_arena *arena;  /* owning arena, NULL for fallback blocks */
+  size_t size;             /* usable payload bytes */
+} ablock;
+
+typedef struct freeblk {
+  struct freeblk *next;    /* stored in the payload of a free block */
+} freeblk;
+
+typedef struct apage {
+  struct apage *next;
+} apage;
+
+/* requests above the largest size class carry a list header in front of
+   the ablock, so the owning arena can release every outstanding block
+   wholesale at teardown (mrb_alloc_arena_free after mrb_close_fast) */
+typedef struct lblock {
+  struct lblock *prev;
+  struct lblock *next;
+  ablock hdr;
+} lblock;
+
+#define LBLOCK_OF(h) ((lblock*)((char*)(h) - offsetof(lblock, hdr)))
+
+struct mrb_alloc_arena {
+  mrb_allocf fallback;
+  void *fallback_ud;
+  freeblk *free_list[MRB_ALLOC_ARENA_CLASSES];
+  freeblk *remote_free;    /* pushed by foreign states, atomically */
+  apage *pages;
+  lblock *large;           /* live blocks above the largest class */
+  size_t live[MRB_ALLOC_ARENA_CLASSES];
+  size_t capa[MRB_ALLOC_ARENA_CLASSES];
+};
+
+static int
+class_for(size_t size)
+{
+  int cls;
+
+  for (cls = 0; cls < MRB_ALLOC_ARENA_CLASSES; cls++) {
+    if (size <= class_sizes[cls]) return cls;
+  }
+  return -1;
+}
+
+static void
+large_link(mrb_alloc_arena *arena, lblock *lb)
+{
+  lb->prev = NULL;
+  lb->next = arena->large;
+  if (arena->large) arena->large->prev = lb;
+  arena->large = lb;
+}
+
+static void
+large_unlink(mrb_alloc_arena *arena, lblock *lb)
+{
+  if (lb->prev) lb->prev->next = lb->next;
+  else arena->large = lb->next;
+  if (lb->next) lb->next->prev = lb->prev;
+}
+
+static void
+remote_push(mrb_alloc_arena *owner, freeblk *blk)
+{
+  freeblk *head = owner->remote_free;
+
+  do {
+    blk->next = head;
+  } while (!ARENA_CAS(&owner->remote_free, &head, blk));
+}
+
+/* move everything foreign states freed back onto our free lists */
+static void
+remote_drain(mrb_alloc_arena *arena)
+{
+  freeblk *blk = (freeblk*)ARENA_XCHG(&arena->remote_free, NULL);
+
+  while (blk) {
+    freeblk *next = blk->next;
+    ablock *hdr = (ablock*)blk - 1;
+    int cls = class_for(hdr->size);
+
+    if (cls < 0) {
+      lblock *lb = LBLOCK_OF(hdr);
+
+      large_unlink(arena, lb);
+      arena->fallback(NULL, lb, 0, arena->fallback_ud);
+    }
+    else {
+      blk->next = arena->free_list[cls];
+      arena->free_list[cls] = blk;
+      arena->live[cls] -= hdr->size;
+    }
+    blk = next;
+  }
+}
+
+/* carve a fresh page into blocks of one class */
+static mrb_bool
+carve_page(mrb_alloc_arena *arena, int cls)
+{
+  size_t blk_size = sizeof(ablock) + class_sizes[cls];
+  char *p, *end;
+  apage *page = (apage*)arena->fallback(NULL, NULL, ARENA_PAGE_SIZE, arena->fallback_ud);
+
+  if (!page) return FALSE;
+  page->next = arena->pages;
+  arena->pages = page;
+  p = (char*)page + sizeof(ablock);   /* keep payloads aligned */
+  end = (char*)page + ARENA_PAGE_SIZE;
+  while (p + blk_size <= end) {
+    ablock *hdr = (ablock*)p;
+    freeblk *blk = (freeblk*)(hdr + 1);
+
+    hdr->arena = arena;
+    hdr->size = class_sizes[cls];
+    blk->next = arena->free_list[cls];
+    arena->free_list[cls] = blk;
+    arena->capa[cls] += class_sizes[cls];
+    p += blk_size;
+  }
+  return TRUE;
+}
+
+static void*
+arena_alloc(mrb_alloc_arena *arena, size_t size)
+{
+  int cls = class_for(size);
+  freeblk *blk;
+
+  if (cls < 0) {
+    lblock *lb = (lblock*)arena->fallback(NULL, NULL, sizeof(lblock) + size, arena->fallback_ud);
+
+    if (!lb) return NULL;
+    lb->hdr.arena = arena;
+    lb->hdr.size = size;
+    large_link(arena, lb);
+    return (void*)(&lb->hdr + 1);
+  }
+  if (!arena->free_list[cls]) {
+    remote_drain(arena);
+  }
+  if (!arena->free_list[cls] && !carve_page(arena, cls)) {
+    return NULL;
+  }
+  blk = arena->free_list[cls];
+  arena->free_list[cls] = blk->next;
+  arena->live[cls] += class_sizes[cls];
+  return (void*)blk;
+}
+
+static void
+arena_dealloc(mrb_alloc_arena *arena, void *p)
+{
+  ablock *hdr = (ablock*)p - 1;
+  int cls = class_for(hdr->size);
+
+  if (hdr->arena != arena) {
+    remote_push(hdr->arena, (freeblk*)p);
+  }
+  else if (cls < 0) {
+    lblock *lb = LBLOCK_OF(hdr);
+
+    large_unlink(arena, lb);
+    arena->fallback(NULL, lb, 0, arena->fallback_ud);
+  }
+  else {
+    freeblk *blk = (freeblk*)p;
+
+    blk->next = arena->free_list[cls];
+    arena->free_list[cls] = blk;
+    arena->live[cls] -= hdr->size;
+  }
+}
+
+void*
+mrb_alloc_arena_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  mrb_alloc_arena *arena = (mrb_alloc_arena*)ud;
+  ablock *hdr;
+  void *q;
+
+  if (size == 0) {
+    if (p) arena_dealloc(arena, p);
+    return NULL;
+  }
+  if (!p) {
+    return arena_alloc(arena, size);
+  }
+  hdr = (ablock*)p - 1;
+  if (size <= hdr->size) {
+    return p;                       /* shrink or refit within the block */
+  }
+  if (hdr->arena == arena && class_for(hdr->size) < 0) {
+    /* grow a large block in place; relocation moves its list header,
+       so take it off the list around the realloc */
+    lblock *lb = LBLOCK_OF(hdr);
+    lblock *nlb;
+
+    large_unlink(arena, lb);
+    nlb = (lblock*)arena->fallback(NULL, lb, sizeof(lblock) + size, arena->fallback_ud);
+    if (!nlb) {
+      large_link(arena, lb);        /* a failed realloc leaves it valid */
+      return NULL;
+    }
+    nlb->hdr.size = size;
+    large_link(arena, nlb);
+    return (void*)(&nlb->hdr + 1);
+  }
+  q = arena_alloc(arena, size);
+  if (!q) return NULL;
+  memcpy(q, p, hdr->size);
+  arena_dealloc(arena, p);
+  return q;
+}
+
+MRB_API mrb_alloc_arena*
+mrb_alloc_arena_new(mrb_allocf fallback, void *fallback_ud)
+{
+  mrb_alloc_arena *arena;
+
+  if (!fallback) fallback = mrb_default_allocf;
+  arena = (mrb_alloc_arena*)fallback(NULL, NULL, sizeof(mrb_alloc_arena), fallback_ud);
+  if (!arena) return NULL;
+  memset(arena, 0, sizeof(mrb_alloc_arena));
+  arena->fallback = fallback;
+  arena->fallback_ud = fallback_ud;
+  return arena;
+}
+
+MRB_API void
+mrb_alloc_arena_free(mrb_alloc_arena *arena)
+{
+  apage *page = arena->pages;
+  lblock *lb;
+
+  remote_drain(arena);    /* reclaim what foreign states freed last */
+  lb = arena->large;
+  while (lb) {
+    lblock *next = lb->next;
+
+    arena->fallback(NULL, lb, 0, arena->fallback_ud);
+    lb = next;
+  }
+  while (page) {
+    apage *next = page->next;
+
+    arena->fallback(NULL, page, 0, arena->fallback_ud);
+    page = next;
+  }
+  arena->fallback(NULL, arena, 0, arena->fallback_ud);
+}
+
+MRB_API mrb_alloc_arena*
+mrb_alloc_arena_of(mrb_state *mrb)
+{
+  if (mrb->allocf != mrb_alloc_arena_allocf) return NULL;
+  return (mrb_alloc_arena*)mrb->allocf_ud;
+}
+
+MRB_API void
+mrb_alloc_arena_stats(mrb_alloc_arena *arena, mrb_alloc_arena_stat stats[MRB_ALLOC_ARENA_CLASSES])
+{
+  int cls;
+
+  for (cls = 0; cls < MRB_ALLOC_ARENA_CLASSES; cls++) {
+    stats[cls].block_size = class_sizes[cls];
+    stats[cls].bytes_live = arena->live[cls];
+    stats[cls].bytes_capacity = arena->capa[cls];
+  }
+}
+
+/* ArenaAlloc.stats -> { block_size => [bytes_live, bytes_capacity] }
+   or nil when the state was not opened with an arena */
+static mrb_value
+arena_stats_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_alloc_arena *arena = mrb_alloc_arena_of(mrb);
+  mrb_alloc_arena_stat stats[MRB_ALLOC_ARENA_CLASSES];
+  mrb_value h;
+  int cls;
+
+  if (!arena) return mrb_nil_value();
+  mrb_alloc_arena_stats(arena, stats);
+  h = mrb_hash_new_capa(mrb, MRB_ALLOC_ARENA_CLASSES);
+  for (cls = 0; cls < MRB_ALLOC_ARENA_CLASSES; cls++) {
+    mrb_value pair = mrb_ary_new_capa(mrb, 2);
+
+    mrb_ary_push(mrb, pair, mrb_fixnum_value((mrb_int)stats[cls].bytes_live));
+    mrb_ary_push(mrb, pair, mrb_fixnum_value((mrb_int)stats[cls].bytes_capacity));
+    mrb_hash_set(mrb, h, mrb_fixnum_value((mrb_int)stats[cls].block_size), pair);
+  }
+  return h;
+}
+
+void
+mrb_mruby_arena_alloc_gem_init(mrb_state *mrb)
+{
+  struct RClass *mod = mrb_define_module(mrb, "ArenaAlloc");
+
+  mrb_define_module_function(mrb, mod, "stats", arena_stats_m, MRB_ARGS_NONE());
+}
+
+void
+mrb_mruby_arena_alloc_gem_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,153 @@
+#include <stdlib.h>
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/compile.h>
+#include <mruby/data.h>
+#include <mruby/variable.h>
+#include <mruby/arena_alloc.h>
+
+/* open a state on a fresh arena, make it allocate, and report
+   [some_capacity, live_le_capacity, stats_seen] */
+static mrb_value
+run_roundtrip(mrb_state *mrb, mrb_value self)
+{
+  mrb_alloc_arena *arena = mrb_alloc_arena_new(NULL, NULL);
+  mrb_alloc_arena_stat stats[MRB_ALLOC_ARENA_CLASSES];
+  mrb_state *mrb2;
+  mrb_value ret[3];
+  size_t capa = 0;
+  mrb_bool ordered = TRUE, seen;
+  int cls;
+
+  if (!arena) mrb_raise(mrb, E_RUNTIME_ERROR, "arena_new failed");
+  mrb2 = mrb_open_allocf(mrb_alloc_arena_allocf, arena);
+  if (!mrb2) {
+    mrb_alloc_arena_free(arena);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "mrb_open_allocf failed");
+  }
+  mrb_load_string(mrb2, "$a = []; 100.times { |i| $a << ('x' * (i % 64)) << {i => i} }");
+  seen = !mrb_nil_p(mrb_load_string(mrb2, "ArenaAlloc.stats"));
+  mrb_alloc_arena_stats(arena, stats);
+  for (cls = 0; cls < MRB_ALLOC_ARENA_CLASSES; cls++) {
+    capa += stats[cls].bytes_capacity;
+    if (stats[cls].bytes_live > stats[cls].bytes_capacity) ordered = FALSE;
+  }
+  mrb_close(mrb2);
+  mrb_alloc_arena_free(arena);
+  ret[0] = mrb_bool_value(capa > 0);
+  ret[1] = mrb_bool_value(ordered);
+  ret[2] = mrb_bool_value(seen);
+  return mrb_ary_new_from_values(mrb, 3, ret);
+}
+
+/* free a block of arena A through arena B and check A reclaims it on
+   its next allocation */
+static mrb_value
+run_remote_free(mrb_state *mrb, mrb_value self)
+{
+  mrb_alloc_arena *a = mrb_alloc_arena_new(NULL, NULL);
+  mrb_alloc_arena *b = mrb_alloc_arena_new(NULL, NULL);
+  mrb_alloc_arena_stat stats[MRB_ALLOC_ARENA_CLASSES];
+  void *p, *blks[300];
+  size_t live_before, live_after;
+  mrb_value ret[2];
+  int i;
+
+  if (!a || !b) mrb_raise(mrb, E_RUNTIME_ERROR, "arena_new failed");
+  p = mrb_alloc_arena_allocf(NULL, NULL, 64, a);
+  mrb_alloc_arena_stats(a, stats);
+  live_before = stats[3].bytes_live;          /* the 64-byte class */
+  mrb_alloc_arena_allocf(NULL, p, 0, b);      /* foreign free */
+  /* churn through more than one page so the owner's free list runs
+     dry and the remote list gets drained */
+  for (i = 0; i < 300; i++) {
+    blks[i] = mrb_alloc_arena_allocf(NULL, NULL, 64, a);
+  }
+  for (i = 0; i < 300; i++) {
+    mrb_alloc_arena_allocf(NULL, blks[i], 0, a);
+  }
+  mrb_alloc_arena_stats(a, stats);
+  live_after = stats[3].bytes_live;           /* 0 only if p came home */
+  mrb_alloc_arena_free(b);
+  mrb_alloc_arena_free(a);
+  ret[0] = mrb_bool_value(live_before == 64);
+  ret[1] = mrb_bool_value(live_after == 0);   /* remote block came home */
+  return mrb_ary_new_from_values(mrb, 2, ret);
+}
+
+/* fallback that counts outstanding blocks, so the test below can prove
+   the arena returned every byte it ever drew */
+struct count_ud {
+  size_t outstanding;
+};
+
+static void*
+counting_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  struct count_ud *c = (struct count_ud*)ud;
+
+  if (size == 0) {
+    if (p) {
+      c->outstanding--;
+      free(p);
+    }
+    return NULL;
+  }
+  if (!p) c->outstanding++;
+  return realloc(p, size);
+}
+
+static int fast_close_dfrees;
+
+static void
+count_dfree(mrb_state *mrb, void *p)
+{
+  fast_close_dfrees++;
+}
+
+static const mrb_data_type count_dt = { "fastclose", count_dfree };
+
+/* close an arena-backed state with mrb_close_fast and check that the
+   RData finalizers ran and that dropping the arena leaked nothing
+   through the counting fallback */
+static mrb_value
+run_fast_close(mrb_state *mrb, mrb_value self)
+{
+  struct count_ud cnt = { 0 };
+  mrb_alloc_arena *arena;
+  mrb_state *mrb2;
+  mrb_value ary, ret[2];
+  int i;
+
+  fast_close_dfrees = 0;
+  arena = mrb_alloc_arena_new(counting_allocf, &cnt);
+  if (!arena) mrb_raise(mrb, E_RUNTIME_ERROR, "arena_new failed");
+  mrb2 = mrb_open_allocf(mrb_alloc_arena_allocf, arena);
+  if (!mrb2) {
+    mrb_alloc_arena_free(arena);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "mrb_open_allocf failed");
+  }
+  mrb_load_string(mrb2, "$a = []; 50.times { |i| $a << ('y' * 400) << {i => 'z' * (i % 32)} }");
+  ary = mrb_ary_new(mrb2);
+  mrb_gv_set(mrb2, mrb_intern_lit(mrb2, "$d"), ary);
+  for (i = 0; i < 3; i++) {
+    mrb_ary_push(mrb2, ary,
+                 mrb_obj_value(mrb_data_object_alloc(mrb2, mrb2->object_class, NULL, &count_dt)));
+  }
+  mrb_close_fast(mrb2);
+  mrb_alloc_arena_free(arena);
+  ret[0] = mrb_bool_value(fast_close_dfrees == 3);
+  ret[1] = mrb_bool_value(cnt.outstanding == 0);
+  return mrb_ary_new_from_values(mrb, 2, ret);
+}
+
+void
+mrb_mruby_arena_alloc_gem_test(mrb_state *mrb)
+{
+  struct RClass *cls;
+
+  cls = mrb_define_class(mrb, "ArenaAllocTest", mrb->object_class);
+  mrb_define_module_function(mrb, cls, "roundtrip", run_roundtrip, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, cls, "remote_free", run_remote_free, MRB_ARGS_NONE());
+  mrb_define_module_function(mrb, cls, "fast_close", run_fast_close, MRB_ARGS_NONE());
+}
@@ -0,0 +1,21 @@
+assert('ArenaAlloc.stats without an arena') do
+  # the test state runs on the default allocator
+  assert_nil ArenaAlloc.stats
+end
+
+assert('arena-backed state round trip') do
+  capa, ordered, seen = ArenaAllocTest.roundtrip
+  assert_true capa     # small allocations were served from size classes
+  assert_true ordered  # live bytes never exceed carved capacity
+  assert_true seen     # ArenaAlloc.stats reports inside the arena state
+end
+
+assert('cross-state free returns blocks to the owner') do
+  assert_equal [true, true], ArenaAllocTest.remote_free
+end
+
+assert('mrb_close_fast runs finalizers and leaks nothing past the arena') do
+  dfrees, reclaimed = ArenaAllocTest.fast_close
+  assert_true dfrees     # every RData dfree still ran
+  assert_true reclaimed  # the arena returned every fallback byte
+end
@@ -24,48 +24,6 @@ class Array
     end
   end
 
-  ##
-  # call-seq:
-  #    ary.uniq!                -> ary or nil
-  #    ary.uniq! { |item| ... } -> ary or nil
-  #
-  # Removes duplicate elements from +self+.
-  # Returns <code>nil</code> if no changes are made (that is, no
-  # duplicates are found).
-  #
-  #    a = [ "a", "a", "b", "b", "c" ]
-  #    a.uniq!   #=> ["a", "b", "c"]
-  #    b = [ "a", "b", "c" ]
-  #    b.uniq!   #=> nil
-  #    c = [["student","sam"], ["student","george"], ["teacher","matz"]]
-  #    c.uniq! { |s| s.first } # => [["student", "sam"], ["teacher", "matz"]]
-  #
-  def uniq!(&block)
-    ary = self.dup
-    result = []
-    if block
-      hash = {}
-      while ary.size > 0
-        val = ary.shift
-        key = block.call(val)
-        hash[key] = val unless hash.has_key?(key)
-      end
-      hash.each_value do |value|
-        result << value
-      end
-    else
-      while ary.size > 0
-        result << ary.shift
-        ary.delete(result.last)
-      end
-    end
-    if result.size == self.size
-      nil
-    else
-      self.replace(result)
-    end
-  end
-
   ##
   # call-seq:
   #    ary.uniq                -> new_ary
@@ -89,68 +47,6 @@ class Array
     ary
   end
 
-  ##
-  # call-seq:
-  #    ary - other_ary    -> new_ary
-  #
-  # Array Difference---Returns a new array that is a copy of
-  # the original array, removing any items that also appear in
-  # <i>other_ary</i>. (If you need set-like behavior, see the
-  # library class Set.)
-  #
-  #    [ 1, 1, 2, 2, 3, 3, 4, 5 ] - [ 1, 2, 4 ]  #=>  [ 3, 3, 5 ]
-  #
-  def -(elem)
-    raise TypeError, "can't convert #{elem.class} into Array" unless elem.class == Array
-
-    hash = {}
-    array = []
-    elem.each { |x| hash[x] = true }
-    self.each { |x| array << x unless hash[x] }
-    array
-  end
-
-  ##
-  # call-seq:
-  #    ary | other_ary     -> new_ary
-  #
-  # Set Union---Returns a new array by joining this array with
-  # <i>other_ary</i>, removing duplicates.
-  #
-  #    [ "a", "b", "c" ] | [ "c", "d", "a" ]
-  #           #=> [ "a", "b", "c", "d" ]
-  #
-  def |(elem)
-    raise TypeError, "can't convert #{elem.class} into Array" unless elem.class == Array
-
-    ary = self + elem
-    ary.uniq! or ary
-  end
-
-  ##
-  # call-seq:
-  #    ary & other_ary      -> new_ary
-  #
-  # Set Intersection---Returns a new array
-  # containing elements common to the two arrays, with no duplicates.
-  #
-  #    [ 1, 1, 3, 5 ] & [ 1, 2, 3 ]   #=> [ 1, 3 ]
-  #
-  def &(elem)
-    raise TypeError, "can't convert #{elem.class} into Array" unless elem.class == Array
-
-    hash = {}
-    array = []
-    elem.each{|v| hash[v] = true }
-    self.each do |v|
-      if hash[v]
-        array << v
-        hash.delete v
-      end
-    end
-    array
-  end
-
   ##
   # call-seq:
   #    ary.flatten -> new_ary
@@ -3,6 +3,8 @@
 #include <mruby/array.h>
 #include <mruby/range.h>
 #include <mruby/hash.h>
+#include <mruby/class.h>
+#include <mruby/compar.h>
 
 /*
  *  call-seq:
@@ -149,6 +151,340 @@ mrb_ary_to_h(mrb_state *mrb, mrb_value ary)
   return hash;
 }
 
+/* set operations below key a temporary Hash by the elements of one
+   operand and stream the other through it, so they are O(n) with no
+   per-probe method dispatch */
+
+static void
+ary_to_key_set(mrb_state *mrb, mrb_value hash, mrb_value ary)
+{
+  mrb_int i;
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (i = 0; i < RARRAY_LEN(ary); i++) {
+    mrb_hash_set(mrb, hash, RARRAY_PTR(ary)[i], mrb_true_value());
+    mrb_gc_arena_restore(mrb, ai);
+  }
+}
+
+static mrb_value
+ary_set_operand(mrb_state *mrb)
+{
+  mrb_value other;
+
+  mrb_get_args(mrb, "o", &other);
+  if (!mrb_array_p(other)) {
+    mrb_raisef(mrb, E_TYPE_ERROR, "can't convert %S into Array",
+               mrb_obj_value(mrb_obj_class(mrb, other)));
+  }
+  return other;
+}
+
+/*
+ *  call-seq:
+ *     ary.uniq!                -> ary or nil
+ *     ary.uniq! { |item| ... } -> ary or nil
+ *
+ *  Removes duplicate elements from +self+.
+ *  Returns <code>nil</code> if no changes are made (that is, no
+ *  duplicates are found).
+ *
+ *     a = [ "a", "a", "b", "b", "c" ]
+ *     a.uniq!   #=> ["a", "b", "c"]
+ *     b = [ "a", "b", "c" ]
+ *     b.uniq!   #=> nil
+ */
+
+static mrb_value
+mrb_ary_uniq_bang(mrb_state *mrb, mrb_value self)
+{
+  mrb_value blk, seen, result;
+  mrb_int i;
+  int ai;
+
+  mrb_get_args(mrb, "&", &blk);
+  seen = mrb_hash_new_capa(mrb, RARRAY_LEN(self));
+  result = mrb_ary_new_capa(mrb, RARRAY_LEN(self));
+  ai = mrb_gc_arena_save(mrb);
+  /* re-read length and pointer each pass; the block may mutate self */
+  for (i = 0; i < RARRAY_LEN(self); i++) {
+    mrb_value v = RARRAY_PTR(self)[i];
+    mrb_value k = mrb_nil_p(blk) ? v : mrb_yield(mrb, blk, v);
+
+    if (!mrb_test(mrb_hash_get(mrb, seen, k))) {
+      mrb_hash_set(mrb, seen, k, mrb_true_value());
+      mrb_ary_push(mrb, result, v);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  if (RARRAY_LEN(result) == RARRAY_LEN(self)) return mrb_nil_value();
+  mrb_ary_replace(mrb, self, result);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     ary - other_ary    -> new_ary
+ *
+ *  Array Difference---Returns a new array that is a copy of
+ *  the original array, removing any items that also appear in
+ *  <i>other_ary</i>.
+ *
+ *     [ 1, 1, 2, 2, 3, 3, 4, 5 ] - [ 1, 2, 4 ]  #=>  [ 3, 3, 5 ]
+ */
+
+static mrb_value
+mrb_ary_diff(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other = ary_set_operand(mrb);
+  mrb_value drop, result;
+  mrb_int i;
+  int ai;
+
+  drop = mrb_hash_new_capa(mrb, RARRAY_LEN(other));
+  ary_to_key_set(mrb, drop, other);
+  result = mrb_ary_new(mrb);
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 0; i < RARRAY_LEN(self); i++) {
+    mrb_value v = RARRAY_PTR(self)[i];
+
+    if (!mrb_test(mrb_hash_get(mrb, drop, v))) {
+      mrb_ary_push(mrb, result, v);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     ary | other_ary     -> new_ary
+ *
+ *  Set Union---Returns a new array by joining this array with
+ *  <i>other_ary</i>, removing duplicates.
+ *
+ *     [ "a", "b", "c" ] | [ "c", "d", "a" ]
+ *            #=> [ "a", "b", "c", "d" ]
+ */
+
+static mrb_value
+mrb_ary_union(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other = ary_set_operand(mrb);
+  mrb_value seen, result;
+  mrb_value operands[2];
+  mrb_int i, n;
+  int ai;
+
+  seen = mrb_hash_new_capa(mrb, RARRAY_LEN(self) + RARRAY_LEN(other));
+  result = mrb_ary_new_capa(mrb, RARRAY_LEN(self));
+  operands[0] = self;
+  operands[1] = other;
+  ai = mrb_gc_arena_save(mrb);
+  for (n = 0; n < 2; n++) {
+    for (i = 0; i < RARRAY_LEN(operands[n]); i++) {
+      mrb_value v = RARRAY_PTR(operands[n])[i];
+
+      if (!mrb_test(mrb_hash_get(mrb, seen, v))) {
+        mrb_hash_set(mrb, seen, v, mrb_true_value());
+        mrb_ary_push(mrb, result, v);
+      }
+      mrb_gc_arena_restore(mrb, ai);
+    }
+  }
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     ary & other_ary      -> new_ary
+ *
+ *  Set Intersection---Returns a new array
+ *  containing elements common to the two arrays, with no duplicates.
+ *
+ *     [ 1, 1, 3, 5 ] & [ 1, 2, 3 ]   #=> [ 1, 3 ]
+ */
+
+static mrb_value
+mrb_ary_intersect(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other = ary_set_operand(mrb);
+  mrb_value keep, result;
+  mrb_int i;
+  int ai;
+
+  keep = mrb_hash_new_capa(mrb, RARRAY_LEN(other));
+  ary_to_key_set(mrb, keep, other);
+  result = mrb_ary_new(mrb);
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 0; i < RARRAY_LEN(self); i++) {
+    mrb_value v = RARRAY_PTR(self)[i];
+
+    if (mrb_test(mrb_hash_get(mrb, keep, v))) {
+      mrb_ary_push(mrb, result, v);
+      mrb_hash_delete_key(mrb, keep, v);   /* no duplicates in the result */
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     ary.reserve(capa) -> ary
+ *
+ *  Pre-allocates internal storage for at least +capa+ elements, so a
+ *  following sequence of pushes up to that size never reallocates.
+ *  The length of the array does not change.
+ *
+ *     a = []
+ *     a.reserve(1000)
+ *     1000.times { |i| a << i }   # no reallocation
+ */
+
+static mrb_value
+mrb_ary_reserve_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_int capa;
+
+  mrb_get_args(mrb, "i", &capa);
+  if (capa < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array capacity");
+  }
+  mrb_ary_reserve(mrb, self, capa);
+  return self;
+}
+
+/* order `val` against `result`, through the block when one is given,
+   otherwise through the prepared `<=>` handle */
+static mrb_int
+ary_minmax_cmp(mrb_state *mrb, mrb_prepared_call *call, mrb_value block,
+               mrb_value val, mrb_value result)
+{
+  mrb_int c;
+
+  if (mrb_nil_p(block)) {
+    c = mrb_cmp_prepared(mrb, call, val, result);
+  }
+  else {
+    mrb_value argv[2];
+
+    argv[0] = val;
+    argv[1] = result;
+    c = mrb_cmp(mrb, mrb_yield_argv(mrb, block, 2, argv), mrb_fixnum_value(0));
+  }
+  if (c == MRB_CMP_FAILED) {
+    mrb_raisef(mrb, E_ARGUMENT_ERROR, "comparison of %S with %S failed",
+               mrb_obj_value(mrb_obj_class(mrb, val)),
+               mrb_obj_value(mrb_obj_class(mrb, result)));
+  }
+  return c;
+}
+
+/*
+ *  call-seq:
+ *     ary.min                  -> obj
+ *     ary.min {|a, b| block}   -> obj
+ *
+ *  Returns the object in the array with the minimum value, ordered by
+ *  <code><=></code> or by the block.  Overrides the each-driven
+ *  Enumerable#min; elements are walked and compared natively, with
+ *  <code><=></code> resolved once for the whole scan.
+ */
+static mrb_value
+mrb_ary_min(mrb_state *mrb, mrb_value self)
+{
+  mrb_value block, result;
+  mrb_prepared_call call = { 0 };
+  mrb_int i;
+  int ai;
+
+  mrb_get_args(mrb, "&", &block);
+  if (RARRAY_LEN(self) == 0) return mrb_nil_value();
+  result = RARRAY_PTR(self)[0];
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 1; i < RARRAY_LEN(self); i++) {
+    mrb_value val = RARRAY_PTR(self)[i];
+
+    if (ary_minmax_cmp(mrb, &call, block, val, result) < 0) {
+      result = val;
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     ary.max                  -> obj
+ *     ary.max {|a, b| block}   -> obj
+ *
+ *  Returns the object in the array with the maximum value; the native
+ *  counterpart of Array#min.
+ */
+static mrb_value
+mrb_ary_max(mrb_state *mrb, mrb_value self)
+{
+  mrb_value block, result;
+  mrb_prepared_call call = { 0 };
+  mrb_int i;
+  int ai;
+
+  mrb_get_args(mrb, "&", &block);
+  if (RARRAY_LEN(self) == 0) return mrb_nil_value();
+  result = RARRAY_PTR(self)[0];
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 1; i < RARRAY_LEN(self); i++) {
+    mrb_value val = RARRAY_PTR(self)[i];
+
+    if (ary_minmax_cmp(mrb, &call, block, val, result) > 0) {
+      result = val;
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+/*
+ *  call-seq:
+ *     ary.minmax                  -> [min, max]
+ *     ary.minmax {|a, b| block}   -> [min, max]
+ *
+ *  Returns both extremes in one native pass.
+ */
+static mrb_value
+mrb_ary_minmax(mrb_state *mrb, mrb_value self)
+{
+  mrb_value block, min, max, ret;
+  mrb_prepared_call call = { 0 };
+  mrb_int i;
+  int ai;
+
+  mrb_get_args(mrb, "&", &block);
+  ret = mrb_ary_new_capa(mrb, 2);
+  if (RARRAY_LEN(self) == 0) {
+    mrb_ary_push(mrb, ret, mrb_nil_value());
+    mrb_ary_push(mrb, ret, mrb_nil_value());
+    return ret;
+  }
+  min = max = RARRAY_PTR(self)[0];
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 1; i < RARRAY_LEN(self); i++) {
+    mrb_value val = RARRAY_PTR(self)[i];
+
+    if (ary_minmax_cmp(mrb, &call, block, val, min) < 0) {
+      min = val;
+    }
+    else if (ary_minmax_cmp(mrb, &call, block, val, max) > 0) {
+      max = val;
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb_ary_push(mrb, ret, min);
+  mrb_ary_push(mrb, ret, max);
+  return ret;
+}
+
 void
 mrb_mruby_array_ext_gem_init(mrb_state* mrb)
 {
@@ -159,6 +495,14 @@ mrb_mruby_array_ext_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, a, "rassoc", mrb_ary_rassoc, MRB_ARGS_REQ(1));
   mrb_define_method(mrb, a, "values_at", mrb_ary_values_at, MRB_ARGS_ANY());
   mrb_define_method(mrb, a, "to_h",   mrb_ary_to_h, MRB_ARGS_REQ(0));
+  mrb_define_method(mrb, a, "reserve", mrb_ary_reserve_m, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, a, "uniq!",  mrb_ary_uniq_bang, MRB_ARGS_NONE());
+  mrb_define_method(mrb, a, "-",      mrb_ary_diff,      MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, a, "|",      mrb_ary_union,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, a, "&",      mrb_ary_intersect, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, a, "min",    mrb_ary_min,    MRB_ARGS_NONE() | MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, a, "max",    mrb_ary_max,    MRB_ARGS_NONE() | MRB_ARGS_BLOCK());
+  mrb_define_method(mrb, a, "minmax", mrb_ary_minmax, MRB_ARGS_NONE() | MRB_ARGS_BLOCK());
 }
 
 void
@@ -317,3 +317,33 @@ assert("Array#dig") do
   assert_nil(h.dig(2, 0))
   assert_raise(TypeError) {h.dig(:a)}
 end
+
+assert("Array#reserve") do
+  a = [1, 2]
+  assert_equal a, a.reserve(100)
+  assert_equal [1, 2], a
+  100.times { |i| a << i }
+  assert_equal 102, a.size
+  assert_raise(ArgumentError) { [].reserve(-1) }
+end
+
+assert("Array#min") do
+  assert_nil [].min
+  assert_equal 1, [3, 1, 2].min
+  assert_equal "a", ["b", "a", "c"].min
+  assert_equal 3, [3, 1, 2].min { |a, b| b <=> a }
+  assert_raise(ArgumentError) { [1, "a"].min }
+end
+
+assert("Array#max") do
+  assert_nil [].max
+  assert_equal 3, [3, 1, 2].max
+  assert_equal "c", ["b", "a", "c"].max
+  assert_equal 1, [3, 1, 2].max { |a, b| b <=> a }
+end
+
+assert("Array#minmax") do
+  assert_equal [nil, nil], [].minmax
+  assert_equal [1, 3], [3, 1, 2].minmax
+  assert_equal [3, 1], [3, 1, 2].minmax { |a, b| b <=> a }
+end
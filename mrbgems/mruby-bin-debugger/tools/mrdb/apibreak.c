@@ -82,6 +82,89 @@ free_breakpoint( mrb_state *mrb, mrb_debug_breakpoint *bp )
   }
 }
 
+static mrb_bool
+patchable_pos_p( mrb_irep *irep, uint32_t pos )
+{
+  if(GET_OPCODE(irep->iseq[pos]) == OP_TRAP) {
+    return FALSE;
+  }
+  if(pos > 0) {
+    /* the second word of a fused pair is read through pc[1] by the
+       superinstruction and must stay a real instruction */
+    switch(GET_OPCODE(irep->iseq[pos - 1])) {
+      case OP_SELFSEND:
+      case OP_MOVESEND:
+      case OP_IVSEND:
+      case OP_JMPLT:
+      case OP_JMPLE:
+      case OP_JMPGT:
+      case OP_JMPGE:
+      case OP_JMPEQ:
+        return FALSE;
+      default:
+        break;
+    }
+  }
+  return TRUE;
+}
+
+static void
+patch_line_irep( mrb_state *mrb, mrb_irep *irep, mrb_debug_breakpoint *bp )
+{
+  const char *file = bp->point.linepoint.file;
+  uint16_t lineno = bp->point.linepoint.lineno;
+  uint32_t pos;
+  uint16_t r_idx;
+
+  if((irep->debug_info != NULL) && !(irep->flags & MRB_ISEQ_NO_FREE)) {
+    for(pos = 0 ; pos < irep->ilen ; pos++) {
+      const char *f;
+      mrb_debug_patchpoint *pp;
+      mrb_code orig;
+
+      if(mrb_debug_get_line(irep, pos) != lineno) continue;
+      if((pos > 0) && (mrb_debug_get_line(irep, pos - 1) == lineno)) continue;
+      if(!patchable_pos_p(irep, pos)) continue;
+      f = mrb_debug_get_filename(irep, pos);
+      if((f == NULL) || (strcmp(f, file) != 0)) continue;
+
+      orig = irep->iseq[pos];
+      /* displaced quickened sends deoptimize by rewriting their own
+         word, which would erase the trap; store the generic form */
+      if((GET_OPCODE(orig) == OP_SENDC) || (GET_OPCODE(orig) == OP_SENDL)) {
+        orig = MKOP_ABC(OP_SEND, GETARG_A(orig), GETARG_B(orig), GETARG_C(orig));
+      }
+
+      pp = mrb_malloc(mrb, sizeof(mrb_debug_patchpoint));
+      pp->irep = irep;
+      pp->pos = pos;
+      pp->orig = orig;
+      pp->next = bp->patch;
+      bp->patch = pp;
+      irep->iseq[pos] = MKOP_Ax(OP_TRAP, bp->bpno);
+    }
+  }
+  for(r_idx = 0 ; r_idx < irep->rlen ; r_idx++) {
+    patch_line_irep(mrb, irep->reps[r_idx], bp);
+  }
+}
+
+static void
+unpatch_breakpoint( mrb_state *mrb, mrb_debug_breakpoint *bp, mrb_bool restore )
+{
+  mrb_debug_patchpoint *pp = bp->patch;
+
+  while(pp != NULL) {
+    mrb_debug_patchpoint *next = pp->next;
+    if((restore == TRUE) && (GET_OPCODE(pp->irep->iseq[pp->pos]) == OP_TRAP)) {
+      pp->irep->iseq[pp->pos] = pp->orig;
+    }
+    mrb_free(mrb, pp);
+    pp = next;
+  }
+  bp->patch = NULL;
+}
+
 static uint16_t
 check_file_lineno( struct mrb_irep *irep, const char *file, uint16_t lineno )
 {
@@ -210,12 +293,15 @@ mrb_debug_set_break_line( mrb_state *mrb, mrb_debug_context *dbg, const char *fi
   dbg->bp[index].enable = TRUE;
   dbg->bp[index].type = MRB_DEBUG_BPTYPE_LINE;
   dbg->bp[index].point.linepoint.lineno = lineno;
+  dbg->bp[index].patch = NULL;
   dbg->bpnum++;
 
   strncpy(set_file, file, strlen(file) + 1);
 
   dbg->bp[index].point.linepoint.file = set_file;
 
+  patch_line_irep(mrb, dbg->root_irep, &dbg->bp[index]);
+
   return dbg->bp[index].bpno;
 }
 
@@ -257,6 +343,7 @@ mrb_debug_set_break_method( mrb_state *mrb, mrb_debug_context *dbg, const char *
   dbg->bp[index].type = MRB_DEBUG_BPTYPE_METHOD;
   dbg->bp[index].point.methodpoint.method_name = set_method;
   dbg->bp[index].point.methodpoint.class_name = set_class;
+  dbg->bp[index].patch = NULL;
   dbg->bpnum++;
 
   return dbg->bp[index].bpno;
@@ -330,6 +417,9 @@ mrb_debug_delete_break( mrb_state *mrb, mrb_debug_context *dbg, uint32_t bpno )
     return MRB_DEBUG_BREAK_INVALID_NO;
   }
 
+  /* once the program has finished its ireps may already be freed;
+     only restore patched words while they are still alive */
+  unpatch_breakpoint(mrb, &dbg->bp[index], dbg->xphase != DBG_PHASE_AFTER_RUN);
   free_breakpoint(mrb, &dbg->bp[index]);
 
   for(i = index ; i < dbg->bpnum; i++) {
@@ -356,6 +446,7 @@ mrb_debug_delete_break_all( mrb_state *mrb, mrb_debug_context *dbg )
   }
 
   for(i = 0 ; i < dbg->bpnum ; i++) {
+    unpatch_breakpoint(mrb, &dbg->bp[i], dbg->xphase != DBG_PHASE_AFTER_RUN);
     free_breakpoint(mrb, &dbg->bp[i]);
   }
 
@@ -464,7 +555,8 @@ mrb_debug_check_breakpoint_line( mrb_state *mrb, mrb_debug_context *dbg, const c
   for(i=0; i<dbg->bpnum; i++) {
     switch (bp->type) {
       case MRB_DEBUG_BPTYPE_LINE:
-        if(bp->enable == TRUE) {
+        /* patched breakpoints stop through the trap hook instead */
+        if((bp->enable == TRUE) && (bp->patch == NULL)) {
           line_p = &bp->point.linepoint;
           if((strcmp(line_p->file, file) == 0) && (line_p->lineno == line)) {
             return bp->bpno;
@@ -513,4 +605,75 @@ mrb_debug_check_breakpoint_method( mrb_state *mrb, mrb_debug_context *dbg, struc
   return 0;
 }
 
+int32_t
+mrb_debug_check_breakpoint_trap( mrb_state *mrb, mrb_debug_context *dbg, struct mrb_irep *irep, mrb_code *pc, mrb_code *orig )
+{
+  mrb_debug_patchpoint *pp;
+  uint32_t pos;
+  uint32_t i;
+
+  *orig = *pc;
+  if((mrb == NULL) || (dbg == NULL) || (irep == NULL)) {
+    return MRB_DEBUG_INVALID_ARGUMENT;
+  }
+
+  pos = (uint32_t)(pc - irep->iseq);
+  for(i = 0 ; i < dbg->bpnum ; i++) {
+    for(pp = dbg->bp[i].patch ; pp != NULL ; pp = pp->next) {
+      if((pp->irep == irep) && (pp->pos == pos)) {
+        *orig = pp->orig;
+        if(dbg->bp[i].enable == TRUE) {
+          return dbg->bp[i].bpno;
+        }
+        return MRB_DEBUG_OK;
+      }
+    }
+  }
+  /* stray trap without an owner; *orig stays the trap itself and the
+     VM steps over it like OP_NOP */
+  return MRB_DEBUG_OK;
+}
+
+void
+mrb_debug_repatch_break_all( mrb_state *mrb, mrb_debug_context *dbg )
+{
+  uint32_t i;
+
+  if((mrb == NULL) || (dbg == NULL)) {
+    return;
+  }
+
+  for(i = 0 ; i < dbg->bpnum ; i++) {
+    /* the patched ireps died with the restarted state; drop the stale
+       patchpoints without touching them and patch the new tree */
+    unpatch_breakpoint(mrb, &dbg->bp[i], FALSE);
+    if((dbg->bp[i].type == MRB_DEBUG_BPTYPE_LINE) && (dbg->root_irep != NULL)) {
+      patch_line_irep(mrb, dbg->root_irep, &dbg->bp[i]);
+    }
+  }
+}
+
+mrb_bool
+mrb_debug_unpatched_break_p( mrb_debug_context *dbg )
+{
+  uint32_t i;
+
+  if(dbg == NULL) {
+    return FALSE;
+  }
+
+  for(i = 0 ; i < dbg->bpnum ; i++) {
+    if(dbg->bp[i].enable == FALSE) {
+      continue;
+    }
+    if(dbg->bp[i].type == MRB_DEBUG_BPTYPE_METHOD) {
+      return TRUE;
+    }
+    if((dbg->bp[i].type == MRB_DEBUG_BPTYPE_LINE) && (dbg->bp[i].patch == NULL)) {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
 
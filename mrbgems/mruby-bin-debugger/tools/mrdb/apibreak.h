@@ -22,5 +22,8 @@ int32_t mrb_debug_disable_break( mrb_state *, mrb_debug_context *, uint32_t );
 int32_t mrb_debug_disable_break_all( mrb_state *, mrb_debug_context * );
 int32_t mrb_debug_check_breakpoint_line( mrb_state *, mrb_debug_context *, const char *, uint16_t );
 int32_t mrb_debug_check_breakpoint_method( mrb_state *, mrb_debug_context *, struct RClass *, mrb_sym, mrb_bool* );
+int32_t mrb_debug_check_breakpoint_trap( mrb_state *, mrb_debug_context *, struct mrb_irep *, mrb_code *, mrb_code * );
+void mrb_debug_repatch_break_all( mrb_state *, mrb_debug_context * );
+mrb_bool mrb_debug_unpatched_break_p( mrb_debug_context * );
 
 #endif /* APIBREAK_H_ */
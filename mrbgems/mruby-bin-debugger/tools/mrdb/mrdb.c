@@ -520,9 +520,36 @@ check_method_breakpoint(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value
   switch(GET_OPCODE(*pc)) {
     case OP_SEND:
     case OP_SENDB:
+    case OP_SENDC:
+    case OP_SENDL:
+    case OP_TAILCALL:
       c = mrb_class(mrb, regs[GETARG_A(*pc)]);
       sym = irep->syms[GETARG_B(*pc)];
       break;
+    /* fused superinstructions: the send is in the following word and
+       its receiver register may be about to be overwritten */
+    case OP_SELFSEND:
+      c = mrb_class(mrb, regs[0]);
+      sym = irep->syms[GETARG_B(pc[1])];
+      break;
+    case OP_MOVESEND:
+      if (GETARG_A(*pc) == GETARG_A(pc[1])) {
+        c = mrb_class(mrb, regs[GETARG_B(*pc)]);
+      }
+      else {
+        c = mrb_class(mrb, regs[GETARG_A(pc[1])]);
+      }
+      sym = irep->syms[GETARG_B(pc[1])];
+      break;
+    case OP_IVSEND:
+      if (GETARG_A(*pc) == GETARG_A(pc[1])) {
+        c = mrb_class(mrb, mrb_vm_iv_get(mrb, irep->syms[GETARG_Bx(*pc)]));
+      }
+      else {
+        c = mrb_class(mrb, regs[GETARG_A(pc[1])]);
+      }
+      sym = irep->syms[GETARG_B(pc[1])];
+      break;
     case OP_SUPER:
       c = mrb->c->ci->target_class->super;
       sym = mrb->c->ci->mid;
@@ -542,6 +569,68 @@ check_method_breakpoint(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value
   return bpno;
 }
 
+static void mrb_code_fetch_hook(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value *regs);
+
+/* the per-instruction fetch hook slows the debuggee by orders of
+   magnitude; line breakpoints live in the iseq as OP_TRAP patches, so
+   the hook is only kept installed while it is actually needed: for
+   stepping, for breakpoints the patcher could not place, and for the
+   one fetch that reports a pending method breakpoint */
+static void
+mrb_debug_sync_hooks(mrb_state *mrb, mrb_debug_context *dbg)
+{
+  if (dbg->xm == DBG_RUN && dbg->method_bpno == 0 &&
+      !mrb_debug_unpatched_break_p(dbg)) {
+    mrb->code_fetch_hook = NULL;
+  }
+  else {
+    mrb->code_fetch_hook = mrb_code_fetch_hook;
+  }
+}
+
+static mrb_code
+mrb_breakpoint_hook(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value *regs)
+{
+  mrb_code orig;
+  int32_t bpno;
+  mrb_bool skip;
+  mrb_debug_context *dbg = mrb_debug_context_get(mrb);
+
+  mrb_assert(dbg);
+
+  bpno = mrb_debug_check_breakpoint_trap(mrb, dbg, irep, pc, &orig);
+
+  /* when the fetch hook just prompted on this very word (a step landed
+     on the patched instruction), resuming must not stop here again */
+  skip = (pc == dbg->stopped_pc);
+  dbg->stopped_pc = NULL;
+  if (skip || bpno <= 0 || dbg->xm != DBG_RUN || dbg->in_prompt) {
+    return orig;
+  }
+
+  dbg->irep = irep;
+  dbg->pc   = pc;
+  dbg->regs = regs;
+  dbg->prvfile = mrb_debug_get_filename(irep, (uint32_t)(pc - irep->iseq));
+  dbg->prvline = mrb_debug_get_line(irep, (uint32_t)(pc - irep->iseq));
+  dbg->method_bpno = 0;
+  dbg->stopped_bpno = bpno;
+  dbg->isCfunc = FALSE;
+  dbg->bm = BRK_BREAK;
+
+  if (--dbg->ccnt > 0) {
+    return orig;
+  }
+
+  dbg->in_prompt = TRUE;
+  dbg->break_hook(mrb, dbg);
+  dbg->in_prompt = FALSE;
+  dbg->xphase = DBG_PHASE_RUNNING;
+  mrb_debug_sync_hooks(mrb, dbg);
+
+  return orig;
+}
+
 static void
 mrb_code_fetch_hook(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value *regs)
 {
@@ -564,6 +653,10 @@ mrb_code_fetch_hook(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value *reg
     dbg->prvci = NULL;
     dbg->xm = DBG_RUN;
     dbg->xphase = DBG_PHASE_RUNNING;
+    /* the restart longjmped out of a prompt; reset its bookkeeping */
+    dbg->in_prompt = FALSE;
+    dbg->stopped_pc = NULL;
+    mrb_debug_repatch_break_all(mrb, dbg);
   }
 
   file = mrb_debug_get_filename(irep, (uint32_t)(pc - irep->iseq));
@@ -626,7 +719,11 @@ mrb_code_fetch_hook(mrb_state *mrb, mrb_irep *irep, mrb_code *pc, mrb_value *reg
   if(dbg->bm == BRK_BREAK && --dbg->ccnt > 0) {
     return;
   }
+  dbg->stopped_pc = pc;
+  dbg->in_prompt = TRUE;
   dbg->break_hook(mrb, dbg);
+  dbg->in_prompt = FALSE;
+  mrb_debug_sync_hooks(mrb, dbg);
 
   dbg->xphase = DBG_PHASE_RUNNING;
 }
@@ -694,6 +791,7 @@ main(int argc, char **argv)
   
   /* setup hook functions */
   mrb->code_fetch_hook = mrb_code_fetch_hook;
+  mrb->breakpoint_hook = mrb_breakpoint_hook;
   mrdb->dbg->break_hook = mrb_debug_break_hook;
 
   if (args.mrbfile) { /* .mrb */
@@ -91,6 +91,15 @@ typedef struct mrb_debug_methodpoint {
   const char *method_name;
 } mrb_debug_methodpoint;
 
+/* one OP_TRAP patched into an iseq for a line breakpoint; the original
+   instruction is kept here and executed through mrb->breakpoint_hook */
+typedef struct mrb_debug_patchpoint {
+  struct mrb_irep *irep;
+  uint32_t pos;                 /* iseq index holding the trap */
+  mrb_code orig;                /* displaced instruction */
+  struct mrb_debug_patchpoint *next;
+} mrb_debug_patchpoint;
+
 typedef struct mrb_debug_breakpoint {
   uint32_t bpno;
   uint8_t enable;
@@ -99,6 +108,9 @@ typedef struct mrb_debug_breakpoint {
     mrb_debug_linepoint linepoint;
     mrb_debug_methodpoint methodpoint;
   } point;
+  mrb_debug_patchpoint *patch;  /* line breakpoints only; NULL when the
+                                   iseq could not be patched and the
+                                   code fetch hook must check the line */
 } mrb_debug_breakpoint;
 
 typedef struct mrb_debug_context {
@@ -125,6 +137,10 @@ typedef struct mrb_debug_context {
   int32_t method_bpno;
   int32_t stopped_bpno;
   mrb_bool isCfunc;
+  mrb_code *stopped_pc;         /* pc the fetch hook last prompted at; a
+                                   trap there must not prompt again */
+  mrb_bool in_prompt;           /* a break_hook is on the stack; traps
+                                   hit while evaluating must not nest */
 
   mrdb_exemode (*break_hook)(mrb_state *mrb, struct mrb_debug_context *dbg);
 
@@ -0,0 +1,269 @@
+/*
+** microbench.c - focused timers around mruby's hot primitives
+**
+** Whole-program benchmarks (benchmark/bm_*.rb) tell us that something
+** moved; this driver tells us which primitive.  Each bench runs its
+** inner operation ITERS times inside a timed loop and reports
+** nanoseconds per operation, so numbers are comparable across
+** revisions:
+**
+**     microbench [scale]
+**
+** `scale` multiplies every iteration count (default 1); use a larger
+** value on fast machines to push per-op noise down.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/compile.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/value.h>
+#include <mruby/variable.h>
+
+static double
+now_sec(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static void
+report(const char *name, long iters, double sec)
+{
+  printf("%-28s %12ld iters %10.4f s %10.1f ns/op\n",
+         name, iters, sec, sec / (double)iters * 1e9);
+}
+
+/* run a script and die loudly if it raised; benchmarks must not
+   silently measure exception unwinding */
+static mrb_value
+run(mrb_state *mrb, const char *code)
+{
+  mrb_value v = mrb_load_string(mrb, code);
+
+  if (mrb->exc) {
+    mrb_print_error(mrb);
+    exit(EXIT_FAILURE);
+  }
+  return v;
+}
+
+/* OP_SEND dispatch: a while loop of sends minus the empty loop */
+static void
+bench_op_send(mrb_state *mrb, long scale)
+{
+  long iters = 1000000 * scale;
+  double t0, loop_sec, send_sec;
+  char code[256];
+
+  run(mrb, "def __mb_m; nil; end");
+  snprintf(code, sizeof(code), "i = 0; while i < %ld; i += 1; end", iters);
+  t0 = now_sec();
+  run(mrb, code);
+  loop_sec = now_sec() - t0;
+  snprintf(code, sizeof(code), "i = 0; while i < %ld; __mb_m; i += 1; end", iters);
+  t0 = now_sec();
+  run(mrb, code);
+  send_sec = now_sec() - t0;
+  report("op_send", iters, send_sec - loop_sec);
+}
+
+static void
+bench_method_search(mrb_state *mrb, long scale)
+{
+  long iters = 2000000 * scale, i;
+  mrb_sym mid = mrb_intern_lit(mrb, "length");
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    struct RClass *c = mrb->string_class;
+    mrb_method_search_vm(mrb, &c, mid);
+  }
+  report("method_search_vm", iters, now_sec() - t0);
+}
+
+static void
+bench_hash(mrb_state *mrb, long scale, mrb_int size)
+{
+  long iters = 1000000 * scale, i;
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_value h = mrb_hash_new_capa(mrb, size);
+  mrb_int k;
+  double t0;
+  char name[64];
+
+  for (k = 0; k < size; k++) {
+    mrb_hash_set(mrb, h, mrb_fixnum_value(k), mrb_fixnum_value(k));
+  }
+  t0 = now_sec();
+  for (i = 0; i < iters; i++) {
+    mrb_hash_get(mrb, h, mrb_fixnum_value((mrb_int)i % size));
+  }
+  snprintf(name, sizeof(name), "hash_get[%d]", (int)size);
+  report(name, iters, now_sec() - t0);
+  t0 = now_sec();
+  for (i = 0; i < iters; i++) {
+    mrb_hash_set(mrb, h, mrb_fixnum_value((mrb_int)i % size), mrb_fixnum_value((mrb_int)i));
+  }
+  snprintf(name, sizeof(name), "hash_set[%d]", (int)size);
+  report(name, iters, now_sec() - t0);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+static void
+bench_str_hash(mrb_state *mrb, long scale)
+{
+  long iters = 2000000 * scale, i;
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_value s = mrb_str_new_lit(mrb, "a medium sized string key 123456");
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    mrb_str_hash(mrb, s);
+  }
+  report("str_hash", iters, now_sec() - t0);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+static void
+bench_str_cat(mrb_state *mrb, long scale)
+{
+  long iters = 200000 * scale, i;
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value s = mrb_str_buf_new(mrb, 0);
+    int j;
+
+    for (j = 0; j < 16; j++) {
+      mrb_str_cat_lit(mrb, s, "01234567");
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  report("str_cat(16x8)", iters, now_sec() - t0);
+}
+
+static void
+bench_ary_push(mrb_state *mrb, long scale)
+{
+  long iters = 200000 * scale, i;
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_value a = mrb_ary_new(mrb);
+    int j;
+
+    for (j = 0; j < 16; j++) {
+      mrb_ary_push(mrb, a, mrb_fixnum_value(j));
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  report("ary_push(16)", iters, now_sec() - t0);
+}
+
+static void
+bench_intern(mrb_state *mrb, long scale)
+{
+  long iters = 1000000 * scale, i;
+  double t0 = now_sec();
+  char name[32];
+
+  for (i = 0; i < iters; i++) {
+    snprintf(name, sizeof(name), "mb_sym_%ld", i % 64);
+    mrb_intern_cstr(mrb, name);
+  }
+  report("intern(64 hot)", iters, now_sec() - t0);
+}
+
+static void
+bench_fiber_resume(mrb_state *mrb, long scale)
+{
+  long iters = 200000 * scale, i;
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_value fib = run(mrb, "Fiber.new { loop { Fiber.yield } }");
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    mrb_funcall(mrb, fib, "resume", 0);
+  }
+  report("fiber_resume", iters, now_sec() - t0);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+static void
+bench_gc(mrb_state *mrb, long scale)
+{
+  long iters = 200 * scale, i;
+  double t0;
+
+  /* populate a retained graph plus garbage so both generations work */
+  run(mrb, "$mb_keep = (1..5000).map { |i| [i.to_s, {i => i}] }");
+  run(mrb, "10000.times { |i| [i.to_s] }");
+  t0 = now_sec();
+  for (i = 0; i < iters; i++) {
+    mrb_incremental_gc(mrb);
+  }
+  report("gc_minor_cycle", iters, now_sec() - t0);
+  t0 = now_sec();
+  for (i = 0; i < iters; i++) {
+    mrb_full_gc(mrb);
+  }
+  report("gc_major_cycle", iters, now_sec() - t0);
+}
+
+static void
+bench_funcall(mrb_state *mrb, long scale)
+{
+  long iters = 1000000 * scale, i;
+  mrb_value obj = mrb_fixnum_value(41);
+  double t0 = now_sec();
+
+  for (i = 0; i < iters; i++) {
+    int ai = mrb_gc_arena_save(mrb);
+    mrb_funcall(mrb, obj, "succ", 0);
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  report("funcall_from_c", iters, now_sec() - t0);
+}
+
+int
+main(int argc, char **argv)
+{
+  long scale = (argc > 1) ? strtol(argv[1], NULL, 10) : 1;
+  mrb_state *mrb = mrb_open();
+
+  if (!mrb) {
+    fputs("microbench: mrb_open failed\n", stderr);
+    return EXIT_FAILURE;
+  }
+  if (scale < 1) scale = 1;
+  printf("mruby microbench (scale %ld)\n", scale);
+  bench_op_send(mrb, scale);
+  bench_method_search(mrb, scale);
+  bench_funcall(mrb, scale);
+  bench_hash(mrb, scale, 8);
+  bench_hash(mrb, scale, 256);
+  bench_hash(mrb, scale, 8192);
+  bench_str_hash(mrb, scale);
+  bench_str_cat(mrb, scale);
+  bench_ary_push(mrb, scale);
+  bench_intern(mrb, scale);
+  bench_fiber_resume(mrb, scale);
+  bench_gc(mrb, scale);
+  mrb_close(mrb);
+  return EXIT_SUCCESS;
+}
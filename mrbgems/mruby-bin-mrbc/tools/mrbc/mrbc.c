@@ -5,6 +5,17 @@
 #include <mruby/compile.h>
 #include <mruby/dump.h>
 #include <mruby/proc.h>
+#include <mruby/irep.h>
+#include <mruby/opcode.h>
+#include <mruby/debug.h>
+
+#if !defined(_WIN32) && !defined(MRBC_NO_PARALLEL)
+# define MRBC_PARALLEL
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+void mrb_codedump_stats(mrb_state *mrb, struct RProc *proc, FILE *out);
 
 #define RITEBIN_EXT ".mrb"
 #define C_EXT       ".c"
@@ -13,11 +24,14 @@ struct mrbc_args {
   int argc;
   char **argv;
   int idx;
+  int jobs;
   const char *prog;
   const char *outfile;
   const char *initname;
   mrb_bool check_syntax : 1;
   mrb_bool verbose      : 1;
+  mrb_bool dump_stats   : 1;
+  mrb_bool structs      : 1;
   unsigned int flags    : 4;
 };
 
@@ -31,6 +45,11 @@ usage(const char *name)
   "-v           print version number, then turn on verbose mode",
   "-g           produce debugging information",
   "-B<symbol>   binary <symbol> output in C language format",
+  "-R<symbol>   constructed irep structs in C language format (execute-in-place)",
+  "-C           generate a compact (varint-encoded) irep section",
+  "-S           print bytecode statistics as JSON instead of compiling",
+  "-j[N]        compile input files in parallel with N workers (default: CPU count);",
+  "             each file becomes its own top-level scope in the output",
   "-e           generate little endian iseq data",
   "-E           generate big endian iseq data",
   "--verbose    run at verbose mode",
@@ -95,6 +114,9 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
           args->outfile = get_outfilename(mrb, argv[i] + 2, "");
         }
         break;
+      case 'R':
+        args->structs = TRUE;
+        /* fall through; takes a symbol name exactly like -B */
       case 'B':
         if (argv[i][2] == '\0' && argv[i+1]) {
           i++;
@@ -118,6 +140,16 @@ parse_args(mrb_state *mrb, int argc, char **argv, struct mrbc_args *args)
       case 'g':
         args->flags |= DUMP_DEBUG_INFO;
         break;
+      case 'C':
+        args->flags |= DUMP_COMPACT;
+        break;
+      case 'S':
+        args->dump_stats = TRUE;
+        break;
+      case 'j':
+        args->jobs = (argv[i][2] != '\0') ? atoi(argv[i] + 2) : -1;
+        if (args->jobs == 0) args->jobs = -1;  /* -j0 means autodetect too */
+        break;
       case 'E':
         args->flags = DUMP_ENDIAN_BIG | (args->flags & ~DUMP_ENDIAN_MASK);
         break;
@@ -226,13 +258,229 @@ load_file(mrb_state *mrb, struct mrbc_args *args)
   return result;
 }
 
+#ifdef MRBC_PARALLEL
+
+struct mrbc_unit {
+  const char *file;             /* input path */
+  uint8_t *bin;                 /* RITE image built by the worker state */
+  size_t len;
+  mrb_bool failed;
+};
+
+struct mrbc_queue {
+  pthread_mutex_t lock;         /* guards next */
+  int next;
+  int count;
+  struct mrbc_unit *units;
+  const struct mrbc_args *args;
+};
+
+/* compiles one input file in a private mrb_state and keeps the result
+   as a native-endian RITE image; reloading the image in the linking
+   state remaps symbol and literal references into that state */
+static void
+compile_unit(const struct mrbc_args *args, struct mrbc_unit *unit)
+{
+  mrb_state *mrb = mrb_open();
+  mrbc_context *c;
+  FILE *infile, *binfp;
+  mrb_value result;
+  char *bin = NULL;
+  size_t len = 0;
+  int n;
+
+  unit->failed = TRUE;
+  if (mrb == NULL) {
+    fprintf(stderr, "%s: cannot allocate compiler state. (%s)\n", args->prog, unit->file);
+    return;
+  }
+  c = mrbc_context_new(mrb);
+  c->no_exec = TRUE;
+  mrbc_filename(mrb, c, unit->file);
+  if ((infile = fopen(unit->file, "r")) == NULL) {
+    fprintf(stderr, "%s: cannot open program file. (%s)\n", args->prog, unit->file);
+    mrbc_context_free(mrb, c);
+    mrb_close(mrb);
+    return;
+  }
+  result = mrb_load_file_cxt(mrb, infile, c);
+  fclose(infile);
+  if (mrb_undef_p(result) || mrb_nil_p(result)) {
+    mrbc_context_free(mrb, c);
+    mrb_close(mrb);
+    return;
+  }
+  if ((binfp = open_memstream(&bin, &len)) == NULL) {
+    mrbc_context_free(mrb, c);
+    mrb_close(mrb);
+    return;
+  }
+  n = mrb_dump_irep_binary(mrb, mrb_proc_ptr(result)->body.irep,
+                           args->flags & DUMP_DEBUG_INFO, binfp);
+  fclose(binfp);
+  mrbc_context_free(mrb, c);
+  mrb_close(mrb);
+  if (n != MRB_DUMP_OK) {
+    fprintf(stderr, "%s: error in mrb dump (%s) %d\n", args->prog, unit->file, n);
+    free(bin);
+    return;
+  }
+  unit->bin = (uint8_t*)bin;
+  unit->len = len;
+  unit->failed = FALSE;
+}
+
+static void*
+worker_main(void *p)
+{
+  struct mrbc_queue *q = (struct mrbc_queue *)p;
+
+  for (;;) {
+    struct mrbc_unit *unit;
+
+    pthread_mutex_lock(&q->lock);
+    if (q->next >= q->count) {
+      pthread_mutex_unlock(&q->lock);
+      return NULL;
+    }
+    unit = &q->units[q->next++];
+    pthread_mutex_unlock(&q->lock);
+    compile_unit(q->args, unit);
+  }
+}
+
+/* builds a driver irep that runs each compiled file in order: every
+   unit becomes a child irep invoked as a block, so files keep their
+   own top-level local scopes but share self and constants */
+static mrb_irep*
+link_units(mrb_state *mrb, struct mrbc_queue *q)
+{
+  mrb_irep *root = mrb_add_irep(mrb);
+  int i;
+
+  /* R(0) self, R(1) per-file proc, R(2) working register for the send */
+  root->nlocals = 1;
+  root->nregs = 3;
+  root->rlen = (size_t)q->count;
+  root->reps = (mrb_irep**)mrb_calloc(mrb, q->count, sizeof(mrb_irep*));
+  root->slen = 1;
+  root->syms = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym));
+  root->syms[0] = mrb_intern_lit(mrb, "call");
+  root->ilen = (size_t)q->count * 2 + 1;
+  root->iseq = (mrb_code*)mrb_malloc(mrb, sizeof(mrb_code) * root->ilen);
+  for (i = 0; i < q->count; i++) {
+    /* mrb_read_irep would keep pointers into the unit image, which is
+       freed right after linking; the FILE* reader makes a full copy */
+    FILE *binfp = fmemopen(q->units[i].bin, q->units[i].len, "rb");
+    mrb_irep *unit = binfp ? mrb_read_irep_file(mrb, binfp) : NULL;
+
+    if (binfp) fclose(binfp);
+    if (unit == NULL) {
+      fprintf(stderr, "%s: cannot reload compiled unit. (%s)\n",
+              q->args->prog, q->units[i].file);
+      return NULL;
+    }
+    /* a top-level irep ends with OP_STOP; as a child it must return
+       to the driver instead of halting the VM */
+    if (unit->ilen > 0 && GET_OPCODE(unit->iseq[unit->ilen - 1]) == OP_STOP) {
+      unit->iseq[unit->ilen - 1] = MKOP_AB(OP_RETURN, 0, OP_R_NORMAL);
+    }
+    root->reps[i] = unit;
+    root->iseq[i*2]   = MKOP_Abc(OP_LAMBDA, 1, i, OP_L_BLOCK);
+    root->iseq[i*2+1] = MKOP_ABC(OP_SEND, 1, 0, 0);
+  }
+  root->iseq[root->ilen - 1] = MKOP_A(OP_STOP, 0);
+  /* the driver has no source of its own; an empty entry keeps -g dumps
+     emitting the debug section for the units */
+  mrb_debug_info_alloc(mrb, root);
+  return root;
+}
+
+static mrb_irep*
+compile_parallel(mrb_state *mrb, struct mrbc_args *args)
+{
+  struct mrbc_queue q;
+  pthread_t *threads = NULL;
+  mrb_irep *root = NULL;
+  int i, nworkers, spawned = 0;
+  int nfiles = args->argc - args->idx;
+  mrb_bool failed = FALSE;
+
+  q.next = 0;
+  q.count = nfiles;
+  q.args = args;
+  q.units = (struct mrbc_unit*)mrb_calloc(mrb, nfiles, sizeof(struct mrbc_unit));
+  for (i = 0; i < nfiles; i++) {
+    q.units[i].file = args->argv[args->idx + i];
+  }
+  pthread_mutex_init(&q.lock, NULL);
+
+  nworkers = args->jobs;
+  if (nworkers < 1) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    nworkers = (n > 0) ? (int)n : 1;
+  }
+  if (nworkers > nfiles) nworkers = nfiles;
+  if (args->verbose) {
+    fprintf(stderr, "%s: compiling %d files with %d workers\n", args->prog, nfiles, nworkers);
+  }
+
+  /* the main thread drains the queue alongside nworkers-1 helpers, so
+     a failed pthread_create degrades to fewer workers, never to a hang */
+  if (nworkers > 1) {
+    threads = (pthread_t*)mrb_malloc(mrb, sizeof(pthread_t) * (nworkers - 1));
+    for (i = 0; i < nworkers - 1; i++) {
+      if (pthread_create(&threads[spawned], NULL, worker_main, &q) == 0) {
+        spawned++;
+      }
+    }
+  }
+  worker_main(&q);
+  for (i = 0; i < spawned; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  mrb_free(mrb, threads);
+  pthread_mutex_destroy(&q.lock);
+
+  for (i = 0; i < nfiles; i++) {
+    if (q.units[i].failed) failed = TRUE;
+  }
+  if (!failed) {
+    root = link_units(mrb, &q);
+  }
+  for (i = 0; i < nfiles; i++) {
+    free(q.units[i].bin);
+  }
+  mrb_free(mrb, q.units);
+  return root;
+}
+
+/* -j covers the plain many-files-to-one-output compile; syntax check,
+   stats and stdin input stay on the sequential path */
+static mrb_bool
+parallel_ok_p(const struct mrbc_args *args)
+{
+  int i;
+
+  if (args->argc - args->idx < 2) return FALSE;
+  if (args->check_syntax || args->dump_stats) return FALSE;
+  for (i = args->idx; i < args->argc; i++) {
+    if (args->argv[i][0] == '-' && args->argv[i][1] == '\0') return FALSE;
+  }
+  return TRUE;
+}
+
+#endif  /* MRBC_PARALLEL */
+
 static int
-dump_file(mrb_state *mrb, FILE *wfp, const char *outfile, struct RProc *proc, struct mrbc_args *args)
+dump_file(mrb_state *mrb, FILE *wfp, const char *outfile, mrb_irep *irep, struct mrbc_args *args)
 {
   int n = MRB_DUMP_OK;
-  mrb_irep *irep = proc->body.irep;
 
-  if (args->initname) {
+  if (args->structs) {
+    n = mrb_dump_irep_struct(mrb, irep, args->flags, wfp, args->initname);
+  }
+  else if (args->initname) {
     n = mrb_dump_irep_cfunc(mrb, irep, args->flags, wfp, args->initname);
     if (n == MRB_DUMP_INVALID_ARGUMENT) {
       fprintf(stderr, "%s: invalid C language symbol name\n", args->initname);
@@ -255,6 +503,8 @@ main(int argc, char **argv)
   struct mrbc_args args;
   FILE *wfp;
   mrb_value load;
+  mrb_irep *irep;
+  mrb_bool linked = FALSE;
 
   if (mrb == NULL) {
     fputs("Invalid mrb_state, exiting mrbc\n", stderr);
@@ -271,7 +521,7 @@ main(int argc, char **argv)
     fprintf(stderr, "%s: no program file given\n", args.prog);
     return EXIT_FAILURE;
   }
-  if (args.outfile == NULL && !args.check_syntax) {
+  if (args.outfile == NULL && !args.check_syntax && !args.dump_stats) {
     if (n + 1 == argc) {
       args.outfile = get_outfilename(mrb, argv[n], args.initname ? C_EXT : RITEBIN_EXT);
     }
@@ -282,18 +532,40 @@ main(int argc, char **argv)
   }
 
   args.idx = n;
-  load = load_file(mrb, &args);
-  if (mrb_nil_p(load)) {
-    cleanup(mrb, &args);
-    return EXIT_FAILURE;
-  }
-  if (args.check_syntax) {
-    printf("%s:%s:Syntax OK\n", args.prog, argv[n]);
+#ifdef MRBC_PARALLEL
+  if (args.jobs != 0 && parallel_ok_p(&args)) {
+    irep = compile_parallel(mrb, &args);
+    if (irep == NULL) {
+      cleanup(mrb, &args);
+      return EXIT_FAILURE;
+    }
+    linked = TRUE;
   }
+  else
+#endif
+  {
+    if (args.jobs != 0 && args.verbose) {
+      fprintf(stderr, "%s: -j ignored; compiling sequentially\n", args.prog);
+    }
+    load = load_file(mrb, &args);
+    if (mrb_nil_p(load)) {
+      cleanup(mrb, &args);
+      return EXIT_FAILURE;
+    }
+    if (args.check_syntax) {
+      printf("%s:%s:Syntax OK\n", args.prog, argv[n]);
+    }
 
-  if (args.check_syntax) {
-    cleanup(mrb, &args);
-    return EXIT_SUCCESS;
+    if (args.check_syntax) {
+      cleanup(mrb, &args);
+      return EXIT_SUCCESS;
+    }
+    if (args.dump_stats) {
+      mrb_codedump_stats(mrb, mrb_proc_ptr(load), stdout);
+      cleanup(mrb, &args);
+      return EXIT_SUCCESS;
+    }
+    irep = mrb_proc_ptr(load)->body.irep;
   }
 
   if (args.outfile) {
@@ -309,8 +581,9 @@ main(int argc, char **argv)
     fprintf(stderr, "Output file is required\n");
     return EXIT_FAILURE;
   }
-  result = dump_file(mrb, wfp, args.outfile, mrb_proc_ptr(load), &args);
+  result = dump_file(mrb, wfp, args.outfile, irep, &args);
   fclose(wfp);
+  if (linked) mrb_irep_decref(mrb, irep);  /* sequential ireps belong to their proc */
   cleanup(mrb, &args);
   if (result != MRB_DUMP_OK) {
     return EXIT_FAILURE;
@@ -7,6 +7,18 @@
 #include <mruby/dump.h>
 #include <mruby/variable.h>
 
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <limits.h>
+#include <mruby/irep.h>
+#include <mruby/proc.h>
+#ifndef PATH_MAX
+#define PATH_MAX 4096
+#endif
+#endif
+
 #ifdef MRB_DISABLE_STDIO
 static void
 p(mrb_state *mrb, mrb_value obj)
@@ -154,6 +166,195 @@ append_cmdline:
   return EXIT_SUCCESS;
 }
 
+#ifndef _WIN32
+/* Transparent compile cache for `mruby foo.rb`: the compiled RITE
+   binary is kept under $XDG_CACHE_HOME/mruby (falling back to
+   ~/.cache/mruby) and revalidated against the script's size and mtime,
+   the way CPython keeps .pyc files next to their sources.  Every
+   failure mode -- no HOME, an unwritable directory, a truncated or
+   stale entry -- silently falls back to a normal compile, so the cache
+   is never needed for correctness.  Set MRUBY_NO_CACHE to disable it. */
+
+void mrb_codedump_all(mrb_state*, struct RProc*);
+
+#define CACHE_MAGIC "mruby cache 0001"
+
+struct cache_key {
+  char magic[16];
+  uint64_t src_size;
+  int64_t src_mtime;
+  uint32_t path_len;            /* absolute source path follows */
+};
+
+static uint64_t
+cache_hash(const char *s)
+{
+  /* FNV-1a; only has to spread paths over file names */
+  uint64_t h = 14695981039346656037ULL;
+
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static mrb_bool
+cache_file_path(const char *abspath, char *buf, size_t len)
+{
+  const char *base = getenv("XDG_CACHE_HOME");
+  size_t n;
+
+  if (base && base[0]) {
+    if ((size_t)snprintf(buf, len, "%s", base) >= len) return FALSE;
+    mkdir(buf, 0777);           /* EEXIST is the common case */
+    if ((size_t)snprintf(buf, len, "%s/mruby", base) >= len) return FALSE;
+  }
+  else {
+    base = getenv("HOME");
+    if (!base || !base[0]) return FALSE;
+    if ((size_t)snprintf(buf, len, "%s/.cache", base) >= len) return FALSE;
+    mkdir(buf, 0777);
+    if ((size_t)snprintf(buf, len, "%s/.cache/mruby", base) >= len) return FALSE;
+  }
+  mkdir(buf, 0777);
+  n = strlen(buf);
+  if ((size_t)snprintf(buf + n, len - n, "/%016llx.mrb",
+                       (unsigned long long)cache_hash(abspath)) >= len - n) {
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* runs the cached binary for abspath if one matches; *hit says whether
+   it did (an exception from the script still counts as a hit) */
+static mrb_value
+cache_load(mrb_state *mrb, const char *cpath, const char *abspath,
+           const struct stat *st, mrbc_context *c, mrb_bool *hit)
+{
+  FILE *fp;
+  struct cache_key key;
+  char path[PATH_MAX];
+  uint8_t *bin = NULL;
+  long pos, paylen;
+  mrb_irep *irep;
+  struct RProc *proc;
+
+  *hit = FALSE;
+  fp = fopen(cpath, "rb");
+  if (!fp) return mrb_nil_value();
+  if (fread(&key, sizeof(key), 1, fp) != 1 ||
+      memcmp(key.magic, CACHE_MAGIC, sizeof(key.magic)) != 0 ||
+      key.src_size != (uint64_t)st->st_size ||
+      key.src_mtime != (int64_t)st->st_mtime ||
+      key.path_len == 0 || key.path_len >= sizeof(path) ||
+      fread(path, 1, key.path_len, fp) != key.path_len) {
+    goto stale;
+  }
+  path[key.path_len] = '\0';
+  if (strcmp(path, abspath) != 0) goto stale;   /* file name collision */
+  pos = ftell(fp);
+  if (pos < 0 || fseek(fp, 0, SEEK_END) != 0) goto stale;
+  paylen = ftell(fp) - pos;
+  if (paylen <= 0 || fseek(fp, pos, SEEK_SET) != 0) goto stale;
+  bin = (uint8_t*)mrb_malloc(mrb, (size_t)paylen);
+  if (fread(bin, 1, (size_t)paylen, fp) != (size_t)paylen) goto stale;
+  fclose(fp);
+
+  /* the RITE loader revalidates the header, version and CRC; the irep
+     borrows iseq, pool strings and symbol names from bin, so the buffer
+     must outlive the state -- it is ours until the process exits */
+  irep = mrb_read_irep(mrb, bin);
+  if (!irep) {
+    mrb_free(mrb, bin);
+    unlink(cpath);
+    return mrb_nil_value();
+  }
+  *hit = TRUE;
+  proc = mrb_proc_new(mrb, irep);
+  mrb_irep_decref(mrb, irep);
+  if (c->dump_result) mrb_codedump_all(mrb, proc);
+  proc->target_class = mrb->object_class;
+  if (mrb->c->ci) mrb->c->ci->target_class = mrb->object_class;
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+
+stale:
+  fclose(fp);
+  if (bin) mrb_free(mrb, bin);
+  unlink(cpath);
+  return mrb_nil_value();
+}
+
+static void
+cache_store(mrb_state *mrb, const char *cpath, const char *abspath,
+            const struct stat *st, struct RProc *proc)
+{
+  struct cache_key key;
+  uint8_t *bin = NULL;
+  size_t bin_size = 0;
+  char tmp[PATH_MAX + 48];
+  FILE *fp;
+  mrb_bool ok;
+
+  /* debug info is kept so backtrace line numbers survive caching */
+  if (mrb_dump_irep(mrb, proc->body.irep, DUMP_DEBUG_INFO, &bin, &bin_size) != MRB_DUMP_OK) {
+    return;
+  }
+  if ((size_t)snprintf(tmp, sizeof(tmp), "%s.%d~", cpath, (int)getpid()) >= sizeof(tmp) ||
+      (fp = fopen(tmp, "wb")) == NULL) {
+    mrb_free(mrb, bin);
+    return;
+  }
+  memset(&key, 0, sizeof(key));         /* keep struct padding off disk */
+  memcpy(key.magic, CACHE_MAGIC, sizeof(key.magic));
+  key.src_size = (uint64_t)st->st_size;
+  key.src_mtime = (int64_t)st->st_mtime;
+  key.path_len = (uint32_t)strlen(abspath);
+  ok = fwrite(&key, sizeof(key), 1, fp) == 1 &&
+       fwrite(abspath, 1, key.path_len, fp) == key.path_len &&
+       fwrite(bin, 1, bin_size, fp) == bin_size;
+  if (fclose(fp) != 0) ok = FALSE;
+  if (ok) {
+    rename(tmp, cpath);         /* atomic publish */
+  }
+  else {
+    unlink(tmp);
+  }
+  mrb_free(mrb, bin);
+}
+
+static mrb_value
+load_file_cached(mrb_state *mrb, struct _args *args, mrbc_context *c)
+{
+  char abspath[PATH_MAX];
+  char cpath[PATH_MAX + 32];
+  struct stat st;
+  mrb_bool hit;
+  mrb_value v;
+  struct RProc *proc;
+
+  if (getenv("MRUBY_NO_CACHE") ||
+      realpath(args->cmdline, abspath) == NULL ||
+      stat(abspath, &st) != 0 ||
+      !cache_file_path(abspath, cpath, sizeof(cpath))) {
+    return mrb_load_file_cxt(mrb, args->rfp, c);
+  }
+  v = cache_load(mrb, cpath, abspath, &st, c, &hit);
+  if (hit) return v;
+
+  /* compile once without executing, publish, then run */
+  c->no_exec = TRUE;
+  v = mrb_load_file_cxt(mrb, args->rfp, c);
+  c->no_exec = FALSE;
+  if (mrb->exc || mrb_type(v) != MRB_TT_PROC) return v;
+  proc = mrb_proc_ptr(v);
+  cache_store(mrb, cpath, abspath, &st, proc);
+  proc->target_class = mrb->object_class;
+  if (mrb->c->ci) mrb->c->ci->target_class = mrb->object_class;
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+#endif  /* !_WIN32 */
+
 static void
 cleanup(mrb_state *mrb, struct _args *args)
 {
@@ -223,7 +424,15 @@ main(int argc, char **argv)
     v = mrb_load_irep_file_cxt(mrb, args.rfp, c);
   }
   else if (args.rfp) {
-    v = mrb_load_file_cxt(mrb, args.rfp, c);
+#ifndef _WIN32
+    if (args.fname && !args.check_syntax) {
+      v = load_file_cached(mrb, &args, c);
+    }
+    else
+#endif
+    {
+      v = mrb_load_file_cxt(mrb, args.rfp, c);
+    }
   }
   else {
     char* utf8 = mrb_utf8_from_locale(args.cmdline, -1);
@@ -73,6 +73,12 @@ typedef struct scope {
   int debug_start_pos;
   uint16_t filename_index;
   parser_state* parser;
+
+  /* unit-wide string literal intern table (top scope only; see
+     new_lit); identical literals in different ireps share one byte
+     buffer through mrb_str_pool_share */
+  mrb_value *unit_lits;
+  size_t ulen, ucapa;
 } codegen_scope;
 
 static codegen_scope* scope_new(mrb_state *mrb, codegen_scope *prev, node *lv);
@@ -170,6 +176,52 @@ no_optimize(codegen_scope *s)
   return FALSE;
 }
 
+/* writes A without reading it and has no side effect; droppable when
+   overwritten before anything reads A */
+static mrb_bool
+peep_load_p(int op)
+{
+  switch (op) {
+  case OP_MOVE:
+  case OP_LOADL:
+  case OP_LOADI:
+  case OP_LOADSYM:
+  case OP_LOADNIL:
+  case OP_LOADSELF:
+  case OP_LOADT:
+  case OP_LOADF:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+/* if the instruction just emitted is a comparison into register a that
+   only feeds the conditional jump the caller is about to emit, rewrite
+   it to its fused compare-and-branch form (see OP_JMPLT in vm.c).  The
+   jump itself is still emitted: it carries the branch offset, can be
+   patched by dispatch, and is where a method-dispatch fallback
+   resumes. */
+static void
+fuse_cmp_jmp(codegen_scope *s, int a)
+{
+  mrb_code i0;
+  int op;
+
+  if (no_optimize(s) || s->pc == 0 || s->lastlabel == s->pc) return;
+  i0 = s->iseq[s->pc-1];
+  if (GETARG_A(i0) != a || a < s->nlocals || GETARG_C(i0) != 1) return;
+  switch (GET_OPCODE(i0)) {
+  case OP_LT: op = OP_JMPLT; break;
+  case OP_LE: op = OP_JMPLE; break;
+  case OP_GT: op = OP_JMPGT; break;
+  case OP_GE: op = OP_JMPGE; break;
+  case OP_EQ: op = OP_JMPEQ; break;
+  default: return;
+  }
+  s->iseq[s->pc-1] = MKOP_ABC(op, a, GETARG_B(i0), GETARG_C(i0));
+}
+
 static int
 genop_peep(codegen_scope *s, mrb_code i, int val)
 {
@@ -179,6 +231,26 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
     int c1 = GET_OPCODE(i);
     int c0 = GET_OPCODE(i0);
 
+    /* a load immediately overwritten is a dead store */
+    if (peep_load_p(c0) && GETARG_A(i0) == GETARG_A(i) &&
+        GETARG_A(i0) >= s->nlocals) {
+      switch (c1) {
+      case OP_STRING:
+      case OP_GETGLOBAL:
+      case OP_GETIV:
+      case OP_GETCV:
+      case OP_GETCONST:
+        s->pc--;
+        return genop_peep(s, i, val);
+      default:
+        if (peep_load_p(c1) && !(c1 == OP_MOVE && GETARG_A(i) == GETARG_B(i))) {
+          s->pc--;
+          return genop_peep(s, i, val);
+        }
+        break;
+      }
+    }
+
     switch (c1) {
     case OP_MOVE:
       if (GETARG_A(i) == GETARG_B(i)) {
@@ -305,14 +377,16 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
         genop_peep(s, i0, NOVAL);
         i0 = s->iseq[s->pc-1];
         return genop(s, MKOP_AB(OP_RETURN, GETARG_A(i0), OP_R_NORMAL));
-#if 0
       case OP_SEND:
-        if (GETARG_B(i) == OP_R_NORMAL && GETARG_A(i) == GETARG_A(i0)) {
+        /* tail call: reuse the caller's callinfo and register window.
+           Limited to method scopes with no pending ensure; the OP_RETURN
+           is still emitted so the VM can fall back to a plain send when
+           the frame cannot be replaced (entered from C, captured env). */
+        if (s->mscope && s->ensure_level == 0 &&
+            GETARG_B(i) == OP_R_NORMAL && GETARG_A(i) == GETARG_A(i0)) {
           s->iseq[s->pc-1] = MKOP_ABC(OP_TAILCALL, GETARG_A(i0), GETARG_B(i0), GETARG_C(i0));
-          return;
         }
         break;
-#endif
       default:
         break;
       }
@@ -352,6 +426,9 @@ genop_peep(codegen_scope *s, mrb_code i, int val)
         s->iseq[s->pc-1] = MKOP_AsBx(c1, GETARG_B(i0), GETARG_sBx(i));
         return s->pc-1;
       }
+      if (!val) {
+        fuse_cmp_jmp(s, GETARG_A(i));
+      }
       break;
     default:
       break;
@@ -434,6 +511,37 @@ push_n_(codegen_scope *s, size_t n)
 #define pop_n(n) (s->sp-=(n))
 #define cursp() (s->sp)
 
+/* pool a string literal, sharing the byte buffer with an identical
+   literal already pooled by another irep of this compilation unit */
+static mrb_value
+unit_lit_str(codegen_scope *s, mrb_value val)
+{
+  codegen_scope *u = s;
+  mrb_value pooled;
+  size_t i;
+
+  if (RSTRING_LEN(val) <= RSTRING_EMBED_LEN_MAX) {
+    /* an embedded copy shares nothing */
+    return mrb_str_pool(s->mrb, val);
+  }
+  while (u->prev) u = u->prev;
+  for (i=0; i<u->ulen; i++) {
+    mrb_value *pv = &u->unit_lits[i];
+
+    if (RSTRING_LEN(*pv) != RSTRING_LEN(val)) continue;
+    if (memcmp(RSTRING_PTR(*pv), RSTRING_PTR(val), RSTRING_LEN(val)) == 0) {
+      return mrb_str_pool_share(s->mrb, *pv);
+    }
+  }
+  pooled = mrb_str_pool(s->mrb, val);
+  if (u->ulen == u->ucapa) {
+    u->ucapa = u->ucapa ? u->ucapa*2 : 64;
+    u->unit_lits = (mrb_value*)codegen_realloc(u, u->unit_lits, sizeof(mrb_value)*u->ucapa);
+  }
+  u->unit_lits[u->ulen++] = pooled;
+  return pooled;
+}
+
 static inline int
 new_lit(codegen_scope *s, mrb_value val)
 {
@@ -481,7 +589,7 @@ new_lit(codegen_scope *s, mrb_value val)
 
   switch (mrb_type(val)) {
   case MRB_TT_STRING:
-    *pv = mrb_str_pool(s->mrb, val);
+    *pv = unit_lit_str(s, val);
     break;
 
   case MRB_TT_FLOAT:
@@ -569,6 +677,85 @@ lv_idx(codegen_scope *s, mrb_sym id)
   return 0;
 }
 
+/* Decide whether a block body really needs the enclosing environment.
+   A block compiled with OP_L_CAPTURE pays for an RProc plus a shared
+   REnv on every OP_LAMBDA, but many blocks only read their own
+   parameters and locals.  The scan walks the generated iseq: any use of
+   self (implicit-receiver sends, ivars, cvars, super), any upvar access
+   that crosses the block boundary, argument/block forwarding from an
+   outer frame, and non-local return/break all force capture.  Nested
+   blocks are scanned one level deeper; OP_EXEC bodies get a fresh self
+   and environment of their own, so they are not descended into.
+   Explicit-receiver calls to eval/instance_eval also force capture:
+   mruby-eval resolves free variables of the evaluated string through
+   the calling proc's environment chain at runtime. */
+static mrb_bool
+block_needs_env(mrb_state *mrb, mrb_irep *irep, int depth)
+{
+  size_t i;
+
+  for (i=0; i<irep->ilen; i++) {
+    mrb_code c = irep->iseq[i];
+
+    switch (GET_OPCODE(c)) {
+    case OP_LOADSELF: case OP_SELFSEND: case OP_IVSEND:
+    case OP_GETIV: case OP_SETIV:
+    case OP_GETCV: case OP_SETCV:
+    case OP_SUPER:
+      /* self comes from env->stack[0], at any nesting depth */
+      return TRUE;
+    case OP_SEND: case OP_SENDB: case OP_SENDC:
+      {
+        mrb_sym mid = irep->syms[GETARG_B(c)];
+
+        if (mid == mrb_intern_lit(mrb, "eval") ||
+            mid == mrb_intern_lit(mrb, "instance_eval")) {
+          return TRUE;
+        }
+      }
+      break;
+    case OP_RETURN:
+      if (GETARG_B(c) != OP_R_NORMAL) return TRUE;
+      break;
+    case OP_GETUPVAR: case OP_SETUPVAR:
+      if (GETARG_C(c) >= depth) return TRUE;
+      break;
+    case OP_ARGARY: case OP_BLKPUSH:
+      if ((GETARG_Bx(c) & 0xf) > depth) return TRUE;
+      break;
+    case OP_LAMBDA:
+      /* method bodies (no capture bit) neither see our locals nor our
+         self; only closures chain through this block's environment */
+      if ((GETARG_c(c) & OP_L_CAPTURE) &&
+          block_needs_env(mrb, irep->reps[GETARG_b(c)], depth+1)) {
+        return TRUE;
+      }
+      break;
+    case OP_EPUSH:
+      if (block_needs_env(mrb, irep->reps[GETARG_Bx(c)], depth+1)) return TRUE;
+      break;
+    default:
+      break;
+    }
+  }
+  return FALSE;
+}
+
+/* Pick the OP_LAMBDA flags for a freshly finished block irep: plain
+   blocks that provably never touch their environment are created
+   without one (mrb_proc_new instead of mrb_closure_new), skipping the
+   REnv allocation.  Disabled together with the other rewrites when
+   no_optimize is set, since eval patches variable references into
+   upvar accesses after codegen. */
+static int
+block_lambda_flags(codegen_scope *s, int idx)
+{
+  if (!no_optimize(s) && !block_needs_env(s->mrb, s->irep->reps[idx], 0)) {
+    return 0;
+  }
+  return OP_L_BLOCK;
+}
+
 static void
 for_body(codegen_scope *s, node *tree)
 {
@@ -610,7 +797,8 @@ for_body(codegen_scope *s, node *tree)
   loop_pop(s, NOVAL);
   scope_finish(s);
   s = prev;
-  genop(s, MKOP_Abc(OP_LAMBDA, cursp(), s->irep->rlen-1, OP_L_BLOCK));
+  genop(s, MKOP_Abc(OP_LAMBDA, cursp(), s->irep->rlen-1,
+                    block_lambda_flags(s, s->irep->rlen-1)));
   pop();
   idx = new_msym(s, mrb_intern_lit(s->mrb, "each"));
   genop(s, MKOP_ABC(OP_SENDB, cursp(), idx, 0));
@@ -749,6 +937,24 @@ nosplat(node *t)
   return TRUE;
 }
 
+/* true for expressions whose evaluation has no observable side effects,
+   so an indexed operator-assignment may evaluate them before the getter
+   call instead of after it (see OP_UPDIDX emission in NODE_OP_ASGN) */
+static mrb_bool
+pure_operand_p(node *n)
+{
+  switch ((intptr_t)n->car) {
+  case NODE_INT: case NODE_FLOAT: case NODE_SYM: case NODE_STR:
+  case NODE_LVAR: case NODE_IVAR: case NODE_GVAR:
+  case NODE_NIL: case NODE_TRUE: case NODE_FALSE:
+    return TRUE;
+  case NODE_NEGATE:
+    return pure_operand_p(n->cdr);
+  default:
+    return FALSE;
+  }
+}
+
 static mrb_sym
 attrsym(codegen_scope *s, mrb_sym a)
 {
@@ -1199,6 +1405,254 @@ readint_mrb_int(codegen_scope *s, const char *p, int base, mrb_bool neg, mrb_boo
   return result;
 }
 
+/* Compile-time constant folding (see the NODE_CALL/NODE_NEGATE cases in
+   codegen).  Only the operators the VM executes with dedicated opcodes
+   and no method dispatch are folded (OP_ADD..OP_DIV, OP_LT..OP_EQ, and
+   the OP_ADD string fast path), so folding cannot be observed even by
+   operator redefinition; each fold mirrors its opcode's semantics
+   exactly (fixnum overflow promotes to float, fixnum division divides
+   as floats). */
+
+enum fold_type {
+  FOLD_NONE,
+  FOLD_INT,
+  FOLD_FLOAT,
+  FOLD_STR,
+  FOLD_BOOL,
+};
+
+struct fold_value {
+  enum fold_type tt;
+  mrb_int i;
+  mrb_float f;
+  mrb_value str;                /* alive while the caller's arena slot is */
+  mrb_bool b;
+};
+
+static mrb_bool fold_call(codegen_scope *s, node *tree, struct fold_value *v);
+
+/* the operand widened to float, for mixed int/float arithmetic */
+static mrb_float
+fold_float(struct fold_value *v)
+{
+  return v->tt == FOLD_INT ? (mrb_float)v->i : v->f;
+}
+
+/* runtime unary minus on a non-literal is OP_SUB from zero */
+static mrb_bool
+fold_negate(struct fold_value *v)
+{
+  if (v->tt == FOLD_FLOAT) {
+    v->f = -v->f;
+    return TRUE;
+  }
+  if (v->tt == FOLD_INT) {
+    mrb_int i;
+
+    if (mrb_int_sub_overflow(0, v->i, &i)) {
+      v->f = -(mrb_float)v->i;
+      v->tt = FOLD_FLOAT;
+    }
+    else {
+      v->i = i;
+    }
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static mrb_bool
+fold_expr(codegen_scope *s, node *n, struct fold_value *v)
+{
+  if (!n) return FALSE;
+  switch ((intptr_t)n->car) {
+  case NODE_INT:
+    {
+      char *p = (char*)n->cdr->car;
+      int base = (intptr_t)n->cdr->cdr;
+      mrb_bool overflow;
+      mrb_int i = readint_mrb_int(s, p, base, FALSE, &overflow);
+
+      if (overflow) {
+        v->tt = FOLD_FLOAT;
+        v->f = readint_float(s, p, base);
+      }
+      else {
+        v->tt = FOLD_INT;
+        v->i = i;
+      }
+    }
+    return TRUE;
+  case NODE_FLOAT:
+    v->tt = FOLD_FLOAT;
+    v->f = str_to_mrb_float((char*)n->cdr);
+    return TRUE;
+  case NODE_NEGATE:
+    if (!fold_expr(s, n->cdr, v)) return FALSE;
+    return fold_negate(v);
+  case NODE_STR:
+    v->tt = FOLD_STR;
+    v->str = mrb_str_new(s->mrb, (char*)n->cdr->car, (size_t)(intptr_t)n->cdr->cdr);
+    return TRUE;
+  case NODE_CALL:
+    return fold_call(s, n->cdr, v);
+  case NODE_BEGIN:
+    /* a parenthesized expression */
+    if (n->cdr && !n->cdr->cdr) return fold_expr(s, n->cdr->car, v);
+    return FALSE;
+  default:
+    return FALSE;
+  }
+}
+
+/* tree is a NODE_CALL payload: (recv sym (args . blk)) */
+static mrb_bool
+fold_call(codegen_scope *s, node *tree, struct fold_value *v)
+{
+  node *args = tree->cdr->cdr->car;
+  mrb_int symlen;
+  const char *name = mrb_sym2name_len(s->mrb, sym(tree->cdr->car), &symlen);
+  struct fold_value x, y;
+  char op;
+
+  if (symlen == 2 && name[0] == '-' && name[1] == '@') {
+    /* unary minus spelled as a call, e.g. -(2*3); negated literals are
+       already folded under NODE_NEGATE */
+    if (args) return FALSE;
+    if (!fold_expr(s, tree->car, &x)) return FALSE;
+    *v = x;
+    return fold_negate(v);
+  }
+  /* exactly one plain argument and no block */
+  if (!args || !args->car || args->car->cdr || args->cdr) return FALSE;
+  if (symlen < 1 || symlen > 2) return FALSE;
+  op = name[0];
+  if (symlen == 1) {
+    if (op != '+' && op != '-' && op != '*' && op != '/' &&
+        op != '<' && op != '>') return FALSE;
+  }
+  else {
+    if (name[1] != '=') return FALSE;
+    if (op != '<' && op != '>' && op != '=') return FALSE;
+  }
+
+  if (!fold_expr(s, tree->car, &x)) return FALSE;
+  if (!fold_expr(s, args->car->car, &y)) return FALSE;
+
+  if (x.tt == FOLD_STR || y.tt == FOLD_STR) {
+    /* string concatenation */
+    if (x.tt != y.tt || symlen != 1 || op != '+') return FALSE;
+    mrb_str_cat(s->mrb, x.str, RSTRING_PTR(y.str), RSTRING_LEN(y.str));
+    *v = x;
+    return TRUE;
+  }
+  if ((x.tt != FOLD_INT && x.tt != FOLD_FLOAT) ||
+      (y.tt != FOLD_INT && y.tt != FOLD_FLOAT)) return FALSE;
+
+  if (symlen == 1 && (op == '+' || op == '-' || op == '*' || op == '/')) {
+    if (op != '/' && x.tt == FOLD_INT && y.tt == FOLD_INT) {
+      mrb_int z;
+      mrb_bool ovf;
+
+      switch (op) {
+      case '+': ovf = mrb_int_add_overflow(x.i, y.i, &z); break;
+      case '-': ovf = mrb_int_sub_overflow(x.i, y.i, &z); break;
+      default:  ovf = mrb_int_mul_overflow(x.i, y.i, &z); break;
+      }
+      if (!ovf) {
+        v->tt = FOLD_INT;
+        v->i = z;
+        return TRUE;
+      }
+      /* the VM promotes to float on overflow; fall through */
+    }
+    {
+      mrb_float a = fold_float(&x);
+      mrb_float b = fold_float(&y);
+
+      switch (op) {
+      case '+': v->f = a + b; break;
+      case '-': v->f = a - b; break;
+      case '*': v->f = a * b; break;
+      default:
+        /* OP_DIV divides fixnums as floats too; still, don't bake an
+           infinity into the pool */
+        if (b == 0) return FALSE;
+        v->f = a / b;
+        break;
+      }
+      v->tt = FOLD_FLOAT;
+      return TRUE;
+    }
+  }
+
+  /* comparison; fixnum pairs compare as ints, like the opcodes */
+  v->tt = FOLD_BOOL;
+  if (x.tt == FOLD_INT && y.tt == FOLD_INT) {
+    if (op == '<')      v->b = symlen == 1 ? x.i < y.i : x.i <= y.i;
+    else if (op == '>') v->b = symlen == 1 ? x.i > y.i : x.i >= y.i;
+    else                v->b = x.i == y.i;
+  }
+  else {
+    mrb_float a = fold_float(&x);
+    mrb_float b = fold_float(&y);
+
+    if (op == '<')      v->b = symlen == 1 ? a < b : a <= b;
+    else if (op == '>') v->b = symlen == 1 ? a > b : a >= b;
+    else                v->b = a == b;
+  }
+  return TRUE;
+}
+
+/* does this statement unconditionally transfer control, making
+   everything after it in the same statement list unreachable? */
+static mrb_bool
+jump_stmt_p(node *n)
+{
+  switch ((intptr_t)n->car) {
+  case NODE_RETURN:
+  case NODE_BREAK:
+  case NODE_NEXT:
+  case NODE_REDO:
+  case NODE_RETRY:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+static void
+gen_fold(codegen_scope *s, struct fold_value *v)
+{
+  int off;
+
+  switch (v->tt) {
+  case FOLD_INT:
+    if (v->i < MAXARG_sBx && v->i > -MAXARG_sBx) {
+      genop(s, MKOP_AsBx(OP_LOADI, cursp(), v->i));
+    }
+    else {
+      off = new_lit(s, mrb_fixnum_value(v->i));
+      genop(s, MKOP_ABx(OP_LOADL, cursp(), off));
+    }
+    break;
+  case FOLD_FLOAT:
+    off = new_lit(s, mrb_float_value(s->mrb, v->f));
+    genop(s, MKOP_ABx(OP_LOADL, cursp(), off));
+    break;
+  case FOLD_STR:
+    off = new_lit(s, v->str);
+    genop(s, MKOP_ABx(OP_STRING, cursp(), off));
+    break;
+  case FOLD_BOOL:
+    genop(s, MKOP_A(v->b ? OP_LOADT : OP_LOADF, cursp()));
+    break;
+  default:
+    break;
+  }
+  push();
+}
+
 static void
 codegen(codegen_scope *s, node *tree, int val)
 {
@@ -1231,6 +1685,15 @@ codegen(codegen_scope *s, node *tree, int val)
     }
     while (tree) {
       codegen(s, tree->car, tree->cdr ? NOVAL : val);
+      if (tree->cdr && jump_stmt_p(tree->car)) {
+        /* the rest of the list is unreachable; keep the stack shape the
+           enclosing expression expects and drop the statements */
+        if (val) {
+          genop(s, MKOP_A(OP_LOADNIL, cursp()));
+          push();
+        }
+        break;
+      }
       tree = tree->cdr;
     }
     break;
@@ -1350,7 +1813,7 @@ codegen(codegen_scope *s, node *tree, int val)
     {
       int idx = lambda_body(s, tree, 1);
 
-      genop(s, MKOP_Abc(OP_LAMBDA, cursp(), idx, OP_L_BLOCK));
+      genop(s, MKOP_Abc(OP_LAMBDA, cursp(), idx, block_lambda_flags(s, idx)));
       push();
     }
     break;
@@ -1433,6 +1896,7 @@ codegen(codegen_scope *s, node *tree, int val)
       dispatch(s, lp->pc1);
       codegen(s, tree->car, VAL);
       pop();
+      fuse_cmp_jmp(s, cursp());
       genop(s, MKOP_AsBx(OP_JMPIF, cursp(), lp->pc2 - s->pc));
 
       loop_pop(s, val);
@@ -1449,6 +1913,7 @@ codegen(codegen_scope *s, node *tree, int val)
       dispatch(s, lp->pc1);
       codegen(s, tree->car, VAL);
       pop();
+      fuse_cmp_jmp(s, cursp());
       genop(s, MKOP_AsBx(OP_JMPNOT, cursp(), lp->pc2 - s->pc));
 
       loop_pop(s, val);
@@ -1530,6 +1995,17 @@ codegen(codegen_scope *s, node *tree, int val)
 
   case NODE_FCALL:
   case NODE_CALL:
+    {
+      int ai = mrb_gc_arena_save(s->mrb);
+      struct fold_value v;
+
+      if (fold_call(s, tree, &v)) {
+        if (val) gen_fold(s, &v);
+        mrb_gc_arena_restore(s->mrb, ai);
+        break;
+      }
+      mrb_gc_arena_restore(s->mrb, ai);
+    }
     gen_call(s, tree, 0, 0, val, 0);
     break;
   case NODE_SCALL:
@@ -1601,7 +2077,25 @@ codegen(codegen_scope *s, node *tree, int val)
       mrb_bool update = FALSE;
 
       while (tree) {
-        codegen(s, tree->car->car, val);
+        node *key = tree->car->car;
+
+        if (val && key && (intptr_t)key->car == NODE_STR) {
+          /* plain string keys become deduplicated frozen literals; the
+             hash freezes its own copy of every string key anyway, so
+             handing it a shared frozen one is observably identical and
+             skips both allocations on re-execution */
+          char *p = (char*)key->cdr->car;
+          size_t n = (intptr_t)key->cdr->cdr;
+          int ai = mrb_gc_arena_save(s->mrb);
+          int off = new_lit(s, mrb_str_new(s->mrb, p, n));
+
+          mrb_gc_arena_restore(s->mrb, ai);
+          genop(s, MKOP_ABx(OP_FROZSTR, cursp(), off));
+          push();
+        }
+        else {
+          codegen(s, key, val);
+        }
         codegen(s, tree->car->cdr, val);
         len++;
         tree = tree->cdr;
@@ -1718,6 +2212,34 @@ codegen(codegen_scope *s, node *tree, int val)
       const char *name = mrb_sym2name_len(s->mrb, sym, &len);
       int idx, callargs = -1, vsp = -1;
 
+      /* `recv[key] op= operand` with a single non-splat index and a
+         side-effect-free operand combines lookup, operation and store
+         into one OP_UPDIDX (logical assignment still needs its branch) */
+      if ((intptr_t)tree->car->car == NODE_CALL &&
+          !(len == 2 && (name[0] == '|' || name[0] == '&')) &&
+          sym(tree->car->cdr->cdr->car) == mrb_intern_lit(s->mrb, "[]") &&
+          tree->car->cdr->cdr->cdr->car &&
+          tree->car->cdr->cdr->cdr->car->car &&
+          !tree->car->cdr->cdr->cdr->car->car->cdr &&
+          nosplat(tree->car->cdr->cdr->cdr->car->car) &&
+          pure_operand_p(tree->cdr->cdr->car)) {
+        node *n = tree->car->cdr;
+
+        if (val) {
+          vsp = cursp();
+          push();
+        }
+        codegen(s, n->car, VAL);                     /* receiver */
+        codegen(s, n->cdr->cdr->car->car->car, VAL); /* index */
+        codegen(s, tree->cdr->cdr->car, VAL);        /* operand */
+        pop(); pop(); pop();
+        genop(s, MKOP_ABC(OP_UPDIDX, cursp(), new_msym(s, sym), 0));
+        if (val) {
+          genop(s, MKOP_AB(OP_MOVE, vsp, cursp()));
+        }
+        return;
+      }
+
       if ((len == 2 && name[0] == '|' && name[1] == '|') &&
           ((intptr_t)tree->car->car == NODE_CONST ||
            (intptr_t)tree->car->car == NODE_CVAR)) {
@@ -2121,7 +2643,7 @@ codegen(codegen_scope *s, node *tree, int val)
   case NODE_INT:
     if (val) {
       char *p = (char*)tree->car;
-      int base = (intptr_t)tree->cdr->car;
+      int base = (intptr_t)tree->cdr;
       mrb_int i;
       mrb_code co;
       mrb_bool overflow;
@@ -2177,7 +2699,7 @@ codegen(codegen_scope *s, node *tree, int val)
       case NODE_INT:
         {
           char *p = (char*)tree->car;
-          int base = (intptr_t)tree->cdr->car;
+          int base = (intptr_t)tree->cdr;
           mrb_int i;
           mrb_code co;
           mrb_bool overflow;
@@ -2204,6 +2726,17 @@ codegen(codegen_scope *s, node *tree, int val)
         break;
 
       default:
+        {
+          int ai = mrb_gc_arena_save(s->mrb);
+          struct fold_value v;
+
+          if (nt == NODE_CALL && fold_call(s, tree, &v) && fold_negate(&v)) {
+            gen_fold(s, &v);
+            mrb_gc_arena_restore(s->mrb, ai);
+            break;
+          }
+          mrb_gc_arena_restore(s->mrb, ai);
+        }
         {
           int sym = new_msym(s, mrb_intern_lit(s->mrb, "-"));
 
@@ -2722,6 +3255,123 @@ scope_new(mrb_state *mrb, codegen_scope *prev, node *lv)
   return p;
 }
 
+/* Return the highest register index the instruction stream actually
+   touches, including the implicit windows of call instructions (args,
+   block slot), or -1 when an unrecognized opcode makes the scan
+   unreliable.  The bump allocator's high-water mark (s->nregs) counts
+   every transient push, so frames are often reserved larger than any
+   instruction needs; trimming nregs to the scanned maximum shrinks
+   every stack_extend for the irep without renumbering registers. */
+static int
+scan_max_reg(mrb_code *iseq, size_t ilen)
+{
+  size_t i;
+  int max = 0;
+
+  for (i=0; i<ilen; i++) {
+    mrb_code c = iseq[i];
+    int a = GETARG_A(c);
+    int m = -1;
+
+    switch (GET_OPCODE(c)) {
+    case OP_NOP: case OP_JMP: case OP_ONERR: case OP_POPERR:
+    case OP_EPUSH: case OP_EPOP: case OP_STOP: case OP_ERR:
+      break;
+    case OP_ENTER: {
+      mrb_aspec ax = GETARG_Ax(c);
+      m = MRB_ASPEC_REQ(ax)+MRB_ASPEC_OPT(ax)+MRB_ASPEC_REST(ax)+MRB_ASPEC_POST(ax)+1;
+      break;
+    }
+    case OP_LOADL: case OP_LOADI: case OP_LOADSYM: case OP_LOADNIL:
+    case OP_LOADSELF: case OP_LOADT: case OP_LOADF:
+    case OP_GETGLOBAL: case OP_SETGLOBAL: case OP_GETSPECIAL: case OP_SETSPECIAL:
+    case OP_GETIV: case OP_SETIV: case OP_GETCV: case OP_SETCV:
+    case OP_GETCONST: case OP_SETCONST: case OP_GETMCNST:
+    case OP_GETUPVAR: case OP_SETUPVAR:
+    case OP_JMPIF: case OP_JMPNOT: case OP_RESCUE: case OP_RAISE:
+    case OP_CALL: case OP_KARG: case OP_KDICT: case OP_RETURN:
+    case OP_STRING: case OP_FROZSTR: case OP_LAMBDA: case OP_EXEC:
+    case OP_OCLASS: case OP_MODULE: case OP_TCLASS:
+    case OP_SELFSEND: case OP_IVSEND:
+      m = a;
+      break;
+    case OP_BLKPUSH: case OP_ARGARY: {
+      int bx = GETARG_Bx(c);
+      m = a + (GET_OPCODE(c) == OP_ARGARY);
+      if ((bx & 0xf) == 0) {  /* reads the current frame's arg slots */
+        int top = ((bx>>10)&0x3f) + ((bx>>9)&0x1) + ((bx>>4)&0x1f) + 1;
+        if (top > m) m = top;
+      }
+      break;
+    }
+    case OP_MOVE: case OP_ARYCAT: case OP_ARYPUSH: case OP_AREF:
+    case OP_ASET: case OP_STRCAT: case OP_SCLASS: case OP_MOVESEND:
+      m = a > GETARG_B(c) ? a : GETARG_B(c);
+      break;
+    case OP_SETMCNST: case OP_CLASS: case OP_METHOD:
+    case OP_ADD: case OP_ADDI: case OP_SUB: case OP_SUBI: case OP_MUL:
+    case OP_DIV: case OP_EQ: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+    case OP_JMPLT: case OP_JMPLE: case OP_JMPGT: case OP_JMPGE: case OP_JMPEQ:
+      m = a + 1;
+      break;
+    case OP_SEND: case OP_SENDB: case OP_SENDC: case OP_FSEND:
+    case OP_SUPER: case OP_TAILCALL:
+      m = GETARG_C(c) == CALL_MAXARGS ? a + 2 : a + GETARG_C(c) + 1;
+      break;
+    case OP_UPDIDX:
+      m = a + 2;
+      break;
+    case OP_ARRAY:
+      m = GETARG_B(c) + GETARG_C(c) - 1;
+      if (a > m) m = a;
+      break;
+    case OP_HASH:
+      m = GETARG_B(c) + GETARG_C(c)*2 - 1;
+      if (a > m) m = a;
+      break;
+    case OP_APOST:
+      m = a + GETARG_C(c);
+      break;
+    case OP_RANGE:
+      m = GETARG_B(c) + 1;
+      if (a > m) m = a;
+      break;
+    case OP_DEBUG:
+      m = a > GETARG_B(c) ? a : GETARG_B(c);
+      if (GETARG_C(c) > m) m = GETARG_C(c);
+      break;
+    default:
+      return -1;
+    }
+    if (m > max) max = m;
+  }
+  return max;
+}
+
+/* Rewrite frequent instruction pairs ending in OP_SEND into fused
+   superinstructions so the VM pays a single dispatch for the pair.
+   The OP_SEND word is left in place (the fused handler skips over it),
+   so jumps into the second instruction remain valid. */
+static void
+fuse_send_pairs(mrb_code *iseq, size_t ilen)
+{
+  size_t i;
+
+  for (i=0; i+1<ilen; i++) {
+    int op;
+
+    if (GET_OPCODE(iseq[i+1]) != OP_SEND) continue;
+    switch (GET_OPCODE(iseq[i])) {
+    case OP_LOADSELF: op = OP_SELFSEND; break;
+    case OP_MOVE:     op = OP_MOVESEND; break;
+    case OP_GETIV:    op = OP_IVSEND;   break;
+    default: continue;
+    }
+    iseq[i] = (iseq[i] & ~(mrb_code)0x7f) | MKOPCODE(op);
+    i++;                        /* skip the OP_SEND we just paired */
+  }
+}
+
 static void
 scope_finish(codegen_scope *s)
 {
@@ -2732,6 +3382,11 @@ scope_finish(codegen_scope *s)
 
   irep->flags = 0;
   if (s->iseq) {
+    /* honor no_optimize: eval patches OP_SEND words after the fact and
+       must not find them hidden behind a fused pair */
+    if (!no_optimize(s)) {
+      fuse_send_pairs(s->iseq, s->pc);
+    }
     irep->iseq = (mrb_code *)codegen_realloc(s, s->iseq, sizeof(mrb_code)*s->pc);
     irep->ilen = s->pc;
     if (s->lines) {
@@ -2757,6 +3412,16 @@ scope_finish(codegen_scope *s)
 
   irep->nlocals = s->nlocals;
   irep->nregs = s->nregs;
+  if (irep->iseq) {
+    int max = scan_max_reg(irep->iseq, irep->ilen);
+
+    if (max >= 0 && max + 1 < irep->nregs) {
+      irep->nregs = max + 1;
+    }
+    if (irep->nregs < s->nlocals + 1) {
+      irep->nregs = s->nlocals + 1;
+    }
+  }
 
   mrb_gc_arena_restore(mrb, s->ai);
   mrb_pool_close(s->mpool);
@@ -2853,6 +3518,7 @@ mrb_generate_code(mrb_state *mrb, parser_state *p)
     codegen(scope, p->tree, NOVAL);
     proc = mrb_proc_new(mrb, scope->irep);
     mrb_irep_decref(mrb, scope->irep);
+    mrb_free(mrb, scope->unit_lits);
     mrb_pool_close(scope->mpool);
     return proc;
   }
@@ -2861,6 +3527,7 @@ mrb_generate_code(mrb_state *mrb, parser_state *p)
       scope->irep->filename = NULL;
     }
     mrb_irep_decref(mrb, scope->irep);
+    mrb_free(mrb, scope->unit_lits);
     mrb_pool_close(scope->mpool);
     return NULL;
   }
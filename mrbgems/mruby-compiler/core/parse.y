@@ -10,6 +10,7 @@
 # define YYDEBUG 1
 #endif
 #define YYERROR_VERBOSE 1
+/* bison 3.x ignores YYERROR_VERBOSE; parse.error is set below */
 /*
  * Force yacc to use our memory management.  This is a little evil because
  * the macros assume that "parser_state *p" is in scope
@@ -229,6 +230,11 @@ local_switch(parser_state *p)
 static void
 local_resume(parser_state *p, node *prev)
 {
+  /* the locals list itself lives on in the AST; only the wrapper
+     cell is dropped here, so hand it back to the free list. */
+  if (p->locals) {
+    cons_free(p->locals);
+  }
   p->locals = prev;
 }
 
@@ -242,7 +248,10 @@ static void
 local_unnest(parser_state *p)
 {
   if (p->locals) {
+    node *c = p->locals;
+
     p->locals = p->locals->cdr;
+    cons_free(c);
   }
 }
 
@@ -447,10 +456,13 @@ static node*
 new_yield(parser_state *p, node *c)
 {
   if (c) {
+    node *a = c->car;
+
     if (c->cdr) {
       yyerror(p, "both block arg and actual block given");
     }
-    return cons((node*)NODE_YIELD, c->car);
+    cons_free(c);
+    return cons((node*)NODE_YIELD, a);
   }
   return cons((node*)NODE_YIELD, 0);
 }
@@ -712,11 +724,11 @@ new_op_asgn(parser_state *p, node *a, mrb_sym op, node *b)
   return list4((node*)NODE_OP_ASGN, a, nsym(op), b);
 }
 
-/* (:int . i) */
+/* (:int . (i . base)) */
 static node*
 new_int(parser_state *p, const char *s, int base)
 {
-  return list3((node*)NODE_INT, (node*)strdup(s), nint(base));
+  return cons((node*)NODE_INT, cons((node*)strdup(s), nint(base)));
 }
 
 /* (:float . i) */
@@ -1018,6 +1030,7 @@ heredoc_end(parser_state *p)
 %}
 
 %pure-parser
+%define parse.error verbose
 %parse-param {parser_state *p}
 %lex-param {parser_state *p}
 
@@ -6196,7 +6209,7 @@ mrb_parser_dump(mrb_state *mrb, node *tree, int offset)
     break;
 
   case NODE_INT:
-    printf("NODE_INT %s base %d\n", (char*)tree->car, (int)(intptr_t)tree->cdr->car);
+    printf("NODE_INT %s base %d\n", (char*)tree->car, (int)(intptr_t)tree->cdr);
     break;
 
   case NODE_FLOAT:
@@ -243,6 +243,8 @@ module Enumerable
   # are equal to +item+ are counted.  If a block is given, it
   # counts the number of elements yielding a true value.
   def count(v=NONE, &block)
+    r = __enum_count(v != NONE, (v == NONE ? nil : v), block)
+    return r[0] if r
     count = 0
     if block
       self.each do |*val|
@@ -454,6 +456,8 @@ module Enumerable
   #     [nil, true].none?                                  #=> false
 
   def none?(&block)
+    r = __enum_none(block)
+    return r[0] if r
     if block
       self.each do |*val|
         return false if block.call(*val)
@@ -484,6 +488,8 @@ module Enumerable
   #
 
   def one?(&block)
+    r = __enum_one(block)
+    return r[0] if r
     count = 0
     if block
       self.each do |*val|
@@ -625,6 +631,8 @@ module Enumerable
   def find_index(val=NONE, &block)
     return to_enum(:find_index, val) if !block && val == NONE
 
+    r = __enum_find_index(val != NONE, (val == NONE ? nil : val), block)
+    return r[0] if r
     idx = 0
     if block
       self.each do |*e|
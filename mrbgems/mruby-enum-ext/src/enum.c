@@ -0,0 +1,201 @@
+/*
+** enum.c - Enumerable module extension
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/proc.h>
+#include <mruby/foreach.h>
+
+/*
+ * Native internal iteration for the hot extension methods, following
+ * the same wrapped-result/decline convention as the core `__enum_*`
+ * methods in src/enum.c.
+ */
+
+#define STOP_DONE 3
+
+struct enum_ext_ctx {
+  mrb_value blk;
+  mrb_value arg;
+  mrb_value ret;
+  mrb_int n;
+  mrb_bool has_arg;
+};
+
+static mrb_value
+enum_ext_wrap(mrb_state *mrb, mrb_value v)
+{
+  return mrb_ary_new_from_values(mrb, 1, &v);
+}
+
+static mrb_value
+enum_ext_result(mrb_state *mrb, int stop, const struct enum_ext_ctx *ctx, mrb_value result)
+{
+  if (stop == MRB_ENUM_YIELD_OUTER) return ctx->ret;
+  if (stop) return enum_ext_wrap(mrb, ctx->ret);  /* break or early exit */
+  return enum_ext_wrap(mrb, result);
+}
+
+static int
+count_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ext_ctx *c = (struct enum_ext_ctx*)data;
+  mrb_value v;
+
+  if (!mrb_nil_p(c->blk)) {
+    int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+    if (rc) { c->ret = v; return rc; }
+    if (mrb_test(v)) c->n++;
+  }
+  else if (c->has_arg) {
+    if (mrb_equal(mrb, val, c->arg)) c->n++;
+  }
+  else {
+    c->n++;
+  }
+  return 0;
+}
+
+static mrb_value
+enum_ext_count(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ext_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "boo", &c.has_arg, &c.arg, &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  if (!mrb_nil_p(c.blk) && !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.n = 0;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, count_i, &c);
+  return enum_ext_result(mrb, stop, &c, mrb_fixnum_value(c.n));
+}
+
+static int
+none_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ext_ctx *c = (struct enum_ext_ctx*)data;
+  mrb_value v = val;
+
+  if (!mrb_nil_p(c->blk)) {
+    int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+    if (rc) { c->ret = v; return rc; }
+  }
+  if (mrb_test(v)) {
+    c->ret = mrb_false_value();
+    return STOP_DONE;
+  }
+  return 0;
+}
+
+static mrb_value
+enum_ext_none(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ext_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  if (!mrb_nil_p(c.blk) && !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, none_i, &c);
+  return enum_ext_result(mrb, stop, &c, mrb_true_value());
+}
+
+static int
+one_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ext_ctx *c = (struct enum_ext_ctx*)data;
+  mrb_value v = val;
+
+  if (!mrb_nil_p(c->blk)) {
+    int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+    if (rc) { c->ret = v; return rc; }
+  }
+  if (mrb_test(v) && ++c->n > 1) {
+    c->ret = mrb_false_value();
+    return STOP_DONE;
+  }
+  return 0;
+}
+
+static mrb_value
+enum_ext_one(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ext_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  if (!mrb_nil_p(c.blk) && !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.n = 0;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, one_i, &c);
+  return enum_ext_result(mrb, stop, &c, mrb_bool_value(c.n == 1));
+}
+
+static int
+find_index_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ext_ctx *c = (struct enum_ext_ctx*)data;
+  mrb_bool hit;
+
+  if (!mrb_nil_p(c->blk)) {
+    mrb_value v;
+    int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+    if (rc) { c->ret = v; return rc; }
+    hit = mrb_test(v);
+  }
+  else {
+    hit = mrb_equal(mrb, val, c->arg);
+  }
+  if (hit) {
+    c->ret = mrb_fixnum_value(c->n);
+    return STOP_DONE;
+  }
+  c->n++;
+  return 0;
+}
+
+static mrb_value
+enum_ext_find_index(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ext_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "boo", &c.has_arg, &c.arg, &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  if (!mrb_nil_p(c.blk) && !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.n = 0;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, find_index_i, &c);
+  return enum_ext_result(mrb, stop, &c, mrb_nil_value());
+}
+
+void
+mrb_mruby_enum_ext_gem_init(mrb_state *mrb)
+{
+  struct RClass *e = mrb_module_get(mrb, "Enumerable");
+
+  mrb_define_method(mrb, e, "__enum_count",      enum_ext_count,      MRB_ARGS_REQ(3));
+  mrb_define_method(mrb, e, "__enum_none",       enum_ext_none,       MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_one",        enum_ext_one,        MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_find_index", enum_ext_find_index, MRB_ARGS_REQ(3));
+}
+
+void
+mrb_mruby_enum_ext_gem_final(mrb_state *mrb)
+{
+}
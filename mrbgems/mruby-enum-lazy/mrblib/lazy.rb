@@ -24,124 +24,87 @@ module Enumerable
   #   Based on https://github.com/yhara/enumerable-lazy
   #   Inspired by https://github.com/antimon2/enumerable_lz
   #   http://jp.rubyist.net/magazine/?0034-Enumerable_lz (ja)
+  #
+  # A pipeline is kept as a flat list of [op, arg] stages over one
+  # source; #each drives a single iteration of the source and runs
+  # every element through the stages in C (see src/lazy.c), so chained
+  # lazy calls add no enumerator or fiber per stage.
   class Lazy < Enumerator
-    def initialize(obj, &block)
-      super(){|yielder|
-        begin
-          obj.each{|x|
-            if block
-              block.call(yielder, x)
-            else
-              yielder << x
-            end
-          }
-        rescue StopIteration
+    def initialize(obj, stages = nil)
+      @source = obj
+      @stages = stages || []
+      # external iteration (next/peek, used by zip) goes through the
+      # inherited fiber machinery over the fused #each
+      super(self, :each)
+    end
+
+    def __chain(op, arg, extra = nil)
+      stage = extra.nil? ? [op, arg] : [op, arg, extra]
+      Lazy.new(@source, @stages + [stage])
+    end
+    private :__chain, :__apply_stages
+
+    def each(&block)
+      return to_enum :each unless block_given?
+      state = Array.new(@stages.size, 0)
+      out = []
+      begin
+        @source.each do |x|
+          more = __apply_stages(@stages, state, x, out)
+          i = 0
+          len = out.size
+          while i < len
+            block.call(out[i])
+            i += 1
+          end
+          break unless more
         end
-      }
+      rescue StopIteration
+      end
+      self
     end
 
     def map(&block)
-      Lazy.new(self){|yielder, val|
-        yielder << block.call(val)
-      }
+      __chain(:map, block)
     end
     alias collect map
 
     def select(&block)
-      Lazy.new(self){|yielder, val|
-        if block.call(val)
-          yielder << val
-        end
-      }
+      __chain(:select, block)
     end
     alias find_all select
 
     def reject(&block)
-      Lazy.new(self){|yielder, val|
-        if not block.call(val)
-          yielder << val
-        end
-      }
+      __chain(:reject, block)
     end
 
     def grep(pattern)
-      Lazy.new(self){|yielder, val|
-        if pattern === val
-          yielder << val
-        end
-      }
+      __chain(:grep, pattern)
     end
 
     def drop(n)
-      dropped = 0
-      Lazy.new(self){|yielder, val|
-        if dropped < n
-          dropped += 1
-        else
-          yielder << val
-        end
-      }
+      __chain(:drop, n)
     end
 
     def drop_while(&block)
-      dropping = true
-      Lazy.new(self){|yielder, val|
-        if dropping
-          if not block.call(val)
-            yielder << val
-            dropping = false
-          end
-        else
-          yielder << val
-        end
-      }
+      __chain(:drop_while, block)
     end
 
     def take(n)
-      if n == 0
-        return Lazy.new(self){raise StopIteration}
-      end
-      taken = 0
-      Lazy.new(self){|yielder, val|
-        yielder << val
-        taken += 1
-        if taken >= n
-          raise StopIteration
-        end
-      }
+      __chain(:take, n)
     end
 
     def take_while(&block)
-      Lazy.new(self){|yielder, val|
-        if block.call(val)
-          yielder << val
-        else
-          raise StopIteration
-        end
-      }
+      __chain(:take_while, block)
     end
 
     def flat_map(&block)
-      Lazy.new(self){|yielder, val|
-        ary = block.call(val)
-        # TODO: check ary is an Array
-        ary.each{|x|
-          yielder << x
-        }
-      }
+      __chain(:flat_map, block)
     end
     alias collect_concat flat_map
 
     def zip(*args, &block)
-      enums = [self] + args
-      Lazy.new(self){|yielder, val|
-        ary = enums.map{|e| e.next}
-        if block
-          yielder << block.call(ary)
-        else
-          yielder << ary
-        end
-      }
+      __chain(:zip, args, block)
     end
 
     alias force to_a
@@ -0,0 +1,160 @@
+/*
+** lazy.c - fused stage evaluation for Enumerable::Lazy
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/variable.h>
+
+/*
+ * A lazy pipeline is a source plus a flat list of stages ([op, arg]
+ * pairs); one iteration over the source applies the stored blocks in
+ * sequence per element instead of stacking an enumerator per stage
+ * (see mrblib/lazy.rb for the driver loop).
+ *
+ * __apply_stages(stages, state, val, out) runs one element through the
+ * pipeline: emitted values are appended to `out` (cleared first) and
+ * the return value is false once the pipeline wants iteration to stop
+ * (take exhausted, take_while failed).  `state` carries the per-run
+ * counters of drop/drop_while/take at the stage's index.
+ */
+static mrb_value
+lazy_apply_stages(mrb_state *mrb, mrb_value self)
+{
+  mrb_value stages, state, val, out;
+  mrb_int si, slen;
+  mrb_bool halt = FALSE;
+
+  mrb_get_args(mrb, "AAoA", &stages, &state, &val, &out);
+  mrb_ary_resize(mrb, out, 0);
+  mrb_ary_push(mrb, out, val);
+  slen = RARRAY_LEN(stages);
+  for (si = 0; si < slen && RARRAY_LEN(out) > 0; si++) {
+    mrb_value stage = RARRAY_PTR(stages)[si];
+    mrb_sym op = mrb_symbol(RARRAY_PTR(stage)[0]);
+    mrb_value arg = RARRAY_PTR(stage)[1];
+    mrb_int i, w = 0;
+    mrb_int len = RARRAY_LEN(out);
+
+    for (i = 0; i < len; i++) {
+      mrb_value v = RARRAY_PTR(out)[i];
+
+      if (op == MRB_SYM(map)) {
+        mrb_ary_set(mrb, out, w++, mrb_yield(mrb, arg, v));
+      }
+      else if (op == MRB_SYM(select)) {
+        if (mrb_test(mrb_yield(mrb, arg, v))) mrb_ary_set(mrb, out, w++, v);
+      }
+      else if (op == MRB_SYM(reject)) {
+        if (!mrb_test(mrb_yield(mrb, arg, v))) mrb_ary_set(mrb, out, w++, v);
+      }
+      else if (op == MRB_SYM(grep)) {
+        if (mrb_test(mrb_funcall_argv(mrb, arg, MRB_OPSYM(eqq), 1, &v))) {
+          mrb_ary_set(mrb, out, w++, v);
+        }
+      }
+      else if (op == MRB_SYM(drop)) {
+        mrb_int dropped = mrb_fixnum(RARRAY_PTR(state)[si]);
+        if (dropped < mrb_fixnum(arg)) {
+          mrb_ary_set(mrb, state, si, mrb_fixnum_value(dropped+1));
+        }
+        else {
+          mrb_ary_set(mrb, out, w++, v);
+        }
+      }
+      else if (op == MRB_SYM(drop_while)) {
+        if (mrb_fixnum(RARRAY_PTR(state)[si]) == 0) {
+          if (!mrb_test(mrb_yield(mrb, arg, v))) {
+            mrb_ary_set(mrb, state, si, mrb_fixnum_value(1));
+            mrb_ary_set(mrb, out, w++, v);
+          }
+        }
+        else {
+          mrb_ary_set(mrb, out, w++, v);
+        }
+      }
+      else if (op == MRB_SYM(take)) {
+        mrb_int taken = mrb_fixnum(RARRAY_PTR(state)[si]);
+        if (taken >= mrb_fixnum(arg)) {  /* covers take(0) */
+          halt = TRUE;
+          break;
+        }
+        mrb_ary_set(mrb, out, w++, v);
+        mrb_ary_set(mrb, state, si, mrb_fixnum_value(taken+1));
+        if (taken+1 >= mrb_fixnum(arg)) {
+          halt = TRUE;
+          break;  /* emit what we have, then stop the source */
+        }
+      }
+      else if (op == MRB_SYM(take_while)) {
+        if (!mrb_test(mrb_yield(mrb, arg, v))) {
+          halt = TRUE;
+          break;
+        }
+        mrb_ary_set(mrb, out, w++, v);
+      }
+      else if (op == MRB_SYM(flat_map)) {
+        mrb_value r = mrb_yield(mrb, arg, v);
+        if (mrb_array_p(r)) {
+          /* expansion cannot be done in place; splice through a copy */
+          mrb_value rest = mrb_ary_new_from_values(mrb, RARRAY_LEN(out)-(i+1),
+                                                   RARRAY_PTR(out)+i+1);
+          mrb_int j;
+          mrb_ary_resize(mrb, out, w);
+          for (j = 0; j < RARRAY_LEN(r); j++) {
+            mrb_ary_push(mrb, out, RARRAY_PTR(r)[j]);
+          }
+          w = RARRAY_LEN(out);
+          for (j = 0; j < RARRAY_LEN(rest); j++) {
+            mrb_ary_push(mrb, out, RARRAY_PTR(rest)[j]);
+          }
+          len = RARRAY_LEN(out);
+          i = w - 1;  /* continue after the spliced values */
+          continue;
+        }
+        mrb_ary_set(mrb, out, w++, r);
+      }
+      else if (op == MRB_SYM(zip)) {
+        mrb_value enums = arg;
+        mrb_value blk = RARRAY_LEN(stage) > 2 ? RARRAY_PTR(stage)[2] : mrb_nil_value();
+        mrb_value ary = mrb_ary_new_capa(mrb, RARRAY_LEN(enums)+1);
+        mrb_int j;
+
+        mrb_ary_push(mrb, ary, v);
+        for (j = 0; j < RARRAY_LEN(enums); j++) {
+          /* StopIteration from an exhausted enum unwinds to the driver */
+          mrb_ary_push(mrb, ary, mrb_funcall(mrb, RARRAY_PTR(enums)[j], "next", 0));
+        }
+        if (!mrb_nil_p(blk)) {
+          ary = mrb_yield(mrb, blk, ary);
+        }
+        mrb_ary_set(mrb, out, w++, ary);
+      }
+      else {
+        mrb_raisef(mrb, E_ARGUMENT_ERROR, "unknown lazy stage %S",
+                   mrb_symbol_value(op));
+      }
+    }
+    mrb_ary_resize(mrb, out, w);
+  }
+  return mrb_bool_value(!halt);
+}
+
+void
+mrb_mruby_enum_lazy_gem_init(mrb_state *mrb)
+{
+  struct RClass *enumerable, *lazy;
+
+  enumerable = mrb_module_get(mrb, "Enumerable");
+  lazy = mrb_define_class_under(mrb, enumerable, "Lazy",
+                                mrb_class_get(mrb, "Enumerator"));
+  mrb_define_method(mrb, lazy, "__apply_stages", lazy_apply_stages, MRB_ARGS_REQ(4));
+}
+
+void
+mrb_mruby_enum_lazy_gem_final(mrb_state *mrb)
+{
+}
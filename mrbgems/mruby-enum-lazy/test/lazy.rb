@@ -45,3 +45,29 @@ assert("Enumerable::Lazy#zip with cycle") do
   e2 = [:a, :b].cycle
   assert_equal [[1,:a],[2,:b],[3,:a]], e1.lazy.zip(e2).first(3)
 end
+
+assert("Enumerable::Lazy fused pipeline") do
+  calls = 0
+  v = (1..1000000).lazy.map{|x| calls += 1; x * 2}.select{|x| x % 3 == 0}.first(3)
+  assert_equal [6, 12, 18], v
+  assert_true calls < 20           # short-circuits instead of mapping everything
+
+  assert_equal [1, 10, 2, 20], [1, 2].lazy.flat_map{|x| [x, x * 10]}.force
+  lz = (1..10).lazy.drop(2).take(2)
+  assert_equal [3, 4], lz.force
+  assert_equal [3, 4], lz.force    # per-run stage state, so force can repeat
+end
+
+assert("break crosses a C-driven block loop") do
+  # a block defined outside an integer range loop can break out of it
+  # even though the loop itself runs as a C fast path
+  runner = Object.new
+  def runner.drive
+    (1..1000000).each { |i| yield i }
+    :finished
+  end
+  n = 0
+  r = runner.drive { |i| n += 1; break :stopped if i == 3 }
+  assert_equal :stopped, r
+  assert_equal 3, n
+end
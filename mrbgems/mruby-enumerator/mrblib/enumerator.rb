@@ -124,9 +124,11 @@ class Enumerator
     @lookahead = nil
     @feedvalue = nil
     @stop_exc = false
+    @cursor = nil
   end
   attr_accessor :obj, :meth, :args, :fib
   private :obj, :meth, :args, :fib
+  private :__indexable?, :__cursor_fetch
 
   def initialize_copy(obj)
     raise TypeError, "can't copy type #{obj.class}" unless obj.kind_of? Enumerator
@@ -137,6 +139,8 @@ class Enumerator
     @fib = nil
     @lookahead = nil
     @feedvalue = nil
+    @cursor = nil
+    @cursor_keys = nil
     self
   end
 
@@ -356,6 +360,21 @@ class Enumerator
     end
     raise @stop_exc if @stop_exc
 
+    # index-cursor fast path: plain `each` over an array, hash or range
+    # needs no fiber, just a position (see src/enumerator.c)
+    if !@fib && @meth == :each && @args.empty? && __indexable?
+      @cursor ||= 0
+      vs = __cursor_fetch(@cursor)
+      if vs
+        @cursor += 1
+        return vs
+      end
+      @stop_exc = StopIteration.new "iteration reached an end"
+      @stop_exc.set_backtrace []   # re-raising it then skips backtrace capture
+      @stop_exc.result = @obj
+      raise @stop_exc
+    end
+
     curr = Fiber.current
 
     if !@fib || !@fib.alive?
@@ -371,6 +390,7 @@ class Enumerator
           feedvalue
         end
         @stop_exc = StopIteration.new "iteration reached an end"
+        @stop_exc.set_backtrace []   # re-raising it then skips backtrace capture
         @stop_exc.result = result
         Fiber.yield nil
       end
@@ -460,6 +480,8 @@ class Enumerator
     @lookahead = nil
     @feedvalue = nil
     @stop_exc = false
+    @cursor = nil
+    @cursor_keys = nil
     self
   end
 
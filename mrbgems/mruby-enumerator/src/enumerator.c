@@ -0,0 +1,99 @@
+/*
+** enumerator.c - index-cursor fast path for external iteration
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/hash.h>
+#include <mruby/range.h>
+#include <mruby/variable.h>
+
+/*
+ * Enumerator#next used to spin up a fiber even for plain `each` over an
+ * array, hash or range, paying a context switch per element.  For those
+ * receivers external iteration is just a position: __cursor_fetch(i)
+ * rebuilds the i-th yielded argument list and the Ruby side keeps the
+ * cursor (see next_values in mrblib/enumerator.rb).  Enumerators over
+ * arbitrary `each` methods still go through the fiber machinery.
+ */
+
+static mrb_value
+enum_indexable_p(mrb_state *mrb, mrb_value self)
+{
+  mrb_value obj = mrb_iv_get(mrb, self, MRB_IVSYM(obj));
+
+  switch (mrb_type(obj)) {
+  case MRB_TT_ARRAY:
+  case MRB_TT_HASH:
+    return mrb_true_value();
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = mrb_range_ptr(obj);
+      return mrb_bool_value(mrb_fixnum_p(r->edges->beg) && mrb_fixnum_p(r->edges->end));
+    }
+  default:
+    return mrb_false_value();
+  }
+}
+
+/* returns the argument list `each` would yield at position idx, or nil
+   once the collection is exhausted */
+static mrb_value
+enum_cursor_fetch(mrb_state *mrb, mrb_value self)
+{
+  mrb_int idx;
+  mrb_value obj = mrb_iv_get(mrb, self, MRB_IVSYM(obj));
+
+  mrb_get_args(mrb, "i", &idx);
+  switch (mrb_type(obj)) {
+  case MRB_TT_ARRAY:
+    if (idx >= RARRAY_LEN(obj)) return mrb_nil_value();
+    return mrb_ary_new_from_values(mrb, 1, RARRAY_PTR(obj)+idx);
+  case MRB_TT_HASH:
+    {
+      /* walk a keys snapshot, like Hash#each does */
+      mrb_value keys = mrb_iv_get(mrb, self, MRB_IVSYM(cursor_keys));
+      mrb_value pair;
+
+      if (mrb_nil_p(keys)) {
+        keys = mrb_hash_keys(mrb, obj);
+        mrb_iv_set(mrb, self, MRB_IVSYM(cursor_keys), keys);
+      }
+      if (idx >= RARRAY_LEN(keys)) return mrb_nil_value();
+      pair = mrb_assoc_new(mrb, RARRAY_PTR(keys)[idx],
+                           mrb_hash_get(mrb, obj, RARRAY_PTR(keys)[idx]));
+      return mrb_ary_new_from_values(mrb, 1, &pair);
+    }
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = mrb_range_ptr(obj);
+      mrb_int val = mrb_fixnum(r->edges->beg) + idx;
+      mrb_int last = mrb_fixnum(r->edges->end);
+      mrb_value v;
+
+      if (r->excl ? (val >= last) : (val > last)) return mrb_nil_value();
+      v = mrb_fixnum_value(val);
+      return mrb_ary_new_from_values(mrb, 1, &v);
+    }
+  default:
+    return mrb_nil_value();
+  }
+}
+
+void
+mrb_mruby_enumerator_gem_init(mrb_state *mrb)
+{
+  struct RClass *enu;
+
+  /* created here so the methods can be attached; reopened by mrblib */
+  enu = mrb_define_class(mrb, "Enumerator", mrb->object_class);
+  mrb_define_method(mrb, enu, "__indexable?", enum_indexable_p, MRB_ARGS_NONE());
+  mrb_define_method(mrb, enu, "__cursor_fetch", enum_cursor_fetch, MRB_ARGS_REQ(1));
+}
+
+void
+mrb_mruby_enumerator_gem_final(mrb_state *mrb)
+{
+}
@@ -534,3 +534,27 @@ assert 'Range#each' do
   end
   assert_equal [1,2,3,4,5], c
 end
+
+assert 'cursor-based next for indexable enumerators' do
+  e = [10, 20].each
+  assert_equal 10, e.next
+  assert_equal 20, e.peek
+  assert_equal 20, e.next
+  assert_raise(StopIteration) { e.next }
+  e.rewind
+  assert_equal 10, e.next
+
+  h = { :a => 1, :b => 2 }.each
+  assert_equal [:a, 1], h.next
+  assert_equal [:b, 2], h.next
+  assert_raise(StopIteration) { h.next }
+
+  r = (1...3).each
+  assert_equal 1, r.next
+  assert_equal 2, r.next
+  begin
+    r.next
+  rescue StopIteration => err
+    assert_equal (1...3), err.result
+  end
+end
@@ -26,6 +26,47 @@ mrb_protect(mrb_state *mrb, mrb_func_t body, mrb_value data, mrb_bool *state)
   return result;
 }
 
+/*
+ * Batch form of mrb_protect.  A single jmpbuf is armed for the whole run
+ * and only re-armed after a body raised, so calling N bodies costs one
+ * setjmp instead of N on the happy path.  results[i] receives the body's
+ * return value, or the exception object when states[i] is set.
+ */
+MRB_API mrb_int
+mrb_protect_each(mrb_state *mrb, mrb_func_t body, mrb_int len, const mrb_value *data,
+                 mrb_value *results, mrb_bool *states)
+{
+  struct mrb_jmpbuf *prev_jmp = mrb->jmp;
+  struct mrb_jmpbuf c_jmp;
+  volatile mrb_int i = 0;
+  volatile mrb_int failed = 0;
+  int ai = mrb_gc_arena_save(mrb);
+
+  while (i < len) {
+    MRB_TRY(&c_jmp) {
+      mrb->jmp = &c_jmp;
+      while (i < len) {
+        mrb_value r = body(mrb, data[i]);
+        if (results) { results[i] = r; }
+        if (states) { states[i] = FALSE; }
+        mrb_gc_arena_restore(mrb, ai);
+        if (results) { mrb_gc_protect(mrb, results[i]); }
+        i++;
+      }
+    } MRB_CATCH(&c_jmp) {
+      if (results) { results[i] = mrb_obj_value(mrb->exc); }
+      if (states) { states[i] = TRUE; }
+      mrb->exc = NULL;
+      mrb_gc_arena_restore(mrb, ai);
+      if (results) { mrb_gc_protect(mrb, results[i]); }
+      i++;
+      failed++;
+    } MRB_END_EXC(&c_jmp);
+  }
+  mrb->jmp = prev_jmp;
+  return failed;
+}
+
 MRB_API mrb_value
 mrb_ensure(mrb_state *mrb, mrb_func_t body, mrb_value b_data, mrb_func_t ensure, mrb_value e_data)
 {
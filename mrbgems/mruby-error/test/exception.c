@@ -20,6 +20,26 @@ run_protect(mrb_state *mrb, mrb_value self)
   return mrb_ary_new_from_values(mrb, 2, ret);
 }
 
+static mrb_value
+run_protect_each(mrb_state *mrb, mrb_value self)
+{
+  mrb_value *data;
+  mrb_int len, i, failed;
+  mrb_value results[16];
+  mrb_bool states[16];
+  mrb_value ret;
+
+  mrb_get_args(mrb, "a", &data, &len);
+  if (len > 16) { mrb_raise(mrb, E_ARGUMENT_ERROR, "too many bodies"); }
+  failed = mrb_protect_each(mrb, protect_cb, len, data, results, states);
+  ret = mrb_ary_new_capa(mrb, len + 1);
+  mrb_ary_push(mrb, ret, mrb_fixnum_value(failed));
+  for (i = 0; i < len; i++) {
+    mrb_ary_push(mrb, ret, states[i] ? mrb_obj_value(mrb_obj_class(mrb, results[i])) : results[i]);
+  }
+  return ret;
+}
+
 static mrb_value
 run_ensure(mrb_state *mrb, mrb_value self)
 {
@@ -53,6 +73,7 @@ mrb_mruby_error_gem_test(mrb_state *mrb)
 
   cls = mrb_define_class(mrb, "ExceptionTest", mrb->object_class);
   mrb_define_module_function(mrb, cls, "mrb_protect", run_protect, MRB_ARGS_NONE() | MRB_ARGS_BLOCK());
+  mrb_define_module_function(mrb, cls, "mrb_protect_each", run_protect_each, MRB_ARGS_REQ(1));
   mrb_define_module_function(mrb, cls, "mrb_ensure", run_ensure, MRB_ARGS_REQ(2));
   mrb_define_module_function(mrb, cls, "mrb_rescue", run_rescue, MRB_ARGS_REQ(2));
   mrb_define_module_function(mrb, cls, "mrb_rescue_exceptions", run_rescue_exceptions, MRB_ARGS_REQ(2));
@@ -9,6 +9,21 @@ assert 'mrb_protect' do
   assert_true result[1]
 end
 
+assert 'mrb_protect_each' do
+  # all bodies succeed under the shared jmpbuf
+  assert_equal [0, 1, 2, 3] do
+    ExceptionTest.mrb_protect_each [Proc.new { 1 }, Proc.new { 2 }, Proc.new { 3 }]
+  end
+  # raising bodies yield their exception class and do not stop the rest
+  assert_equal [2, 1, TypeError, 3, RuntimeError] do
+    ExceptionTest.mrb_protect_each [Proc.new { 1 }, Proc.new { raise TypeError, 't' },
+                                    Proc.new { 3 }, Proc.new { raise 'r' }]
+  end
+  assert_equal [0] do
+    ExceptionTest.mrb_protect_each []
+  end
+end
+
 assert 'mrb_ensure' do
   a = false
   assert_equal 'test' do
@@ -1,3 +1,4 @@
+#include <string.h>
 #include <mruby.h>
 #include <mruby/class.h>
 #include <mruby/compile.h>
@@ -5,6 +6,11 @@
 #include <mruby/proc.h>
 #include <mruby/opcode.h>
 
+/* number of compiled strings remembered per state */
+#ifndef MRB_EVAL_CACHE_SIZE
+#define MRB_EVAL_CACHE_SIZE 256
+#endif
+
 static struct mrb_irep *
 get_closure_irep(mrb_state *mrb, int level)
 {
@@ -26,7 +32,7 @@ get_closure_irep(mrb_state *mrb, int level)
   }
 
   if (!e) return NULL;
-  proc = c->cibase[e->cioff].proc;
+  proc = mrb_ci_at(c, e->cioff)->proc;
 
   if (!proc || MRB_PROC_CFUNC_P(proc)) {
     return NULL;
@@ -130,6 +136,127 @@ patch_irep(mrb_state *mrb, mrb_irep *irep, int bnest)
   }
 }
 
+/*
+ * Compiled-string cache.
+ *
+ * patch_irep bakes the enclosing local-variable layout into the
+ * generated code, so a compiled irep can only be reused when both the
+ * source and that layout match.  The context signature below hashes the
+ * same closure chain search_variable walks; entries additionally keep
+ * the full source (and file/line, which end up in the debug info) so a
+ * hash collision can never execute the wrong code.  Reuse builds a
+ * fresh RProc around the shared irep; the env and target_class are
+ * per-call and never cached.
+ */
+
+struct eval_cache_entry {
+  char *src;
+  size_t len;
+  char *file;
+  mrb_int line;
+  uint32_t sig;
+  uint32_t last_use;
+  mrb_irep *irep;
+};
+
+struct mrb_eval_cache {
+  struct eval_cache_entry entries[MRB_EVAL_CACHE_SIZE];
+  uint32_t tick;
+};
+
+static uint32_t
+eval_context_sig(mrb_state *mrb, const char *s, size_t len)
+{
+  uint32_t h = 2166136261u;
+  mrb_irep *virep;
+  int level, pos;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h = (h ^ (uint8_t)s[i]) * 16777619;
+  }
+  for (level = 0; (virep = get_closure_irep(mrb, level)); level++) {
+    h = (h ^ virep->nlocals) * 16777619;
+    if (virep->lv == NULL) continue;
+    for (pos = 0; pos < virep->nlocals - 1; pos++) {
+      h = (h ^ virep->lv[pos].name) * 16777619;
+    }
+  }
+  return h;
+}
+
+static mrb_irep*
+eval_cache_lookup(mrb_state *mrb, const char *s, size_t len, const char *file, mrb_int line, uint32_t sig)
+{
+  struct mrb_eval_cache *cache = mrb->eval_cache;
+  int i;
+
+  if (!cache) return NULL;
+  for (i = 0; i < MRB_EVAL_CACHE_SIZE; i++) {
+    struct eval_cache_entry *e = &cache->entries[i];
+
+    if (e->irep == NULL) continue;
+    if (e->sig != sig || e->len != len || e->line != line) continue;
+    if (memcmp(e->src, s, len) != 0) continue;
+    if (strcmp(e->file, file) != 0) continue;
+    e->last_use = ++cache->tick;
+    return e->irep;
+  }
+  return NULL;
+}
+
+static void
+eval_cache_store(mrb_state *mrb, const char *s, size_t len, const char *file, mrb_int line, uint32_t sig, mrb_irep *irep)
+{
+  struct mrb_eval_cache *cache = mrb->eval_cache;
+  struct eval_cache_entry *e;
+  int i;
+
+  if (!cache) return;
+  /* evict the least recently used slot */
+  e = &cache->entries[0];
+  for (i = 1; i < MRB_EVAL_CACHE_SIZE; i++) {
+    if (cache->entries[i].irep == NULL) {
+      e = &cache->entries[i];
+      break;
+    }
+    if (cache->entries[i].last_use < e->last_use) {
+      e = &cache->entries[i];
+    }
+  }
+  if (e->irep) {
+    mrb_free(mrb, e->src);
+    mrb_free(mrb, e->file);
+    mrb_irep_decref(mrb, e->irep);
+  }
+  e->src = (char*)mrb_malloc(mrb, len);
+  memcpy(e->src, s, len);
+  e->len = len;
+  e->file = (char*)mrb_malloc(mrb, strlen(file) + 1);
+  strcpy(e->file, file);
+  e->line = line;
+  e->sig = sig;
+  e->last_use = ++cache->tick;
+  e->irep = irep;
+  mrb_irep_incref(mrb, irep);
+}
+
+static void
+eval_cache_free(mrb_state *mrb, struct mrb_eval_cache *cache)
+{
+  int i;
+
+  if (!cache) return;
+  for (i = 0; i < MRB_EVAL_CACHE_SIZE; i++) {
+    if (cache->entries[i].irep) {
+      mrb_free(mrb, cache->entries[i].src);
+      mrb_free(mrb, cache->entries[i].file);
+      mrb_irep_decref(mrb, cache->entries[i].irep);
+    }
+  }
+  mrb_free(mrb, cache);
+}
+
 void mrb_codedump_all(mrb_state*, struct RProc*);
 
 static struct RProc*
@@ -140,44 +267,58 @@ create_proc_from_string(mrb_state *mrb, char *s, int len, mrb_value binding, con
   struct RProc *proc;
   struct REnv *e;
   struct mrb_context *c = mrb->c;
+  mrb_irep *cached;
+  uint32_t sig;
 
   if (!mrb_nil_p(binding)) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "Binding of eval must be nil.");
   }
 
-  cxt = mrbc_context_new(mrb);
-  cxt->lineno = line;
-
   if (!file) {
     file = "(eval)";
   }
-  mrbc_filename(mrb, cxt, file);
-  cxt->capture_errors = TRUE;
-  cxt->no_optimize = TRUE;
-
-  p = mrb_parse_nstring(mrb, s, len, cxt);
 
-  /* only occur when memory ran out */
-  if (!p) {
-    mrb_raise(mrb, E_RUNTIME_ERROR, "Failed to create parser state.");
+  sig = eval_context_sig(mrb, s, len);
+  cached = eval_cache_lookup(mrb, s, len, file, line, sig);
+  if (cached) {
+    proc = mrb_proc_new(mrb, cached);
   }
+  else {
+    cxt = mrbc_context_new(mrb);
+    cxt->lineno = line;
+    mrbc_filename(mrb, cxt, file);
+    cxt->capture_errors = TRUE;
+    cxt->no_optimize = TRUE;
 
-  if (0 < p->nerr) {
-    /* parse error */
-    char buf[256];
-    int n;
-    n = snprintf(buf, sizeof(buf), "line %d: %s\n", p->error_buffer[0].lineno, p->error_buffer[0].message);
-    mrb_parser_free(p);
-    mrbc_context_free(mrb, cxt);
-    mrb_exc_raise(mrb, mrb_exc_new(mrb, E_SYNTAX_ERROR, buf, n));
-  }
+    p = mrb_parse_nstring(mrb, s, len, cxt);
+
+    /* only occur when memory ran out */
+    if (!p) {
+      mrb_raise(mrb, E_RUNTIME_ERROR, "Failed to create parser state.");
+    }
+
+    if (0 < p->nerr) {
+      /* parse error */
+      char buf[256];
+      int n;
+      n = snprintf(buf, sizeof(buf), "line %d: %s\n", p->error_buffer[0].lineno, p->error_buffer[0].message);
+      mrb_parser_free(p);
+      mrbc_context_free(mrb, cxt);
+      mrb_exc_raise(mrb, mrb_exc_new(mrb, E_SYNTAX_ERROR, buf, n));
+    }
+
+    proc = mrb_generate_code(mrb, p);
+    if (proc == NULL) {
+      /* codegen error */
+      mrb_parser_free(p);
+      mrbc_context_free(mrb, cxt);
+      mrb_raise(mrb, E_SCRIPT_ERROR, "codegen error");
+    }
+    patch_irep(mrb, proc->body.irep, 0);
+    eval_cache_store(mrb, s, len, file, line, sig, proc->body.irep);
 
-  proc = mrb_generate_code(mrb, p);
-  if (proc == NULL) {
-    /* codegen error */
     mrb_parser_free(p);
     mrbc_context_free(mrb, cxt);
-    mrb_raise(mrb, E_SCRIPT_ERROR, "codegen error");
   }
   if (c->ci[-1].proc->target_class) {
     proc->target_class = c->ci[-1].proc->target_class;
@@ -186,15 +327,11 @@ create_proc_from_string(mrb_state *mrb, char *s, int len, mrb_value binding, con
   if (!e) e = c->ci[-1].env;
   e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, (struct RClass*)e);
   e->mid = c->ci[-1].mid;
-  e->cioff = c->ci - c->cibase - 1;
+  e->cioff = c->ci->ciidx - 1;
   e->stack = c->ci->stackent;
   MRB_SET_ENV_STACK_LEN(e, c->ci[-1].proc->body.irep->nlocals);
   c->ci->env = e;
   proc->env = e;
-  patch_irep(mrb, proc->body.irep, 0);
-
-  mrb_parser_free(p);
-  mrbc_context_free(mrb, cxt);
 
   return proc;
 }
@@ -258,6 +395,7 @@ f_instance_eval(mrb_state *mrb, mrb_value self)
 void
 mrb_mruby_eval_gem_init(mrb_state* mrb)
 {
+  mrb->eval_cache = (struct mrb_eval_cache*)mrb_calloc(mrb, 1, sizeof(struct mrb_eval_cache));
   mrb_define_module_function(mrb, mrb->kernel_module, "eval", f_eval, MRB_ARGS_ARG(1, 3));
   mrb_define_method(mrb, mrb->kernel_module, "instance_eval", f_instance_eval, MRB_ARGS_ARG(1, 2));
 }
@@ -265,4 +403,6 @@ mrb_mruby_eval_gem_init(mrb_state* mrb)
 void
 mrb_mruby_eval_gem_final(mrb_state* mrb)
 {
+  eval_cache_free(mrb, mrb->eval_cache);
+  mrb->eval_cache = NULL;
 }
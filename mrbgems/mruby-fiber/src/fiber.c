@@ -1,12 +1,13 @@
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/class.h>
+#include <mruby/gc.h>
 #include <mruby/proc.h>
+#include <mruby/trace.h>
 
 #define fiber_ptr(o) ((struct RFiber*)mrb_ptr(o))
 
 #define FIBER_STACK_INIT_SIZE 64
-#define FIBER_CI_INIT_SIZE 8
 #define CI_ACC_RESUMED -3
 
 /*
@@ -82,40 +83,71 @@ fiber_init(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_FIBER_ERROR, "tried to create Fiber from C defined method");
   }
 
-  f->cxt = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
-  *f->cxt = mrb_context_zero;
-  c = f->cxt;
-
   /* initialize VM stack */
   slen = FIBER_STACK_INIT_SIZE;
   if (p->body.irep->nregs > slen) {
     slen += p->body.irep->nregs;
   }
-  c->stbase = (mrb_value *)mrb_malloc(mrb, slen*sizeof(mrb_value));
-  c->stend = c->stbase + slen;
-  c->stack = c->stbase;
 
+  c = mrb_context_cache_get(mrb);
+  if (c) {
+    /* recycled context: stack and callinfo segment come back allocated,
+       nil-filled and zeroed; only grow the stack when this proc needs
+       more than the previous owner did */
+    f->cxt = c;
+    if (c->stend - c->stbase < (mrb_int)slen) {
+      size_t oldlen = c->stend - c->stbase;
+
+      c->stbase = (mrb_value *)mrb_realloc(mrb, c->stbase, slen*sizeof(mrb_value));
+      c->stend = c->stbase + slen;
+      c->stack = c->stbase;
 #ifdef MRB_NAN_BOXING
-  {
-    mrb_value *p = c->stbase;
-    mrb_value *pend = c->stend;
-
-    while (p < pend) {
-      SET_NIL_VALUE(*p);
-      p++;
+      {
+        mrb_value *sp = c->stbase + oldlen;
+
+        while (sp < c->stend) {
+          SET_NIL_VALUE(*sp);
+          sp++;
+        }
+      }
+#else
+      memset(c->stbase + oldlen, 0, (slen - oldlen)*sizeof(mrb_value));
+#endif
     }
   }
+  else {
+    f->cxt = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
+    *f->cxt = mrb_context_zero;
+    c = f->cxt;
+
+    c->stbase = (mrb_value *)mrb_malloc(mrb, slen*sizeof(mrb_value));
+    c->stend = c->stbase + slen;
+    c->stack = c->stbase;
+
+#ifdef MRB_NAN_BOXING
+    {
+      mrb_value *sp = c->stbase;
+      mrb_value *pend = c->stend;
+
+      while (sp < pend) {
+        SET_NIL_VALUE(*sp);
+        sp++;
+      }
+    }
 #else
-  memset(c->stbase, 0, slen * sizeof(mrb_value));
+    memset(c->stbase, 0, slen * sizeof(mrb_value));
 #endif
 
+    /* initialize callinfo stack */
+    c->ciseg = (mrb_callinfo **)mrb_malloc(mrb, sizeof(mrb_callinfo*));
+    c->ciseg[0] = (mrb_callinfo *)mrb_calloc(mrb, MRB_CALLINFO_SEG_SIZE, sizeof(mrb_callinfo));
+    c->cisegs = 1;
+    c->ci = c->ciseg[0];
+    c->ci_clean = -1;
+  }
+
   /* copy receiver from a block */
   c->stack[0] = mrb->c->stack[0];
-
-  /* initialize callinfo stack */
-  c->cibase = (mrb_callinfo *)mrb_calloc(mrb, FIBER_CI_INIT_SIZE, sizeof(mrb_callinfo));
-  c->ciend = c->cibase + FIBER_CI_INIT_SIZE;
-  c->ci = c->cibase;
   c->ci->stackent = c->stack;
 
   /* adjust return callinfo */
@@ -124,8 +156,10 @@ fiber_init(mrb_state *mrb, mrb_value self)
   ci->proc = p;
   ci->pc = p->body.irep->iseq;
   ci->nregs = p->body.irep->nregs;
-  ci[1] = ci[0];
-  c->ci++;                      /* push dummy callinfo */
+  ci->arena_idx = mrb_gc_arena_save(mrb);  /* base frames were not cipush'ed */
+  c->ci = mrb_ci_at(c, 1);
+  *c->ci = *ci;                 /* push dummy callinfo */
+  c->ci->ciidx = 1;
 
   c->fib = f;
   c->status = MRB_FIBER_CREATED;
@@ -140,7 +174,7 @@ fiber_check(mrb_state *mrb, mrb_value fib)
 
   mrb_assert(f->tt == MRB_TT_FIBER);
   if (!f->cxt) {
-    mrb_raise(mrb, E_FIBER_ERROR, "uninitialized Fiber");
+    mrb_control_raise(mrb, E_FIBER_ERROR, "uninitialized Fiber");
   }
   return f->cxt;
 }
@@ -159,13 +193,19 @@ fiber_result(mrb_state *mrb, const mrb_value *a, mrb_int len)
 static void
 fiber_check_cfunc(mrb_state *mrb, struct mrb_context *c)
 {
-  mrb_callinfo *ci;
-
-  for (ci = c->ci; ci >= c->cibase; ci--) {
-    if (ci->acc < 0) {
-      mrb_raise(mrb, E_FIBER_ERROR, "can't cross C function boundary");
+  int i;
+
+  /* frames at or below ci_clean were verified on an earlier switch and
+     cannot have turned into C boundaries since (acc is fixed at push
+     time; the watermark is lowered whenever frames above it are popped
+     or acc is flipped in place), so only the frames pushed since the
+     last switch need scanning */
+  for (i = c->ci->ciidx; i > c->ci_clean; i--) {
+    if (mrb_ci_at(c, i)->acc < 0) {
+      mrb_control_raise(mrb, E_FIBER_ERROR, "can't cross C function boundary");
     }
   }
+  c->ci_clean = c->ci->ciidx;
 }
 
 static mrb_value
@@ -177,14 +217,15 @@ fiber_switch(mrb_state *mrb, mrb_value self, mrb_int len, const mrb_value *a, mr
 
   fiber_check_cfunc(mrb, c);
   if (resume && c->status == MRB_FIBER_TRANSFERRED) {
-    mrb_raise(mrb, E_FIBER_ERROR, "resuming transferred fiber");
+    mrb_control_raise(mrb, E_FIBER_ERROR, "resuming transferred fiber");
   }
   if (c->status == MRB_FIBER_RUNNING || c->status == MRB_FIBER_RESUMED) {
-    mrb_raise(mrb, E_FIBER_ERROR, "double resume (fib)");
+    mrb_control_raise(mrb, E_FIBER_ERROR, "double resume (fib)");
   }
   if (c->status == MRB_FIBER_TERMINATED) {
-    mrb_raise(mrb, E_FIBER_ERROR, "resuming dead fiber");
+    mrb_control_raise(mrb, E_FIBER_ERROR, "resuming dead fiber");
   }
+  if (mrb->trace) mrb_trace_instant(mrb, resume ? "fiber.resume" : "fiber.transfer");
   mrb->c->status = resume ? MRB_FIBER_RESUMED : MRB_FIBER_TRANSFERRED;
   c->prev = resume ? mrb->c : (c->prev ? c->prev : mrb->root_c);
   if (c->status == MRB_FIBER_CREATED) {
@@ -194,8 +235,13 @@ fiber_switch(mrb_state *mrb, mrb_value self, mrb_int len, const mrb_value *a, mr
     while (b<e) {
       *b++ = *a++;
     }
-    c->cibase->argc = len;
-    value = c->stack[0] = c->ci->proc->env->stack[0];
+    mrb_ci_at(c, 0)->argc = len;
+    if (c->ci->proc->env) {
+      value = c->stack[0] = c->ci->proc->env->stack[0];
+    }
+    else {  /* block compiled without environment; it never reads self */
+      value = c->stack[0] = mrb_nil_value();
+    }
   }
   else {
     value = fiber_result(mrb, a, len);
@@ -205,8 +251,18 @@ fiber_switch(mrb_state *mrb, mrb_value self, mrb_int len, const mrb_value *a, mr
   mrb->c = c;
 
   if (vmexec) {
+    mrb_callinfo *entry = c->ci;
+
     c->vmexec = TRUE;
-    value = mrb_vm_exec(mrb, c->ci[-1].proc, c->ci->pc);
+    /* mirror the in-VM switch-in sequence: deliver the switch value as
+       the result of the call the fiber is parked in (the creation dummy
+       or the C function it yielded from), then drop that frame and
+       resume from its return address */
+    c->stack[0] = value;
+    c->stack = entry->stackent;
+    c->ci = mrb_ci_at(c, entry->ciidx - 1);
+    if (c->ci_clean >= entry->ciidx) c->ci_clean = entry->ciidx - 1;
+    value = mrb_vm_exec(mrb, c->ci->proc, entry->pc);
     mrb->c = old_c;
   }
   else {
@@ -277,6 +333,31 @@ fiber_eq(mrb_state *mrb, mrb_value self)
   return mrb_bool_value(fiber_ptr(self) == fiber_ptr(other));
 }
 
+/* transfer control to a fiber without pushing the caller onto the
+   fiber call stack (see Fiber#transfer below) */
+MRB_API mrb_value
+mrb_fiber_transfer(mrb_state *mrb, mrb_value fib, mrb_int len, const mrb_value *a)
+{
+  struct mrb_context *c = fiber_check(mrb, fib);
+
+  fiber_check_cfunc(mrb, mrb->c);
+
+  if (c == mrb->root_c) {
+    mrb->c->status = MRB_FIBER_TRANSFERRED;
+    mrb->c = c;
+    c->status = MRB_FIBER_RUNNING;
+    MARK_CONTEXT_MODIFY(c);
+    mrb_write_barrier(mrb, (struct RBasic*)c->fib);
+    return fiber_result(mrb, a, len);
+  }
+
+  if (c == mrb->c) {
+    return fiber_result(mrb, a, len);
+  }
+
+  return fiber_switch(mrb, fib, len, a, FALSE, FALSE);
+}
+
 /*
  *  call-seq:
  *     fiber.transfer(args, ...) -> obj
@@ -292,27 +373,11 @@ fiber_eq(mrb_state *mrb, mrb_value self)
 static mrb_value
 fiber_transfer(mrb_state *mrb, mrb_value self)
 {
-  struct mrb_context *c = fiber_check(mrb, self);
-  mrb_value* a;
+  mrb_value *a;
   mrb_int len;
 
-  fiber_check_cfunc(mrb, mrb->c);
   mrb_get_args(mrb, "*", &a, &len);
-
-  if (c == mrb->root_c) {
-    mrb->c->status = MRB_FIBER_TRANSFERRED;
-    mrb->c = c;
-    c->status = MRB_FIBER_RUNNING;
-    MARK_CONTEXT_MODIFY(c);
-    mrb_write_barrier(mrb, (struct RBasic*)c->fib);
-    return fiber_result(mrb, a, len);
-  }
-
-  if (c == mrb->c) {
-    return fiber_result(mrb, a, len);
-  }
-
-  return fiber_switch(mrb, self, len, a, FALSE, FALSE);
+  return mrb_fiber_transfer(mrb, self, len, a);
 }
 
 /* yield values to the caller fiber */
@@ -323,9 +388,10 @@ mrb_fiber_yield(mrb_state *mrb, mrb_int len, const mrb_value *a)
   struct mrb_context *c = mrb->c;
 
   if (!c->prev) {
-    mrb_raise(mrb, E_FIBER_ERROR, "can't yield from root fiber");
+    mrb_control_raise(mrb, E_FIBER_ERROR, "can't yield from root fiber");
   }
 
+  if (mrb->trace) mrb_trace_instant(mrb, "fiber.yield");
   c->prev->status = MRB_FIBER_RUNNING;
   c->status = MRB_FIBER_SUSPENDED;
   mrb->c = c->prev;
@@ -333,6 +399,11 @@ mrb_fiber_yield(mrb_state *mrb, mrb_int len, const mrb_value *a)
   if (c->vmexec) {
     c->vmexec = FALSE;
     mrb->c->ci->acc = CI_ACC_RESUMED;
+    /* the frame just became a C boundary after having been verified;
+       pull the watermark below it so the next switch rechecks it */
+    if (mrb->c->ci_clean >= mrb->c->ci->ciidx) {
+      mrb->c->ci_clean = mrb->c->ci->ciidx - 1;
+    }
   }
   mrb_write_barrier(mrb, (struct RBasic*)c->fib);
   MARK_CONTEXT_MODIFY(mrb->c);
@@ -79,41 +79,6 @@ class Hash
     end
   end
 
-  ##
-  # call-seq:
-  #     hsh.merge!(other_hash)                                 -> hsh
-  #     hsh.merge!(other_hash){|key, oldval, newval| block}    -> hsh
-  #
-  #  Adds the contents of _other_hash_ to _hsh_.  If no block is specified,
-  #  entries with duplicate keys are overwritten with the values from
-  #  _other_hash_, otherwise the value of each duplicate key is determined by
-  #  calling the block with the key, its value in _hsh_ and its value in
-  #  _other_hash_.
-  #
-  #     h1 = { "a" => 100, "b" => 200 }
-  #     h2 = { "b" => 254, "c" => 300 }
-  #     h1.merge!(h2)   #=> {"a"=>100, "b"=>254, "c"=>300}
-  #
-  #     h1 = { "a" => 100, "b" => 200 }
-  #     h2 = { "b" => 254, "c" => 300 }
-  #     h1.merge!(h2) { |key, v1, v2| v1 }
-  #                     #=> {"a"=>100, "b"=>200, "c"=>300}
-  #
-
-  def merge!(other, &block)
-    raise TypeError, "can't convert argument into Hash" unless other.respond_to?(:to_hash)
-    if block
-      other.each_key{|k|
-        self[k] = (self.has_key?(k))? block.call(k, self[k], other[k]): other[k]
-      }
-    else
-      other.each_key{|k| self[k] = other[k]}
-    end
-    self
-  end
-
-  alias update merge!
-
   ##
   #  call-seq:
   #     hsh.fetch(key [, default] )       -> obj
@@ -43,6 +43,9 @@ mrb_mruby_hash_ext_gem_init(mrb_state *mrb)
 
   h = mrb->hash_class;
   mrb_define_method(mrb, h, "values_at", hash_values_at, MRB_ARGS_ANY());
+  /* bulk insertion lives next to the table internals in src/hash.c */
+  mrb_define_method(mrb, h, "merge!",    mrb_hash_update_m, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, h, "update",    mrb_hash_update_m, MRB_ARGS_REQ(1));
 }
 
 void
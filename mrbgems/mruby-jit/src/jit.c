@@ -0,0 +1,686 @@
+/*
+** jit.c - tier-1 template JIT for hot ireps
+**
+** Once a method's invocation counter passes a threshold, its iseq is
+** compiled to native code by pasting per-opcode templates.  Only ireps
+** whose every instruction belongs to a small side-effect-free subset
+** (fixnum arithmetic and comparisons, register moves, branches, plain
+** return) are compiled; a dataflow pass proves every operand a fixnum
+** so no type guards are needed at runtime beyond checking the incoming
+** arguments.  Compiled code works on unboxed mrb_int stack slots and
+** bails out on arithmetic overflow, in which case the interpreter
+** re-executes the method from the start -- safe because the subset has
+** no observable side effects.
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/irep.h>
+#include <mruby/proc.h>
+#include <mruby/opcode.h>
+
+#if defined(__x86_64__) && (defined(__linux__) || defined(__APPLE__)) && MRB_INT_BIT >= 32
+#define MRB_JIT_SUPPORTED 1
+#endif
+
+#ifdef MRB_JIT_SUPPORTED
+
+#include <string.h>
+#include <sys/mman.h>
+
+#define JIT_CALL_THRESHOLD 100
+#define JIT_MAX_ILEN 1024
+#define JIT_MAX_REGS 30
+#define JIT_MAX_ARGS 8
+
+/* abstract types tracked per register and pc */
+enum {
+  TY_NONE = 0,                  /* unknown; must not be read */
+  TY_FIX,
+  TY_BOOL,                      /* 0/1 in the slot */
+  TY_NIL,                       /* 0 in the slot */
+  TY_UNVISITED = 0xff
+};
+
+/* return status of compiled code */
+enum {
+  JIT_R_BAIL = 0,               /* overflow; re-run in the interpreter */
+  JIT_R_FIX,
+  JIT_R_BOOL,
+  JIT_R_NIL
+};
+
+/* compiled code always works on 64-bit slots, whatever mrb_int is;
+   values are kept sign-extended */
+typedef int (*jit_fn)(const int64_t *argv, int64_t *out);
+
+struct jit_entry {
+  uint32_t count;
+  uint8_t state;                /* 0 counting, 1 compiled, 2 rejected */
+  uint8_t req;                  /* required argument count */
+  jit_fn fn;
+  size_t codesize;
+};
+
+struct jit_fixup {
+  size_t at;                    /* offset of the rel32 to patch */
+  int32_t target;               /* vm pc, or -1 for the bail stub */
+};
+
+struct jit_asm {
+  mrb_state *mrb;
+  uint8_t *buf;
+  size_t len, cap;
+  int32_t *off;                 /* native offset per vm pc */
+  struct jit_fixup *fix;
+  size_t nfix, fixcap;
+};
+
+static void
+asm_u8(struct jit_asm *a, uint8_t b)
+{
+  if (a->len == a->cap) {
+    a->cap = a->cap ? a->cap*2 : 256;
+    a->buf = (uint8_t*)mrb_realloc(a->mrb, a->buf, a->cap);
+  }
+  a->buf[a->len++] = b;
+}
+
+static void
+asm_bytes(struct jit_asm *a, const uint8_t *p, size_t n)
+{
+  size_t i;
+  for (i = 0; i < n; i++) asm_u8(a, p[i]);
+}
+
+static void
+asm_u32(struct jit_asm *a, uint32_t v)
+{
+  asm_u8(a, v & 0xff);
+  asm_u8(a, (v >> 8) & 0xff);
+  asm_u8(a, (v >> 16) & 0xff);
+  asm_u8(a, (v >> 24) & 0xff);
+}
+
+#define ASM(a, ...) do {                                        \
+  static const uint8_t bytes_[] = { __VA_ARGS__ };              \
+  asm_bytes(a, bytes_, sizeof(bytes_));                         \
+} while (0)
+
+/* vm register slots live below rbp, 8 bytes each, sign-extended */
+static int32_t
+slot(int r)
+{
+  return -8 * (r + 1);
+}
+
+static void
+ld_rax(struct jit_asm *a, int r)
+{
+  ASM(a, 0x48, 0x8b, 0x85);     /* mov rax, [rbp+disp32] */
+  asm_u32(a, (uint32_t)slot(r));
+}
+
+static void
+ld_rcx(struct jit_asm *a, int r)
+{
+  ASM(a, 0x48, 0x8b, 0x8d);     /* mov rcx, [rbp+disp32] */
+  asm_u32(a, (uint32_t)slot(r));
+}
+
+static void
+st_rax(struct jit_asm *a, int r)
+{
+  ASM(a, 0x48, 0x89, 0x85);     /* mov [rbp+disp32], rax */
+  asm_u32(a, (uint32_t)slot(r));
+}
+
+static void
+add_fixup(struct jit_asm *a, int32_t target)
+{
+  if (a->nfix == a->fixcap) {
+    a->fixcap = a->fixcap ? a->fixcap*2 : 16;
+    a->fix = (struct jit_fixup*)mrb_realloc(a->mrb, a->fix, sizeof(struct jit_fixup)*a->fixcap);
+  }
+  a->fix[a->nfix].at = a->len;
+  a->fix[a->nfix].target = target;
+  a->nfix++;
+  asm_u32(a, 0);
+}
+
+static void
+jo_bail(struct jit_asm *a)
+{
+  ASM(a, 0x0f, 0x80);           /* jo rel32 */
+  add_fixup(a, -1);
+}
+
+/* sign-extend a 32-bit result back into the 64-bit slot */
+static void
+sext_rax(struct jit_asm *a)
+{
+#if MRB_INT_BIT == 32
+  ASM(a, 0x48, 0x63, 0xc0);     /* movsxd rax, eax */
+#else
+  (void)a;
+#endif
+}
+
+static uint8_t
+type_meet(uint8_t x, uint8_t y)
+{
+  if (x == TY_UNVISITED) return y;
+  if (y == TY_UNVISITED) return x;
+  return (x == y) ? x : TY_NONE;
+}
+
+/* compute the abstract type of every register at every pc; returns
+   FALSE when the irep reads a value it cannot prove to be safe */
+static mrb_bool
+jit_typecheck(mrb_state *mrb, mrb_irep *irep, int req, uint8_t *ty)
+{
+  int nregs = irep->nregs;
+  size_t ilen = irep->ilen;
+  int *work;
+  uint8_t *inq;
+  int nwork = 0;
+  mrb_bool ok = TRUE;
+  int r;
+
+  work = (int*)mrb_malloc(mrb, sizeof(int)*ilen);
+  inq = (uint8_t*)mrb_calloc(mrb, ilen, 1);
+  memset(ty, TY_UNVISITED, ilen*nregs);
+  for (r = 0; r < nregs; r++) {
+    ty[1*nregs + r] = (r >= 1 && r <= req) ? TY_FIX : TY_NONE;
+  }
+  work[nwork++] = 1;            /* pc 0 is OP_ENTER */
+  inq[1] = 1;
+
+  while (nwork > 0 && ok) {
+    int pc = work[--nwork];
+
+    inq[pc] = 0;
+    mrb_code i = irep->iseq[pc];
+    uint8_t cur[JIT_MAX_REGS];
+    int succ[2];
+    int nsucc = 0;
+    int a = GETARG_A(i);
+    int s;
+
+    memcpy(cur, &ty[pc*nregs], nregs);
+#define READ(rr) do { if (cur[rr] == TY_NONE) { ok = FALSE; } } while (0)
+#define READ_FIX(rr) do { if (cur[rr] != TY_FIX) { ok = FALSE; } } while (0)
+    switch (GET_OPCODE(i)) {
+    case OP_NOP:
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_MOVE:
+      READ(GETARG_B(i));
+      cur[a] = cur[GETARG_B(i)];
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_LOADI:
+      cur[a] = TY_FIX;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_LOADT:
+    case OP_LOADF:
+      cur[a] = TY_BOOL;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_LOADNIL:
+      cur[a] = TY_NIL;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+      if (GETARG_C(i) != 1) { ok = FALSE; break; }
+      READ_FIX(a);
+      READ_FIX(a+1);
+      cur[a] = TY_FIX;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_ADDI:
+    case OP_SUBI:
+      READ_FIX(a);
+      cur[a] = TY_FIX;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_EQ:
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE:
+      READ_FIX(a);
+      READ_FIX(a+1);
+      cur[a] = TY_BOOL;
+      succ[nsucc++] = pc+1;
+      break;
+    case OP_JMPEQ:
+    case OP_JMPLT:
+    case OP_JMPLE:
+    case OP_JMPGT:
+    case OP_JMPGE:
+      /* branch offset and polarity live in the following jump; with
+         both operands proven fixnum the jump itself is unreachable
+         (see fuse_cmp_jmp in codegen.c) */
+      if ((size_t)pc+1 >= ilen) { ok = FALSE; break; }
+      READ_FIX(a);
+      READ_FIX(a+1);
+      succ[nsucc++] = pc+2;
+      succ[nsucc++] = pc + 1 + GETARG_sBx(irep->iseq[pc+1]);
+      break;
+    case OP_JMP:
+      succ[nsucc++] = pc + GETARG_sBx(i);
+      break;
+    case OP_JMPIF:
+      READ(a);
+      if (cur[a] == TY_FIX) succ[nsucc++] = pc + GETARG_sBx(i);
+      else if (cur[a] == TY_NIL) succ[nsucc++] = pc+1;
+      else {
+        succ[nsucc++] = pc+1;
+        succ[nsucc++] = pc + GETARG_sBx(i);
+      }
+      break;
+    case OP_JMPNOT:
+      READ(a);
+      if (cur[a] == TY_FIX) succ[nsucc++] = pc+1;
+      else if (cur[a] == TY_NIL) succ[nsucc++] = pc + GETARG_sBx(i);
+      else {
+        succ[nsucc++] = pc+1;
+        succ[nsucc++] = pc + GETARG_sBx(i);
+      }
+      break;
+    case OP_RETURN:
+      if (GETARG_B(i) != OP_R_NORMAL) { ok = FALSE; break; }
+      READ(a);
+      break;
+    default:
+      ok = FALSE;
+      break;
+    }
+#undef READ
+#undef READ_FIX
+    for (s = 0; s < nsucc && ok; s++) {
+      uint8_t *tgt;
+      mrb_bool changed = FALSE;
+
+      if (succ[s] <= 0 || (size_t)succ[s] >= ilen) { ok = FALSE; break; }
+      tgt = &ty[succ[s]*nregs];
+      for (r = 0; r < nregs; r++) {
+        uint8_t met = type_meet(tgt[r], cur[r]);
+        if (met != tgt[r]) {
+          tgt[r] = met;
+          changed = TRUE;
+        }
+      }
+      if (changed && !inq[succ[s]]) {
+        inq[succ[s]] = 1;
+        work[nwork++] = succ[s];
+      }
+    }
+  }
+  mrb_free(mrb, work);
+  mrb_free(mrb, inq);
+  return ok;
+}
+
+static mrb_bool
+jit_emit(mrb_state *mrb, mrb_irep *irep, int req, const uint8_t *ty, struct jit_entry *e)
+{
+  struct jit_asm a;
+  int nregs = irep->nregs;
+  size_t ilen = irep->ilen;
+  size_t framesz = ((size_t)nregs*8 + 15) & ~(size_t)15;
+  size_t pc, n, bail_off;
+  int k;
+  void *mem;
+  mrb_bool ok = TRUE;
+
+  memset(&a, 0, sizeof(a));
+  a.mrb = mrb;
+  a.off = (int32_t*)mrb_malloc(mrb, sizeof(int32_t)*ilen);
+
+  /* prologue: rdi = unboxed args, rsi = result out */
+  ASM(&a, 0x55);                        /* push rbp */
+  ASM(&a, 0x48, 0x89, 0xe5);            /* mov rbp, rsp */
+  ASM(&a, 0x48, 0x81, 0xec);            /* sub rsp, imm32 */
+  asm_u32(&a, (uint32_t)framesz);
+  for (k = 0; k < req; k++) {
+    ASM(&a, 0x48, 0x8b, 0x87);          /* mov rax, [rdi+imm32] */
+    asm_u32(&a, (uint32_t)(8*k));
+    st_rax(&a, 1+k);
+  }
+
+  for (pc = 1; pc < ilen && ok; pc++) {
+    mrb_code i = irep->iseq[pc];
+    const uint8_t *cur = &ty[pc*nregs];
+    int at = GETARG_A(i);
+
+    a.off[pc] = (int32_t)a.len;
+    if (cur[0] == TY_UNVISITED) {
+      /* unreachable; never a branch target */
+      continue;
+    }
+    switch (GET_OPCODE(i)) {
+    case OP_NOP:
+      break;
+    case OP_MOVE:
+      ld_rax(&a, GETARG_B(i));
+      st_rax(&a, at);
+      break;
+    case OP_LOADI:
+      ASM(&a, 0x48, 0xc7, 0xc0);        /* mov rax, imm32 (sign-extended) */
+      asm_u32(&a, (uint32_t)GETARG_sBx(i));
+      st_rax(&a, at);
+      break;
+    case OP_LOADT:
+      ASM(&a, 0x48, 0xc7, 0xc0);
+      asm_u32(&a, 1);
+      st_rax(&a, at);
+      break;
+    case OP_LOADF:
+    case OP_LOADNIL:
+      ASM(&a, 0x31, 0xc0);              /* xor eax, eax */
+      st_rax(&a, at);
+      break;
+    case OP_ADD:
+      ld_rax(&a, at);
+      ld_rcx(&a, at+1);
+#if MRB_INT_BIT == 64
+      ASM(&a, 0x48, 0x01, 0xc8);        /* add rax, rcx */
+#else
+      ASM(&a, 0x01, 0xc8);              /* add eax, ecx */
+#endif
+      jo_bail(&a);
+      sext_rax(&a);
+      st_rax(&a, at);
+      break;
+    case OP_SUB:
+      ld_rax(&a, at);
+      ld_rcx(&a, at+1);
+#if MRB_INT_BIT == 64
+      ASM(&a, 0x48, 0x29, 0xc8);        /* sub rax, rcx */
+#else
+      ASM(&a, 0x29, 0xc8);              /* sub eax, ecx */
+#endif
+      jo_bail(&a);
+      sext_rax(&a);
+      st_rax(&a, at);
+      break;
+    case OP_MUL:
+      ld_rax(&a, at);
+      ld_rcx(&a, at+1);
+#if MRB_INT_BIT == 64
+      ASM(&a, 0x48, 0x0f, 0xaf, 0xc1);  /* imul rax, rcx */
+#else
+      ASM(&a, 0x0f, 0xaf, 0xc1);        /* imul eax, ecx */
+#endif
+      jo_bail(&a);
+      sext_rax(&a);
+      st_rax(&a, at);
+      break;
+    case OP_ADDI:
+      ld_rax(&a, at);
+#if MRB_INT_BIT == 64
+      ASM(&a, 0x48, 0x05);              /* add rax, imm32 */
+#else
+      ASM(&a, 0x05);                    /* add eax, imm32 */
+#endif
+      asm_u32(&a, (uint32_t)GETARG_C(i));
+      jo_bail(&a);
+      sext_rax(&a);
+      st_rax(&a, at);
+      break;
+    case OP_SUBI:
+      ld_rax(&a, at);
+#if MRB_INT_BIT == 64
+      ASM(&a, 0x48, 0x2d);              /* sub rax, imm32 */
+#else
+      ASM(&a, 0x2d);                    /* sub eax, imm32 */
+#endif
+      asm_u32(&a, (uint32_t)GETARG_C(i));
+      jo_bail(&a);
+      sext_rax(&a);
+      st_rax(&a, at);
+      break;
+    case OP_EQ:
+    case OP_LT:
+    case OP_LE:
+    case OP_GT:
+    case OP_GE: {
+      uint8_t setcc;
+
+      switch (GET_OPCODE(i)) {
+      case OP_EQ: setcc = 0x94; break;
+      case OP_LT: setcc = 0x9c; break;
+      case OP_LE: setcc = 0x9e; break;
+      case OP_GT: setcc = 0x9f; break;
+      default:    setcc = 0x9d; break;  /* OP_GE */
+      }
+      ld_rax(&a, at);
+      ld_rcx(&a, at+1);
+      ASM(&a, 0x48, 0x39, 0xc8);        /* cmp rax, rcx */
+      ASM(&a, 0x0f); asm_u8(&a, setcc); asm_u8(&a, 0xc0);
+      ASM(&a, 0x0f, 0xb6, 0xc0);        /* movzx eax, al */
+      st_rax(&a, at);
+      break;
+    }
+    case OP_JMPEQ:
+    case OP_JMPLT:
+    case OP_JMPLE:
+    case OP_JMPGT:
+    case OP_JMPGE: {
+      mrb_code i2 = irep->iseq[pc+1];
+      mrb_bool ontrue = GET_OPCODE(i2) == OP_JMPIF;
+      uint8_t jcc;
+
+      /* operands are proven fixnums, so the complement is exact */
+      switch (GET_OPCODE(i)) {
+      case OP_JMPEQ: jcc = ontrue ? 0x84 : 0x85; break;  /* je : jne */
+      case OP_JMPLT: jcc = ontrue ? 0x8c : 0x8d; break;  /* jl : jge */
+      case OP_JMPLE: jcc = ontrue ? 0x8e : 0x8f; break;  /* jle : jg */
+      case OP_JMPGT: jcc = ontrue ? 0x8f : 0x8e; break;  /* jg : jle */
+      default:       jcc = ontrue ? 0x8d : 0x8c; break;  /* jge : jl */
+      }
+      ld_rax(&a, at);
+      ld_rcx(&a, at+1);
+      ASM(&a, 0x48, 0x39, 0xc8);        /* cmp rax, rcx */
+      ASM(&a, 0x0f); asm_u8(&a, jcc);
+      add_fixup(&a, (int32_t)pc + 1 + GETARG_sBx(i2));
+      break;
+    }
+    case OP_JMP:
+      ASM(&a, 0xe9);                    /* jmp rel32 */
+      add_fixup(&a, (int32_t)pc + GETARG_sBx(i));
+      break;
+    case OP_JMPIF:
+      if (cur[at] == TY_FIX) {          /* always truthy */
+        ASM(&a, 0xe9);
+        add_fixup(&a, (int32_t)pc + GETARG_sBx(i));
+      }
+      else if (cur[at] == TY_BOOL) {
+        ld_rax(&a, at);
+        ASM(&a, 0x48, 0x85, 0xc0);      /* test rax, rax */
+        ASM(&a, 0x0f, 0x85);            /* jnz rel32 */
+        add_fixup(&a, (int32_t)pc + GETARG_sBx(i));
+      }
+      /* TY_NIL: never taken */
+      break;
+    case OP_JMPNOT:
+      if (cur[at] == TY_NIL) {          /* always falsy */
+        ASM(&a, 0xe9);
+        add_fixup(&a, (int32_t)pc + GETARG_sBx(i));
+      }
+      else if (cur[at] == TY_BOOL) {
+        ld_rax(&a, at);
+        ASM(&a, 0x48, 0x85, 0xc0);      /* test rax, rax */
+        ASM(&a, 0x0f, 0x84);            /* jz rel32 */
+        add_fixup(&a, (int32_t)pc + GETARG_sBx(i));
+      }
+      /* TY_FIX: never taken */
+      break;
+    case OP_RETURN: {
+      uint32_t st;
+
+      switch (cur[at]) {
+      case TY_FIX:  st = JIT_R_FIX; break;
+      case TY_BOOL: st = JIT_R_BOOL; break;
+      case TY_NIL:  st = JIT_R_NIL; break;
+      default: ok = FALSE; st = JIT_R_BAIL; break;
+      }
+      ld_rax(&a, at);
+      ASM(&a, 0x48, 0x89, 0x06);        /* mov [rsi], rax */
+      ASM(&a, 0xb8);                    /* mov eax, imm32 */
+      asm_u32(&a, st);
+      ASM(&a, 0xc9, 0xc3);              /* leave; ret */
+      break;
+    }
+    default:
+      ok = FALSE;
+      break;
+    }
+  }
+
+  /* bail stub: overflow restarts the method in the interpreter */
+  bail_off = a.len;
+  ASM(&a, 0xb8);
+  asm_u32(&a, JIT_R_BAIL);
+  ASM(&a, 0xc9, 0xc3);                  /* leave; ret */
+
+  for (n = 0; n < a.nfix && ok; n++) {
+    size_t tgt = (a.fix[n].target < 0) ? bail_off : (size_t)a.off[a.fix[n].target];
+    int32_t rel = (int32_t)(tgt - (a.fix[n].at + 4));
+
+    memcpy(&a.buf[a.fix[n].at], &rel, 4);
+  }
+
+  if (ok) {
+    mem = mmap(NULL, a.len, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      ok = FALSE;
+    }
+    else {
+      memcpy(mem, a.buf, a.len);
+      if (mprotect(mem, a.len, PROT_READ|PROT_EXEC) != 0) {
+        munmap(mem, a.len);
+        ok = FALSE;
+      }
+      else {
+        e->fn = (jit_fn)mem;
+        e->codesize = a.len;
+        e->req = (uint8_t)req;
+      }
+    }
+  }
+  mrb_free(mrb, a.buf);
+  mrb_free(mrb, a.off);
+  mrb_free(mrb, a.fix);
+  return ok;
+}
+
+static mrb_bool
+jit_compile(mrb_state *mrb, mrb_irep *irep, struct jit_entry *e)
+{
+  mrb_code i0;
+  uint32_t ax;
+  int req;
+  uint8_t *ty;
+  mrb_bool ok;
+
+  if (irep->ilen < 2 || irep->ilen > JIT_MAX_ILEN) return FALSE;
+  if (irep->nregs > JIT_MAX_REGS) return FALSE;
+  i0 = irep->iseq[0];
+  if (GET_OPCODE(i0) != OP_ENTER) return FALSE;
+  ax = GETARG_Ax(i0);
+  req = (ax >> 18) & 0x1f;
+  if (ax != (uint32_t)MRB_ARGS_REQ(req)) return FALSE;  /* required args only */
+  if (req > JIT_MAX_ARGS) return FALSE;
+
+  ty = (uint8_t*)mrb_malloc(mrb, irep->ilen * irep->nregs);
+  ok = jit_typecheck(mrb, irep, req, ty);
+  if (ok) {
+    ok = jit_emit(mrb, irep, req, ty, e);
+  }
+  mrb_free(mrb, ty);
+  return ok;
+}
+
+static int
+jit_call_hook(mrb_state *mrb, struct RProc *m, mrb_value *argv, int argc, mrb_value *result)
+{
+  mrb_irep *irep = m->body.irep;
+  struct jit_entry *e = (struct jit_entry*)irep->jit;
+  int64_t a[JIT_MAX_ARGS];
+  int64_t out = 0;
+  int st, k;
+
+  if (!e) {
+    e = (struct jit_entry*)mrb_calloc(mrb, 1, sizeof(struct jit_entry));
+    irep->jit = e;
+  }
+  if (e->state == 2) return FALSE;
+  if (e->state == 0) {
+    if (++e->count < JIT_CALL_THRESHOLD) return FALSE;
+    if (!jit_compile(mrb, irep, e)) {
+      e->state = 2;
+      return FALSE;
+    }
+    e->state = 1;
+  }
+  if (argc != e->req) return FALSE;     /* wrong arity raises in the interpreter */
+  for (k = 0; k < argc; k++) {
+    if (!mrb_fixnum_p(argv[k+1])) return FALSE;
+    a[k] = mrb_fixnum(argv[k+1]);
+  }
+  st = e->fn(a, &out);
+  switch (st) {
+  case JIT_R_FIX:
+    *result = mrb_fixnum_value((mrb_int)out);
+    return TRUE;
+  case JIT_R_BOOL:
+    *result = mrb_bool_value(out != 0);
+    return TRUE;
+  case JIT_R_NIL:
+    *result = mrb_nil_value();
+    return TRUE;
+  default:                              /* JIT_R_BAIL */
+    return FALSE;
+  }
+}
+
+static void
+jit_irep_free_hook(mrb_state *mrb, mrb_irep *irep)
+{
+  struct jit_entry *e = (struct jit_entry*)irep->jit;
+
+  if (e->fn) {
+    munmap((void*)e->fn, e->codesize);
+  }
+  mrb_free(mrb, e);
+  irep->jit = NULL;
+}
+
+static const struct mrb_jit_hooks jit_hooks = {
+  jit_call_hook,
+  jit_irep_free_hook,
+};
+
+#endif  /* MRB_JIT_SUPPORTED */
+
+void
+mrb_mruby_jit_gem_init(mrb_state *mrb)
+{
+#ifdef MRB_JIT_SUPPORTED
+  mrb->jit = &jit_hooks;
+#endif
+}
+
+void
+mrb_mruby_jit_gem_final(mrb_state *mrb)
+{
+  /* keep the hooks installed: ireps outlive gem finalization and their
+     compiled code is released through jit_irep_free_hook in mrb_close */
+}
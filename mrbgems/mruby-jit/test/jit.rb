@@ -0,0 +1,59 @@
+##
+# mruby-jit test
+# methods are called past the compile threshold so the assertions run
+# against the compiled code
+
+assert('JIT compiled loop matches the interpreter') do
+  def jit_sum(n)
+    i = 0
+    s = 0
+    while i < n
+      s += i
+      i += 1
+    end
+    s
+  end
+
+  r = 0
+  200.times { r = jit_sum(100) }
+  assert_equal 4950, r
+  assert_equal 0, jit_sum(0)
+end
+
+assert('JIT compiled comparison returns booleans') do
+  def jit_lt(a, b)
+    a < b
+  end
+
+  r = nil
+  200.times { r = jit_lt(1, 2) }
+  assert_true r
+  assert_false jit_lt(5, 2)
+  # non-fixnum arguments fall back to the interpreter
+  assert_true jit_lt("a", "b")
+end
+
+assert('JIT bails out to the interpreter on fixnum overflow') do
+  def jit_double(n)
+    i = 0
+    while i < 80
+      n += n
+      i += 1
+    end
+    n
+  end
+
+  r = nil
+  200.times { r = jit_double(3) }
+  assert_equal Float, r.class
+  assert_true r > 0
+end
+
+assert('JIT keeps argument errors') do
+  def jit_id(a)
+    a
+  end
+
+  200.times { jit_id(1) }
+  assert_raise(ArgumentError) { jit_id(1, 2) }
+end
@@ -16,7 +16,7 @@ static mrb_value
 mrb_f_method(mrb_state *mrb, mrb_value self)
 {
   mrb_callinfo *ci = mrb->c->ci;
-  ci--;
+  ci = mrb_ci_at(mrb->c, ci->ciidx - 1);
   if (ci->mid)
     return mrb_symbol_value(ci->mid);
   else
@@ -150,3 +150,29 @@ end
 assert('Math.erfc -1') do
   check_float(Math.erfc(-1), 1.8427007929497148)
 end
+
+assert('Math.map_sqrt') do
+  r = Math.map_sqrt([4.0, 9, 2.0])
+  assert_float 2.0, r[0]
+  assert_float 3.0, r[1]
+  assert_float Math.sqrt(2.0), r[2]
+  assert_raise(Math::DomainError) { Math.map_sqrt([-1.0]) }
+  assert_raise(TypeError) { Math.map_sqrt(["x"]) }
+end
+
+assert('Math.map_sin fast approximation') do
+  [-7.25, -1.0, 0.0, 0.5, 3.0, 42.0].each do |x|
+    assert_true (Math.map_sin([x], true)[0] - Math.sin(x)).abs < 1e-6
+    assert_true (Math.map_cos([x], true)[0] - Math.cos(x)).abs < 1e-6
+  end
+  assert_true (Math.map_exp([3.7], true)[0] - Math.exp(3.7)).abs / Math.exp(3.7) < 1e-6
+  assert_true (Math.map_log([123.4], true)[0] - Math.log(123.4)).abs < 1e-6
+end
+
+assert('Math.map_exp over FloatArray') do
+  f = FloatArray.new(3)
+  3.times { |i| f[i] = i.to_f }
+  g = Math.map_exp(f)
+  assert_equal FloatArray, g.class
+  assert_float Math::E, g[1]
+end
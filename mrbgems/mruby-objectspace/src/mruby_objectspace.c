@@ -1,4 +1,5 @@
 #include <mruby.h>
+#include <mruby/array.h>
 #include <mruby/gc.h>
 #include <mruby/hash.h>
 #include <mruby/class.h>
@@ -171,12 +172,162 @@ os_each_object(mrb_state *mrb, mrb_value self)
   return mrb_fixnum_value(d.count);
 }
 
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_start(interval=1, capacity=1024) -> nil
+ *
+ *  Starts sampled allocation tracing. One in +interval+ allocations is
+ *  recorded (type tag, class, allocating method) into a ring buffer of
+ *  +capacity+ records; the newest sample overwrites the oldest. Larger
+ *  intervals lower the overhead accordingly.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_start(mrb_state *mrb, mrb_value self)
+{
+  mrb_int interval = 1, capacity = 1024;
+
+  mrb_get_args(mrb, "|ii", &interval, &capacity);
+  mrb_alloc_trace_start(mrb, (int32_t)interval, (int32_t)capacity);
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.trace_allocations_stop -> nil
+ *
+ *  Stops allocation tracing and discards the collected samples.
+ *
+ */
+
+static mrb_value
+os_trace_allocations_stop(mrb_state *mrb, mrb_value self)
+{
+  mrb_alloc_trace_stop(mrb);
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.allocation_samples -> hash
+ *
+ *  Returns the collected allocation samples aggregated into a hash of
+ *
+ *    [type_symbol, class_symbol, method_symbol] => count
+ *
+ *  where class and method are nil when unknown (anonymous class,
+ *  toplevel). Tracing keeps running; an empty hash is returned when
+ *  tracing was never started.
+ *
+ */
+
+static mrb_value
+os_allocation_samples(mrb_state *mrb, mrb_value self)
+{
+  mrb_alloc_trace *tr = mrb->gc.alloc_trace;
+  mrb_value hash = mrb_hash_new(mrb);
+  size_t i;
+  int ai = mrb_gc_arena_save(mrb);
+
+  if (!tr) return hash;
+  /* detach the trace while aggregating so our own allocations do not
+     overwrite the records being read */
+  mrb->gc.alloc_trace = NULL;
+  for (i = 0; i < tr->count; i++) {
+    mrb_alloc_trace_rec *rec = &tr->samples[i];
+    mrb_value key = mrb_ary_new_capa(mrb, 3);
+    mrb_value type;
+    mrb_value cnt;
+
+    switch ((enum mrb_vtype)rec->tt) {
+#define COUNT_TYPE(t) case (MRB_T ## t): type = mrb_symbol_value(mrb_intern_lit(mrb, #t)); break;
+      COUNT_TYPE(T_FALSE);
+      COUNT_TYPE(T_FREE);
+      COUNT_TYPE(T_TRUE);
+      COUNT_TYPE(T_FIXNUM);
+      COUNT_TYPE(T_SYMBOL);
+      COUNT_TYPE(T_UNDEF);
+      COUNT_TYPE(T_FLOAT);
+      COUNT_TYPE(T_CPTR);
+      COUNT_TYPE(T_OBJECT);
+      COUNT_TYPE(T_CLASS);
+      COUNT_TYPE(T_MODULE);
+      COUNT_TYPE(T_ICLASS);
+      COUNT_TYPE(T_SCLASS);
+      COUNT_TYPE(T_PROC);
+      COUNT_TYPE(T_ARRAY);
+      COUNT_TYPE(T_HASH);
+      COUNT_TYPE(T_STRING);
+      COUNT_TYPE(T_RANGE);
+      COUNT_TYPE(T_EXCEPTION);
+      COUNT_TYPE(T_FILE);
+      COUNT_TYPE(T_ENV);
+      COUNT_TYPE(T_DATA);
+      COUNT_TYPE(T_FIBER);
+#undef COUNT_TYPE
+    default:
+      type = mrb_fixnum_value(rec->tt); break;
+    }
+    mrb_ary_push(mrb, key, type);
+    mrb_ary_push(mrb, key, rec->cname ? mrb_symbol_value(rec->cname) : mrb_nil_value());
+    mrb_ary_push(mrb, key, rec->mid ? mrb_symbol_value(rec->mid) : mrb_nil_value());
+    cnt = mrb_hash_get(mrb, hash, key);
+    mrb_hash_set(mrb, hash, key, mrb_fixnum_value(mrb_nil_p(cnt) ? 1 : mrb_fixnum(cnt) + 1));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  mrb->gc.alloc_trace = tr;
+  return hash;
+}
+
+static void
+os_count_size_cb(mrb_state *mrb, struct RClass *cls, mrb_int count, mrb_int bytes, void *data)
+{
+  mrb_value hash = *(mrb_value*)data;
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_value pair = mrb_ary_new_capa(mrb, 2);
+
+  mrb_ary_push(mrb, pair, mrb_fixnum_value(count));
+  mrb_ary_push(mrb, pair, mrb_fixnum_value(bytes));
+  mrb_hash_set(mrb, hash, mrb_obj_value(cls), pair);
+  mrb_gc_arena_restore(mrb, ai);
+}
+
+/*
+ *  call-seq:
+ *     ObjectSpace.count_objects_size -> hash
+ *
+ *  Returns live object counts and memory per class:
+ *
+ *    { String => [count, bytes], ... }
+ *
+ *  where bytes includes external buffers (string and array capacity,
+ *  hash buckets, variable tables).  The first call starts incremental
+ *  per-class accounting with one seeding scan; from then on counts
+ *  follow allocation and every full GC re-measures the byte sizes, so
+ *  repeated calls never rescan the heap.
+ *
+ */
+
+static mrb_value
+os_count_objects_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_value hash = mrb_hash_new(mrb);
+
+  mrb_census_each(mrb, os_count_size_cb, &hash);
+  return hash;
+}
+
 void
 mrb_mruby_objectspace_gem_init(mrb_state *mrb)
 {
   struct RClass *os = mrb_define_module(mrb, "ObjectSpace");
   mrb_define_class_method(mrb, os, "count_objects", os_count_objects, MRB_ARGS_OPT(1));
   mrb_define_class_method(mrb, os, "each_object", os_each_object, MRB_ARGS_OPT(1));
+  mrb_define_class_method(mrb, os, "trace_allocations_start", os_trace_allocations_start, MRB_ARGS_OPT(2));
+  mrb_define_class_method(mrb, os, "trace_allocations_stop", os_trace_allocations_stop, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "allocation_samples", os_allocation_samples, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, os, "count_objects_size", os_count_objects_size, MRB_ARGS_NONE());
 }
 
 void
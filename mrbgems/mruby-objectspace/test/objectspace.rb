@@ -58,3 +58,40 @@ end
 assert 'Check class pointer of ObjectSpace.each_object.' do
   ObjectSpace.each_object { |obj| !obj }
 end
+
+assert('ObjectSpace.trace_allocations') do
+  class AllocTracedThing; end
+  begin
+    ObjectSpace.trace_allocations_start(1, 512)
+    things = []
+    10.times { things << AllocTracedThing.new }
+    samples = ObjectSpace.allocation_samples
+    assert_kind_of(Hash, samples)
+    assert_true(samples.keys.any? {|type, cls, meth|
+      type == :T_OBJECT && cls == :AllocTracedThing
+    })
+    assert_true(samples.values.all? {|v| v.is_a?(Integer) && v > 0 })
+  ensure
+    ObjectSpace.trace_allocations_stop
+  end
+  assert_equal({}, ObjectSpace.allocation_samples)
+end
+
+assert('ObjectSpace.count_objects_size') do
+  class SizeCountedThing
+    def initialize
+      @payload = "x" * 128
+    end
+  end
+  things = []
+  10.times { things << SizeCountedThing.new }
+  sizes = ObjectSpace.count_objects_size
+  assert_kind_of(Hash, sizes)
+  count, bytes = sizes[SizeCountedThing]
+  assert_true(count >= 10)
+  assert_true(bytes > 0)
+  str_count, str_bytes = sizes[String]
+  assert_true(str_count >= 10)
+  # heap-allocated payloads charge their capacity, not just the cell
+  assert_true(str_bytes > str_count)
+end
@@ -25,11 +25,14 @@ module Kernel
     len = args.size
     while i < len
       s = args[i].to_s
-      __printstr__ s
-      __printstr__ "\n" if (s[-1] != "\n")
+      if s[-1] == "\n"
+        __printstr__ s
+      else
+        __printline__ s
+      end
       i += 1
     end
-    __printstr__ "\n" if len == 0
+    __printline__ "" if len == 0
     nil
   end
 
@@ -41,8 +44,7 @@ module Kernel
     i = 0
     len = args.size
     while i < len
-      __printstr__ args[i].inspect
-      __printstr__ "\n"
+      __printline__ args[i].inspect
       i += 1
     end
     args[0]
@@ -62,3 +64,67 @@ module Kernel
     end
   end
 end
+
+##
+# Minimal handle over the buffered print writer, so scripts can tune
+# it the way they would a real IO ($stdout.sync = false before a bulk
+# export, $stdout.flush at a checkpoint).  mruby-io, when present,
+# replaces this with a full IO object.
+$stdout = Object.new
+
+class << $stdout
+  def write(s)
+    s = s.to_s
+    __printstr__ s
+    s.size
+  end
+
+  def print(*args)
+    i = 0
+    len = args.size
+    while i < len
+      __printstr__ args[i].to_s
+      i += 1
+    end
+  end
+
+  def puts(*args)
+    i = 0
+    len = args.size
+    while i < len
+      s = args[i].to_s
+      if s[-1] == "\n"
+        __printstr__ s
+      else
+        __printline__ s
+      end
+      i += 1
+    end
+    __printline__ "" if len == 0
+    nil
+  end
+
+  # force buffered output out to the descriptor
+  def flush
+    __printflush__
+    self
+  end
+
+  # false => flush only when the buffer fills (bulk export)
+  # :line => flush completed lines (the default)
+  # true  => flush after every call (IO#sync semantics)
+  def sync
+    [false, :line, true][__printsync__]
+  end
+
+  def sync=(mode)
+    __printsync__(mode == :line ? 1 : (mode ? 2 : 0))
+    mode
+  end
+
+  # resize the writer's buffer; larger buffers batch more lines per
+  # write when sync is false
+  def buffer_size=(size)
+    __printbufsize__(size)
+  end
+end
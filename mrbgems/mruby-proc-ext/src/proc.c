@@ -25,6 +25,7 @@ mrb_proc_source_location(mrb_state *mrb, mrb_value self)
     int32_t line;
     const char *filename;
 
+    mrb_debug_info_materialize(mrb, irep);
     filename = mrb_debug_get_filename(irep, 0);
     line = mrb_debug_get_line(irep, 0);
 
@@ -46,6 +47,7 @@ mrb_proc_inspect(mrb_state *mrb, mrb_value self)
     int32_t line;
     mrb_str_cat_lit(mrb, str, "@");
 
+    mrb_debug_info_materialize(mrb, irep);
     filename = mrb_debug_get_filename(irep, 0);
     mrb_str_cat_cstr(mrb, str, filename ? filename : "-");
     mrb_str_cat_lit(mrb, str, ":");
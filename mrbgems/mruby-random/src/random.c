@@ -9,62 +9,64 @@
 #include <mruby/class.h>
 #include <mruby/data.h>
 #include <mruby/array.h>
-#include "mt19937ar.h"
+#include <mruby/string.h>
+#include "xoshiro256.h"
+#include "random.h"
 
 #include <time.h>
 
-static char const MT_STATE_KEY[] = "$mrb_i_mt_state";
+static char const RAND_STATE_KEY[] = "$mrb_i_rand_state";
 
-static const struct mrb_data_type mt_state_type = {
-  MT_STATE_KEY, mrb_free,
+static const struct mrb_data_type rand_state_type = {
+  RAND_STATE_KEY, mrb_free,
 };
 
 static mrb_value mrb_random_rand(mrb_state *mrb, mrb_value self);
 static mrb_value mrb_random_srand(mrb_state *mrb, mrb_value self);
 
 static void
-mt_srand(mt_state *t, unsigned long seed)
+rand_srand(rand_state *t, unsigned long seed)
 {
   mrb_random_init_genrand(t, seed);
 }
 
 static unsigned long
-mt_rand(mt_state *t)
+rand_int32(rand_state *t)
 {
   return mrb_random_genrand_int32(t);
 }
 
 static double
-mt_rand_real(mt_state *t)
+rand_real(rand_state *t)
 {
   return mrb_random_genrand_real1(t);
 }
 
 static mrb_value
-mrb_random_mt_srand(mrb_state *mrb, mt_state *t, mrb_value seed)
+mrb_random_rand_srand(mrb_state *mrb, rand_state *t, mrb_value seed)
 {
   if (mrb_nil_p(seed)) {
-    seed = mrb_fixnum_value((mrb_int)(time(NULL) + mt_rand(t)));
+    seed = mrb_fixnum_value((mrb_int)(time(NULL) + rand_int32(t)));
     if (mrb_fixnum(seed) < 0) {
       seed = mrb_fixnum_value(0 - mrb_fixnum(seed));
     }
   }
 
-  mt_srand(t, (unsigned) mrb_fixnum(seed));
+  rand_srand(t, (unsigned) mrb_fixnum(seed));
 
   return seed;
 }
 
 static mrb_value
-mrb_random_mt_rand(mrb_state *mrb, mt_state *t, mrb_value max)
+mrb_random_rand_int(mrb_state *mrb, rand_state *t, mrb_value max)
 {
   mrb_value value;
 
   if (mrb_fixnum(max) == 0) {
-    value = mrb_float_value(mrb, mt_rand_real(t));
+    value = mrb_float_value(mrb, rand_real(t));
   }
   else {
-    value = mrb_fixnum_value(mt_rand(t) % mrb_fixnum(max));
+    value = mrb_fixnum_value(rand_int32(t) % mrb_fixnum(max));
   }
 
   return value;
@@ -97,11 +99,11 @@ get_random(mrb_state *mrb) {
              mrb_intern_lit(mrb, "DEFAULT"));
 }
 
-static mt_state *
+static rand_state *
 get_random_state(mrb_state *mrb)
 {
   mrb_value random_val = get_random(mrb);
-  return DATA_GET_PTR(mrb, random_val, &mt_state_type, mt_state);
+  return DATA_GET_PTR(mrb, random_val, &rand_state_type, rand_state);
 }
 
 static mrb_value
@@ -122,20 +124,19 @@ static mrb_value
 mrb_random_init(mrb_state *mrb, mrb_value self)
 {
   mrb_value seed;
-  mt_state *t;
+  rand_state *t;
 
   /* avoid memory leaks */
-  t = (mt_state*)DATA_PTR(self);
+  t = (rand_state*)DATA_PTR(self);
   if (t) {
     mrb_free(mrb, t);
   }
-  mrb_data_init(self, NULL, &mt_state_type);
+  mrb_data_init(self, NULL, &rand_state_type);
 
-  t = (mt_state *)mrb_malloc(mrb, sizeof(mt_state));
-  t->mti = N + 1;
+  t = (rand_state *)mrb_malloc(mrb, sizeof(rand_state));
 
   seed = get_opt(mrb);
-  seed = mrb_random_mt_srand(mrb, t, seed);
+  seed = mrb_random_rand_srand(mrb, t, seed);
   if (mrb_nil_p(seed)) {
     t->has_seed = FALSE;
   }
@@ -145,16 +146,16 @@ mrb_random_init(mrb_state *mrb, mrb_value self)
     t->seed = mrb_fixnum(seed);
   }
 
-  mrb_data_init(self, t, &mt_state_type);
+  mrb_data_init(self, t, &rand_state_type);
 
   return self;
 }
 
 static void
-mrb_random_rand_seed(mrb_state *mrb, mt_state *t)
+mrb_random_rand_seed(mrb_state *mrb, rand_state *t)
 {
   if (!t->has_seed) {
-    mrb_random_mt_srand(mrb, t, mrb_nil_value());
+    mrb_random_rand_srand(mrb, t, mrb_nil_value());
   }
 }
 
@@ -162,11 +163,11 @@ static mrb_value
 mrb_random_rand(mrb_state *mrb, mrb_value self)
 {
   mrb_value max;
-  mt_state *t = DATA_GET_PTR(mrb, self, &mt_state_type, mt_state);
+  rand_state *t = DATA_GET_PTR(mrb, self, &rand_state_type, rand_state);
 
   max = get_opt(mrb);
   mrb_random_rand_seed(mrb, t);
-  return mrb_random_mt_rand(mrb, t, max);
+  return mrb_random_rand_int(mrb, t, max);
 }
 
 static mrb_value
@@ -174,10 +175,10 @@ mrb_random_srand(mrb_state *mrb, mrb_value self)
 {
   mrb_value seed;
   mrb_value old_seed;
-  mt_state *t = DATA_GET_PTR(mrb, self, &mt_state_type, mt_state);
+  rand_state *t = DATA_GET_PTR(mrb, self, &rand_state_type, rand_state);
 
   seed = get_opt(mrb);
-  seed = mrb_random_mt_srand(mrb, t, seed);
+  seed = mrb_random_rand_srand(mrb, t, seed);
   old_seed = t->has_seed? mrb_fixnum_value(t->seed) : mrb_nil_value();
   if (mrb_nil_p(seed)) {
     t->has_seed = FALSE;
@@ -191,6 +192,82 @@ mrb_random_srand(mrb_state *mrb, mrb_value self)
   return old_seed;
 }
 
+/*
+ *  call-seq:
+ *     rnd.bytes(size)  ->  string
+ *
+ *  Returns a string of +size+ random bytes, drawn in bulk from the
+ *  generator with one method dispatch.
+ */
+static mrb_value
+mrb_random_bytes(mrb_state *mrb, mrb_value self)
+{
+  mrb_int n;
+  mrb_value str;
+  rand_state *t = DATA_GET_PTR(mrb, self, &rand_state_type, rand_state);
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative size");
+  }
+  mrb_random_rand_seed(mrb, t);
+  str = mrb_str_new(mrb, NULL, n);
+  mrb_random_genrand_fill(t, RSTRING_PTR(str), (size_t)n);
+
+  return str;
+}
+
+/*
+ *  call-seq:
+ *     rnd.floats(size)  ->  array
+ *
+ *  Returns an array of +size+ random floats on [0,1), filled from a
+ *  batch of draws instead of one rand call per element.
+ */
+static mrb_value
+mrb_random_floats(mrb_state *mrb, mrb_value self)
+{
+  double buf[128];
+  mrb_int n, i;
+  size_t m;
+  mrb_value ary;
+  int ai;
+  rand_state *t = DATA_GET_PTR(mrb, self, &rand_state_type, rand_state);
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative size");
+  }
+  mrb_random_rand_seed(mrb, t);
+  ary = mrb_ary_new_capa(mrb, n);
+  ai = mrb_gc_arena_save(mrb);
+  while (n > 0) {
+    m = (n > (mrb_int)(sizeof(buf)/sizeof(buf[0]))) ? sizeof(buf)/sizeof(buf[0]) : (size_t)n;
+    mrb_random_genrand_fill_real(t, buf, m);
+    for (i = 0; i < (mrb_int)m; i++) {
+      mrb_ary_push(mrb, ary, mrb_float_value(mrb, buf[i]));
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    n -= (mrb_int)m;
+  }
+
+  return ary;
+}
+
+/*
+ * Fills buf with len random bytes from the default generator; the
+ * C-side counterpart of Random#bytes for embedding code that needs
+ * bulk randomness without entering the VM.
+ */
+MRB_API void
+mrb_random_fill(mrb_state *mrb, void *buf, size_t len)
+{
+  rand_state *t = get_random_state(mrb);
+
+  mrb_random_rand_seed(mrb, t);
+  mrb_random_genrand_fill(t, buf, len);
+}
+
 /*
  *  call-seq:
  *     ary.shuffle!   ->   ary
@@ -202,10 +279,10 @@ static mrb_value
 mrb_ary_shuffle_bang(mrb_state *mrb, mrb_value ary)
 {
   mrb_int i;
-  mt_state *random = NULL;
+  rand_state *random = NULL;
 
   if (RARRAY_LEN(ary) > 1) {
-    mrb_get_args(mrb, "|d", &random, &mt_state_type);
+    mrb_get_args(mrb, "|d", &random, &rand_state_type);
 
     if (random == NULL) {
       random = get_random_state(mrb);
@@ -218,11 +295,11 @@ mrb_ary_shuffle_bang(mrb_state *mrb, mrb_value ary)
       mrb_int j;
       mrb_value tmp;
 
-      j = mrb_fixnum(mrb_random_mt_rand(mrb, random, mrb_fixnum_value(RARRAY_LEN(ary))));
+      j = mrb_fixnum(mrb_random_rand_int(mrb, random, mrb_fixnum_value(RARRAY_LEN(ary))));
 
       tmp = RARRAY_PTR(ary)[i];
-      mrb_ary_ptr(ary)->ptr[i] = RARRAY_PTR(ary)[j];
-      mrb_ary_ptr(ary)->ptr[j] = tmp;
+      ARY_PTR(mrb_ary_ptr(ary))[i] = RARRAY_PTR(ary)[j];
+      ARY_PTR(mrb_ary_ptr(ary))[j] = tmp;
     }
   }
 
@@ -265,15 +342,15 @@ mrb_ary_sample(mrb_state *mrb, mrb_value ary)
 {
   mrb_int n = 0;
   mrb_bool given;
-  mt_state *random = NULL;
+  rand_state *random = NULL;
   mrb_int len = RARRAY_LEN(ary);
 
-  mrb_get_args(mrb, "|i?d", &n, &given, &random, &mt_state_type);
+  mrb_get_args(mrb, "|i?d", &n, &given, &random, &rand_state_type);
   if (random == NULL) {
     random = get_random_state(mrb);
   }
   mrb_random_rand_seed(mrb, random);
-  mt_rand(random);
+  rand_int32(random);
   if (!given) {                 /* pick one element */
     switch (len) {
     case 0:
@@ -281,7 +358,7 @@ mrb_ary_sample(mrb_state *mrb, mrb_value ary)
     case 1:
       return RARRAY_PTR(ary)[0];
     default:
-      return RARRAY_PTR(ary)[mt_rand(random) % len];
+      return RARRAY_PTR(ary)[rand_int32(random) % len];
     }
   }
   else {
@@ -296,7 +373,7 @@ mrb_ary_sample(mrb_state *mrb, mrb_value ary)
 
       for (;;) {
       retry:
-        r = mt_rand(random) % len;
+        r = rand_int32(random) % len;
 
         for (j=0; j<i; j++) {
           if (mrb_fixnum(RARRAY_PTR(result)[j]) == r) {
@@ -331,6 +408,8 @@ void mrb_mruby_random_gem_init(mrb_state *mrb)
   mrb_define_method(mrb, random, "initialize", mrb_random_init, MRB_ARGS_OPT(1));
   mrb_define_method(mrb, random, "rand", mrb_random_rand, MRB_ARGS_OPT(1));
   mrb_define_method(mrb, random, "srand", mrb_random_srand, MRB_ARGS_OPT(1));
+  mrb_define_method(mrb, random, "bytes", mrb_random_bytes, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, random, "floats", mrb_random_floats, MRB_ARGS_REQ(1));
 
   mrb_define_method(mrb, array, "shuffle", mrb_ary_shuffle, MRB_ARGS_OPT(1));
   mrb_define_method(mrb, array, "shuffle!", mrb_ary_shuffle_bang, MRB_ARGS_OPT(1));
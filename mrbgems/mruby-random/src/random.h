@@ -9,4 +9,7 @@
 
 void mrb_mruby_random_gem_init(mrb_state *mrb);
 
+/* fills buf with len random bytes from the default generator */
+MRB_API void mrb_random_fill(mrb_state *mrb, void *buf, size_t len);
+
 #endif
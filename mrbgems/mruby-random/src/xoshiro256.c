@@ -0,0 +1,97 @@
+/*
+** xoshiro256.c - xoshiro256** pseudorandom number generator
+**
+** Based on the public domain reference implementation by
+** David Blackman and Sebastiano Vigna (2018).
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include <mruby.h>
+#include "xoshiro256.h"
+
+static uint64_t
+rotl(uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+
+static uint64_t
+rand_next(rand_state *t)
+{
+  uint64_t *s = t->s;
+  uint64_t result = rotl(s[1] * 5, 7) * 9;
+  uint64_t u = s[1] << 17;
+
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= u;
+  s[3] = rotl(s[3], 45);
+
+  return result;
+}
+
+/* expands the seed into the 256-bit state with splitmix64, as the
+   xoshiro authors recommend; guarantees a non-zero state */
+void
+mrb_random_init_genrand(rand_state *t, unsigned long seed)
+{
+  uint64_t z = (uint64_t)seed;
+  uint64_t w;
+  int i;
+
+  for (i = 0; i < 4; i++) {
+    z += 0x9e3779b97f4a7c15ULL;
+    w = z;
+    w = (w ^ (w >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    w = (w ^ (w >> 27)) * 0x94d049bb133111ebULL;
+    t->s[i] = w ^ (w >> 31);
+  }
+}
+
+/* generates a random number on [0,0xffffffff]-interval */
+unsigned long
+mrb_random_genrand_int32(rand_state *t)
+{
+  return (unsigned long)(rand_next(t) >> 32);
+}
+
+/* generates a random number on [0,1) with 53-bit resolution */
+double
+mrb_random_genrand_real1(rand_state *t)
+{
+  return (double)(rand_next(t) >> 11) * (1.0/9007199254740992.0);
+}
+
+/* fills buf with len random bytes */
+void
+mrb_random_genrand_fill(rand_state *t, void *buf, size_t len)
+{
+  uint8_t *p = (uint8_t *)buf;
+  uint64_t r;
+
+  while (len >= sizeof(r)) {
+    r = rand_next(t);
+    memcpy(p, &r, sizeof(r));
+    p += sizeof(r);
+    len -= sizeof(r);
+  }
+  if (len > 0) {
+    r = rand_next(t);
+    memcpy(p, &r, len);
+  }
+}
+
+/* fills buf with len doubles on [0,1) */
+void
+mrb_random_genrand_fill_real(rand_state *t, double *buf, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    buf[i] = (double)(rand_next(t) >> 11) * (1.0/9007199254740992.0);
+  }
+}
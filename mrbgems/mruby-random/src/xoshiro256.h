@@ -0,0 +1,18 @@
+/*
+** xoshiro256.h - xoshiro256** random functions
+**
+** See Copyright Notice in mruby.h
+*/
+
+typedef struct rand_state {
+  uint64_t s[4];
+
+  mrb_int seed;
+  mrb_bool has_seed : 1;
+} rand_state;
+
+void mrb_random_init_genrand(rand_state *, unsigned long);
+unsigned long mrb_random_genrand_int32(rand_state *);
+double mrb_random_genrand_real1(rand_state *);
+void mrb_random_genrand_fill(rand_state *, void *, size_t);
+void mrb_random_genrand_fill_real(rand_state *, double *, size_t);
@@ -74,3 +74,21 @@ assert('Array#shuffle!(random)') do
 
   ary1 != [1, 2, 3, 4, 5, 6, 7, 8, 9, 10] and 10.times { |x| ary1.include? x } and ary1 == ary2
 end
+
+assert("Random#bytes") do
+  r1 = Random.new(456)
+  b1 = r1.bytes(17)
+  r2 = Random.new(456)
+  b2 = r2.bytes(17)
+
+  b1.size == 17 and b1 == b2 and Random.new(457).bytes(17) != b1
+end
+
+assert("Random#floats") do
+  r1 = Random.new(567)
+  f1 = r1.floats(9)
+  r2 = Random.new(567)
+  f2 = r2.floats(9)
+
+  f1.size == 9 and f1 == f2 and f1.all? { |f| f.class == Float and f >= 0 and f < 1 }
+end
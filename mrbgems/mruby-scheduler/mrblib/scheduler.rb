@@ -0,0 +1,15 @@
+class Scheduler
+  # Wrap the block in a fiber and place it on the ready queue.  The
+  # optional +value+ arrives as the block argument on first resume.
+  def spawn(value = nil, &block)
+    raise ArgumentError, "tried to spawn a task without a block" unless block
+    f = Fiber.new(&block)
+    schedule(f, value)
+    f
+  end
+
+  # A channel bound to this scheduler for passing values between tasks.
+  def channel
+    Channel.new(self)
+  end
+end
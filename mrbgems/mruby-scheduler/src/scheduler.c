@@ -0,0 +1,497 @@
+/*
+** scheduler.c - cooperative fiber scheduler
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/variable.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+/* what the task that just yielded asked the run loop to do with it */
+enum sched_op {
+  SCHED_OP_NONE,                /* requeue (plain yield / Scheduler.pass) */
+  SCHED_OP_SLEEP,               /* park on the timer heap until op_sleep_at */
+  SCHED_OP_BLOCK                /* a channel holds the fiber; do nothing */
+};
+
+typedef struct mrb_scheduler {
+  mrb_int rhead;                /* consumed prefix of the @ready array */
+  double *tm_at;                /* timer deadlines, binary min-heap */
+  mrb_int tm_len;
+  mrb_int tm_capa;
+  mrb_int blocked;              /* tasks parked on channels */
+  enum sched_op op;
+  double op_sleep_at;
+} mrb_scheduler;
+
+typedef struct mrb_channel {
+  mrb_int bhead;                /* consumed prefix of @buf */
+  mrb_int whead;                /* consumed prefix of @waiting */
+} mrb_channel;
+
+/* compact a shifted array once the dead prefix dominates it */
+#define SCHED_COMPACT_MIN 64
+
+static void
+sched_free(mrb_state *mrb, void *p)
+{
+  mrb_scheduler *s = (mrb_scheduler*)p;
+
+  if (s) {
+    mrb_free(mrb, s->tm_at);
+    mrb_free(mrb, s);
+  }
+}
+
+static void
+channel_free(mrb_state *mrb, void *p)
+{
+  mrb_free(mrb, p);
+}
+
+static const struct mrb_data_type mrb_scheduler_type = { "Scheduler", sched_free };
+static const struct mrb_data_type mrb_channel_type = { "Scheduler::Channel", channel_free };
+
+static double
+sched_now(void)
+{
+#ifdef _WIN32
+  return (double)GetTickCount64() / 1000.0;
+#else
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (double)tv.tv_sec + (double)tv.tv_usec * 1e-6;
+#endif
+}
+
+static void
+sched_pause(double sec)
+{
+#ifdef _WIN32
+  Sleep((DWORD)(sec * 1000.0));
+#else
+  usleep((useconds_t)(sec * 1e6));
+#endif
+}
+
+static mrb_scheduler*
+sched_get(mrb_state *mrb, mrb_value self)
+{
+  mrb_scheduler *s = (mrb_scheduler*)mrb_data_get_ptr(mrb, self, &mrb_scheduler_type);
+
+  if (!s) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized scheduler");
+  }
+  return s;
+}
+
+static mrb_bool
+fiber_terminated_p(mrb_value fib)
+{
+  return ((struct RFiber*)mrb_ptr(fib))->cxt->status == MRB_FIBER_TERMINATED;
+}
+
+/* pop `n` consecutive values off the front of the array in `iv`,
+   tracking the consumed prefix in *head instead of memmoving on every
+   shift; the prefix is dropped in one go when it outgrows the live
+   part.  Returns FALSE when fewer than `n` values remain. */
+static mrb_bool
+sched_shift(mrb_state *mrb, mrb_value self, mrb_sym iv, mrb_int *head, mrb_int n, mrb_value *out)
+{
+  mrb_value ary = mrb_iv_get(mrb, self, iv);
+  mrb_int len = RARRAY_LEN(ary);
+  mrb_int i;
+
+  if (*head + n > len) return FALSE;
+  if (*head >= SCHED_COMPACT_MIN && *head * 2 >= len) {
+    ary = mrb_ary_new_from_values(mrb, len - *head, RARRAY_PTR(ary) + *head);
+    mrb_iv_set(mrb, self, iv, ary);
+    *head = 0;
+  }
+  for (i = 0; i < n; i++) {
+    out[i] = mrb_ary_ref(mrb, ary, *head + i);
+  }
+  *head += n;
+  return TRUE;
+}
+
+static void
+sched_enqueue(mrb_state *mrb, mrb_value self, mrb_value fib, mrb_value val)
+{
+  mrb_value ready = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@ready"));
+
+  mrb_ary_push(mrb, ready, fib);
+  mrb_ary_push(mrb, ready, val);
+}
+
+/* timer heap; deadlines live in the C heap for cheap comparisons, the
+   fiber at tm_at[i] sits at index i of @timers so the GC can see it */
+
+static void
+timer_swap(mrb_state *mrb, mrb_value timers, mrb_scheduler *s, mrb_int i, mrb_int j)
+{
+  double t = s->tm_at[i];
+  mrb_value a = mrb_ary_ref(mrb, timers, i);
+
+  s->tm_at[i] = s->tm_at[j];
+  s->tm_at[j] = t;
+  mrb_ary_set(mrb, timers, i, mrb_ary_ref(mrb, timers, j));
+  mrb_ary_set(mrb, timers, j, a);
+}
+
+static void
+timer_push(mrb_state *mrb, mrb_value self, mrb_scheduler *s, mrb_value fib, double at)
+{
+  mrb_value timers = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@timers"));
+  mrb_int i = s->tm_len;
+
+  if (i >= s->tm_capa) {
+    s->tm_capa = s->tm_capa ? s->tm_capa * 2 : 8;
+    s->tm_at = (double*)mrb_realloc(mrb, s->tm_at, sizeof(double) * s->tm_capa);
+  }
+  s->tm_at[i] = at;
+  mrb_ary_set(mrb, timers, i, fib);
+  s->tm_len++;
+  while (i > 0) {
+    mrb_int parent = (i - 1) / 2;
+
+    if (s->tm_at[parent] <= s->tm_at[i]) break;
+    timer_swap(mrb, timers, s, i, parent);
+    i = parent;
+  }
+}
+
+static mrb_value
+timer_pop(mrb_state *mrb, mrb_value self, mrb_scheduler *s)
+{
+  mrb_value timers = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@timers"));
+  mrb_value fib = mrb_ary_ref(mrb, timers, 0);
+  mrb_int i = 0, last = s->tm_len - 1;
+
+  s->tm_at[0] = s->tm_at[last];
+  mrb_ary_set(mrb, timers, 0, mrb_ary_ref(mrb, timers, last));
+  mrb_ary_pop(mrb, timers);
+  s->tm_len = last;
+  for (;;) {
+    mrb_int child = i * 2 + 1;
+
+    if (child >= last) break;
+    if (child + 1 < last && s->tm_at[child + 1] < s->tm_at[child]) child++;
+    if (s->tm_at[i] <= s->tm_at[child]) break;
+    timer_swap(mrb, timers, s, i, child);
+    i = child;
+  }
+  return fib;
+}
+
+/* the scheduler whose run loop is currently active, kept on the class
+   so Scheduler.sleep and channels can find it from inside a task */
+static mrb_value
+sched_current(mrb_state *mrb)
+{
+  struct RClass *c = mrb_class_get(mrb, "Scheduler");
+
+  return mrb_obj_iv_get(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__current__"));
+}
+
+static void
+sched_set_current(mrb_state *mrb, mrb_value sched)
+{
+  struct RClass *c = mrb_class_get(mrb, "Scheduler");
+
+  mrb_obj_iv_set(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__current__"), sched);
+}
+
+static mrb_value
+sched_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_scheduler *s;
+
+  s = (mrb_scheduler*)mrb_calloc(mrb, 1, sizeof(mrb_scheduler));
+  DATA_PTR(self) = s;
+  DATA_TYPE(self) = &mrb_scheduler_type;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@ready"), mrb_ary_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@timers"), mrb_ary_new(mrb));
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     scheduler.schedule(fiber, value = nil) -> scheduler
+ *
+ *  Places a fiber on the ready queue.  +value+ becomes the result of
+ *  the <code>Fiber.yield</code> the fiber is suspended in (or its block
+ *  argument when it has not started yet).
+ */
+static mrb_value
+sched_schedule(mrb_state *mrb, mrb_value self)
+{
+  mrb_value fib, val = mrb_nil_value();
+
+  mrb_get_args(mrb, "o|o", &fib, &val);
+  if (mrb_type(fib) != MRB_TT_FIBER) {
+    mrb_raise(mrb, E_TYPE_ERROR, "can only schedule a Fiber");
+  }
+  sched_get(mrb, self);         /* initialized check */
+  sched_enqueue(mrb, self, fib, val);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     scheduler.run -> scheduler
+ *
+ *  Resumes ready tasks round-robin until the ready queue and the timer
+ *  heap are both empty.  A task that finishes or parks itself (see
+ *  Scheduler.sleep and Channel#receive) leaves the queue; any other
+ *  yield requeues it.  Raises RuntimeError when every remaining task is
+ *  blocked on a channel that nothing can fill.
+ */
+static mrb_value
+sched_run(mrb_state *mrb, mrb_value self)
+{
+  mrb_scheduler *s = sched_get(mrb, self);
+  mrb_sym ready_iv = mrb_intern_lit(mrb, "@ready");
+  mrb_value prev = sched_current(mrb);
+  int ai = mrb_gc_arena_save(mrb);
+
+  sched_set_current(mrb, self);
+  for (;;) {
+    mrb_value slot[2];
+
+    mrb_gc_arena_restore(mrb, ai);
+    if (!sched_shift(mrb, self, ready_iv, &s->rhead, 2, slot)) {
+      if (s->tm_len == 0) {
+        if (s->blocked > 0) {
+          sched_set_current(mrb, prev);
+          mrb_raisef(mrb, E_RUNTIME_ERROR, "deadlock: %S task(s) blocked on a channel",
+                     mrb_fixnum_value(s->blocked));
+        }
+        break;
+      }
+      /* nothing runnable; wait for the earliest timer */
+      if (s->tm_at[0] > sched_now()) {
+        sched_pause(s->tm_at[0] - sched_now());
+      }
+      while (s->tm_len > 0 && s->tm_at[0] <= sched_now()) {
+        mrb_value fib = timer_pop(mrb, self, s);
+
+        sched_enqueue(mrb, self, fib, mrb_nil_value());
+      }
+      continue;
+    }
+    if (fiber_terminated_p(slot[0])) continue;
+    s->op = SCHED_OP_NONE;
+    {
+      /* a task yielding back marks this C frame CI_ACC_RESUMED so the
+         fiber's VM loop returns to us; undo that once we are back, or
+         the VM we were called from would treat our own return as a
+         context switch */
+      mrb_callinfo *ci = mrb->c->ci;
+      int acc = ci->acc;
+      struct RClass *tc = ci->target_class;
+
+      mrb_fiber_resume(mrb, slot[0], 1, &slot[1]);
+      ci->acc = acc;
+      ci->target_class = tc;
+    }
+    switch (s->op) {
+    case SCHED_OP_SLEEP:
+      timer_push(mrb, self, s, slot[0], s->op_sleep_at);
+      break;
+    case SCHED_OP_BLOCK:
+      break;
+    default:
+      if (!fiber_terminated_p(slot[0])) {
+        sched_enqueue(mrb, self, slot[0], mrb_nil_value());
+      }
+      break;
+    }
+  }
+  sched_set_current(mrb, prev);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.sleep(seconds) -> nil
+ *
+ *  Parks the calling task on the running scheduler's timer heap and
+ *  yields; the scheduler resumes it once the deadline has passed and
+ *  every earlier-ready task has had its turn.
+ */
+static mrb_value
+sched_s_sleep(mrb_state *mrb, mrb_value self)
+{
+  mrb_value cur = sched_current(mrb);
+  mrb_scheduler *s;
+  mrb_float sec;
+
+  mrb_get_args(mrb, "f", &sec);
+  if (mrb_nil_p(cur) || !mrb->c->fib) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "Scheduler.sleep outside of a running task");
+  }
+  s = sched_get(mrb, cur);
+  if (sec < 0) sec = 0;
+  s->op = SCHED_OP_SLEEP;
+  s->op_sleep_at = sched_now() + (double)sec;
+  return mrb_fiber_yield(mrb, 0, NULL);
+}
+
+/*
+ *  call-seq:
+ *     Scheduler.pass -> nil
+ *
+ *  Yields the calling task back to the scheduler, which requeues it
+ *  behind the other ready tasks.
+ */
+static mrb_value
+sched_s_pass(mrb_state *mrb, mrb_value self)
+{
+  if (mrb_nil_p(sched_current(mrb)) || !mrb->c->fib) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "Scheduler.pass outside of a running task");
+  }
+  return mrb_fiber_yield(mrb, 0, NULL);
+}
+
+static mrb_channel*
+channel_get(mrb_state *mrb, mrb_value self)
+{
+  mrb_channel *ch = (mrb_channel*)mrb_data_get_ptr(mrb, self, &mrb_channel_type);
+
+  if (!ch) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized channel");
+  }
+  return ch;
+}
+
+static mrb_value
+channel_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_value sched;
+  mrb_channel *ch;
+
+  mrb_get_args(mrb, "o", &sched);
+  sched_get(mrb, sched);        /* type check */
+  ch = (mrb_channel*)mrb_calloc(mrb, 1, sizeof(mrb_channel));
+  DATA_PTR(self) = ch;
+  DATA_TYPE(self) = &mrb_channel_type;
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@scheduler"), sched);
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@buf"), mrb_ary_new(mrb));
+  mrb_iv_set(mrb, self, mrb_intern_lit(mrb, "@waiting"), mrb_ary_new(mrb));
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     channel.send(value) -> channel
+ *
+ *  Delivers a value.  When a task is parked in Channel#receive the
+ *  value goes straight to it as its resume argument and the task is
+ *  requeued; otherwise the value is buffered.  May be called from
+ *  outside the scheduler, e.g. to seed work before Scheduler#run.
+ */
+static mrb_value
+channel_send(mrb_state *mrb, mrb_value self)
+{
+  mrb_channel *ch = channel_get(mrb, self);
+  mrb_value sched = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@scheduler"));
+  mrb_value val, waiter;
+
+  mrb_get_args(mrb, "o", &val);
+  if (sched_shift(mrb, self, mrb_intern_lit(mrb, "@waiting"), &ch->whead, 1, &waiter)) {
+    sched_get(mrb, sched)->blocked--;
+    sched_enqueue(mrb, sched, waiter, val);
+  }
+  else {
+    mrb_ary_push(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@buf")), val);
+  }
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     channel.receive -> obj
+ *
+ *  Takes the oldest buffered value, or parks the calling task until a
+ *  sender hands one over.
+ */
+static mrb_value
+channel_receive(mrb_state *mrb, mrb_value self)
+{
+  mrb_channel *ch = channel_get(mrb, self);
+  mrb_value sched = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@scheduler"));
+  mrb_scheduler *s;
+  mrb_value val;
+
+  if (sched_shift(mrb, self, mrb_intern_lit(mrb, "@buf"), &ch->bhead, 1, &val)) {
+    return val;
+  }
+  if (mrb_nil_p(sched_current(mrb)) || !mrb->c->fib) {
+    mrb_raise(mrb, E_RUNTIME_ERROR, "Channel#receive would block outside of a running task");
+  }
+  s = sched_get(mrb, sched);
+  mrb_ary_push(mrb, mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@waiting")),
+               mrb_obj_value(mrb->c->fib));
+  s->blocked++;
+  s->op = SCHED_OP_BLOCK;
+  return mrb_fiber_yield(mrb, 0, NULL);
+}
+
+static mrb_value
+channel_size(mrb_state *mrb, mrb_value self)
+{
+  mrb_channel *ch = channel_get(mrb, self);
+  mrb_value buf = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@buf"));
+
+  return mrb_fixnum_value(RARRAY_LEN(buf) - ch->bhead);
+}
+
+static mrb_value
+channel_empty_p(mrb_state *mrb, mrb_value self)
+{
+  mrb_channel *ch = channel_get(mrb, self);
+  mrb_value buf = mrb_iv_get(mrb, self, mrb_intern_lit(mrb, "@buf"));
+
+  return mrb_bool_value(RARRAY_LEN(buf) - ch->bhead == 0);
+}
+
+void
+mrb_mruby_scheduler_gem_init(mrb_state *mrb)
+{
+  struct RClass *sched, *chan;
+
+  sched = mrb_define_class(mrb, "Scheduler", mrb->object_class);
+  MRB_SET_INSTANCE_TT(sched, MRB_TT_DATA);
+  mrb_define_method(mrb, sched, "initialize", sched_init,     MRB_ARGS_NONE());
+  mrb_define_method(mrb, sched, "schedule",   sched_schedule, MRB_ARGS_ARG(1, 1));
+  mrb_define_method(mrb, sched, "run",        sched_run,      MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, sched, "sleep", sched_s_sleep, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, sched, "pass",  sched_s_pass,  MRB_ARGS_NONE());
+
+  chan = mrb_define_class_under(mrb, sched, "Channel", mrb->object_class);
+  MRB_SET_INSTANCE_TT(chan, MRB_TT_DATA);
+  mrb_define_method(mrb, chan, "initialize", channel_init,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, chan, "send",       channel_send,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, chan, "<<",         channel_send,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, chan, "receive",    channel_receive, MRB_ARGS_NONE());
+  mrb_define_method(mrb, chan, "size",       channel_size,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, chan, "empty?",     channel_empty_p, MRB_ARGS_NONE());
+}
+
+void
+mrb_mruby_scheduler_gem_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,74 @@
+##
+# Scheduler test
+
+assert('Scheduler#run drains spawned tasks in order') do
+  s = Scheduler.new
+  order = []
+  s.spawn { order << :a }
+  s.spawn { order << :b }
+  s.run
+  assert_equal [:a, :b], order
+end
+
+assert('Scheduler#spawn passes the seed value to the block') do
+  s = Scheduler.new
+  got = nil
+  s.spawn(42) { |v| got = v }
+  s.run
+  assert_equal 42, got
+end
+
+assert('Scheduler.pass round-robins between tasks') do
+  s = Scheduler.new
+  order = []
+  s.spawn { order << 1; Scheduler.pass; order << 3 }
+  s.spawn { order << 2; Scheduler.pass; order << 4 }
+  s.run
+  assert_equal [1, 2, 3, 4], order
+end
+
+assert('Scheduler.sleep wakes tasks by deadline') do
+  s = Scheduler.new
+  order = []
+  s.spawn { Scheduler.sleep(0.003); order << :slow }
+  s.spawn { Scheduler.sleep(0.001); order << :fast }
+  s.run
+  assert_equal [:fast, :slow], order
+end
+
+assert('Scheduler.sleep outside a task raises') do
+  assert_raise(RuntimeError) { Scheduler.sleep(0) }
+end
+
+assert('Channel passes buffered values in order') do
+  s = Scheduler.new
+  ch = s.channel
+  got = []
+  ch.send(1)
+  ch << 2
+  s.spawn { 2.times { got << ch.receive } }
+  s.run
+  assert_equal [1, 2], got
+  assert_true ch.empty?
+end
+
+assert('Channel#receive parks the task until a send') do
+  s = Scheduler.new
+  ch = s.channel
+  order = []
+  s.spawn { order << [:got, ch.receive] }
+  s.spawn { order << :send; ch.send(:msg) }
+  s.run
+  assert_equal [:send, [:got, :msg]], order
+end
+
+assert('Scheduler#run raises on channel deadlock') do
+  s = Scheduler.new
+  ch = s.channel
+  s.spawn { ch.receive }
+  assert_raise(RuntimeError) { s.run }
+end
+
+assert('Scheduler#schedule rejects non-fibers') do
+  assert_raise(TypeError) { Scheduler.new.schedule(1) }
+end
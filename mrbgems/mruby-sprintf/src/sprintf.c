@@ -12,6 +12,8 @@
 #include <mruby/string.h>
 #include <mruby/hash.h>
 #include <mruby/numeric.h>
+#include <mruby/data.h>
+#include <mruby/variable.h>
 #include <math.h>
 #include <ctype.h>
 
@@ -188,6 +190,285 @@ mrb_fix2binstr(mrb_state *mrb, mrb_value x, int base)
   num = mrb_fixnum(tmp_v); \
 } while (0)
 
+/* ---- compiled format cache ----
+ *
+ * A format string made of literal text and bare conversions (no flags,
+ * width, precision, or positional/named references) is compiled once
+ * into a small op list and replayed on later calls with the same
+ * format, skipping the character-by-character scanner below. Anything
+ * fancier is remembered as uncompilable so it only pays the failed
+ * compile once. The executor validates every argument before emitting
+ * anything and falls back to the scanner on any surprise (wrong type,
+ * negative value for an unsigned base, non-finite float), so output,
+ * errors, and side-effect order are identical either way. */
+
+enum fmt_op_type {
+  FMT_OP_LIT,      /* bytes [off, off+len) of the format string */
+  FMT_OP_NUM,      /* %d %i %o %x %X %b %B %u of a Fixnum */
+  FMT_OP_FLT,      /* %e %E %f %g %G of a finite Float (or Fixnum) */
+  FMT_OP_STR,      /* %s */
+  FMT_OP_INSPECT   /* %p */
+};
+
+struct fmt_op {
+  uint8_t type;
+  char conv;
+  int32_t off;
+  int32_t len;
+};
+
+struct fmt_entry {
+  char *fmt;            /* private copy of the format bytes */
+  mrb_int len;
+  struct fmt_op *ops;   /* NULL: format is uncompilable */
+  int nops;
+};
+
+#define FMT_CACHE_SIZE 8
+#define FMT_CACHE_MAX_LEN 256
+
+struct fmt_cache {
+  struct fmt_entry ent[FMT_CACHE_SIZE];
+  int next;             /* round-robin eviction cursor */
+};
+
+static void
+fmt_cache_free(mrb_state *mrb, void *p)
+{
+  struct fmt_cache *c = (struct fmt_cache*)p;
+  int i;
+
+  if (!c) return;
+  for (i = 0; i < FMT_CACHE_SIZE; i++) {
+    mrb_free(mrb, c->ent[i].fmt);
+    mrb_free(mrb, c->ent[i].ops);
+  }
+  mrb_free(mrb, c);
+}
+
+static const struct mrb_data_type fmt_cache_type = {
+  "sprintf_format_cache", fmt_cache_free,
+};
+
+static struct fmt_cache*
+fmt_cache_get(mrb_state *mrb)
+{
+  mrb_sym sym = mrb_intern_lit(mrb, "_sprintf_cache_");
+  mrb_value v = mrb_gv_get(mrb, sym);
+
+  if (mrb_nil_p(v)) {
+    struct fmt_cache *c = (struct fmt_cache*)mrb_calloc(mrb, 1, sizeof(struct fmt_cache));
+    struct RData *d = mrb_data_object_alloc(mrb, mrb->object_class, c, &fmt_cache_type);
+
+    v = mrb_obj_value(d);
+    mrb_gv_set(mrb, sym, v);
+  }
+  return (struct fmt_cache*)DATA_PTR(v);
+}
+
+static void
+fmt_compile(mrb_state *mrb, struct fmt_entry *e)
+{
+  const char *p = e->fmt, *end = e->fmt + e->len;
+  struct fmt_op *ops = NULL;
+  int nops = 0, capa = 0;
+
+  while (p < end) {
+    const char *t = p;
+    struct fmt_op op;
+
+    while (t < end && *t != '%') t++;
+    if (nops == capa) {
+      capa = capa ? capa * 2 : 8;
+      ops = (struct fmt_op*)mrb_realloc(mrb, ops, capa * sizeof(struct fmt_op));
+    }
+    if (t > p) {
+      op.type = FMT_OP_LIT;
+      op.conv = 0;
+      op.off = (int32_t)(p - e->fmt);
+      op.len = (int32_t)(t - p);
+      ops[nops++] = op;
+      if (nops == capa) {
+        capa *= 2;
+        ops = (struct fmt_op*)mrb_realloc(mrb, ops, capa * sizeof(struct fmt_op));
+      }
+    }
+    if (t >= end) break;
+    p = t + 1;                  /* skip '%' */
+    if (p >= end) goto reject;  /* trailing '%': scanner quirk territory */
+    op.conv = *p;
+    op.off = 0;
+    op.len = 0;
+    switch (*p) {
+    case '%':
+      op.type = FMT_OP_LIT;
+      op.off = (int32_t)(p - e->fmt);
+      op.len = 1;
+      break;
+    case 'd': case 'i': case 'o': case 'x': case 'X':
+    case 'b': case 'B': case 'u':
+      op.type = FMT_OP_NUM;
+      break;
+    case 'e': case 'E': case 'f': case 'g': case 'G':
+      op.type = FMT_OP_FLT;
+      break;
+    case 's':
+      op.type = FMT_OP_STR;
+      break;
+    case 'p':
+      op.type = FMT_OP_INSPECT;
+      break;
+    default:                    /* flags, width, %<>, %{}, errors, ... */
+      goto reject;
+    }
+    ops[nops++] = op;
+    p++;
+  }
+  e->ops = ops;
+  e->nops = nops;
+  return;
+
+ reject:
+  mrb_free(mrb, ops);
+  e->ops = NULL;
+  e->nops = 0;
+}
+
+static struct fmt_entry*
+fmt_cache_lookup(mrb_state *mrb, const char *p, mrb_int len)
+{
+  struct fmt_cache *c;
+  struct fmt_entry *e;
+  int i;
+
+  if (len > FMT_CACHE_MAX_LEN) return NULL;
+  c = fmt_cache_get(mrb);
+  for (i = 0; i < FMT_CACHE_SIZE; i++) {
+    e = &c->ent[i];
+    if (e->fmt && e->len == len && memcmp(e->fmt, p, len) == 0) {
+      return e;
+    }
+  }
+  e = &c->ent[c->next];
+  c->next = (c->next + 1) % FMT_CACHE_SIZE;
+  mrb_free(mrb, e->fmt);
+  mrb_free(mrb, e->ops);
+  e->ops = NULL;
+  e->nops = 0;
+  e->fmt = (char*)mrb_malloc(mrb, len ? (size_t)len : 1);
+  memcpy(e->fmt, p, len);
+  e->len = len;
+  fmt_compile(mrb, e);
+  return e;
+}
+
+/* argc/argv come pre-shifted as in mrb_str_format: values start at
+ * argv[1]. Returns FALSE when the scanner must run instead. */
+static mrb_bool
+fmt_compiled_exec(mrb_state *mrb, struct fmt_entry *e, int argc,
+                  const mrb_value *argv, mrb_value *resp)
+{
+  mrb_value result;
+  int i, nextarg;
+
+  /* validate every argument first so no conversion runs twice */
+  nextarg = 1;
+  for (i = 0; i < e->nops; i++) {
+    const struct fmt_op *op = &e->ops[i];
+    mrb_value val;
+
+    if (op->type == FMT_OP_LIT) continue;
+    if (nextarg >= argc) return FALSE;  /* scanner raises "too few" */
+    val = argv[nextarg++];
+    switch (op->type) {
+    case FMT_OP_NUM:
+      if (!mrb_fixnum_p(val)) return FALSE;
+      if (op->conv == 'd' || op->conv == 'i') {
+        if (mrb_fixnum(val) == MRB_INT_MIN) return FALSE;
+      }
+      else if (mrb_fixnum(val) < 0) return FALSE;
+      break;
+    case FMT_OP_FLT:
+      if (mrb_float_p(val)) {
+        if (!isfinite(mrb_float(val))) return FALSE;
+      }
+      else if (!mrb_fixnum_p(val)) return FALSE;
+      break;
+    default:
+      break;
+    }
+  }
+
+  result = mrb_str_buf_new(mrb, 120);
+  nextarg = 1;
+  for (i = 0; i < e->nops; i++) {
+    const struct fmt_op *op = &e->ops[i];
+
+    switch (op->type) {
+    case FMT_OP_LIT:
+      mrb_str_cat(mrb, result, e->fmt + op->off, op->len);
+      break;
+    case FMT_OP_NUM: {
+      mrb_int v = mrb_fixnum(argv[nextarg++]);
+      char nbuf[MRB_INT_BIT + 2], *s = nbuf + sizeof(nbuf);
+      mrb_bool neg = FALSE;
+      int base;
+
+      switch (op->conv) {
+      case 'o': base = 8; break;
+      case 'x': case 'X': base = 16; break;
+      case 'b': case 'B': base = 2; break;
+      default: base = 10; break;
+      }
+      if (v < 0) {
+        neg = TRUE;
+        v = -v;
+      }
+      do {
+        char d = mrb_digitmap[v % base];
+        if (op->conv == 'X') d = toupper((unsigned char)d);
+        *--s = d;
+        v /= base;
+      } while (v > 0);
+      if (neg) *--s = '-';
+      mrb_str_cat(mrb, result, s, nbuf + sizeof(nbuf) - s);
+      break;
+    }
+    case FMT_OP_FLT: {
+      double fval = mrb_float(mrb_Float(mrb, argv[nextarg++]));
+      char fb[4] = {'%', 0, 0, 0};
+      char cbuf[384];
+      int need = 0, n, ex = INT_MIN;
+
+      fb[1] = op->conv;
+      if (op->conv != 'e' && op->conv != 'E') {
+        frexp(fval, &ex);
+        if (ex > 0) need = BIT_DIGITS(ex);
+      }
+      need += 26;               /* default precision, sign, dot, exp */
+      if (need > (int)sizeof(cbuf)) break;  /* cannot happen for doubles */
+      n = snprintf(cbuf, sizeof(cbuf), fb, fval);
+      mrb_str_cat(mrb, result, cbuf, n);
+      break;
+    }
+    case FMT_OP_STR: {
+      mrb_value str = mrb_obj_as_string(mrb, argv[nextarg++]);
+
+      mrb_str_cat(mrb, result, RSTRING_PTR(str), RSTRING_LEN(str));
+      break;
+    }
+    case FMT_OP_INSPECT: {
+      mrb_value str = mrb_inspect(mrb, argv[nextarg++]);
+
+      mrb_str_cat(mrb, result, RSTRING_PTR(str), RSTRING_LEN(str));
+      break;
+    }
+    }
+  }
+  *resp = result;
+  return TRUE;
+}
+
 static mrb_value
 get_hash(mrb_state *mrb, mrb_value *hash, int argc, const mrb_value *argv)
 {
@@ -518,6 +799,17 @@ mrb_str_format(mrb_state *mrb, int argc, const mrb_value *argv, mrb_value fmt)
   ++argc;
   --argv;
   fmt = mrb_str_to_str(mrb, fmt);
+  {
+    struct fmt_entry *e = fmt_cache_lookup(mrb, RSTRING_PTR(fmt), RSTRING_LEN(fmt));
+
+    if (e && e->ops) {
+      mrb_value fast;
+
+      if (fmt_compiled_exec(mrb, e, argc, argv, &fast)) {
+        return fast;
+      }
+    }
+  }
   p = RSTRING_PTR(fmt);
   end = p + RSTRING_LEN(fmt);
   blen = 0;
@@ -0,0 +1,59 @@
+/*
+** mruby/statechannel.h - message channels between mrb_states
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_STATECHANNEL_H
+#define MRUBY_STATECHANNEL_H
+
+#include <mruby.h>
+
+MRB_BEGIN_DECL
+
+/*
+ * An mrb_chan is a FIFO of messages that is not tied to any mrb_state:
+ * values are converted into state-independent payloads on send and
+ * materialized in the receiving state.  Producers may push from several
+ * threads at once (the push is a single atomic exchange); messages must
+ * be popped by one consumer at a time.
+ *
+ * Supported payloads are nil, booleans, integers, floats, symbols,
+ * strings, and arrays/hashes built out of those.  A string whose buffer
+ * is exclusively owned by the sender is handed over without copying:
+ * the sender's object is left empty and the receiver adopts the buffer.
+ * Everything else is copied structurally.
+ *
+ * Because buffers allocated by one state are released by another, all
+ * participating states must draw from the same malloc family; states
+ * opened with mrb_open (the default allocator) qualify.
+ */
+typedef struct mrb_chan mrb_chan;
+
+/* create a channel with one reference; free that reference with
+   mrb_chan_release.  Returns NULL when out of memory. */
+mrb_chan *mrb_chan_new(void);
+
+/* take/drop a reference, e.g. when handing the channel to the thread
+   that owns another state.  The queue and any undelivered messages are
+   freed with the last reference. */
+void mrb_chan_retain(mrb_chan *chan);
+void mrb_chan_release(mrb_chan *chan);
+
+/* convert `val` and enqueue it; raises TypeError in `mrb` for payloads
+   that cannot cross states (procs, fibers, arbitrary objects, ...) */
+void mrb_chan_send(mrb_state *mrb, mrb_chan *chan, mrb_value val);
+
+/* pop the oldest message into the receiving state; returns FALSE and
+   leaves *val untouched when the channel is empty */
+mrb_bool mrb_chan_recv(mrb_state *mrb, mrb_chan *chan, mrb_value *val);
+
+mrb_int mrb_chan_size(mrb_chan *chan);
+
+/* wrap an existing channel in a StateChannel object of `mrb`, taking a
+   new reference; this is how an embedder connects two states */
+mrb_value mrb_chan_wrap(mrb_state *mrb, mrb_chan *chan);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_STATECHANNEL_H */
@@ -0,0 +1,485 @@
+/*
+** statechannel.c - message channels between mrb_states
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/hash.h>
+#include <mruby/string.h>
+#include <mruby/statechannel.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* producers race on the queue head; use compiler atomics where we have
+   them and degrade to plain accesses (single-threaded use) elsewhere */
+#ifdef __GNUC__
+#define CHAN_XCHG(p, v)   __atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define CHAN_ADD(p, v)    __atomic_add_fetch((p), (v), __ATOMIC_ACQ_REL)
+#define CHAN_LOAD(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#else
+#define CHAN_XCHG(p, v)   chan_plain_xchg((void**)(p), (v))
+#define CHAN_ADD(p, v)    (*(p) += (v))
+#define CHAN_LOAD(p)      (*(p))
+static void*
+chan_plain_xchg(void **p, void *v)
+{
+  void *old = *p;
+  *p = v;
+  return old;
+}
+#endif
+
+/* nesting allowed before send assumes a cyclic container */
+#define CHAN_MAX_DEPTH 32
+
+enum chan_type {
+  CHAN_NIL,
+  CHAN_FALSE,
+  CHAN_TRUE,
+  CHAN_INT,
+  CHAN_FLOAT,
+  CHAN_SYM,
+  CHAN_STR,
+  CHAN_ARY,
+  CHAN_HASH                     /* seq holds len key/value pairs */
+};
+
+typedef struct chan_value {
+  uint8_t type;
+  union {
+    mrb_int i;
+    double f;
+    struct {
+      char *ptr;                /* malloc-family buffer, owned by the message */
+      mrb_int len;
+    } str;
+    struct {
+      struct chan_value *vals;
+      mrb_int len;              /* elements (CHAN_ARY) or pairs (CHAN_HASH) */
+    } seq;
+  } as;
+} chan_value;
+
+typedef struct chan_msg {
+  struct chan_msg *next;
+  chan_value v;
+} chan_msg;
+
+struct mrb_chan {
+  chan_msg *head;               /* most recent push; producers exchange this */
+  chan_msg *consume;            /* oldest-first run owned by the consumer */
+  mrb_int count;
+  int refs;
+};
+
+static void
+chan_value_clear(chan_value *v)
+{
+  mrb_int i;
+
+  switch (v->type) {
+  case CHAN_SYM:
+  case CHAN_STR:
+    free(v->as.str.ptr);
+    break;
+  case CHAN_ARY:
+  case CHAN_HASH:
+    {
+      mrb_int n = (v->type == CHAN_HASH) ? v->as.seq.len * 2 : v->as.seq.len;
+
+      for (i = 0; i < n; i++) {
+        chan_value_clear(&v->as.seq.vals[i]);
+      }
+      free(v->as.seq.vals);
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+mrb_chan*
+mrb_chan_new(void)
+{
+  mrb_chan *chan = (mrb_chan*)calloc(1, sizeof(mrb_chan));
+
+  if (chan) chan->refs = 1;
+  return chan;
+}
+
+void
+mrb_chan_retain(mrb_chan *chan)
+{
+  CHAN_ADD(&chan->refs, 1);
+}
+
+void
+mrb_chan_release(mrb_chan *chan)
+{
+  chan_msg *m, *next;
+
+  if (CHAN_ADD(&chan->refs, -1) > 0) return;
+  for (m = chan->consume; m; m = next) {
+    next = m->next;
+    chan_value_clear(&m->v);
+    free(m);
+  }
+  /* pushed-but-unconsumed messages are newest-first */
+  for (m = chan->head; m; m = next) {
+    next = m->next;
+    chan_value_clear(&m->v);
+    free(m);
+  }
+  free(chan);
+}
+
+mrb_int
+mrb_chan_size(mrb_chan *chan)
+{
+  return CHAN_LOAD(&chan->count);
+}
+
+/* out-of-memory while converting in the sender; unwind what was built */
+static void
+chan_send_nomem(mrb_state *mrb, chan_value *root)
+{
+  chan_value_clear(root);
+  mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+}
+
+static void
+chan_convert(mrb_state *mrb, mrb_value val, chan_value *out, chan_value *root, int depth)
+{
+  if (depth > CHAN_MAX_DEPTH) {
+    chan_value_clear(root);
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "channel payload nested too deeply (cyclic?)");
+  }
+  switch (mrb_type(val)) {
+  case MRB_TT_FALSE:
+    out->type = mrb_nil_p(val) ? CHAN_NIL : CHAN_FALSE;
+    break;
+  case MRB_TT_TRUE:
+    out->type = CHAN_TRUE;
+    break;
+  case MRB_TT_FIXNUM:
+    out->type = CHAN_INT;
+    out->as.i = mrb_fixnum(val);
+    break;
+  case MRB_TT_FLOAT:
+    out->type = CHAN_FLOAT;
+    out->as.f = (double)mrb_float(val);
+    break;
+  case MRB_TT_SYMBOL:
+    {
+      mrb_int len;
+      const char *name = mrb_sym2name_len(mrb, mrb_symbol(val), &len);
+      char *buf = (char*)malloc(len + 1);
+
+      if (!buf) chan_send_nomem(mrb, root);
+      memcpy(buf, name, len);
+      buf[len] = '\0';
+      out->type = CHAN_SYM;
+      out->as.str.ptr = buf;
+      out->as.str.len = len;
+    }
+    break;
+  case MRB_TT_STRING:
+    {
+      struct RString *s = mrb_str_ptr(val);
+
+      out->type = CHAN_STR;
+      if (!RSTR_EMBED_P(s) && !(s->flags & (MRB_STR_SHARED|MRB_STR_NOFREE|MRB_STR_FROZEN))) {
+        /* sole owner of the buffer: hand it over and leave the sender's
+           string empty instead of copying */
+        out->as.str.ptr = s->as.heap.ptr;
+        out->as.str.len = s->as.heap.len;
+        RSTR_SET_EMBED_FLAG(s);
+        RSTR_SET_EMBED_LEN(s, 0);
+      }
+      else {
+        mrb_int len = RSTR_LEN(s);
+        char *buf = (char*)malloc(len ? len : 1);
+
+        if (!buf) chan_send_nomem(mrb, root);
+        memcpy(buf, RSTR_PTR(s), len);
+        out->as.str.ptr = buf;
+        out->as.str.len = len;
+      }
+    }
+    break;
+  case MRB_TT_ARRAY:
+    {
+      mrb_int len = RARRAY_LEN(val);
+      mrb_int i;
+      chan_value *vals = (chan_value*)calloc(len ? len : 1, sizeof(chan_value));
+
+      if (!vals) chan_send_nomem(mrb, root);
+      out->type = CHAN_ARY;
+      out->as.seq.vals = vals;
+      out->as.seq.len = len;
+      for (i = 0; i < len; i++) {
+        chan_convert(mrb, mrb_ary_ref(mrb, val, i), &vals[i], root, depth + 1);
+      }
+    }
+    break;
+  case MRB_TT_HASH:
+    {
+      mrb_value keys = mrb_hash_keys(mrb, val);
+      mrb_int len = RARRAY_LEN(keys);
+      mrb_int i;
+      chan_value *vals = (chan_value*)calloc(len ? len * 2 : 1, sizeof(chan_value));
+
+      if (!vals) chan_send_nomem(mrb, root);
+      out->type = CHAN_HASH;
+      out->as.seq.vals = vals;
+      out->as.seq.len = len;
+      for (i = 0; i < len; i++) {
+        mrb_value k = mrb_ary_ref(mrb, keys, i);
+
+        chan_convert(mrb, k, &vals[i*2], root, depth + 1);
+        chan_convert(mrb, mrb_hash_get(mrb, val, k), &vals[i*2+1], root, depth + 1);
+      }
+    }
+    break;
+  default:
+    chan_value_clear(root);
+    mrb_raisef(mrb, E_TYPE_ERROR, "can't send %S across states",
+               mrb_str_new_cstr(mrb, mrb_obj_classname(mrb, val)));
+  }
+}
+
+void
+mrb_chan_send(mrb_state *mrb, mrb_chan *chan, mrb_value val)
+{
+  chan_value v;
+  chan_msg *m;
+
+  memset(&v, 0, sizeof(v));
+  chan_convert(mrb, val, &v, &v, 0);   /* frees what it built on raise */
+  m = (chan_msg*)malloc(sizeof(chan_msg));
+  if (!m) {
+    chan_value_clear(&v);
+    mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+  }
+  m->v = v;
+  m->next = CHAN_XCHG(&chan->head, m);
+  CHAN_ADD(&chan->count, 1);
+}
+
+/* adopt a malloc-family buffer as a string without copying */
+static mrb_value
+chan_adopt_str(mrb_state *mrb, char *buf, mrb_int len)
+{
+  mrb_value str = mrb_str_new(mrb, NULL, 0);
+  struct RString *s = mrb_str_ptr(str);
+
+  RSTR_UNSET_EMBED_FLAG(s);
+  s->as.heap.ptr = buf;
+  s->as.heap.len = len;
+  s->as.heap.aux.capa = len;
+  return str;
+}
+
+static mrb_value
+chan_materialize(mrb_state *mrb, chan_value *v)
+{
+  switch (v->type) {
+  case CHAN_FALSE:
+    return mrb_false_value();
+  case CHAN_TRUE:
+    return mrb_true_value();
+  case CHAN_INT:
+    return mrb_fixnum_value(v->as.i);
+  case CHAN_FLOAT:
+    return mrb_float_value(mrb, (mrb_float)v->as.f);
+  case CHAN_SYM:
+    {
+      mrb_value sym = mrb_symbol_value(mrb_intern(mrb, v->as.str.ptr, v->as.str.len));
+
+      free(v->as.str.ptr);
+      v->as.str.ptr = NULL;
+      return sym;
+    }
+  case CHAN_STR:
+    {
+      mrb_value str = chan_adopt_str(mrb, v->as.str.ptr, v->as.str.len);
+
+      v->as.str.ptr = NULL;     /* buffer now belongs to the receiver's GC */
+      return str;
+    }
+  case CHAN_ARY:
+    {
+      mrb_value ary = mrb_ary_new_capa(mrb, v->as.seq.len);
+      mrb_int i;
+
+      for (i = 0; i < v->as.seq.len; i++) {
+        mrb_ary_push(mrb, ary, chan_materialize(mrb, &v->as.seq.vals[i]));
+      }
+      return ary;
+    }
+  case CHAN_HASH:
+    {
+      mrb_value hash = mrb_hash_new(mrb);
+      mrb_int i;
+
+      for (i = 0; i < v->as.seq.len; i++) {
+        mrb_value k = chan_materialize(mrb, &v->as.seq.vals[i*2]);
+
+        mrb_hash_set(mrb, hash, k, chan_materialize(mrb, &v->as.seq.vals[i*2+1]));
+      }
+      return hash;
+    }
+  default:
+    return mrb_nil_value();
+  }
+}
+
+mrb_bool
+mrb_chan_recv(mrb_state *mrb, mrb_chan *chan, mrb_value *val)
+{
+  chan_msg *m;
+
+  if (!chan->consume) {
+    /* take everything pushed so far in one exchange and restore FIFO
+       order; pushes that race with this see an empty head and simply
+       start the next batch */
+    chan_msg *grabbed = CHAN_XCHG(&chan->head, NULL);
+    chan_msg *rev = NULL;
+
+    while (grabbed) {
+      chan_msg *next = grabbed->next;
+
+      grabbed->next = rev;
+      rev = grabbed;
+      grabbed = next;
+    }
+    chan->consume = rev;
+  }
+  m = chan->consume;
+  if (!m) return FALSE;
+  chan->consume = m->next;
+  CHAN_ADD(&chan->count, -1);
+  *val = chan_materialize(mrb, &m->v);
+  chan_value_clear(&m->v);
+  free(m);
+  return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Ruby binding                                                       */
+
+static void
+chan_data_free(mrb_state *mrb, void *p)
+{
+  if (p) mrb_chan_release((mrb_chan*)p);
+}
+
+static const struct mrb_data_type mrb_chan_data_type = { "StateChannel", chan_data_free };
+
+static mrb_chan*
+chan_data_get(mrb_state *mrb, mrb_value self)
+{
+  mrb_chan *chan = (mrb_chan*)mrb_data_get_ptr(mrb, self, &mrb_chan_data_type);
+
+  if (!chan) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized channel");
+  }
+  return chan;
+}
+
+static mrb_value
+chan_init_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_chan *chan = mrb_chan_new();
+
+  if (!chan) {
+    mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+  }
+  DATA_PTR(self) = chan;
+  DATA_TYPE(self) = &mrb_chan_data_type;
+  return self;
+}
+
+mrb_value
+mrb_chan_wrap(mrb_state *mrb, mrb_chan *chan)
+{
+  struct RClass *c = mrb_class_get(mrb, "StateChannel");
+  struct RData *d = mrb_data_object_alloc(mrb, c, chan, &mrb_chan_data_type);
+
+  mrb_chan_retain(chan);
+  return mrb_obj_value(d);
+}
+
+/*
+ *  call-seq:
+ *     channel.send(value) -> channel
+ *
+ *  Converts the value into a state-independent message and enqueues it.
+ *  Strings whose buffer the sender owns outright are handed over
+ *  without copying and left empty; everything else is copied.  Raises
+ *  TypeError for values that cannot cross states.
+ */
+static mrb_value
+chan_send_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_value val;
+
+  mrb_get_args(mrb, "o", &val);
+  mrb_chan_send(mrb, chan_data_get(mrb, self), val);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     channel.receive -> obj or nil
+ *
+ *  Pops the oldest message and materializes it in this state, or
+ *  returns nil when the channel is empty (see #empty? to tell an empty
+ *  channel from a nil message).
+ */
+static mrb_value
+chan_receive_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_value val;
+
+  if (!mrb_chan_recv(mrb, chan_data_get(mrb, self), &val)) {
+    return mrb_nil_value();
+  }
+  return val;
+}
+
+static mrb_value
+chan_size_m(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(mrb_chan_size(chan_data_get(mrb, self)));
+}
+
+static mrb_value
+chan_empty_m(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(mrb_chan_size(chan_data_get(mrb, self)) == 0);
+}
+
+void
+mrb_mruby_statechannel_gem_init(mrb_state *mrb)
+{
+  struct RClass *c;
+
+  c = mrb_define_class(mrb, "StateChannel", mrb->object_class);
+  MRB_SET_INSTANCE_TT(c, MRB_TT_DATA);
+  mrb_define_method(mrb, c, "initialize", chan_init_m,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "send",       chan_send_m,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "<<",         chan_send_m,    MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "receive",    chan_receive_m, MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "size",       chan_size_m,    MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "empty?",     chan_empty_m,   MRB_ARGS_NONE());
+}
+
+void
+mrb_mruby_statechannel_gem_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,66 @@
+##
+# StateChannel test
+
+assert('StateChannel delivers messages in FIFO order') do
+  ch = StateChannel.new
+  ch.send(1)
+  ch << 2
+  ch.send(3)
+  assert_equal 3, ch.size
+  assert_equal [1, 2, 3], [ch.receive, ch.receive, ch.receive]
+  assert_true ch.empty?
+end
+
+assert('StateChannel#receive returns nil when empty') do
+  assert_nil StateChannel.new.receive
+end
+
+assert('StateChannel round-trips primitive types') do
+  ch = StateChannel.new
+  [nil, true, false, 42, 1.5, :sym].each { |v| ch.send(v) }
+  assert_nil ch.receive
+  assert_true ch.receive
+  assert_false ch.receive
+  assert_equal 42, ch.receive
+  assert_equal 1.5, ch.receive
+  assert_equal :sym, ch.receive
+end
+
+assert('StateChannel hands over an owned string buffer') do
+  ch = StateChannel.new
+  s = "abc" * 20                # heap-allocated, exclusively owned
+  ch.send(s)
+  assert_equal "", s            # ownership moved into the message
+  assert_equal "abc" * 20, ch.receive
+end
+
+assert('StateChannel copies strings it cannot take over') do
+  ch = StateChannel.new
+  s = "tiny"                    # embedded; stays with the sender
+  ch.send(s)
+  assert_equal "tiny", s
+  assert_equal "tiny", ch.receive
+end
+
+assert('StateChannel copies arrays and hashes structurally') do
+  ch = StateChannel.new
+  a = [1, [2, 3], { :k => 4.5, "s" => nil }]
+  ch.send(a)
+  b = ch.receive
+  assert_equal [1, [2, 3], { :k => 4.5, "s" => nil }], b
+  b[1] << 99
+  assert_equal [2, 3], a[1]     # receiver got its own copy
+end
+
+assert('StateChannel rejects payloads that cannot cross states') do
+  ch = StateChannel.new
+  assert_raise(TypeError) { ch.send(Object.new) }
+  assert_raise(TypeError) { ch.send(->{ 1 }) }
+end
+
+assert('StateChannel rejects cyclic payloads') do
+  ch = StateChannel.new
+  a = [1]
+  a << a
+  assert_raise(ArgumentError) { ch.send(a) }
+end
@@ -305,34 +305,38 @@ mrb_str_lines(mrb_state *mrb, mrb_value self)
   mrb_value result;
   mrb_value blk;
   int ai;
-  mrb_int len;
   mrb_value arg;
-  char *p = RSTRING_PTR(self), *t;
-  char *e = p + RSTRING_LEN(self);
+  mrb_int beg = 0, end;
 
   mrb_get_args(mrb, "&", &blk);
 
   result = mrb_ary_new(mrb);
 
+  /* emit shared views instead of copies; sharing may realloc the
+     receiver's buffer, so work with offsets and refetch the pointer */
   if (!mrb_nil_p(blk)) {
-    while (p < e) {
-      t = p;
-      while (p < e && *p != '\n') p++;
-      if (*p == '\n') p++;
-      len = (mrb_int) (p - t);
-      arg = mrb_str_new(mrb, t, len);
+    while (beg < RSTRING_LEN(self)) {
+      const char *p = RSTRING_PTR(self);
+
+      end = beg;
+      while (end < RSTRING_LEN(self) && p[end] != '\n') end++;
+      if (end < RSTRING_LEN(self)) end++;
+      arg = mrb_str_byte_subseq(mrb, self, beg, end - beg);
       mrb_yield_argv(mrb, blk, 1, &arg);
+      beg = end;
     }
     return self;
   }
-  while (p < e) {
+  while (beg < RSTRING_LEN(self)) {
+    const char *p = RSTRING_PTR(self);
+
     ai = mrb_gc_arena_save(mrb);
-    t = p;
-    while (p < e && *p != '\n') p++;
-    if (*p == '\n') p++;
-    len = (mrb_int) (p - t);
-    mrb_ary_push(mrb, result, mrb_str_new(mrb, t, len));
+    end = beg;
+    while (end < RSTRING_LEN(self) && p[end] != '\n') end++;
+    if (end < RSTRING_LEN(self)) end++;
+    mrb_ary_push(mrb, result, mrb_str_byte_subseq(mrb, self, beg, end - beg));
     mrb_gc_arena_restore(mrb, ai);
+    beg = end;
   }
   return result;
 }
@@ -533,6 +537,47 @@ mrb_str_ord(mrb_state* mrb, mrb_value str)
 }
 #endif
 
+/*
+ *  call-seq:
+ *     str.reserve(n)   -> str
+ *
+ *  Ensures the internal buffer can hold at least +n+ bytes without
+ *  reallocating, then returns +str+.
+ */
+static mrb_value
+mrb_str_reserve_m(mrb_state *mrb, mrb_value str)
+{
+  mrb_int n;
+
+  mrb_get_args(mrb, "i", &n);
+  if (n < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative capacity");
+  }
+  return mrb_str_reserve(mrb, str, n);
+}
+
+/*
+ *  call-seq:
+ *     str.capacity   -> integer
+ *
+ *  Returns the number of bytes the internal buffer can hold before it
+ *  has to be reallocated.
+ */
+static mrb_value
+mrb_str_capacity(mrb_state *mrb, mrb_value str)
+{
+  struct RString *s = mrb_str_ptr(str);
+  mrb_int capa;
+
+  if (RSTR_EMBED_P(s))
+    capa = RSTRING_EMBED_LEN_MAX;
+  else if (RSTR_SHARED_P(s) || RSTR_NOFREE_P(s))
+    capa = RSTR_LEN(s);
+  else
+    capa = s->as.heap.aux.capa;
+  return mrb_fixnum_value(capa);
+}
+
 void
 mrb_mruby_string_ext_gem_init(mrb_state* mrb)
 {
@@ -558,6 +603,8 @@ mrb_mruby_string_ext_gem_init(mrb_state* mrb)
   mrb_alias_method(mrb, s, mrb_intern_lit(mrb, "next"), mrb_intern_lit(mrb, "succ"));
   mrb_alias_method(mrb, s, mrb_intern_lit(mrb, "next!"), mrb_intern_lit(mrb, "succ!"));
   mrb_define_method(mrb, s, "ord", mrb_str_ord, MRB_ARGS_NONE());
+  mrb_define_method(mrb, s, "reserve",  mrb_str_reserve_m, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, s, "capacity", mrb_str_capacity,  MRB_ARGS_NONE());
 
   mrb_define_method(mrb, mrb->fixnum_class, "chr", mrb_fixnum_chr, MRB_ARGS_NONE());
 }
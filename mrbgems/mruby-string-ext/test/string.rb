@@ -582,3 +582,18 @@ assert('String#each_codepoint(UTF-8)') do
   end
   assert_equal expect, cp
 end if UTF8STRING
+
+assert('String#reserve') do
+  s = "foo"
+  assert_equal s, s.reserve(1024)
+  assert_true s.capacity >= 1024
+  assert_equal "foo", s
+  s << "bar"
+  assert_equal "foobar", s
+  assert_true s.capacity >= 1024
+end
+
+assert('String#capacity') do
+  assert_true "".capacity >= 0
+  assert_true ("x" * 300).capacity >= 300
+end
@@ -11,10 +11,11 @@
 #include <mruby/class.h>
 #include <mruby/variable.h>
 #include <mruby/hash.h>
+#include <mruby/proc.h>
 #include <mruby/range.h>
 
-#define RSTRUCT_LEN(st) mrb_ary_ptr(st)->len
-#define RSTRUCT_PTR(st) mrb_ary_ptr(st)->ptr
+#define RSTRUCT_LEN(st) RARRAY_LEN(st)
+#define RSTRUCT_PTR(st) ARY_PTR(mrb_ary_ptr(st))
 
 static struct RClass *
 struct_class(mrb_state *mrb)
@@ -98,33 +99,6 @@ mrb_struct_members(mrb_state *mrb, mrb_value obj)
   return mrb_struct_s_members_m(mrb, mrb_obj_value(mrb_obj_class(mrb, obj)));
 }
 
-static mrb_value
-mrb_struct_getmember(mrb_state *mrb, mrb_value obj, mrb_sym id)
-{
-  mrb_value members, slot, *ptr;
-  const mrb_value *ptr_members;
-  mrb_int i, len;
-
-  ptr = RSTRUCT_PTR(obj);
-  members = struct_members(mrb, obj);
-  ptr_members = RARRAY_PTR(members);
-  slot = mrb_symbol_value(id);
-  len = RARRAY_LEN(members);
-  for (i=0; i<len; i++) {
-    if (mrb_obj_equal(mrb, ptr_members[i], slot)) {
-      return ptr[i];
-    }
-  }
-  mrb_raisef(mrb, E_INDEX_ERROR, "'%S' is not a struct member", mrb_sym2str(mrb, id));
-  return mrb_nil_value();       /* not reached */
-}
-
-static mrb_value
-mrb_struct_ref(mrb_state *mrb, mrb_value obj)
-{
-  return mrb_struct_getmember(mrb, obj, mrb->c->ci->mid);
-}
-
 static mrb_value mrb_struct_ref0(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[0];}
 static mrb_value mrb_struct_ref1(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[1];}
 static mrb_value mrb_struct_ref2(mrb_state* mrb, mrb_value obj) {return RSTRUCT_PTR(obj)[2];}
@@ -171,40 +145,45 @@ mrb_id_attrset(mrb_state *mrb, mrb_sym id)
   return mid;
 }
 
-static mrb_value
-mrb_struct_set(mrb_state *mrb, mrb_value obj, mrb_value val)
+/* Accessors generated by make_struct carry their member index in the
+   proc's cfunc env, so reads and writes are bounds-checked array loads
+   with no scan of __members__ and no symbol work per call. */
+static mrb_int
+struct_env_index(mrb_state *mrb, mrb_value obj)
 {
-  const char *name;
-  mrb_int i, len, slen;
-  mrb_sym mid;
-  mrb_value members, slot, *ptr;
-  const mrb_value *ptr_members;
+  mrb_int i = mrb_fixnum(mrb_proc_cfunc_env_get(mrb, 0));
 
-  /* get base id */
-  name = mrb_sym2name_len(mrb, mrb->c->ci->mid, &slen);
-  mid = mrb_intern(mrb, name, slen-1); /* omit last "=" */
-
-  members = struct_members(mrb, obj);
-  ptr_members = RARRAY_PTR(members);
-  len = RARRAY_LEN(members);
-  ptr = RSTRUCT_PTR(obj);
-  for (i=0; i<len; i++) {
-    slot = ptr_members[i];
-    if (mrb_symbol(slot) == mid) {
-      return ptr[i] = val;
-    }
+  if (RSTRUCT_LEN(obj) <= i) {
+    mrb_raisef(mrb, E_TYPE_ERROR,
+               "struct size differs (%S required %S given)",
+               mrb_fixnum_value(i+1), mrb_fixnum_value(RSTRUCT_LEN(obj)));
   }
-  mrb_raisef(mrb, E_INDEX_ERROR, "'%S' is not a struct member", mrb_sym2str(mrb, mid));
-  return mrb_nil_value();       /* not reached */
+  return i;
+}
+
+static mrb_value
+mrb_struct_ref_env(mrb_state *mrb, mrb_value obj)
+{
+  return RSTRUCT_PTR(obj)[struct_env_index(mrb, obj)];
 }
 
 static mrb_value
-mrb_struct_set_m(mrb_state *mrb, mrb_value obj)
+mrb_struct_set_env(mrb_state *mrb, mrb_value obj)
 {
   mrb_value val;
 
   mrb_get_args(mrb, "o", &val);
-  return mrb_struct_set(mrb, obj, val);
+  return RSTRUCT_PTR(obj)[struct_env_index(mrb, obj)] = val;
+}
+
+static void
+define_indexed_accessor(mrb_state *mrb, struct RClass *c, mrb_sym mid, mrb_func_t func, mrb_int i)
+{
+  mrb_value idx = mrb_fixnum_value(i);
+  struct RProc *p = mrb_proc_new_cfunc_with_env(mrb, func, 1, &idx);
+
+  p->target_class = c;
+  mrb_define_method_raw(mrb, c, mid, p);
 }
 
 static mrb_bool
@@ -238,9 +217,9 @@ make_struct_define_accessors(mrb_state *mrb, mrb_value members, struct RClass *c
         mrb_define_method_id(mrb, c, id, ref_func[i], MRB_ARGS_NONE());
       }
       else {
-        mrb_define_method_id(mrb, c, id, mrb_struct_ref, MRB_ARGS_NONE());
+        define_indexed_accessor(mrb, c, id, mrb_struct_ref_env, i);
       }
-      mrb_define_method_id(mrb, c, mrb_id_attrset(mrb, id), mrb_struct_set_m, MRB_ARGS_REQ(1));
+      define_indexed_accessor(mrb, c, mrb_id_attrset(mrb, id), mrb_struct_set_env, i);
       mrb_gc_arena_restore(mrb, ai);
     }
   }
@@ -25,10 +25,12 @@ typedef struct symbol_name {
 static mrb_value
 mrb_sym_all_symbols(mrb_state *mrb, mrb_value self)
 {
-  mrb_sym i, lim;
-  mrb_value ary = mrb_ary_new_capa(mrb, mrb->symidx);
+  mrb_sym i;
+  mrb_value ary = mrb_ary_new(mrb);
 
-  for (i=1, lim=mrb->symidx+1; i<lim; i++) {
+  /* walk IDs up to the first unassigned one instead of reading
+     mrb->symidx, which does not exist with MRB_USE_SHARED_SYMBOLS */
+  for (i=1; mrb_sym2name_len(mrb, i, NULL) != NULL; i++) {
     mrb_ary_push(mrb, ary, mrb_symbol_value(i));
   }
 
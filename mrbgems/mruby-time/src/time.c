@@ -175,18 +175,55 @@ struct mrb_time {
   time_t              sec;
   time_t              usec;
   enum mrb_timezone   timezone;
+  mrb_bool            datetime_valid;
   struct tm           datetime;
 };
 
 static const struct mrb_data_type mrb_time_type = { "Time", mrb_free };
 
+/* One-entry conversion memo per timezone.  Log pipelines convert long
+runs of timestamps sharing the same second, so a hit here skips the
+localtime_r/gmtime_r call entirely.  The timezone is a process-wide
+property (the TZ environment), so the memo is too; Time.tzset clears
+it. */
+static struct time_memo {
+  time_t    sec;
+  mrb_bool  valid;
+  struct tm datetime;
+} time_memo[MRB_TIMEZONE_LAST];
+
+/* cached offset of the local zone from UTC, valid for one second of
+time_t like the conversion memo */
+static struct {
+  time_t   sec;
+  time_t   offset;
+  mrb_bool valid;
+} utc_offset_memo;
+
+static void
+time_memo_clear(void)
+{
+  int i;
+
+  for (i = 0; i < MRB_TIMEZONE_LAST; i++) {
+    time_memo[i].valid = FALSE;
+  }
+  utc_offset_memo.valid = FALSE;
+}
+
 /** Updates the datetime of a mrb_time based on it's timezone and
 seconds setting. Returns self on success, NULL of failure. */
 static struct mrb_time*
 mrb_time_update_datetime(struct mrb_time *self)
 {
   struct tm *aid;
+  struct time_memo *memo = &time_memo[self->timezone];
 
+  if (memo->valid && memo->sec == self->sec) {
+    self->datetime = memo->datetime;
+    self->datetime_valid = TRUE;
+    return self;
+  }
   if (self->timezone == MRB_TIMEZONE_UTC) {
     aid = gmtime_r(&self->sec, &self->datetime);
   }
@@ -197,10 +234,26 @@ mrb_time_update_datetime(struct mrb_time *self)
 #ifdef NO_GMTIME_R
   self->datetime = *aid; /* copy data */
 #endif
+  self->datetime_valid = TRUE;
+  memo->sec = self->sec;
+  memo->datetime = self->datetime;
+  memo->valid = TRUE;
 
   return self;
 }
 
+/* broken-down time is computed on first field access and kept until
+the timezone changes; Time arithmetic that never looks at fields pays
+no conversion at all */
+static struct tm*
+time_datetime(struct mrb_time *self)
+{
+  if (!self->datetime_valid) {
+    mrb_time_update_datetime(self);
+  }
+  return &self->datetime;
+}
+
 static mrb_value
 mrb_time_wrap(mrb_state *mrb, struct RClass *tc, struct mrb_time *tm)
 {
@@ -238,7 +291,7 @@ time_alloc(mrb_state *mrb, double sec, double usec, enum mrb_timezone timezone)
     tm->usec -= 1000000;
   }
   tm->timezone = timezone;
-  mrb_time_update_datetime(tm);
+  tm->datetime_valid = FALSE;
 
   return tm;
 }
@@ -290,7 +343,7 @@ current_mrb_time(mrb_state *mrb)
   }
 #endif
   tm->timezone = MRB_TIMEZONE_LOCAL;
-  mrb_time_update_datetime(tm);
+  tm->datetime_valid = FALSE;
 
   return tm;
 }
@@ -451,7 +504,7 @@ mrb_time_wday(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_wday);
+  return mrb_fixnum_value(time_datetime(tm)->tm_wday);
 }
 
 /* 15.2.19.7.31 */
@@ -462,7 +515,7 @@ mrb_time_yday(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_yday + 1);
+  return mrb_fixnum_value(time_datetime(tm)->tm_yday + 1);
 }
 
 /* 15.2.19.7.32 */
@@ -473,7 +526,7 @@ mrb_time_year(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_year + 1900);
+  return mrb_fixnum_value(time_datetime(tm)->tm_year + 1900);
 }
 
 /* 15.2.19.7.33 */
@@ -502,7 +555,7 @@ mrb_time_asctime(mrb_state *mrb, mrb_value self)
   int len;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  d = &tm->datetime;
+  d = time_datetime(tm);
   len = snprintf(buf, sizeof(buf), "%s %s %02d %02d:%02d:%02d %s%d",
     wday_names[d->tm_wday], mon_names[d->tm_mon], d->tm_mday,
     d->tm_hour, d->tm_min, d->tm_sec,
@@ -520,7 +573,7 @@ mrb_time_day(mrb_state *mrb, mrb_value self)
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
   if (!tm) return mrb_nil_value();
-  return mrb_fixnum_value(tm->datetime.tm_mday);
+  return mrb_fixnum_value(time_datetime(tm)->tm_mday);
 }
 
 
@@ -532,7 +585,7 @@ mrb_time_dst_p(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_bool_value(tm->datetime.tm_isdst);
+  return mrb_bool_value(time_datetime(tm)->tm_isdst);
 }
 
 /* 15.2.19.7.8 */
@@ -547,7 +600,7 @@ mrb_time_getutc(mrb_state *mrb, mrb_value self)
   tm2 = (struct mrb_time *)mrb_malloc(mrb, sizeof(*tm));
   *tm2 = *tm;
   tm2->timezone = MRB_TIMEZONE_UTC;
-  mrb_time_update_datetime(tm2);
+  tm2->datetime_valid = FALSE;
   return mrb_time_wrap(mrb, mrb_obj_class(mrb, self), tm2);
 }
 
@@ -562,7 +615,7 @@ mrb_time_getlocal(mrb_state *mrb, mrb_value self)
   tm2 = (struct mrb_time *)mrb_malloc(mrb, sizeof(*tm));
   *tm2 = *tm;
   tm2->timezone = MRB_TIMEZONE_LOCAL;
-  mrb_time_update_datetime(tm2);
+  tm2->datetime_valid = FALSE;
   return mrb_time_wrap(mrb, mrb_obj_class(mrb, self), tm2);
 }
 
@@ -574,7 +627,7 @@ mrb_time_hour(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_hour);
+  return mrb_fixnum_value(time_datetime(tm)->tm_hour);
 }
 
 /* 15.2.19.7.16 */
@@ -633,7 +686,7 @@ mrb_time_localtime(mrb_state *mrb, mrb_value self)
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
   tm->timezone = MRB_TIMEZONE_LOCAL;
-  mrb_time_update_datetime(tm);
+  tm->datetime_valid = FALSE;
   return self;
 }
 
@@ -645,7 +698,7 @@ mrb_time_mday(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_mday);
+  return mrb_fixnum_value(time_datetime(tm)->tm_mday);
 }
 
 /* 15.2.19.7.20 */
@@ -656,7 +709,7 @@ mrb_time_min(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_min);
+  return mrb_fixnum_value(time_datetime(tm)->tm_min);
 }
 
 /* 15.2.19.7.21 and 15.2.19.7.22 */
@@ -667,7 +720,7 @@ mrb_time_mon(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_mon + 1);
+  return mrb_fixnum_value(time_datetime(tm)->tm_mon + 1);
 }
 
 /* 15.2.19.7.23 */
@@ -678,7 +731,7 @@ mrb_time_sec(mrb_state *mrb, mrb_value self)
   struct mrb_time *tm;
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
-  return mrb_fixnum_value(tm->datetime.tm_sec);
+  return mrb_fixnum_value(time_datetime(tm)->tm_sec);
 }
 
 
@@ -730,7 +783,7 @@ mrb_time_utc(mrb_state *mrb, mrb_value self)
 
   tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
   tm->timezone = MRB_TIMEZONE_UTC;
-  mrb_time_update_datetime(tm);
+  tm->datetime_valid = FALSE;
   return self;
 }
 
@@ -745,6 +798,73 @@ mrb_time_utc_p(mrb_state *mrb, mrb_value self)
   return mrb_bool_value(tm->timezone == MRB_TIMEZONE_UTC);
 }
 
+/* 15.2.19.7.12 */
+/* 15.2.19.7.14 */
+/* 15.2.19.7.29 */
+/* Returns the offset of this time from UTC, in seconds. */
+static mrb_value
+mrb_time_utc_offset(mrb_state *mrb, mrb_value self)
+{
+  struct mrb_time *tm;
+  struct tm local;
+  time_t offset;
+
+  tm = DATA_GET_PTR(mrb, self, &mrb_time_type, struct mrb_time);
+  if (tm->timezone == MRB_TIMEZONE_UTC) {
+    return mrb_fixnum_value(0);
+  }
+  if (utc_offset_memo.valid && utc_offset_memo.sec == tm->sec) {
+    return mrb_fixnum_value((mrb_int)utc_offset_memo.offset);
+  }
+  /* reading the local fields back as if they were UTC yields the
+     seconds the zone is ahead */
+  if (tm->timezone == MRB_TIMEZONE_LOCAL && tm->datetime_valid) {
+    local = tm->datetime;
+  }
+  else if (!localtime_r(&tm->sec, &local)) {
+    return mrb_nil_value();
+  }
+  offset = timegm(&local) - tm->sec;
+  utc_offset_memo.sec = tm->sec;
+  utc_offset_memo.offset = offset;
+  utc_offset_memo.valid = TRUE;
+  return mrb_fixnum_value((mrb_int)offset);
+}
+
+/* Returns seconds from a monotonic clock as a Float, for measuring
+   intervals without going through the datetime machinery. */
+static mrb_value
+mrb_time_monotonic(mrb_state *mrb, mrb_value self)
+{
+#if defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return mrb_float_value(mrb, (mrb_float)ts.tv_sec + (mrb_float)ts.tv_nsec / 1.0e9);
+  }
+#endif
+#ifndef NO_GETTIMEOFDAY
+  {
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return mrb_float_value(mrb, (mrb_float)tv.tv_sec + (mrb_float)tv.tv_usec / 1.0e6);
+  }
+#else
+  return mrb_float_value(mrb, (mrb_float)time(NULL));
+#endif
+}
+
+/* Drops the cached timezone conversions; call after changing TZ. */
+static mrb_value
+mrb_time_tzset(mrb_state *mrb, mrb_value self)
+{
+#ifndef _WIN32
+  tzset();
+#endif
+  time_memo_clear();
+  return mrb_nil_value();
+}
 
 void
 mrb_mruby_time_gem_init(mrb_state* mrb)
@@ -760,6 +880,8 @@ mrb_mruby_time_gem_init(mrb_state* mrb)
   mrb_define_class_method(mrb, tc, "mktime", mrb_time_local, MRB_ARGS_ARG(1,6));/* 15.2.19.6.4 */
   mrb_define_class_method(mrb, tc, "now", mrb_time_now, MRB_ARGS_NONE());       /* 15.2.19.6.5 */
   mrb_define_class_method(mrb, tc, "utc", mrb_time_gm, MRB_ARGS_ARG(1,6));      /* 15.2.19.6.6 */
+  mrb_define_class_method(mrb, tc, "monotonic", mrb_time_monotonic, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, tc, "tzset", mrb_time_tzset, MRB_ARGS_NONE());
 
   mrb_define_method(mrb, tc, "=="     , mrb_time_eq     , MRB_ARGS_REQ(1));
   mrb_define_method(mrb, tc, "<=>"    , mrb_time_cmp    , MRB_ARGS_REQ(1)); /* 15.2.19.7.1 */
@@ -775,7 +897,9 @@ mrb_mruby_time_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, tc, "getlocal",mrb_time_getlocal,MRB_ARGS_NONE()); /* 15.2.19.7.9 */
   mrb_define_method(mrb, tc, "getutc" , mrb_time_getutc , MRB_ARGS_NONE()); /* 15.2.19.7.10 */
   mrb_define_method(mrb, tc, "gmt?"   , mrb_time_utc_p  , MRB_ARGS_NONE()); /* 15.2.19.7.11 */
+  mrb_define_method(mrb, tc, "gmt_offset", mrb_time_utc_offset, MRB_ARGS_NONE()); /* 15.2.19.7.12 */
   mrb_define_method(mrb, tc, "gmtime" , mrb_time_utc    , MRB_ARGS_NONE()); /* 15.2.19.7.13 */
+  mrb_define_method(mrb, tc, "gmtoff" , mrb_time_utc_offset, MRB_ARGS_NONE()); /* 15.2.19.7.14 */
   mrb_define_method(mrb, tc, "hour"   , mrb_time_hour, MRB_ARGS_NONE());    /* 15.2.19.7.15 */
   mrb_define_method(mrb, tc, "localtime", mrb_time_localtime, MRB_ARGS_NONE()); /* 15.2.19.7.18 */
   mrb_define_method(mrb, tc, "mday"   , mrb_time_mday, MRB_ARGS_NONE());    /* 15.2.19.7.19 */
@@ -789,6 +913,7 @@ mrb_mruby_time_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, tc, "to_f", mrb_time_to_f, MRB_ARGS_NONE());       /* 15.2.19.7.24 */
   mrb_define_method(mrb, tc, "usec", mrb_time_usec, MRB_ARGS_NONE());       /* 15.2.19.7.26 */
   mrb_define_method(mrb, tc, "utc" , mrb_time_utc, MRB_ARGS_NONE());        /* 15.2.19.7.27 */
+  mrb_define_method(mrb, tc, "utc_offset", mrb_time_utc_offset, MRB_ARGS_NONE()); /* 15.2.19.7.29 */
   mrb_define_method(mrb, tc, "utc?", mrb_time_utc_p,MRB_ARGS_NONE());       /* 15.2.19.7.28 */
   mrb_define_method(mrb, tc, "wday", mrb_time_wday, MRB_ARGS_NONE());       /* 15.2.19.7.30 */
   mrb_define_method(mrb, tc, "yday", mrb_time_yday, MRB_ARGS_NONE());       /* 15.2.19.7.31 */
@@ -798,12 +923,6 @@ mrb_mruby_time_gem_init(mrb_state* mrb)
   mrb_define_method(mrb, tc, "initialize", mrb_time_initialize, MRB_ARGS_REQ(1)); /* 15.2.19.7.16 */
   mrb_define_method(mrb, tc, "initialize_copy", mrb_time_initialize_copy, MRB_ARGS_REQ(1)); /* 15.2.19.7.17 */
 
-  /*
-    methods not available:
-      gmt_offset(15.2.19.7.12)
-      gmtoff(15.2.19.7.14)
-      utc_offset(15.2.19.7.29)
-  */
 }
 
 void
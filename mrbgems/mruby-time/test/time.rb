@@ -211,3 +211,24 @@ assert('2000 times 500us make a second') do
   end
   t.usec == 0
 end
+
+assert('Time#utc_offset') do
+  t = Time.gm(2012, 12, 24)
+  assert_equal 0, t.utc_offset
+  assert_equal 0, t.gmt_offset
+  assert_equal 0, t.gmtoff
+  l = Time.local(2012, 12, 24)
+  assert_equal t.to_i - l.to_i, l.utc_offset
+end
+
+assert('Time.monotonic') do
+  a = Time.monotonic
+  b = Time.monotonic
+  assert_kind_of Float, a
+  assert_true b >= a
+end
+
+assert('Time.tzset') do
+  Time.tzset
+  Time.gm(2012, 12, 24).wday == 1
+end
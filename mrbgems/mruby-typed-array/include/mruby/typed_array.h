@@ -0,0 +1,44 @@
+/*
+** mruby/typed_array.h - packed numeric arrays (mruby-typed-array gem)
+**
+** See Copyright Notice in mruby.h
+*/
+
+#ifndef MRUBY_TYPED_ARRAY_H
+#define MRUBY_TYPED_ARRAY_H
+
+#include <mruby.h>
+#include <mruby/data.h>
+#include <stdint.h>
+
+MRB_BEGIN_DECL
+
+/*
+ * Backing store of Int32Array and FloatArray: one contiguous C buffer
+ * of unboxed elements, so numeric pipelines get cache-linear storage
+ * and C extensions can read and write it in place.
+ */
+typedef struct mrb_typed_array {
+  mrb_int len;
+  mrb_int capa;
+  union {
+    int32_t *i32;
+    mrb_float *f;
+    void *ptr;
+  } data;
+} mrb_typed_array;
+
+extern const struct mrb_data_type mrb_int32_array_type;
+extern const struct mrb_data_type mrb_float_array_type;
+
+/*
+ * Zero-copy access from C: returns the element buffer and stores the
+ * element count in *len.  The pointer stays valid until the array is
+ * resized or collected.
+ */
+int32_t *mrb_int32_array_ptr(mrb_state *mrb, mrb_value ary, mrb_int *len);
+mrb_float *mrb_float_array_ptr(mrb_state *mrb, mrb_value ary, mrb_int *len);
+
+MRB_END_DECL
+
+#endif  /* MRUBY_TYPED_ARRAY_H */
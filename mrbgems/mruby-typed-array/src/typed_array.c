@@ -0,0 +1,321 @@
+/*
+** typed_array.c - packed Int32Array/FloatArray
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/numeric.h>
+#include <mruby/typed_array.h>
+#include <string.h>
+
+/* element kinds; the element size is all that differs between the
+   two classes, so most of the implementation is shared */
+enum ta_kind {
+  TA_INT32,
+  TA_FLOAT
+};
+
+#define TA_DEFAULT_CAPA 4
+
+static void
+ta_free(mrb_state *mrb, void *p)
+{
+  mrb_typed_array *ta = (mrb_typed_array*)p;
+
+  if (ta) {
+    mrb_free(mrb, ta->data.ptr);
+    mrb_free(mrb, ta);
+  }
+}
+
+const struct mrb_data_type mrb_int32_array_type = { "Int32Array", ta_free };
+const struct mrb_data_type mrb_float_array_type = { "FloatArray", ta_free };
+
+static enum ta_kind
+ta_kind_of(mrb_state *mrb, mrb_value self)
+{
+  if (DATA_TYPE(self)) {
+    return (DATA_TYPE(self) == &mrb_int32_array_type) ? TA_INT32 : TA_FLOAT;
+  }
+  /* not initialized yet; decide by class */
+  return mrb_obj_is_kind_of(mrb, self, mrb_class_get(mrb, "Int32Array")) ? TA_INT32 : TA_FLOAT;
+}
+
+static size_t
+ta_elem_size(enum ta_kind kind)
+{
+  return (kind == TA_INT32) ? sizeof(int32_t) : sizeof(mrb_float);
+}
+
+static mrb_typed_array*
+ta_get(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = (mrb_typed_array*)DATA_PTR(self);
+
+  if (!ta) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "uninitialized typed array");
+  }
+  return ta;
+}
+
+static mrb_typed_array*
+ta_alloc(mrb_state *mrb, enum ta_kind kind, mrb_int capa)
+{
+  mrb_typed_array *ta = (mrb_typed_array*)mrb_malloc(mrb, sizeof(mrb_typed_array));
+
+  ta->len = 0;
+  ta->capa = (capa > 0) ? capa : TA_DEFAULT_CAPA;
+  ta->data.ptr = NULL;           /* alloc below may raise; keep freeable */
+  ta->data.ptr = mrb_calloc(mrb, (size_t)ta->capa, ta_elem_size(kind));
+  return ta;
+}
+
+static void
+ta_expand(mrb_state *mrb, mrb_typed_array *ta, enum ta_kind kind, mrb_int len)
+{
+  mrb_int capa = ta->capa;
+
+  if (len <= capa) return;
+  while (capa < len) {
+    capa *= 2;
+  }
+  ta->data.ptr = mrb_realloc(mrb, ta->data.ptr, (size_t)capa * ta_elem_size(kind));
+  /* zero the new tail so auto-extending stores read back as 0 */
+  memset((char*)ta->data.ptr + (size_t)ta->capa * ta_elem_size(kind), 0,
+         (size_t)(capa - ta->capa) * ta_elem_size(kind));
+  ta->capa = capa;
+}
+
+static mrb_value
+ta_box(mrb_state *mrb, mrb_typed_array *ta, enum ta_kind kind, mrb_int i)
+{
+  if (kind == TA_INT32) {
+    return mrb_fixnum_value((mrb_int)ta->data.i32[i]);
+  }
+  return mrb_float_value(mrb, ta->data.f[i]);
+}
+
+static void
+ta_store(mrb_state *mrb, mrb_typed_array *ta, enum ta_kind kind, mrb_int i, mrb_value v)
+{
+  if (kind == TA_INT32) {
+    if (mrb_fixnum_p(v)) {
+      ta->data.i32[i] = (int32_t)mrb_fixnum(v);
+    }
+    else if (mrb_float_p(v)) {
+      ta->data.i32[i] = (int32_t)mrb_float(v);
+    }
+    else {
+      mrb_raise(mrb, E_TYPE_ERROR, "expected Numeric");
+    }
+  }
+  else {
+    if (mrb_float_p(v)) {
+      ta->data.f[i] = mrb_float(v);
+    }
+    else if (mrb_fixnum_p(v)) {
+      ta->data.f[i] = (mrb_float)mrb_fixnum(v);
+    }
+    else {
+      mrb_raise(mrb, E_TYPE_ERROR, "expected Numeric");
+    }
+  }
+}
+
+static mrb_value
+ta_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_int size = 0;
+  mrb_value fill = mrb_nil_value();
+  mrb_typed_array *ta;
+  enum ta_kind kind = ta_kind_of(mrb, self);
+
+  mrb_get_args(mrb, "|io", &size, &fill);
+  if (size < 0) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
+  }
+  ta_free(mrb, DATA_PTR(self));  /* avoid leaks on re-initialize */
+  mrb_data_init(self, NULL, NULL);
+
+  ta = ta_alloc(mrb, kind, size);
+  ta->len = size;
+  mrb_data_init(self, ta, (kind == TA_INT32) ? &mrb_int32_array_type : &mrb_float_array_type);
+  if (!mrb_nil_p(fill)) {
+    mrb_int i;
+
+    for (i = 0; i < size; i++) {
+      ta_store(mrb, ta, kind, i, fill);
+    }
+  }
+  return self;
+}
+
+static mrb_value
+ta_aget(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = ta_get(mrb, self);
+  mrb_int i;
+
+  mrb_get_args(mrb, "i", &i);
+  if (i < 0) i += ta->len;
+  if (i < 0 || ta->len <= i) return mrb_nil_value();
+  return ta_box(mrb, ta, ta_kind_of(mrb, self), i);
+}
+
+static mrb_value
+ta_aset(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = ta_get(mrb, self);
+  enum ta_kind kind = ta_kind_of(mrb, self);
+  mrb_int i;
+  mrb_value v;
+
+  mrb_get_args(mrb, "io", &i, &v);
+  if (i < 0) {
+    i += ta->len;
+    if (i < 0) {
+      mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array",
+                 mrb_fixnum_value(i - ta->len));
+    }
+  }
+  if (ta->len <= i) {            /* auto-extend with zeros, like Array */
+    ta_expand(mrb, ta, kind, i + 1);
+    ta->len = i + 1;
+  }
+  ta_store(mrb, ta, kind, i, v);
+  return v;
+}
+
+static mrb_value
+ta_push(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = ta_get(mrb, self);
+  enum ta_kind kind = ta_kind_of(mrb, self);
+  mrb_value v;
+
+  mrb_get_args(mrb, "o", &v);
+  ta_expand(mrb, ta, kind, ta->len + 1);
+  ta_store(mrb, ta, kind, ta->len, v);
+  ta->len++;
+  return self;
+}
+
+static mrb_value
+ta_size(mrb_state *mrb, mrb_value self)
+{
+  return mrb_fixnum_value(ta_get(mrb, self)->len);
+}
+
+static mrb_value
+ta_each(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = ta_get(mrb, self);
+  enum ta_kind kind = ta_kind_of(mrb, self);
+  mrb_value blk;
+  mrb_int i;
+  int ai;
+
+  mrb_get_args(mrb, "&", &blk);
+  if (mrb_nil_p(blk)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "no block given");
+  }
+  ai = mrb_gc_arena_save(mrb);
+  for (i = 0; i < ta->len; i++) {
+    mrb_yield(mrb, blk, ta_box(mrb, ta, kind, i));
+    mrb_gc_arena_restore(mrb, ai);
+    ta = ta_get(mrb, self);      /* the block may have resized us */
+  }
+  return self;
+}
+
+static mrb_value
+ta_to_a(mrb_state *mrb, mrb_value self)
+{
+  mrb_typed_array *ta = ta_get(mrb, self);
+  enum ta_kind kind = ta_kind_of(mrb, self);
+  mrb_value result = mrb_ary_new_capa(mrb, ta->len);
+  mrb_int i;
+  int ai = mrb_gc_arena_save(mrb);
+
+  for (i = 0; i < ta->len; i++) {
+    mrb_ary_push(mrb, result, ta_box(mrb, ta, kind, i));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
+
+static mrb_value
+ta_from_a(mrb_state *mrb, mrb_value klass)
+{
+  mrb_value src, obj;
+  mrb_typed_array *ta;
+  enum ta_kind kind;
+  mrb_int i, len;
+
+  mrb_get_args(mrb, "A", &src);
+  obj = mrb_obj_new(mrb, mrb_class_ptr(klass), 0, NULL);
+  ta = ta_get(mrb, obj);
+  kind = ta_kind_of(mrb, obj);
+  len = RARRAY_LEN(src);
+  ta_expand(mrb, ta, kind, len);
+  for (i = 0; i < len; i++) {
+    ta_store(mrb, ta, kind, i, RARRAY_PTR(src)[i]);
+  }
+  ta->len = len;
+  return obj;
+}
+
+/* zero-copy C access */
+int32_t*
+mrb_int32_array_ptr(mrb_state *mrb, mrb_value ary, mrb_int *len)
+{
+  mrb_typed_array *ta = DATA_GET_PTR(mrb, ary, &mrb_int32_array_type, mrb_typed_array);
+
+  if (len) *len = ta->len;
+  return ta->data.i32;
+}
+
+mrb_float*
+mrb_float_array_ptr(mrb_state *mrb, mrb_value ary, mrb_int *len)
+{
+  mrb_typed_array *ta = DATA_GET_PTR(mrb, ary, &mrb_float_array_type, mrb_typed_array);
+
+  if (len) *len = ta->len;
+  return ta->data.f;
+}
+
+static struct RClass*
+ta_define_class(mrb_state *mrb, const char *name)
+{
+  struct RClass *c = mrb_define_class(mrb, name, mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(c, MRB_TT_DATA);
+  mrb_include_module(mrb, c, mrb_module_get(mrb, "Enumerable"));
+  mrb_define_method(mrb, c, "initialize", ta_init,  MRB_ARGS_OPT(2));
+  mrb_define_method(mrb, c, "[]",         ta_aget,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "[]=",        ta_aset,  MRB_ARGS_REQ(2));
+  mrb_define_method(mrb, c, "push",       ta_push,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "<<",         ta_push,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, c, "size",       ta_size,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "length",     ta_size,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "each",       ta_each,  MRB_ARGS_NONE());
+  mrb_define_method(mrb, c, "to_a",       ta_to_a,  MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, c, "from_a", ta_from_a, MRB_ARGS_REQ(1));
+  return c;
+}
+
+void
+mrb_mruby_typed_array_gem_init(mrb_state *mrb)
+{
+  ta_define_class(mrb, "Int32Array");
+  ta_define_class(mrb, "FloatArray");
+}
+
+void
+mrb_mruby_typed_array_gem_final(mrb_state *mrb)
+{
+}
@@ -0,0 +1,46 @@
+##
+# Typed packed array Test
+
+assert("Int32Array basics") do
+  a = Int32Array.new(3)
+  assert_equal 3, a.size
+  assert_equal 0, a[0]
+  a[1] = 42
+  assert_equal 42, a[1]
+  a << 7
+  assert_equal 4, a.size
+  assert_equal 7, a[-1]
+  assert_nil a[100]
+  assert_raise(TypeError) { a[0] = "x" }
+end
+
+assert("Int32Array auto-extends on store") do
+  a = Int32Array.new
+  a[5] = 1
+  assert_equal 6, a.size
+  assert_equal 0, a[4]
+  assert_equal 1, a[5]
+end
+
+assert("FloatArray basics") do
+  f = FloatArray.new(2, 1.5)
+  assert_equal 1.5, f[0]
+  f[0] = 2
+  assert_equal 2.0, f[0]
+  f.push 3.25
+  assert_equal 3.25, f[2]
+end
+
+assert("typed arrays are enumerable") do
+  a = Int32Array.from_a([3, 1, 2])
+  assert_equal [3, 1, 2], a.to_a
+  assert_equal [6, 2, 4], a.map { |x| x * 2 }
+  assert_equal 6, a.inject(:+)
+  assert_equal [1, 2, 3], a.sort
+end
+
+assert("Int32Array.from_a converts in bulk") do
+  a = Int32Array.from_a([1, 2.7, 3])
+  assert_equal [1, 2, 3], a.to_a
+  assert_raise(TypeError) { Int32Array.from_a([:sym]) }
+end
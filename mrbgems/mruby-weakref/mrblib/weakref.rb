@@ -0,0 +1,42 @@
+# A weak-valued cache: values may be reclaimed by the GC at any time,
+# at which point their entries read as nil and are dropped on access.
+class WeakCache
+  def initialize
+    @refs = {}
+  end
+
+  def [](key)
+    ref = @refs[key]
+    return nil unless ref
+    value = ref.target
+    @refs.delete(key) if value.nil?
+    value
+  end
+
+  def []=(key, value)
+    @refs[key] = WeakRef.new(value)
+    value
+  end
+
+  def key?(key)
+    !self[key].nil?
+  end
+
+  def delete(key)
+    ref = @refs.delete(key)
+    ref ? ref.target : nil
+  end
+
+  # Drops entries whose value has been collected and returns self.
+  def compact!
+    @refs.keys.each do |key|
+      @refs.delete(key) if @refs[key].target.nil?
+    end
+    self
+  end
+
+  def size
+    compact!
+    @refs.size
+  end
+end
@@ -0,0 +1,98 @@
+/*
+** weakref.c - WeakRef class
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/data.h>
+#include <mruby/gc.h>
+
+/* the target lives in a malloc'd cell registered with the collector as
+   a weak slot; the cell is not traced from the wrapper, so it never
+   keeps its target alive, and the GC nils it when the target dies */
+struct weakref_cell {
+  mrb_value target;
+};
+
+static void
+weakref_free(mrb_state *mrb, void *ptr)
+{
+  struct weakref_cell *cell = (struct weakref_cell*)ptr;
+
+  if (cell) {
+    mrb_gc_unregister_weak(mrb, &cell->target);
+    mrb_free(mrb, cell);
+  }
+}
+
+static const struct mrb_data_type weakref_type = {
+  "WeakRef", weakref_free,
+};
+
+static mrb_value
+weakref_init(mrb_state *mrb, mrb_value self)
+{
+  mrb_value target;
+  struct weakref_cell *cell;
+
+  mrb_get_args(mrb, "o", &target);
+  cell = (struct weakref_cell*)DATA_PTR(self);
+  if (cell) {
+    weakref_free(mrb, cell);
+  }
+  mrb_data_init(self, NULL, &weakref_type);
+  cell = (struct weakref_cell*)mrb_malloc(mrb, sizeof(struct weakref_cell));
+  cell->target = target;
+  mrb_data_init(self, cell, &weakref_type);
+  mrb_gc_register_weak(mrb, &cell->target);
+  return self;
+}
+
+/*
+ *  call-seq:
+ *     weakref.target -> obj or nil
+ *
+ *  Returns the referenced object, or nil once it has been collected.
+ */
+
+static mrb_value
+weakref_target(mrb_state *mrb, mrb_value self)
+{
+  struct weakref_cell *cell = DATA_GET_PTR(mrb, self, &weakref_type, struct weakref_cell);
+
+  return cell->target;
+}
+
+/*
+ *  call-seq:
+ *     weakref.alive? -> true or false
+ *
+ *  Returns false once the referenced object has been collected. A
+ *  reference created on nil is indistinguishable from a dead one.
+ */
+
+static mrb_value
+weakref_alive_p(mrb_state *mrb, mrb_value self)
+{
+  struct weakref_cell *cell = DATA_GET_PTR(mrb, self, &weakref_type, struct weakref_cell);
+
+  return mrb_bool_value(!mrb_nil_p(cell->target));
+}
+
+void
+mrb_mruby_weakref_gem_init(mrb_state *mrb)
+{
+  struct RClass *w = mrb_define_class(mrb, "WeakRef", mrb->object_class);
+
+  MRB_SET_INSTANCE_TT(w, MRB_TT_DATA);
+  mrb_define_method(mrb, w, "initialize", weakref_init, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, w, "target", weakref_target, MRB_ARGS_NONE());
+  mrb_define_method(mrb, w, "alive?", weakref_alive_p, MRB_ARGS_NONE());
+}
+
+void
+mrb_mruby_weakref_gem_final(mrb_state *mrb)
+{
+}
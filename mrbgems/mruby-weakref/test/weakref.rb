@@ -0,0 +1,33 @@
+##
+# WeakRef test
+
+assert('WeakRef keeps reachable targets readable') do
+  s = "still here"
+  ref = WeakRef.new(s)
+  GC.start
+  assert_true ref.alive?
+  assert_equal "still here", ref.target
+end
+
+assert('WeakRef is cleared when its target is collected') do
+  ref = nil
+  make = lambda { ref = WeakRef.new("doomed" + "!") }
+  make.call
+  GC.start
+  GC.start
+  assert_false ref.alive?
+  assert_nil ref.target
+end
+
+assert('WeakCache drops entries for collected values') do
+  cache = WeakCache.new
+  keep = "kept"
+  cache[:keep] = keep
+  fill = lambda { cache[:drop] = "transient" + "!" }
+  fill.call
+  GC.start
+  GC.start
+  assert_equal "kept", cache[:keep]
+  assert_nil cache[:drop]
+  assert_equal 1, cache.size
+end
@@ -22,6 +22,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.1
   def all?(&block)
+    r = __enum_all(block)
+    return r[0] if r
     if block
       self.each{|*val| return false unless block.call(*val)}
     else
@@ -39,6 +41,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.2
   def any?(&block)
+    r = __enum_any(block)
+    return r[0] if r
     if block
       self.each{|*val| return true if block.call(*val)}
     else
@@ -57,6 +61,8 @@ module Enumerable
   def collect(&block)
     return to_enum :collect unless block
 
+    r = __enum_collect(block)
+    return r[0] if r
     ary = []
     self.each{|*val| ary.push(block.call(*val))}
     ary
@@ -71,6 +77,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.4
   def detect(ifnone=nil, &block)
+    r = __enum_detect(block)
+    return r.empty? ? ifnone : r[0] if r
     ret = ifnone
     self.each{|*val|
       if block.call(*val)
@@ -105,6 +113,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.6
   def entries
+    r = __enum_entries
+    return r[0] if r
     ary = []
     self.each{|*val|
       # __svalue is an internal method
@@ -129,6 +139,8 @@ module Enumerable
   def find_all(&block)
     return to_enum :find_all unless block
 
+    r = __enum_select(block)
+    return r[0] if r
     ary = []
     self.each{|*val|
       ary.push(val.__svalue) if block.call(*val)
@@ -163,6 +175,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.10
   def include?(obj)
+    r = __enum_include(obj)
+    return r[0] if r
     self.each{|*val|
       return true if val.__svalue == obj
     }
@@ -179,10 +193,9 @@ module Enumerable
   # ISO 15.3.2.2.11
   def inject(*args, &block)
     raise ArgumentError, "too many arguments" if args.size > 2
+    sym = nil
     if Symbol === args[-1]
-      sym = args[-1]
-      block = ->(x,y){x.__send__(sym,y)}
-      args.pop
+      sym = args.pop
     end
     if args.empty?
       flag = true  # no initial argument
@@ -191,6 +204,9 @@ module Enumerable
       flag = false
       result = args[0]
     end
+    r = __enum_inject(flag, result, sym, block)
+    return r[0] if r
+    block = ->(x,y){x.__send__(sym,y)} if sym
     self.each{|*val|
       val = val.__svalue
       if flag
@@ -302,6 +318,8 @@ module Enumerable
   #
   # ISO 15.3.2.2.17
   def reject(&block)
+    r = __enum_reject(block)
+    return r[0] if r
     ary = []
     self.each{|*val|
       ary.push(val.__svalue) unless block.call(*val)
@@ -170,29 +170,6 @@ class Hash
   # ISO 15.2.13.4.17
   alias initialize_copy replace
 
-  ##
-  # Return a hash which contains the content of
-  # +self+ and +other+. If a block is given
-  # it will be called for each element with
-  # a duplicate key. The value of the block
-  # will be the final value of this element.
-  #
-  # ISO 15.2.13.4.22
-  def merge(other, &block)
-    h = {}
-    raise TypeError, "can't convert argument into Hash" unless other.respond_to?(:to_hash)
-    other = other.to_hash
-    self.each_key{|k| h[k] = self[k]}
-    if block
-      other.each_key{|k|
-        h[k] = (self.has_key?(k))? block.call(k, self[k], other[k]): other[k]
-      }
-    else
-      other.each_key{|k| h[k] = other[k]}
-    end
-    h
-  end
-
   # internal method for Hash inspection
   def _inspect
     return "{}" if self.size == 0
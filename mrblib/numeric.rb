@@ -72,6 +72,13 @@ module Integral
   def times &block
     return to_enum :times unless block_given?
 
+    if self.kind_of?(Fixnum)
+      r = __times_int(&block) # counted C loop; declines inside a fiber
+      if r
+        return self if r.equal?(true)
+        return r[0] # value passed to break inside the block
+      end
+    end
     i = 0
     while i < self
       block.call i
@@ -16,6 +16,11 @@ class Range
     last = self.last
 
     if val.kind_of?(Fixnum) && last.kind_of?(Fixnum) # fixnums are special
+      r = __each_int(&block) # counted C loop; declines inside a fiber
+      if r
+        return self if r.equal?(true)
+        return r[0] # value passed to break inside the block
+      end
       lim = last
       lim += 1 unless exclude_end?
       i = val
@@ -9,6 +9,7 @@
 #include <mruby/class.h>
 #include <mruby/string.h>
 #include <mruby/range.h>
+#include <mruby/foreach.h>
 #include "value_array.h"
 
 #define ARY_DEFAULT_LEN   4
@@ -40,9 +41,14 @@ ary_new_capa(mrb_state *mrb, mrb_int capa)
   }
 
   a = (struct RArray*)mrb_obj_alloc(mrb, MRB_TT_ARRAY, mrb->array_class);
-  a->ptr = (mrb_value *)mrb_malloc(mrb, blen);
-  a->aux.capa = capa;
-  a->len = 0;
+  if (capa <= MRB_ARY_EMBED_LEN_MAX) {
+    a->flags |= MRB_ARY_EMBED;
+  }
+  else {
+    a->as.heap.ptr = (mrb_value *)mrb_malloc(mrb, blen);
+    a->as.heap.aux.capa = capa;
+    a->as.heap.len = 0;
+  }
 
   return a;
 }
@@ -60,37 +66,40 @@ mrb_ary_new(mrb_state *mrb)
   return mrb_ary_new_capa(mrb, 0);
 }
 
-/*
- * to copy array, use this instead of memcpy because of portability
- * * gcc on ARM may fail optimization of memcpy
- *   http://infocenter.arm.com/help/index.jsp?topic=/com.arm.doc.faqs/ka3934.html
- * * gcc on MIPS also fail
- *   http://gcc.gnu.org/bugzilla/show_bug.cgi?id=39755
- * * memcpy doesn't exist on freestanding environment
- *
- * If you optimize for binary size, use memcpy instead of this at your own risk
- * of above portability issue.
- *
- * see also http://togetter.com/li/462898
- *
- */
+/* non-overlapping bulk copy; small counts (pairs and short argument
+   lists are the common case) are unrolled, the rest is a single memcpy */
 static inline void
 array_copy(mrb_value *dst, const mrb_value *src, mrb_int size)
 {
-  mrb_int i;
-
-  for (i = 0; i < size; i++) {
-    dst[i] = src[i];
+  switch (size) {
+  case 0: return;
+  case 1: dst[0] = src[0]; return;
+  case 2: dst[0] = src[0]; dst[1] = src[1]; return;
+  default: memcpy(dst, src, sizeof(mrb_value)*(size_t)size); return;
   }
 }
 
+/* moves the embedded values to a heap buffer of capa slots */
+static void
+ary_unembed(mrb_state *mrb, struct RArray *a, mrb_int capa)
+{
+  mrb_int len = ARY_EMBED_LEN(a);
+  mrb_value *ptr = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*capa);
+
+  array_copy(ptr, a->as.embed, len);
+  a->flags &= ~(MRB_ARY_EMBED|MRB_ARY_EMBED_LEN_MASK);
+  a->as.heap.ptr = ptr;
+  a->as.heap.len = len;
+  a->as.heap.aux.capa = capa;
+}
+
 MRB_API mrb_value
 mrb_ary_new_from_values(mrb_state *mrb, mrb_int size, const mrb_value *vals)
 {
   struct RArray *a = ary_new_capa(mrb, size);
 
-  array_copy(a->ptr, vals, size);
-  a->len = size;
+  array_copy(ARY_PTR(a), vals, size);
+  ARY_SET_LEN(a, size);
 
   return mrb_obj_value(a);
 }
@@ -99,11 +108,13 @@ MRB_API mrb_value
 mrb_assoc_new(mrb_state *mrb, mrb_value car, mrb_value cdr)
 {
   struct RArray *a;
+  mrb_value *p;
 
   a = ary_new_capa(mrb, 2);
-  a->ptr[0] = car;
-  a->ptr[1] = cdr;
-  a->len = 2;
+  p = ARY_PTR(a);
+  p[0] = car;
+  p[1] = cdr;
+  ARY_SET_LEN(a, 2);
   return mrb_obj_value(a);
 }
 
@@ -121,25 +132,25 @@ static void
 ary_modify(mrb_state *mrb, struct RArray *a)
 {
   if (ARY_SHARED_P(a)) {
-    mrb_shared_array *shared = a->aux.shared;
+    mrb_shared_array *shared = a->as.heap.aux.shared;
 
-    if (shared->refcnt == 1 && a->ptr == shared->ptr) {
-      a->ptr = shared->ptr;
-      a->aux.capa = a->len;
+    if (shared->refcnt == 1 && a->as.heap.ptr == shared->ptr) {
+      a->as.heap.ptr = shared->ptr;
+      a->as.heap.aux.capa = a->as.heap.len;
       mrb_free(mrb, shared);
     }
     else {
       mrb_value *ptr, *p;
       mrb_int len;
 
-      p = a->ptr;
-      len = a->len * sizeof(mrb_value);
+      p = a->as.heap.ptr;
+      len = a->as.heap.len * sizeof(mrb_value);
       ptr = (mrb_value *)mrb_malloc(mrb, len);
       if (p) {
-        array_copy(ptr, p, a->len);
+        array_copy(ptr, p, a->as.heap.len);
       }
-      a->ptr = ptr;
-      a->aux.capa = a->len;
+      a->as.heap.ptr = ptr;
+      a->as.heap.aux.capa = a->as.heap.len;
       mrb_ary_decref(mrb, shared);
     }
     ARY_UNSET_SHARED_FLAG(a);
@@ -160,14 +171,20 @@ ary_make_shared(mrb_state *mrb, struct RArray *a)
     mrb_shared_array *shared = (mrb_shared_array *)mrb_malloc(mrb, sizeof(mrb_shared_array));
 
     shared->refcnt = 1;
-    if (a->aux.capa > a->len) {
-      a->ptr = shared->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*a->len+1);
+    if (ARY_EMBED_P(a)) {
+      /* shared buffers live on the heap; spill the embedded values
+         (at least one slot so the buffer is never zero-sized) */
+      ary_unembed(mrb, a, ARY_EMBED_LEN(a) > 0 ? ARY_EMBED_LEN(a) : 1);
+      shared->ptr = a->as.heap.ptr;
+    }
+    else if (a->as.heap.aux.capa > a->as.heap.len) {
+      a->as.heap.ptr = shared->ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*a->as.heap.len+1);
     }
     else {
-      shared->ptr = a->ptr;
+      shared->ptr = a->as.heap.ptr;
     }
-    shared->len = a->len;
-    a->aux.shared = shared;
+    shared->len = a->as.heap.len;
+    a->as.heap.aux.shared = shared;
     ARY_SET_SHARED_FLAG(a);
   }
 }
@@ -175,12 +192,24 @@ ary_make_shared(mrb_state *mrb, struct RArray *a)
 static void
 ary_expand_capa(mrb_state *mrb, struct RArray *a, mrb_int len)
 {
-  mrb_int capa = a->aux.capa;
+  mrb_int capa;
 
   if (len > ARY_MAX_SIZE) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
   }
 
+  if (ARY_EMBED_P(a)) {
+    if (len <= MRB_ARY_EMBED_LEN_MAX) return;
+    capa = ARY_DEFAULT_LEN;
+    while (capa < len) {
+      capa *= 2;
+    }
+    if (capa > ARY_MAX_SIZE) capa = ARY_MAX_SIZE;
+    ary_unembed(mrb, a, capa);
+    return;
+  }
+
+  capa = a->as.heap.aux.capa;
   if (capa == 0) {
     capa = ARY_DEFAULT_LEN;
   }
@@ -190,21 +219,24 @@ ary_expand_capa(mrb_state *mrb, struct RArray *a, mrb_int len)
 
   if (capa > ARY_MAX_SIZE) capa = ARY_MAX_SIZE; /* len <= capa <= ARY_MAX_SIZE */
 
-  if (capa > a->aux.capa) {
-    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+  if (capa > a->as.heap.aux.capa) {
+    mrb_value *expanded_ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*capa);
 
-    a->aux.capa = capa;
-    a->ptr = expanded_ptr;
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = expanded_ptr;
   }
 }
 
 static void
 ary_shrink_capa(mrb_state *mrb, struct RArray *a)
 {
-  mrb_int capa = a->aux.capa;
+  mrb_int capa;
+
+  if (ARY_EMBED_P(a)) return;
 
+  capa = a->as.heap.aux.capa;
   if (capa < ARY_DEFAULT_LEN * 2) return;
-  if (capa <= a->len * ARY_SHRINK_RATIO) return;
+  if (capa <= a->as.heap.len * ARY_SHRINK_RATIO) return;
 
   do {
     capa /= 2;
@@ -212,11 +244,11 @@ ary_shrink_capa(mrb_state *mrb, struct RArray *a)
       capa = ARY_DEFAULT_LEN;
       break;
     }
-  } while (capa > a->len * ARY_SHRINK_RATIO);
+  } while (capa > a->as.heap.len * ARY_SHRINK_RATIO);
 
-  if (capa > a->len && capa < a->aux.capa) {
-    a->aux.capa = capa;
-    a->ptr = (mrb_value *)mrb_realloc(mrb, a->ptr, sizeof(mrb_value)*capa);
+  if (capa > a->as.heap.len && capa < a->as.heap.aux.capa) {
+    a->as.heap.aux.capa = capa;
+    a->as.heap.ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*capa);
   }
 }
 
@@ -229,13 +261,14 @@ mrb_ary_resize(mrb_state *mrb, mrb_value ary, mrb_int new_len)
   ary_modify(mrb, a);
   old_len = RARRAY_LEN(ary);
   if (old_len != new_len) {
-    a->len = new_len;
     if (new_len < old_len) {
+      ARY_SET_LEN(a, new_len);
       ary_shrink_capa(mrb, a);
     }
     else {
       ary_expand_capa(mrb, a, new_len);
-      ary_fill_with_nil(a->ptr + old_len, new_len - old_len);
+      ary_fill_with_nil(ARY_PTR(a) + old_len, new_len - old_len);
+      ARY_SET_LEN(a, new_len);
     }
   }
 
@@ -253,16 +286,44 @@ mrb_ary_s_create(mrb_state *mrb, mrb_value self)
   return mrb_ary_new_from_values(mrb, len, vals);
 }
 
+/* ensures room for at least capa elements so a known-size build does a
+   single allocation instead of doubling through ary_expand_capa */
+MRB_API void
+mrb_ary_reserve(mrb_state *mrb, mrb_value ary, mrb_int capa)
+{
+  struct RArray *a = mrb_ary_ptr(ary);
+
+  if (capa > ARY_MAX_SIZE) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
+  }
+  ary_modify(mrb, a);
+  if (capa <= ARY_CAPA(a)) return;
+  if (ARY_EMBED_P(a)) {
+    ary_unembed(mrb, a, capa);
+  }
+  else {
+    a->as.heap.ptr = (mrb_value *)mrb_realloc(mrb, a->as.heap.ptr, sizeof(mrb_value)*capa);
+    a->as.heap.aux.capa = capa;
+  }
+}
+
 static void
-ary_concat(mrb_state *mrb, struct RArray *a, mrb_value *ptr, mrb_int blen)
+ary_concat(mrb_state *mrb, struct RArray *a, const mrb_value *ptr, mrb_int blen)
 {
-  mrb_int len = a->len + blen;
+  mrb_int len = ARY_LEN(a) + blen;
 
   ary_modify(mrb, a);
-  if (a->aux.capa < len) ary_expand_capa(mrb, a, len);
-  array_copy(a->ptr+a->len, ptr, blen);
+  if (ARY_CAPA(a) < len) ary_expand_capa(mrb, a, len);
+  array_copy(ARY_PTR(a)+ARY_LEN(a), ptr, blen);
   mrb_write_barrier(mrb, (struct RBasic*)a);
-  a->len = len;
+  ARY_SET_LEN(a, len);
+}
+
+/* appends vals[0..n-1] with one capacity check and one copy */
+MRB_API void
+mrb_ary_cat(mrb_state *mrb, mrb_value ary, const mrb_value *vals, mrb_int n)
+{
+  ary_concat(mrb, mrb_ary_ptr(ary), vals, n);
 }
 
 MRB_API void
@@ -270,7 +331,7 @@ mrb_ary_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RArray *a2 = mrb_ary_ptr(other);
 
-  ary_concat(mrb, mrb_ary_ptr(self), a2->ptr, a2->len);
+  ary_concat(mrb, mrb_ary_ptr(self), ARY_PTR(a2), ARY_LEN(a2));
 }
 
 static mrb_value
@@ -293,13 +354,13 @@ mrb_ary_plus(mrb_state *mrb, mrb_value self)
   mrb_int blen;
 
   mrb_get_args(mrb, "a", &ptr, &blen);
-  if (ARY_MAX_SIZE - blen < a1->len) {
+  if (ARY_MAX_SIZE - blen < ARY_LEN(a1)) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
   }
-  a2 = ary_new_capa(mrb, a1->len + blen);
-  array_copy(a2->ptr, a1->ptr, a1->len);
-  array_copy(a2->ptr + a1->len, ptr, blen);
-  a2->len = a1->len + blen;
+  a2 = ary_new_capa(mrb, ARY_LEN(a1) + blen);
+  array_copy(ARY_PTR(a2), ARY_PTR(a1), ARY_LEN(a1));
+  array_copy(ARY_PTR(a2) + ARY_LEN(a1), ptr, blen);
+  ARY_SET_LEN(a2, ARY_LEN(a1) + blen);
 
   return mrb_obj_value(a2);
 }
@@ -308,11 +369,11 @@ static void
 ary_replace(mrb_state *mrb, struct RArray *a, mrb_value *argv, mrb_int len)
 {
   ary_modify(mrb, a);
-  if (a->aux.capa < len)
+  if (ARY_CAPA(a) < len)
     ary_expand_capa(mrb, a, len);
-  array_copy(a->ptr, argv, len);
+  array_copy(ARY_PTR(a), argv, len);
   mrb_write_barrier(mrb, (struct RBasic*)a);
-  a->len = len;
+  ARY_SET_LEN(a, len);
 }
 
 MRB_API void
@@ -320,7 +381,7 @@ mrb_ary_replace(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RArray *a2 = mrb_ary_ptr(other);
 
-  ary_replace(mrb, mrb_ary_ptr(self), a2->ptr, a2->len);
+  ary_replace(mrb, mrb_ary_ptr(self), ARY_PTR(a2), ARY_LEN(a2));
 }
 
 static mrb_value
@@ -347,15 +408,15 @@ mrb_ary_times(mrb_state *mrb, mrb_value self)
     mrb_raise(mrb, E_ARGUMENT_ERROR, "negative argument");
   }
   if (times == 0) return mrb_ary_new(mrb);
-  if (ARY_MAX_SIZE / times < a1->len) {
+  if (ARY_MAX_SIZE / times < ARY_LEN(a1)) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "array size too big");
   }
-  a2 = ary_new_capa(mrb, a1->len * times);
-  ptr = a2->ptr;
+  a2 = ary_new_capa(mrb, ARY_LEN(a1) * times);
+  ARY_SET_LEN(a2, ARY_LEN(a1) * times);
+  ptr = ARY_PTR(a2);
   while (times--) {
-    array_copy(ptr, a1->ptr, a1->len);
-    ptr += a1->len;
-    a2->len += a1->len;
+    array_copy(ptr, ARY_PTR(a1), ARY_LEN(a1));
+    ptr += ARY_LEN(a1);
   }
 
   return mrb_obj_value(a2);
@@ -366,12 +427,12 @@ mrb_ary_reverse_bang(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  if (a->len > 1) {
+  if (ARY_LEN(a) > 1) {
     mrb_value *p1, *p2;
 
     ary_modify(mrb, a);
-    p1 = a->ptr;
-    p2 = a->ptr + a->len - 1;
+    p1 = ARY_PTR(a);
+    p2 = p1 + ARY_LEN(a) - 1;
 
     while (p1 < p2) {
       mrb_value tmp = *p1;
@@ -385,18 +446,18 @@ mrb_ary_reverse_bang(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_ary_reverse(mrb_state *mrb, mrb_value self)
 {
-  struct RArray *a = mrb_ary_ptr(self), *b = ary_new_capa(mrb, a->len);
+  struct RArray *a = mrb_ary_ptr(self), *b = ary_new_capa(mrb, ARY_LEN(a));
 
-  if (a->len > 0) {
+  if (ARY_LEN(a) > 0) {
     mrb_value *p1, *p2, *e;
 
-    p1 = a->ptr;
-    e  = p1 + a->len;
-    p2 = b->ptr + a->len - 1;
+    ARY_SET_LEN(b, ARY_LEN(a));
+    p1 = ARY_PTR(a);
+    e  = p1 + ARY_LEN(a);
+    p2 = ARY_PTR(b) + ARY_LEN(a) - 1;
     while (p1 < e) {
       *p2-- = *p1++;
     }
-    b->len = a->len;
   }
   return mrb_obj_value(b);
 }
@@ -405,11 +466,14 @@ MRB_API void
 mrb_ary_push(mrb_state *mrb, mrb_value ary, mrb_value elem)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len;
 
   ary_modify(mrb, a);
-  if (a->len == a->aux.capa)
-    ary_expand_capa(mrb, a, a->len + 1);
-  a->ptr[a->len++] = elem;
+  len = ARY_LEN(a);
+  if (len == ARY_CAPA(a))
+    ary_expand_capa(mrb, a, len + 1);
+  ARY_PTR(a)[len] = elem;
+  ARY_SET_LEN(a, len+1);
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, elem);
 }
 
@@ -431,9 +495,11 @@ MRB_API mrb_value
 mrb_ary_pop(mrb_state *mrb, mrb_value ary)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len = ARY_LEN(a);
 
-  if (a->len == 0) return mrb_nil_value();
-  return a->ptr[--a->len];
+  if (len == 0) return mrb_nil_value();
+  ARY_SET_LEN(a, len-1);
+  return ARY_PTR(a)[len-1];
 }
 
 #define ARY_SHIFT_SHARED_MIN 10
@@ -444,28 +510,28 @@ mrb_ary_shift(mrb_state *mrb, mrb_value self)
   struct RArray *a = mrb_ary_ptr(self);
   mrb_value val;
 
-  if (a->len == 0) return mrb_nil_value();
+  if (ARY_LEN(a) == 0) return mrb_nil_value();
   if (ARY_SHARED_P(a)) {
   L_SHIFT:
-    val = a->ptr[0];
-    a->ptr++;
-    a->len--;
+    val = a->as.heap.ptr[0];
+    a->as.heap.ptr++;
+    a->as.heap.len--;
     return val;
   }
-  if (a->len > ARY_SHIFT_SHARED_MIN) {
+  if (ARY_LEN(a) > ARY_SHIFT_SHARED_MIN) {
     ary_make_shared(mrb, a);
     goto L_SHIFT;
   }
   else {
-    mrb_value *ptr = a->ptr;
-    mrb_int size = a->len;
+    mrb_value *ptr = ARY_PTR(a);
+    mrb_int size = ARY_LEN(a);
 
     val = *ptr;
     while (--size) {
       *ptr = *(ptr+1);
       ++ptr;
     }
-    --a->len;
+    ARY_SET_LEN(a, ARY_LEN(a)-1);
   }
   return val;
 }
@@ -480,19 +546,23 @@ mrb_ary_unshift(mrb_state *mrb, mrb_value self, mrb_value item)
   struct RArray *a = mrb_ary_ptr(self);
 
   if (ARY_SHARED_P(a)
-      && a->aux.shared->refcnt == 1 /* shared only referenced from this array */
-      && a->ptr - a->aux.shared->ptr >= 1) /* there's room for unshifted item */ {
-    a->ptr--;
-    a->ptr[0] = item;
+      && a->as.heap.aux.shared->refcnt == 1 /* shared only referenced from this array */
+      && a->as.heap.ptr - a->as.heap.aux.shared->ptr >= 1) /* there's room for unshifted item */ {
+    a->as.heap.ptr--;
+    a->as.heap.ptr[0] = item;
+    a->as.heap.len++;
   }
   else {
+    mrb_int len;
+
     ary_modify(mrb, a);
-    if (a->aux.capa < a->len + 1)
-      ary_expand_capa(mrb, a, a->len + 1);
-    value_move(a->ptr + 1, a->ptr, a->len);
-    a->ptr[0] = item;
+    len = ARY_LEN(a);
+    if (ARY_CAPA(a) < len + 1)
+      ary_expand_capa(mrb, a, len + 1);
+    value_move(ARY_PTR(a) + 1, ARY_PTR(a), len);
+    ARY_PTR(a)[0] = item;
+    ARY_SET_LEN(a, len+1);
   }
-  a->len++;
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, item);
 
   return self;
@@ -507,19 +577,19 @@ mrb_ary_unshift_m(mrb_state *mrb, mrb_value self)
 
   mrb_get_args(mrb, "*", &vals, &len);
   if (ARY_SHARED_P(a)
-      && a->aux.shared->refcnt == 1 /* shared only referenced from this array */
-      && a->ptr - a->aux.shared->ptr >= len) /* there's room for unshifted item */ {
-    a->ptr -= len;
+      && a->as.heap.aux.shared->refcnt == 1 /* shared only referenced from this array */
+      && a->as.heap.ptr - a->as.heap.aux.shared->ptr >= len) /* there's room for unshifted item */ {
+    a->as.heap.ptr -= len;
   }
   else {
     ary_modify(mrb, a);
     if (len == 0) return self;
-    if (a->aux.capa < a->len + len)
-      ary_expand_capa(mrb, a, a->len + len);
-    value_move(a->ptr + len, a->ptr, a->len);
+    if (ARY_CAPA(a) < ARY_LEN(a) + len)
+      ary_expand_capa(mrb, a, ARY_LEN(a) + len);
+    value_move(ARY_PTR(a) + len, ARY_PTR(a), ARY_LEN(a));
   }
-  array_copy(a->ptr, vals, len);
-  a->len += len;
+  array_copy(ARY_PTR(a), vals, len);
+  ARY_SET_LEN(a, ARY_LEN(a)+len);
   while (len--) {
     mrb_field_write_barrier_value(mrb, (struct RBasic*)a, vals[len]);
   }
@@ -531,12 +601,13 @@ MRB_API mrb_value
 mrb_ary_ref(mrb_state *mrb, mrb_value ary, mrb_int n)
 {
   struct RArray *a = mrb_ary_ptr(ary);
+  mrb_int len = ARY_LEN(a);
 
   /* range check */
-  if (n < 0) n += a->len;
-  if (n < 0 || a->len <= n) return mrb_nil_value();
+  if (n < 0) n += len;
+  if (n < 0 || len <= n) return mrb_nil_value();
 
-  return a->ptr[n];
+  return ARY_PTR(a)[n];
 }
 
 MRB_API void
@@ -547,19 +618,19 @@ mrb_ary_set(mrb_state *mrb, mrb_value ary, mrb_int n, mrb_value val)
   ary_modify(mrb, a);
   /* range check */
   if (n < 0) {
-    n += a->len;
+    n += ARY_LEN(a);
     if (n < 0) {
-      mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array", mrb_fixnum_value(n - a->len));
+      mrb_raisef(mrb, E_INDEX_ERROR, "index %S out of array", mrb_fixnum_value(n - ARY_LEN(a)));
     }
   }
-  if (a->len <= n) {
-    if (a->aux.capa <= n)
+  if (ARY_LEN(a) <= n) {
+    if (ARY_CAPA(a) <= n)
       ary_expand_capa(mrb, a, n + 1);
-    ary_fill_with_nil(a->ptr + a->len, n + 1 - a->len);
-    a->len = n + 1;
+    ary_fill_with_nil(ARY_PTR(a) + ARY_LEN(a), n + 1 - ARY_LEN(a));
+    ARY_SET_LEN(a, n+1);
   }
 
-  a->ptr[n] = val;
+  ARY_PTR(a)[n] = val;
   mrb_field_write_barrier_value(mrb, (struct RBasic*)a, val);
 }
 
@@ -578,13 +649,13 @@ mrb_ary_splice(mrb_state *mrb, mrb_value ary, mrb_int head, mrb_int len, mrb_val
 
   /* range check */
   if (head < 0) {
-    head += a->len;
+    head += ARY_LEN(a);
     if (head < 0) {
       mrb_raise(mrb, E_INDEX_ERROR, "index is out of array");
     }
   }
-  if (a->len < len || a->len < head + len) {
-    len = a->len - head;
+  if (ARY_LEN(a) < len || ARY_LEN(a) < head + len) {
+    len = ARY_LEN(a) - head;
   }
   tail = head + len;
 
@@ -599,23 +670,23 @@ mrb_ary_splice(mrb_state *mrb, mrb_value ary, mrb_int head, mrb_int len, mrb_val
   }
   size = head + argc;
 
-  if (tail < a->len) size += a->len - tail;
-  if (size > a->aux.capa)
+  if (tail < ARY_LEN(a)) size += ARY_LEN(a) - tail;
+  if (size > ARY_CAPA(a))
     ary_expand_capa(mrb, a, size);
 
-  if (head > a->len) {
-    ary_fill_with_nil(a->ptr + a->len, head - a->len);
+  if (head > ARY_LEN(a)) {
+    ary_fill_with_nil(ARY_PTR(a) + ARY_LEN(a), head - ARY_LEN(a));
   }
-  else if (head < a->len) {
-    value_move(a->ptr + head + argc, a->ptr + tail, a->len - tail);
+  else if (head < ARY_LEN(a)) {
+    value_move(ARY_PTR(a) + head + argc, ARY_PTR(a) + tail, ARY_LEN(a) - tail);
   }
 
   for (i = 0; i < argc; i++) {
-    *(a->ptr + head + i) = *(argv + i);
+    *(ARY_PTR(a) + head + i) = *(argv + i);
     mrb_field_write_barrier_value(mrb, (struct RBasic*)a, argv[i]);
   }
 
-  a->len = size;
+  ARY_SET_LEN(a, size);
 
   return ary;
 }
@@ -635,12 +706,17 @@ ary_subseq(mrb_state *mrb, struct RArray *a, mrb_int beg, mrb_int len)
 {
   struct RArray *b;
 
+  /* small slices (and slices of embedded arrays) are cheaper to copy
+     than to convert the source to the shared representation */
+  if (len <= MRB_ARY_EMBED_LEN_MAX || ARY_EMBED_P(a)) {
+    return mrb_ary_new_from_values(mrb, len, ARY_PTR(a)+beg);
+  }
   ary_make_shared(mrb, a);
   b  = (struct RArray*)mrb_obj_alloc(mrb, MRB_TT_ARRAY, mrb->array_class);
-  b->ptr = a->ptr + beg;
-  b->len = len;
-  b->aux.shared = a->aux.shared;
-  b->aux.shared->refcnt++;
+  b->as.heap.ptr = a->as.heap.ptr + beg;
+  b->as.heap.len = len;
+  b->as.heap.aux.shared = a->as.heap.aux.shared;
+  b->as.heap.aux.shared->refcnt++;
   ARY_SET_SHARED_FLAG(b);
 
   return mrb_obj_value(b);
@@ -697,12 +773,13 @@ mrb_ary_aget(mrb_state *mrb, mrb_value self)
   struct RArray *a = mrb_ary_ptr(self);
   mrb_int i, len;
   mrb_value index;
+  static mrb_arg_spec args_spec;
 
-  if (mrb_get_args(mrb, "o|i", &index, &len) == 1) {
+  if (mrb_get_args_spec(mrb, &args_spec, "o|i", &index, &len) == 1) {
     switch (mrb_type(index)) {
       /* a[n..m] */
     case MRB_TT_RANGE:
-      if (mrb_range_beg_len(mrb, index, &i, &len, a->len)) {
+      if (mrb_range_beg_len(mrb, index, &i, &len, ARY_LEN(a))) {
         return ary_subseq(mrb, a, i, len);
       }
       else {
@@ -716,11 +793,11 @@ mrb_ary_aget(mrb_state *mrb, mrb_value self)
   }
 
   i = aget_index(mrb, index);
-  if (i < 0) i += a->len;
-  if (i < 0 || a->len < i) return mrb_nil_value();
+  if (i < 0) i += ARY_LEN(a);
+  if (i < 0 || ARY_LEN(a) < i) return mrb_nil_value();
   if (len < 0) return mrb_nil_value();
-  if (a->len == i) return mrb_ary_new(mrb);
-  if (len > a->len - i) len = a->len - i;
+  if (ARY_LEN(a) == i) return mrb_ary_new(mrb);
+  if (len > ARY_LEN(a) - i) len = ARY_LEN(a) - i;
 
   return ary_subseq(mrb, a, i, len);
 }
@@ -765,8 +842,9 @@ mrb_ary_aset(mrb_state *mrb, mrb_value self)
 {
   mrb_value v1, v2, v3;
   mrb_int i, len;
+  static mrb_arg_spec args_spec;
 
-  if (mrb_get_args(mrb, "oo|o", &v1, &v2, &v3) == 2) {
+  if (mrb_get_args_spec(mrb, &args_spec, "oo|o", &v1, &v2, &v3) == 2) {
     switch (mrb_type(v1)) {
     /* a[n..m] = v */
     case MRB_TT_RANGE:
@@ -800,19 +878,20 @@ mrb_ary_delete_at(mrb_state *mrb, mrb_value self)
   mrb_int len;
 
   mrb_get_args(mrb, "i", &index);
-  if (index < 0) index += a->len;
-  if (index < 0 || a->len <= index) return mrb_nil_value();
+  if (index < 0) index += ARY_LEN(a);
+  if (index < 0 || ARY_LEN(a) <= index) return mrb_nil_value();
 
   ary_modify(mrb, a);
-  val = a->ptr[index];
+  ptr = ARY_PTR(a);
+  val = ptr[index];
 
-  ptr = a->ptr + index;
-  len = a->len - index;
+  ptr += index;
+  len = ARY_LEN(a) - index;
   while (--len) {
     *ptr = *(ptr+1);
     ++ptr;
   }
-  --a->len;
+  ARY_SET_LEN(a, ARY_LEN(a)-1);
 
   ary_shrink_capa(mrb, a);
 
@@ -826,17 +905,17 @@ mrb_ary_first(mrb_state *mrb, mrb_value self)
   mrb_int size;
 
   if (mrb_get_args(mrb, "|i", &size) == 0) {
-    return (a->len > 0)? a->ptr[0]: mrb_nil_value();
+    return (ARY_LEN(a) > 0)? ARY_PTR(a)[0]: mrb_nil_value();
   }
   if (size < 0) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
   }
 
-  if (size > a->len) size = a->len;
-  if (ARY_SHARED_P(a)) {
+  if (size > ARY_LEN(a)) size = ARY_LEN(a);
+  if (ARY_SHARED_P(a) || size > ARY_DEFAULT_LEN) {
     return ary_subseq(mrb, a, 0, size);
   }
-  return mrb_ary_new_from_values(mrb, size, a->ptr);
+  return mrb_ary_new_from_values(mrb, size, ARY_PTR(a));
 }
 
 static mrb_value
@@ -846,16 +925,16 @@ mrb_ary_last(mrb_state *mrb, mrb_value self)
   mrb_int size;
 
   if (mrb_get_args(mrb, "|i", &size) == 0)
-    return (a->len > 0)? a->ptr[a->len - 1]: mrb_nil_value();
+    return (ARY_LEN(a) > 0)? ARY_PTR(a)[ARY_LEN(a) - 1]: mrb_nil_value();
 
   if (size < 0) {
     mrb_raise(mrb, E_ARGUMENT_ERROR, "negative array size");
   }
-  if (size > a->len) size = a->len;
+  if (size > ARY_LEN(a)) size = ARY_LEN(a);
   if (ARY_SHARED_P(a) || size > ARY_DEFAULT_LEN) {
-    return ary_subseq(mrb, a, a->len - size, size);
+    return ary_subseq(mrb, a, ARY_LEN(a) - size, size);
   }
-  return mrb_ary_new_from_values(mrb, size, a->ptr + a->len - size);
+  return mrb_ary_new_from_values(mrb, size, ARY_PTR(a) + ARY_LEN(a) - size);
 }
 
 static mrb_value
@@ -894,7 +973,7 @@ mrb_ary_splat(mrb_state *mrb, mrb_value v)
   if (mrb_array_p(v)) {
     return v;
   }
-  if (mrb_respond_to(mrb, v, mrb_intern_lit(mrb, "to_a"))) {
+  if (mrb_respond_to(mrb, v, MRB_SYM(to_a))) {
     return mrb_funcall(mrb, v, "to_a", 0);
   }
   else {
@@ -907,7 +986,7 @@ mrb_ary_size(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  return mrb_fixnum_value(a->len);
+  return mrb_fixnum_value(ARY_LEN(a));
 }
 
 MRB_API mrb_value
@@ -916,15 +995,15 @@ mrb_ary_clear(mrb_state *mrb, mrb_value self)
   struct RArray *a = mrb_ary_ptr(self);
 
   if (ARY_SHARED_P(a)) {
-    mrb_ary_decref(mrb, a->aux.shared);
+    mrb_ary_decref(mrb, a->as.heap.aux.shared);
     ARY_UNSET_SHARED_FLAG(a);
   }
-  else {
-    mrb_free(mrb, a->ptr);
+  else if (!ARY_EMBED_P(a)) {
+    mrb_free(mrb, a->as.heap.ptr);
   }
-  a->len = 0;
-  a->aux.capa = 0;
-  a->ptr = 0;
+  /* an empty array fits in the cell again */
+  a->flags |= MRB_ARY_EMBED;
+  ARY_SET_EMBED_LEN(a, 0);
 
   return self;
 }
@@ -934,7 +1013,7 @@ mrb_ary_empty_p(mrb_state *mrb, mrb_value self)
 {
   struct RArray *a = mrb_ary_ptr(self);
 
-  return mrb_bool_value(a->len == 0);
+  return mrb_bool_value(ARY_LEN(a) == 0);
 }
 
 MRB_API mrb_value
@@ -1034,6 +1113,216 @@ mrb_ary_join_m(mrb_state *mrb, mrb_value ary)
   return mrb_ary_join(mrb, ary, sep);
 }
 
+/* native Array#sort: introsort (quicksort switching to heapsort when
+   partitioning degenerates, insertion sort for small runs) over the
+   value buffer, with dispatch-free comparators when every element is
+   Fixnum, numeric, or String */
+
+struct sort_ctx {
+  mrb_state *mrb;
+  mrb_value blk;                /* nil unless a block was given */
+  int ai;                       /* arena index to restore after dispatch */
+};
+
+typedef int (*sort_cmp_func)(struct sort_ctx*, mrb_value, mrb_value);
+
+static int
+sort_cmp_fixnum(struct sort_ctx *c, mrb_value a, mrb_value b)
+{
+  mrb_int x = mrb_fixnum(a), y = mrb_fixnum(b);
+
+  return (x > y) - (x < y);
+}
+
+static int
+sort_cmp_float(struct sort_ctx *c, mrb_value a, mrb_value b)
+{
+  mrb_float x = mrb_fixnum_p(a) ? (mrb_float)mrb_fixnum(a) : mrb_float(a);
+  mrb_float y = mrb_fixnum_p(b) ? (mrb_float)mrb_fixnum(b) : mrb_float(b);
+
+  return (x > y) - (x < y);
+}
+
+static int
+sort_cmp_string(struct sort_ctx *c, mrb_value a, mrb_value b)
+{
+  return mrb_str_cmp(c->mrb, a, b);
+}
+
+static int
+sort_cmp_generic(struct sort_ctx *c, mrb_value a, mrb_value b)
+{
+  mrb_state *mrb = c->mrb;
+  mrb_value r;
+  int n;
+
+  if (mrb_nil_p(c->blk)) {
+    r = mrb_funcall(mrb, a, "<=>", 1, b);
+  }
+  else {
+    mrb_value args[2];
+
+    args[0] = a;
+    args[1] = b;
+    r = mrb_yield_argv(mrb, c->blk, 2, args);
+  }
+  if (mrb_fixnum_p(r)) {
+    n = (mrb_fixnum(r) > 0) - (mrb_fixnum(r) < 0);
+  }
+  else if (mrb_float_p(r)) {
+    n = (mrb_float(r) > 0) - (mrb_float(r) < 0);
+  }
+  else {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "comparison failed");
+  }
+  mrb_gc_arena_restore(mrb, c->ai);
+  return n;
+}
+
+static void
+sort_insertion(struct sort_ctx *c, sort_cmp_func cmp, mrb_value *p, mrb_int len)
+{
+  mrb_int i, j;
+
+  for (i = 1; i < len; i++) {
+    mrb_value v = p[i];
+
+    for (j = i; j > 0 && cmp(c, p[j-1], v) > 0; j--) {
+      p[j] = p[j-1];
+    }
+    p[j] = v;
+  }
+}
+
+static void
+sort_sift_down(struct sort_ctx *c, sort_cmp_func cmp, mrb_value *p, mrb_int root, mrb_int len)
+{
+  mrb_value v = p[root];
+
+  for (;;) {
+    mrb_int child = root*2 + 1;
+
+    if (child >= len) break;
+    if (child+1 < len && cmp(c, p[child], p[child+1]) < 0) child++;
+    if (cmp(c, v, p[child]) >= 0) break;
+    p[root] = p[child];
+    root = child;
+  }
+  p[root] = v;
+}
+
+static void
+sort_heap(struct sort_ctx *c, sort_cmp_func cmp, mrb_value *p, mrb_int len)
+{
+  mrb_int i;
+
+  for (i = len/2 - 1; i >= 0; i--) {
+    sort_sift_down(c, cmp, p, i, len);
+  }
+  for (i = len-1; i > 0; i--) {
+    mrb_value tmp = p[0];
+
+    p[0] = p[i];
+    p[i] = tmp;
+    sort_sift_down(c, cmp, p, 0, i);
+  }
+}
+
+#define SORT_INSERTION_MAX 16
+
+static void
+sort_intro(struct sort_ctx *c, sort_cmp_func cmp, mrb_value *p, mrb_int len, int depth)
+{
+  while (len > SORT_INSERTION_MAX) {
+    mrb_value pivot, tmp;
+    mrb_int i, j, mid;
+
+    if (depth-- == 0) {
+      /* partitioning degenerated; heapsort keeps the O(n log n) bound */
+      sort_heap(c, cmp, p, len);
+      return;
+    }
+    /* median of first/middle/last as pivot */
+    mid = len/2;
+    if (cmp(c, p[0], p[mid]) > 0) { tmp = p[0]; p[0] = p[mid]; p[mid] = tmp; }
+    if (cmp(c, p[mid], p[len-1]) > 0) {
+      tmp = p[mid]; p[mid] = p[len-1]; p[len-1] = tmp;
+      if (cmp(c, p[0], p[mid]) > 0) { tmp = p[0]; p[0] = p[mid]; p[mid] = tmp; }
+    }
+    pivot = p[mid];
+    i = 0;
+    j = len-1;
+    for (;;) {
+      /* bounds guards keep an inconsistent user comparator in range */
+      while (i < len-1 && cmp(c, p[i], pivot) < 0) i++;
+      while (j > 0 && cmp(c, pivot, p[j]) < 0) j--;
+      if (i >= j) break;
+      tmp = p[i]; p[i] = p[j]; p[j] = tmp;
+      i++;
+      j--;
+    }
+    /* recurse into the smaller side, iterate on the larger */
+    if (j+1 <= len-(j+1)) {
+      sort_intro(c, cmp, p, j+1, depth);
+      p += j+1;
+      len -= j+1;
+    }
+    else {
+      sort_intro(c, cmp, p+j+1, len-(j+1), depth);
+      len = j+1;
+    }
+  }
+  sort_insertion(c, cmp, p, len);
+}
+
+static mrb_value
+mrb_ary_sort_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_value blk, result;
+  mrb_value *p;
+  mrb_int i, len;
+  struct sort_ctx c;
+  sort_cmp_func cmp;
+  int depth;
+
+  mrb_get_args(mrb, "&", &blk);
+  len = RARRAY_LEN(self);
+  result = mrb_ary_new_from_values(mrb, len, RARRAY_PTR(self));
+  if (len <= 1) return result;
+
+  c.mrb = mrb;
+  c.blk = blk;
+  c.ai = mrb_gc_arena_save(mrb);
+  p = ARY_PTR(mrb_ary_ptr(result));
+
+  if (!mrb_nil_p(blk)) {
+    cmp = sort_cmp_generic;
+  }
+  else {
+    mrb_bool all_fixnum = TRUE, all_num = TRUE, all_str = TRUE;
+
+    for (i = 0; i < len; i++) {
+      switch (mrb_type(p[i])) {
+      case MRB_TT_FIXNUM: all_str = FALSE; break;
+      case MRB_TT_FLOAT:  all_fixnum = all_str = FALSE; break;
+      case MRB_TT_STRING: all_fixnum = all_num = FALSE; break;
+      default:            all_fixnum = all_num = all_str = FALSE; break;
+      }
+      if (!all_num && !all_str) break;
+    }
+    if (all_fixnum)    cmp = sort_cmp_fixnum;
+    else if (all_num)  cmp = sort_cmp_float;
+    else if (all_str)  cmp = sort_cmp_string;
+    else               cmp = sort_cmp_generic;
+  }
+
+  /* depth budget of 2*log2(len) quicksort levels before heapsort */
+  for (depth = 0, i = len; i > 0; i >>= 1) depth += 2;
+  sort_intro(&c, cmp, p, len, depth);
+
+  return result;
+}
+
 static mrb_value
 mrb_ary_eq(mrb_state *mrb, mrb_value ary1)
 {
@@ -1063,6 +1352,23 @@ mrb_ary_cmp(mrb_state *mrb, mrb_value ary1)
   return ary2;
 }
 
+MRB_API int
+mrb_ary_foreach(mrb_state *mrb, mrb_value ary, mrb_foreach_func func, void *data)
+{
+  mrb_int i;
+  int ai = mrb_gc_arena_save(mrb);
+  int ret;
+
+  /* length and pointer are re-read every pass: the callback may mutate
+     the array (matching what mrblib's index-based loops observe) */
+  for (i = 0; i < RARRAY_LEN(ary); i++) {
+    ret = func(mrb, RARRAY_PTR(ary)[i], data);
+    if (ret) return ret;  /* keep the stopping callback's values in the arena */
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return 0;
+}
+
 void
 mrb_init_array(mrb_state *mrb)
 {
@@ -1097,6 +1403,7 @@ mrb_init_array(mrb_state *mrb)
   mrb_define_method(mrb, a, "shift",           mrb_ary_shift,        MRB_ARGS_NONE()); /* 15.2.12.5.27 */
   mrb_define_method(mrb, a, "size",            mrb_ary_size,         MRB_ARGS_NONE()); /* 15.2.12.5.28 */
   mrb_define_method(mrb, a, "slice",           mrb_ary_aget,         MRB_ARGS_ANY());  /* 15.2.12.5.29 */
+  mrb_define_method(mrb, a, "sort",            mrb_ary_sort_m,       MRB_ARGS_NONE()); /* replaces Enumerable#sort */
   mrb_define_method(mrb, a, "unshift",         mrb_ary_unshift_m,    MRB_ARGS_ANY());  /* 15.2.12.5.30 */
 
   mrb_define_method(mrb, a, "__ary_eq",        mrb_ary_eq,           MRB_ARGS_REQ(1));
@@ -16,8 +16,8 @@
 
 struct backtrace_location_raw {
   int i;
-  int lineno;
-  const char *filename;
+  mrb_irep *irep;
+  uint32_t pc_off;
   mrb_sym method_id;
   char sep;
   struct RClass *klass;
@@ -103,7 +103,7 @@ each_backtrace(mrb_state *mrb, mrb_int ciidx, mrb_code *pc0, each_backtrace_func
 {
   int i;
 
-  if (ciidx >= mrb->c->ciend - mrb->c->cibase)
+  if (ciidx >= mrb->c->cisegs * MRB_CALLINFO_SEG_SIZE)
     ciidx = 10; /* ciidx is broken... */
 
   for (i = ciidx; i >= 0; i--) {
@@ -112,26 +112,24 @@ each_backtrace(mrb_state *mrb, mrb_int ciidx, mrb_code *pc0, each_backtrace_func
     mrb_irep *irep;
     mrb_code *pc;
 
-    ci = &mrb->c->cibase[i];
+    ci = mrb_ci_at(mrb->c, i);
 
     if (!ci->proc) continue;
     if (MRB_PROC_CFUNC_P(ci->proc)) continue;
 
     irep = ci->proc->body.irep;
 
-    if (mrb->c->cibase[i].err) {
-      pc = mrb->c->cibase[i].err;
+    if (ci->err) {
+      pc = ci->err;
     }
     else if (i+1 <= ciidx) {
-      pc = mrb->c->cibase[i+1].pc - 1;
+      pc = mrb_ci_at(mrb->c, i+1)->pc - 1;
     }
     else {
       pc = pc0;
     }
-    loc.filename = mrb_debug_get_filename(irep, (uint32_t)(pc - irep->iseq));
-    loc.lineno = mrb_debug_get_line(irep, (uint32_t)(pc - irep->iseq));
-
-    if (loc.lineno == -1) continue;
+    loc.irep = irep;
+    loc.pc_off = (uint32_t)(pc - irep->iseq);
 
     if (ci->target_class == ci->proc->target_class) {
       loc.sep = '.';
@@ -140,10 +138,6 @@ each_backtrace(mrb_state *mrb, mrb_int ciidx, mrb_code *pc0, each_backtrace_func
       loc.sep = '#';
     }
 
-    if (!loc.filename) {
-      loc.filename = "(unknown)";
-    }
-
     loc.method_id = ci->mid;
     loc.klass = ci->proc->target_class;
     loc.i = i;
@@ -156,15 +150,33 @@ struct output_backtrace_args {
   void *data;
 };
 
+/* decode file and line out of the irep's debug info; returns FALSE for
+   frames with no line information, which the output skips */
+static mrb_bool
+resolve_location(mrb_state *mrb, mrb_irep *irep, uint32_t pc_off,
+                 const char **filename, int *lineno)
+{
+  mrb_debug_info_materialize(mrb, irep);
+  *filename = mrb_debug_get_filename(irep, pc_off);
+  *lineno = mrb_debug_get_line(irep, pc_off);
+
+  if (*lineno == -1) return FALSE;
+  if (!*filename) {
+    *filename = "(unknown)";
+  }
+  return TRUE;
+}
+
 static void
 output_backtrace_i(mrb_state *mrb, struct backtrace_location_raw *loc_raw, void *data)
 {
   struct backtrace_location loc;
   struct output_backtrace_args *args = data;
 
+  if (!resolve_location(mrb, loc_raw->irep, loc_raw->pc_off, &loc.filename, &loc.lineno)) {
+    return;
+  }
   loc.i          = loc_raw->i;
-  loc.lineno     = loc_raw->lineno;
-  loc.filename   = loc_raw->filename;
   loc.method     = mrb_sym2name(mrb, loc_raw->method_id);
   loc.sep        = loc_raw->sep;
   loc.class_name = mrb_class_name(mrb, loc_raw->klass);
@@ -187,14 +199,14 @@ exc_output_backtrace(mrb_state *mrb, struct RObject *exc, output_stream_func fun
   mrb_value lastpc;
   mrb_code *code;
 
-  lastpc = mrb_obj_iv_get(mrb, exc, mrb_intern_lit(mrb, "lastpc"));
+  lastpc = mrb_obj_iv_get(mrb, exc, MRB_SYM(lastpc));
   if (mrb_nil_p(lastpc)) {
     code = NULL;
   } else {
     code = (mrb_code*)mrb_cptr(lastpc);
   }
 
-  output_backtrace(mrb, mrb_fixnum(mrb_obj_iv_get(mrb, exc, mrb_intern_lit(mrb, "ciidx"))),
+  output_backtrace(mrb, mrb_fixnum(mrb_obj_iv_get(mrb, exc, MRB_SYM(ciidx))),
                    code, func, stream);
 }
 
@@ -232,9 +244,14 @@ print_backtrace_saved(mrb_state *mrb)
   fprintf(stream, "trace:\n");
   for (i = 0; i < mrb->backtrace.n; i++) {
     mrb_backtrace_entry *entry;
+    const char *filename;
+    int lineno;
 
     entry = &(mrb->backtrace.entries[i]);
-    fprintf(stream, "\t[%d] %s:%d", i, entry->filename, entry->lineno);
+    if (!resolve_location(mrb, entry->irep, entry->pc_off, &filename, &lineno)) {
+      continue;
+    }
+    fprintf(stream, "\t[%d] %s:%d", i, filename, lineno);
 
     if (entry->method_id != 0) {
       const char *method_name;
@@ -264,7 +281,7 @@ mrb_print_backtrace(mrb_state *mrb)
     return;
   }
 
-  backtrace = mrb_obj_iv_get(mrb, mrb->exc, mrb_intern_lit(mrb, "backtrace"));
+  backtrace = mrb_obj_iv_get(mrb, mrb->exc, MRB_SYM(backtrace));
   if (!mrb_nil_p(backtrace)) {
     print_backtrace(mrb, backtrace);
   }
@@ -305,7 +322,7 @@ mrb_get_backtrace(mrb_state *mrb)
   mrb_value ary;
   mrb_callinfo *ci = mrb->c->ci;
   mrb_code *pc = ci->pc;
-  mrb_int ciidx = (mrb_int)(ci - mrb->c->cibase - 1);
+  mrb_int ciidx = (mrb_int)(ci->ciidx - 1);
 
   if (ciidx < 0) ciidx = 0;
   ary = mrb_ary_new(mrb);
@@ -314,11 +331,24 @@ mrb_get_backtrace(mrb_state *mrb)
   return ary;
 }
 
+/* drop the raw snapshot, releasing the irep references it held; the
+   entry buffer itself is kept for the next raise */
 void
-mrb_free_backtrace(mrb_state *mrb)
+mrb_clear_backtrace(mrb_state *mrb)
 {
-  mrb->backtrace.exc = 0;
+  int i;
+
+  for (i = 0; i < mrb->backtrace.n; i++) {
+    mrb_irep_decref(mrb, mrb->backtrace.entries[i].irep);
+  }
   mrb->backtrace.n = 0;
+  mrb->backtrace.exc = 0;
+}
+
+void
+mrb_free_backtrace(mrb_state *mrb)
+{
+  mrb_clear_backtrace(mrb);
   mrb->backtrace.n_allocated = 0;
   mrb_free(mrb, mrb->backtrace.entries);
 }
@@ -346,11 +376,12 @@ save_backtrace_i(mrb_state *mrb,
   }
 
   entry = &mrb->backtrace.entries[mrb->backtrace.n];
-  entry->filename  = loc_raw->filename;
-  entry->lineno    = loc_raw->lineno;
+  entry->irep      = loc_raw->irep;
+  entry->pc_off    = loc_raw->pc_off;
   entry->klass     = loc_raw->klass;
   entry->sep       = loc_raw->sep;
   entry->method_id = loc_raw->method_id;
+  mrb_irep_incref(mrb, entry->irep);
 
   mrb->backtrace.n++;
 }
@@ -362,15 +393,14 @@ mrb_save_backtrace(mrb_state *mrb)
   mrb_code *code;
   mrb_int ciidx;
 
-  mrb->backtrace.n = 0;
-  mrb->backtrace.exc = 0;
+  mrb_clear_backtrace(mrb);
 
   if (!mrb->exc)
     return;
 
   mrb->backtrace.exc = mrb->exc;
 
-  lastpc = mrb_obj_iv_get(mrb, mrb->exc, mrb_intern_lit(mrb, "lastpc"));
+  lastpc = mrb_obj_iv_get(mrb, mrb->exc, MRB_SYM(lastpc));
   if (mrb_nil_p(lastpc)) {
     code = NULL;
   }
@@ -378,7 +408,7 @@ mrb_save_backtrace(mrb_state *mrb)
     code = (mrb_code*)mrb_cptr(lastpc);
   }
 
-  ciidx = mrb_fixnum(mrb_obj_iv_get(mrb, mrb->exc, mrb_intern_lit(mrb, "ciidx")));
+  ciidx = mrb_fixnum(mrb_obj_iv_get(mrb, mrb->exc, MRB_SYM(ciidx)));
 
   each_backtrace(mrb, ciidx, code, save_backtrace_i, NULL);
 }
@@ -394,15 +424,21 @@ mrb_restore_backtrace(mrb_state *mrb)
     int ai;
     mrb_backtrace_entry *entry;
     mrb_value mrb_entry;
+    const char *filename;
+    int lineno;
 
     ai = mrb_gc_arena_save(mrb);
     entry = &(mrb->backtrace.entries[i]);
+    if (!resolve_location(mrb, entry->irep, entry->pc_off, &filename, &lineno)) {
+      mrb_gc_arena_restore(mrb, ai);
+      continue;
+    }
 
-    mrb_entry = mrb_str_new_cstr(mrb, entry->filename);
+    mrb_entry = mrb_str_new_cstr(mrb, filename);
     mrb_str_cat_lit(mrb, mrb_entry, ":");
     mrb_str_concat(mrb, mrb_entry,
                    mrb_fixnum_to_str(mrb,
-                                     mrb_fixnum_value(entry->lineno),
+                                     mrb_fixnum_value(lineno),
                                      10));
     if (entry->method_id != 0) {
       mrb_str_cat_lit(mrb, mrb_entry, ":in ");
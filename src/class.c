@@ -43,6 +43,21 @@ mrb_gc_mark_mt_size(mrb_state *mrb, struct RClass *c)
   return kh_size(h);
 }
 
+/* heap bytes held by the method table: one metadata byte, key and
+   value per bucket, doubled while an incremental rehash is draining */
+size_t
+mrb_gc_mt_memsize(mrb_state *mrb, struct RClass *c)
+{
+  khash_t(mt) *h = c->mt;
+  size_t len = 1 + sizeof(mrb_sym) + sizeof(struct RProc*);
+  size_t bytes;
+
+  if (!h) return 0;
+  bytes = sizeof(khash_t(mt)) + len*h->n_buckets;
+  if (h->old_n_buckets) bytes += len*h->old_n_buckets;
+  return bytes;
+}
+
 void
 mrb_gc_free_mt(mrb_state *mrb, struct RClass *c)
 {
@@ -53,7 +68,7 @@ static void
 name_class(mrb_state *mrb, struct RClass *c, mrb_sym name)
 {
   mrb_obj_iv_set(mrb, (struct RObject*)c,
-                 mrb_intern_lit(mrb, "__classid__"), mrb_symbol_value(name));
+                 MRB_SYM(__classid__), mrb_symbol_value(name));
 }
 
 static void
@@ -62,7 +77,7 @@ setup_class(mrb_state *mrb, struct RClass *outer, struct RClass *c, mrb_sym id)
   name_class(mrb, c, id);
   mrb_obj_iv_set(mrb, (struct RObject*)outer, id, mrb_obj_value(c));
   if (outer != mrb->object_class) {
-    mrb_obj_iv_set(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__outer__"),
+    mrb_obj_iv_set(mrb, (struct RObject*)c, MRB_SYM(__outer__),
                    mrb_obj_value(outer));
   }
 }
@@ -100,7 +115,7 @@ prepare_singleton_class(mrb_state *mrb, struct RBasic *o)
   o->c = sc;
   mrb_field_write_barrier(mrb, (struct RBasic*)o, (struct RBasic*)sc);
   mrb_field_write_barrier(mrb, (struct RBasic*)sc, (struct RBasic*)o);
-  mrb_obj_iv_set(mrb, (struct RObject*)sc, mrb_intern_lit(mrb, "__attached__"), mrb_obj_value(o));
+  mrb_obj_iv_set(mrb, (struct RObject*)sc, MRB_SYM(__attached__), mrb_obj_value(o));
 }
 
 static struct RClass *
@@ -126,7 +141,7 @@ mrb_class_outer_module(mrb_state *mrb, struct RClass *c)
 {
   mrb_value outer;
 
-  outer = mrb_obj_iv_get(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__outer__"));
+  outer = mrb_obj_iv_get(mrb, (struct RObject*)c, MRB_SYM(__outer__));
   if (mrb_nil_p(outer)) return NULL;
   return mrb_class_ptr(outer);
 }
@@ -328,6 +343,25 @@ mrb_define_class_under(mrb_state *mrb, struct RClass *outer, const char *name, s
   return c;
 }
 
+/* invalidate every inline method cache; called whenever a method
+   table or a superclass chain is modified, and when a class is freed */
+void
+mrb_method_cache_clear(mrb_state *mrb)
+{
+  mrb->cache_gen++;
+}
+
+/* invalidate every per-site constant cache; called whenever a constant
+   table is modified, when an ancestry constants resolve through changes
+   (module inclusion), and when a class is freed.  Kept separate from
+   the method generation so defining methods at runtime does not flush
+   resolved constants. */
+void
+mrb_const_cache_clear(mrb_state *mrb)
+{
+  mrb->const_gen++;
+}
+
 MRB_API void
 mrb_define_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, struct RProc *p)
 {
@@ -336,6 +370,7 @@ mrb_define_method_raw(mrb_state *mrb, struct RClass *c, mrb_sym mid, struct RPro
   MRB_CLASS_ORIGIN(c);
   h = c->mt;
 
+  mrb_method_cache_clear(mrb);
   if (!h) h = c->mt = kh_init(mt, mrb);
   k = kh_put(mt, mrb, h, mid);
   kh_value(h, k) = p;
@@ -463,32 +498,84 @@ to_sym(mrb_state *mrb, mrb_value ss)
     |:      optional                              Next argument of '|' and later are optional.
     ?:      optional given [mrb_bool]             true if preceding argument (optional) is given.
  */
-MRB_API mrb_int
-mrb_get_args(mrb_state *mrb, const char *format, ...)
+#define ARGSPEC_NILOK 0x80
+
+/* parse an argument format string once into its compiled form */
+static void
+arg_spec_compile(mrb_state *mrb, mrb_arg_spec *spec, mrb_args_format format)
 {
+  const char *p = format;
   char c;
+  mrb_bool opt = FALSE;
+
+  spec->nreq = spec->nopt = spec->nent = 0;
+  spec->rest = FALSE;
+  while ((c = *p++)) {
+    uint8_t e = (uint8_t)c;
+
+    switch (c) {
+    case 'S': case 'A': case 'H': case 's': case 'z': case 'a': case 'd':
+      if (*p == '!') {
+        e |= ARGSPEC_NILOK;
+        p++;
+      }
+      /* fall through */
+    case 'o': case 'C': case 'f': case 'i': case 'b': case 'n':
+      if (opt) spec->nopt++;
+      else spec->nreq++;
+      break;
+    case '|':
+      opt = TRUE;
+      break;
+    case '*':
+      spec->rest = TRUE;
+      break;
+    case '&': case '?':
+      break;
+    default:
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid argument specifier %S", mrb_str_new(mrb, &c, 1));
+      break;
+    }
+    if (spec->nent >= MRB_ARG_SPEC_MAX) {
+      mrb_raise(mrb, E_ARGUMENT_ERROR, "argument specification too long");
+    }
+    spec->ent[spec->nent++] = e;
+  }
+  spec->format = format;
+}
+
+/* validate the argument count against the compiled arity, then scatter
+   the arguments with a tight loop over the compiled entries */
+static mrb_int
+get_args_spec(mrb_state *mrb, const mrb_arg_spec *spec, va_list ap)
+{
   int i = 0;
-  va_list ap;
   int argc = mrb->c->ci->argc;
   int arg_i = 0;
+  int ei;
   mrb_bool array_argv;
   mrb_bool opt = FALSE;
   mrb_bool given = TRUE;
 
-  va_start(ap, format);
   if (argc < 0) {
     struct RArray *a = mrb_ary_ptr(mrb->c->stack[1]);
 
-    argc = a->len;
+    argc = ARY_LEN(a);
     array_argv = TRUE;
   } else {
     array_argv = FALSE;
   }
+  if (argc < spec->nreq || (!spec->rest && argc > spec->nreq + spec->nopt)) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments");
+  }
 
 #define ARGV \
-  (array_argv ? mrb_ary_ptr(mrb->c->stack[1])->ptr : (mrb->c->stack + 1))
+  (array_argv ? ARY_PTR(mrb_ary_ptr(mrb->c->stack[1])) : (mrb->c->stack + 1))
+
+  for (ei = 0; ei < spec->nent; ei++) {
+    char c = (char)(spec->ent[ei] & ~ARGSPEC_NILOK);
+    mrb_bool nilok = (spec->ent[ei] & ARGSPEC_NILOK) != 0;
 
-  while ((c = *format++)) {
     switch (c) {
     case '|': case '*': case '&': case '?':
       break;
@@ -544,8 +631,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         mrb_value *p;
 
         p = va_arg(ap, mrb_value*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *p = ARGV[arg_i++];
             i++;
@@ -563,8 +649,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         mrb_value *p;
 
         p = va_arg(ap, mrb_value*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *p = ARGV[arg_i++];
             i++;
@@ -582,8 +667,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         mrb_value *p;
 
         p = va_arg(ap, mrb_value*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *p = ARGV[arg_i++];
             i++;
@@ -604,8 +688,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         ps = va_arg(ap, char**);
         pl = va_arg(ap, mrb_int*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *ps = NULL;
             *pl = 0;
@@ -627,8 +710,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         const char **ps;
 
         ps = va_arg(ap, const char**);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *ps = NULL;
             i++; arg_i++;
@@ -651,8 +733,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         pb = va_arg(ap, mrb_value**);
         pl = va_arg(ap, mrb_int*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *pb = 0;
             *pl = 0;
@@ -663,8 +744,8 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         if (i < argc) {
           aa = to_ary(mrb, ARGV[arg_i++]);
           a = mrb_ary_ptr(aa);
-          *pb = a->ptr;
-          *pl = a->len;
+          *pb = ARY_PTR(a);
+          *pl = ARY_LEN(a);
           i++;
         }
       }
@@ -745,8 +826,7 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
 
         datap = va_arg(ap, void**);
         type = va_arg(ap, struct mrb_data_type const*);
-        if (*format == '!') {
-          format++;
+        if (nilok) {
           if (i < argc && mrb_nil_p(ARGV[arg_i])) {
             *datap = 0;
             i++; arg_i++;
@@ -807,19 +887,41 @@ mrb_get_args(mrb_state *mrb, const char *format, ...)
         }
       }
       break;
-    default:
-      mrb_raisef(mrb, E_ARGUMENT_ERROR, "invalid argument specifier %S", mrb_str_new(mrb, &c, 1));
-      break;
     }
   }
 
 #undef ARGV
 
-  if (!c && argc > i) {
-    mrb_raise(mrb, E_ARGUMENT_ERROR, "wrong number of arguments");
+  return i;
+}
+
+MRB_API mrb_int
+mrb_get_args(mrb_state *mrb, mrb_args_format format, ...)
+{
+  mrb_arg_spec spec;
+  va_list ap;
+  mrb_int n;
+
+  arg_spec_compile(mrb, &spec, format);
+  va_start(ap, format);
+  n = get_args_spec(mrb, &spec, ap);
+  va_end(ap);
+  return n;
+}
+
+MRB_API mrb_int
+mrb_get_args_spec(mrb_state *mrb, mrb_arg_spec *spec, mrb_args_format format, ...)
+{
+  va_list ap;
+  mrb_int n;
+
+  if (spec->format != format) {
+    arg_spec_compile(mrb, spec, format);
   }
+  va_start(ap, format);
+  n = get_args_spec(mrb, spec, ap);
   va_end(ap);
-  return i;
+  return n;
 }
 
 static struct RClass*
@@ -902,6 +1004,9 @@ include_module_at(mrb_state *mrb, struct RClass *c, struct RClass *ins_pos, stru
   skip:
     m = m->super;
   }
+  mrb_method_cache_clear(mrb);
+  /* the module's constants are now visible through the ancestry */
+  mrb_const_cache_clear(mrb);
   return 0;
 }
 
@@ -1168,7 +1273,7 @@ mrb_singleton_class(mrb_state *mrb, mrb_value v)
   obj = mrb_basic_ptr(v);
   prepare_singleton_class(mrb, obj);
   if (mrb->c && mrb->c->ci && mrb->c->ci->target_class) {
-    mrb_obj_iv_set(mrb, (struct RObject*)obj->c, mrb_intern_lit(mrb, "__outer__"),
+    mrb_obj_iv_set(mrb, (struct RObject*)obj->c, MRB_SYM(__outer__),
                    mrb_obj_value(mrb->c->ci->target_class));
   }
   return mrb_obj_value(obj->c);
@@ -1200,6 +1305,13 @@ mrb_method_search_vm(mrb_state *mrb, struct RClass **cp, mrb_sym mid)
   khiter_t k;
   struct RProc *m;
   struct RClass *c = *cp;
+  struct mrb_method_cache_entry *mc;
+
+  mc = &mrb->method_cache[(((uintptr_t)c >> 3) ^ mid) & (MRB_METHOD_CACHE_SIZE - 1)];
+  if (mc->c == c && mc->mid == mid && mc->gen == mrb->cache_gen) {
+    *cp = mc->tc;
+    return mc->m;
+  }
 
   while (c) {
     khash_t(mt) *h = c->mt;
@@ -1209,6 +1321,11 @@ mrb_method_search_vm(mrb_state *mrb, struct RClass **cp, mrb_sym mid)
       if (k != kh_end(h)) {
         m = kh_value(h, k);
         if (!m) break;
+        mc->c = *cp;
+        mc->tc = c;
+        mc->mid = mid;
+        mc->m = m;
+        mc->gen = mrb->cache_gen;
         *cp = c;
         return m;
       }
@@ -1347,6 +1464,17 @@ mrb_instance_alloc(mrb_state *mrb, mrb_value cv)
  *
  */
 
+/* TRUE when c resolves #initialize to the BasicObject no-op, in which
+   case Class#new can skip the call; the lookup goes through the method
+   cache, so redefinition invalidates the answer via the cache serial */
+static mrb_bool
+default_init_p(mrb_state *mrb, struct RClass *c)
+{
+  struct RProc *m = mrb_method_search_vm(mrb, &c, MRB_SYM(initialize));
+
+  return m && MRB_PROC_CFUNC_P(m) && m->body.func == mrb_bob_init;
+}
+
 MRB_API mrb_value
 mrb_instance_new(mrb_state *mrb, mrb_value cv)
 {
@@ -1356,7 +1484,9 @@ mrb_instance_new(mrb_state *mrb, mrb_value cv)
 
   mrb_get_args(mrb, "*&", &argv, &argc, &blk);
   obj = mrb_instance_alloc(mrb, cv);
-  mrb_funcall_with_block(mrb, obj, mrb_intern_lit(mrb, "initialize"), argc, argv, blk);
+  if (!default_init_p(mrb, mrb_class_ptr(cv))) {
+    mrb_funcall_with_block(mrb, obj, MRB_SYM(initialize), argc, argv, blk);
+  }
 
   return obj;
 }
@@ -1367,7 +1497,9 @@ mrb_obj_new(mrb_state *mrb, struct RClass *c, mrb_int argc, const mrb_value *arg
   mrb_value obj;
 
   obj = mrb_instance_alloc(mrb, mrb_obj_value(c));
-  mrb_funcall_argv(mrb, obj, mrb_intern_lit(mrb, "initialize"), argc, argv);
+  if (!default_init_p(mrb, c)) {
+    mrb_funcall_argv(mrb, obj, MRB_SYM(initialize), argc, argv);
+  }
 
   return obj;
 }
@@ -1396,7 +1528,7 @@ mrb_class_new_class(mrb_state *mrb, mrb_value cv)
     super = mrb_obj_value(mrb->object_class);
   }
   new_class = mrb_obj_value(mrb_class_new(mrb, mrb_class_ptr(super)));
-  mrb_funcall_with_block(mrb, new_class, mrb_intern_lit(mrb, "initialize"), n, &super, blk);
+  mrb_funcall_with_block(mrb, new_class, MRB_SYM(initialize), n, &super, blk);
   mrb_class_inherited(mrb, mrb_class_ptr(super), mrb_class_ptr(new_class));
   return new_class;
 }
@@ -1415,7 +1547,9 @@ mrb_class_superclass(mrb_state *mrb, mrb_value klass)
   return mrb_obj_value(c);
 }
 
-static mrb_value
+/* non-static so the OP_SEND fast path for Class#new can recognize a
+   class whose #initialize is still this no-op */
+mrb_value
 mrb_bob_init(mrb_state *mrb, mrb_value cv)
 {
   return mrb_nil_value();
@@ -1433,12 +1567,12 @@ mrb_method_missing(mrb_state *mrb, mrb_sym name, mrb_value self, mrb_value args)
   mrb_sym inspect;
   mrb_value repr;
 
-  inspect = mrb_intern_lit(mrb, "inspect");
-  if (mrb->c->ci > mrb->c->cibase && mrb->c->ci[-1].mid == inspect) {
+  inspect = MRB_SYM(inspect);
+  if (mrb->c->ci->ciidx > 0 && mrb_ci_at(mrb->c, mrb->c->ci->ciidx-1)->mid == inspect) {
     /* method missing in inspect; avoid recursion */
     repr = mrb_any_to_s(mrb, self);
   }
-  else if (mrb_respond_to(mrb, self, inspect) && mrb->c->ci - mrb->c->cibase < 64) {
+  else if (mrb_respond_to(mrb, self, inspect) && mrb->c->ci->ciidx < 64) {
     repr = mrb_funcall_argv(mrb, self, inspect, 0, 0);
     if (mrb_string_p(repr) && RSTRING_LEN(repr) > 64) {
       repr = mrb_any_to_s(mrb, self);
@@ -1533,7 +1667,7 @@ mrb_class_path(mrb_state *mrb, struct RClass *c)
 {
   mrb_value path;
   const char *name;
-  mrb_sym classpath = mrb_intern_lit(mrb, "__classpath__");
+  mrb_sym classpath = MRB_SYM(__classpath__);
 
   path = mrb_obj_iv_get(mrb, (struct RObject*)c, classpath);
   if (mrb_nil_p(path)) {
@@ -1706,7 +1840,7 @@ mrb_mod_to_s(mrb_state *mrb, mrb_value klass)
   mrb_value str;
 
   if (mrb_type(klass) == MRB_TT_SCLASS) {
-    mrb_value v = mrb_iv_get(mrb, klass, mrb_intern_lit(mrb, "__attached__"));
+    mrb_value v = mrb_iv_get(mrb, klass, MRB_SYM(__attached__));
 
     str = mrb_str_new_lit(mrb, "#<Class:");
 
@@ -2013,6 +2147,7 @@ remove_method(mrb_state *mrb, mrb_value mod, mrb_sym mid)
     k = kh_get(mt, mrb, h, mid);
     if (k != kh_end(h)) {
       kh_del(mt, mrb, h, k);
+      mrb_method_cache_clear(mrb);
       mrb_funcall(mrb, mod, "method_removed", 1, mrb_symbol_value(mid));
       return;
     }
@@ -2111,6 +2246,7 @@ mrb_mod_remove_const(mrb_state *mrb, mrb_value mod)
 
   mrb_get_args(mrb, "n", &id);
   check_const_name_sym(mrb, id);
+  mrb_const_cache_clear(mrb);
   val = mrb_iv_remove(mrb, mod, id);
   if (mrb_undef_p(val)) {
     mrb_name_error(mrb, id, "constant %S not defined", mrb_sym2str(mrb, id));
@@ -2222,10 +2358,10 @@ mrb_init_class(mrb_state *mrb)
   mrb_define_const(mrb, obj, "Class",       mrb_obj_value(cls));
 
   /* name each classes */
-  name_class(mrb, bob, mrb_intern_lit(mrb, "BasicObject"));
-  name_class(mrb, obj, mrb_intern_lit(mrb, "Object"));           /* 15.2.1 */
-  name_class(mrb, mod, mrb_intern_lit(mrb, "Module"));           /* 15.2.2 */
-  name_class(mrb, cls, mrb_intern_lit(mrb, "Class"));            /* 15.2.3 */
+  name_class(mrb, bob, MRB_SYM(BasicObject));
+  name_class(mrb, obj, MRB_SYM(Object));           /* 15.2.1 */
+  name_class(mrb, mod, MRB_SYM(Module));           /* 15.2.2 */
+  name_class(mrb, cls, MRB_SYM(Class));            /* 15.2.3 */
 
   mrb->proc_class = mrb_define_class(mrb, "Proc", mrb->object_class);  /* 15.2.17 */
   MRB_SET_INSTANCE_TT(mrb->proc_class, MRB_TT_PROC);
@@ -1,6 +1,7 @@
 #include <mruby.h>
 #include <mruby/irep.h>
 #include <mruby/debug.h>
+#include <mruby/dump.h>
 #include <mruby/opcode.h>
 #include <mruby/string.h>
 #include <mruby/proc.h>
@@ -61,6 +62,7 @@ codedump(mrb_state *mrb, mrb_irep *irep)
   int32_t line;
 
   if (!irep) return;
+  mrb_debug_info_materialize(mrb, irep);
   printf("irep %p nregs=%d nlocals=%d pools=%d syms=%d reps=%d\n", (void*)irep,
          irep->nregs, irep->nlocals, (int)irep->plen, (int)irep->slen, (int)irep->rlen);
 
@@ -207,6 +209,30 @@ codedump(mrb_state *mrb, mrb_irep *irep)
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
              GETARG_C(c));
       break;
+    case OP_SENDC:
+      printf("OP_SENDC\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_SENDL:
+      printf("OP_SENDL\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_UPDIDX:
+      printf("OP_UPDIDX\tR%d\t:%s\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]));
+      break;
+    case OP_SELFSEND:
+      printf("OP_SELFSEND\tR%d\n", GETARG_A(c));
+      break;
+    case OP_MOVESEND:
+      printf("OP_MOVESEND\tR%d\tR%d\n", GETARG_A(c), GETARG_B(c));
+      break;
+    case OP_IVSEND:
+      printf("OP_IVSEND\tR%d\t%s\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_Bx(c)]));
+      break;
     case OP_TAILCALL:
       printf("OP_TAILCALL\tR%d\t:%s\t%d\n", GETARG_A(c),
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
@@ -326,10 +352,38 @@ codedump(mrb_state *mrb, mrb_irep *irep)
              mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
              GETARG_C(c));
       break;
+    case OP_JMPLT:
+      printf("OP_JMPLT\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_JMPLE:
+      printf("OP_JMPLE\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_JMPGT:
+      printf("OP_JMPGT\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_JMPGE:
+      printf("OP_JMPGE\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
+    case OP_JMPEQ:
+      printf("OP_JMPEQ\tR%d\t:%s\t%d\n", GETARG_A(c),
+             mrb_sym2name(mrb, irep->syms[GETARG_B(c)]),
+             GETARG_C(c));
+      break;
 
     case OP_STOP:
       printf("OP_STOP\n");
       break;
+    case OP_TRAP:
+      printf("OP_TRAP\t%d\n", GETARG_Ax(c));
+      break;
 
     case OP_ARRAY:
       printf("OP_ARRAY\tR%d\tR%d\t%d", GETARG_A(c), GETARG_B(c), GETARG_C(c));
@@ -359,6 +413,14 @@ codedump(mrb_state *mrb, mrb_irep *irep)
       }
       print_lv(mrb, irep, c, RA);
       break;
+    case OP_FROZSTR:
+      {
+        mrb_value v = irep->pool[GETARG_Bx(c)];
+        mrb_value s = mrb_str_dump(mrb, mrb_str_new(mrb, RSTRING_PTR(v), RSTRING_LEN(v)));
+        printf("OP_FROZSTR\tR%d\tL(%d)\t; %s", GETARG_A(c), GETARG_Bx(c), RSTRING_PTR(s));
+      }
+      print_lv(mrb, irep, c, RA);
+      break;
     case OP_STRCAT:
       printf("OP_STRCAT\tR%d\tR%d\t", GETARG_A(c), GETARG_B(c));
       print_lv(mrb, irep, c, RAB);
@@ -441,7 +503,9 @@ codedump_recur(mrb_state *mrb, mrb_irep *irep)
 
   codedump(mrb, irep);
   for (i=0; i<irep->rlen; i++) {
-    codedump_recur(mrb, irep->reps[i]);
+    if (irep->reps[i]) {
+      codedump_recur(mrb, irep->reps[i]);
+    }
   }
 }
 
@@ -450,3 +514,224 @@ mrb_codedump_all(mrb_state *mrb, struct RProc *proc)
 {
   codedump_recur(mrb, proc->body.irep);
 }
+
+#ifndef MRB_DISABLE_STDIO
+
+/* must match the opcode enum in mruby/opcode.h */
+static const char *op_names[] = {
+  "NOP", "MOVE", "LOADL", "LOADI", "LOADSYM", "LOADNIL", "LOADSELF",
+  "LOADT", "LOADF",
+  "GETGLOBAL", "SETGLOBAL", "GETSPECIAL", "SETSPECIAL", "GETIV", "SETIV",
+  "GETCV", "SETCV", "GETCONST", "SETCONST", "GETMCNST", "SETMCNST",
+  "GETUPVAR", "SETUPVAR",
+  "JMP", "JMPIF", "JMPNOT", "ONERR", "RESCUE", "POPERR", "RAISE",
+  "EPUSH", "EPOP",
+  "SEND", "SENDB", "FSEND", "CALL", "SUPER", "ARGARY", "ENTER",
+  "KARG", "KDICT",
+  "RETURN", "TAILCALL", "BLKPUSH",
+  "ADD", "ADDI", "SUB", "SUBI", "MUL", "DIV", "EQ", "LT", "LE", "GT", "GE",
+  "ARRAY", "ARYCAT", "ARYPUSH", "AREF", "ASET", "APOST",
+  "STRING", "STRCAT",
+  "HASH", "LAMBDA", "RANGE",
+  "OCLASS", "CLASS", "MODULE", "EXEC", "METHOD", "SCLASS", "TCLASS",
+  "DEBUG", "STOP", "ERR",
+  "SENDC",
+  "SELFSEND", "MOVESEND", "IVSEND",
+  "FROZSTR",
+  "JMPLT", "JMPLE", "JMPGT", "JMPGE", "JMPEQ",
+  "RSVD1", "RSVD2", "RSVD3", "RSVD4", "RSVD5",
+};
+
+#define CODESTAT_NOPS ((int)(sizeof(op_names) / sizeof(op_names[0])))
+#define CODESTAT_MAX_ENC 8      /* compact encodings are 1..7 bytes */
+
+struct codestat {
+  uint32_t ops[CODESTAT_NOPS];
+  /* instructions by size of their compact (CPIR varint) encoding; the
+     operand-size distribution quickening and encoding work cares about */
+  uint32_t enc_bytes[CODESTAT_MAX_ENC + 1];
+  struct codestat_call {
+    mrb_sym sym;
+    uint32_t count;
+  } *calls;
+  size_t calls_len, calls_capa;
+  uint64_t ilen;
+  uint64_t plen, slen;
+  uint32_t max_nregs;
+  uint32_t nirep;
+};
+
+static void
+codestat_add_call(mrb_state *mrb, struct codestat *st, mrb_sym sym)
+{
+  size_t i;
+
+  for (i = 0; i < st->calls_len; i++) {
+    if (st->calls[i].sym == sym) {
+      st->calls[i].count++;
+      return;
+    }
+  }
+  if (st->calls_len == st->calls_capa) {
+    st->calls_capa = st->calls_capa ? st->calls_capa * 2 : 16;
+    st->calls = (struct codestat_call*)mrb_realloc(mrb, st->calls,
+                    sizeof(struct codestat_call) * st->calls_capa);
+  }
+  st->calls[st->calls_len].sym = sym;
+  st->calls[st->calls_len].count = 1;
+  st->calls_len++;
+}
+
+/* true when Syms(B) of the instruction names a dispatch target */
+static mrb_bool
+codestat_call_op_p(int op)
+{
+  switch (op) {
+  case OP_SEND: case OP_SENDB: case OP_SENDC: case OP_SENDL: case OP_FSEND:
+  case OP_TAILCALL: case OP_UPDIDX:
+  case OP_ADD: case OP_ADDI: case OP_SUB: case OP_SUBI:
+  case OP_MUL: case OP_DIV:
+  case OP_EQ: case OP_LT: case OP_LE: case OP_GT: case OP_GE:
+  case OP_JMPEQ: case OP_JMPLT: case OP_JMPLE: case OP_JMPGT: case OP_JMPGE:
+    return TRUE;
+  default:
+    return FALSE;
+  }
+}
+
+static size_t
+codestat_enc_size(mrb_code c)
+{
+  int op = GET_OPCODE(c);
+
+  switch (mrb_compact_op_fmt(op)) {
+  case CPIR_FMT_ABX:
+    return 1 + varint_size(GETARG_A(c)) + varint_size(GETARG_Bx(c));
+  case CPIR_FMT_ASBX: {
+    int32_t sbx = GETARG_sBx(c);
+    uint32_t z = ((uint32_t)sbx << 1) ^ (uint32_t)(sbx >> 31);
+
+    return 1 + varint_size(GETARG_A(c)) + varint_size(z);
+  }
+  default:
+    return 1 + varint_size(GETARG_A(c)) + varint_size(GETARG_B(c)) +
+           varint_size(GETARG_C(c));
+  }
+}
+
+static void
+codestat_irep(mrb_state *mrb, mrb_irep *irep, struct codestat *st)
+{
+  size_t i, enc;
+  int op, b;
+  mrb_code c;
+
+  st->nirep++;
+  st->ilen += irep->ilen;
+  st->plen += irep->plen;
+  st->slen += irep->slen;
+  if (irep->nregs > st->max_nregs) st->max_nregs = irep->nregs;
+  for (i = 0; i < irep->ilen; i++) {
+    c = irep->iseq[i];
+    op = GET_OPCODE(c);
+    if (op < CODESTAT_NOPS) st->ops[op]++;
+    enc = codestat_enc_size(c);
+    if (enc > CODESTAT_MAX_ENC) enc = CODESTAT_MAX_ENC;
+    st->enc_bytes[enc]++;
+    if (codestat_call_op_p(op)) {
+      b = GETARG_B(c);
+      if ((size_t)b < irep->slen && irep->syms[b] != 0) {
+        codestat_add_call(mrb, st, irep->syms[b]);
+      }
+    }
+  }
+}
+
+static void
+codestat_print_sym(mrb_state *mrb, FILE *out, mrb_sym sym)
+{
+  mrb_int len;
+  const char *name = mrb_sym2name_len(mrb, sym, &len);
+  mrb_int i;
+
+  fputc('"', out);
+  for (i = 0; i < len; i++) {
+    if (name[i] == '"' || name[i] == '\\') fputc('\\', out);
+    fputc(name[i], out);
+  }
+  fputc('"', out);
+}
+
+static void
+codestat_print(mrb_state *mrb, FILE *out, const struct codestat *st)
+{
+  int i, first;
+
+  fprintf(out, "\"ilen\":%u,\"plen\":%u,\"slen\":%u,",
+          (unsigned)st->ilen, (unsigned)st->plen, (unsigned)st->slen);
+  fprintf(out, "\"ops\":{");
+  first = 1;
+  for (i = 0; i < CODESTAT_NOPS; i++) {
+    if (st->ops[i] == 0) continue;
+    fprintf(out, "%s\"%s\":%u", first ? "" : ",", op_names[i], st->ops[i]);
+    first = 0;
+  }
+  fprintf(out, "},\"compact_bytes\":{");
+  first = 1;
+  for (i = 0; i <= CODESTAT_MAX_ENC; i++) {
+    if (st->enc_bytes[i] == 0) continue;
+    fprintf(out, "%s\"%d\":%u", first ? "" : ",", i, st->enc_bytes[i]);
+    first = 0;
+  }
+  fprintf(out, "},\"calls\":{");
+  for (i = 0; (size_t)i < st->calls_len; i++) {
+    if (i > 0) fputc(',', out);
+    codestat_print_sym(mrb, out, st->calls[i].sym);
+    fprintf(out, ":%u", st->calls[i].count);
+  }
+  fprintf(out, "}");
+}
+
+static void
+codestat_recur(mrb_state *mrb, mrb_irep *irep, struct codestat *total,
+               FILE *out, int *idx)
+{
+  struct codestat st = { { 0 } };
+  size_t i;
+
+  codestat_irep(mrb, irep, &st);
+  codestat_irep(mrb, irep, total);
+  if (*idx > 0) fputc(',', out);
+  fprintf(out, "{\"irep\":%d,\"nregs\":%d,\"nlocals\":%d,\"reps\":%d,",
+          *idx, irep->nregs, irep->nlocals, (int)irep->rlen);
+  codestat_print(mrb, out, &st);
+  fprintf(out, "}");
+  mrb_free(mrb, st.calls);
+  (*idx)++;
+  for (i = 0; i < irep->rlen; i++) {
+    if (irep->reps[i]) {
+      codestat_recur(mrb, irep->reps[i], total, out, idx);
+    }
+  }
+}
+
+/* per-irep bytecode statistics (opcode histogram, compact-encoding size
+   distribution, dispatch targets) plus an aggregate, as one JSON object;
+   for tuning superinstructions and quickening against real workloads
+   without instrumenting the VM */
+void
+mrb_codedump_stats(mrb_state *mrb, struct RProc *proc, FILE *out)
+{
+  struct codestat total = { { 0 } };
+  int idx = 0;
+
+  fprintf(out, "{\"ireps\":[");
+  codestat_recur(mrb, proc->body.irep, &total, out, &idx);
+  fprintf(out, "],\"total\":{\"irep_count\":%u,\"max_nregs\":%u,",
+          total.nirep, total.max_nregs);
+  codestat_print(mrb, out, &total);
+  fprintf(out, "}}\n");
+  mrb_free(mrb, total.calls);
+}
+
+#endif /* MRB_DISABLE_STDIO */
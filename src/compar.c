@@ -5,9 +5,173 @@
 */
 
 #include <mruby.h>
+#include <mruby/class.h>
+#include <mruby/string.h>
+#include <mruby/compar.h>
+
+/* normalize a `<=>` result to -1/0/1, MRB_CMP_FAILED for nil; exotic
+   result objects are asked how they compare to zero */
+static mrb_int
+cmp_int(mrb_state *mrb, mrb_value v)
+{
+  if (mrb_fixnum_p(v)) {
+    mrb_int n = mrb_fixnum(v);
+    return n > 0 ? 1 : n < 0 ? -1 : 0;
+  }
+  if (mrb_nil_p(v)) {
+    return MRB_CMP_FAILED;
+  }
+  if (mrb_float_p(v)) {
+    mrb_float f = mrb_float(v);
+    return f > 0 ? 1 : f < 0 ? -1 : 0;
+  }
+  if (mrb_test(mrb_funcall(mrb, v, ">", 1, mrb_fixnum_value(0)))) return 1;
+  if (mrb_test(mrb_funcall(mrb, v, "<", 1, mrb_fixnum_value(0)))) return -1;
+  return 0;
+}
+
+static mrb_int
+cmp_common(mrb_state *mrb, mrb_prepared_call *call, mrb_value obj1, mrb_value obj2)
+{
+  mrb_value v;
+
+  /* common receivers order without dispatching `<=>` at all */
+  switch (mrb_type(obj1)) {
+  case MRB_TT_FIXNUM:
+  case MRB_TT_FLOAT:
+    if (mrb_fixnum_p(obj1) && mrb_fixnum_p(obj2)) {
+      mrb_int a = mrb_fixnum(obj1), b = mrb_fixnum(obj2);
+      return a > b ? 1 : a < b ? -1 : 0;
+    }
+    if (mrb_fixnum_p(obj2) || mrb_float_p(obj2)) {
+      mrb_float a = mrb_fixnum_p(obj1) ? (mrb_float)mrb_fixnum(obj1) : mrb_float(obj1);
+      mrb_float b = mrb_fixnum_p(obj2) ? (mrb_float)mrb_fixnum(obj2) : mrb_float(obj2);
+      if (a > b) return 1;
+      if (a < b) return -1;
+      if (a == b) return 0;
+      return MRB_CMP_FAILED;  /* NaN */
+    }
+    break;
+  case MRB_TT_STRING:
+    if (mrb_string_p(obj2)) {
+      return mrb_str_cmp(mrb, obj1, obj2);
+    }
+    break;
+  default:
+    break;
+  }
+  if (call) {
+    if (call->mid == 0 || call->c != mrb_class(mrb, obj1)) {
+      mrb_funcall_prepare(mrb, call, mrb_class(mrb, obj1),
+                          mrb_intern_lit(mrb, "<=>"), 1);
+    }
+    v = mrb_funcall_prepared(mrb, call, obj1, &obj2);
+  }
+  else {
+    v = mrb_funcall_argv(mrb, obj1, mrb_intern_lit(mrb, "<=>"), 1, &obj2);
+  }
+  return cmp_int(mrb, v);
+}
+
+MRB_API mrb_int
+mrb_cmp(mrb_state *mrb, mrb_value obj1, mrb_value obj2)
+{
+  return cmp_common(mrb, NULL, obj1, obj2);
+}
+
+MRB_API mrb_int
+mrb_cmp_prepared(mrb_state *mrb, mrb_prepared_call *call, mrb_value obj1, mrb_value obj2)
+{
+  return cmp_common(mrb, call, obj1, obj2);
+}
+
+static void
+cmp_failed(mrb_state *mrb, mrb_value obj1, mrb_value obj2)
+{
+  mrb_raisef(mrb, E_ARGUMENT_ERROR, "comparison of %S with %S failed",
+             mrb_obj_value(mrb_obj_class(mrb, obj1)),
+             mrb_obj_value(mrb_obj_class(mrb, obj2)));
+}
+
+static mrb_int
+cmp_or_raise(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other;
+  mrb_int c;
+
+  mrb_get_args(mrb, "o", &other);
+  c = mrb_cmp(mrb, self, other);
+  if (c == MRB_CMP_FAILED) {
+    cmp_failed(mrb, self, other);
+  }
+  return c;
+}
+
+/* 15.3.3.2.1 */
+static mrb_value
+cmp_lt(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(cmp_or_raise(mrb, self) < 0);
+}
+
+/* 15.3.3.2.2 */
+static mrb_value
+cmp_le(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(cmp_or_raise(mrb, self) <= 0);
+}
+
+/* 15.3.3.2.3 */
+static mrb_value
+cmp_eq(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other;
+
+  mrb_get_args(mrb, "o", &other);
+  return mrb_bool_value(mrb_cmp(mrb, self, other) == 0);
+}
+
+/* 15.3.3.2.4 */
+static mrb_value
+cmp_gt(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(cmp_or_raise(mrb, self) > 0);
+}
+
+/* 15.3.3.2.5 */
+static mrb_value
+cmp_ge(mrb_state *mrb, mrb_value self)
+{
+  return mrb_bool_value(cmp_or_raise(mrb, self) >= 0);
+}
+
+/* 15.3.3.2.6 */
+static mrb_value
+cmp_between(mrb_state *mrb, mrb_value self)
+{
+  mrb_value min, max;
+  mrb_prepared_call call = { 0 };
+  mrb_int c;
+
+  mrb_get_args(mrb, "oo", &min, &max);
+  c = mrb_cmp_prepared(mrb, &call, self, min);
+  if (c == MRB_CMP_FAILED) cmp_failed(mrb, self, min);
+  if (c < 0) return mrb_false_value();
+  c = mrb_cmp_prepared(mrb, &call, self, max);
+  if (c == MRB_CMP_FAILED) cmp_failed(mrb, self, max);
+  return mrb_bool_value(c <= 0);
+}
 
 void
 mrb_init_comparable(mrb_state *mrb)
 {
-  mrb_define_module(mrb, "Comparable");  /* 15.3.3 */
+  struct RClass *comp;
+
+  comp = mrb_define_module(mrb, "Comparable");                        /* 15.3.3 */
+  mrb_define_method(mrb, comp, "<",  cmp_lt, MRB_ARGS_REQ(1));        /* 15.3.3.2.1 */
+  mrb_define_method(mrb, comp, "<=", cmp_le, MRB_ARGS_REQ(1));        /* 15.3.3.2.2 */
+  mrb_define_method(mrb, comp, "==", cmp_eq, MRB_ARGS_REQ(1));        /* 15.3.3.2.3 */
+  mrb_define_method(mrb, comp, ">",  cmp_gt, MRB_ARGS_REQ(1));        /* 15.3.3.2.4 */
+  mrb_define_method(mrb, comp, ">=", cmp_ge, MRB_ARGS_REQ(1));        /* 15.3.3.2.5 */
+  mrb_define_method(mrb, comp, "between?", cmp_between, MRB_ARGS_REQ(2)); /* 15.3.3.2.6 */
 }
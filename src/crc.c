@@ -15,25 +15,41 @@
 **        carry
 */
 #define  CRC_16_CCITT       0x11021ul        /* x^16+x^12+x^5+1 */
-#define  CRC_XOR_PATTERN    (CRC_16_CCITT << 8)
-#define  CRC_CARRY_BIT      (0x01000000)
 
-uint16_t
-calc_crc_16_ccitt(const uint8_t *src, size_t nbytes, uint16_t crc)
+/* remainder of t<<8 for every top byte t; note that the historical
+** bit-by-bit loop fed each data byte in below the CRC, so the byte
+** itself only lands in the low half and the reduction is driven by
+** the CRC's top byte alone */
+static uint16_t crc_table[256];
+
+static void
+crc_table_init(void)
 {
-  size_t ibyte;
-  uint32_t ibit;
-  uint32_t crcwk = crc << 8;
+  uint32_t t, ibit;
+
+  for (t = 0; t < 256; t++) {
+    uint32_t r = t << 8;
 
-  for (ibyte = 0; ibyte < nbytes; ibyte++) {
-    crcwk |= *src++;
     for (ibit = 0; ibit < CHAR_BIT; ibit++) {
-      crcwk <<= 1;
-      if (crcwk & CRC_CARRY_BIT) {
-        crcwk ^= CRC_XOR_PATTERN;
+      r <<= 1;
+      if (r & 0x10000) {
+        r ^= CRC_16_CCITT;
       }
     }
+    crc_table[t] = (uint16_t)r;
   }
-  return (uint16_t)(crcwk >> 8);
 }
 
+uint16_t
+calc_crc_16_ccitt(const uint8_t *src, size_t nbytes, uint16_t crc)
+{
+  size_t ibyte;
+
+  if (!crc_table[1]) {
+    crc_table_init();
+  }
+  for (ibyte = 0; ibyte < nbytes; ibyte++) {
+    crc = (uint16_t)((crc << 8) ^ crc_table[crc >> 8] ^ *src++);
+  }
+  return crc;
+}
@@ -10,6 +10,7 @@ get_file(mrb_irep_debug_info *info, uint32_t pc)
   int32_t count;
 
   if (pc >= info->pc_count) { return NULL; }
+  if (info->flen == 0) { return NULL; }  /* valid but empty record */
   /* get upper bound */
   ret = info->files;
   count =  info->flen;
@@ -5,12 +5,15 @@
 */
 
 #include <string.h>
+#include <stdlib.h>
 #include <limits.h>
 #include <mruby/dump.h>
 #include <mruby/string.h>
 #include <mruby/irep.h>
 #include <mruby/numeric.h>
 #include <mruby/debug.h>
+#include <mruby/opcode.h>
+#include <mruby/presym.h>
 
 #define FLAG_BYTEORDER_NATIVE 2
 #define FLAG_BYTEORDER_NONATIVE 0
@@ -209,48 +212,135 @@ write_pool_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
 }
 
 
+/* unique symbols of the whole irep tree (SYMT section), sorted by sym
+   id so both dump passes resolve the same indices by binary search */
+typedef struct symtab_dump {
+  mrb_sym *syms;
+  size_t len, capa;
+} symtab_dump;
+
+static void
+symtab_dump_collect(mrb_state *mrb, mrb_irep *irep, symtab_dump *tab)
+{
+  size_t i;
+
+  for (i = 0; i < irep->slen; i++) {
+    if (irep->syms[i] == 0) continue;
+    if (tab->len == tab->capa) {
+      tab->capa = tab->capa ? tab->capa * 2 : 256;
+      tab->syms = (mrb_sym*)mrb_realloc(mrb, tab->syms, sizeof(mrb_sym) * tab->capa);
+    }
+    tab->syms[tab->len++] = irep->syms[i];
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    symtab_dump_collect(mrb, irep->reps[i], tab);
+  }
+}
+
+static int
+symtab_dump_cmp(const void *a, const void *b)
+{
+  mrb_sym x = *(const mrb_sym*)a, y = *(const mrb_sym*)b;
+
+  return x < y ? -1 : x > y;
+}
+
+static void
+symtab_dump_build(mrb_state *mrb, mrb_irep *irep, symtab_dump *tab)
+{
+  size_t i, n;
+
+  symtab_dump_collect(mrb, irep, tab);
+  if (tab->len == 0) return;
+  qsort(tab->syms, tab->len, sizeof(mrb_sym), symtab_dump_cmp);
+  for (i = n = 1; i < tab->len; i++) {
+    if (tab->syms[i] != tab->syms[n-1]) {
+      tab->syms[n++] = tab->syms[i];
+    }
+  }
+  tab->len = n;
+  /* indices are stored as uint16 with MRB_DUMP_NULL_SYM_LEN reserved */
+  mrb_assert(tab->len < MRB_DUMP_NULL_SYM_LEN);
+}
+
+static size_t
+symtab_dump_index(const symtab_dump *tab, mrb_sym sym)
+{
+  size_t lo = 0, hi = tab->len;
+
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+
+    if (tab->syms[mid] < sym) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static size_t
+get_section_symtab_size(mrb_state *mrb, const symtab_dump *tab)
+{
+  size_t size = sizeof(struct rite_section_header), i;
+  mrb_int len;
+
+  size += sizeof(uint32_t); /* number of symbols */
+  for (i = 0; i < tab->len; i++) {
+    mrb_sym2name_len(mrb, tab->syms[i], &len);
+    size += sizeof(uint16_t) + len + 1; /* snl(n), sn(n), null char */
+  }
+  return size;
+}
+
+static int
+write_section_symtab(mrb_state *mrb, const symtab_dump *tab, uint8_t *bin, size_t *len_p)
+{
+  struct rite_section_header *header = (struct rite_section_header*)bin;
+  uint8_t *cur = bin + sizeof(struct rite_section_header);
+  size_t i;
+
+  cur += uint32_to_bin((uint32_t)tab->len, cur); /* number of symbols */
+  for (i = 0; i < tab->len; i++) {
+    mrb_int len;
+    const char *name = mrb_sym2name_len(mrb, tab->syms[i], &len);
+
+    mrb_assert_int_fit(mrb_int, len, uint16_t, UINT16_MAX);
+    cur += uint16_to_bin((uint16_t)len, cur); /* length of symbol name */
+    memcpy(cur, name, len); /* symbol name */
+    cur += len;
+    *cur++ = '\0';
+  }
+  *len_p = cur - bin;
+  memcpy(header->section_ident, RITE_SECTION_SYMTAB_IDENT, sizeof(header->section_ident));
+  mrb_assert_int_fit(size_t, *len_p, uint32_t, UINT32_MAX);
+  uint32_to_bin((uint32_t)*len_p, header->section_size);
+  return MRB_DUMP_OK;
+}
+
 static size_t
 get_syms_block_size(mrb_state *mrb, mrb_irep *irep)
 {
   size_t size = 0;
-  uint32_t sym_no;
-  mrb_int len;
 
   size += sizeof(uint32_t); /* slen */
-  for (sym_no = 0; sym_no < irep->slen; sym_no++) {
-    size += sizeof(uint16_t); /* snl(n) */
-    if (irep->syms[sym_no] != 0) {
-      mrb_sym2name_len(mrb, irep->syms[sym_no], &len);
-      size += len + 1; /* sn(n) + null char */
-    }
-  }
+  size += irep->slen * sizeof(uint16_t); /* symtab index(n) */
 
   return size;
 }
 
 static ptrdiff_t
-write_syms_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf)
+write_syms_block(mrb_state *mrb, mrb_irep *irep, uint8_t *buf, const symtab_dump *tab)
 {
   uint32_t sym_no;
   uint8_t *cur = buf;
-  const char *name;
 
   cur += uint32_to_bin(irep->slen, cur); /* number of symbol */
 
   for (sym_no = 0; sym_no < irep->slen; sym_no++) {
     if (irep->syms[sym_no] != 0) {
-      mrb_int len;
-
-      name = mrb_sym2name_len(mrb, irep->syms[sym_no], &len);
-
-      mrb_assert_int_fit(mrb_int, len, uint16_t, UINT16_MAX);
-      cur += uint16_to_bin((uint16_t)len, cur); /* length of symbol name */
-      memcpy(cur, name, len); /* symbol name */
-      cur += (uint16_t)len;
-      *cur++ = '\0';
+      cur += uint16_to_bin((uint16_t)symtab_dump_index(tab, irep->syms[sym_no]), cur);
     }
     else {
-      cur += uint16_to_bin(MRB_DUMP_NULL_SYM_LEN, cur); /* length of symbol name */
+      cur += uint16_to_bin(MRB_DUMP_NULL_SYM_LEN, cur);
     }
   }
 
@@ -283,7 +373,7 @@ get_irep_record_size(mrb_state *mrb, mrb_irep *irep)
 }
 
 static int
-write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *irep_record_size, uint8_t flags)
+write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *irep_record_size, uint8_t flags, const symtab_dump *symtab)
 {
   uint32_t i;
   uint8_t *src = bin;
@@ -300,13 +390,13 @@ write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *irep_rec
   bin += write_irep_header(mrb, irep, bin);
   bin += write_iseq_block(mrb, irep, bin, flags);
   bin += write_pool_block(mrb, irep, bin);
-  bin += write_syms_block(mrb, irep, bin);
+  bin += write_syms_block(mrb, irep, bin, symtab);
 
   for (i = 0; i < irep->rlen; i++) {
     int result;
     size_t rsize;
 
-    result = write_irep_record(mrb, irep->reps[i], bin, &rsize, flags);
+    result = write_irep_record(mrb, irep->reps[i], bin, &rsize, flags, symtab);
     if (result != MRB_DUMP_OK) {
       return result;
     }
@@ -316,6 +406,253 @@ write_irep_record(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *irep_rec
   return MRB_DUMP_OK;
 }
 
+/* operand layout used for an opcode in the compact irep section */
+int
+mrb_compact_op_fmt(int op)
+{
+  switch (op) {
+  case OP_JMP: case OP_JMPIF: case OP_JMPNOT: case OP_ONERR:
+  case OP_LOADI:
+    return CPIR_FMT_ASBX;
+  case OP_LOADL: case OP_LOADSYM:
+  case OP_GETGLOBAL: case OP_SETGLOBAL:
+  case OP_GETSPECIAL: case OP_SETSPECIAL:
+  case OP_GETIV: case OP_SETIV:
+  case OP_GETCV: case OP_SETCV:
+  case OP_GETCONST: case OP_SETCONST:
+  case OP_GETMCNST: case OP_SETMCNST:
+  case OP_EPUSH: case OP_ARGARY: case OP_BLKPUSH:
+  case OP_STRING: case OP_FROZSTR: case OP_LAMBDA:
+  case OP_EXEC: case OP_ERR: case OP_IVSEND:
+    return CPIR_FMT_ABX;
+  default:
+    return CPIR_FMT_ABC;
+  }
+}
+
+/* deduplicated string table of the compact irep section; holds pool
+   literals and symbol names of the whole irep tree exactly once */
+typedef struct compact_strtab {
+  char **str;
+  uint16_t *len;
+  size_t slen, capa;
+} compact_strtab;
+
+static size_t
+compact_strtab_index(mrb_state *mrb, compact_strtab *tab, const char *s, size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < tab->slen; i++) {
+    if (tab->len[i] == len && memcmp(tab->str[i], s, len) == 0) {
+      return i;
+    }
+  }
+  if (tab->slen == tab->capa) {
+    tab->capa = tab->capa ? tab->capa * 2 : 64;
+    tab->str = (char**)mrb_realloc(mrb, tab->str, sizeof(char*) * tab->capa);
+    tab->len = (uint16_t*)mrb_realloc(mrb, tab->len, sizeof(uint16_t) * tab->capa);
+  }
+  mrb_assert_int_fit(size_t, len, uint16_t, UINT16_MAX);
+  tab->str[i] = (char*)mrb_malloc(mrb, len);
+  memcpy(tab->str[i], s, len);
+  tab->len[i] = (uint16_t)len;
+  tab->slen++;
+  return i;
+}
+
+static void
+compact_strtab_free(mrb_state *mrb, compact_strtab *tab)
+{
+  size_t i;
+
+  for (i = 0; i < tab->slen; i++) {
+    mrb_free(mrb, tab->str[i]);
+  }
+  mrb_free(mrb, tab->str);
+  mrb_free(mrb, tab->len);
+}
+
+/* string-table index of a pool value, rendered the same way as in the
+   plain irep section (numbers as decimal/exponent strings) */
+static size_t
+compact_pool_index(mrb_state *mrb, compact_strtab *tab, mrb_value v)
+{
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_value str;
+  size_t idx;
+
+  switch (mrb_type(v)) {
+  case MRB_TT_FIXNUM:
+    str = mrb_fixnum_to_str(mrb, v, 10);
+    break;
+  case MRB_TT_FLOAT:
+    str = mrb_float_to_str(mrb, v, MRB_FLOAT_FMT);
+    break;
+  default:
+    str = v;
+    break;
+  }
+  idx = compact_strtab_index(mrb, tab, RSTRING_PTR(str), (size_t)RSTRING_LEN(str));
+  mrb_gc_arena_restore(mrb, ai);
+  return idx;
+}
+
+static size_t
+compact_iseq_to_bin(mrb_code c, uint8_t *buf)
+{
+  int op = GET_OPCODE(c);
+  uint8_t *cur = buf;
+
+  *cur++ = (uint8_t)op;
+  switch (mrb_compact_op_fmt(op)) {
+  case CPIR_FMT_ABX:
+    cur += varint_to_bin((uint32_t)GETARG_A(c), cur);
+    cur += varint_to_bin((uint32_t)GETARG_Bx(c), cur);
+    break;
+  case CPIR_FMT_ASBX: {
+    int32_t sbx = (int32_t)GETARG_sBx(c);
+
+    cur += varint_to_bin((uint32_t)GETARG_A(c), cur);
+    cur += varint_to_bin(((uint32_t)sbx << 1) ^ (uint32_t)(sbx >> 31), cur);
+    break;
+  }
+  default: /* CPIR_FMT_ABC */
+    cur += varint_to_bin((uint32_t)GETARG_A(c), cur);
+    cur += varint_to_bin((uint32_t)GETARG_B(c), cur);
+    cur += varint_to_bin((uint32_t)GETARG_C(c), cur);
+    break;
+  }
+  return cur - buf;
+}
+
+/* sizes a compact record and registers its strings; the indices seen
+   here are final, so the write pass below finds the same ones */
+static size_t
+get_compact_record_size(mrb_state *mrb, mrb_irep *irep, compact_strtab *tab)
+{
+  size_t size = 0, i;
+  uint8_t tmp[8];
+
+  size += varint_size(irep->nlocals);
+  size += varint_size(irep->nregs);
+  size += varint_size((uint32_t)irep->rlen);
+  size += varint_size((uint32_t)irep->ilen);
+  for (i = 0; i < irep->ilen; i++) {
+    size += compact_iseq_to_bin(irep->iseq[i], tmp);
+  }
+  size += varint_size((uint32_t)irep->plen);
+  for (i = 0; i < irep->plen; i++) {
+    size += sizeof(uint8_t); /* data type */
+    size += varint_size((uint32_t)compact_pool_index(mrb, tab, irep->pool[i]));
+  }
+  size += varint_size((uint32_t)irep->slen);
+  for (i = 0; i < irep->slen; i++) {
+    if (irep->syms[i] == 0) {
+      size += varint_size(0);
+    }
+    else {
+      mrb_int len;
+      const char *name = mrb_sym2name_len(mrb, irep->syms[i], &len);
+
+      size += varint_size((uint32_t)(compact_strtab_index(mrb, tab, name, (size_t)len) + 1));
+    }
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    size += get_compact_record_size(mrb, irep->reps[i], tab);
+  }
+  return size;
+}
+
+static size_t
+get_section_compact_size(mrb_state *mrb, mrb_irep *irep, compact_strtab *tab)
+{
+  size_t size = sizeof(struct rite_section_irep_header);
+  size_t body = get_compact_record_size(mrb, irep, tab); /* fills tab */
+  size_t i;
+
+  size += varint_size((uint32_t)tab->slen);
+  for (i = 0; i < tab->slen; i++) {
+    size += varint_size(tab->len[i]) + tab->len[i];
+  }
+  return size + body;
+}
+
+static size_t
+write_compact_record(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, compact_strtab *tab)
+{
+  uint8_t *cur = bin;
+  size_t i;
+
+  cur += varint_to_bin(irep->nlocals, cur);
+  cur += varint_to_bin(irep->nregs, cur);
+  cur += varint_to_bin((uint32_t)irep->rlen, cur);
+  cur += varint_to_bin((uint32_t)irep->ilen, cur);
+  for (i = 0; i < irep->ilen; i++) {
+    cur += compact_iseq_to_bin(irep->iseq[i], cur);
+  }
+  cur += varint_to_bin((uint32_t)irep->plen, cur);
+  for (i = 0; i < irep->plen; i++) {
+    switch (mrb_type(irep->pool[i])) {
+    case MRB_TT_FIXNUM:
+      cur += uint8_to_bin(IREP_TT_FIXNUM, cur);
+      break;
+    case MRB_TT_FLOAT:
+      cur += uint8_to_bin(IREP_TT_FLOAT, cur);
+      break;
+    default:
+      cur += uint8_to_bin(IREP_TT_STRING, cur);
+      break;
+    }
+    cur += varint_to_bin((uint32_t)compact_pool_index(mrb, tab, irep->pool[i]), cur);
+  }
+  cur += varint_to_bin((uint32_t)irep->slen, cur);
+  for (i = 0; i < irep->slen; i++) {
+    if (irep->syms[i] == 0) {
+      cur += varint_to_bin(0, cur);
+    }
+    else {
+      mrb_int len;
+      const char *name = mrb_sym2name_len(mrb, irep->syms[i], &len);
+
+      cur += varint_to_bin((uint32_t)(compact_strtab_index(mrb, tab, name, (size_t)len) + 1), cur);
+    }
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    cur += write_compact_record(mrb, irep->reps[i], cur, tab);
+  }
+  return cur - bin;
+}
+
+static int
+write_section_compact(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *len_p, compact_strtab *tab)
+{
+  struct rite_section_irep_header *header = (struct rite_section_irep_header*)bin;
+  uint8_t *cur = bin;
+  size_t i;
+
+  if (mrb == NULL || bin == NULL) {
+    return MRB_DUMP_INVALID_ARGUMENT;
+  }
+
+  cur += sizeof(struct rite_section_irep_header);
+  cur += varint_to_bin((uint32_t)tab->slen, cur);
+  for (i = 0; i < tab->slen; i++) {
+    cur += varint_to_bin(tab->len[i], cur);
+    memcpy(cur, tab->str[i], tab->len[i]);
+    cur += tab->len[i];
+  }
+  cur += write_compact_record(mrb, irep, cur, tab);
+  *len_p = cur - bin;
+
+  memcpy(header->section_ident, RITE_SECTION_COMPACT_IREP_IDENT, sizeof(header->section_ident));
+  mrb_assert_int_fit(size_t, *len_p, uint32_t, UINT32_MAX);
+  uint32_to_bin((uint32_t)*len_p, header->section_size);
+  memcpy(header->rite_version, RITE_VM_VER, sizeof(header->rite_version));
+
+  return MRB_DUMP_OK;
+}
+
 static uint32_t
 write_footer(mrb_state *mrb, uint8_t *bin)
 {
@@ -344,7 +681,7 @@ write_section_irep_header(mrb_state *mrb, size_t section_size, uint8_t *bin)
 }
 
 static int
-write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *len_p, uint8_t flags)
+write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *len_p, uint8_t flags, const symtab_dump *symtab)
 {
   int result;
   size_t rsize = 0;
@@ -356,7 +693,7 @@ write_section_irep(mrb_state *mrb, mrb_irep *irep, uint8_t *bin, size_t *len_p,
 
   cur += sizeof(struct rite_section_irep_header);
 
-  result = write_irep_record(mrb, irep, cur, &rsize, flags);
+  result = write_irep_record(mrb, irep, cur, &rsize, flags, symtab);
   if (result != MRB_DUMP_OK) {
     return result;
   }
@@ -878,12 +1215,12 @@ dump_flags(uint8_t flags, uint8_t native)
 {
   if (native == FLAG_BYTEORDER_NATIVE) {
     if ((flags & DUMP_ENDIAN_NAT) == 0) {
-      return (flags & DUMP_DEBUG_INFO) | DUMP_ENDIAN_NAT;
+      return (flags & (DUMP_DEBUG_INFO|DUMP_COMPACT)) | DUMP_ENDIAN_NAT;
     }
     return flags;
   }
   if ((flags & DUMP_ENDIAN_NAT) == 0) {
-    return (flags & DUMP_DEBUG_INFO) | DUMP_ENDIAN_BIG;
+    return (flags & (DUMP_DEBUG_INFO|DUMP_COMPACT)) | DUMP_ENDIAN_BIG;
   }
   return flags;
 }
@@ -899,14 +1236,26 @@ dump_irep(mrb_state *mrb, mrb_irep *irep, uint8_t flags, uint8_t **bin, size_t *
   mrb_bool const debug_info_defined = is_debug_info_defined(irep), lv_defined = is_lv_defined(irep);
   mrb_sym *lv_syms = NULL; uint32_t lv_syms_len = 0;
   mrb_sym *filenames = NULL; uint16_t filenames_len = 0;
+  compact_strtab strtab = { NULL, NULL, 0, 0 };
+  symtab_dump symtab = { NULL, 0, 0 };
+  size_t section_symtab_size = 0;
 
   if (mrb == NULL) {
     *bin = NULL;
     return MRB_DUMP_GENERAL_FAILURE;
   }
 
-  section_irep_size = sizeof(struct rite_section_irep_header);
-  section_irep_size += get_irep_record_size(mrb, irep);
+  if (flags & DUMP_COMPACT) {
+    section_irep_size = get_section_compact_size(mrb, irep, &strtab);
+  }
+  else {
+    /* the irep records refer to symbols by index into one per-binary
+       symbol table, so the loader interns each unique name only once */
+    symtab_dump_build(mrb, irep, &symtab);
+    section_symtab_size = get_section_symtab_size(mrb, &symtab);
+    section_irep_size = sizeof(struct rite_section_irep_header);
+    section_irep_size += get_irep_record_size(mrb, irep);
+  }
 
   /* DEBUG section size */
   if (flags & DUMP_DEBUG_INFO) {
@@ -934,18 +1283,30 @@ dump_irep(mrb_state *mrb, mrb_irep *irep, uint8_t flags, uint8_t **bin, size_t *
   }
 
   malloc_size = sizeof(struct rite_binary_header) +
-                section_irep_size + section_lineno_size + section_lv_size +
+                section_symtab_size + section_irep_size +
+                section_lineno_size + section_lv_size +
                 sizeof(struct rite_binary_footer);
   cur = *bin = (uint8_t*)mrb_malloc(mrb, malloc_size);
   cur += sizeof(struct rite_binary_header);
 
-  result = write_section_irep(mrb, irep, cur, &section_irep_size, flags);
+  if (flags & DUMP_COMPACT) {
+    result = write_section_compact(mrb, irep, cur, &section_irep_size, &strtab);
+  }
+  else {
+    result = write_section_symtab(mrb, &symtab, cur, &section_symtab_size);
+    if (result != MRB_DUMP_OK) {
+      goto error_exit;
+    }
+    cur += section_symtab_size;
+    result = write_section_irep(mrb, irep, cur, &section_irep_size, flags, &symtab);
+  }
   if (result != MRB_DUMP_OK) {
     goto error_exit;
   }
   cur += section_irep_size;
   *bin_size = sizeof(struct rite_binary_header) +
-              section_irep_size + section_lineno_size + section_lv_size +
+              section_symtab_size + section_irep_size +
+              section_lineno_size + section_lv_size +
               sizeof(struct rite_binary_footer);
 
   /* write DEBUG section */
@@ -980,6 +1341,8 @@ error_exit:
   }
   mrb_free(mrb, lv_syms);
   mrb_free(mrb, filenames);
+  mrb_free(mrb, symtab.syms);
+  compact_strtab_free(mrb, &strtab);
   return result;
 }
 
@@ -1092,4 +1455,293 @@ mrb_dump_irep_cfunc(mrb_state *mrb, mrb_irep *irep, uint8_t flags, FILE *fp, con
   return result;
 }
 
+/*
+ * mrbc -R: emit fully-constructed mrb_irep structs as C source, so the
+ * program links into the image and loading is a pointer assignment
+ * (mrb_load_irep_struct) with no parse and no RAM copy of the iseq.
+ * Symbols that are preloaded by mrb_open come out as presym macros;
+ * everything else (app symbols, pool literals) is filled in by a small
+ * per-state fixup the generated entry point runs on first use.
+ */
+
+/* must match OPERATORS in tasks/gen_presym.rb */
+static const struct opsym_spell {
+  const char *name;
+  const char *spell;
+} opsym_spells[] = {
+  { "!", "not" }, { "!=", "neq" }, { "!~", "nmatch" }, { "%", "mod" },
+  { "&", "and" }, { "&&", "andand" }, { "*", "mul" }, { "**", "pow" },
+  { "+", "add" }, { "+@", "plus" }, { "-", "sub" }, { "-@", "minus" },
+  { "/", "div" }, { "<", "lt" }, { "<=", "le" }, { "<<", "lshift" },
+  { "<=>", "cmp" }, { "==", "eq" }, { "===", "eqq" }, { "=~", "match" },
+  { ">", "gt" }, { ">=", "ge" }, { ">>", "rshift" }, { "[]", "aref" },
+  { "[]=", "aset" }, { "^", "xor" }, { "`", "tick" }, { "|", "or" },
+  { "||", "oror" }, { "~", "neg" },
+};
+
+static mrb_bool
+c_ident_p(const char *s, mrb_int len)
+{
+  mrb_int i;
+
+  if (len == 0) return FALSE;
+  if (!ISALPHA(s[0]) && s[0] != '_') return FALSE;
+  for (i = 1; i < len; i++) {
+    if (!ISALNUM(s[i]) && s[i] != '_') return FALSE;
+  }
+  return TRUE;
+}
+
+/* writes the presym macro addressing `name` into buf, mirroring
+   enum_name in tasks/gen_presym.rb; FALSE when no macro spells it */
+static mrb_bool
+presym_macro(const char *name, mrb_int len, char *buf, size_t bufsize)
+{
+  size_t i;
+
+  for (i = 0; i < sizeof(opsym_spells)/sizeof(opsym_spells[0]); i++) {
+    if (strlen(opsym_spells[i].name) == (size_t)len &&
+        memcmp(opsym_spells[i].name, name, len) == 0) {
+      snprintf(buf, bufsize, "MRB_OPSYM(%s)", opsym_spells[i].spell);
+      return TRUE;
+    }
+  }
+  if (c_ident_p(name, len)) {
+    snprintf(buf, bufsize, "MRB_SYM(%.*s)", (int)len, name);
+    return TRUE;
+  }
+  if (len > 1 && c_ident_p(name, len-1)) {
+    const char *m;
+
+    switch (name[len-1]) {
+    case '?': m = "MRB_SYM_Q"; break;
+    case '!': m = "MRB_SYM_B"; break;
+    case '=': m = "MRB_SYM_E"; break;
+    default: return FALSE;
+    }
+    snprintf(buf, bufsize, "%s(%.*s)", m, (int)(len-1), name);
+    return TRUE;
+  }
+  if (len > 1 && name[0] == '@' && c_ident_p(name+1, len-1)) {
+    snprintf(buf, bufsize, "MRB_IVSYM(%.*s)", (int)(len-1), name+1);
+    return TRUE;
+  }
+  if (len > 2 && name[0] == '@' && name[1] == '@' && c_ident_p(name+2, len-2)) {
+    snprintf(buf, bufsize, "MRB_CVSYM(%.*s)", (int)(len-2), name+2);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+static void
+dump_c_string(FILE *fp, const char *s, mrb_int len)
+{
+  mrb_int i;
+
+  fputc('"', fp);
+  for (i = 0; i < len; i++) {
+    unsigned char c = (unsigned char)s[i];
+
+    switch (c) {
+    case '"':  fputs("\\\"", fp); break;
+    case '\\': fputs("\\\\", fp); break;
+    case '\n': fputs("\\n", fp); break;
+    case '\t': fputs("\\t", fp); break;
+    default:
+      if (c < 0x20 || c >= 0x7f) {
+        fprintf(fp, "\\%03o", c);
+      }
+      else {
+        fputc(c, fp);
+      }
+    }
+  }
+  fputc('"', fp);
+}
+
+struct irep_list {
+  mrb_irep **ireps;
+  size_t len, capa;
+};
+
+static void
+irep_list_collect(mrb_state *mrb, mrb_irep *irep, struct irep_list *l)
+{
+  size_t i;
+
+  if (l->len == l->capa) {
+    l->capa *= 2;
+    l->ireps = (mrb_irep**)mrb_realloc(mrb, l->ireps, sizeof(mrb_irep*) * l->capa);
+  }
+  l->ireps[l->len++] = irep;
+  for (i = 0; i < irep->rlen; i++) {
+    irep_list_collect(mrb, irep->reps[i], l);
+  }
+}
+
+static size_t
+irep_list_index(const struct irep_list *l, const mrb_irep *irep)
+{
+  size_t i;
+
+  for (i = 0; i < l->len; i++) {
+    if (l->ireps[i] == irep) return i;
+  }
+  return 0;  /* unreachable: every child is collected */
+}
+
+int
+mrb_dump_irep_struct(mrb_state *mrb, mrb_irep *irep, uint8_t flags, FILE *fp, const char *initname)
+{
+  struct irep_list l;
+  char macro[256];
+  size_t n, i;
+
+  if (fp == NULL || initname == NULL || initname[0] == '\0') {
+    return MRB_DUMP_INVALID_ARGUMENT;
+  }
+  l.capa = 16;
+  l.len = 0;
+  l.ireps = (mrb_irep**)mrb_malloc(mrb, sizeof(mrb_irep*) * l.capa);
+  irep_list_collect(mrb, irep, &l);
+
+  fprintf(fp,
+          "/* fully-constructed ireps for execute-in-place (mrbc -R).\n"
+          "   Call %s(mrb) for the root irep and run it with\n"
+          "   mrb_load_irep_struct(); iseq and literals stay in .rodata. */\n"
+          "#include <mruby.h>\n"
+          "#include <mruby/irep.h>\n"
+          "#include <mruby/presym.h>\n"
+          "#include <mruby/string.h>\n"
+          "#include <mruby/value.h>\n\n",
+          initname);
+  for (n = 0; n < l.len; n++) {
+    fprintf(fp, "static mrb_irep %s_irep_%d;\n", initname, (int)n);
+  }
+  fputc('\n', fp);
+
+  for (n = 0; n < l.len; n++) {
+    mrb_irep *ir = l.ireps[n];
+
+    if (ir->ilen > 0) {
+      fprintf(fp, "static const mrb_code %s_iseq_%d[] = {", initname, (int)n);
+      for (i = 0; i < ir->ilen; i++) {
+        fprintf(fp, "%s0x%08x,", i % 8 == 0 ? "\n  " : "", (unsigned)ir->iseq[i]);
+      }
+      fputs("\n};\n", fp);
+    }
+    if (ir->slen > 0) {
+      fprintf(fp, "static mrb_sym %s_syms_%d[] = {\n", initname, (int)n);
+      for (i = 0; i < ir->slen; i++) {
+        mrb_int len;
+        const char *name;
+
+        if (ir->syms[i] == 0) {
+          fputs("  0,\n", fp);
+          continue;
+        }
+        name = mrb_sym2name_len(mrb, ir->syms[i], &len);
+        if (ir->syms[i] <= MRB_PRESYM_MAX && presym_macro(name, len, macro, sizeof(macro))) {
+          fprintf(fp, "  %s,\n", macro);
+        }
+        else {
+          fprintf(fp, "  0, /* fixup: ");
+          dump_c_string(fp, name, len);
+          fputs(" */\n", fp);
+        }
+      }
+      fputs("};\n", fp);
+    }
+    if (ir->plen > 0) {
+      fprintf(fp, "static mrb_value %s_pool_%d[%d]; /* filled by fixup */\n",
+              initname, (int)n, (int)ir->plen);
+    }
+    if (ir->rlen > 0) {
+      fprintf(fp, "static mrb_irep *%s_reps_%d[] = {", initname, (int)n);
+      for (i = 0; i < ir->rlen; i++) {
+        fprintf(fp, "%s&%s_irep_%d,", i % 4 == 0 ? "\n  " : " ",
+                initname, (int)irep_list_index(&l, ir->reps[i]));
+      }
+      fputs("\n};\n", fp);
+    }
+  }
+  fputc('\n', fp);
+
+  for (n = 0; n < l.len; n++) {
+    mrb_irep *ir = l.ireps[n];
+
+    fprintf(fp, "static mrb_irep %s_irep_%d = {\n", initname, (int)n);
+    fprintf(fp, "  .nlocals = %d, .nregs = %d,\n", ir->nlocals, ir->nregs);
+    fprintf(fp, "  .flags = MRB_ISEQ_NO_FREE | MRB_IREP_STATIC,\n");
+    if (ir->ilen > 0) {
+      fprintf(fp, "  .iseq = (mrb_code*)%s_iseq_%d, .ilen = %d,\n",
+              initname, (int)n, (int)ir->ilen);
+    }
+    if (ir->plen > 0) {
+      fprintf(fp, "  .pool = %s_pool_%d, .plen = %d,\n", initname, (int)n, (int)ir->plen);
+    }
+    if (ir->slen > 0) {
+      fprintf(fp, "  .syms = %s_syms_%d, .slen = %d,\n", initname, (int)n, (int)ir->slen);
+    }
+    if (ir->rlen > 0) {
+      fprintf(fp, "  .reps = %s_reps_%d, .rlen = %d,\n", initname, (int)n, (int)ir->rlen);
+    }
+    fprintf(fp, "  .refcnt = 1,\n};\n");
+  }
+
+  fprintf(fp, "\nstatic void\n%s_fixup(mrb_state *mrb)\n{\n", initname);
+  for (n = 0; n < l.len; n++) {
+    mrb_irep *ir = l.ireps[n];
+
+    for (i = 0; i < ir->slen; i++) {
+      mrb_int len;
+      const char *name;
+
+      if (ir->syms[i] == 0) continue;
+      name = mrb_sym2name_len(mrb, ir->syms[i], &len);
+      if (ir->syms[i] <= MRB_PRESYM_MAX && presym_macro(name, len, macro, sizeof(macro))) {
+        continue;
+      }
+      fprintf(fp, "  %s_syms_%d[%d] = mrb_intern_lit(mrb, ", initname, (int)n, (int)i);
+      dump_c_string(fp, name, len);
+      fputs(");\n", fp);
+    }
+    for (i = 0; i < ir->plen; i++) {
+      switch (mrb_type(ir->pool[i])) {
+      case MRB_TT_FIXNUM:
+        fprintf(fp, "  %s_pool_%d[%d] = mrb_fixnum_value(%lld);\n",
+                initname, (int)n, (int)i, (long long)mrb_fixnum(ir->pool[i]));
+        break;
+      case MRB_TT_FLOAT:
+        fprintf(fp, "  %s_pool_%d[%d] = mrb_float_pool(mrb, %.17g);\n",
+                initname, (int)n, (int)i, (double)mrb_float(ir->pool[i]));
+        break;
+      case MRB_TT_STRING:
+        fprintf(fp, "  %s_pool_%d[%d] = mrb_str_pool_static(mrb, ",
+                initname, (int)n, (int)i);
+        dump_c_string(fp, RSTRING_PTR(ir->pool[i]), RSTRING_LEN(ir->pool[i]));
+        fprintf(fp, ", %d);\n", (int)RSTRING_LEN(ir->pool[i]));
+        break;
+      default:
+        break;
+      }
+    }
+  }
+  fputs("}\n", fp);
+
+  fprintf(fp,
+          "\nmrb_irep*\n%s(mrb_state *mrb)\n{\n"
+          "  static mrb_state *fixup_state;\n\n"
+          "  if (fixup_state != mrb) {\n"
+          "    %s_fixup(mrb);\n"
+          "    fixup_state = mrb;\n"
+          "  }\n"
+          "  return &%s_irep_0;\n"
+          "}\n",
+          initname, initname, initname);
+
+  mrb_free(mrb, l.ireps);
+  return ferror(fp) ? MRB_DUMP_WRITE_FAULT : MRB_DUMP_OK;
+}
+
 #endif /* MRB_DISABLE_STDIO */
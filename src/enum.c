@@ -5,10 +5,356 @@
 */
 
 #include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/class.h>
+#include <mruby/proc.h>
+#include <mruby/foreach.h>
+
+/*
+ * Native internal iteration for the hot Enumerable methods.
+ *
+ * The mrblib definitions compose `each` with a fresh block per call, so
+ * every map/select/inject over a plain array allocates an RProc and
+ * dispatches per element.  The `__enum_*` methods below walk built-in
+ * collections through the foreach protocol instead and call the user's
+ * block directly.  Each returns the result wrapped in a one-element
+ * array, or nil to decline, in which case the mrblib wrapper falls back
+ * to the generic `each` path (same convention as Range#__each_int).
+ */
+
+MRB_API int
+mrb_foreach(mrb_state *mrb, mrb_value obj, mrb_foreach_func func, void *data)
+{
+  switch (mrb_type(obj)) {
+  case MRB_TT_ARRAY: return mrb_ary_foreach(mrb, obj, func, data);
+  case MRB_TT_HASH:  return mrb_hash_pair_foreach(mrb, obj, func, data);
+  case MRB_TT_RANGE: return mrb_range_foreach(mrb, obj, func, data);
+  default:
+    mrb_raise(mrb, E_TYPE_ERROR, "not a built-in collection");
+    return 0; /* not reached */
+  }
+}
+
+MRB_API mrb_bool
+mrb_enum_yieldable_p(mrb_state *mrb, mrb_value blk)
+{
+  struct RProc *p;
+
+  if (mrb_type(blk) != MRB_TT_PROC) return FALSE;
+  /* yielding from inside a fiber cannot cross this C frame */
+  if (mrb->c != mrb->root_c) return FALSE;
+  p = mrb_proc_ptr(blk);
+  /* a captured env whose stack is gone (dead fiber) cannot be yielded */
+  if (p->env && !p->env->stack) return FALSE;
+  /* a block-`return` must unwind the enclosing method and cannot cross
+     this C frame */
+  if (mrb_proc_block_return_p(mrb, p)) return FALSE;
+  return TRUE;
+}
+
+MRB_API int
+mrb_enum_yield(mrb_state *mrb, mrb_value blk, mrb_int argc, const mrb_value *argv, mrb_value *out)
+{
+  *out = mrb_yield_argv(mrb, blk, argc, argv);
+  if (mrb->break_proc) {
+    if (mrb->break_proc == mrb_proc_ptr(blk)) {
+      mrb->break_proc = NULL;
+      return MRB_ENUM_YIELD_BREAK;
+    }
+    return MRB_ENUM_YIELD_OUTER;
+  }
+  return MRB_ENUM_YIELD_OK;
+}
+
+/* callback stop codes; BREAK/OUTER intentionally match mrb_enum_yield */
+#define STOP_BREAK MRB_ENUM_YIELD_BREAK
+#define STOP_OUTER MRB_ENUM_YIELD_OUTER
+#define STOP_DONE  3
+
+struct enum_ctx {
+  mrb_value blk;
+  mrb_value acc;            /* accumulator (result array, inject value) */
+  mrb_value holder;         /* 1-slot array keeping acc across restores */
+  mrb_value ret;            /* early-exit or break value */
+  mrb_value arg;
+  mrb_sym sym;
+  mrb_bool flag;
+  mrb_prepared_call call;
+};
+
+static mrb_value
+enum_wrap(mrb_state *mrb, mrb_value v)
+{
+  return mrb_ary_new_from_values(mrb, 1, &v);
+}
+
+/* shared tail: wrap the result for the mrblib wrapper, or hand an outer
+   block's break value straight back so the VM resumes unwinding */
+static mrb_value
+enum_result(mrb_state *mrb, int stop, const struct enum_ctx *ctx, mrb_value result)
+{
+  if (stop == STOP_OUTER) return ctx->ret;
+  if (stop == STOP_BREAK || stop == STOP_DONE) return enum_wrap(mrb, ctx->ret);
+  return enum_wrap(mrb, result);
+}
+
+static int
+collect_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+  mrb_value v;
+  int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+
+  if (rc) { c->ret = v; return rc; }
+  mrb_ary_push(mrb, c->acc, v);
+  return 0;
+}
+
+static mrb_value
+enum_collect(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self) || !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.acc = mrb_ary_new(mrb);
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, collect_i, &c);
+  return enum_result(mrb, stop, &c, c.acc);
+}
+
+static int
+select_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+  mrb_value v;
+  int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+
+  if (rc) { c->ret = v; return rc; }
+  if (mrb_test(v) == c->flag) {
+    mrb_ary_push(mrb, c->acc, val);
+  }
+  return 0;
+}
+
+/* find_all when keep is TRUE, reject when FALSE */
+static mrb_value
+enum_select_common(mrb_state *mrb, mrb_value self, mrb_bool keep)
+{
+  struct enum_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self) || !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.acc = mrb_ary_new(mrb);
+  c.flag = keep;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, select_i, &c);
+  return enum_result(mrb, stop, &c, c.acc);
+}
+
+static mrb_value
+enum_select(mrb_state *mrb, mrb_value self)
+{
+  return enum_select_common(mrb, self, TRUE);
+}
+
+static mrb_value
+enum_reject(mrb_state *mrb, mrb_value self)
+{
+  return enum_select_common(mrb, self, FALSE);
+}
+
+static int
+inject_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+  mrb_value v;
+
+  if (c->flag) {
+    /* no initial value: the first element seeds the accumulator */
+    c->flag = FALSE;
+    c->acc = val;
+  }
+  else if (c->sym) {
+    if (c->call.mid == 0 || c->call.c != mrb_class(mrb, c->acc)) {
+      mrb_funcall_prepare(mrb, &c->call, mrb_class(mrb, c->acc), c->sym, 1);
+    }
+    c->acc = mrb_funcall_prepared(mrb, &c->call, c->acc, &val);
+  }
+  else {
+    mrb_value argv[2];
+    int rc;
+
+    argv[0] = c->acc;
+    argv[1] = val;
+    rc = mrb_enum_yield(mrb, c->blk, 2, argv, &v);
+    if (rc) { c->ret = v; return rc; }
+    c->acc = v;
+  }
+  mrb_ary_set(mrb, c->holder, 0, c->acc);
+  return 0;
+}
+
+static mrb_value
+enum_inject(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ctx c;
+  mrb_value symv;
+  int stop;
+
+  mrb_get_args(mrb, "booo", &c.flag, &c.acc, &symv, &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  c.sym = mrb_nil_p(symv) ? 0 : mrb_symbol(symv);
+  if (!c.sym && !mrb_enum_yieldable_p(mrb, c.blk)) return mrb_nil_value();
+  c.holder = mrb_ary_new_capa(mrb, 1);
+  mrb_ary_set(mrb, c.holder, 0, c.acc);
+  c.call.mid = 0;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, inject_i, &c);
+  return enum_result(mrb, stop, &c, c.acc);
+}
+
+static int
+include_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+
+  if (mrb_equal(mrb, val, c->arg)) {
+    c->ret = mrb_true_value();
+    return STOP_DONE;
+  }
+  return 0;
+}
+
+static mrb_value
+enum_include(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.arg);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  stop = mrb_foreach(mrb, self, include_i, &c);
+  return enum_result(mrb, stop, &c, mrb_false_value());
+}
+
+static int
+all_any_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+  mrb_value v = val;
+
+  if (!mrb_nil_p(c->blk)) {
+    int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+    if (rc) { c->ret = v; return rc; }
+  }
+  if (mrb_test(v) != c->flag) {
+    /* all?: a falsy value decides; any?: a truthy one does */
+    c->ret = mrb_bool_value(!c->flag);
+    return STOP_DONE;
+  }
+  return 0;
+}
+
+/* all? when expect is TRUE, any? when FALSE */
+static mrb_value
+enum_all_any_common(mrb_state *mrb, mrb_value self, mrb_bool expect)
+{
+  struct enum_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  if (!mrb_nil_p(c.blk) && !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  c.flag = expect;
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, all_any_i, &c);
+  return enum_result(mrb, stop, &c, mrb_bool_value(expect));
+}
+
+static mrb_value
+enum_all(mrb_state *mrb, mrb_value self)
+{
+  return enum_all_any_common(mrb, self, TRUE);
+}
+
+static mrb_value
+enum_any(mrb_state *mrb, mrb_value self)
+{
+  return enum_all_any_common(mrb, self, FALSE);
+}
+
+static int
+detect_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+  mrb_value v;
+  int rc = mrb_enum_yield(mrb, c->blk, 1, &val, &v);
+
+  if (rc) { c->ret = v; return rc; }
+  if (mrb_test(v)) {
+    c->ret = val;
+    return STOP_DONE;
+  }
+  return 0;
+}
+
+static mrb_value
+enum_detect(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ctx c;
+  int stop;
+
+  mrb_get_args(mrb, "o", &c.blk);
+  if (!mrb_foreach_supported_p(self) || !mrb_enum_yieldable_p(mrb, c.blk)) {
+    return mrb_nil_value();
+  }
+  mrb->break_proc = NULL;
+  stop = mrb_foreach(mrb, self, detect_i, &c);
+  if (stop == 0) return mrb_ary_new(mrb);  /* no match: wrapper uses ifnone */
+  return enum_result(mrb, stop, &c, mrb_nil_value());
+}
+
+static int
+entries_i(mrb_state *mrb, mrb_value val, void *data)
+{
+  struct enum_ctx *c = (struct enum_ctx*)data;
+
+  mrb_ary_push(mrb, c->acc, val);
+  return 0;
+}
+
+static mrb_value
+enum_entries(mrb_state *mrb, mrb_value self)
+{
+  struct enum_ctx c;
+
+  if (!mrb_foreach_supported_p(self)) return mrb_nil_value();
+  c.acc = mrb_ary_new(mrb);
+  mrb_foreach(mrb, self, entries_i, &c);
+  return enum_wrap(mrb, c.acc);
+}
 
 void
 mrb_init_enumerable(mrb_state *mrb)
 {
-  mrb_define_module(mrb, "Enumerable");  /* 15.3.2 */
-}
+  struct RClass *e = mrb_define_module(mrb, "Enumerable");  /* 15.3.2 */
 
+  mrb_define_method(mrb, e, "__enum_collect", enum_collect, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_select",  enum_select,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_reject",  enum_reject,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_inject",  enum_inject,  MRB_ARGS_REQ(4));
+  mrb_define_method(mrb, e, "__enum_include", enum_include, MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_all",     enum_all,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_any",     enum_any,     MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_detect",  enum_detect,  MRB_ARGS_REQ(1));
+  mrb_define_method(mrb, e, "__enum_entries", enum_entries, MRB_ARGS_NONE());
+}
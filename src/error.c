@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/irep.h>
@@ -46,7 +47,7 @@ exc_initialize(mrb_state *mrb, mrb_value exc)
   mrb_value mesg;
 
   if (mrb_get_args(mrb, "|o", &mesg) == 1) {
-    mrb_iv_set(mrb, exc, mrb_intern_lit(mrb, "mesg"), mesg);
+    mrb_iv_set(mrb, exc, MRB_SYM(mesg), mesg);
   }
   return exc;
 }
@@ -75,7 +76,7 @@ exc_exception(mrb_state *mrb, mrb_value self)
   if (argc == 0) return self;
   if (mrb_obj_equal(mrb, self, a)) return self;
   exc = mrb_obj_clone(mrb, self);
-  mrb_iv_set(mrb, exc, mrb_intern_lit(mrb, "mesg"), a);
+  mrb_iv_set(mrb, exc, MRB_SYM(mesg), a);
 
   return exc;
 }
@@ -91,7 +92,7 @@ exc_exception(mrb_state *mrb, mrb_value self)
 static mrb_value
 exc_to_s(mrb_state *mrb, mrb_value exc)
 {
-  mrb_value mesg = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "mesg"));
+  mrb_value mesg = mrb_attr_get(mrb, exc, MRB_SYM(mesg));
   struct RObject *p;
 
   if (!mrb_string_p(mesg)) {
@@ -136,9 +137,9 @@ exc_inspect(mrb_state *mrb, mrb_value exc)
   mrb_value str, mesg, file, line;
   mrb_bool append_mesg;
 
-  mesg = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "mesg"));
-  file = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "file"));
-  line = mrb_attr_get(mrb, exc, mrb_intern_lit(mrb, "line"));
+  mesg = mrb_attr_get(mrb, exc, MRB_SYM(mesg));
+  file = mrb_attr_get(mrb, exc, MRB_SYM(file));
+  line = mrb_attr_get(mrb, exc, MRB_SYM(line));
 
   append_mesg = !mrb_nil_p(mesg);
   if (append_mesg) {
@@ -175,6 +176,7 @@ exc_inspect(mrb_state *mrb, mrb_value exc)
 }
 
 void mrb_save_backtrace(mrb_state *mrb);
+void mrb_clear_backtrace(mrb_state *mrb);
 mrb_value mrb_restore_backtrace(mrb_state *mrb);
 
 static mrb_value
@@ -183,13 +185,12 @@ exc_get_backtrace(mrb_state *mrb, mrb_value exc)
   mrb_sym attr_name;
   mrb_value backtrace;
 
-  attr_name = mrb_intern_lit(mrb, "backtrace");
+  attr_name = MRB_SYM(backtrace);
   backtrace = mrb_iv_get(mrb, exc, attr_name);
   if (mrb_nil_p(backtrace)) {
     if (mrb_obj_ptr(exc) == mrb->backtrace.exc && mrb->backtrace.n > 0) {
       backtrace = mrb_restore_backtrace(mrb);
-      mrb->backtrace.n = 0;
-      mrb->backtrace.exc = 0;
+      mrb_clear_backtrace(mrb);
     }
     else {
       backtrace = mrb_exc_backtrace(mrb, exc);
@@ -206,7 +207,7 @@ exc_set_backtrace(mrb_state *mrb, mrb_value exc)
   mrb_value backtrace;
 
   mrb_get_args(mrb, "o", &backtrace);
-  mrb_iv_set(mrb, exc, mrb_intern_lit(mrb, "backtrace"), backtrace);
+  mrb_iv_set(mrb, exc, MRB_SYM(backtrace), backtrace);
 
   return backtrace;
 }
@@ -217,24 +218,28 @@ exc_debug_info(mrb_state *mrb, struct RObject *exc)
   mrb_callinfo *ci = mrb->c->ci;
   mrb_code *pc = ci->pc;
 
-  mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "ciidx"), mrb_fixnum_value((mrb_int)(ci - mrb->c->cibase)));
-  while (ci >= mrb->c->cibase) {
+  mrb_obj_iv_set(mrb, exc, MRB_SYM(ciidx), mrb_fixnum_value(ci->ciidx));
+  for (;;) {
     mrb_code *err = ci->err;
 
     if (!err && pc) err = pc - 1;
     if (err && ci->proc && !MRB_PROC_CFUNC_P(ci->proc)) {
       mrb_irep *irep = ci->proc->body.irep;
+      int32_t line;
+      char const* file;
 
-      int32_t const line = mrb_debug_get_line(irep, (uint32_t)(err - irep->iseq));
-      char const* file = mrb_debug_get_filename(irep, (uint32_t)(err - irep->iseq));
+      mrb_debug_info_materialize(mrb, irep);
+      line = mrb_debug_get_line(irep, (uint32_t)(err - irep->iseq));
+      file = mrb_debug_get_filename(irep, (uint32_t)(err - irep->iseq));
       if (line != -1 && file) {
-        mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "file"), mrb_str_new_cstr(mrb, file));
-        mrb_obj_iv_set(mrb, exc, mrb_intern_lit(mrb, "line"), mrb_fixnum_value(line));
+        mrb_obj_iv_set(mrb, exc, MRB_SYM(file), mrb_str_new_cstr(mrb, file));
+        mrb_obj_iv_set(mrb, exc, MRB_SYM(line), mrb_fixnum_value(line));
         return;
       }
     }
     pc = ci->pc;
-    ci--;
+    if (ci->ciidx == 0) break;
+    ci = mrb_ci_at(mrb->c, ci->ciidx - 1);
   }
 }
 
@@ -247,7 +252,7 @@ set_backtrace(mrb_state *mrb, mrb_value info, mrb_value bt)
 static mrb_bool
 have_backtrace(mrb_state *mrb, struct RObject *exc)
 {
-  return !mrb_nil_p(mrb_obj_iv_get(mrb, exc, mrb_intern_lit(mrb, "backtrace")));
+  return !mrb_nil_p(mrb_obj_iv_get(mrb, exc, MRB_SYM(backtrace)));
 }
 
 void
@@ -273,7 +278,7 @@ mrb_exc_set(mrb_state *mrb, mrb_value exc)
     mrb_gc_arena_restore(mrb, ai);
   }
 
-  mrb->backtrace.n = 0;
+  mrb_clear_backtrace(mrb);
   if (mrb_nil_p(exc)) {
     mrb->exc = 0;
   }
@@ -286,7 +291,10 @@ MRB_API mrb_noreturn void
 mrb_exc_raise(mrb_state *mrb, mrb_value exc)
 {
   mrb_exc_set(mrb, exc);
-  if (!mrb->gc.out_of_memory) {
+  /* an exception that already carries a backtrace (set_backtrace, or a
+     preallocated control-flow instance) keeps it; skipping the capture
+     makes re-raising such an exception allocation free */
+  if (!mrb->gc.out_of_memory && !have_backtrace(mrb, mrb->exc)) {
     exc_debug_info(mrb, mrb->exc);
     mrb_save_backtrace(mrb);
   }
@@ -297,6 +305,40 @@ mrb_exc_raise(mrb_state *mrb, mrb_value exc)
   MRB_THROW(mrb->jmp);
 }
 
+/*
+ * Raise a cached instance of exception class `c`.  Control-flow
+ * exceptions (StopIteration, FiberError, ...) are raised over and over
+ * with the same message and almost always caught and discarded, so
+ * allocating a fresh object plus message string per raise is wasted
+ * work.  The instance is created on the first raise, remembered in a
+ * hidden variable on the class, and carries an empty backtrace so
+ * mrb_exc_raise skips the capture as well.
+ */
+MRB_API mrb_noreturn void
+mrb_control_raise(mrb_state *mrb, struct RClass *c, const char *msg)
+{
+  mrb_value cache, exc, mesg;
+  mrb_int i, len;
+
+  cache = mrb_obj_iv_get(mrb, (struct RObject*)c, MRB_SYM(__control_exc__));
+  if (mrb_nil_p(cache)) {
+    cache = mrb_ary_new_capa(mrb, 1);
+    mrb_obj_iv_set(mrb, (struct RObject*)c, MRB_SYM(__control_exc__), cache);
+  }
+  len = RARRAY_LEN(cache);
+  for (i = 0; i < len; i++) {
+    exc = mrb_ary_ref(mrb, cache, i);
+    mesg = mrb_iv_get(mrb, exc, MRB_SYM(mesg));
+    if (mrb_string_p(mesg) && strcmp(RSTRING_PTR(mesg), msg) == 0) {
+      mrb_exc_raise(mrb, exc);
+    }
+  }
+  exc = mrb_exc_new_str(mrb, c, mrb_str_new_cstr(mrb, msg));
+  mrb_iv_set(mrb, exc, MRB_SYM(backtrace), mrb_ary_new(mrb));
+  mrb_ary_push(mrb, cache, exc);
+  mrb_exc_raise(mrb, exc);
+}
+
 MRB_API mrb_noreturn void
 mrb_raise(mrb_state *mrb, struct RClass *c, const char *msg)
 {
@@ -446,7 +488,7 @@ make_exception(mrb_state *mrb, int argc, const mrb_value *argv, mrb_bool isstr)
       n = 1;
 exception_call:
       {
-        mrb_sym exc = mrb_intern_lit(mrb, "exception");
+        mrb_sym exc = MRB_SYM(exception);
         if (mrb_respond_to(mrb, argv[0], exc)) {
           mesg = mrb_funcall_argv(mrb, argv[0], exc, n, argv+1);
         }
@@ -4,6 +4,7 @@
 ** See Copyright Notice in mruby.h
 */
 
+#include <string.h>
 #include <mruby.h>
 #include <mruby/string.h>
 #include <mruby/data.h>
@@ -17,12 +18,40 @@ mrb_data_object_alloc(mrb_state *mrb, struct RClass *klass, void *ptr, const mrb
   struct RData *data;
 
   data = (struct RData*)mrb_obj_alloc(mrb, MRB_TT_DATA, klass);
-  data->data = ptr;
+  data->as.heap.ptr = ptr;
   data->type = type;
 
   return data;
 }
 
+MRB_API struct RData*
+mrb_data_object_alloc_inline(mrb_state *mrb, struct RClass *klass, const void *ptr, size_t size, const mrb_data_type *type)
+{
+  struct RData *data;
+
+  if (size > MRB_DATA_INLINE_MAX) {
+    /* does not fit in the cell; degrade to the classic two-allocation
+       shape, which needs a dfree to release the payload */
+    void *p;
+
+    if (!type->dfree) {
+      mrb_raisef(mrb, E_ARGUMENT_ERROR, "%S too large for inline data and no dfree given",
+                 mrb_str_new_cstr(mrb, type->struct_name));
+    }
+    p = mrb_malloc(mrb, size);
+    if (ptr) memcpy(p, ptr, size);
+    else memset(p, 0, size);
+    return mrb_data_object_alloc(mrb, klass, p, type);
+  }
+  data = (struct RData*)mrb_obj_alloc(mrb, MRB_TT_DATA, klass);
+  data->flags |= MRB_DATA_INLINE;
+  data->type = type;
+  if (ptr) memcpy(data->as.buf, ptr, size);
+  else memset(data->as.buf, 0, size);
+
+  return data;
+}
+
 MRB_API void
 mrb_data_check_type(mrb_state *mrb, mrb_value obj, const mrb_data_type *type)
 {
@@ -54,6 +83,9 @@ mrb_data_check_get_ptr(mrb_state *mrb, mrb_value obj, const mrb_data_type *type)
   if (DATA_TYPE(obj) != type) {
     return NULL;
   }
+  if (mrb_data_inline_p(obj)) {
+    return RDATA(obj)->as.buf;
+  }
   return DATA_PTR(obj);
 }
 
@@ -61,6 +93,9 @@ MRB_API void*
 mrb_data_get_ptr(mrb_state *mrb, mrb_value obj, const mrb_data_type *type)
 {
   mrb_data_check_type(mrb, obj, type);
+  if (mrb_data_inline_p(obj)) {
+    return RDATA(obj)->as.buf;
+  }
   return DATA_PTR(obj);
 }
 
@@ -150,6 +185,9 @@ mrb_word_boxing_float_value(mrb_state *mrb, mrb_float f)
 {
   mrb_value v;
 
+#ifdef MRB_WORD_BOXING_FLONUM
+  if (mrb_flonum_pack(f, &v)) return v;
+#endif
   v.value.p = mrb_obj_alloc(mrb, MRB_TT_FLOAT, mrb->float_class);
   v.value.fp->f = f;
   return v;
@@ -158,7 +196,15 @@ mrb_word_boxing_float_value(mrb_state *mrb, mrb_float f)
 MRB_API mrb_value
 mrb_word_boxing_float_pool(mrb_state *mrb, mrb_float f)
 {
-  struct RFloat *nf = (struct RFloat *)mrb_malloc(mrb, sizeof(struct RFloat));
+  struct RFloat *nf;
+
+#ifdef MRB_WORD_BOXING_FLONUM
+  {
+    mrb_value v;
+    if (mrb_flonum_pack(f, &v)) return v;
+  }
+#endif
+  nf = (struct RFloat *)mrb_malloc(mrb, sizeof(struct RFloat));
   nf->tt = MRB_TT_FLOAT;
   nf->c = mrb->float_class;
   nf->f = f;
@@ -328,6 +328,328 @@ fmt_fp(struct fmt_args *f, long double y, int w, int p, int fl, int t)
   return MAX(w, pl+l);
 }
 
+/* Shortest round-trip digit generation for doubles, after the Grisu2
+ * algorithm (Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers", PLDI 2010). The produced digit string is
+ * guaranteed to read back as the same double; it is the shortest such
+ * string for the overwhelming majority of inputs. */
+
+typedef struct diy_fp {
+  uint64_t f;
+  int e;
+} diy_fp;
+
+#define DP_SIGNIFICAND_SIZE 52
+#define DP_EXPONENT_BIAS (0x3FF + DP_SIGNIFICAND_SIZE)
+#define DP_MIN_EXPONENT (-DP_EXPONENT_BIAS)
+#define DP_EXPONENT_MASK 0x7FF0000000000000ULL
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+
+static diy_fp
+double2diy_fp(double d)
+{
+  diy_fp fp;
+  uint64_t u64;
+  int biased_e;
+
+  memcpy(&u64, &d, sizeof(u64));
+  biased_e = (int)((u64 & DP_EXPONENT_MASK) >> DP_SIGNIFICAND_SIZE);
+  fp.f = u64 & DP_SIGNIFICAND_MASK;
+  if (biased_e != 0) {
+    fp.f += DP_HIDDEN_BIT;
+    fp.e = biased_e - DP_EXPONENT_BIAS;
+  }
+  else {
+    fp.e = DP_MIN_EXPONENT + 1;
+  }
+  return fp;
+}
+
+static diy_fp
+diy_fp_normalize(diy_fp v)
+{
+  while (!(v.f & 0x8000000000000000ULL)) {
+    v.f <<= 1;
+    v.e--;
+  }
+  return v;
+}
+
+/* 64x64->128 bit multiply keeping the (rounded) high half */
+static diy_fp
+diy_fp_mul(diy_fp x, diy_fp y)
+{
+  diy_fp r;
+  uint64_t a = x.f >> 32, b = x.f & 0xFFFFFFFFu;
+  uint64_t c = y.f >> 32, d = y.f & 0xFFFFFFFFu;
+  uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+  uint64_t tmp = (bd >> 32) + (ad & 0xFFFFFFFFu) + (bc & 0xFFFFFFFFu);
+
+  tmp += 1ULL << 31;  /* round */
+  r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+static diy_fp
+normalize_boundary(diy_fp in)
+{
+  while (!(in.f & (DP_HIDDEN_BIT << 1))) {
+    in.f <<= 1;
+    in.e--;
+  }
+  in.f <<= 64 - DP_SIGNIFICAND_SIZE - 2;
+  in.e -= 64 - DP_SIGNIFICAND_SIZE - 2;
+  return in;
+}
+
+static void
+normalized_boundaries(double d, diy_fp *out_m_minus, diy_fp *out_m_plus)
+{
+  diy_fp v = double2diy_fp(d);
+  diy_fp m_plus, m_minus;
+  mrb_bool significand_is_zero = v.f == DP_HIDDEN_BIT;
+
+  m_plus.f = (v.f << 1) + 1;
+  m_plus.e = v.e - 1;
+  m_plus = normalize_boundary(m_plus);
+  if (significand_is_zero) {
+    /* lower boundary is closer: v sits on a power-of-two */
+    m_minus.f = (v.f << 2) - 1;
+    m_minus.e = v.e - 2;
+  }
+  else {
+    m_minus.f = (v.f << 1) - 1;
+    m_minus.e = v.e - 1;
+  }
+  m_minus.f <<= m_minus.e - m_plus.e;
+  m_minus.e = m_plus.e;
+  *out_m_plus = m_plus;
+  *out_m_minus = m_minus;
+}
+
+/* powers of ten from 10^-348 to 10^340, every eighth exponent, as
+ * normalized diy_fp values */
+static const uint64_t powers_ten[] = {
+  0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL,
+  0xcf42894a5dce35eaULL, 0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL,
+  0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL, 0xbe5691ef416bd60cULL,
+  0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+  0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL,
+  0xc21094364dfb5637ULL, 0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL,
+  0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL, 0xb23867fb2a35b28eULL,
+  0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+  0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL,
+  0xb5b5ada8aaff80b8ULL, 0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL,
+  0x964e858c91ba2655ULL, 0xdff9772470297ebdULL, 0xa6dfbd9fb8e5b88fULL,
+  0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+  0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL,
+  0xaa242499697392d3ULL, 0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL,
+  0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL, 0x9c40000000000000ULL,
+  0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+  0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL,
+  0x9f4f2726179a2245ULL, 0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL,
+  0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL, 0x924d692ca61be758ULL,
+  0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+  0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL,
+  0x952ab45cfa97a0b3ULL, 0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL,
+  0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL, 0x88fcf317f22241e2ULL,
+  0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+  0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL,
+  0x8bab8eefb6409c1aULL, 0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL,
+  0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL, 0x80444b5e7aa7cf85ULL,
+  0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+  0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d8ULL, 0xaf87023b9bf0ee6aULL
+};
+static const int16_t powers_ten_e[] = {
+  -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007,
+   -980,  -954,  -927,  -901,  -874,  -847,  -821,  -794,  -768,
+   -741,  -715,  -688,  -661,  -635,  -608,  -582,  -555,  -529,
+   -502,  -475,  -449,  -422,  -396,  -369,  -343,  -316,  -289,
+   -263,  -236,  -210,  -183,  -157,  -130,  -103,   -77,   -50,
+    -24,     3,    30,    56,    83,   109,   136,   162,   189,
+    216,   242,   269,   295,   322,   348,   375,   402,   428,
+    455,   481,   508,   534,   561,   588,   614,   641,   667,
+    694,   720,   747,   774,   800,   827,   853,   880,   907,
+    933,   960,   986,  1013,  1039,  1066
+};
+
+/* pick the cached power of ten that scales a value with binary
+ * exponent e into the window digit_gen expects (e in [-59,-32]) */
+static diy_fp
+cached_power(int e, int *K)
+{
+  double dk = (-61 - e) * 0.30102999566398114 + 347;
+  int k = (int)dk;
+  int idx;
+  diy_fp c;
+
+  if (dk - k > 0.0) k++;
+  idx = (k >> 3) + 1;
+  *K = -(-348 + (idx << 3));
+  c.f = powers_ten[idx];
+  c.e = powers_ten_e[idx];
+  return c;
+}
+
+static const uint32_t pow10_32[] = {
+  1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+};
+
+static void
+grisu_round(char *buffer, int len, uint64_t delta, uint64_t rest,
+            uint64_t ten_kappa, uint64_t wp_w)
+{
+  while (rest < wp_w && delta - rest >= ten_kappa &&
+         (rest + ten_kappa < wp_w ||  /* closer */
+          wp_w - rest > rest + ten_kappa - wp_w)) {
+    buffer[len - 1]--;
+    rest += ten_kappa;
+  }
+}
+
+static int
+digit_gen(diy_fp W, diy_fp Mp, uint64_t delta, char *buffer, int *K)
+{
+  diy_fp one;
+  uint64_t wp_w = Mp.f - W.f;
+  uint64_t p2;
+  uint32_t p1, d;
+  int kappa, len = 0;
+
+  one.f = 1ULL << -Mp.e;
+  one.e = Mp.e;
+  p1 = (uint32_t)(Mp.f >> -one.e);
+  p2 = Mp.f & (one.f - 1);
+  for (kappa = 10; kappa > 1 && p1 < pow10_32[kappa - 1]; ) kappa--;
+  while (kappa > 0) {
+    uint64_t tmp;
+
+    d = p1 / pow10_32[kappa - 1];
+    p1 %= pow10_32[kappa - 1];
+    if (d || len) buffer[len++] = '0' + d;
+    kappa--;
+    tmp = ((uint64_t)p1 << -one.e) + p2;
+    if (tmp <= delta) {
+      *K += kappa;
+      grisu_round(buffer, len, delta, tmp,
+                  (uint64_t)pow10_32[kappa] << -one.e, wp_w);
+      return len;
+    }
+  }
+  for (;;) {
+    p2 *= 10;
+    delta *= 10;
+    d = (uint32_t)(p2 >> -one.e);
+    if (d || len) buffer[len++] = '0' + d;
+    p2 &= one.f - 1;
+    kappa--;
+    if (p2 < delta) {
+      *K += kappa;
+      /* -kappa can exceed the table for long fractional expansions; a
+         zero weight just disables the rounding nudge for those */
+      grisu_round(buffer, len, delta, p2, one.f,
+                  -kappa < 10 ? wp_w * pow10_32[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+/* write the digits of v (finite, > 0) into buffer and return their
+ * count; v == 0.buffer * 10^(count + *K) */
+static int
+grisu2(double v, char *buffer, int *K)
+{
+  diy_fp w_m, w_p, w, c_mk;
+  uint64_t delta;
+
+  normalized_boundaries(v, &w_m, &w_p);
+  w = diy_fp_normalize(double2diy_fp(v));
+  c_mk = cached_power(w_p.e, K);
+  w = diy_fp_mul(w, c_mk);
+  w_p = diy_fp_mul(w_p, c_mk);
+  w_m = diy_fp_mul(w_m, c_mk);
+  w_m.f++;  /* shrink the interval so any digit string inside it */
+  w_p.f--;  /* is guaranteed to read back as v */
+  delta = w_p.f - w_m.f;
+  return digit_gen(w, w_p, delta, buffer, K);
+}
+
+/* Fast path for %g: when the shortest round-trip form of y fits in the
+ * requested precision it is, after zero-trimming, exactly what the slow
+ * path would print, so emit it directly. Returns FALSE when the caller
+ * must fall back to fmt_fp (more digits needed, non-finite input, or a
+ * precision our equivalence argument does not cover). */
+static mrb_bool
+fmt_g_shortest(struct fmt_args *f, double y, int p, int t)
+{
+  char digits[20];
+  char buf[40], *s = buf;
+  int n, K = 0, X, i;
+
+  if (p < 0) p = 6;
+  else if (p == 0) p = 1;
+  if (p > 14 || !isfinite(y)) return FALSE;
+  if (signbit(y)) {
+    *s++ = '-';
+    y = -y;
+  }
+  if (y == 0) {
+    *s++ = '0';
+    out(f, buf, s - buf);
+    return TRUE;
+  }
+  /* for subnormals an ulp is no longer small relative to the value, so
+   * the shortest form can differ from the rounded fixed-precision one */
+  if (y < DBL_MIN) return FALSE;
+  n = grisu2(y, digits, &K);
+  while (n > 1 && digits[n - 1] == '0') {
+    n--;
+    K++;
+  }
+  if (n > p) return FALSE;
+  X = n + K - 1;                /* exponent of the leading digit */
+  if (X < -4 || X >= p) {       /* exponential form */
+    *s++ = digits[0];
+    if (n > 1) {
+      *s++ = '.';
+      memcpy(s, digits + 1, n - 1);
+      s += n - 1;
+    }
+    *s++ = (t == 'G') ? 'E' : 'e';
+    *s++ = (X < 0) ? '-' : '+';
+    i = (X < 0) ? -X : X;
+    if (i >= 100) {
+      *s++ = '0' + i / 100;
+      i %= 100;
+    }
+    *s++ = '0' + i / 10;
+    *s++ = '0' + i % 10;
+  }
+  else if (X < 0) {             /* 0.00ddd */
+    *s++ = '0';
+    *s++ = '.';
+    for (i = -1; i > X; i--) *s++ = '0';
+    memcpy(s, digits, n);
+    s += n;
+  }
+  else if (n > X + 1) {         /* dd.ddd */
+    memcpy(s, digits, X + 1);
+    s += X + 1;
+    *s++ = '.';
+    memcpy(s, digits + X + 1, n - X - 1);
+    s += n - X - 1;
+  }
+  else {                        /* ddd00 */
+    memcpy(s, digits, n);
+    s += n;
+    for (i = n; i <= X; i++) *s++ = '0';
+  }
+  out(f, buf, s - buf);
+  return TRUE;
+}
+
 static int
 fmt_core(struct fmt_args *f, const char *fmt, mrb_float flo)
 {
@@ -349,12 +671,17 @@ fmt_core(struct fmt_args *f, const char *fmt, mrb_float flo)
   }
 
   switch (*fmt) {
-  case 'e': case 'f': case 'g': case 'a':
-  case 'E': case 'F': case 'G': case 'A':
+  case 'g': case 'G':
+    if (fmt_g_shortest(f, (double)flo, p, *fmt)) {
+      return 0;
+    }
+    /* fall through to the exact long-division formatter */
+  case 'e': case 'f': case 'a':
+  case 'E': case 'F': case 'A':
     return fmt_fp(f, flo, 0, p, 0, *fmt);
   default:
     return -1;
-  } 
+  }
 }
 
 mrb_value
@@ -6,6 +6,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/class.h>
@@ -16,7 +17,14 @@
 #include <mruby/string.h>
 #include <mruby/variable.h>
 #include <mruby/gc.h>
+#include <mruby/khash.h>
 #include <mruby/error.h>
+#include <mruby/trace.h>
+
+/* this file defines the barrier slow paths; drop the call-site
+   fast-path macros from mruby.h so the definitions below compile */
+#undef mrb_field_write_barrier
+#undef mrb_write_barrier
 
 /*
   = Tri-color Incremental Garbage Collection
@@ -176,7 +184,7 @@ gettimeofday_time(void)
 #define GC_GRAY 0
 #define GC_WHITE_A 1
 #define GC_WHITE_B (1 << 1)
-#define GC_BLACK (1 << 2)
+#define GC_BLACK MRB_GC_COLOR_BLACK
 #define GC_WHITES (GC_WHITE_A | GC_WHITE_B)
 #define GC_COLOR_MASK 7
 
@@ -303,6 +311,20 @@ link_free_heap_page(mrb_gc *gc, mrb_heap_page *page)
     gc->free_heaps->free_prev = page;
   }
   gc->free_heaps = page;
+  if (gc->free_heaps_tail == NULL)
+    gc->free_heaps_tail = page;
+}
+
+static void
+link_free_heap_page_tail(mrb_gc *gc, mrb_heap_page *page)
+{
+  if (gc->free_heaps_tail == NULL) {
+    link_free_heap_page(gc, page);
+    return;
+  }
+  page->free_prev = gc->free_heaps_tail;
+  gc->free_heaps_tail->free_next = page;
+  gc->free_heaps_tail = page;
 }
 
 static void
@@ -314,6 +336,8 @@ unlink_free_heap_page(mrb_gc *gc, mrb_heap_page *page)
     page->free_next->free_prev = page->free_prev;
   if (gc->free_heaps == page)
     gc->free_heaps = page->free_next;
+  if (gc->free_heaps_tail == page)
+    gc->free_heaps_tail = page->free_prev;
   page->free_prev = NULL;
   page->free_next = NULL;
 }
@@ -322,10 +346,13 @@ static void
 add_heap(mrb_state *mrb, mrb_gc *gc)
 {
   mrb_heap_page *page = (mrb_heap_page *)mrb_calloc(mrb, 1, sizeof(mrb_heap_page) + MRB_HEAP_PAGE_SIZE * sizeof(RVALUE));
-  RVALUE *p, *e;
+  RVALUE *p, *b;
   struct RBasic *prev = NULL;
 
-  for (p = objects(page), e=p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
+  /* chain the slots in address order so allocation bumps through the
+     fresh page front to back */
+  b = objects(page);
+  for (p = b+MRB_HEAP_PAGE_SIZE; p-- > b; ) {
     p->as.free.tt = MRB_TT_FREE;
     p->as.free.next = prev;
     prev = &p->as.basic;
@@ -339,10 +366,83 @@ add_heap(mrb_state *mrb, mrb_gc *gc)
 #define DEFAULT_GC_INTERVAL_RATIO 200
 #define DEFAULT_GC_STEP_RATIO 200
 #define DEFAULT_MAJOR_GC_INC_RATIO 200
+#define DEFAULT_GC_STEP_RATIO_MIN 50
+#define DEFAULT_GC_STEP_RATIO_MAX 1000
+#define MAJOR_GC_INC_RATIO_MIN 110
+#define MAJOR_GC_INC_RATIO_MAX 600
 #define is_generational(gc) ((gc)->generational)
 #define is_major_gc(gc) (is_generational(gc) && (gc)->full)
 #define is_minor_gc(gc) (is_generational(gc) && !(gc)->full)
 
+#ifndef MRB_SLAB_PAGE_BYTES
+#define MRB_SLAB_PAGE_BYTES 4096
+#endif
+
+/* sized allocator for small auxiliary buffers (khash tables,
+   environment stacks). Chunks are served from GC-owned pages carved
+   into one power-of-two size class each, so small allocations carry no
+   per-chunk malloc metadata and stay close together in memory. Freed
+   chunks go back to their class freelist; pages are only returned to
+   the system in mrb_gc_destroy. */
+
+static int
+slab_class(size_t size)
+{
+  int sc = 0;
+
+  while (((size_t)1 << (sc + MRB_SLAB_MIN_SHIFT)) < size) {
+    sc++;
+  }
+  return sc;
+}
+
+void*
+mrb_slab_alloc(mrb_state *mrb, size_t size)
+{
+  mrb_gc *gc = &mrb->gc;
+  int sc;
+  void *p;
+
+  if (size > ((size_t)1 << MRB_SLAB_MAX_SHIFT)) {
+    return mrb_malloc(mrb, size);
+  }
+  sc = slab_class(size);
+  if (!gc->slab_freelist[sc]) {
+    /* carve a fresh page into chunks of this class */
+    size_t csize = (size_t)1 << (sc + MRB_SLAB_MIN_SHIFT);
+    mrb_slab_page *page = (mrb_slab_page*)mrb_malloc(mrb, sizeof(mrb_slab_page) + MRB_SLAB_PAGE_BYTES);
+    uint8_t *c = (uint8_t*)(page + 1);
+    uint8_t *e = c + MRB_SLAB_PAGE_BYTES;
+
+    page->h.next = gc->slab_pages;
+    gc->slab_pages = page;
+    while (c + csize <= e) {
+      *(void**)c = gc->slab_freelist[sc];
+      gc->slab_freelist[sc] = c;
+      c += csize;
+    }
+  }
+  p = gc->slab_freelist[sc];
+  gc->slab_freelist[sc] = *(void**)p;
+  return p;
+}
+
+void
+mrb_slab_free(mrb_state *mrb, void *p, size_t size)
+{
+  mrb_gc *gc = &mrb->gc;
+  int sc;
+
+  if (p == NULL) return;
+  if (size > ((size_t)1 << MRB_SLAB_MAX_SHIFT)) {
+    mrb_free(mrb, p);
+    return;
+  }
+  sc = slab_class(size);
+  *(void**)p = gc->slab_freelist[sc];
+  gc->slab_freelist[sc] = p;
+}
+
 void
 mrb_gc_init(mrb_state *mrb, mrb_gc *gc)
 {
@@ -354,9 +454,27 @@ mrb_gc_init(mrb_state *mrb, mrb_gc *gc)
   gc->current_white_part = GC_WHITE_A;
   gc->heaps = NULL;
   gc->free_heaps = NULL;
+  gc->free_heaps_tail = NULL;
+  gc->slab_pages = NULL;
+  gc->alloc_trace = NULL;
+  gc->weak_slots = NULL;
+  gc->weak_count = 0;
+  gc->weak_capa = 0;
+  gc->max_pause_us = 0;
+  gc->pause_debt = 0.0;
+  {
+    int i;
+
+    for (i = 0; i < MRB_SLAB_CLASSES; i++) {
+      gc->slab_freelist[i] = NULL;
+    }
+  }
   add_heap(mrb, gc);
   gc->interval_ratio = DEFAULT_GC_INTERVAL_RATIO;
   gc->step_ratio = DEFAULT_GC_STEP_RATIO;
+  gc->step_ratio_min = DEFAULT_GC_STEP_RATIO_MIN;
+  gc->step_ratio_max = DEFAULT_GC_STEP_RATIO_MAX;
+  gc->majorgc_inc_ratio = DEFAULT_MAJOR_GC_INC_RATIO;
 #ifndef MRB_GC_TURN_OFF_GENERATIONAL
   gc->generational = TRUE;
   gc->full = TRUE;
@@ -368,6 +486,8 @@ mrb_gc_init(mrb_state *mrb, mrb_gc *gc)
 }
 
 static void obj_free(mrb_state *mrb, struct RBasic *obj);
+static size_t incremental_sweep_phase(mrb_state *mrb, mrb_gc *gc, size_t limit);
+static double gc_clock(void);
 
 void
 free_heap(mrb_state *mrb, mrb_gc *gc)
@@ -390,15 +510,121 @@ free_heap(mrb_state *mrb, mrb_gc *gc)
 void
 mrb_gc_destroy(mrb_state *mrb, mrb_gc *gc)
 {
+  mrb_slab_page *spage;
+
+  mrb_alloc_trace_stop(mrb);
+  mrb_census_stop(mrb);
   free_heap(mrb, gc);
+  /* after free_heap no slab chunk is referenced any more */
+  spage = gc->slab_pages;
+  while (spage) {
+    mrb_slab_page *tmp = spage;
+
+    spage = spage->h.next;
+    mrb_free(mrb, tmp);
+  }
+  /* cells unregister themselves from obj_free, so the registry must
+     outlive free_heap above */
+  mrb_free(mrb, gc->weak_slots);
 #ifndef MRB_GC_FIXED_ARENA
   mrb_free(mrb, gc->arena);
 #endif
 }
 
+/* Teardown counterpart of mrb_gc_destroy for mrb_close_fast: only
+   objects holding resources outside the state's allocator -- RData
+   with a dfree -- get a callback; every other object's storage is
+   reclaimed when the embedder drops the allocator's memory.  The walk
+   is one type-tag test per cell and the frees are one per page, so
+   closing costs O(heap pages) instead of O(objects). */
+void
+mrb_gc_destroy_fast(mrb_state *mrb, mrb_gc *gc)
+{
+  mrb_heap_page *page = gc->heaps;
+  mrb_heap_page *tmp;
+  mrb_slab_page *spage;
+  RVALUE *p, *e;
+
+  mrb_alloc_trace_stop(mrb);
+  mrb_census_stop(mrb);
+  while (page) {
+    tmp = page;
+    page = page->next;
+    for (p = objects(tmp), e = p+MRB_HEAP_PAGE_SIZE; p<e; p++) {
+      if (p->as.free.tt != MRB_TT_DATA) continue;
+      if (MRB_FLAG_TEST(&p->as.basic, MRB_DATA_INLINE)) continue;
+      if (p->as.data.type && p->as.data.type->dfree) {
+        p->as.data.type->dfree(mrb, p->as.data.as.heap.ptr);
+      }
+    }
+    mrb_free(mrb, tmp);
+  }
+  spage = gc->slab_pages;
+  while (spage) {
+    mrb_slab_page *stmp = spage;
+
+    spage = spage->h.next;
+    mrb_free(mrb, stmp);
+  }
+  mrb_free(mrb, gc->weak_slots);
+#ifndef MRB_GC_FIXED_ARENA
+  mrb_free(mrb, gc->arena);
+#endif
+}
+
+MRB_API void
+mrb_gc_register_weak(mrb_state *mrb, mrb_value *cell)
+{
+  mrb_gc *gc = &mrb->gc;
+
+  if (gc->weak_count == gc->weak_capa) {
+    size_t capa = gc->weak_capa ? gc->weak_capa*2 : 8;
+
+    gc->weak_slots = (mrb_value**)mrb_realloc(mrb, gc->weak_slots, sizeof(mrb_value*)*capa);
+    gc->weak_capa = capa;
+  }
+  gc->weak_slots[gc->weak_count++] = cell;
+}
+
+MRB_API void
+mrb_gc_unregister_weak(mrb_state *mrb, mrb_value *cell)
+{
+  mrb_gc *gc = &mrb->gc;
+  size_t i;
+
+  for (i = 0; i < gc->weak_count; i++) {
+    if (gc->weak_slots[i] == cell) {
+      gc->weak_slots[i] = gc->weak_slots[--gc->weak_count];
+      return;
+    }
+  }
+}
+
+/* runs between the final mark and the sweep; anything a weak cell
+   still points at that did not get marked is about to be freed, so nil
+   the cell before the mutator can observe a dangling value */
+static void
+clear_weak_slots(mrb_state *mrb, mrb_gc *gc)
+{
+  size_t i;
+
+  for (i = 0; i < gc->weak_count; i++) {
+    mrb_value *cell = gc->weak_slots[i];
+
+    if (!mrb_immediate_p(*cell) && is_dead(gc, mrb_basic_ptr(*cell))) {
+      SET_NIL_VALUE(*cell);
+    }
+  }
+}
+
 static void
 gc_protect(mrb_state *mrb, mrb_gc *gc, struct RBasic *p)
 {
+  if (gc->arena_idx > 0 && gc->arena[gc->arena_idx-1] == p) {
+    /* already on top of the arena; protecting an object right after
+       allocating it is the common case and needs no second slot */
+    return;
+  }
 #ifdef MRB_GC_FIXED_ARENA
   if (gc->arena_idx >= MRB_GC_ARENA_SIZE) {
     /* arena overflow error */
@@ -413,6 +639,9 @@ gc_protect(mrb_state *mrb, mrb_gc *gc, struct RBasic *p)
   }
 #endif
   gc->arena[gc->arena_idx++] = p;
+  if (gc->arena_idx > gc->stats.arena_peak) {
+    gc->stats.arena_peak = gc->arena_idx;
+  }
 }
 
 /* mrb_gc_protect() leaves the object in the arena */
@@ -462,14 +691,511 @@ mrb_gc_unregister(mrb_state *mrb, mrb_value obj)
   }
   a = mrb_ary_ptr(table);
   mrb_ary_modify(mrb, a);
-  for (i=j=0; i<a->len; i++) {
-    if (!mrb_obj_eq(mrb, a->ptr[i], obj)) {
-      a->ptr[j++] = a->ptr[i];
+  for (i=j=0; i<ARY_LEN(a); i++) {
+    if (!mrb_obj_eq(mrb, ARY_PTR(a)[i], obj)) {
+      ARY_PTR(a)[j++] = ARY_PTR(a)[i];
+    }
+  }
+  ARY_SET_LEN(a, j);
+}
+
+/* sampled allocation tracing; the steady-state cost when enabled is one
+   pointer test and a decrement per allocation */
+
+static void
+alloc_trace_record(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
+{
+  mrb_alloc_trace *tr = mrb->gc.alloc_trace;
+  mrb_alloc_trace_rec *rec;
+
+  tr->countdown = tr->interval;
+  rec = &tr->samples[tr->head];
+  tr->head = (tr->head + 1) % tr->capacity;
+  if (tr->count < tr->capacity) tr->count++;
+  rec->tt = (uint8_t)ttype;
+  rec->mid = (mrb->c && mrb->c->ci) ? mrb->c->ci->mid : 0;
+  /* class name via __classid__ only: resolving the full path could
+     allocate, and we are inside the allocator */
+  rec->cname = cls ? mrb_class_sym(mrb, mrb_class_real(cls), NULL) : 0;
+}
+
+MRB_API void
+mrb_alloc_trace_start(mrb_state *mrb, int32_t interval, int32_t capacity)
+{
+  mrb_alloc_trace *tr;
+
+  mrb_alloc_trace_stop(mrb);
+  if (interval < 1) interval = 1;
+  if (capacity < 1) capacity = 1;
+  tr = (mrb_alloc_trace*)mrb_malloc(mrb, sizeof(mrb_alloc_trace));
+  tr->interval = (uint32_t)interval;
+  tr->countdown = (uint32_t)interval;
+  tr->capacity = (size_t)capacity;
+  tr->head = 0;
+  tr->count = 0;
+  tr->samples = (mrb_alloc_trace_rec*)mrb_malloc(mrb, sizeof(mrb_alloc_trace_rec)*(size_t)capacity);
+  mrb->gc.alloc_trace = tr;
+}
+
+MRB_API void
+mrb_alloc_trace_stop(mrb_state *mrb)
+{
+  mrb_alloc_trace *tr = mrb->gc.alloc_trace;
+
+  if (!tr) return;
+  mrb->gc.alloc_trace = NULL;
+  mrb_free(mrb, tr->samples);
+  mrb_free(mrb, tr);
+}
+
+/* per-class census: live object counts and bytes keyed by class.
+   Allocation bumps the published table; every completed full sweep
+   rebuilds a fresh table from the survivors it scans anyway, which
+   both corrects any drift and re-measures external buffer sizes.
+   The sweep scan only ever touches live objects, whose classes are
+   guaranteed live too, so unlike obj_free-time accounting it never
+   chases class pointers into pages released earlier in the sweep. */
+
+typedef struct census_acct {
+  mrb_int count;
+  mrb_int bytes;
+} census_acct;
+
+static inline khint_t
+census_hash_func(mrb_state *mrb, struct RClass *key)
+{
+  return (khint_t)((uintptr_t)key >> 3);
+}
+#define census_hash_equal(mrb, a, b) ((a) == (b))
+
+KHASH_DECLARE(census, struct RClass*, census_acct, TRUE)
+KHASH_DEFINE(census, struct RClass*, census_acct, TRUE, census_hash_func, census_hash_equal)
+
+/* the class an object is accounted under: singleton and include
+   wrapper classes resolve to the real class behind them */
+static struct RClass*
+census_class(struct RClass *c)
+{
+  while (c && (c->tt == MRB_TT_SCLASS || c->tt == MRB_TT_ICLASS)) {
+    c = c->super;
+  }
+  return c;
+}
+
+/* bytes owned by the object beyond its heap cell: buffer capacities,
+   table buckets and stacks.  Shared buffers are apportioned across
+   their sharers; irep memory (shared between procs) and RData
+   payloads of unknown size are not charged. */
+static mrb_int
+obj_memsize(mrb_state *mrb, struct RBasic *obj)
+{
+  mrb_int bytes = sizeof(RVALUE);
+
+  switch (obj->tt) {
+  case MRB_TT_DATA:
+    if (MRB_FLAG_TEST(obj, MRB_DATA_INLINE)) break;
+    /* fall through */
+
+  case MRB_TT_OBJECT:
+  case MRB_TT_EXCEPTION:
+    bytes += mrb_gc_iv_memsize(mrb, (struct RObject*)obj);
+    break;
+
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+    bytes += mrb_gc_iv_memsize(mrb, (struct RObject*)obj);
+    bytes += mrb_gc_mt_memsize(mrb, (struct RClass*)obj);
+    break;
+
+  case MRB_TT_ICLASS:
+    if (MRB_FLAG_TEST(obj, MRB_FLAG_IS_ORIGIN))
+      bytes += mrb_gc_mt_memsize(mrb, (struct RClass*)obj);
+    break;
+
+  case MRB_TT_STRING:
+    bytes += mrb_gc_str_memsize(mrb, (struct RString*)obj);
+    break;
+
+  case MRB_TT_ARRAY:
+    {
+      struct RArray *a = (struct RArray*)obj;
+
+      if (ARY_SHARED_P(a)) {
+        mrb_shared_array *s = a->as.heap.aux.shared;
+
+        bytes += (mrb_int)((sizeof(mrb_shared_array) + sizeof(mrb_value)*(size_t)s->len)
+                           / (s->refcnt > 0 ? s->refcnt : 1));
+      }
+      else if (!ARY_EMBED_P(a)) {
+        bytes += sizeof(mrb_value)*a->as.heap.aux.capa;
+      }
+    }
+    break;
+
+  case MRB_TT_HASH:
+    bytes += mrb_gc_iv_memsize(mrb, (struct RObject*)obj);
+    bytes += mrb_gc_hash_memsize(mrb, (struct RHash*)obj);
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+
+      if (!MRB_ENV_STACK_SHARED_P(e))
+        bytes += sizeof(mrb_value)*MRB_ENV_STACK_LEN(e);
+    }
+    break;
+
+  case MRB_TT_RANGE:
+    if (((struct RRange*)obj)->edges)
+      bytes += sizeof(mrb_range_edges);
+    break;
+
+  case MRB_TT_FIBER:
+    {
+      struct mrb_context *c = ((struct RFiber*)obj)->cxt;
+
+      if (c && c != mrb->root_c) {
+        bytes += sizeof(struct mrb_context);
+        bytes += sizeof(mrb_value)*(c->stend - c->stbase);
+        bytes += (sizeof(mrb_callinfo*) + sizeof(mrb_callinfo)*MRB_CALLINFO_SEG_SIZE)*c->cisegs;
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+  return bytes;
+}
+
+static void
+census_add(mrb_state *mrb, struct kh_census *t, struct RClass *cls, mrb_int count, mrb_int bytes)
+{
+  mrb_gc *gc = &mrb->gc;
+  struct kh_census *cur, *nxt;
+  khiter_t k;
+  int ret;
+
+  cls = census_class(cls);
+  if (!cls) return;
+  /* a kh_put that grows the table allocates; an emergency full GC
+     taken on that path must not swap the tables out from under us */
+  cur = gc->census; nxt = gc->census_next;
+  gc->census = gc->census_next = NULL;
+  k = kh_put2(census, mrb, t, cls, &ret);
+  gc->census = cur; gc->census_next = nxt;
+  if (ret != 0) {
+    kh_value(t, k).count = 0;
+    kh_value(t, k).bytes = 0;
+  }
+  kh_value(t, k).count += count;
+  kh_value(t, k).bytes += bytes;
+}
+
+static void
+census_scan(mrb_state *mrb, mrb_gc *gc, struct kh_census *t)
+{
+  mrb_heap_page *page;
+
+  for (page = gc->heaps; page; page = page->next) {
+    RVALUE *p = objects(page);
+    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
+
+    for (; p < e; p++) {
+      if (p->as.basic.tt == MRB_TT_FREE) continue;
+      if (is_dead(gc, &p->as.basic)) continue;
+      census_add(mrb, t, p->as.basic.c, 1, obj_memsize(mrb, &p->as.basic));
+    }
+  }
+}
+
+/*
+ * Starts per-class accounting with one seeding scan of the heap; that
+ * scan is the only full walk.  Counts are exact as of the last full-GC
+ * boundary plus allocations since, and byte sizes (which change as
+ * buffers grow) are re-measured at each boundary.
+ */
+MRB_API void
+mrb_census_start(mrb_state *mrb)
+{
+  mrb_gc *gc = &mrb->gc;
+
+  if (gc->census) return;
+  gc->census = kh_init(census, mrb);
+  census_scan(mrb, gc, gc->census);
+}
+
+MRB_API void
+mrb_census_stop(mrb_state *mrb)
+{
+  mrb_gc *gc = &mrb->gc;
+
+  if (gc->census) {
+    kh_destroy(census, mrb, gc->census);
+    gc->census = NULL;
+  }
+  if (gc->census_next) {
+    kh_destroy(census, mrb, gc->census_next);
+    gc->census_next = NULL;
+  }
+}
+
+/*
+ * Yields every accounted class with its live object count and byte
+ * total (cells plus external buffers); starts accounting on first use.
+ */
+MRB_API void
+mrb_census_each(mrb_state *mrb, mrb_census_callback *cb, void *data)
+{
+  mrb_gc *gc = &mrb->gc;
+  struct kh_census *t;
+  struct census_snap { struct RClass *cls; census_acct acct; } *snap;
+  khiter_t k;
+  size_t n = 0, i;
+
+  if (!gc->census) mrb_census_start(mrb);
+  t = gc->census;
+  /* snapshot first: the callback may allocate and a triggered
+     collection would rebuild the table under the iteration */
+  snap = (struct census_snap*)mrb_malloc(mrb, sizeof(struct census_snap)*(kh_size(t)+1));
+  for (k = kh_begin(t); k != kh_end(t); k++) {
+    if (!kh_exist(t, k)) continue;
+    if (kh_value(t, k).count <= 0) continue;
+    snap[n].cls = kh_key(t, k);
+    snap[n].acct = kh_value(t, k);
+    n++;
+  }
+  for (i = 0; i < n; i++) {
+    struct RClass *cls = snap[i].cls;
+
+    /* entries can outlive their class until the rebuild at the next
+       full-GC boundary drops them; skip anything no longer a class */
+    if (cls->tt != MRB_TT_CLASS && cls->tt != MRB_TT_MODULE) continue;
+    if (mrb_object_dead_p(mrb, (struct RBasic*)cls)) continue;
+    cb(mrb, cls, snap[i].acct.count, snap[i].acct.bytes, data);
+  }
+  mrb_free(mrb, snap);
+}
+
+#ifndef MRB_DISABLE_STDIO
+
+/* heap dump: one JSON line per live object for offline retention and
+   dominator analysis (tools/heap_graph.rb).  The reference lists
+   mirror the gc_mark_children traversal, so an edge exists in the dump
+   exactly where the collector would keep a child alive.  RData
+   payloads traverse through dmark and cannot be enumerated; they are
+   dumped without their native references. */
+
+struct heap_dump_ctx {
+  FILE *fp;
+  mrb_bool first;               /* no ref written yet for this record */
+};
+
+static void
+dump_ref_ptr(struct heap_dump_ctx *d, void *ptr)
+{
+  if (!ptr) return;
+  fprintf(d->fp, "%s\"%p\"", d->first ? "" : ",", ptr);
+  d->first = FALSE;
+}
+
+static void
+dump_ref_value(struct heap_dump_ctx *d, mrb_value v)
+{
+  if (mrb_immediate_p(v)) return;
+  dump_ref_ptr(d, mrb_basic_ptr(v));
+}
+
+static int
+dump_iv_ref_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *ud)
+{
+  dump_ref_value((struct heap_dump_ctx*)ud, v);
+  return 0;
+}
+
+static int
+dump_hash_ref_i(mrb_state *mrb, mrb_value key, mrb_value val, void *ud)
+{
+  dump_ref_value((struct heap_dump_ctx*)ud, key);
+  dump_ref_value((struct heap_dump_ctx*)ud, val);
+  return 0;
+}
+
+static void
+dump_mt_refs(struct heap_dump_ctx *d, struct RClass *c)
+{
+  khash_t(mt) *h = c->mt;
+  khiter_t k;
+
+  if (!h) return;
+  for (k = kh_begin(h); k != kh_end(h); k++) {
+    if (kh_exist(h, k)) dump_ref_ptr(d, kh_value(h, k));
+  }
+}
+
+static void
+dump_context_refs(struct heap_dump_ctx *d, struct mrb_context *c)
+{
+  mrb_value *sp;
+  int i;
+
+  if (!c) return;
+  for (sp = c->stbase; sp && sp < c->stend; sp++) {
+    dump_ref_value(d, *sp);
+  }
+  if (c->ciseg && c->ci) {
+    for (i = 0; i <= c->ci->ciidx; i++) {
+      mrb_callinfo *ci = mrb_ci_at(c, i);
+
+      dump_ref_ptr(d, ci->env);
+      dump_ref_ptr(d, ci->proc);
+      dump_ref_ptr(d, ci->target_class);
     }
   }
-  a->len = j;
+  if (c->prev && c->prev->fib) dump_ref_ptr(d, c->prev->fib);
 }
 
+static void
+heap_dump_obj(mrb_state *mrb, FILE *fp, struct RBasic *obj)
+{
+  struct heap_dump_ctx d;
+  struct RClass *cls = census_class(obj->c);
+  mrb_sym cname = cls ? mrb_class_sym(mrb, cls, NULL) : 0;
+  const char *name = cname ? mrb_sym2name(mrb, cname) : "";
+
+  fprintf(fp, "{\"addr\":\"%p\",\"tt\":%d,\"class\":\"%s\",\"size\":%ld,\"refs\":[",
+          (void*)obj, (int)obj->tt, name, (long)obj_memsize(mrb, obj));
+  d.fp = fp;
+  d.first = TRUE;
+  dump_ref_ptr(&d, obj->c);
+  switch (obj->tt) {
+  case MRB_TT_ICLASS:
+    if (MRB_FLAG_TEST(obj, MRB_FLAG_IS_ORIGIN))
+      dump_mt_refs(&d, (struct RClass*)obj);
+    dump_ref_ptr(&d, ((struct RClass*)obj)->super);
+    break;
+
+  case MRB_TT_CLASS:
+  case MRB_TT_MODULE:
+  case MRB_TT_SCLASS:
+    dump_mt_refs(&d, (struct RClass*)obj);
+    dump_ref_ptr(&d, ((struct RClass*)obj)->super);
+    mrb_iv_foreach(mrb, mrb_obj_value(obj), dump_iv_ref_i, &d);
+    break;
+
+  case MRB_TT_DATA:
+    if (MRB_FLAG_TEST(obj, MRB_DATA_INLINE)) break;
+    /* fall through */
+
+  case MRB_TT_OBJECT:
+  case MRB_TT_EXCEPTION:
+    mrb_iv_foreach(mrb, mrb_obj_value(obj), dump_iv_ref_i, &d);
+    break;
+
+  case MRB_TT_PROC:
+    dump_ref_ptr(&d, ((struct RProc*)obj)->env);
+    dump_ref_ptr(&d, ((struct RProc*)obj)->target_class);
+    break;
+
+  case MRB_TT_ENV:
+    {
+      struct REnv *e = (struct REnv*)obj;
+      mrb_int i, len = MRB_ENV_STACK_LEN(e);
+
+      for (i = 0; i < len; i++) {
+        dump_ref_value(&d, e->stack[i]);
+      }
+    }
+    break;
+
+  case MRB_TT_FIBER:
+    dump_context_refs(&d, ((struct RFiber*)obj)->cxt);
+    break;
+
+  case MRB_TT_ARRAY:
+    {
+      struct RArray *a = (struct RArray*)obj;
+      mrb_int i, len = ARY_LEN(a);
+
+      for (i = 0; i < len; i++) {
+        dump_ref_value(&d, ARY_PTR(a)[i]);
+      }
+    }
+    break;
+
+  case MRB_TT_HASH:
+    mrb_iv_foreach(mrb, mrb_obj_value(obj), dump_iv_ref_i, &d);
+    mrb_hash_foreach(mrb, (struct RHash*)obj, dump_hash_ref_i, &d);
+    break;
+
+  case MRB_TT_RANGE:
+    {
+      struct RRange *r = (struct RRange*)obj;
+
+      if (r->edges) {
+        dump_ref_value(&d, r->edges->beg);
+        dump_ref_value(&d, r->edges->end);
+      }
+    }
+    break;
+
+  default:
+    break;
+  }
+  fputs("]}\n", fp);
+}
+
+static int
+dump_root_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *ud)
+{
+  dump_ref_value((struct heap_dump_ctx*)ud, v);
+  return 0;
+}
+
+/*
+ * Writes the live heap as JSON lines: a leading record naming the GC
+ * roots (globals, toplevel objects, the protection arena and the
+ * running context), then one record per object.  Nothing is allocated
+ * while dumping, so the heap is not perturbed.
+ */
+MRB_API void
+mrb_heap_dump(mrb_state *mrb, FILE *fp)
+{
+  mrb_gc *gc = &mrb->gc;
+  mrb_heap_page *page;
+  struct heap_dump_ctx d;
+  int i;
+
+  d.fp = fp;
+  d.first = TRUE;
+  fputs("{\"roots\":[", fp);
+  dump_ref_ptr(&d, mrb->object_class);
+  dump_ref_ptr(&d, mrb->top_self);
+  dump_ref_ptr(&d, mrb->exc);
+  mrb_gv_foreach(mrb, dump_root_i, &d);
+  for (i = 0; i < gc->arena_idx; i++) {
+    dump_ref_ptr(&d, gc->arena[i]);
+  }
+  dump_context_refs(&d, mrb->root_c);
+  if (mrb->c != mrb->root_c) dump_context_refs(&d, mrb->c);
+  fputs("]}\n", fp);
+
+  for (page = gc->heaps; page; page = page->next) {
+    RVALUE *p = objects(page);
+    RVALUE *e = p + MRB_HEAP_PAGE_SIZE;
+
+    for (; p < e; p++) {
+      if (p->as.basic.tt == MRB_TT_FREE) continue;
+      if (is_dead(gc, &p->as.basic)) continue;
+      heap_dump_obj(mrb, fp, &p->as.basic);
+    }
+  }
+}
+
+#endif /* MRB_DISABLE_STDIO */
+
 MRB_API struct RBasic*
 mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
 {
@@ -484,7 +1210,20 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
     mrb_incremental_gc(mrb);
   }
   if (gc->free_heaps == NULL) {
-    add_heap(mrb, gc);
+    /* demand sweep: while a sweep is in progress, reclaim dead slots
+       from already-marked pages before growing the heap past them; the
+       cycle-finishing transition and its bookkeeping stay with
+       mrb_incremental_gc */
+    if (!gc->disabled && gc->state == MRB_GC_STATE_SWEEP) {
+      double t0 = gc_clock();
+      while (gc->sweeps && gc->free_heaps == NULL) {
+        incremental_sweep_phase(mrb, gc, MRB_HEAP_PAGE_SIZE);
+      }
+      gc->stats.sweep_time += gc_clock() - t0;
+    }
+    if (gc->free_heaps == NULL) {
+      add_heap(mrb, gc);
+    }
   }
 
   p = gc->free_heaps->freelist;
@@ -494,11 +1233,18 @@ mrb_obj_alloc(mrb_state *mrb, enum mrb_vtype ttype, struct RClass *cls)
   }
 
   gc->live++;
+  gc->stats.total_allocated++;
   gc_protect(mrb, gc, p);
   *(RVALUE *)p = RVALUE_zero;
   p->tt = ttype;
   p->c = cls;
   paint_partial_white(gc, p);
+  if (gc->alloc_trace && --gc->alloc_trace->countdown == 0) {
+    alloc_trace_record(mrb, ttype, cls);
+  }
+  if (gc->census && cls) {
+    census_add(mrb, gc->census, cls, 1, sizeof(RVALUE));
+  }
   return p;
 }
 
@@ -548,8 +1294,11 @@ mark_context(mrb_state *mrb, struct mrb_context *c)
   mark_context_stack(mrb, c);
 
   /* mark VM stack */
-  if (c->cibase) {
-    for (ci = c->cibase; ci <= c->ci; ci++) {
+  if (c->ciseg) {
+    int i;
+
+    for (i=0; i<=c->ci->ciidx; i++) {
+      ci = mrb_ci_at(c, i);
       if (ci->eidx > e) {
         e = ci->eidx;
       }
@@ -596,8 +1345,13 @@ gc_mark_children(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
     }
     /* fall through */
 
-  case MRB_TT_OBJECT:
   case MRB_TT_DATA:
+    if (obj->tt == MRB_TT_DATA && MRB_FLAG_TEST(obj, MRB_DATA_INLINE)) {
+      break;  /* inline payload; no iv and nothing to mark */
+    }
+    /* fall through */
+
+  case MRB_TT_OBJECT:
   case MRB_TT_EXCEPTION:
     mrb_gc_mark_iv(mrb, (struct RObject*)obj);
     break;
@@ -635,9 +1389,10 @@ gc_mark_children(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
     {
       struct RArray *a = (struct RArray*)obj;
       size_t i, e;
+      mrb_value *p = ARY_PTR(a);
 
-      for (i=0,e=a->len; i<e; i++) {
-        mrb_gc_mark_value(mrb, a->ptr[i]);
+      for (i=0,e=ARY_LEN(a); i<e; i++) {
+        mrb_gc_mark_value(mrb, p[i]);
       }
     }
     break;
@@ -672,6 +1427,22 @@ mrb_gc_mark(mrb_state *mrb, struct RBasic *obj)
   if (obj == 0) return;
   if (!is_white(obj)) return;
   mrb_assert((obj)->tt != MRB_TT_FREE);
+  /* leaf objects carry no references besides their class, so paint
+     them black directly instead of taking a round-trip through the
+     gray list; strings usually dominate the heap, which makes this a
+     sizable cut in mark-phase work */
+  switch (obj->tt) {
+  case MRB_TT_STRING:
+#ifdef MRB_WORD_BOXING
+  case MRB_TT_FLOAT:
+  case MRB_TT_CPTR:
+#endif
+    paint_black(obj);
+    mrb_gc_mark(mrb, (struct RBasic*)obj->c);
+    return;
+  default:
+    break;
+  }
   add_gray_list(mrb, &mrb->gc, obj);
 }
 
@@ -709,17 +1480,21 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
   case MRB_TT_SCLASS:
     mrb_gc_free_mt(mrb, (struct RClass*)obj);
     mrb_gc_free_iv(mrb, (struct RObject*)obj);
+    mrb_method_cache_clear(mrb);
+    /* constant caches key on class pointers; drop them too */
+    mrb_const_cache_clear(mrb);
     break;
   case MRB_TT_ICLASS:
     if (MRB_FLAG_TEST(obj, MRB_FLAG_IS_ORIGIN))
       mrb_gc_free_mt(mrb, (struct RClass*)obj);
+    mrb_method_cache_clear(mrb);
     break;
   case MRB_TT_ENV:
     {
       struct REnv *e = (struct REnv*)obj;
 
       if (!MRB_ENV_STACK_SHARED_P(e)) {
-        mrb_free(mrb, e->stack);
+        mrb_slab_free(mrb, e->stack, sizeof(mrb_value)*MRB_ENV_STACK_LEN(e));
         e->stack = NULL;
       }
     }
@@ -729,26 +1504,24 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
     {
       struct mrb_context *c = ((struct RFiber*)obj)->cxt;
       if (c && c != mrb->root_c) {
-        mrb_callinfo *ci = c->ci;
-        mrb_callinfo *ce = c->cibase;
+        int i;
 
-        while (ce <= ci) {
-          struct REnv *e = ci->env;
+        for (i=c->ci ? c->ci->ciidx : -1; i>=0; i--) {
+          struct REnv *e = mrb_ci_at(c, i)->env;
           if (e && !is_dead(&mrb->gc, e) && MRB_ENV_STACK_SHARED_P(e)) {
             mrb_env_unshare(mrb, e);
           }
-          ci--;
         }
-        mrb_free_context(mrb, c);
+        mrb_context_recycle(mrb, c);
       }
     }
     break;
 
   case MRB_TT_ARRAY:
     if (ARY_SHARED_P(obj))
-      mrb_ary_decref(mrb, ((struct RArray*)obj)->aux.shared);
-    else
-      mrb_free(mrb, ((struct RArray*)obj)->ptr);
+      mrb_ary_decref(mrb, ((struct RArray*)obj)->as.heap.aux.shared);
+    else if (!ARY_EMBED_P(obj))
+      mrb_free(mrb, ((struct RArray*)obj)->as.heap.ptr);
     break;
 
   case MRB_TT_HASH:
@@ -775,10 +1548,10 @@ obj_free(mrb_state *mrb, struct RBasic *obj)
     break;
 
   case MRB_TT_DATA:
-    {
+    if (!MRB_FLAG_TEST(obj, MRB_DATA_INLINE)) {
       struct RData *d = (struct RData*)obj;
       if (d->type && d->type->dfree) {
-        d->type->dfree(mrb, d->data);
+        d->type->dfree(mrb, d->as.heap.ptr);
       }
       mrb_gc_free_iv(mrb, (struct RObject*)obj);
     }
@@ -847,8 +1620,11 @@ gc_gray_mark(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
     }
     break;
 
-  case MRB_TT_OBJECT:
   case MRB_TT_DATA:
+    if (MRB_FLAG_TEST(obj, MRB_DATA_INLINE)) break;
+    /* fall through */
+
+  case MRB_TT_OBJECT:
   case MRB_TT_EXCEPTION:
     children += mrb_gc_mark_iv_size(mrb, (struct RObject*)obj);
     break;
@@ -861,7 +1637,6 @@ gc_gray_mark(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
     {
       struct mrb_context *c = ((struct RFiber*)obj)->cxt;
       size_t i;
-      mrb_callinfo *ci;
 
       if (!c) break;
       /* mark stack */
@@ -874,10 +1649,7 @@ gc_gray_mark(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
       children += (c->ci) ? c->ci->eidx : 0;
 
       /* mark closure */
-      if (c->cibase) {
-        for (i=0, ci = c->cibase; ci <= c->ci; i++, ci++)
-          ;
-      }
+      i = c->ci ? (size_t)(c->ci->ciidx + 1) : 0;
       children += i;
     }
     break;
@@ -885,7 +1657,7 @@ gc_gray_mark(mrb_state *mrb, mrb_gc *gc, struct RBasic *obj)
   case MRB_TT_ARRAY:
     {
       struct RArray *a = (struct RArray*)obj;
-      children += a->len;
+      children += ARY_LEN(a);
     }
     break;
 
@@ -947,6 +1719,11 @@ prepare_incremental_sweep(mrb_state *mrb, mrb_gc *gc)
   gc->state = MRB_GC_STATE_SWEEP;
   gc->sweeps = gc->heaps;
   gc->live_after_mark = gc->live;
+  /* full sweeps visit every slot anyway; rebuild the census from the
+     survivors and swap it in once the sweep completes */
+  if (gc->census && !is_minor_gc(gc)) {
+    gc->census_next = kh_init(census, mrb);
+  }
 }
 
 static size_t
@@ -961,6 +1738,8 @@ incremental_sweep_phase(mrb_state *mrb, mrb_gc *gc, size_t limit)
     size_t freed = 0;
     mrb_bool dead_slot = TRUE;
     mrb_bool full = (page->freelist == NULL);
+    struct RBasic *reclaimed = NULL;
+    struct RBasic **reclaimed_tail = &reclaimed;
 
     if (is_minor_gc(gc) && page->old) {
       /* skip a slot which doesn't contain any young object */
@@ -971,18 +1750,29 @@ incremental_sweep_phase(mrb_state *mrb, mrb_gc *gc, size_t limit)
       if (is_dead(gc, &p->as.basic)) {
         if (p->as.basic.tt != MRB_TT_FREE) {
           obj_free(mrb, &p->as.basic);
-          p->as.free.next = page->freelist;
-          page->freelist = (struct RBasic*)p;
+          /* append rather than push; the scan runs front to back, so
+             the reclaimed slots end up chained in address order and
+             allocation refills them sequentially */
+          *reclaimed_tail = (struct RBasic*)p;
+          reclaimed_tail = &p->as.free.next;
           freed++;
         }
       }
       else {
+        if (gc->census_next && p->as.basic.tt != MRB_TT_FREE)
+          census_add(mrb, gc->census_next, p->as.basic.c, 1, obj_memsize(mrb, &p->as.basic));
         if (!is_generational(gc))
           paint_partial_white(gc, &p->as.basic); /* next gc target */
+        else if (is_minor_gc(gc) && p->as.basic.tt != MRB_TT_FREE)
+          gc->stats.promoted++; /* survivor stays old from here on */
         dead_slot = 0;
       }
       p++;
     }
+    if (freed > 0) {
+      *reclaimed_tail = page->freelist;
+      page->freelist = reclaimed;
+    }
 
     /* free dead slot */
     if (dead_slot && freed < MRB_HEAP_PAGE_SIZE) {
@@ -995,7 +1785,14 @@ incremental_sweep_phase(mrb_state *mrb, mrb_gc *gc, size_t limit)
     }
     else {
       if (full && freed > 0) {
-        link_free_heap_page(gc, page);
+        /* mostly-dead pages go to the back of the free list so that
+           allocation refills dense pages first; sparse pages are left
+           to drain empty and be handed back once fully dead, which is
+           as close to compaction as a non-moving heap gets */
+        if (freed >= MRB_HEAP_PAGE_SIZE/2)
+          link_free_heap_page_tail(gc, page);
+        else
+          link_free_heap_page(gc, page);
       }
       if (page->freelist == NULL && is_minor_gc(gc))
         page->old = TRUE;
@@ -1011,36 +1808,67 @@ incremental_sweep_phase(mrb_state *mrb, mrb_gc *gc, size_t limit)
   return tried_sweep;
 }
 
+/* wall-ish clock for the statistics; clock() is ANSI C so this stays
+   available on embedded libcs that lack gettimeofday */
+static double
+gc_clock(void)
+{
+  return (double)clock() / CLOCKS_PER_SEC;
+}
+
 static size_t
 incremental_gc(mrb_state *mrb, mrb_gc *gc, size_t limit)
 {
+  size_t result = 0;
+  mrb_gc_state prev_state = gc->state;
+  double t0 = gc_clock();
+
+  if (mrb->trace) {
+    mrb_trace_phase_begin(mrb, prev_state == MRB_GC_STATE_ROOT ? "gc.root_scan" :
+                          prev_state == MRB_GC_STATE_MARK ? "gc.mark_slice" :
+                          "gc.sweep_slice");
+  }
   switch (gc->state) {
   case MRB_GC_STATE_ROOT:
+    gc->live_at_cycle_start = gc->live;
     root_scan_phase(mrb, gc);
     gc->state = MRB_GC_STATE_MARK;
     flip_white_part(gc);
-    return 0;
+    break;
   case MRB_GC_STATE_MARK:
     if (gc->gray_list) {
-      return incremental_marking_phase(mrb, gc, limit);
+      result = incremental_marking_phase(mrb, gc, limit);
     }
     else {
       final_marking_phase(mrb, gc);
+      clear_weak_slots(mrb, gc);
       prepare_incremental_sweep(mrb, gc);
-      return 0;
     }
-  case MRB_GC_STATE_SWEEP: {
-     size_t tried_sweep = 0;
-     tried_sweep = incremental_sweep_phase(mrb, gc, limit);
-     if (tried_sweep == 0)
-       gc->state = MRB_GC_STATE_ROOT;
-     return tried_sweep;
-  }
+    break;
+  case MRB_GC_STATE_SWEEP:
+    result = incremental_sweep_phase(mrb, gc, limit);
+    if (result == 0) {
+      gc->state = MRB_GC_STATE_ROOT;
+      if (gc->census_next) {
+        kh_destroy(census, mrb, gc->census);
+        gc->census = gc->census_next;
+        gc->census_next = NULL;
+      }
+    }
+    break;
   default:
     /* unknown state */
     mrb_assert(0);
-    return 0;
+    break;
   }
+
+  if (mrb->trace) mrb_trace_phase_end(mrb);
+  gc->stats.step_count++;
+  if (prev_state == MRB_GC_STATE_SWEEP)
+    gc->stats.sweep_time += gc_clock() - t0;
+  else
+    gc->stats.mark_time += gc_clock() - t0;
+  return result;
 }
 
 static void
@@ -1051,15 +1879,37 @@ incremental_gc_until(mrb_state *mrb, mrb_gc *gc, mrb_gc_state to_state)
   } while (gc->state != to_state);
 }
 
+/* objects processed between clock checks in pause-budget mode; small
+   enough that one granule stays well below typical budgets */
+#define GC_TIMED_GRANULE 64
+
 static void
 incremental_gc_step(mrb_state *mrb, mrb_gc *gc)
 {
   size_t limit = 0, result = 0;
-  limit = (GC_STEP_SIZE/100) * gc->step_ratio;
-  while (result < limit) {
-    result += incremental_gc(mrb, gc, limit);
-    if (gc->state == MRB_GC_STATE_ROOT)
-      break;
+
+  if (gc->max_pause_us > 0) {
+    /* advance by wall time: run small granules until the budget for
+       this slice is used up, carrying any overrun into the next slice */
+    double budget = (double)gc->max_pause_us * 1e-6 - gc->pause_debt;
+    double t0 = gc_clock();
+    double spent = 0.0;
+
+    while (spent < budget) {
+      incremental_gc(mrb, gc, GC_TIMED_GRANULE);
+      spent = gc_clock() - t0;
+      if (gc->state == MRB_GC_STATE_ROOT)
+        break;
+    }
+    gc->pause_debt = (spent > budget) ? spent - budget : 0.0;
+  }
+  else {
+    limit = (GC_STEP_SIZE/100) * gc->step_ratio;
+    while (result < limit) {
+      result += incremental_gc(mrb, gc, limit);
+      if (gc->state == MRB_GC_STATE_ROOT)
+        break;
+    }
   }
 
   gc->threshold = gc->live + GC_STEP_SIZE;
@@ -1087,15 +1937,77 @@ clear_all_old(mrb_state *mrb, mrb_gc *gc)
   gc->atomic_gray_list = gc->gray_list = NULL;
 }
 
+/* feedback controller, run once per finished cycle when enabled.
+ * After a minor cycle the promotion volume steers how soon the next
+ * major should come: heavy promotion pulls majorgc_inc_ratio down so
+ * old garbage is reclaimed sooner, light promotion pushes it up. After
+ * a full or major cycle the garbage share of the heap steers
+ * step_ratio: a mostly-garbage heap means the mutator is allocating
+ * fast and collection must keep pace, a mostly-live heap means steps
+ * can be smaller for shorter pauses. */
+static void
+gc_autotune(mrb_gc *gc, mrb_bool minor)
+{
+  size_t start = gc->live_at_cycle_start;
+  size_t survived = gc->live;
+
+  if (minor) {
+    size_t promoted = gc->stats.promoted - gc->tune_prev_promoted;
+
+    gc->tune_prev_promoted = gc->stats.promoted;
+    if (promoted > survived/4)
+      gc->majorgc_inc_ratio -= gc->majorgc_inc_ratio/4;
+    else if (promoted < survived/16)
+      gc->majorgc_inc_ratio += gc->majorgc_inc_ratio/4;
+    if (gc->majorgc_inc_ratio < MAJOR_GC_INC_RATIO_MIN)
+      gc->majorgc_inc_ratio = MAJOR_GC_INC_RATIO_MIN;
+    if (gc->majorgc_inc_ratio > MAJOR_GC_INC_RATIO_MAX)
+      gc->majorgc_inc_ratio = MAJOR_GC_INC_RATIO_MAX;
+    gc->majorgc_old_threshold = survived/100 * gc->majorgc_inc_ratio;
+  }
+  else {
+    int garbage_pct = 0;
+
+    if (start > survived) {
+      garbage_pct = (int)((start - survived) * 100 / start);
+    }
+    if (garbage_pct > 60)
+      gc->step_ratio += gc->step_ratio/2;
+    else if (garbage_pct < 20)
+      gc->step_ratio -= gc->step_ratio/4;
+    if (gc->step_ratio < gc->step_ratio_min)
+      gc->step_ratio = gc->step_ratio_min;
+    if (gc->step_ratio > gc->step_ratio_max)
+      gc->step_ratio = gc->step_ratio_max;
+  }
+}
+
+MRB_API void
+mrb_gc_autotune(mrb_state *mrb, mrb_bool enable, int step_ratio_min, int step_ratio_max)
+{
+  mrb_gc *gc = &mrb->gc;
+
+  gc->autotune = enable;
+  if (step_ratio_min > 0)
+    gc->step_ratio_min = step_ratio_min;
+  if (step_ratio_max > 0)
+    gc->step_ratio_max = step_ratio_max;
+  if (gc->step_ratio_max < gc->step_ratio_min)
+    gc->step_ratio_max = gc->step_ratio_min;
+  gc->tune_prev_promoted = gc->stats.promoted;
+}
+
 MRB_API void
 mrb_incremental_gc(mrb_state *mrb)
 {
   mrb_gc *gc = &mrb->gc;
+  double pause;
 
   if (gc->disabled) return;
 
   GC_INVOKE_TIME_REPORT("mrb_incremental_gc()");
   GC_TIME_START;
+  pause = gc_clock();
 
   if (is_minor_gc(gc)) {
     incremental_gc_until(mrb, gc, MRB_GC_STATE_ROOT);
@@ -1105,6 +2017,8 @@ mrb_incremental_gc(mrb_state *mrb)
   }
 
   if (gc->state == MRB_GC_STATE_ROOT) {
+    mrb_bool was_minor = is_minor_gc(gc);
+
     mrb_assert(gc->live >= gc->live_after_mark);
     gc->threshold = (gc->live_after_mark/100) * gc->interval_ratio;
     if (gc->threshold < GC_STEP_SIZE) {
@@ -1112,17 +2026,30 @@ mrb_incremental_gc(mrb_state *mrb)
     }
 
     if (is_major_gc(gc)) {
-      gc->majorgc_old_threshold = gc->live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
+      gc->majorgc_old_threshold = gc->live_after_mark/100 * gc->majorgc_inc_ratio;
       gc->full = FALSE;
+      gc->stats.major_count++;
     }
     else if (is_minor_gc(gc)) {
+      gc->stats.minor_count++;
       if (gc->live > gc->majorgc_old_threshold) {
         clear_all_old(mrb, gc);
         gc->full = TRUE;
       }
     }
+    else {
+      gc->stats.major_count++; /* full incremental cycle */
+    }
+
+    if (gc->autotune) {
+      gc_autotune(gc, was_minor);
+    }
   }
 
+  pause = gc_clock() - pause;
+  if (pause > gc->stats.max_pause) {
+    gc->stats.max_pause = pause;
+  }
   GC_TIME_STOP_AND_REPORT;
 }
 
@@ -1131,11 +2058,13 @@ MRB_API void
 mrb_full_gc(mrb_state *mrb)
 {
   mrb_gc *gc = &mrb->gc;
+  double pause;
 
   if (gc->disabled) return;
 
   GC_INVOKE_TIME_REPORT("mrb_full_gc()");
   GC_TIME_START;
+  pause = gc_clock();
 
   if (is_generational(gc)) {
     /* clear all the old objects back to young */
@@ -1151,10 +2080,15 @@ mrb_full_gc(mrb_state *mrb)
   gc->threshold = (gc->live_after_mark/100) * gc->interval_ratio;
 
   if (is_generational(gc)) {
-    gc->majorgc_old_threshold = gc->live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
+    gc->majorgc_old_threshold = gc->live_after_mark/100 * gc->majorgc_inc_ratio;
     gc->full = FALSE;
   }
+  gc->stats.major_count++;
 
+  pause = gc_clock() - pause;
+  if (pause > gc->stats.max_pause) {
+    gc->stats.max_pause = pause;
+  }
   GC_TIME_STOP_AND_REPORT;
 }
 
@@ -1164,6 +2098,16 @@ mrb_garbage_collect(mrb_state *mrb)
   mrb_full_gc(mrb);
 }
 
+/* bound incremental collection slices by wall time (microseconds)
+   instead of the unitless step_ratio; 0 restores step_ratio pacing */
+MRB_API void
+mrb_gc_set_max_pause(mrb_state *mrb, int32_t us)
+{
+  if (us < 0) us = 0;
+  mrb->gc.max_pause_us = (uint32_t)us;
+  mrb->gc.pause_debt = 0.0;
+}
+
 MRB_API int
 mrb_gc_arena_save(mrb_state *mrb)
 {
@@ -1376,12 +2320,82 @@ change_gen_gc_mode(mrb_state *mrb, mrb_gc *gc, mrb_bool enable)
   }
   else if (!is_generational(gc) && enable) {
     incremental_gc_until(mrb, gc, MRB_GC_STATE_ROOT);
-    gc->majorgc_old_threshold = gc->live_after_mark/100 * DEFAULT_MAJOR_GC_INC_RATIO;
+    gc->majorgc_old_threshold = gc->live_after_mark/100 * gc->majorgc_inc_ratio;
     gc->full = FALSE;
   }
   gc->generational = enable;
 }
 
+/*
+ *  call-seq:
+ *     GC.max_pause      -> fixnum
+ *
+ *  Returns the incremental step pause budget in microseconds.
+ *  0 means pacing by GC.step_ratio.
+ *
+ */
+
+static mrb_value
+gc_max_pause_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_fixnum_value((mrb_int)mrb->gc.max_pause_us);
+}
+
+/*
+ *  call-seq:
+ *     GC.max_pause = fixnum    -> nil
+ *
+ *  Bounds each incremental collection slice by the given wall-time
+ *  budget in microseconds; a slice that overruns shortens the next
+ *  one. Set 0 to return to GC.step_ratio pacing. Minor generational
+ *  collections still run to completion.
+ *
+ */
+
+static mrb_value
+gc_max_pause_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_int us;
+
+  mrb_get_args(mrb, "i", &us);
+  mrb_gc_set_max_pause(mrb, (int32_t)us);
+  return mrb_nil_value();
+}
+
+/*
+ *  call-seq:
+ *     GC.autotune?    -> true or false
+ *
+ *  Returns whether the allocation-rate feedback controller is on.
+ *
+ */
+
+static mrb_value
+gc_autotune_get(mrb_state *mrb, mrb_value obj)
+{
+  return mrb_bool_value(mrb->gc.autotune);
+}
+
+/*
+ *  call-seq:
+ *     GC.autotune = true or false    -> true or false
+ *
+ *  Turns the feedback controller on or off. While on, GC.step_ratio
+ *  and the threshold for major generational collections are retuned
+ *  after every cycle from the observed garbage and promotion rates.
+ *
+ */
+
+static mrb_value
+gc_autotune_set(mrb_state *mrb, mrb_value obj)
+{
+  mrb_bool enable;
+
+  mrb_get_args(mrb, "b", &enable);
+  mrb_gc_autotune(mrb, enable, 0, 0);
+  return mrb_bool_value(enable);
+}
+
 /*
  *  call-seq:
  *     GC.generational_mode -> true or false
@@ -1417,6 +2431,69 @@ gc_generational_mode_set(mrb_state *mrb, mrb_value self)
 }
 
 
+static void gc_each_objects(mrb_state *mrb, mrb_gc *gc, mrb_each_object_callback *callback, void *data);
+
+static void
+count_object_types(mrb_state *mrb, struct RBasic *obj, void *data)
+{
+  size_t *counts = (size_t*)data;
+
+  if (obj->tt < MRB_TT_MAXDEFINE && obj->tt != MRB_TT_FREE) {
+    counts[obj->tt]++;
+  }
+}
+
+/*
+ *  call-seq:
+ *     GC.stat    -> hash
+ *
+ *  Returns collector statistics accumulated since the interpreter was
+ *  created: collection and step counts, cumulative mark/sweep times and
+ *  the longest pause in seconds, objects promoted to the old
+ *  generation, total objects allocated, the GC arena high-water mark,
+ *  and live object counts per type under :live_by_type.
+ *
+ *     GC.stat[:minor_count]             #=> 5
+ *     GC.stat[:live_by_type][:string]   #=> 1024
+ *
+ */
+
+static mrb_value
+gc_stat_get(mrb_state *mrb, mrb_value obj)
+{
+  mrb_gc *gc = &mrb->gc;
+  mrb_gc_stats *st = &gc->stats;
+  mrb_value hash = mrb_hash_new(mrb);
+  mrb_value by_type = mrb_hash_new(mrb);
+  size_t counts[MRB_TT_MAXDEFINE] = { 0 };
+  static const char * const tt_names[MRB_TT_MAXDEFINE] = {
+    "false", NULL, "true", "fixnum", "symbol", "undef", "float", "cptr",
+    "object", "class", "module", "iclass", "sclass", "proc", "array",
+    "hash", "string", "range", "exception", "file", "env", "data", "fiber"
+  };
+  int tt;
+
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(live)), mrb_fixnum_value((mrb_int)gc->live));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(minor_count)), mrb_fixnum_value((mrb_int)st->minor_count));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(major_count)), mrb_fixnum_value((mrb_int)st->major_count));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(step_count)), mrb_fixnum_value((mrb_int)st->step_count));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(promoted)), mrb_fixnum_value((mrb_int)st->promoted));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(total_allocated)), mrb_fixnum_value((mrb_int)st->total_allocated));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(arena_peak)), mrb_fixnum_value(st->arena_peak));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(mark_time)), mrb_float_value(mrb, (mrb_float)st->mark_time));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(sweep_time)), mrb_float_value(mrb, (mrb_float)st->sweep_time));
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(max_pause)), mrb_float_value(mrb, (mrb_float)st->max_pause));
+
+  gc_each_objects(mrb, gc, count_object_types, counts);
+  for (tt = 0; tt < MRB_TT_MAXDEFINE; tt++) {
+    if (counts[tt] > 0 && tt_names[tt]) {
+      mrb_hash_set(mrb, by_type, mrb_symbol_value(mrb_intern_cstr(mrb, tt_names[tt])), mrb_fixnum_value((mrb_int)counts[tt]));
+    }
+  }
+  mrb_hash_set(mrb, hash, mrb_symbol_value(MRB_SYM(live_by_type)), by_type);
+  return hash;
+}
+
 static void
 gc_each_objects(mrb_state *mrb, mrb_gc *gc, mrb_each_object_callback *callback, void *data)
 {
@@ -1447,6 +2524,32 @@ static mrb_value gc_test(mrb_state *, mrb_value);
 #endif
 #endif
 
+#ifndef MRB_DISABLE_STDIO
+/*
+ *  call-seq:
+ *     GC.dump_heap(path) -> nil
+ *
+ *  Writes the live heap to +path+ as JSON lines for offline analysis
+ *  with tools/heap_graph.rb (see mrb_heap_dump).
+ */
+
+static mrb_value
+gc_dump_heap(mrb_state *mrb, mrb_value obj)
+{
+  const char *path;
+  FILE *fp;
+
+  mrb_get_args(mrb, "z", &path);
+  fp = fopen(path, "wb");
+  if (!fp) {
+    mrb_raisef(mrb, E_RUNTIME_ERROR, "cannot open %S", mrb_str_new_cstr(mrb, path));
+  }
+  mrb_heap_dump(mrb, fp);
+  fclose(fp);
+  return mrb_nil_value();
+}
+#endif
+
 void
 mrb_init_gc(mrb_state *mrb)
 {
@@ -1463,6 +2566,14 @@ mrb_init_gc(mrb_state *mrb)
   mrb_define_class_method(mrb, gc, "step_ratio=", gc_step_ratio_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode=", gc_generational_mode_set, MRB_ARGS_REQ(1));
   mrb_define_class_method(mrb, gc, "generational_mode", gc_generational_mode_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "stat", gc_stat_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "max_pause", gc_max_pause_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "max_pause=", gc_max_pause_set, MRB_ARGS_REQ(1));
+  mrb_define_class_method(mrb, gc, "autotune?", gc_autotune_get, MRB_ARGS_NONE());
+  mrb_define_class_method(mrb, gc, "autotune=", gc_autotune_set, MRB_ARGS_REQ(1));
+#ifndef MRB_DISABLE_STDIO
+  mrb_define_class_method(mrb, gc, "dump_heap", gc_dump_heap, MRB_ARGS_REQ(1));
+#endif
 #ifdef GC_TEST
 #ifdef GC_DEBUG
   mrb_define_class_method(mrb, gc, "test", gc_test, MRB_ARGS_NONE());
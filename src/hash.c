@@ -11,6 +11,7 @@
 #include <mruby/khash.h>
 #include <mruby/string.h>
 #include <mruby/variable.h>
+#include <mruby/foreach.h>
 
 /* a function to get hash value of a float number */
 mrb_int mrb_float_id(mrb_float f);
@@ -20,19 +21,13 @@ mrb_hash_ht_hash_func(mrb_state *mrb, mrb_value key)
 {
   enum mrb_vtype t = mrb_type(key);
   mrb_value hv;
-  const char *p;
-  mrb_int i, len;
   khint_t h;
 
   switch (t) {
   case MRB_TT_STRING:
-    p = RSTRING_PTR(key);
-    len = RSTRING_LEN(key);
-    h = 0;
-    for (i=0; i<len; i++) {
-      h = (h << 5) - h + *p++;
-    }
-    return h;
+    /* mrb_str_hash caches its result for shared strings, which is what
+       stored keys are after mrb_hash_ht_key dups them */
+    return (khint_t)mrb_str_hash(mrb, key);
 
   case MRB_TT_SYMBOL:
     h = (khint_t)mrb_symbol(key);
@@ -91,7 +86,7 @@ mrb_hash_ht_hash_equal(mrb_state *mrb, mrb_value a, mrb_value b)
   }
 }
 
-KHASH_DEFINE (ht, mrb_value, mrb_hash_value, TRUE, mrb_hash_ht_hash_func, mrb_hash_ht_hash_equal)
+KHASH_DEFINE (ht, mrb_value, mrb_int, TRUE, mrb_hash_ht_hash_func, mrb_hash_ht_hash_equal)
 
 static void mrb_hash_modify(mrb_state *mrb, mrb_value hash);
 
@@ -107,21 +102,222 @@ mrb_hash_ht_key(mrb_state *mrb, mrb_value key)
 
 #define KEY(key) mrb_hash_ht_key(mrb, key)
 
+/* Hashes start out as a flat small table: key/value pairs stored side
+   by side in insertion order and scanned linearly.  Options hashes and
+   the like never pay for khash buckets; the table is promoted to a
+   real khash once it outgrows MRB_HASH_SMALL_MAX entries (or when a C
+   extension asks for the khash via mrb_hash_tbl). */
+#define MRB_HASH_SMALL_MAX      8
+#define MRB_HASH_SMALL_MIN_CAPA 4
+
+typedef struct small_ht {
+  uint8_t size;
+  uint8_t capa;
+  /* 2*capa mrb_values (key/value pairs) follow the header */
+} small_ht;
+
+#define sh_entries(sh) ((mrb_value*)((sh)+1))
+#define sh_bytes(capa) (sizeof(small_ht)+sizeof(mrb_value)*2*(capa))
+#define SH_TBL(hash) ((small_ht*)RHASH_TBL(hash))
+
+static small_ht*
+sh_new(mrb_state *mrb, uint8_t capa)
+{
+  small_ht *sh = (small_ht*)mrb_slab_alloc(mrb, sh_bytes(capa));
+
+  sh->size = 0;
+  sh->capa = capa;
+  return sh;
+}
+
+static mrb_int
+sh_find(mrb_state *mrb, small_ht *sh, mrb_value key)
+{
+  mrb_value *e = sh_entries(sh);
+  mrb_int i;
+
+  for (i = 0; i < sh->size; i++) {
+    if (mrb_hash_ht_hash_equal(mrb, e[i*2], key)) return i;
+  }
+  return -1;
+}
+
+/* scan for hashes still in the all-symbol shape: every stored key is a
+   symbol, so the loop is raw mrb_sym compares with no type dispatch */
+static mrb_int
+sh_find_sym(small_ht *sh, mrb_sym sym)
+{
+  mrb_value *e = sh_entries(sh);
+  mrb_int i;
+
+  for (i = 0; i < sh->size; i++) {
+    if (mrb_symbol(e[i*2]) == sym) return i;
+  }
+  return -1;
+}
+
+static mrb_int
+sh_lookup(mrb_state *mrb, mrb_value hash, small_ht *sh, mrb_value key)
+{
+  if (MRB_RHASH_ALL_SYM_P(hash)) {
+    /* no symbol compares equal to a non-symbol */
+    if (!mrb_symbol_p(key)) return -1;
+    return sh_find_sym(sh, mrb_symbol(key));
+  }
+  return sh_find(mrb, sh, key);
+}
+
+/* Promoted hashes keep their pairs in a dense entries array in
+   insertion order; the khash is only an index from key to entry
+   offset.  Iteration, #keys and #values walk the entries linearly
+   instead of the sparse buckets, and deletion punches a hole (key set
+   to undef) that compaction squeezes out once holes reach half the
+   array. */
+typedef struct ht_entry {
+  mrb_value key;
+  mrb_value val;
+} ht_entry;
+
+typedef struct big_ht {
+  khash_t(ht) *index;      /* key -> offset into entries */
+  ht_entry *entries;       /* insertion order, holes keyed with undef */
+  mrb_int capa;
+  mrb_int n;               /* slots used, holes included */
+  mrb_int n_del;           /* holes */
+  mrb_int head;            /* first possibly-live slot, for #shift */
+} big_ht;
+
+#define BIG_TBL(hash) ((big_ht*)RHASH_TBL(hash))
+#define big_size(b) ((b)->n - (b)->n_del)
+
+static big_ht*
+big_new(mrb_state *mrb, mrb_int capa)
+{
+  big_ht *b = (big_ht*)mrb_slab_alloc(mrb, sizeof(big_ht));
+
+  b->entries = NULL;
+  b->capa = b->n = b->n_del = b->head = 0;
+  b->index = kh_init(ht, mrb);
+  /* the key index is only ever probed, never iterated, so it can
+     spread large rehashes over many operations */
+  b->index->incremental = TRUE;
+  if (capa > 0) {
+    b->entries = (ht_entry*)mrb_malloc(mrb, sizeof(ht_entry)*capa);
+    b->capa = capa;
+    /* ask for headroom above the load factor so capa inserts never
+       resize the index */
+    kh_resize(ht, mrb, b->index, capa+(capa>>1));
+  }
+  return b;
+}
+
+static mrb_int
+big_push(mrb_state *mrb, big_ht *b, mrb_value key, mrb_value val)
+{
+  if (b->n == b->capa) {
+    mrb_int capa = b->capa > 0 ? b->capa*2 : MRB_HASH_SMALL_MAX*2;
+
+    b->entries = (ht_entry*)mrb_realloc(mrb, b->entries, sizeof(ht_entry)*capa);
+    b->capa = capa;
+  }
+  b->entries[b->n].key = key;
+  b->entries[b->n].val = val;
+  return b->n++;
+}
+
+/* key index probe honoring the all-symbol shape: such a hash cannot
+   match a non-symbol key, so skip the probe entirely */
+static khiter_t
+big_find(mrb_state *mrb, mrb_value hash, big_ht *b, mrb_value key)
+{
+  if (MRB_RHASH_ALL_SYM_P(hash) && !mrb_symbol_p(key)) {
+    return kh_end(b->index);
+  }
+  return kh_get(ht, mrb, b->index, key);
+}
+
+static void
+big_compact(mrb_state *mrb, big_ht *b)
+{
+  mrb_int i, j = 0;
+
+  kh_clear(ht, mrb, b->index);
+  for (i = 0; i < b->n; i++) {
+    if (mrb_undef_p(b->entries[i].key)) continue;
+    b->entries[j] = b->entries[i];
+    kh_value(b->index, kh_put(ht, mrb, b->index, b->entries[j].key)) = j;
+    j++;
+  }
+  b->n = j;
+  b->n_del = 0;
+  b->head = 0;
+}
+
+static big_ht*
+sh_promote(mrb_state *mrb, mrb_value hash)
+{
+  small_ht *sh = SH_TBL(hash);
+  big_ht *b = big_new(mrb, MRB_HASH_SMALL_MAX*2);
+
+  if (sh) {
+    mrb_value *e = sh_entries(sh);
+    mrb_int i;
+
+    for (i = 0; i < sh->size; i++) {
+      kh_value(b->index, kh_put(ht, mrb, b->index, e[i*2])) =
+        big_push(mrb, b, e[i*2], e[i*2+1]);
+    }
+    mrb_slab_free(mrb, sh, sh_bytes(sh->capa));
+  }
+  RHASH(hash)->flags &= ~MRB_HASH_SMALL;
+  RHASH_TBL(hash) = (struct kh_ht*)b;
+  return b;
+}
+
 void
 mrb_gc_mark_hash(mrb_state *mrb, struct RHash *hash)
 {
-  khiter_t k;
-  khash_t(ht) *h = hash->ht;
+  big_ht *b;
+  mrb_int i;
+
+  if (!hash->ht) return;
+  if (hash->flags & MRB_HASH_SMALL) {
+    small_ht *sh = (small_ht*)hash->ht;
+
+    for (i = 0; i < sh->size*2; i++) {
+      mrb_gc_mark_value(mrb, sh_entries(sh)[i]);
+    }
+    return;
+  }
+  b = (big_ht*)hash->ht;
+  for (i = 0; i < b->n; i++) {
+    if (mrb_undef_p(b->entries[i].key)) continue;
+    mrb_gc_mark_value(mrb, b->entries[i].key);
+    mrb_gc_mark_value(mrb, b->entries[i].val);
+  }
+}
+
+/* yields each pair without allocating; a non-zero return stops the
+   iteration.  The hash must not be modified while it runs. */
+MRB_API void
+mrb_hash_foreach(mrb_state *mrb, struct RHash *hash, mrb_hash_foreach_func *func, void *data)
+{
+  big_ht *b;
+  mrb_int i;
 
-  if (!h) return;
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      mrb_value key = kh_key(h, k);
-      mrb_value val = kh_value(h, k).v;
+  if (!hash->ht) return;
+  if (hash->flags & MRB_HASH_SMALL) {
+    small_ht *sh = (small_ht*)hash->ht;
 
-      mrb_gc_mark_value(mrb, key);
-      mrb_gc_mark_value(mrb, val);
+    for (i = 0; i < sh->size; i++) {
+      if (func(mrb, sh_entries(sh)[i*2], sh_entries(sh)[i*2+1], data) != 0) return;
     }
+    return;
+  }
+  b = (big_ht*)hash->ht;
+  for (i = 0; i < b->n; i++) {
+    if (mrb_undef_p(b->entries[i].key)) continue;
+    if (func(mrb, b->entries[i].key, b->entries[i].val, data) != 0) return;
   }
 }
 
@@ -129,13 +325,51 @@ size_t
 mrb_gc_mark_hash_size(mrb_state *mrb, struct RHash *hash)
 {
   if (!hash->ht) return 0;
-  return kh_size(hash->ht)*2;
+  if (hash->flags & MRB_HASH_SMALL) {
+    return ((small_ht*)hash->ht)->size*2;
+  }
+  return big_size((big_ht*)hash->ht)*2;
+}
+
+/* heap bytes owned by the hash table beyond the RHash cell: the entry
+   array plus the key index buckets (one metadata byte, key and value
+   per bucket, doubled while an incremental rehash is draining) */
+size_t
+mrb_gc_hash_memsize(mrb_state *mrb, struct RHash *hash)
+{
+  big_ht *b;
+  size_t bytes;
+
+  if (!hash->ht) return 0;
+  if (hash->flags & MRB_HASH_SMALL) {
+    return sh_bytes(((small_ht*)hash->ht)->capa);
+  }
+  b = (big_ht*)hash->ht;
+  bytes = sizeof(big_ht) + sizeof(ht_entry)*(size_t)b->capa;
+  if (b->index) {
+    size_t len = 1 + sizeof(mrb_value) + sizeof(mrb_int);
+
+    bytes += sizeof(khash_t(ht)) + len*b->index->n_buckets;
+    if (b->index->old_n_buckets) bytes += len*b->index->old_n_buckets;
+  }
+  return bytes;
 }
 
 void
 mrb_gc_free_hash(mrb_state *mrb, struct RHash *hash)
 {
-  if (hash->ht) kh_destroy(ht, mrb, hash->ht);
+  big_ht *b;
+
+  if (!hash->ht) return;
+  if (hash->flags & MRB_HASH_SMALL) {
+    small_ht *sh = (small_ht*)hash->ht;
+    mrb_slab_free(mrb, sh, sh_bytes(sh->capa));
+    return;
+  }
+  b = (big_ht*)hash->ht;
+  kh_destroy(ht, mrb, b->index);
+  mrb_free(mrb, b->entries);
+  mrb_slab_free(mrb, b, sizeof(big_ht));
 }
 
 
@@ -145,11 +379,17 @@ mrb_hash_new_capa(mrb_state *mrb, int capa)
   struct RHash *h;
 
   h = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
-  h->ht = kh_init(ht, mrb);
-  if (capa > 0) {
-    kh_resize(ht, mrb, h->ht, capa);
-  }
+  h->ht = NULL;
   h->iv = 0;
+  /* an empty hash is trivially all-symbol; the first non-symbol key
+     clears the flag */
+  h->flags |= MRB_HASH_ALL_SYM;
+  if (capa > MRB_HASH_SMALL_MAX) {
+    h->ht = (struct kh_ht*)big_new(mrb, capa);
+  }
+  else {
+    h->flags |= MRB_HASH_SMALL;
+  }
   return mrb_obj_value(h);
 }
 
@@ -159,16 +399,38 @@ mrb_hash_new(mrb_state *mrb)
   return mrb_hash_new_capa(mrb, 0);
 }
 
+MRB_API mrb_value
+mrb_hash_new_from_values(mrb_state *mrb, mrb_int argc, const mrb_value *vals)
+{
+  mrb_value hash = mrb_hash_new_capa(mrb, argc/2);
+  mrb_int i;
+
+  for (i = 0; i+1 < argc; i += 2) {
+    mrb_hash_set(mrb, hash, vals[i], vals[i+1]);
+  }
+  return hash;
+}
+
 MRB_API mrb_value
 mrb_hash_get(mrb_state *mrb, mrb_value hash, mrb_value key)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  khash_t(ht) *h;
+  big_ht *b;
   khiter_t k;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+    mrb_int i;
+
+    if (sh && (i = sh_lookup(mrb, hash, sh, key)) >= 0) {
+      return sh_entries(sh)[i*2+1];
+    }
+  }
+  else if ((b = BIG_TBL(hash)) != NULL) {
+    h = b->index;
+    k = big_find(mrb, hash, b, key);
     if (k != kh_end(h))
-      return kh_value(h, k).v;
+      return b->entries[kh_value(h, k)].val;
   }
 
   /* not found */
@@ -184,19 +446,59 @@ mrb_hash_get(mrb_state *mrb, mrb_value hash, mrb_value key)
 MRB_API mrb_value
 mrb_hash_fetch(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value def)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  khash_t(ht) *h;
+  big_ht *b;
   khiter_t k;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+    mrb_int i;
+
+    if (sh && (i = sh_lookup(mrb, hash, sh, key)) >= 0) {
+      return sh_entries(sh)[i*2+1];
+    }
+  }
+  else if ((b = BIG_TBL(hash)) != NULL) {
+    h = b->index;
+    k = big_find(mrb, hash, b, key);
     if (k != kh_end(h))
-      return kh_value(h, k).v;
+      return b->entries[kh_value(h, k)].val;
   }
 
   /* not found */
   return def;
 }
 
+/* Resolve the storage slot for an existing key with a single lookup, so
+   OP_UPDIDX can read and write a counter without hashing the key twice.
+   Returns NULL when the key is absent.  The pointer is invalidated by
+   any mutation of the hash; callers may only store immediate values
+   through it (no write barrier is issued). */
+mrb_value*
+mrb_hash_value_slot(mrb_state *mrb, mrb_value hash, mrb_value key)
+{
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+    mrb_int i;
+
+    if (sh && (i = sh_lookup(mrb, hash, sh, key)) >= 0) {
+      return &sh_entries(sh)[i*2+1];
+    }
+  }
+  else {
+    big_ht *b = BIG_TBL(hash);
+
+    if (b) {
+      khiter_t k = big_find(mrb, hash, b, key);
+
+      if (k != kh_end(b->index)) {
+        return &b->entries[kh_value(b->index, k)].val;
+      }
+    }
+  }
+  return NULL;
+}
+
 MRB_API void
 mrb_hash_set(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value val)
 {
@@ -205,18 +507,65 @@ mrb_hash_set(mrb_state *mrb, mrb_value hash, mrb_value key, mrb_value val)
   int r;
 
   mrb_hash_modify(mrb, hash);
-  h = RHASH_TBL(hash);
+  if (!mrb_symbol_p(key)) {
+    /* demote from the all-symbol shape for good */
+    RHASH(hash)->flags &= ~MRB_HASH_ALL_SYM;
+  }
 
-  if (!h) h = RHASH_TBL(hash) = kh_init(ht, mrb);
-  k = kh_put2(ht, mrb, h, key, &r);
-  kh_value(h, k).v = val;
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+    mrb_int i;
 
-  if (r != 0) {
-    /* expand */
-    int ai = mrb_gc_arena_save(mrb);
-    key = kh_key(h, k) = KEY(key);
-    mrb_gc_arena_restore(mrb, ai);
-    kh_value(h, k).n = kh_size(h)-1;
+    if (sh && (i = sh_lookup(mrb, hash, sh, key)) >= 0) {
+      sh_entries(sh)[i*2+1] = val;
+      mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), val);
+      return;
+    }
+    if (!sh) {
+      sh = sh_new(mrb, MRB_HASH_SMALL_MIN_CAPA);
+      RHASH_TBL(hash) = (struct kh_ht*)sh;
+    }
+    else if (sh->size == sh->capa && sh->capa < MRB_HASH_SMALL_MAX) {
+      small_ht *ns = sh_new(mrb, MRB_HASH_SMALL_MAX);
+
+      memcpy(sh_entries(ns), sh_entries(sh), sizeof(mrb_value)*2*sh->size);
+      ns->size = sh->size;
+      mrb_slab_free(mrb, sh, sh_bytes(sh->capa));
+      sh = ns;
+      RHASH_TBL(hash) = (struct kh_ht*)sh;
+    }
+    if (sh->size < sh->capa) {
+      int ai = mrb_gc_arena_save(mrb);
+      mrb_value *e = sh_entries(sh) + sh->size*2;
+
+      e[0] = key = KEY(key);
+      e[1] = val;
+      sh->size++;
+      mrb_gc_arena_restore(mrb, ai);
+      mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), key);
+      mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), val);
+      return;
+    }
+    /* outgrown: promote to the dense table and fall through */
+    sh_promote(mrb, hash);
+  }
+  {
+    big_ht *b = BIG_TBL(hash);
+
+    if (!b) b = (big_ht*)(RHASH_TBL(hash) = (struct kh_ht*)big_new(mrb, 0));
+    h = b->index;
+    k = kh_put2(ht, mrb, h, key, &r);
+
+    if (r != 0) {
+      /* expand */
+      int ai = mrb_gc_arena_save(mrb);
+      key = kh_key(h, k) = KEY(key);
+      kh_value(h, k) = big_push(mrb, b, key, val);
+      mrb_gc_arena_restore(mrb, ai);
+    }
+    else {
+      b->entries[kh_value(h, k)].val = val;
+    }
   }
 
   mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), key);
@@ -228,23 +577,47 @@ static mrb_value
 mrb_hash_dup(mrb_state *mrb, mrb_value hash)
 {
   struct RHash* ret;
-  khash_t(ht) *h, *ret_h;
-  khiter_t k, ret_k;
+  big_ht *b, *ret_b;
+
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh;
+
+    ret = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
+    ret->ht = NULL;
+    ret->iv = 0;
+    ret->flags |= MRB_HASH_SMALL | (RHASH(hash)->flags & MRB_HASH_ALL_SYM);
+    sh = SH_TBL(hash);
+    if (sh && sh->size > 0) {
+      small_ht *ns = sh_new(mrb, sh->capa);
+
+      memcpy(sh_entries(ns), sh_entries(sh), sizeof(mrb_value)*2*sh->size);
+      ns->size = sh->size;
+      ret->ht = (struct kh_ht*)ns;
+    }
+    return mrb_obj_value(ret);
+  }
 
-  h = RHASH_TBL(hash);
+  b = BIG_TBL(hash);
   ret = (struct RHash*)mrb_obj_alloc(mrb, MRB_TT_HASH, mrb->hash_class);
-  ret->ht = kh_init(ht, mrb);
-
-  if (kh_size(h) > 0) {
-    ret_h = ret->ht;
-
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (kh_exist(h, k)) {
-        int ai = mrb_gc_arena_save(mrb);
-        ret_k = kh_put(ht, mrb, ret_h, KEY(kh_key(h, k)));
-        mrb_gc_arena_restore(mrb, ai);
-        kh_val(ret_h, ret_k) = kh_val(h, k);
-      }
+  ret->ht = NULL;
+  ret->iv = 0;
+  ret->flags |= RHASH(hash)->flags & MRB_HASH_ALL_SYM;
+  ret_b = big_new(mrb, b ? big_size(b) : 0);
+  ret->ht = (struct kh_ht*)ret_b;
+
+  if (b) {
+    mrb_int i;
+
+    for (i = 0; i < b->n; i++) {
+      int ai;
+      mrb_value key;
+
+      if (mrb_undef_p(b->entries[i].key)) continue;
+      ai = mrb_gc_arena_save(mrb);
+      key = KEY(b->entries[i].key);
+      kh_value(ret_b->index, kh_put(ht, mrb, ret_b->index, key)) =
+        big_push(mrb, ret_b, key, b->entries[i].val);
+      mrb_gc_arena_restore(mrb, ai);
     }
   }
 
@@ -260,17 +633,25 @@ mrb_check_hash_type(mrb_state *mrb, mrb_value hash)
 MRB_API khash_t(ht)*
 mrb_hash_tbl(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  big_ht *b;
 
-  if (!h) {
-    return RHASH_TBL(hash) = kh_init(ht, mrb);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    /* a caller holding the key index cannot follow later promotions,
+       so leave the small representation for good */
+    return sh_promote(mrb, hash)->index;
+  }
+  b = BIG_TBL(hash);
+  if (!b) {
+    b = big_new(mrb, 0);
+    RHASH_TBL(hash) = (struct kh_ht*)b;
   }
-  return h;
+  return b->index;
 }
 
 static void
 mrb_hash_modify(mrb_state *mrb, mrb_value hash)
 {
+  if (MRB_RHASH_SMALL_P(hash)) return; /* table is created lazily */
   mrb_hash_tbl(mrb, hash);
 }
 
@@ -328,7 +709,7 @@ mrb_hash_init(mrb_state *mrb, mrb_value hash)
   }
   if (!mrb_nil_p(ifnone)) {
     RHASH(hash)->flags |= MRB_HASH_DEFAULT;
-    mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+    mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   }
   return hash;
 }
@@ -422,7 +803,7 @@ mrb_hash_set_default(mrb_state *mrb, mrb_value hash)
 
   mrb_get_args(mrb, "o", &ifnone);
   mrb_hash_modify(mrb, hash);
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   RHASH(hash)->flags &= ~MRB_HASH_PROC_DEFAULT;
   if (!mrb_nil_p(ifnone)) {
     RHASH(hash)->flags |= MRB_HASH_DEFAULT;
@@ -478,7 +859,7 @@ mrb_hash_set_default_proc(mrb_state *mrb, mrb_value hash)
 
   mrb_get_args(mrb, "o", &ifnone);
   mrb_hash_modify(mrb, hash);
-  mrb_iv_set(mrb, hash, mrb_intern_lit(mrb, "ifnone"), ifnone);
+  mrb_iv_set(mrb, hash, MRB_SYM(ifnone), ifnone);
   if (!mrb_nil_p(ifnone)) {
     RHASH(hash)->flags |= MRB_HASH_PROC_DEFAULT;
     RHASH(hash)->flags |= MRB_HASH_DEFAULT;
@@ -494,20 +875,41 @@ mrb_hash_set_default_proc(mrb_state *mrb, mrb_value hash)
 MRB_API mrb_value
 mrb_hash_delete_key(mrb_state *mrb, mrb_value hash, mrb_value key)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  khash_t(ht) *h;
+  big_ht *b;
   khiter_t k;
   mrb_value delVal;
   mrb_int n;
 
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+    mrb_int i;
+
+    if (sh && (i = sh_lookup(mrb, hash, sh, key)) >= 0) {
+      mrb_value *e = sh_entries(sh);
+
+      delVal = e[i*2+1];
+      memmove(e+i*2, e+(i+1)*2, sizeof(mrb_value)*2*(sh->size-i-1));
+      sh->size--;
+      return delVal;
+    }
+    return mrb_nil_value();
+  }
+
+  b = BIG_TBL(hash);
+  if (b) {
+    h = b->index;
+    k = big_find(mrb, hash, b, key);
     if (k != kh_end(h)) {
-      delVal = kh_value(h, k).v;
-      n = kh_value(h, k).n;
+      n = kh_value(h, k);
+      delVal = b->entries[n].val;
       kh_del(ht, mrb, h, k);
-      for (k = kh_begin(h); k != kh_end(h); k++) {
-        if (!kh_exist(h, k)) continue;
-        if (kh_value(h, k).n > n) kh_value(h, k).n--;
+      /* punch a hole; compaction squeezes them out in bulk */
+      b->entries[n].key = mrb_undef_value();
+      b->entries[n].val = mrb_nil_value();
+      b->n_del++;
+      if (b->n_del > b->n/2) {
+        big_compact(mrb, b);
       }
       return delVal;
     }
@@ -561,17 +963,34 @@ mrb_hash_delete(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_hash_shift(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  big_ht *b;
   mrb_value delKey, delVal;
 
   mrb_hash_modify(mrb, hash);
-  if (h && kh_size(h) > 0) {
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (!kh_exist(h, k)) continue;
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+
+    if (sh && sh->size > 0) {
+      mrb_value *e = sh_entries(sh);
 
-      delKey = kh_key(h, k);
+      delKey = e[0];
+      delVal = e[1];
       mrb_gc_protect(mrb, delKey);
+      mrb_gc_protect(mrb, delVal);
+      memmove(e, e+2, sizeof(mrb_value)*2*(sh->size-1));
+      sh->size--;
+      return mrb_assoc_new(mrb, delKey, delVal);
+    }
+  }
+  else if ((b = BIG_TBL(hash)) != NULL && big_size(b) > 0) {
+    mrb_int i;
+
+    for (i = b->head; i < b->n; i++) {
+      if (mrb_undef_p(b->entries[i].key)) continue;
+
+      delKey = b->entries[i].key;
+      mrb_gc_protect(mrb, delKey);
+      b->head = i+1;
       delVal = mrb_hash_delete_key(mrb, hash, delKey);
       mrb_gc_protect(mrb, delVal);
 
@@ -605,9 +1024,19 @@ mrb_hash_shift(mrb_state *mrb, mrb_value hash)
 MRB_API mrb_value
 mrb_hash_clear(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
+  big_ht *b;
 
-  if (h) kh_clear(ht, mrb, h);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+
+    if (sh) sh->size = 0;
+    return hash;
+  }
+  b = BIG_TBL(hash);
+  if (b) {
+    kh_clear(ht, mrb, b->index);
+    b->n = b->n_del = b->head = 0;
+  }
   return hash;
 }
 
@@ -657,10 +1086,16 @@ mrb_hash_aset(mrb_state *mrb, mrb_value self)
 static mrb_value
 mrb_hash_size_m(mrb_state *mrb, mrb_value self)
 {
-  khash_t(ht) *h = RHASH_TBL(self);
+  big_ht *b;
+
+  if (MRB_RHASH_SMALL_P(self)) {
+    small_ht *sh = SH_TBL(self);
 
-  if (!h) return mrb_fixnum_value(0);
-  return mrb_fixnum_value(kh_size(h));
+    return mrb_fixnum_value(sh ? sh->size : 0);
+  }
+  b = BIG_TBL(self);
+  if (!b) return mrb_fixnum_value(0);
+  return mrb_fixnum_value(big_size(b));
 }
 
 /* 15.2.13.4.12 */
@@ -676,9 +1111,15 @@ mrb_hash_size_m(mrb_state *mrb, mrb_value self)
 MRB_API mrb_value
 mrb_hash_empty_p(mrb_state *mrb, mrb_value self)
 {
-  khash_t(ht) *h = RHASH_TBL(self);
+  big_ht *b;
+
+  if (MRB_RHASH_SMALL_P(self)) {
+    small_ht *sh = SH_TBL(self);
 
-  if (h) return mrb_bool_value(kh_size(h) == 0);
+    return mrb_bool_value(!sh || sh->size == 0);
+  }
+  b = BIG_TBL(self);
+  if (b) return mrb_bool_value(big_size(b) == 0);
   return mrb_true_value();
 }
 
@@ -712,22 +1153,26 @@ mrb_hash_to_hash(mrb_state *mrb, mrb_value hash)
 MRB_API mrb_value
 mrb_hash_keys(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  big_ht *b;
   mrb_value ary;
-  mrb_value *p;
+  mrb_int i;
 
-  if (!h || kh_size(h) == 0) return mrb_ary_new(mrb);
-  ary = mrb_ary_new_capa(mrb, kh_size(h));
-  mrb_ary_set(mrb, ary, kh_size(h)-1, mrb_nil_value());
-  p = mrb_ary_ptr(ary)->ptr;
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      mrb_value kv = kh_key(h, k);
-      mrb_hash_value hv = kh_value(h, k);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
 
-      p[hv.n] = kv;
+    if (!sh || sh->size == 0) return mrb_ary_new(mrb);
+    ary = mrb_ary_new_capa(mrb, sh->size);
+    for (i = 0; i < sh->size; i++) {
+      mrb_ary_push(mrb, ary, sh_entries(sh)[i*2]);
     }
+    return ary;
+  }
+  b = BIG_TBL(hash);
+  if (!b || big_size(b) == 0) return mrb_ary_new(mrb);
+  ary = mrb_ary_new_capa(mrb, big_size(b));
+  for (i = 0; i < b->n; i++) {
+    if (mrb_undef_p(b->entries[i].key)) continue;
+    mrb_ary_push(mrb, ary, b->entries[i].key);
   }
   return ary;
 }
@@ -748,18 +1193,27 @@ mrb_hash_keys(mrb_state *mrb, mrb_value hash)
 static mrb_value
 mrb_hash_values(mrb_state *mrb, mrb_value hash)
 {
-  khash_t(ht) *h = RHASH_TBL(hash);
-  khiter_t k;
+  big_ht *b;
   mrb_value ary;
+  mrb_int i;
 
-  if (!h) return mrb_ary_new(mrb);
-  ary = mrb_ary_new_capa(mrb, kh_size(h));
-  for (k = kh_begin(h); k != kh_end(h); k++) {
-    if (kh_exist(h, k)) {
-      mrb_hash_value hv = kh_value(h, k);
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
 
-      mrb_ary_set(mrb, ary, hv.n, hv.v);
+    ary = mrb_ary_new(mrb);
+    if (sh) {
+      for (i = 0; i < sh->size; i++) {
+        mrb_ary_push(mrb, ary, sh_entries(sh)[i*2+1]);
+      }
     }
+    return ary;
+  }
+  b = BIG_TBL(hash);
+  if (!b) return mrb_ary_new(mrb);
+  ary = mrb_ary_new_capa(mrb, big_size(b));
+  for (i = 0; i < b->n; i++) {
+    if (mrb_undef_p(b->entries[i].key)) continue;
+    mrb_ary_push(mrb, ary, b->entries[i].val);
   }
   return ary;
 }
@@ -787,15 +1241,20 @@ static mrb_value
 mrb_hash_has_key(mrb_state *mrb, mrb_value hash)
 {
   mrb_value key;
-  khash_t(ht) *h;
+  big_ht *b;
   khiter_t k;
 
   mrb_get_args(mrb, "o", &key);
 
-  h = RHASH_TBL(hash);
-  if (h) {
-    k = kh_get(ht, mrb, h, key);
-    return mrb_bool_value(k != kh_end(h));
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+
+    return mrb_bool_value(sh && sh_lookup(mrb, hash, sh, key) >= 0);
+  }
+  b = BIG_TBL(hash);
+  if (b) {
+    k = big_find(mrb, hash, b, key);
+    return mrb_bool_value(k != kh_end(b->index));
   }
   return mrb_false_value();
 }
@@ -819,17 +1278,30 @@ static mrb_value
 mrb_hash_has_value(mrb_state *mrb, mrb_value hash)
 {
   mrb_value val;
-  khash_t(ht) *h;
-  khiter_t k;
+  big_ht *b;
+  mrb_int i;
 
   mrb_get_args(mrb, "o", &val);
-  h = RHASH_TBL(hash);
 
-  if (h) {
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (!kh_exist(h, k)) continue;
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+
+    if (sh) {
+      for (i = 0; i < sh->size; i++) {
+        if (mrb_equal(mrb, sh_entries(sh)[i*2+1], val)) {
+          return mrb_true_value();
+        }
+      }
+    }
+    return mrb_false_value();
+  }
+  b = BIG_TBL(hash);
+
+  if (b) {
+    for (i = 0; i < b->n; i++) {
+      if (mrb_undef_p(b->entries[i].key)) continue;
 
-      if (mrb_equal(mrb, kh_value(h, k).v, val)) {
+      if (mrb_equal(mrb, b->entries[i].val, val)) {
         return mrb_true_value();
       }
     }
@@ -837,6 +1309,195 @@ mrb_hash_has_value(mrb_state *mrb, mrb_value hash)
   return mrb_false_value();
 }
 
+static mrb_int
+hash_len(mrb_state *mrb, mrb_value hash)
+{
+  if (MRB_RHASH_SMALL_P(hash)) {
+    small_ht *sh = SH_TBL(hash);
+
+    return sh ? sh->size : 0;
+  }
+  else {
+    big_ht *b = BIG_TBL(hash);
+
+    return b ? big_size(b) : 0;
+  }
+}
+
+/* Streams every pair of +other+ into +hash+ in one pass.  The
+   destination is grown to the combined size up front, so the inserts
+   below never resize the entry array or the key index, and each pair
+   costs a single probe instead of a full #[]= dispatch.  With a block,
+   a conflicting key is the only thing that dispatches: once, to the
+   block. */
+static void
+hash_merge(mrb_state *mrb, mrb_value hash, mrb_value other, mrb_value blk)
+{
+  mrb_int i, total;
+
+  mrb_hash_modify(mrb, hash);
+  total = hash_len(mrb, hash) + hash_len(mrb, other);
+  if (MRB_RHASH_SMALL_P(hash) && total > MRB_HASH_SMALL_MAX) {
+    sh_promote(mrb, hash);
+  }
+  if (!MRB_RHASH_SMALL_P(hash)) {
+    big_ht *b = BIG_TBL(hash);
+
+    if (!b) b = (big_ht*)(RHASH_TBL(hash) = (struct kh_ht*)big_new(mrb, 0));
+    if (b->capa < total) {
+      b->entries = (ht_entry*)mrb_realloc(mrb, b->entries, sizeof(ht_entry)*total);
+      b->capa = total;
+    }
+    if ((khint_t)(total+(total>>1)) > b->index->n_buckets) {
+      kh_resize(ht, mrb, b->index, total+(total>>1));
+    }
+  }
+
+  for (i = 0; ; i++) {
+    mrb_value key, val;
+
+    /* re-fetch the source table every pass: a conflict block may
+       mutate either hash under us */
+    if (MRB_RHASH_SMALL_P(other)) {
+      small_ht *sh = SH_TBL(other);
+
+      if (!sh || i >= sh->size) break;
+      key = sh_entries(sh)[i*2];
+      val = sh_entries(sh)[i*2+1];
+    }
+    else {
+      big_ht *ob = BIG_TBL(other);
+
+      if (!ob || i >= ob->n) break;
+      if (mrb_undef_p(ob->entries[i].key)) continue;
+      key = ob->entries[i].key;
+      val = ob->entries[i].val;
+    }
+
+    if (!mrb_nil_p(blk)) {
+      mrb_value old = mrb_hash_fetch(mrb, hash, key, mrb_undef_value());
+
+      if (!mrb_undef_p(old)) {
+        mrb_value args[3];
+
+        args[0] = key;
+        args[1] = old;
+        args[2] = val;
+        val = mrb_yield_argv(mrb, blk, 3, args);
+      }
+      mrb_hash_set(mrb, hash, key, val);
+    }
+    else if (MRB_RHASH_SMALL_P(hash)) {
+      mrb_hash_set(mrb, hash, key, val);
+    }
+    else {
+      big_ht *b = BIG_TBL(hash);
+      khash_t(ht) *h = b->index;
+      khiter_t k;
+      int r;
+
+      if (!mrb_symbol_p(key)) {
+        RHASH(hash)->flags &= ~MRB_HASH_ALL_SYM;
+      }
+      k = kh_put2(ht, mrb, h, key, &r);
+      if (r != 0) {
+        int ai = mrb_gc_arena_save(mrb);
+
+        key = kh_key(h, k) = KEY(key);
+        kh_value(h, k) = big_push(mrb, b, key, val);
+        mrb_gc_arena_restore(mrb, ai);
+      }
+      else {
+        b->entries[kh_value(h, k)].val = val;
+      }
+      mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), key);
+      mrb_field_write_barrier_value(mrb, (struct RBasic*)RHASH(hash), val);
+    }
+  }
+}
+
+MRB_API void
+mrb_hash_merge(mrb_state *mrb, mrb_value hash1, mrb_value hash2)
+{
+  hash_merge(mrb, hash1, hash2, mrb_nil_value());
+}
+
+static mrb_value
+hash_merge_other(mrb_state *mrb, mrb_value other)
+{
+  if (mrb_hash_p(other)) return other;
+  other = mrb_check_hash_type(mrb, other);
+  if (mrb_nil_p(other)) {
+    mrb_raise(mrb, E_TYPE_ERROR, "can't convert argument into Hash");
+  }
+  return other;
+}
+
+/* 15.2.13.4.22 */
+/*
+ *  call-seq:
+ *     hsh.merge(other_hash)                              -> new_hash
+ *     hsh.merge(other_hash){|key, oldval, newval| block} -> new_hash
+ *
+ *  Returns a new hash containing the contents of <i>other_hash</i> and
+ *  the contents of <i>hsh</i>. If no block is specified, the value for
+ *  entries with duplicate keys will be that of <i>other_hash</i>.
+ *  Otherwise the value for each duplicate key is determined by calling
+ *  the block with the key, its value in <i>hsh</i> and its value in
+ *  <i>other_hash</i>.
+ *
+ *     h1 = { "a" => 100, "b" => 200 }
+ *     h2 = { "b" => 254, "c" => 300 }
+ *     h1.merge(h2)   #=> {"a"=>100, "b"=>254, "c"=>300}
+ *     h1.merge(h2){|key, oldval, newval| newval - oldval}
+ *                    #=> {"a"=>100, "b"=>54,  "c"=>300}
+ *     h1             #=> {"a"=>100, "b"=>200}
+ */
+static mrb_value
+mrb_hash_merge_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other, blk, ret;
+
+  mrb_get_args(mrb, "o&", &other, &blk);
+  other = hash_merge_other(mrb, other);
+  ret = mrb_hash_dup(mrb, self);
+  hash_merge(mrb, ret, other, blk);
+  return ret;
+}
+
+/* core of Hash#merge! and Hash#update (mruby-hash-ext) */
+mrb_value
+mrb_hash_update_m(mrb_state *mrb, mrb_value self)
+{
+  mrb_value other, blk;
+
+  mrb_get_args(mrb, "o&", &other, &blk);
+  hash_merge(mrb, self, hash_merge_other(mrb, other), blk);
+  return self;
+}
+
+MRB_API int
+mrb_hash_pair_foreach(mrb_state *mrb, mrb_value hash, mrb_foreach_func func, void *data)
+{
+  /* snapshot keys and values up front, exactly as mrblib's Hash#each
+     does, so the callback can mutate the hash without walking a table
+     that rehashes under it; elements are yielded as [key, value] */
+  mrb_value keys = mrb_hash_keys(mrb, hash);
+  mrb_value vals = mrb_hash_values(mrb, hash);
+  mrb_int i, len = RARRAY_LEN(keys);
+  int ai = mrb_gc_arena_save(mrb);
+  int ret;
+
+  for (i = 0; i < len; i++) {
+    mrb_value pair = mrb_assoc_new(mrb, RARRAY_PTR(keys)[i], RARRAY_PTR(vals)[i]);
+
+    ret = func(mrb, pair, data);
+    if (ret) return ret;  /* keep the stopping callback's values in the arena */
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return 0;
+}
+
 void
 mrb_init_hash(mrb_state *mrb)
 {
@@ -862,6 +1523,7 @@ mrb_init_hash(mrb_state *mrb)
   mrb_define_method(mrb, h, "keys",            mrb_hash_keys,        MRB_ARGS_NONE()); /* 15.2.13.4.19 */
   mrb_define_method(mrb, h, "length",          mrb_hash_size_m,      MRB_ARGS_NONE()); /* 15.2.13.4.20 */
   mrb_define_method(mrb, h, "member?",         mrb_hash_has_key,     MRB_ARGS_REQ(1)); /* 15.2.13.4.21 */
+  mrb_define_method(mrb, h, "merge",           mrb_hash_merge_m,     MRB_ARGS_REQ(1)); /* 15.2.13.4.22 */
   mrb_define_method(mrb, h, "shift",           mrb_hash_shift,       MRB_ARGS_NONE()); /* 15.2.13.4.24 */
   mrb_define_method(mrb, h, "dup",             mrb_hash_dup,         MRB_ARGS_NONE());
   mrb_define_method(mrb, h, "size",            mrb_hash_size_m,      MRB_ARGS_NONE()); /* 15.2.13.4.25 */
@@ -4,12 +4,14 @@
 ** See Copyright Notice in mruby.h
 */
 
+#include <string.h>
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/class.h>
 #include <mruby/proc.h>
 #include <mruby/string.h>
 #include <mruby/variable.h>
+#include <mruby/data.h>
 #include <mruby/error.h>
 
 typedef enum {
@@ -29,7 +31,7 @@ typedef enum {
 static mrb_bool
 mrb_obj_basic_to_s_p(mrb_state *mrb, mrb_value obj)
 {
-  struct RProc *me = mrb_method_search(mrb, mrb_class(mrb, obj), mrb_intern_lit(mrb, "to_s"));
+  struct RProc *me = mrb_method_search(mrb, mrb_class(mrb, obj), MRB_SYM(to_s));
   if (MRB_PROC_CFUNC_P(me) && (me->body.func == mrb_any_to_s))
     return TRUE;
   return FALSE;
@@ -180,11 +182,11 @@ mrb_f_block_given_p_m(mrb_state *mrb, mrb_value self)
   mrb_bool given_p;
 
   bp = ci->stackent + 1;
-  ci--;
-  if (ci <= mrb->c->cibase) {
+  if (ci->ciidx <= 1) {
     given_p = FALSE;
   }
   else {
+    ci = mrb_ci_at(mrb->c, ci->ciidx - 1);
     /* block_given? called within block; check upper scope */
     if (ci->proc->env) {
       struct REnv *e = ci->proc->env;
@@ -198,8 +200,8 @@ mrb_f_block_given_p_m(mrb_state *mrb, mrb_value self)
         /* top-level does not have block slot (alway false) */
         if (sp == mrb->c->stbase)
           return mrb_false_value();
-        ci = mrb->c->cibase + e->cioff;
-        bp = ci[1].stackent + 1;
+        ci = mrb_ci_at(mrb->c, e->cioff);
+        bp = mrb_ci_at(mrb->c, e->cioff + 1)->stackent + 1;
       }
     }
     if (ci->argc > 0) {
@@ -249,7 +251,7 @@ mrb_singleton_class_clone(mrb_state *mrb, mrb_value obj)
     clone->super = klass->super;
     if (klass->iv) {
       mrb_iv_copy(mrb, mrb_obj_value(clone), mrb_obj_value(klass));
-      mrb_obj_iv_set(mrb, (struct RObject*)clone, mrb_intern_lit(mrb, "__attached__"), obj);
+      mrb_obj_iv_set(mrb, (struct RObject*)clone, MRB_SYM(__attached__), obj);
     }
     if (klass->mt) {
       clone->mt = kh_copy(mt, mrb, klass->mt);
@@ -294,10 +296,20 @@ init_copy(mrb_state *mrb, mrb_value dest, mrb_value obj)
     case MRB_TT_MODULE:
       copy_class(mrb, dest, obj);
       /* fall through */
+    case MRB_TT_DATA:
+      if (mrb_data_inline_p(obj)) {
+        /* replicate the in-cell payload; there are no ivs to copy */
+        struct RData *s = RDATA(obj), *d = RDATA(dest);
+
+        d->flags |= MRB_DATA_INLINE;
+        d->type = s->type;
+        memcpy(d->as.buf, s->as.buf, MRB_DATA_INLINE_MAX);
+        break;
+      }
+      /* fall through */
     case MRB_TT_OBJECT:
     case MRB_TT_SCLASS:
     case MRB_TT_HASH:
-    case MRB_TT_DATA:
     case MRB_TT_EXCEPTION:
       mrb_iv_copy(mrb, dest, obj);
       break;
@@ -860,7 +872,7 @@ mrb_f_raise(mrb_state *mrb, mrb_value self)
     /* fall through */
   default:
     exc = mrb_make_exception(mrb, argc, a);
-    mrb_obj_iv_set(mrb, mrb_obj_ptr(exc), mrb_intern_lit(mrb, "lastpc"), mrb_cptr_value(mrb, mrb->c->ci->pc));
+    mrb_obj_iv_set(mrb, mrb_obj_ptr(exc), MRB_SYM(lastpc), mrb_cptr_value(mrb, mrb->c->ci->pc));
     mrb_exc_raise(mrb, exc);
     break;
   }
@@ -1075,8 +1087,8 @@ mrb_local_variables(mrb_state *mrb, mrb_value self)
     struct REnv *e = proc->env;
 
     while (e) {
-      if (!MRB_PROC_CFUNC_P(mrb->c->cibase[e->cioff].proc)) {
-        irep = mrb->c->cibase[e->cioff].proc->body.irep;
+      if (!MRB_PROC_CFUNC_P(mrb_ci_at(mrb->c, e->cioff)->proc)) {
+        irep = mrb_ci_at(mrb->c, e->cioff)->proc->body.irep;
         if (irep->lv) {
           for (i = 0; i + 1 < irep->nlocals; ++i) {
             if (irep->lv[i].name) {
@@ -1149,5 +1161,5 @@ mrb_init_kernel(mrb_state *mrb)
   mrb_define_method(mrb, krn, "__case_eqq",                 mrb_obj_ceqq,                    MRB_ARGS_REQ(1));    /* internal */
 
   mrb_include_module(mrb, mrb->object_class, mrb->kernel_module);
-  mrb_alias_method(mrb, mrb->module_class, mrb_intern_lit(mrb, "dup"), mrb_intern_lit(mrb, "clone"));
+  mrb_alias_method(mrb, mrb->module_class, MRB_SYM(dup), MRB_SYM(clone));
 }
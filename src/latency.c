@@ -0,0 +1,172 @@
+/*
+** latency.c - latency histograms around VM entry points
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <string.h>
+#include <time.h>
+#include <mruby.h>
+#include <mruby/khash.h>
+#include <mruby/latency.h>
+
+KHASH_DECLARE(lat, mrb_sym, mrb_latency_hist*, TRUE)
+KHASH_DEFINE(lat, mrb_sym, mrb_latency_hist*, TRUE, kh_int_hash_func, kh_int_hash_equal)
+
+uint64_t
+mrb_latency_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#else
+  return (uint64_t)clock() * (UINT64_C(1000000000) / CLOCKS_PER_SEC);
+#endif
+}
+
+/* bucket index of a duration: values below one sub-bucket range are
+   exact, above that each octave is split into 2^SUB_BITS sub-buckets
+   (the HdrHistogram layout) */
+static uint32_t
+hist_index(uint64_t ns)
+{
+  int msb;
+
+  if (ns < ((uint64_t)1 << MRB_LATENCY_SUB_BITS)) {
+    return (uint32_t)ns;
+  }
+  msb = MRB_LATENCY_SUB_BITS;
+  while ((msb < MRB_LATENCY_MAX_OCTAVE) && (ns >> (msb + 1))) {
+    msb++;
+  }
+  return (uint32_t)(((msb - MRB_LATENCY_SUB_BITS + 1) << MRB_LATENCY_SUB_BITS)
+                    + ((ns >> (msb - MRB_LATENCY_SUB_BITS)) & (((uint32_t)1 << MRB_LATENCY_SUB_BITS) - 1)));
+}
+
+/* lower bound of a bucket, the inverse of hist_index */
+static uint64_t
+hist_bucket_low(uint32_t idx)
+{
+  int oct;
+  uint64_t sub;
+
+  if (idx < ((uint32_t)1 << MRB_LATENCY_SUB_BITS)) {
+    return idx;
+  }
+  oct = (int)(idx >> MRB_LATENCY_SUB_BITS) + MRB_LATENCY_SUB_BITS - 1;
+  sub = idx & (((uint32_t)1 << MRB_LATENCY_SUB_BITS) - 1);
+  return ((uint64_t)1 << oct) | (sub << (oct - MRB_LATENCY_SUB_BITS));
+}
+
+MRB_API void
+mrb_latency_start(mrb_state *mrb)
+{
+  mrb_latency *lat;
+
+  if (mrb->lat) return;
+  lat = (mrb_latency*)mrb_malloc(mrb, sizeof(mrb_latency));
+  lat->tbl = kh_init(lat, mrb);
+  mrb->lat = lat;
+}
+
+MRB_API void
+mrb_latency_stop(mrb_state *mrb)
+{
+  mrb_latency *lat = mrb->lat;
+  khiter_t k;
+
+  if (!lat) return;
+  mrb->lat = NULL;
+  for (k = kh_begin(lat->tbl); k != kh_end(lat->tbl); k++) {
+    if (kh_exist(lat->tbl, k)) {
+      mrb_free(mrb, kh_value(lat->tbl, k));
+    }
+  }
+  kh_destroy(lat, mrb, lat->tbl);
+  mrb_free(mrb, lat);
+}
+
+void
+mrb_latency_record(mrb_state *mrb, mrb_sym mid, uint64_t ns)
+{
+  mrb_latency *lat = mrb->lat;
+  mrb_latency_hist *h;
+  khiter_t k;
+  int ret;
+
+  if (!lat) return;
+  k = kh_put2(lat, mrb, lat->tbl, mid, &ret);
+  if (ret) { /* first sample for this entry symbol */
+    h = (mrb_latency_hist*)mrb_calloc(mrb, 1, sizeof(mrb_latency_hist));
+    h->min = UINT64_MAX;
+    kh_value(lat->tbl, k) = h;
+  }
+  else {
+    h = kh_value(lat->tbl, k);
+  }
+  h->count++;
+  h->total += ns;
+  if (ns < h->min) h->min = ns;
+  if (ns > h->max) h->max = ns;
+  h->buckets[hist_index(ns)]++;
+}
+
+MRB_API void
+mrb_latency_each(mrb_state *mrb, mrb_latency_callback *cb, void *data)
+{
+  mrb_latency *lat = mrb->lat;
+  khiter_t k;
+
+  if (!lat) return;
+  for (k = kh_begin(lat->tbl); k != kh_end(lat->tbl); k++) {
+    if (kh_exist(lat->tbl, k)) {
+      cb(mrb, kh_key(lat->tbl, k), kh_value(lat->tbl, k), data);
+    }
+  }
+}
+
+MRB_API void
+mrb_latency_reset(mrb_state *mrb)
+{
+  mrb_latency *lat = mrb->lat;
+  khiter_t k;
+
+  if (!lat) return;
+  for (k = kh_begin(lat->tbl); k != kh_end(lat->tbl); k++) {
+    if (kh_exist(lat->tbl, k)) {
+      mrb_latency_hist *h = kh_value(lat->tbl, k);
+
+      memset(h, 0, sizeof(*h));
+      h->min = UINT64_MAX;
+    }
+  }
+}
+
+MRB_API uint64_t
+mrb_latency_percentile(const mrb_latency_hist *hist, double pct)
+{
+  uint64_t rank;
+  uint64_t seen = 0;
+  uint32_t i;
+
+  if (hist->count == 0) return 0;
+  rank = (uint64_t)((pct / 100.0) * (double)hist->count + 0.5);
+  if (rank < 1) rank = 1;
+  if (rank > hist->count) rank = hist->count;
+  for (i = 0; i < MRB_LATENCY_BUCKETS; i++) {
+    seen += hist->buckets[i];
+    if (seen >= rank) {
+      /* bucket midpoint; clamp into the exactly tracked extremes */
+      uint64_t low = hist_bucket_low(i);
+      uint64_t high = hist_bucket_low(i + 1);
+      uint64_t mid = low + (high - low) / 2;
+
+      if (mid < hist->min) mid = hist->min;
+      if (mid > hist->max) mid = hist->max;
+      return mid;
+    }
+  }
+  return hist->max;
+}
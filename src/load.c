@@ -13,6 +13,8 @@
 #include <mruby/string.h>
 #include <mruby/debug.h>
 #include <mruby/error.h>
+#include <mruby/opcode.h>
+#include <mruby/trace.h>
 
 #if SIZE_MAX < UINT32_MAX
 # error size_t must be at least 32 bits wide
@@ -21,6 +23,9 @@
 #define FLAG_BYTEORDER_BIG 2
 #define FLAG_BYTEORDER_LIL 4
 #define FLAG_BYTEORDER_NATIVE 8
+#define FLAG_LAZY 16
+#define FLAG_SYMTAB 32
+#define FLAG_NO_CRC 64
 #define FLAG_SRC_MALLOC 1
 #define FLAG_SRC_STATIC 0
 
@@ -40,8 +45,51 @@ offset_crc_body(void)
   return ((uint8_t *)header.binary_crc - (uint8_t *)&header) + sizeof(header.binary_crc);
 }
 
+/* advances over one irep record and its children without reading it */
+static const uint8_t*
+skip_irep_record(const uint8_t *src, uint8_t flags)
+{
+  uint16_t rlen, dlen, snl;
+  uint32_t ilen, plen, slen;
+  size_t i;
+
+  src += sizeof(uint32_t);            /* record size */
+  src += sizeof(uint16_t) * 2;        /* nlocals, nregs */
+  rlen = bin_to_uint16(src);
+  src += sizeof(uint16_t);
+  ilen = bin_to_uint32(src);
+  src += sizeof(uint32_t);
+  src += skip_padding(src);
+  src += sizeof(uint32_t) * ilen;
+  plen = bin_to_uint32(src);
+  src += sizeof(uint32_t);
+  for (i = 0; i < plen; i++) {
+    src++;                            /* pool TT */
+    dlen = bin_to_uint16(src);
+    src += sizeof(uint16_t) + dlen;
+  }
+  slen = bin_to_uint32(src);
+  src += sizeof(uint32_t);
+  if (flags & FLAG_SYMTAB) {          /* symbol table indices */
+    src += sizeof(uint16_t) * slen;
+  }
+  else {
+    for (i = 0; i < slen; i++) {
+      snl = bin_to_uint16(src);
+      src += sizeof(uint16_t);
+      if (snl != MRB_DUMP_NULL_SYM_LEN) {
+        src += snl + 1;
+      }
+    }
+  }
+  for (i = 0; i < rlen; i++) {
+    src = skip_irep_record(src, flags);
+  }
+  return src;
+}
+
 static mrb_irep*
-read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags)
+read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags, struct mrb_irep_symtab *symtab)
 {
   size_t i;
   const uint8_t *src = bin;
@@ -118,6 +166,14 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flag
       tt = *src++; /* pool TT */
       pool_data_len = bin_to_uint16(src); /* pool data length */
       src += sizeof(uint16_t);
+      if (tt == IREP_TT_STRING && (flags & FLAG_SRC_MALLOC) == 0) {
+        /* the source outlives the irep, so pool the bytes in place as a
+           nofree view without allocating a temporary GC string */
+        irep->pool[i] = mrb_str_pool_static(mrb, (const char *)src, pool_data_len);
+        src += pool_data_len;
+        irep->plen++;
+        continue;
+      }
       if (flags & FLAG_SRC_MALLOC) {
         s = mrb_str_new(mrb, (char *)src, pool_data_len);
       }
@@ -158,7 +214,7 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flag
     irep->syms = (mrb_sym *)mrb_malloc(mrb, sizeof(mrb_sym) * irep->slen);
 
     for (i = 0; i < irep->slen; i++) {
-      snl = bin_to_uint16(src);               /* symbol name length */
+      snl = bin_to_uint16(src);               /* symbol name length or index */
       src += sizeof(uint16_t);
 
       if (snl == MRB_DUMP_NULL_SYM_LEN) {
@@ -166,6 +222,16 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flag
         continue;
       }
 
+      if (flags & FLAG_SYMTAB) {
+        /* index into the binary's symbol table; the name was already
+           interned once when the SYMT section was read */
+        if (symtab == NULL || snl >= symtab->len) {
+          return NULL;
+        }
+        irep->syms[i] = symtab->syms[snl];
+        continue;
+      }
+
       if (flags & FLAG_SRC_MALLOC) {
         irep->syms[i] = mrb_intern(mrb, (char *)src, snl);
       }
@@ -188,9 +254,9 @@ read_irep_record_1(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flag
 }
 
 static mrb_irep*
-read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags)
+read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags, struct mrb_irep_symtab *symtab)
 {
-  mrb_irep *irep = read_irep_record_1(mrb, bin, len, flags);
+  mrb_irep *irep = read_irep_record_1(mrb, bin, len, flags, symtab);
   size_t i;
 
   if (irep == NULL) {
@@ -198,10 +264,31 @@ read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags)
   }
 
   bin += *len;
+  if ((flags & FLAG_LAZY) && irep->rlen > 0) {
+    /* note where each child record sits and read it on first use; the
+       record size field is an estimate (max padding), so the skim has
+       to walk the record structure to find the child boundaries */
+    irep->lazy_reps = (const uint8_t **)mrb_malloc(mrb, sizeof(uint8_t*) * irep->rlen);
+    irep->lazy_flags = flags;
+    if (symtab) {
+      /* children resolve their symbol indices when materialized */
+      irep->symtab = symtab;
+      symtab->refcnt++;
+    }
+    for (i=0; i<irep->rlen; i++) {
+      const uint8_t *next = skip_irep_record(bin, flags);
+
+      irep->reps[i] = NULL;
+      irep->lazy_reps[i] = bin;
+      *len += (size_t)(next - bin);
+      bin = next;
+    }
+    return irep;
+  }
   for (i=0; i<irep->rlen; i++) {
     size_t rlen;
 
-    irep->reps[i] = read_irep_record(mrb, bin, &rlen, flags);
+    irep->reps[i] = read_irep_record(mrb, bin, &rlen, flags, symtab);
     if (irep->reps[i] == NULL) {
       return NULL;
     }
@@ -211,13 +298,232 @@ read_irep_record(mrb_state *mrb, const uint8_t *bin, size_t *len, uint8_t flags)
   return irep;
 }
 
+/* reads the lazily noted child record i of irep (see FLAG_LAZY) */
+mrb_irep*
+mrb_irep_read_rep(mrb_state *mrb, mrb_irep *irep, size_t i)
+{
+  size_t len;
+  mrb_irep *child;
+
+  child = read_irep_record(mrb, irep->lazy_reps[i], &len, irep->lazy_flags, irep->symtab);
+  if (child == NULL) {
+    mrb_raise(mrb, E_SCRIPT_ERROR, "irep load error");
+  }
+  irep->reps[i] = child;
+  return child;
+}
+
+/* resolves the binary's symbol table (SYMT section) up front: each
+   unique name is interned exactly once, and the irep records that
+   follow refer to symbols by index into it */
+static struct mrb_irep_symtab*
+read_section_symtab(mrb_state *mrb, const uint8_t *bin, uint8_t flags)
+{
+  const uint8_t *src = bin + sizeof(struct rite_section_header);
+  struct mrb_irep_symtab *tab;
+  uint32_t i, len;
+  uint16_t snl;
+
+  len = bin_to_uint32(src);
+  src += sizeof(uint32_t);
+  tab = (struct mrb_irep_symtab*)mrb_malloc(mrb, sizeof(struct mrb_irep_symtab));
+  tab->len = len;
+  tab->refcnt = 1;
+  tab->syms = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym) * len);
+  for (i = 0; i < len; i++) {
+    snl = bin_to_uint16(src);
+    src += sizeof(uint16_t);
+    if (flags & FLAG_SRC_MALLOC) {
+      tab->syms[i] = mrb_intern(mrb, (const char*)src, snl);
+    }
+    else {
+      tab->syms[i] = mrb_intern_static(mrb, (const char*)src, snl);
+    }
+    src += snl + 1;
+  }
+  return tab;
+}
+
+void
+mrb_irep_symtab_decref(mrb_state *mrb, struct mrb_irep_symtab *tab)
+{
+  if (--tab->refcnt > 0) return;
+  mrb_free(mrb, tab->syms);
+  mrb_free(mrb, tab);
+}
+
+/* forces every pending lazy child in; the lineno/debug/lv sections
+   index the whole irep tree and need it materialized */
+static void
+read_lazy_reps(mrb_state *mrb, mrb_irep *irep)
+{
+  size_t i;
+
+  for (i = 0; i < irep->rlen; i++) {
+    if (irep->reps[i] == NULL) {
+      mrb_irep_read_rep(mrb, irep, i);
+    }
+    read_lazy_reps(mrb, irep->reps[i]);
+  }
+}
+
 static mrb_irep*
-read_section_irep(mrb_state *mrb, const uint8_t *bin, uint8_t flags)
+read_section_irep(mrb_state *mrb, const uint8_t *bin, uint8_t flags, struct mrb_irep_symtab *symtab)
 {
   size_t len;
 
   bin += sizeof(struct rite_section_irep_header);
-  return read_irep_record(mrb, bin, &len, flags);
+  return read_irep_record(mrb, bin, &len, flags, symtab);
+}
+
+/* compact irep section (CPIR): varint operands and one string table
+   shared by the whole tree.  Always expands into native heap copies,
+   so zero-copy static loading and lazy children do not apply here. */
+static mrb_code
+read_compact_iseq(const uint8_t **src)
+{
+  int op = *(*src)++;
+  uint32_t a, b, c;
+
+  switch (mrb_compact_op_fmt(op)) {
+  case CPIR_FMT_ABX:
+    a = bin_to_varint(src);
+    b = bin_to_varint(src);
+    return MKOP_ABx(op, a, b);
+  case CPIR_FMT_ASBX: {
+    int32_t sbx;
+
+    a = bin_to_varint(src);
+    b = bin_to_varint(src);
+    sbx = (int32_t)(b >> 1) ^ -(int32_t)(b & 1);
+    return MKOP_AsBx(op, a, sbx);
+  }
+  default: /* CPIR_FMT_ABC */
+    a = bin_to_varint(src);
+    b = bin_to_varint(src);
+    c = bin_to_varint(src);
+    return MKOP_ABC(op, a, b, c);
+  }
+}
+
+static mrb_irep*
+read_compact_record(mrb_state *mrb, const uint8_t **src, const char **str, const uint16_t *len, uint32_t nstrings, mrb_sym *symmemo)
+{
+  int ai = mrb_gc_arena_save(mrb);
+  mrb_irep *irep = mrb_add_irep(mrb);
+  size_t i, plen;
+  uint32_t idx;
+  uint8_t tt;
+
+  irep->nlocals = (uint16_t)bin_to_varint(src);
+  irep->nregs = (uint16_t)bin_to_varint(src);
+  irep->rlen = (size_t)bin_to_varint(src);
+
+  irep->ilen = (size_t)bin_to_varint(src);
+  if (irep->ilen > 0) {
+    if (SIZE_ERROR_MUL(irep->ilen, sizeof(mrb_code))) {
+      return NULL;
+    }
+    irep->iseq = (mrb_code*)mrb_malloc(mrb, sizeof(mrb_code) * irep->ilen);
+    for (i = 0; i < irep->ilen; i++) {
+      irep->iseq[i] = read_compact_iseq(src);
+    }
+  }
+
+  plen = (size_t)bin_to_varint(src);
+  if (plen > 0) {
+    if (SIZE_ERROR_MUL(plen, sizeof(mrb_value))) {
+      return NULL;
+    }
+    irep->pool = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value) * plen);
+    for (i = 0; i < plen; i++) {
+      mrb_value s;
+
+      tt = *(*src)++; /* pool TT */
+      idx = bin_to_varint(src);
+      if (idx >= nstrings) {
+        return NULL;
+      }
+      s = mrb_str_new(mrb, str[idx], len[idx]);
+      switch (tt) { /* pool data */
+      case IREP_TT_FIXNUM:
+        irep->pool[i] = mrb_str_to_inum(mrb, s, 10, FALSE);
+        break;
+
+      case IREP_TT_FLOAT:
+        irep->pool[i] = mrb_float_pool(mrb, mrb_str_to_dbl(mrb, s, FALSE));
+        break;
+
+      case IREP_TT_STRING:
+        irep->pool[i] = mrb_str_pool(mrb, s);
+        break;
+
+      default:
+        /* should not happen */
+        irep->pool[i] = mrb_nil_value();
+        break;
+      }
+      irep->plen++;
+      mrb_gc_arena_restore(mrb, ai);
+    }
+  }
+
+  irep->slen = (size_t)bin_to_varint(src);
+  if (irep->slen > 0) {
+    if (SIZE_ERROR_MUL(irep->slen, sizeof(mrb_sym))) {
+      return NULL;
+    }
+    irep->syms = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym) * irep->slen);
+    for (i = 0; i < irep->slen; i++) {
+      idx = bin_to_varint(src);
+      if (idx == 0) { /* null symbol */
+        irep->syms[i] = 0;
+        continue;
+      }
+      if (idx > nstrings) {
+        return NULL;
+      }
+      if (symmemo[idx-1] == 0) { /* intern each unique name once per binary */
+        symmemo[idx-1] = mrb_intern(mrb, str[idx-1], len[idx-1]);
+      }
+      irep->syms[i] = symmemo[idx-1];
+    }
+  }
+
+  irep->reps = (mrb_irep**)mrb_malloc(mrb, sizeof(mrb_irep*)*irep->rlen);
+  for (i = 0; i < irep->rlen; i++) {
+    irep->reps[i] = read_compact_record(mrb, src, str, len, nstrings, symmemo);
+    if (irep->reps[i] == NULL) {
+      return NULL;
+    }
+  }
+  return irep;
+}
+
+static mrb_irep*
+read_section_compact(mrb_state *mrb, const uint8_t *bin)
+{
+  const uint8_t *src = bin + sizeof(struct rite_section_irep_header);
+  uint32_t nstrings, i;
+  const char **str;
+  uint16_t *len;
+  mrb_sym *symmemo;
+  mrb_irep *irep;
+
+  nstrings = bin_to_varint(&src);
+  str = (const char**)mrb_malloc(mrb, sizeof(char*) * nstrings);
+  len = (uint16_t*)mrb_malloc(mrb, sizeof(uint16_t) * nstrings);
+  symmemo = (mrb_sym*)mrb_calloc(mrb, nstrings, sizeof(mrb_sym));
+  for (i = 0; i < nstrings; i++) {
+    len[i] = (uint16_t)bin_to_varint(&src);
+    str[i] = (const char*)src;
+    src += len[i];
+  }
+  irep = read_compact_record(mrb, &src, str, len, nstrings, symmemo);
+  mrb_free(mrb, str);
+  mrb_free(mrb, len);
+  mrb_free(mrb, symmemo);
+  return irep;
 }
 
 static int
@@ -289,12 +595,12 @@ read_section_lineno(mrb_state *mrb, const uint8_t *bin, mrb_irep *irep)
 }
 
 static int
-read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
+read_debug_record_1(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
 {
   const uint8_t *bin = start;
   ptrdiff_t diff;
-  size_t record_size, i;
-  uint16_t f_idx;
+  size_t record_size;
+  uint16_t flen, f_idx;
 
   if (irep->debug_info) { return MRB_DUMP_INVALID_IREP; }
 
@@ -304,17 +610,20 @@ read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *
   record_size = (size_t)bin_to_uint32(bin);
   bin += sizeof(uint32_t);
 
-  irep->debug_info->flen = bin_to_uint16(bin);
-  irep->debug_info->files = (mrb_irep_debug_info_file**)mrb_malloc(mrb, sizeof(mrb_irep_debug_info*) * irep->debug_info->flen);
+  flen = bin_to_uint16(bin);
+  irep->debug_info->files = (mrb_irep_debug_info_file**)mrb_malloc(mrb, sizeof(mrb_irep_debug_info*) * flen);
+  /* counted up as files land, so a partial record frees cleanly */
+  irep->debug_info->flen = 0;
   bin += sizeof(uint16_t);
 
-  for (f_idx = 0; f_idx < irep->debug_info->flen; ++f_idx) {
+  for (f_idx = 0; f_idx < flen; ++f_idx) {
     mrb_irep_debug_info_file *file;
     uint16_t filename_idx;
     mrb_int len;
 
     file = (mrb_irep_debug_info_file *)mrb_malloc(mrb, sizeof(*file));
-    irep->debug_info->files[f_idx] = file;
+    file->lines.ptr = NULL;
+    irep->debug_info->files[irep->debug_info->flen++] = file;
 
     file->start_pos = bin_to_uint32(bin);
     bin += sizeof(uint32_t);
@@ -366,9 +675,24 @@ read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *
     return MRB_DUMP_GENERAL_FAILURE;
   }
 
+  *record_len = (size_t)diff;
+  return MRB_DUMP_OK;
+}
+
+static int
+read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *record_len, const mrb_sym *filenames, size_t filenames_len)
+{
+  const uint8_t *bin = start;
+  ptrdiff_t diff;
+  size_t i;
+  int ret;
+
+  ret = read_debug_record_1(mrb, bin, irep, record_len, filenames, filenames_len);
+  if (ret != MRB_DUMP_OK) return ret;
+  bin += *record_len;
+
   for (i = 0; i < irep->rlen; i++) {
     size_t len;
-    int ret;
 
     ret = read_debug_record(mrb, bin, irep->reps[i], &len, filenames, filenames_len);
     if (ret != MRB_DUMP_OK) return ret;
@@ -382,6 +706,47 @@ read_debug_record(mrb_state *mrb, const uint8_t *start, mrb_irep* irep, size_t *
   return MRB_DUMP_OK;
 }
 
+/* notes where each irep's debug record sits instead of decoding it;
+   record sizes in the debug section are exact, so the walk is a few
+   adds per irep.  `files` is the section's filename table, shared by
+   the whole tree. */
+static const uint8_t*
+note_debug_record(const uint8_t *bin, mrb_irep *irep, struct mrb_irep_symtab *files)
+{
+  size_t i;
+
+  irep->lazy_debug = bin;
+  irep->debug_files = files;
+  files->refcnt++;
+  bin += bin_to_uint32(bin);
+  for (i = 0; i < irep->rlen; i++) {
+    bin = note_debug_record(bin, irep->reps[i], files);
+  }
+  return bin;
+}
+
+/* decodes the debug record noted by read_section_debug on first use; a
+   process that never prints a backtrace keeps the line tables out of
+   RAM entirely */
+MRB_API void
+mrb_debug_info_materialize(mrb_state *mrb, mrb_irep *irep)
+{
+  size_t len;
+  int ret;
+
+  if (irep == NULL || irep->lazy_debug == NULL) return;
+  ret = read_debug_record_1(mrb, irep->lazy_debug, irep, &len,
+                            irep->debug_files->syms, irep->debug_files->len);
+  if (ret != MRB_DUMP_OK && irep->debug_info) {
+    /* fall back to no line info rather than failing mid-backtrace */
+    mrb_debug_info_free(mrb, irep->debug_info);
+    irep->debug_info = NULL;
+  }
+  irep->lazy_debug = NULL;
+  mrb_irep_symtab_decref(mrb, irep->debug_files);
+  irep->debug_files = NULL;
+}
+
 static int
 read_section_debug(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, uint8_t flags)
 {
@@ -413,6 +778,26 @@ read_section_debug(mrb_state *mrb, const uint8_t *start, mrb_irep *irep, uint8_t
     bin += f_len;
   }
 
+  if (!(flags & FLAG_SRC_MALLOC)) {
+    /* the binary stays around: note each record's position and decode
+       on first use (mrb_debug_info_materialize).  The filename table
+       moves into a shared refcounted struct the noted ireps hold. */
+    struct mrb_irep_symtab *files;
+
+    files = (struct mrb_irep_symtab*)mrb_malloc(mrb, sizeof(struct mrb_irep_symtab));
+    files->syms = filenames;
+    files->len = filenames_len;
+    files->refcnt = 1;
+    bin = note_debug_record(bin, irep, files);
+    mrb_irep_symtab_decref(mrb, files);
+    diff = bin - start;
+    mrb_assert_int_fit(ptrdiff_t, diff, size_t, SIZE_MAX);
+    if ((uint32_t)diff != bin_to_uint32(header->section_size)) {
+      return MRB_DUMP_GENERAL_FAILURE;
+    }
+    return MRB_DUMP_OK;
+  }
+
   result = read_debug_record(mrb, bin, irep, &len, filenames, filenames_len);
   if (result != MRB_DUMP_OK) goto debug_exit;
 
@@ -549,6 +934,7 @@ read_irep(mrb_state *mrb, const uint8_t *bin, uint8_t flags)
 {
   int result;
   mrb_irep *irep = NULL;
+  struct mrb_irep_symtab *symtab = NULL;
   const struct rite_section_header *section_header;
   uint16_t crc;
   size_t bin_size = 0;
@@ -562,43 +948,68 @@ read_irep(mrb_state *mrb, const uint8_t *bin, uint8_t flags)
   if (result != MRB_DUMP_OK) {
     return NULL;
   }
+  if (!(flags & FLAG_SRC_MALLOC)) {
+    /* the binary stays around, so child ireps can wait until used */
+    flags |= FLAG_LAZY;
+  }
 
-  n = offset_crc_body();
-  if (crc != calc_crc_16_ccitt(bin + n, bin_size - n, 0)) {
-    return NULL;
+  if (!(flags & FLAG_NO_CRC)) {
+    n = offset_crc_body();
+    if (crc != calc_crc_16_ccitt(bin + n, bin_size - n, 0)) {
+      return NULL;
+    }
   }
 
   bin += sizeof(struct rite_binary_header);
   do {
     section_header = (const struct rite_section_header *)bin;
-    if (memcmp(section_header->section_ident, RITE_SECTION_IREP_IDENT, sizeof(section_header->section_ident)) == 0) {
-      irep = read_section_irep(mrb, bin, flags);
-      if (!irep) return NULL;
+    if (memcmp(section_header->section_ident, RITE_SECTION_SYMTAB_IDENT, sizeof(section_header->section_ident)) == 0) {
+      symtab = read_section_symtab(mrb, bin, flags);
+      flags |= FLAG_SYMTAB;
+    }
+    else if (memcmp(section_header->section_ident, RITE_SECTION_IREP_IDENT, sizeof(section_header->section_ident)) == 0) {
+      irep = read_section_irep(mrb, bin, flags, symtab);
+      if (!irep) goto load_exit;
+    }
+    else if (memcmp(section_header->section_ident, RITE_SECTION_COMPACT_IREP_IDENT, sizeof(section_header->section_ident)) == 0) {
+      irep = read_section_compact(mrb, bin);
+      if (!irep) goto load_exit;
     }
     else if (memcmp(section_header->section_ident, RITE_SECTION_LINENO_IDENT, sizeof(section_header->section_ident)) == 0) {
-      if (!irep) return NULL;   /* corrupted data */
+      if (!irep) goto load_exit;   /* corrupted data */
+      read_lazy_reps(mrb, irep);
       result = read_section_lineno(mrb, bin, irep);
       if (result < MRB_DUMP_OK) {
-        return NULL;
+        irep = NULL;
+        goto load_exit;
       }
     }
     else if (memcmp(section_header->section_ident, RITE_SECTION_DEBUG_IDENT, sizeof(section_header->section_ident)) == 0) {
-      if (!irep) return NULL;   /* corrupted data */
+      if (!irep) goto load_exit;   /* corrupted data */
+      read_lazy_reps(mrb, irep);
       result = read_section_debug(mrb, bin, irep, flags);
       if (result < MRB_DUMP_OK) {
-        return NULL;
+        irep = NULL;
+        goto load_exit;
       }
     }
     else if (memcmp(section_header->section_ident, RITE_SECTION_LV_IDENT, sizeof(section_header->section_ident)) == 0) {
-      if (!irep) return NULL;
+      if (!irep) goto load_exit;
+      read_lazy_reps(mrb, irep);
       result = read_section_lv(mrb, bin, irep, flags);
       if (result < MRB_DUMP_OK) {
-        return NULL;
+        irep = NULL;
+        goto load_exit;
       }
     }
     bin += bin_to_uint32(section_header->section_size);
   } while (memcmp(section_header->section_ident, RITE_BINARY_EOF, sizeof(section_header->section_ident)) != 0);
 
+load_exit:
+  if (symtab) {
+    /* ireps with pending lazy children keep their own reference */
+    mrb_irep_symtab_decref(mrb, symtab);
+  }
   return irep;
 }
 
@@ -614,6 +1025,37 @@ mrb_read_irep(mrb_state *mrb, const uint8_t *bin)
   return read_irep(mrb, bin, flags);
 }
 
+/*
+ * Reads a binary the caller guarantees to outlive the mrb_state, such
+ * as a memory-mapped .mrb file or a flash-resident array.  iseq, pool
+ * strings and symbol names then point straight into the binary when its
+ * byte order matches; mrb_read_irep only does that for buffers it can
+ * prove live in the program image (mrb_ro_data_p).
+ */
+MRB_API mrb_irep*
+mrb_read_irep_static(mrb_state *mrb, const uint8_t *bin)
+{
+  return read_irep(mrb, bin, FLAG_SRC_STATIC);
+}
+
+/*
+ * As mrb_read_irep, for buffers whose integrity the embedder has
+ * already established by stronger means (a signature check, a secure
+ * boot chain): skips the CRC pass over the binary.  Never feed this
+ * unverified data; the default entry points stay checked.
+ */
+MRB_API mrb_irep*
+mrb_read_irep_trusted(mrb_state *mrb, const uint8_t *bin)
+{
+#ifdef MRB_USE_ETEXT_EDATA
+  uint8_t flags = mrb_ro_data_p((char*)bin) ? FLAG_SRC_STATIC : FLAG_SRC_MALLOC;
+#else
+  uint8_t flags = FLAG_SRC_STATIC;
+#endif
+
+  return read_irep(mrb, bin, flags | FLAG_NO_CRC);
+}
+
 void mrb_exc_set(mrb_state *mrb, mrb_value exc);
 
 static void
@@ -625,9 +1067,13 @@ irep_error(mrb_state *mrb)
 MRB_API mrb_value
 mrb_load_irep_cxt(mrb_state *mrb, const uint8_t *bin, mrbc_context *c)
 {
-  mrb_irep *irep = mrb_read_irep(mrb, bin);
+  mrb_irep *irep;
   struct RProc *proc;
+  mrb_value v;
 
+  if (mrb->trace) mrb_trace_phase_begin(mrb, "load_irep.read");
+  irep = mrb_read_irep(mrb, bin);
+  if (mrb->trace) mrb_trace_phase_end(mrb);
   if (!irep) {
     irep_error(mrb);
     return mrb_nil_value();
@@ -635,7 +1081,10 @@ mrb_load_irep_cxt(mrb_state *mrb, const uint8_t *bin, mrbc_context *c)
   proc = mrb_proc_new(mrb, irep);
   mrb_irep_decref(mrb, irep);
   if (c && c->no_exec) return mrb_obj_value(proc);
-  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+  if (mrb->trace) mrb_trace_phase_begin(mrb, "load_irep.exec");
+  v = mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+  if (mrb->trace) mrb_trace_phase_end(mrb);
+  return v;
 }
 
 MRB_API mrb_value
@@ -644,6 +1093,111 @@ mrb_load_irep(mrb_state *mrb, const uint8_t *bin)
   return mrb_load_irep_cxt(mrb, bin, NULL);
 }
 
+#ifdef MRB_USE_SHARED_SYMBOLS
+/* drops every per-state cache in the tree: inline method/constant/ivar
+   caches, frozen literals and JIT code hold pointers into the state
+   that executed the irep last and must not leak into the next one */
+static void
+irep_cache_reset(mrb_state *mrb, mrb_irep *irep)
+{
+  size_t i;
+
+  mrb_free(mrb, irep->ccache);
+  irep->ccache = NULL;
+  mrb_free(mrb, irep->kcache);
+  irep->kcache = NULL;
+  mrb_free(mrb, irep->icache);
+  irep->icache = NULL;
+  mrb_free(mrb, irep->lcache);
+  irep->lcache = NULL;
+  if (mrb->jit && irep->jit) {
+    mrb->jit->irep_free(mrb, irep);
+    irep->jit = NULL;
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    if (irep->reps[i]) {
+      irep_cache_reset(mrb, irep->reps[i]);
+    }
+  }
+}
+#endif
+
+/*
+ * Runs an irep image read once (mrb_read_irep_static) in another
+ * mrb_state, so per-sandbox states skip re-reading the binary.  The
+ * caller keeps its own reference and releases the image with
+ * mrb_irep_decref when done with it.
+ *
+ * Requires MRB_USE_SHARED_SYMBOLS: with per-state symbol tables the
+ * symbol ids baked into the image are meaningless in other states.
+ * The states must also share the allocator (true for mrb_open), and
+ * attach/teardown of an image is not synchronized — serialize it when
+ * sandboxes run on multiple threads.
+ */
+MRB_API mrb_value
+mrb_load_irep_shared(mrb_state *mrb, mrb_irep *irep)
+{
+#ifndef MRB_USE_SHARED_SYMBOLS
+  mrb_raise(mrb, E_RUNTIME_ERROR, "shared irep images require MRB_USE_SHARED_SYMBOLS");
+  return mrb_nil_value();
+#else
+  struct RProc *proc;
+
+  irep_cache_reset(mrb, irep);
+  proc = mrb_proc_new(mrb, irep);
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+#endif
+}
+
+/* as mrb_load_irep, for binaries that outlive the mrb_state (see
+   mrb_read_irep_static) */
+MRB_API mrb_value
+mrb_load_irep_static(mrb_state *mrb, const uint8_t *bin)
+{
+  mrb_irep *irep = mrb_read_irep_static(mrb, bin);
+  struct RProc *proc;
+
+  if (!irep) {
+    irep_error(mrb);
+    return mrb_nil_value();
+  }
+  proc = mrb_proc_new(mrb, irep);
+  mrb_irep_decref(mrb, irep);
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+
+/* as mrb_load_irep, for embedder-verified binaries (see
+   mrb_read_irep_trusted) */
+MRB_API mrb_value
+mrb_load_irep_trusted(mrb_state *mrb, const uint8_t *bin)
+{
+  mrb_irep *irep = mrb_read_irep_trusted(mrb, bin);
+  struct RProc *proc;
+
+  if (!irep) {
+    irep_error(mrb);
+    return mrb_nil_value();
+  }
+  proc = mrb_proc_new(mrb, irep);
+  mrb_irep_decref(mrb, irep);
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+
+/* runs an irep tree linked into the executable by mrbc -R; no decref,
+   static ireps are never freed */
+MRB_API mrb_value
+mrb_load_irep_struct(mrb_state *mrb, mrb_irep *irep)
+{
+  struct RProc *proc;
+
+  if (!irep) {
+    irep_error(mrb);
+    return mrb_nil_value();
+  }
+  proc = mrb_proc_new(mrb, irep);
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+
 #ifndef MRB_DISABLE_STDIO
 
 MRB_API mrb_irep*
@@ -680,6 +1234,205 @@ irep_exit:
   return irep;
 }
 
+/*
+ * Streaming reader: parses the file section by section and, inside the
+ * IREP section, record by record, through one reused window buffer, so
+ * the whole binary is never resident next to the constructed ireps.
+ * Peak transient memory is bounded by the largest single irep record
+ * (largest section for the lineno/debug/lv sections).  Needs a
+ * seekable stream: the CRC pass runs first, and each record's size
+ * field is an estimate the reader seeks back over.
+ */
+static mrb_irep*
+read_irep_record_file(mrb_state *mrb, FILE *fp, uint8_t **window, size_t *window_size, uint8_t flags, struct mrb_irep_symtab *symtab)
+{
+  uint8_t sizebuf[sizeof(uint32_t)];
+  uint32_t estimate;
+  long pos = ftell(fp);
+  /* the writer pads iseq relative to the binary start, so the record
+     must sit at the same offset modulo the alignment in the window */
+  size_t phase = (size_t)pos & (MRB_DUMP_ALIGNMENT-1);
+  size_t len, i;
+  mrb_irep *irep;
+
+  if (fread(sizebuf, 1, sizeof(sizebuf), fp) != sizeof(sizebuf)) {
+    return NULL;
+  }
+  estimate = bin_to_uint32(sizebuf);
+  if (estimate < sizeof(sizebuf)) {
+    return NULL;
+  }
+  if (*window_size < phase + estimate) {
+    *window_size = phase + estimate;
+    *window = (uint8_t*)mrb_realloc(mrb, *window, *window_size);
+  }
+  memcpy(*window + phase, sizebuf, sizeof(sizebuf));
+  /* the estimate includes maximum padding, so it may overlap what
+     follows the record by a few bytes; the footer guarantees they
+     exist, and the seek below rewinds over them */
+  if (fread(*window + phase + sizeof(sizebuf), 1, estimate - sizeof(sizebuf), fp) != estimate - sizeof(sizebuf)) {
+    return NULL;
+  }
+  irep = read_irep_record_1(mrb, *window + phase, &len, flags, symtab);
+  if (irep == NULL) {
+    return NULL;
+  }
+  if (fseek(fp, pos + (long)len, SEEK_SET) != 0) {
+    return NULL;
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    irep->reps[i] = read_irep_record_file(mrb, fp, window, window_size, flags, symtab);
+    if (irep->reps[i] == NULL) {
+      return NULL;
+    }
+  }
+  return irep;
+}
+
+MRB_API mrb_irep*
+mrb_read_irep_file_stream(mrb_state *mrb, FILE *fp)
+{
+  uint8_t header[sizeof(struct rite_binary_header)];
+  uint8_t secbuf[sizeof(struct rite_section_irep_header)];
+  uint8_t *window = NULL;
+  size_t window_size = 0;
+  mrb_irep *irep = NULL;
+  struct mrb_irep_symtab *symtab = NULL;
+  uint8_t flags = FLAG_SRC_MALLOC;
+  uint16_t crc;
+  size_t bin_size = 0, n;
+  long spos;
+  int result;
+
+  if ((mrb == NULL) || (fp == NULL)) {
+    return NULL;
+  }
+  if (fread(header, sizeof(header), 1, fp) == 0) {
+    return NULL;
+  }
+  result = read_binary_header(header, &bin_size, &crc, &flags);
+  if (result != MRB_DUMP_OK || bin_size <= sizeof(header)) {
+    return NULL;
+  }
+
+  /* CRC over the file in small chunks */
+  n = offset_crc_body();
+  if (fseek(fp, (long)n, SEEK_SET) != 0) {
+    return NULL;
+  }
+  {
+    uint8_t chunk[256];
+    size_t left = bin_size - n;
+    uint16_t c = 0;
+
+    while (left > 0) {
+      size_t want = left < sizeof(chunk) ? left : sizeof(chunk);
+
+      if (fread(chunk, 1, want, fp) != want) {
+        return NULL;
+      }
+      c = calc_crc_16_ccitt(chunk, want, c);
+      left -= want;
+    }
+    if (c != crc) {
+      return NULL;
+    }
+  }
+  if (fseek(fp, (long)sizeof(header), SEEK_SET) != 0) {
+    return NULL;
+  }
+
+  do {
+    struct rite_section_header *sh = (struct rite_section_header*)secbuf;
+    uint32_t section_size;
+
+    spos = ftell(fp);
+    if (fread(secbuf, 1, sizeof(struct rite_section_header), fp) != sizeof(struct rite_section_header)) {
+      irep = NULL;
+      break;
+    }
+    section_size = bin_to_uint32(sh->section_size);
+    if (memcmp(sh->section_ident, RITE_SECTION_IREP_IDENT, sizeof(sh->section_ident)) == 0) {
+      /* skip the rite version, then stream the records */
+      if (fseek(fp, spos + (long)sizeof(struct rite_section_irep_header), SEEK_SET) != 0) {
+        irep = NULL;
+        break;
+      }
+      irep = read_irep_record_file(mrb, fp, &window, &window_size, flags, symtab);
+      if (!irep) break;
+    }
+    else if (memcmp(sh->section_ident, RITE_BINARY_EOF, sizeof(sh->section_ident)) == 0) {
+      break;
+    }
+    else {
+      /* symtab/lineno/debug/lv sections have exact sizes; window the
+         whole section and reuse the in-memory readers */
+      if (window_size < section_size) {
+        window_size = section_size;
+        window = (uint8_t*)mrb_realloc(mrb, window, window_size);
+      }
+      memcpy(window, secbuf, sizeof(struct rite_section_header));
+      if (fread(window + sizeof(struct rite_section_header), 1,
+                section_size - sizeof(struct rite_section_header), fp)
+          != section_size - sizeof(struct rite_section_header)) {
+        irep = NULL;
+        break;
+      }
+      if (memcmp(sh->section_ident, RITE_SECTION_SYMTAB_IDENT, sizeof(sh->section_ident)) == 0) {
+        symtab = read_section_symtab(mrb, window, flags);
+        flags |= FLAG_SYMTAB;
+      }
+      else if (memcmp(sh->section_ident, RITE_SECTION_COMPACT_IREP_IDENT, sizeof(sh->section_ident)) == 0) {
+        irep = read_section_compact(mrb, window);
+        if (!irep) break;
+      }
+      else if (memcmp(sh->section_ident, RITE_SECTION_LINENO_IDENT, sizeof(sh->section_ident)) == 0) {
+        if (!irep || read_section_lineno(mrb, window, irep) < MRB_DUMP_OK) {
+          irep = NULL;
+          break;
+        }
+      }
+      else if (memcmp(sh->section_ident, RITE_SECTION_DEBUG_IDENT, sizeof(sh->section_ident)) == 0) {
+        if (!irep || read_section_debug(mrb, window, irep, flags) < MRB_DUMP_OK) {
+          irep = NULL;
+          break;
+        }
+      }
+      else if (memcmp(sh->section_ident, RITE_SECTION_LV_IDENT, sizeof(sh->section_ident)) == 0) {
+        if (!irep || read_section_lv(mrb, window, irep, flags) < MRB_DUMP_OK) {
+          irep = NULL;
+          break;
+        }
+      }
+    }
+    if (fseek(fp, spos + (long)section_size, SEEK_SET) != 0) {
+      irep = NULL;
+      break;
+    }
+  } while (1);
+
+  mrb_free(mrb, window);
+  if (symtab) {
+    mrb_irep_symtab_decref(mrb, symtab);
+  }
+  return irep;
+}
+
+MRB_API mrb_value
+mrb_load_irep_file_stream(mrb_state *mrb, FILE *fp)
+{
+  mrb_irep *irep = mrb_read_irep_file_stream(mrb, fp);
+  struct RProc *proc;
+
+  if (!irep) {
+    irep_error(mrb);
+    return mrb_nil_value();
+  }
+  proc = mrb_proc_new(mrb, irep);
+  mrb_irep_decref(mrb, irep);
+  return mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+
 void mrb_codedump_all(mrb_state*, struct RProc*);
 
 MRB_API mrb_value
@@ -12,6 +12,7 @@
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/numeric.h>
+#include <mruby/proc.h>
 #include <mruby/string.h>
 
 #ifdef MRB_USE_FLOAT
@@ -53,6 +54,22 @@ num_pow(mrb_state *mrb, mrb_value x)
   mrb_float d, yv;
 
   mrb_get_args(mrb, "o", &y);
+  if (mrb_fixnum_p(x) && mrb_fixnum_p(y) && mrb_fixnum(y) >= 0) {
+    /* exponentiation by squaring; pow() would round large results */
+    mrb_int base = mrb_fixnum(x);
+    mrb_int exp = mrb_fixnum(y);
+    mrb_int result = 1;
+
+    for (;;) {
+      if (exp & 1) {
+        if (mrb_int_mul_overflow(result, base, &result)) break;
+      }
+      exp >>= 1;
+      if (exp == 0) return mrb_fixnum_value(result);
+      if (mrb_int_mul_overflow(base, base, &base)) break;
+    }
+    /* overflowed; the result is a float anyway */
+  }
   yv = mrb_to_flo(mrb, y);
   d = pow(mrb_to_flo(mrb, x), yv);
   if (mrb_fixnum_p(x) && mrb_fixnum_p(y) && FIXABLE(d) && yv > 0 && 
@@ -586,20 +603,11 @@ fixdivmod(mrb_state *mrb, mrb_int x, mrb_int y, mrb_int *divp, mrb_int *modp)
 
   /* TODO: add mrb_assert(y != 0) to make sure */
 
-  if (y < 0) {
-    if (x < 0)
-      div = -x / -y;
-    else
-      div = - (x / -y);
-  }
-  else {
-    if (x < 0)
-      div = - (-x / y);
-    else
-      div = x / y;
-  }
-  mod = x - div*y;
-  if ((mod < 0 && y > 0) || (mod > 0 && y < 0)) {
+  /* one hardware division: C99 / and % truncate toward zero, so a
+     single fixup turns them into the floored pair Ruby wants */
+  div = x / y;
+  mod = x % y;
+  if (mod != 0 && ((mod ^ y) < 0)) {
     mod += y;
     div -= 1;
   }
@@ -1055,6 +1063,41 @@ mrb_fixnum_to_str(mrb_state *mrb, mrb_value x, int base)
   if (val == 0) {
     *--b = '0';
   }
+  else if (base == 10) {
+    /* two digits per division halves the divide count on the common
+       radix; negative values stay negative to keep MRB_INT_MIN safe */
+    static const char digitpairs[] =
+      "00010203040506070809101112131415161718192021222324"
+      "25262728293031323334353637383940414243444546474849"
+      "50515253545556575859606162636465666768697071727374"
+      "75767778798081828384858687888990919293949596979899";
+    mrb_bool neg = FALSE;
+    int r;
+
+    if (val < 0) {
+      neg = TRUE;
+    }
+    else {
+      val = -val;
+    }
+    while (val <= -100) {
+      r = -(int)(val % 100);
+      val /= 100;
+      b -= 2;
+      b[0] = digitpairs[r*2];
+      b[1] = digitpairs[r*2+1];
+    }
+    r = -(int)val;
+    if (r >= 10) {
+      b -= 2;
+      b[0] = digitpairs[r*2];
+      b[1] = digitpairs[r*2+1];
+    }
+    else {
+      *--b = mrb_digitmap[r];
+    }
+    if (neg) *--b = '-';
+  }
   else if (val < 0) {
     do {
       *--b = mrb_digitmap[-(val % base)];
@@ -1152,6 +1195,47 @@ flo_plus(mrb_state *mrb, mrb_value x)
 }
 
 /* ------------------------------------------------------------------------*/
+/*
+ * Counted-loop core of Integer#times, stepping a C counter instead of
+ * dispatching #+ and #< per round.  Declines (returns false) off the
+ * root context, where a block could legitimately Fiber.yield; the
+ * mrblib Integral#times then falls back to its in-VM loop.
+ */
+static mrb_value
+fix_times_int(mrb_state *mrb, mrb_value self)
+{
+  mrb_value blk, v;
+  mrb_int i, n;
+  int ai;
+
+  mrb_get_args(mrb, "&", &blk);
+  if (mrb->c != mrb->root_c) return mrb_false_value();
+  /* a captured env whose stack is gone (dead fiber) cannot be yielded
+     from here; env-less blocks never read self and are fine */
+  if (mrb_proc_ptr(blk)->env && !mrb_proc_ptr(blk)->env->stack) return mrb_false_value();
+  /* a block-`return` must unwind the enclosing method and cannot cross
+     this C frame */
+  if (mrb_proc_block_return_p(mrb, mrb_proc_ptr(blk))) return mrb_false_value();
+
+  n = mrb_fixnum(self);
+  ai = mrb_gc_arena_save(mrb);
+  mrb->break_proc = NULL;
+  for (i = 0; i < n; i++) {
+    v = mrb_yield(mrb, blk, mrb_fixnum_value(i));
+    if (mrb->break_proc) {
+      if (mrb->break_proc != mrb_proc_ptr(blk)) {
+        return v;  /* an outer block's break; the VM resumes it on return */
+      }
+      /* `break` in the block stopped at this C boundary; hand the
+         break value up for mrblib to return */
+      mrb->break_proc = NULL;
+      return mrb_ary_new_from_values(mrb, 1, &v);
+    }
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return mrb_true_value();
+}
+
 void
 mrb_init_numeric(mrb_state *mrb)
 {
@@ -1186,6 +1270,7 @@ mrb_init_numeric(mrb_state *mrb)
   mrb_define_method(mrb, fixnum,  ">>",       fix_rshift,        MRB_ARGS_REQ(1)); /* 15.2.8.3.13 */
   mrb_define_method(mrb, fixnum,  "eql?",     fix_eql,           MRB_ARGS_REQ(1)); /* 15.2.8.3.16 */
   mrb_define_method(mrb, fixnum,  "hash",     flo_hash,          MRB_ARGS_NONE()); /* 15.2.8.3.18 */
+  mrb_define_method(mrb, fixnum,  "__times_int", fix_times_int,  MRB_ARGS_NONE()); /* called from mrblib Integral#times */
   mrb_define_method(mrb, fixnum,  "to_f",     fix_to_f,          MRB_ARGS_NONE()); /* 15.2.8.3.23 */
   mrb_define_method(mrb, fixnum,  "to_s",     fix_to_s,          MRB_ARGS_NONE()); /* 15.2.8.3.25 */
   mrb_define_method(mrb, fixnum,  "inspect",  fix_to_s,          MRB_ARGS_NONE());
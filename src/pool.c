@@ -50,8 +50,14 @@ struct mrb_pool {
 MRB_API mrb_pool*
 mrb_pool_open(mrb_state *mrb)
 {
-  mrb_pool *pool = (mrb_pool *)mrb_malloc_simple(mrb, sizeof(mrb_pool));
+  mrb_pool *pool;
 
+  if (mrb && mrb->pool_cache) {
+    pool = mrb->pool_cache;
+    mrb->pool_cache = NULL;
+    return pool;
+  }
+  pool = (mrb_pool *)mrb_malloc_simple(mrb, sizeof(mrb_pool));
   if (pool) {
     pool->mrb = mrb;
     pool->pages = NULL;
@@ -66,6 +72,30 @@ mrb_pool_close(mrb_pool *pool)
   struct mrb_pool_page *page, *tmp;
 
   if (!pool) return;
+  if (pool->mrb && !pool->mrb->pool_cache) {
+    /* The compiler opens a pool per parse and another per codegen pass,
+       so incremental callers (mirb lines, eval) malloc and free pool
+       pages for every statement.  Keep one standard-size page around
+       for the next open instead; oversized pages still go back. */
+    struct mrb_pool_page *keep = NULL;
+
+    page = pool->pages;
+    while (page) {
+      tmp = page;
+      page = page->next;
+      if (!keep && tmp->len == POOL_PAGE_SIZE) {
+        tmp->offset = 0;
+        tmp->next = NULL;
+        keep = tmp;
+      }
+      else {
+        mrb_free(pool->mrb, tmp);
+      }
+    }
+    pool->pages = keep;
+    pool->mrb->pool_cache = pool;
+    return;
+  }
   page = pool->pages;
   while (page) {
     tmp = page;
@@ -75,6 +105,23 @@ mrb_pool_close(mrb_pool *pool)
   mrb_free(pool->mrb, pool);
 }
 
+void
+mrb_pool_cache_clear(mrb_state *mrb)
+{
+  mrb_pool *pool = mrb->pool_cache;
+  struct mrb_pool_page *page, *tmp;
+
+  if (!pool) return;
+  mrb->pool_cache = NULL;
+  page = pool->pages;
+  while (page) {
+    tmp = page;
+    page = page->next;
+    mrb_free(mrb, tmp);
+  }
+  mrb_free(mrb, pool);
+}
+
 static struct mrb_pool_page*
 page_alloc(mrb_pool *pool, size_t len)
 {
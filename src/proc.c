@@ -42,7 +42,7 @@ env_new(mrb_state *mrb, int nlocals)
   e = (struct REnv*)mrb_obj_alloc(mrb, MRB_TT_ENV, (struct RClass*)mrb->c->ci->proc->env);
   MRB_SET_ENV_STACK_LEN(e, nlocals);
   e->mid = mrb->c->ci->mid;
-  e->cioff = mrb->c->ci - mrb->c->cibase;
+  e->cioff = mrb->c->ci->ciidx;
   e->stack = mrb->c->stack;
 
   return e;
@@ -68,7 +68,9 @@ mrb_closure_new(mrb_state *mrb, mrb_irep *irep)
 {
   struct RProc *p = mrb_proc_new(mrb, irep);
 
-  closure_setup(mrb, p, mrb->c->ci->proc->body.irep->nlocals);
+  /* capture only as much of the frame as its blocks can actually
+     reach; the env then pins that many slots instead of every local */
+  closure_setup(mrb, p, mrb_irep_env_len(mrb, mrb->c->ci->proc->body.irep));
   return p;
 }
 
@@ -95,7 +97,7 @@ mrb_proc_new_cfunc_with_env(mrb_state *mrb, mrb_func_t func, mrb_int argc, const
   p->env = e = env_new(mrb, argc);
   mrb_field_write_barrier(mrb, (struct RBasic *)p, (struct RBasic *)p->env);
   MRB_ENV_UNSHARE_STACK(e);
-  e->stack = (mrb_value*)mrb_malloc(mrb, sizeof(mrb_value) * argc);
+  e->stack = (mrb_value*)mrb_slab_alloc(mrb, sizeof(mrb_value) * argc);
   if (argv) {
     for (i = 0; i < argc; ++i) {
       e->stack[i] = argv[i];
@@ -272,7 +274,7 @@ mrb_init_proc(mrb_state *mrb)
   mrb_define_method(mrb, mrb->proc_class, "arity", mrb_proc_arity, MRB_ARGS_NONE());
 
   m = mrb_proc_new(mrb, call_irep);
-  mrb_define_method_raw(mrb, mrb->proc_class, mrb_intern_lit(mrb, "call"), m);
+  mrb_define_method_raw(mrb, mrb->proc_class, MRB_SYM(call), m);
   mrb_define_method_raw(mrb, mrb->proc_class, mrb_intern_lit(mrb, "[]"), m);
 
   mrb_define_class_method(mrb, mrb->kernel_module, "lambda", proc_lambda, MRB_ARGS_NONE()); /* 15.3.1.2.6  */
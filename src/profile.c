@@ -0,0 +1,149 @@
+/*
+** profile.c - sampling profiler
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <mruby.h>
+#include <mruby/array.h>
+#include <mruby/irep.h>
+#include <mruby/debug.h>
+#include <mruby/hash.h>
+#include <mruby/numeric.h>
+#include <mruby/proc.h>
+#include <mruby/profile.h>
+#include <mruby/string.h>
+
+MRB_API void
+mrb_profile_start(mrb_state *mrb, uint32_t interval, uint32_t capacity)
+{
+  mrb_profile *prof;
+
+  mrb_profile_stop(mrb);
+  if (interval == 0) interval = 1;
+  if (capacity == 0) capacity = 1;
+  prof = (mrb_profile*)mrb_malloc(mrb, sizeof(mrb_profile));
+  prof->interval = interval;
+  prof->countdown = interval;
+  prof->capacity = capacity;
+  prof->head = 0;
+  prof->count = 0;
+  prof->samples = (struct mrb_profile_sample*)mrb_malloc(mrb, sizeof(struct mrb_profile_sample)*capacity);
+  mrb->prof = prof;
+}
+
+MRB_API void
+mrb_profile_stop(mrb_state *mrb)
+{
+  if (!mrb->prof) return;
+  mrb_free(mrb, mrb->prof->samples);
+  mrb_free(mrb, mrb->prof);
+  mrb->prof = NULL;
+}
+
+/* record the current callinfo chain, innermost frame first;
+   pc0 is the program counter of the topmost (interpreted) frame */
+void
+mrb_profile_sample_stack(mrb_state *mrb, mrb_code *pc0)
+{
+  mrb_profile *prof = mrb->prof;
+  struct mrb_profile_sample *s;
+  int i, ciidx;
+
+  prof->countdown = prof->interval;
+  s = &prof->samples[prof->head];
+  prof->head = (prof->head + 1) % prof->capacity;
+  if (prof->count < prof->capacity) prof->count++;
+  s->depth = 0;
+  ciidx = mrb->c->ci->ciidx;
+  for (i = ciidx; i >= 0 && s->depth < MRB_PROFILE_MAX_DEPTH; i--) {
+    mrb_callinfo *ci = mrb_ci_at(mrb->c, i);
+    mrb_irep *irep;
+    mrb_code *pc;
+
+    if (!ci->proc) continue;
+    if (MRB_PROC_CFUNC_P(ci->proc)) continue;
+    irep = ci->proc->body.irep;
+    if (i < ciidx) {
+      pc = mrb_ci_at(mrb->c, i+1)->pc - 1;
+    }
+    else {
+      pc = pc0;
+    }
+    s->frames[s->depth].mid = ci->mid;
+    if (pc && pc >= irep->iseq && pc < irep->iseq + irep->ilen) {
+      mrb_debug_info_materialize(mrb, irep);
+      s->frames[s->depth].lineno = mrb_debug_get_line(irep, (uint32_t)(pc - irep->iseq));
+    }
+    else {
+      s->frames[s->depth].lineno = -1;
+    }
+    s->depth++;
+  }
+}
+
+static mrb_value
+folded_stack_str(mrb_state *mrb, struct mrb_profile_sample *s)
+{
+  mrb_value str = mrb_str_new(mrb, NULL, 0);
+  int i;
+
+  /* frames are recorded innermost first; folded format wants the root
+     on the left */
+  for (i = s->depth - 1; i >= 0; i--) {
+    struct mrb_profile_frame *f = &s->frames[i];
+
+    if (f->mid) {
+      mrb_str_cat_cstr(mrb, str, mrb_sym2name(mrb, f->mid));
+    }
+    else {
+      mrb_str_cat_lit(mrb, str, "(top)");
+    }
+    if (f->lineno >= 0) {
+      mrb_str_cat_lit(mrb, str, ":");
+      mrb_str_append(mrb, str, mrb_fixnum_to_str(mrb, mrb_fixnum_value(f->lineno), 10));
+    }
+    if (i > 0) {
+      mrb_str_cat_lit(mrb, str, ";");
+    }
+  }
+  return str;
+}
+
+MRB_API mrb_value
+mrb_profile_dump(mrb_state *mrb)
+{
+  mrb_profile *prof = mrb->prof;
+  mrb_value agg, keys, result;
+  uint32_t n;
+  mrb_int k;
+  int ai;
+
+  result = mrb_str_new(mrb, NULL, 0);
+  if (!prof || prof->count == 0) return result;
+
+  /* aggregate identical stacks */
+  agg = mrb_hash_new(mrb);
+  ai = mrb_gc_arena_save(mrb);
+  for (n = 0; n < prof->count; n++) {
+    mrb_value str = folded_stack_str(mrb, &prof->samples[n]);
+    mrb_value cnt = mrb_hash_get(mrb, agg, str);
+
+    if (mrb_nil_p(cnt)) cnt = mrb_fixnum_value(0);
+    mrb_hash_set(mrb, agg, str, mrb_fixnum_value(mrb_fixnum(cnt)+1));
+    mrb_gc_arena_restore(mrb, ai);
+  }
+
+  keys = mrb_hash_keys(mrb, agg);
+  ai = mrb_gc_arena_save(mrb);
+  for (k = 0; k < RARRAY_LEN(keys); k++) {
+    mrb_value str = mrb_ary_ref(mrb, keys, k);
+
+    mrb_str_append(mrb, result, str);
+    mrb_str_cat_lit(mrb, result, " ");
+    mrb_str_append(mrb, result, mrb_fixnum_to_str(mrb, mrb_hash_get(mrb, agg, str), 10));
+    mrb_str_cat_lit(mrb, result, "\n");
+    mrb_gc_arena_restore(mrb, ai);
+  }
+  return result;
+}
@@ -9,6 +9,9 @@
 #include <mruby/range.h>
 #include <mruby/string.h>
 #include <mruby/array.h>
+#include <mruby/proc.h>
+#include <mruby/compar.h>
+#include <mruby/foreach.h>
 
 #define RANGE_CLASS (mrb_class_get(mrb, "Range"))
 
@@ -408,6 +411,121 @@ mrb_get_values_at(mrb_state *mrb, mrb_value obj, mrb_int olen, mrb_int argc, con
   return result;
 }
 
+/*
+ * Counted-loop core of Range#each for integer ranges, stepping a C
+ * counter instead of dispatching Fixnum#< and Fixnum#+ per round.
+ *
+ * Blocks invoked from C cannot Fiber.yield in this VM, so the helper
+ * declines (returns false) when called off the root context; the
+ * mrblib Range#each then falls back to its in-VM loop, which keeps
+ * fiber-based Enumerators working.  On the root context Fiber.yield
+ * would raise anyway, so the C loop is observationally equivalent.
+ */
+static mrb_value
+mrb_range_each_int(mrb_state *mrb, mrb_value range)
+{
+  struct RRange *r = mrb_range_ptr(range);
+  mrb_value blk, v;
+  mrb_int i, last;
+  int ai;
+
+  mrb_get_args(mrb, "&", &blk);
+  if (mrb->c != mrb->root_c) return mrb_false_value();
+  /* a captured env whose stack is gone (dead fiber) cannot be yielded
+     from here; env-less blocks never read self and are fine */
+  if (mrb_proc_ptr(blk)->env && !mrb_proc_ptr(blk)->env->stack) return mrb_false_value();
+  /* a block-`return` must unwind the enclosing method and cannot cross
+     this C frame */
+  if (mrb_proc_block_return_p(mrb, mrb_proc_ptr(blk))) return mrb_false_value();
+
+  i = mrb_fixnum(r->edges->beg);
+  last = mrb_fixnum(r->edges->end);
+  ai = mrb_gc_arena_save(mrb);
+  mrb->break_proc = NULL;
+  if (r->excl) {
+    while (i < last) {
+      v = mrb_yield(mrb, blk, mrb_fixnum_value(i));
+      if (mrb->break_proc) {
+        if (mrb->break_proc == mrb_proc_ptr(blk)) goto broke;
+        return v;  /* an outer block's break; the VM resumes it on return */
+      }
+      mrb_gc_arena_restore(mrb, ai);
+      i++;
+    }
+  }
+  else {
+    while (i <= last) {
+      v = mrb_yield(mrb, blk, mrb_fixnum_value(i));
+      if (mrb->break_proc) {
+        if (mrb->break_proc == mrb_proc_ptr(blk)) goto broke;
+        return v;  /* an outer block's break; the VM resumes it on return */
+      }
+      mrb_gc_arena_restore(mrb, ai);
+      if (i == last) break;  /* avoid overflow at MRB_INT_MAX */
+      i++;
+    }
+  }
+  return mrb_true_value();
+
+broke:
+  /* `break` in the block stopped at this C boundary; hand the break
+     value up for mrblib to return */
+  mrb->break_proc = NULL;
+  return mrb_ary_new_from_values(mrb, 1, &v);
+}
+
+MRB_API int
+mrb_range_foreach(mrb_state *mrb, mrb_value range, mrb_foreach_func func, void *data)
+{
+  struct RRange *r = mrb_range_ptr(range);
+  int ai = mrb_gc_arena_save(mrb);
+  int ret;
+
+  if (mrb_fixnum_p(r->edges->beg) && mrb_fixnum_p(r->edges->end)) {
+    mrb_int i = mrb_fixnum(r->edges->beg);
+    mrb_int last = mrb_fixnum(r->edges->end);
+    mrb_bool excl = r->excl;
+
+    while (excl ? i < last : i <= last) {
+      ret = func(mrb, mrb_fixnum_value(i), data);
+      if (ret) return ret;
+      mrb_gc_arena_restore(mrb, ai);
+      if (i == last) break;  /* avoid overflow at MRB_INT_MAX */
+      i++;
+    }
+    return 0;
+  }
+  else {
+    /* generic walk via succ/<=>, mirroring mrblib's Range#each */
+    mrb_value val = r->edges->beg;
+    mrb_value last = r->edges->end;
+    mrb_prepared_call succ_call = { 0 };
+    mrb_int cmp;
+
+    if (!mrb_respond_to(mrb, val, mrb_intern_lit(mrb, "succ"))) {
+      mrb_raise(mrb, E_TYPE_ERROR, "can't iterate");
+    }
+    for (;;) {
+      cmp = mrb_cmp(mrb, val, last);
+      if (cmp == MRB_CMP_FAILED) {
+        mrb_raise(mrb, E_TYPE_ERROR, "can't iterate");
+      }
+      if (cmp > 0 || (cmp == 0 && r->excl)) break;
+      ret = func(mrb, val, data);
+      if (ret) return ret;  /* keep the stopping callback's values in the arena */
+      mrb_gc_arena_restore(mrb, ai);
+      if (cmp == 0) break;
+      if (succ_call.mid == 0 || succ_call.c != mrb_class(mrb, val)) {
+        mrb_funcall_prepare(mrb, &succ_call, mrb_class(mrb, val),
+                            mrb_intern_lit(mrb, "succ"), 0);
+      }
+      val = mrb_funcall_prepared(mrb, &succ_call, val, NULL);
+      mrb_gc_protect(mrb, val);  /* keep across the next restore */
+    }
+    return 0;
+  }
+}
+
 void
 mrb_init_range(mrb_state *mrb)
 {
@@ -420,6 +538,7 @@ mrb_init_range(mrb_state *mrb)
   mrb_define_method(mrb, r, "end",             mrb_range_end,         MRB_ARGS_NONE()); /* 15.2.14.4.5  */
   mrb_define_method(mrb, r, "==",              mrb_range_eq,          MRB_ARGS_REQ(1)); /* 15.2.14.4.1  */
   mrb_define_method(mrb, r, "===",             mrb_range_include,     MRB_ARGS_REQ(1)); /* 15.2.14.4.2  */
+  mrb_define_method(mrb, r, "__each_int",      mrb_range_each_int,    MRB_ARGS_NONE()); /* called from mrblib Range#each */
   mrb_define_method(mrb, r, "exclude_end?",    mrb_range_excl,        MRB_ARGS_NONE()); /* 15.2.14.4.6  */
   mrb_define_method(mrb, r, "first",           mrb_range_beg,         MRB_ARGS_NONE()); /* 15.2.14.4.7  */
   mrb_define_method(mrb, r, "include?",        mrb_range_include,     MRB_ARGS_REQ(1)); /* 15.2.14.4.8  */
@@ -0,0 +1,246 @@
+/*
+** snapshot.c - boot-state snapshot and restore
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <mruby.h>
+#include <mruby/snapshot.h>
+
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * Everything a snapshotable state allocates is handed out by the
+ * first-fit allocator below from one contiguous anonymous mapping.  A
+ * snapshot is then just the used prefix of that mapping, and restore
+ * maps it back at the recorded address, so no pointer in the image
+ * ever needs rewriting.  The only addresses that reach outside the
+ * region are C function pointers and static data of the executable
+ * itself; the header records a probe address so restore can reject a
+ * process whose code sits elsewhere.
+ *
+ * The allocator is deliberately simple: boot allocations are long
+ * lived and the free list only has to absorb the churn of loading app
+ * code, so there is no coalescing and no size classes.
+ */
+
+#define SNAPSHOT_MAGIC "MRBSNAP0"
+#define SNAPSHOT_ALIGN (2 * sizeof(void*))
+#define snapshot_align(n) (((n) + SNAPSHOT_ALIGN - 1) & ~(SNAPSHOT_ALIGN - 1))
+
+struct snapshot_chunk {
+  size_t size;                  /* payload bytes */
+  struct snapshot_chunk *next;  /* next free chunk, on the free list */
+};
+
+struct snapshot_region {
+  char magic[8];
+  void *base;                   /* mapping address */
+  size_t size;                  /* mapping size */
+  size_t brk;                   /* high-water offset of the bump pointer */
+  struct snapshot_chunk *freelist;
+  mrb_state *mrb;
+  void *text_probe;             /* &mrb_open in the writing process */
+};
+
+static void*
+region_alloc(struct snapshot_region *r, size_t size)
+{
+  struct snapshot_chunk **p, *c;
+
+  size = snapshot_align(size);
+  for (p = &r->freelist; (c = *p) != NULL; p = &c->next) {
+    if (c->size >= size) {
+      *p = c->next;
+      return (char*)c + SNAPSHOT_ALIGN;
+    }
+  }
+  if (r->brk + SNAPSHOT_ALIGN + size > r->size) {
+    return NULL;
+  }
+  c = (struct snapshot_chunk*)((char*)r->base + r->brk);
+  c->size = size;
+  r->brk += SNAPSHOT_ALIGN + size;
+  return (char*)c + SNAPSHOT_ALIGN;
+}
+
+static void
+region_free(struct snapshot_region *r, void *p)
+{
+  struct snapshot_chunk *c = (struct snapshot_chunk*)((char*)p - SNAPSHOT_ALIGN);
+
+  c->next = r->freelist;
+  r->freelist = c;
+}
+
+static void*
+snapshot_allocf(mrb_state *mrb, void *p, size_t size, void *ud)
+{
+  struct snapshot_region *r = (struct snapshot_region*)ud;
+  struct snapshot_chunk *c;
+  void *q;
+
+  if (size == 0) {
+    if (p) region_free(r, p);
+    return NULL;
+  }
+  if (p == NULL) {
+    return region_alloc(r, size);
+  }
+  c = (struct snapshot_chunk*)((char*)p - SNAPSHOT_ALIGN);
+  if (c->size >= size) {
+    return p;                   /* shrinks stay in place */
+  }
+  q = region_alloc(r, size);
+  if (q == NULL) return NULL;
+  memcpy(q, p, c->size);
+  region_free(r, p);
+  return q;
+}
+
+static struct snapshot_region*
+state_region(mrb_state *mrb)
+{
+  struct snapshot_region *r = (struct snapshot_region*)mrb->allocf_ud;
+
+  if (r == NULL || memcmp(r->magic, SNAPSHOT_MAGIC, sizeof(r->magic)) != 0) {
+    return NULL;
+  }
+  return r;
+}
+
+MRB_API mrb_state*
+mrb_open_snapshotable(size_t region_size)
+{
+#ifdef MRB_USE_SHARED_SYMBOLS
+  /* symbols live in a process-global table outside the region, so the
+     image would not survive a new process */
+  return NULL;
+#else
+  struct snapshot_region *r;
+  void *mem;
+
+  if (region_size == 0) region_size = MRB_SNAPSHOT_REGION_SIZE;
+  mem = mmap(NULL, region_size, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  r = (struct snapshot_region*)mem;
+  memcpy(r->magic, SNAPSHOT_MAGIC, sizeof(r->magic));
+  r->base = mem;
+  r->size = region_size;
+  r->brk = snapshot_align(sizeof(*r));
+  r->freelist = NULL;
+  r->text_probe = (void*)(uintptr_t)mrb_open;
+  r->mrb = mrb_open_allocf(snapshot_allocf, r);
+  if (r->mrb == NULL) {
+    munmap(mem, region_size);
+    return NULL;
+  }
+  return r->mrb;
+#endif
+}
+
+MRB_API int
+mrb_snapshot_write(mrb_state *mrb, FILE *fp)
+{
+  struct snapshot_region *r = state_region(mrb);
+
+  if (r == NULL || fp == NULL) {
+    return MRB_SNAPSHOT_ERROR;
+  }
+  mrb_full_gc(mrb);
+  r->mrb = mrb;
+  if (fwrite(r->base, 1, r->brk, fp) != r->brk) {
+    return MRB_SNAPSHOT_ERROR;
+  }
+  return MRB_SNAPSHOT_OK;
+}
+
+MRB_API mrb_state*
+mrb_snapshot_restore(FILE *fp)
+{
+  struct snapshot_region hdr;
+  struct snapshot_region *r;
+  void *mem;
+
+  if (fp == NULL || fread(&hdr, sizeof(hdr), 1, fp) == 0) {
+    return NULL;
+  }
+  if (memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0) {
+    return NULL;
+  }
+  if (hdr.text_probe != (void*)(uintptr_t)mrb_open) {
+    /* the executable's code sits elsewhere (different binary, PIE with
+       ASLR); the image's function pointers would dangle */
+    return NULL;
+  }
+  if (hdr.brk > hdr.size || hdr.brk < sizeof(hdr)) {
+    return NULL;
+  }
+#ifdef MAP_FIXED_NOREPLACE
+  mem = mmap(hdr.base, hdr.size, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED_NOREPLACE, -1, 0);
+#else
+  mem = mmap(hdr.base, hdr.size, PROT_READ|PROT_WRITE,
+             MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+#endif
+  if (mem == MAP_FAILED) {
+    return NULL;
+  }
+  if (mem != hdr.base) {
+    /* the original address range is taken */
+    munmap(mem, hdr.size);
+    return NULL;
+  }
+  memcpy(mem, &hdr, sizeof(hdr));
+  if (fread((char*)mem + sizeof(hdr), 1, hdr.brk - sizeof(hdr), fp)
+      != hdr.brk - sizeof(hdr)) {
+    munmap(mem, hdr.size);
+    return NULL;
+  }
+  r = (struct snapshot_region*)mem;
+  return r->mrb;
+}
+
+MRB_API void
+mrb_snapshot_discard(mrb_state *mrb)
+{
+  struct snapshot_region *r = state_region(mrb);
+
+  if (r == NULL) return;
+  munmap(r->base, r->size);
+}
+
+#else  /* _WIN32 */
+
+MRB_API mrb_state*
+mrb_open_snapshotable(size_t region_size)
+{
+  return NULL;
+}
+
+MRB_API int
+mrb_snapshot_write(mrb_state *mrb, FILE *fp)
+{
+  return MRB_SNAPSHOT_ERROR;
+}
+
+MRB_API mrb_state*
+mrb_snapshot_restore(FILE *fp)
+{
+  return NULL;
+}
+
+MRB_API void
+mrb_snapshot_discard(mrb_state *mrb)
+{
+}
+
+#endif
@@ -10,13 +10,21 @@
 #include <mruby/irep.h>
 #include <mruby/variable.h>
 #include <mruby/debug.h>
+#include <mruby/profile.h>
 #include <mruby/string.h>
+#include <mruby/trace.h>
+#include <mruby/latency.h>
 
 void mrb_init_core(mrb_state*);
 void mrb_init_mrbgems(mrb_state*);
 
 void mrb_gc_init(mrb_state*, mrb_gc *gc);
 void mrb_gc_destroy(mrb_state*, mrb_gc *gc);
+void mrb_gc_destroy_fast(mrb_state*, mrb_gc *gc);
+
+#ifdef MRB_VM_OPCODE_PROFILE
+void mrb_opprof_dump(mrb_state*);  /* vm.c */
+#endif
 
 static mrb_value
 inspect_main(mrb_state *mrb, mrb_value mod)
@@ -42,6 +50,7 @@ mrb_open_core(mrb_allocf f, void *ud)
   mrb_gc_init(mrb, &mrb->gc);
   mrb->c = (struct mrb_context*)mrb_malloc(mrb, sizeof(struct mrb_context));
   *mrb->c = mrb_context_zero;
+  mrb->c->ci_clean = -1;
   mrb->root_c = mrb->c;
 
   mrb_init_core(mrb);
@@ -139,6 +148,25 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
 {
   size_t i;
 
+  if (irep->jit && mrb->jit && mrb->jit->irep_free) {
+    mrb->jit->irep_free(mrb, irep);
+  }
+  if (irep->flags & MRB_IREP_STATIC) {
+    /* linked into the executable; release only the per-state runtime
+       caches so the struct can serve the next state */
+    mrb_free(mrb, irep->ccache);
+    mrb_free(mrb, irep->kcache);
+    mrb_free(mrb, irep->lcache);
+    mrb_free(mrb, irep->icache);
+    irep->ccache = NULL;
+    irep->kcache = NULL;
+    irep->lcache = NULL;
+    irep->icache = NULL;
+    irep->jit = NULL;
+    irep->flags &= ~MRB_IREP_LEAF_CHECKED;
+    irep->refcnt = 1;
+    return;
+  }
   if (!(irep->flags & MRB_ISEQ_NO_FREE))
     mrb_free(mrb, irep->iseq);
   for (i=0; i<irep->plen; i++) {
@@ -147,7 +175,11 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
       mrb_free(mrb, mrb_obj_ptr(irep->pool[i]));
     }
 #ifdef MRB_WORD_BOXING
-    else if (mrb_type(irep->pool[i]) == MRB_TT_FLOAT) {
+    else if (mrb_type(irep->pool[i]) == MRB_TT_FLOAT
+#ifdef MRB_WORD_BOXING_FLONUM
+             && !mrb_flonum_p(irep->pool[i])
+#endif
+             ) {
       mrb_free(mrb, mrb_obj_ptr(irep->pool[i]));
     }
 #endif
@@ -155,9 +187,22 @@ mrb_irep_free(mrb_state *mrb, mrb_irep *irep)
   mrb_free(mrb, irep->pool);
   mrb_free(mrb, irep->syms);
   for (i=0; i<irep->rlen; i++) {
-    mrb_irep_decref(mrb, irep->reps[i]);
+    if (irep->reps[i]) {
+      mrb_irep_decref(mrb, irep->reps[i]);
+    }
   }
   mrb_free(mrb, irep->reps);
+  mrb_free(mrb, irep->lazy_reps);
+  if (irep->symtab) {
+    mrb_irep_symtab_decref(mrb, irep->symtab);
+  }
+  if (irep->debug_files) {
+    mrb_irep_symtab_decref(mrb, irep->debug_files);
+  }
+  mrb_free(mrb, irep->ccache);
+  mrb_free(mrb, irep->kcache);
+  mrb_free(mrb, irep->lcache);
+  mrb_free(mrb, irep->icache);
   mrb_free(mrb, irep->lv);
   mrb_free(mrb, (void *)irep->filename);
   mrb_free(mrb, irep->lines);
@@ -215,6 +260,24 @@ mrb_str_pool(mrb_state *mrb, mrb_value str)
   return mrb_obj_value(ns);
 }
 
+/* pool a string literal that lives as long as the state does (e.g. a
+   linked-in .mrb image) as a nofree view, without going through a
+   temporary GC string */
+mrb_value
+mrb_str_pool_static(mrb_state *mrb, const char *p, size_t len)
+{
+  struct RString *ns;
+
+  ns = (struct RString *)mrb_malloc(mrb, sizeof(struct RString));
+  ns->tt = MRB_TT_STRING;
+  ns->c = mrb->string_class;
+  ns->flags = MRB_STR_NOFREE;
+  ns->as.heap.ptr = (char *)p;
+  ns->as.heap.len = (mrb_int)len;
+  ns->as.heap.aux.capa = 0;
+  return mrb_obj_value(ns);
+}
+
 void mrb_free_backtrace(mrb_state *mrb);
 
 MRB_API void
@@ -222,12 +285,105 @@ mrb_free_context(mrb_state *mrb, struct mrb_context *c)
 {
   if (!c) return;
   mrb_free(mrb, c->stbase);
-  mrb_free(mrb, c->cibase);
+  if (c->ciseg) {
+    int i;
+
+    for (i=0; i<c->cisegs; i++) {
+      mrb_free(mrb, c->ciseg[i]);
+    }
+    mrb_free(mrb, c->ciseg);
+  }
   mrb_free(mrb, c->rescue);
   mrb_free(mrb, c->ensure);
   mrb_free(mrb, c);
 }
 
+/* Fiber contexts are recycled through a small per-state pool so that
+   short-lived fibers do not pay three allocations apiece: the context
+   struct, its value stack and its first callinfo segment stay warm
+   between fibers.  Contexts whose stack grew large are released rather
+   than hoarded. */
+#ifndef MRB_CONTEXT_CACHE_SIZE
+#define MRB_CONTEXT_CACHE_SIZE 16
+#endif
+#define CONTEXT_CACHE_MAX_STACK 256
+
+struct mrb_context*
+mrb_context_cache_get(mrb_state *mrb)
+{
+  struct mrb_context *c = mrb->cxt_cache;
+
+  if (!c) return NULL;
+  mrb->cxt_cache = c->prev;
+  mrb->cxt_cache_len--;
+  c->prev = NULL;
+  return c;
+}
+
+void
+mrb_context_recycle(mrb_state *mrb, struct mrb_context *c)
+{
+  mrb_value *stbase, *stend;
+  mrb_callinfo **ciseg;
+  int i;
+
+  if (!c) return;
+  if (mrb->cxt_cache_len >= MRB_CONTEXT_CACHE_SIZE ||
+      !c->stbase || !c->ciseg ||
+      c->stend - c->stbase > CONTEXT_CACHE_MAX_STACK) {
+    mrb_free_context(mrb, c);
+    return;
+  }
+
+  /* normalize to the shape fiber_init leaves after a fresh allocation:
+     one zeroed callinfo segment and a nil-filled stack */
+  for (i=1; i<c->cisegs; i++) {
+    mrb_free(mrb, c->ciseg[i]);
+  }
+  mrb_free(mrb, c->rescue);
+  mrb_free(mrb, c->ensure);
+  stbase = c->stbase;
+  stend = c->stend;
+  ciseg = c->ciseg;
+  memset(ciseg[0], 0, sizeof(mrb_callinfo)*MRB_CALLINFO_SEG_SIZE);
+#ifdef MRB_NAN_BOXING
+  {
+    mrb_value *p = stbase;
+
+    while (p < stend) {
+      SET_NIL_VALUE(*p);
+      p++;
+    }
+  }
+#else
+  memset(stbase, 0, (stend - stbase)*sizeof(mrb_value));
+#endif
+  memset(c, 0, sizeof(struct mrb_context));
+  c->stbase = c->stack = stbase;
+  c->stend = stend;
+  c->ciseg = ciseg;
+  c->cisegs = 1;
+  c->ci = ciseg[0];
+  c->ci_clean = -1;
+
+  c->prev = mrb->cxt_cache;
+  mrb->cxt_cache = c;
+  mrb->cxt_cache_len++;
+}
+
+void
+mrb_context_cache_clear(mrb_state *mrb)
+{
+  struct mrb_context *c;
+
+  while ((c = mrb->cxt_cache) != NULL) {
+    mrb->cxt_cache = c->prev;
+    c->prev = NULL;
+    mrb_free_context(mrb, c);
+  }
+  mrb->cxt_cache_len = 0;
+}
+
 MRB_API void
 mrb_close(mrb_state *mrb)
 {
@@ -242,13 +398,56 @@ mrb_close(mrb_state *mrb)
 #endif
   }
 
+#ifdef MRB_VM_OPCODE_PROFILE
+  mrb_opprof_dump(mrb);
+#endif
+
   /* free */
+  mrb_free(mrb, mrb->lazy_consts);
+  mrb_profile_stop(mrb);
+  mrb_latency_stop(mrb);
+  mrb_trace_stop(mrb);
   mrb_gc_free_gv(mrb);
   mrb_free_backtrace(mrb);
   mrb_free_context(mrb, mrb->root_c);
   mrb_free_symtbl(mrb);
   mrb_alloca_free(mrb);
+  mrb_pool_cache_clear(mrb);
   mrb_gc_destroy(mrb, &mrb->gc);
+  /* after the final sweep, which may have recycled fiber contexts */
+  mrb_context_cache_clear(mrb);
+  mrb_free(mrb, mrb);
+}
+
+/* Closes a state whose memory the embedder reclaims wholesale
+   afterwards, e.g. one opened on an mrb_alloc_arena that is freed right
+   after (see mruby/arena_alloc.h).  Only side effects that reach
+   outside the state's allocator still run: atexit handlers and the
+   dfree finalizers of wrapped RData objects.  String buffers, ivar
+   segments, khash tables, ireps and contexts are left untouched for the
+   allocator teardown, so closing costs O(heap pages) instead of
+   O(objects).  Never pair this with the default system allocator --
+   every per-object allocation would leak. */
+MRB_API void
+mrb_close_fast(mrb_state *mrb)
+{
+  if (!mrb) return;
+  if (mrb->atexit_stack_len > 0) {
+    mrb_int i;
+    for (i = mrb->atexit_stack_len; i > 0; --i) {
+      mrb->atexit_stack[i - 1](mrb);
+    }
+  }
+
+#ifdef MRB_VM_OPCODE_PROFILE
+  mrb_opprof_dump(mrb);
+#endif
+
+  /* these may dump requested reports before their buffers vanish */
+  mrb_profile_stop(mrb);
+  mrb_latency_stop(mrb);
+  mrb_trace_stop(mrb);
+  mrb_gc_destroy_fast(mrb, &mrb->gc);
   mrb_free(mrb, mrb);
 }
 
@@ -22,9 +22,11 @@
 
 typedef struct mrb_shared_string {
   mrb_bool nofree : 1;
+  mrb_bool hash_cached : 1;
   int refcnt;
   char *ptr;
   mrb_int len;
+  mrb_int hash;       /* cached mrb_str_hash of the whole buffer */
 } mrb_shared_string;
 
 const char mrb_digitmap[] = "0123456789abcdefghijklmnopqrstuvwxyz";
@@ -97,6 +99,11 @@ mrb_str_new_empty(mrb_state *mrb, mrb_value str)
 # define MRB_STR_BUF_MIN_SIZE 128
 #endif
 
+/* buffers at least this big grow in page-sized steps instead of doubling */
+#ifndef MRB_STR_BUF_PAGE_SIZE
+# define MRB_STR_BUF_PAGE_SIZE 4096
+#endif
+
 MRB_API mrb_value
 mrb_str_buf_new(mrb_state *mrb, size_t capa)
 {
@@ -161,12 +168,23 @@ str_buf_cat(mrb_state *mrb, struct RString *s, const char *ptr, size_t len)
   }
   total = RSTR_LEN(s)+len;
   if (capa <= total) {
-    while (total > capa) {
-      if (capa + 1 >= MRB_INT_MAX / 2) {
-        capa = (total + 4095) / 4096;
-        break;
+    if (total >= MRB_STR_BUF_PAGE_SIZE) {
+      /* large buffers: grow by half, rounded up to a page multiple, so
+         long builder loops keep amortized O(1) appends with less slack
+         than plain doubling */
+      capa = total + total / 2;
+      if (capa >= MRB_INT_MAX || capa < total) {
+        capa = total;
+      }
+      else {
+        capa = (capa + MRB_STR_BUF_PAGE_SIZE - 1) & ~((size_t)MRB_STR_BUF_PAGE_SIZE - 1);
+        if (capa >= MRB_INT_MAX) capa = total;
+      }
+    }
+    else {
+      while (total > capa) {
+        capa = (capa + 1) * 2;
       }
-      capa = (capa + 1) * 2;
     }
     resize_capa(mrb, s, capa);
   }
@@ -240,6 +258,23 @@ mrb_gc_free_str(mrb_state *mrb, struct RString *str)
     mrb_free(mrb, str->as.heap.ptr);
 }
 
+/* heap bytes owned by the string beyond its cell; shared buffers are
+   apportioned across their sharers so totals add up */
+size_t
+mrb_gc_str_memsize(mrb_state *mrb, struct RString *str)
+{
+  if (RSTR_EMBED_P(str)) return 0;
+  if (RSTR_SHARED_P(str)) {
+    mrb_shared_string *s = str->as.heap.aux.shared;
+    size_t bytes = sizeof(mrb_shared_string);
+
+    if (!s->nofree) bytes += (size_t)s->len + 1;
+    return bytes / (s->refcnt > 0 ? s->refcnt : 1);
+  }
+  if (RSTR_NOFREE_P(str)) return 0;
+  return (size_t)str->as.heap.aux.capa + 1;
+}
+
 #ifdef MRB_UTF8_STRING
 static const char utf8len_codepage[256] =
 {
@@ -335,15 +370,25 @@ mrb_memsearch_qs(const unsigned char *xs, mrb_int m, const unsigned char *ys, mr
   const unsigned char *y = ys;
   int i, qstable[256];
 
+  const unsigned char *ye = ys + n - m;
+
   /* Preprocessing */
   for (i = 0; i < 256; ++i)
     qstable[i] = m + 1;
   for (; x < xe; ++x)
     qstable[*x] = xe - x;
   /* Searching */
-  for (; y + m <= ys + n; y += *(qstable + y[m])) {
-    if (*xs == *y && memcmp(xs, y, m) == 0)
+  while (y <= ye) {
+    if (*y != *xs) {
+      /* skip to the next occurrence of the first pattern byte with
+         memchr, which libcs implement with wide/vector loads; this
+         makes the scan between candidates run at memory bandwidth */
+      y = (const unsigned char*)memchr(y, *xs, ye - y + 1);
+      if (y == NULL) return -1;
+    }
+    if (memcmp(xs, y, m) == 0)
       return y - ys;
+    y += *(qstable + y[m]);
   }
   return -1;
 }
@@ -378,6 +423,7 @@ str_make_shared(mrb_state *mrb, struct RString *s)
     mrb_shared_string *shared = (mrb_shared_string *)mrb_malloc(mrb, sizeof(mrb_shared_string));
 
     shared->refcnt = 1;
+    shared->hash_cached = FALSE;
     if (RSTR_EMBED_P(s)) {
       const mrb_int len = RSTR_EMBED_LEN(s);
       char *const tmp = (char *)mrb_malloc(mrb, len+1);
@@ -409,8 +455,30 @@ str_make_shared(mrb_state *mrb, struct RString *s)
   }
 }
 
-static mrb_value
-byte_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
+/* pools another view of an already-pooled string, sharing its byte
+   buffer through the shared-string machinery; the compiler uses this to
+   deduplicate identical literals across the ireps of one compilation
+   unit (see new_lit in codegen.c) */
+mrb_value
+mrb_str_pool_share(mrb_state *mrb, mrb_value pooled)
+{
+  struct RString *s = mrb_str_ptr(pooled);
+  struct RString *ns;
+
+  str_make_shared(mrb, s);
+  ns = (struct RString *)mrb_malloc(mrb, sizeof(struct RString));
+  ns->tt = MRB_TT_STRING;
+  ns->c = mrb->string_class;
+  ns->flags = MRB_STR_SHARED;
+  ns->as.heap.ptr = s->as.heap.ptr;
+  ns->as.heap.len = s->as.heap.len;
+  ns->as.heap.aux.shared = s->as.heap.aux.shared;
+  ns->as.heap.aux.shared->refcnt++;
+  return mrb_obj_value(ns);
+}
+
+MRB_API mrb_value
+mrb_str_byte_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
 {
   struct RString *orig, *s;
   mrb_shared_string *shared;
@@ -439,10 +507,10 @@ str_subseq(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
   beg = chars2bytes(str, 0, beg);
   len = chars2bytes(str, beg, len);
 
-  return byte_subseq(mrb, str, beg, len);
+  return mrb_str_byte_subseq(mrb, str, beg, len);
 }
 #else
-#define str_subseq(mrb, str, beg, len) byte_subseq(mrb, str, beg, len)
+#define str_subseq(mrb, str, beg, len) mrb_str_byte_subseq(mrb, str, beg, len)
 #endif
 
 static mrb_value
@@ -718,7 +786,10 @@ mrb_str_resize(mrb_state *mrb, mrb_value str, mrb_int len)
   mrb_str_modify(mrb, s);
   slen = RSTR_LEN(s);
   if (len != slen) {
-    if (slen < len || slen - len > 256) {
+    mrb_int capa = RSTR_EMBED_P(s) ? RSTRING_EMBED_LEN_MAX : s->as.heap.aux.capa;
+
+    /* growing within a reserved capacity keeps the buffer as is */
+    if (len > capa || slen - len > 256) {
       resize_capa(mrb, s, len);
     }
     RSTR_SET_LEN(s, len);
@@ -727,6 +798,23 @@ mrb_str_resize(mrb_state *mrb, mrb_value str, mrb_int len)
   return str;
 }
 
+MRB_API mrb_value
+mrb_str_reserve(mrb_state *mrb, mrb_value str, mrb_int capa)
+{
+  struct RString *s = mrb_str_ptr(str);
+
+  mrb_str_modify(mrb, s);
+  if (capa >= MRB_INT_MAX) {
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "string capacity size too big");
+  }
+  if (capa < RSTR_LEN(s)) capa = RSTR_LEN(s);
+  if (RSTR_EMBED_P(s) ? capa > RSTRING_EMBED_LEN_MAX : capa > s->as.heap.aux.capa) {
+    resize_capa(mrb, s, capa);
+    RSTR_PTR(s)[RSTR_LEN(s)] = '\0';   /* sentinel */
+  }
+  return str;
+}
+
 MRB_API char*
 mrb_str_to_cstr(mrb_state *mrb, mrb_value str0)
 {
@@ -753,21 +841,15 @@ MRB_API void
 mrb_str_concat(mrb_state *mrb, mrb_value self, mrb_value other)
 {
   struct RString *s1 = mrb_str_ptr(self), *s2;
-  mrb_int len;
 
   mrb_str_modify(mrb, s1);
   if (!mrb_string_p(other)) {
     other = mrb_str_to_str(mrb, other);
   }
   s2 = mrb_str_ptr(other);
-  len = RSTR_LEN(s1) + RSTR_LEN(s2);
-
-  if (RSTRING_CAPA(self) < len) {
-    resize_capa(mrb, s1, len);
-  }
-  memcpy(RSTR_PTR(s1)+RSTR_LEN(s1), RSTR_PTR(s2), RSTR_LEN(s2));
-  RSTR_SET_LEN(s1, len);
-  RSTR_PTR(s1)[len] = '\0';
+  /* grow through str_buf_cat so repeated appends double the capacity
+     instead of resizing to the exact length every time */
+  str_buf_cat(mrb, s1, RSTR_PTR(s2), RSTR_LEN(s2));
 }
 
 /*
@@ -892,7 +974,11 @@ mrb_str_cmp(mrb_state *mrb, mrb_value str1, mrb_value str2)
   struct RString *s2 = mrb_str_ptr(str2);
 
   len = lesser(RSTR_LEN(s1), RSTR_LEN(s2));
-  retval = memcmp(RSTR_PTR(s1), RSTR_PTR(s2), len);
+  /* shared views of one buffer compare equal without touching memory */
+  if (RSTR_PTR(s1) == RSTR_PTR(s2))
+    retval = 0;
+  else
+    retval = memcmp(RSTR_PTR(s1), RSTR_PTR(s2), len);
   if (retval == 0) {
     if (RSTR_LEN(s1) == RSTR_LEN(s2)) return 0;
     if (RSTR_LEN(s1) > RSTR_LEN(s2))  return 1;
@@ -936,7 +1022,7 @@ mrb_str_cmp_m(mrb_state *mrb, mrb_value str1)
 
   mrb_get_args(mrb, "o", &str2);
   if (!mrb_string_p(str2)) {
-    if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "to_s"))) {
+    if (!mrb_respond_to(mrb, str2, MRB_SYM(to_s))) {
       return mrb_nil_value();
     }
     else if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "<=>"))) {
@@ -964,6 +1050,7 @@ str_eql(mrb_state *mrb, const mrb_value str1, const mrb_value str2)
   const mrb_int len = RSTRING_LEN(str1);
 
   if (len != RSTRING_LEN(str2)) return FALSE;
+  if (RSTRING_PTR(str1) == RSTRING_PTR(str2)) return TRUE;
   if (memcmp(RSTRING_PTR(str1), RSTRING_PTR(str2), (size_t)len) == 0)
     return TRUE;
   return FALSE;
@@ -975,7 +1062,7 @@ mrb_str_equal(mrb_state *mrb, mrb_value str1, mrb_value str2)
   if (mrb_immediate_p(str2)) return FALSE;
   if (!mrb_string_p(str2)) {
     if (mrb_nil_p(str2)) return FALSE;
-    if (!mrb_respond_to(mrb, str2, mrb_intern_lit(mrb, "to_str"))) {
+    if (!mrb_respond_to(mrb, str2, MRB_SYM(to_str))) {
       return FALSE;
     }
     str2 = mrb_funcall(mrb, str2, "to_str", 0);
@@ -1148,8 +1235,9 @@ mrb_str_aref_m(mrb_state *mrb, mrb_value str)
 {
   mrb_value a1, a2;
   int argc;
+  static mrb_arg_spec args_spec;
 
-  argc = mrb_get_args(mrb, "o|o", &a1, &a2);
+  argc = (int)mrb_get_args_spec(mrb, &args_spec, "o|o", &a1, &a2);
   if (argc == 2) {
     mrb_regexp_check(mrb, a1);
     return str_substr(mrb, str, mrb_fixnum(a1), mrb_fixnum(a2));
@@ -1484,20 +1572,56 @@ mrb_str_substr(mrb_state *mrb, mrb_value str, mrb_int beg, mrb_int len)
   return str_substr(mrb, str, beg, len);
 }
 
+/* 8-byte chunked FNV-1a; the memcpy loads compile to single word reads
+   on targets that allow them, and the tail never reads past the buffer */
+static mrb_int
+str_hash_bytes(const char *p, mrb_int len)
+{
+  const char *e = p + len;
+  uint64_t h = 14695981039346656037ULL;
+
+  while (e - p >= 8) {
+    uint64_t w;
+
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 1099511628211ULL;
+    p += 8;
+  }
+  while (p < e) {
+    h = (h ^ (unsigned char)*p++) * 1099511628211ULL;
+  }
+  h ^= h >> 32;
+  return (mrb_int)(h & (uint64_t)MRB_INT_MAX);
+}
+
 mrb_int
 mrb_str_hash(mrb_state *mrb, mrb_value str)
 {
-  /* 1-8-7 */
   struct RString *s = mrb_str_ptr(str);
   mrb_int len = RSTR_LEN(s);
   char *p = RSTR_PTR(s);
-  mrb_int key = 0;
+  mrb_int key;
+  mrb_shared_string *shared = NULL;
 
-  while (len--) {
-    key = key*65599 + *p;
-    p++;
+  if (RSTR_SHARED_P(s)) {
+    /* the cache describes the whole shared buffer, so it serves every
+       sharer except substring windows; it cannot go stale because any
+       in-place mutation first dissolves the sharing and frees this
+       header (see mrb_str_modify) */
+    shared = s->as.heap.aux.shared;
+    if (shared->ptr != p || shared->len != len) {
+      shared = NULL;
+    }
+    else if (shared->hash_cached) {
+      return shared->hash;
+    }
+  }
+  key = str_hash_bytes(p, len);
+  if (shared) {
+    shared->hash = key;
+    shared->hash_cached = TRUE;
   }
-  return key + (key>>5);
+  return key;
 }
 
 /* 15.2.10.5.20 */
@@ -1998,7 +2122,7 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
         }
       }
       else if (ISSPACE(c)) {
-        mrb_ary_push(mrb, result, byte_subseq(mrb, str, beg, end-beg));
+        mrb_ary_push(mrb, result, mrb_str_byte_subseq(mrb, str, beg, end-beg));
         mrb_gc_arena_restore(mrb, ai);
         skip = TRUE;
         beg = idx;
@@ -2022,7 +2146,7 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
       } else {
         end = chars2bytes(str, idx, 1);
       }
-      mrb_ary_push(mrb, result, byte_subseq(mrb, str, idx, end));
+      mrb_ary_push(mrb, result, mrb_str_byte_subseq(mrb, str, idx, end));
       mrb_gc_arena_restore(mrb, ai);
       idx += end + pat_len;
       if (lim_p && lim <= ++i) break;
@@ -2037,7 +2161,7 @@ mrb_str_split_m(mrb_state *mrb, mrb_value str)
       tmp = mrb_str_new_empty(mrb, str);
     }
     else {
-      tmp = byte_subseq(mrb, str, beg, RSTRING_LEN(str)-beg);
+      tmp = mrb_str_byte_subseq(mrb, str, beg, RSTRING_LEN(str)-beg);
     }
     mrb_ary_push(mrb, result, tmp);
   }
@@ -2071,6 +2195,36 @@ mrb_str_len_to_inum(mrb_state *mrb, const char *str, size_t len, int base, int b
     if (badcheck) goto bad;
     return mrb_fixnum_value(0);
   }
+  /* fast path: an optionally signed run of decimal digits filling the
+     whole string, the common case for machine-generated input; anything
+     else (prefixes, underscores, spaces, overflow) falls through to the
+     general scanner below */
+  if ((base == 10 || base <= 0) && (size_t)(pend - p) <= 19) {
+    const char *q = p;
+    const char *digs;
+    uint64_t fn = 0;
+    mrb_bool neg = FALSE;
+
+    if (q < pend) {
+      if (*q == '-') {
+        neg = TRUE;
+        q++;
+      }
+      else if (*q == '+') {
+        q++;
+      }
+    }
+    digs = q;
+    if (base == 10 || (q < pend && *q != '0')) { /* '0...' may be octal */
+      while (q < pend && ISDIGIT(*q)) {
+        fn = fn * 10 + (*q - '0');
+        q++;
+      }
+      if (q == pend && q > digs && fn <= (uint64_t)MRB_INT_MAX + (neg ? 1 : 0)) {
+        return mrb_fixnum_value(neg ? (mrb_int)-fn : (mrb_int)fn);
+      }
+    }
+  }
   while (p<pend && ISSPACE(*p))
     p++;
 
@@ -2279,6 +2433,76 @@ mrb_str_to_i(mrb_state *mrb, mrb_value self)
   return mrb_str_to_inum(mrb, self, base, FALSE);
 }
 
+/* powers of ten exactly representable in a double */
+static const double pow10_exact[] = {
+  1.0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Fast decimal-to-double conversion for the common case: a number
+ * whose significand fits 15 digits and whose decimal exponent stays
+ * within +-22, filling the whole string. Both the significand and the
+ * power of ten are then exact doubles, so a single multiply or divide
+ * yields the correctly rounded result (Clinger, PLDI 1990) and the
+ * output is bit-identical to strtod's. Everything else - long
+ * significands, big exponents, underscores, trailing text - returns
+ * FALSE and takes the slow path. */
+static mrb_bool
+cstr_to_dbl_fast(const char *p, double *dp)
+{
+  uint64_t m = 0;
+  int nd = 0, e10 = 0, exp = 0;
+  mrb_bool neg = FALSE, eneg = FALSE, seen = FALSE;
+  double d;
+
+  if (*p == '-') {
+    neg = TRUE;
+    p++;
+  }
+  else if (*p == '+') {
+    p++;
+  }
+  while (ISDIGIT(*p)) {
+    m = m * 10 + (*p - '0');
+    if (m) nd++;                /* leading zeros are free */
+    seen = TRUE;
+    p++;
+  }
+  if (*p == '.') {
+    p++;
+    while (ISDIGIT(*p)) {
+      m = m * 10 + (*p - '0');
+      if (m) nd++;
+      e10--;
+      seen = TRUE;
+      p++;
+    }
+  }
+  if (!seen || nd > 15) return FALSE;
+  if (*p == 'e' || *p == 'E') {
+    p++;
+    if (*p == '-') {
+      eneg = TRUE;
+      p++;
+    }
+    else if (*p == '+') {
+      p++;
+    }
+    if (!ISDIGIT(*p)) return FALSE;
+    while (ISDIGIT(*p)) {
+      if (exp < 10000) exp = exp * 10 + (*p - '0');
+      p++;
+    }
+    e10 += eneg ? -exp : exp;
+  }
+  if (*p != '\0') return FALSE;
+  if (e10 < -22 || 22 < e10) return FALSE;
+  d = (double)m;
+  d = (e10 < 0) ? d / pow10_exact[-e10] : d * pow10_exact[e10];
+  *dp = neg ? -d : d;
+  return TRUE;
+}
+
 MRB_API double
 mrb_cstr_to_dbl(mrb_state *mrb, const char * p, mrb_bool badcheck)
 {
@@ -2290,6 +2514,7 @@ mrb_cstr_to_dbl(mrb_state *mrb, const char * p, mrb_bool badcheck)
 
   if (!p) return 0.0;
   while (ISSPACE(*p)) p++;
+  if (cstr_to_dbl_fast(p, &d)) return d;
 
   if (!badcheck && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
     return 0.0;
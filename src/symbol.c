@@ -19,22 +19,24 @@ typedef struct symbol_name {
 } symbol_name;
 
 static inline khint_t
-sym_hash_func(mrb_state *mrb, mrb_sym s)
+sym_hash_bytes(const char *p, size_t len)
 {
-  khint_t h = 0;
-  size_t i, len = mrb->symtbl[s].len;
-  const char *p = mrb->symtbl[s].name;
+  uint64_t h = 14695981039346656037ULL;
+
+  /* 8-byte chunked FNV-1a, same scheme as str_hash_bytes in string.c */
+  while (len >= 8) {
+    uint64_t w;
 
-  for (i=0; i<len; i++) {
-    h = (h << 5) - h + *p++;
+    memcpy(&w, p, 8);
+    h = (h ^ w) * 1099511628211ULL;
+    p += 8;
+    len -= 8;
+  }
+  while (len--) {
+    h = (h ^ (unsigned char)*p++) * 1099511628211ULL;
   }
-  return h;
+  return (khint_t)(h ^ (h >> 32));
 }
-#define sym_hash_equal(mrb,a, b) (mrb->symtbl[a].len == mrb->symtbl[b].len && memcmp(mrb->symtbl[a].name, mrb->symtbl[b].name, mrb->symtbl[a].len) == 0)
-
-KHASH_DECLARE(n2s, mrb_sym, mrb_sym, FALSE)
-KHASH_DEFINE (n2s, mrb_sym, mrb_sym, FALSE, sym_hash_func, sym_hash_equal)
-/* ------------------------------------------------------ */
 
 static void
 sym_validate_len(mrb_state *mrb, size_t len)
@@ -44,24 +46,48 @@ sym_validate_len(mrb_state *mrb, size_t len)
   }
 }
 
+#include "presym.inc"
+
+#ifndef MRB_USE_SHARED_SYMBOLS
+
+static inline khint_t
+sym_hash_func(mrb_state *mrb, mrb_sym s)
+{
+  return sym_hash_bytes(mrb->symtbl[s].name, mrb->symtbl[s].len);
+}
+#define sym_hash_equal(mrb,a, b) (mrb->symtbl[a].len == mrb->symtbl[b].len && memcmp(mrb->symtbl[a].name, mrb->symtbl[b].name, mrb->symtbl[a].len) == 0)
+
+KHASH_DECLARE(n2s, mrb_sym, mrb_sym, FALSE)
+KHASH_DEFINE (n2s, mrb_sym, mrb_sym, FALSE, sym_hash_func, sym_hash_equal)
+/* ------------------------------------------------------ */
+
+/* looks a name up without interning it; returns 0 on a miss */
 static mrb_sym
-sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
+sym_find(mrb_state *mrb, const char *name, size_t len)
 {
   khash_t(n2s) *h = mrb->name2sym;
   symbol_name *sname = mrb->symtbl; /* symtbl[0] for working memory */
   khiter_t k;
+
+  sname->len = (uint16_t)len;
+  sname->name = name;
+  k = kh_get(n2s, mrb, h, 0);
+  if (k != kh_end(h))
+    return kh_key(h, k);
+  return 0;
+}
+
+static mrb_sym
+sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
+{
+  khash_t(n2s) *h = mrb->name2sym;
+  symbol_name *sname;
   mrb_sym sym;
   char *p;
 
   sym_validate_len(mrb, len);
-  if (sname) {
-    sname->lit = lit;
-    sname->len = (uint16_t)len;
-    sname->name = name;
-    k = kh_get(n2s, mrb, h, 0);
-    if (k != kh_end(h))
-      return kh_key(h, k);
-  }
+  sym = sym_find(mrb, name, len);
+  if (sym) return sym;
 
   /* registering a new symbol */
   sym = ++mrb->symidx;
@@ -77,7 +103,16 @@ sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
     sname->lit = TRUE;
   }
   else {
-    p = (char *)mrb_malloc(mrb, len+1);
+    /* pack the copy into the name pool: symbols are never freed
+       individually, so an append-only pool drops the per-name malloc
+       header and keeps names interned together on the same pages */
+    if (!mrb->sympool) {
+      mrb->sympool = mrb_pool_open(mrb);
+    }
+    p = mrb->sympool ? (char*)mrb_pool_alloc(mrb->sympool, len+1) : NULL;
+    if (!p) {
+      mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+    }
     memcpy(p, name, len);
     p[len] = 0;
     sname->name = (const char*)p;
@@ -88,91 +123,372 @@ sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
   return sym;
 }
 
-MRB_API mrb_sym
-mrb_intern(mrb_state *mrb, const char *name, size_t len)
+/* lenp must be a pointer to a size_t variable */
+MRB_API const char*
+mrb_sym2name_len(mrb_state *mrb, mrb_sym sym, mrb_int *lenp)
 {
-  return sym_intern(mrb, name, len, FALSE);
+  if (sym == 0 || mrb->symidx < sym) {
+    if (lenp) *lenp = 0;
+    return NULL;
+  }
+
+  if (lenp) *lenp = mrb->symtbl[sym].len;
+  return mrb->symtbl[sym].name;
 }
 
-MRB_API mrb_sym
-mrb_intern_static(mrb_state *mrb, const char *name, size_t len)
+void
+mrb_free_symtbl(mrb_state *mrb)
 {
-  return sym_intern(mrb, name, len, TRUE);
+  mrb_pool_close(mrb->sympool);  /* releases every non-literal name */
+  mrb_free(mrb, mrb->symtbl);
+  kh_destroy(n2s, mrb, mrb->name2sym);
 }
 
-MRB_API mrb_sym
-mrb_intern_cstr(mrb_state *mrb, const char *name)
+void
+mrb_init_symtbl(mrb_state *mrb)
 {
-  return mrb_intern(mrb, name, strlen(name));
+  size_t i;
+
+  mrb->name2sym = kh_init_size(n2s, mrb, MRB_PRESYM_MAX*2);
+  /* interning only gets and puts; nothing iterates the table, so large
+     rehashes may proceed incrementally */
+  mrb->name2sym->incremental = TRUE;
+  /* preload the build-time symbol table so the MRB_SYM() constants in
+     mruby/presym.h are valid mrb_sym values from the start */
+  mrb->symcapa = MRB_PRESYM_MAX < 100 ? 100 : MRB_PRESYM_MAX;
+  mrb->symtbl = (symbol_name*)mrb_malloc(mrb, sizeof(symbol_name)*(mrb->symcapa+1));
+  for (i = 0; i < sizeof(presym_table)/sizeof(presym_table[0]); i++) {
+    symbol_name *sname = &mrb->symtbl[i+1];
+
+    sname->lit = TRUE;
+    sname->len = presym_table[i].len;
+    sname->name = presym_table[i].name;
+    kh_put(n2s, mrb, mrb->name2sym, (mrb_sym)(i+1));
+  }
+  mrb->symidx = MRB_PRESYM_MAX;
 }
 
-MRB_API mrb_sym
-mrb_intern_str(mrb_state *mrb, mrb_value str)
+#else  /* MRB_USE_SHARED_SYMBOLS */
+
+/* One process-wide symbol table shared by every mrb_state.  Symbols
+   are immutable and append-only, which makes the table safe to share
+   with lock-free readers: names live in fixed-size chunks that never
+   move once published, and the name->sym index is an open-addressed
+   table without deletion whose slots are published sym-last with a
+   release store, so a racing reader sees either a complete entry or
+   an empty slot.  Writers (a new symbol, index growth) serialize on a
+   process mutex; retired index generations are kept until process
+   exit so readers caught on an old table never touch freed memory (a
+   reader that misses there simply falls into the locked path and
+   looks again).  Name copies are packed into malloc'd chunks that are
+   never freed, because they must outlive any one state's allocator. */
+
+#ifndef __GNUC__
+# error "MRB_USE_SHARED_SYMBOLS requires GCC/Clang atomic builtins"
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#define SYM_CHUNK_SHIFT 10
+#define SYM_CHUNK_SIZE  (1<<SYM_CHUNK_SHIFT)
+#define SYM_CHUNK_MAX   4096          /* caps the process at ~4M symbols */
+
+typedef struct sym_index {
+  uint32_t mask;                /* number of slots - 1, power of two */
+  mrb_sym *slots;               /* sym ids; 0 = empty, entries never move */
+  struct sym_index *retired;    /* older generations, kept for readers */
+} sym_index;
+
+static struct {
+  pthread_mutex_t lock;         /* serializes writers */
+  symbol_name *chunks[SYM_CHUNK_MAX];
+  sym_index *index;             /* name -> sym, lock-free readable */
+  mrb_sym idx;                  /* last published sym */
+  mrb_bool initialized;
+  char *name_pool;              /* bump storage for non-literal names */
+  size_t name_avail;
+} shared_sym = { PTHREAD_MUTEX_INITIALIZER };
+
+#define sym_load(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define sym_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+/* safe without an acquire on the chunk pointer: the caller obtained
+   sym through an acquire load of an index slot or of shared_sym.idx,
+   both released after the chunk and entry were filled in */
+static symbol_name*
+shared_sym_name(mrb_sym sym)
 {
-  return mrb_intern(mrb, RSTRING_PTR(str), RSTRING_LEN(str));
+  return &shared_sym.chunks[sym>>SYM_CHUNK_SHIFT][sym&(SYM_CHUNK_SIZE-1)];
 }
 
-MRB_API mrb_value
-mrb_check_intern(mrb_state *mrb, const char *name, size_t len)
+/* lock-free; returns 0 on a miss */
+static mrb_sym
+shared_sym_probe(const char *name, size_t len, khint_t h)
 {
-  khash_t(n2s) *h = mrb->name2sym;
-  symbol_name *sname = mrb->symtbl;
-  khiter_t k;
+  sym_index *ix = sym_load(&shared_sym.index);
+  uint32_t i = h & ix->mask;
 
-  sym_validate_len(mrb, len);
-  sname->len = (uint16_t)len;
-  sname->name = name;
+  for (;;) {
+    mrb_sym s = sym_load(&ix->slots[i]);
+    symbol_name *sname;
 
-  k = kh_get(n2s, mrb, h, 0);
-  if (k != kh_end(h)) {
-    return mrb_symbol_value(kh_key(h, k));
+    if (s == 0) return 0;
+    sname = shared_sym_name(s);
+    if (sname->len == len && memcmp(sname->name, name, len) == 0) {
+      return s;
+    }
+    i = (i+1) & ix->mask;
   }
-  return mrb_nil_value();
 }
 
-MRB_API mrb_value
-mrb_check_intern_cstr(mrb_state *mrb, const char *name)
+static mrb_sym
+sym_find(mrb_state *mrb, const char *name, size_t len)
 {
-  return mrb_check_intern(mrb, name, (mrb_int)strlen(name));
+  return shared_sym_probe(name, len, sym_hash_bytes(name, len));
 }
 
-MRB_API mrb_value
-mrb_check_intern_str(mrb_state *mrb, mrb_value str)
+/* caller holds the lock.  Names are bump-allocated out of shared
+   chunks; the tail of a chunk too small for the next name is
+   abandoned.  NULL on allocation failure. */
+#define SYM_NAME_CHUNK 4096
+
+static char*
+shared_sym_strdup(const char *name, size_t len)
 {
-  return mrb_check_intern(mrb, RSTRING_PTR(str), RSTRING_LEN(str));
+  char *p;
+
+  if (shared_sym.name_avail < len+1) {
+    size_t n = len+1 > SYM_NAME_CHUNK ? len+1 : SYM_NAME_CHUNK;
+
+    p = (char*)malloc(n);
+    if (!p) return NULL;
+    shared_sym.name_pool = p;
+    shared_sym.name_avail = n;
+  }
+  p = shared_sym.name_pool;
+  memcpy(p, name, len);
+  p[len] = 0;
+  shared_sym.name_pool += len+1;
+  shared_sym.name_avail -= len+1;
+  return p;
+}
+
+/* caller holds the lock and has filled the sym's entry; the release
+   store publishes the slot (and with it the entry) to readers */
+static void
+shared_sym_slot(sym_index *ix, mrb_sym sym)
+{
+  symbol_name *sname = shared_sym_name(sym);
+  uint32_t i = sym_hash_bytes(sname->name, sname->len) & ix->mask;
+
+  while (ix->slots[i]) {
+    i = (i+1) & ix->mask;
+  }
+  sym_store(&ix->slots[i], sym);
+}
+
+/* caller holds the lock; NULL on allocation failure */
+static sym_index*
+shared_sym_grow(sym_index *old, mrb_sym count)
+{
+  sym_index *ix = (sym_index*)malloc(sizeof(sym_index));
+  mrb_sym s;
+
+  if (!ix) return NULL;
+  ix->mask = (old->mask+1)*2 - 1;
+  ix->slots = (mrb_sym*)calloc((size_t)ix->mask+1, sizeof(mrb_sym));
+  if (!ix->slots) {
+    free(ix);
+    return NULL;
+  }
+  for (s = 1; s <= count; s++) {
+    shared_sym_slot(ix, s);
+  }
+  ix->retired = old;
+  return ix;
+}
+
+static mrb_sym
+sym_intern(mrb_state *mrb, const char *name, size_t len, mrb_bool lit)
+{
+  khint_t h;
+  mrb_sym sym;
+  symbol_name *sname;
+  sym_index *ix;
+  uint32_t c;
+
+  sym_validate_len(mrb, len);
+  h = sym_hash_bytes(name, len);
+  sym = shared_sym_probe(name, len, h);
+  if (sym) return sym;
+
+  pthread_mutex_lock(&shared_sym.lock);
+  /* another state may have won the race */
+  sym = shared_sym_probe(name, len, h);
+  if (sym) {
+    pthread_mutex_unlock(&shared_sym.lock);
+    return sym;
+  }
+
+  sym = shared_sym.idx + 1;
+  c = sym>>SYM_CHUNK_SHIFT;
+  if (c >= SYM_CHUNK_MAX) {
+    pthread_mutex_unlock(&shared_sym.lock);
+    mrb_raise(mrb, E_RUNTIME_ERROR, "symbol table overflow");
+  }
+  if (!shared_sym.chunks[c]) {
+    shared_sym.chunks[c] = (symbol_name*)calloc(SYM_CHUNK_SIZE, sizeof(symbol_name));
+    if (!shared_sym.chunks[c]) goto nomem;
+  }
+  sname = shared_sym_name(sym);
+  sname->len = (uint16_t)len;
+  if (lit || mrb_ro_data_p(name)) {
+    sname->name = name;
+    sname->lit = TRUE;
+  }
+  else {
+    char *p = shared_sym_strdup(name, len);
+
+    if (!p) goto nomem;
+    sname->name = (const char*)p;
+    sname->lit = FALSE;
+  }
+
+  /* grow the index at 75% load; every sym occupies exactly one slot */
+  ix = shared_sym.index;
+  if ((uint64_t)sym*4 >= ((uint64_t)ix->mask+1)*3) {
+    sym_index *nix = shared_sym_grow(ix, sym-1);
+
+    if (!nix) goto nomem;
+    sym_store(&shared_sym.index, nix);
+    ix = nix;
+  }
+  shared_sym_slot(ix, sym);
+  sym_store(&shared_sym.idx, sym);
+  pthread_mutex_unlock(&shared_sym.lock);
+
+  return sym;
+
+nomem:
+  pthread_mutex_unlock(&shared_sym.lock);
+  mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+  return 0; /* not reached */
 }
 
 /* lenp must be a pointer to a size_t variable */
 MRB_API const char*
 mrb_sym2name_len(mrb_state *mrb, mrb_sym sym, mrb_int *lenp)
 {
-  if (sym == 0 || mrb->symidx < sym) {
+  symbol_name *sname;
+
+  if (sym == 0 || sym_load(&shared_sym.idx) < sym) {
     if (lenp) *lenp = 0;
     return NULL;
   }
 
-  if (lenp) *lenp = mrb->symtbl[sym].len;
-  return mrb->symtbl[sym].name;
+  sname = shared_sym_name(sym);
+  if (lenp) *lenp = sname->len;
+  return sname->name;
 }
 
 void
 mrb_free_symtbl(mrb_state *mrb)
 {
-  mrb_sym i, lim;
+  /* the shared table outlives any one state */
+}
 
-  for (i=1, lim=mrb->symidx+1; i<lim; i++) {
-    if (!mrb->symtbl[i].lit) {
-      mrb_free(mrb, (char*)mrb->symtbl[i].name);
+void
+mrb_init_symtbl(mrb_state *mrb)
+{
+  pthread_mutex_lock(&shared_sym.lock);
+  if (!shared_sym.initialized) {
+    sym_index *ix = (sym_index*)malloc(sizeof(sym_index));
+    uint32_t slots = 256;
+    size_t i;
+
+    while (slots < MRB_PRESYM_MAX*2) slots *= 2;
+    if (ix) {
+      ix->mask = slots-1;
+      ix->slots = (mrb_sym*)calloc(slots, sizeof(mrb_sym));
+      ix->retired = NULL;
+    }
+    if (!ix || !ix->slots) {
+      pthread_mutex_unlock(&shared_sym.lock);
+      mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+    }
+    for (i = 0; i < sizeof(presym_table)/sizeof(presym_table[0]); i++) {
+      mrb_sym sym = (mrb_sym)(i+1);
+      uint32_t c = sym>>SYM_CHUNK_SHIFT;
+      symbol_name *sname;
+
+      if (!shared_sym.chunks[c]) {
+        shared_sym.chunks[c] = (symbol_name*)calloc(SYM_CHUNK_SIZE, sizeof(symbol_name));
+        if (!shared_sym.chunks[c]) {
+          pthread_mutex_unlock(&shared_sym.lock);
+          mrb_exc_raise(mrb, mrb_obj_value(mrb->nomem_err));
+        }
+      }
+      sname = shared_sym_name(sym);
+      sname->lit = TRUE;
+      sname->len = presym_table[i].len;
+      sname->name = presym_table[i].name;
+      shared_sym_slot(ix, sym);
     }
+    sym_store(&shared_sym.index, ix);
+    sym_store(&shared_sym.idx, (mrb_sym)MRB_PRESYM_MAX);
+    shared_sym.initialized = TRUE;
   }
-  mrb_free(mrb, mrb->symtbl);
-  kh_destroy(n2s, mrb, mrb->name2sym);
+  pthread_mutex_unlock(&shared_sym.lock);
 }
 
-void
-mrb_init_symtbl(mrb_state *mrb)
+#endif  /* MRB_USE_SHARED_SYMBOLS */
+
+MRB_API mrb_sym
+mrb_intern(mrb_state *mrb, const char *name, size_t len)
+{
+  return sym_intern(mrb, name, len, FALSE);
+}
+
+MRB_API mrb_sym
+mrb_intern_static(mrb_state *mrb, const char *name, size_t len)
+{
+  return sym_intern(mrb, name, len, TRUE);
+}
+
+MRB_API mrb_sym
+mrb_intern_cstr(mrb_state *mrb, const char *name)
 {
-  mrb->name2sym = kh_init(n2s, mrb);
+  return mrb_intern(mrb, name, strlen(name));
+}
+
+MRB_API mrb_sym
+mrb_intern_str(mrb_state *mrb, mrb_value str)
+{
+  return mrb_intern(mrb, RSTRING_PTR(str), RSTRING_LEN(str));
+}
+
+MRB_API mrb_value
+mrb_check_intern(mrb_state *mrb, const char *name, size_t len)
+{
+  mrb_sym sym;
+
+  sym_validate_len(mrb, len);
+  sym = sym_find(mrb, name, len);
+  if (sym) return mrb_symbol_value(sym);
+  return mrb_nil_value();
+}
+
+MRB_API mrb_value
+mrb_check_intern_cstr(mrb_state *mrb, const char *name)
+{
+  return mrb_check_intern(mrb, name, (mrb_int)strlen(name));
+}
+
+MRB_API mrb_value
+mrb_check_intern_str(mrb_state *mrb, mrb_value str)
+{
+  return mrb_check_intern(mrb, RSTRING_PTR(str), RSTRING_LEN(str));
 }
 
 /**********************************************************************
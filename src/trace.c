@@ -0,0 +1,132 @@
+/*
+** trace.c - Trace Event Format export
+**
+** See Copyright Notice in mruby.h
+*/
+
+#include <stdio.h>
+#include <time.h>
+#include <mruby.h>
+#include <mruby/string.h>
+#include <mruby/trace.h>
+
+static double
+trace_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + (double)ts.tv_nsec / 1.0e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+MRB_API void
+mrb_trace_start(mrb_state *mrb, uint32_t capacity)
+{
+  mrb_trace *tr;
+
+  mrb_trace_stop(mrb);
+  if (capacity == 0) capacity = 4096;
+  tr = (mrb_trace*)mrb_malloc(mrb, sizeof(mrb_trace));
+  tr->capacity = capacity;
+  tr->head = 0;
+  tr->count = 0;
+  tr->depth = 0;
+  tr->events = (struct mrb_trace_event*)mrb_malloc(mrb, sizeof(struct mrb_trace_event)*capacity);
+  mrb->trace = tr;
+}
+
+MRB_API void
+mrb_trace_stop(mrb_state *mrb)
+{
+  if (!mrb->trace) return;
+  mrb_free(mrb, mrb->trace->events);
+  mrb_free(mrb, mrb->trace);
+  mrb->trace = NULL;
+}
+
+static void
+trace_push(mrb_trace *tr, const char *name, char ph, double ts, double dur)
+{
+  struct mrb_trace_event *e = &tr->events[tr->head];
+
+  tr->head = (tr->head + 1) % tr->capacity;
+  if (tr->count < tr->capacity) tr->count++;
+  e->name = name;
+  e->ph = ph;
+  e->ts = ts;
+  e->dur = dur;
+}
+
+void
+mrb_trace_phase_begin(mrb_state *mrb, const char *name)
+{
+  mrb_trace *tr = mrb->trace;
+
+  if (tr->depth < MRB_TRACE_MAX_DEPTH) {
+    tr->names[tr->depth] = name;
+    tr->begins[tr->depth] = trace_clock();
+  }
+  tr->depth++;
+}
+
+void
+mrb_trace_phase_end(mrb_state *mrb)
+{
+  mrb_trace *tr = mrb->trace;
+
+  if (tr->depth == 0) return;
+  tr->depth--;
+  if (tr->depth < MRB_TRACE_MAX_DEPTH) {
+    trace_push(tr, tr->names[tr->depth], 'X', tr->begins[tr->depth],
+               trace_clock() - tr->begins[tr->depth]);
+  }
+}
+
+void
+mrb_trace_instant(mrb_state *mrb, const char *name)
+{
+  trace_push(mrb->trace, name, 'i', trace_clock(), 0.0);
+}
+
+MRB_API mrb_value
+mrb_trace_dump(mrb_state *mrb)
+{
+  mrb_trace *tr = mrb->trace;
+  mrb_value result;
+  uint32_t n;
+  char buf[128];
+
+  if (!tr || tr->count == 0) return mrb_str_new_lit(mrb, "[]");
+
+  /* building the string allocates and may run the collector; detach
+     the buffer so those cycles do not trace into what we are dumping */
+  mrb->trace = NULL;
+  result = mrb_str_new_lit(mrb, "[");
+  for (n = 0; n < tr->count; n++) {
+    /* oldest first: the ring overwrites from `head` backwards */
+    uint32_t i = (tr->head + tr->capacity - tr->count + n) % tr->capacity;
+    struct mrb_trace_event *e = &tr->events[i];
+
+    if (n > 0) mrb_str_cat_lit(mrb, result, ",\n");
+    mrb_str_cat_lit(mrb, result, "{\"name\":\"");
+    mrb_str_cat_cstr(mrb, result, e->name);
+    if (e->ph == 'X') {
+      snprintf(buf, sizeof(buf), "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}",
+               e->ts * 1.0e6, e->dur * 1.0e6);
+    }
+    else {
+      snprintf(buf, sizeof(buf), "\",\"ph\":\"i\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"s\":\"t\"}",
+               e->ts * 1.0e6);
+    }
+    mrb_str_cat_cstr(mrb, result, buf);
+  }
+  mrb_str_cat_lit(mrb, result, "]");
+  tr->head = 0;
+  tr->count = 0;
+  mrb->trace = tr;
+  return result;
+}
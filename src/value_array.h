@@ -2,25 +2,40 @@
 #define MRB_VALUE_ARRAY_H__
 
 #include <mruby.h>
+#include <string.h>
 
+/* mrb_value is trivially copyable, so bulk moves can be a single
+   memmove the compiler expands to wide loads/stores.  The 1-4 element
+   cases that dominate call argument shuffling are unrolled; loading
+   into temporaries first keeps them correct for overlapping ranges. */
 static inline void
 value_move(mrb_value *s1, const mrb_value *s2, size_t n)
 {
-  if (s1 > s2 && s1 < s2 + n)
-  {
-    s1 += n;
-    s2 += n;
-    while (n-- > 0) {
-      *--s1 = *--s2;
-    }
+  if (s1 == s2) return;
+  switch (n) {
+  case 0:
+    return;
+  case 1:
+    s1[0] = s2[0];
+    return;
+  case 2: {
+    mrb_value v0 = s2[0], v1 = s2[1];
+    s1[0] = v0; s1[1] = v1;
+    return;
   }
-  else if (s1 != s2) {
-    while (n-- > 0) {
-      *s1++ = *s2++;
-    }
+  case 3: {
+    mrb_value v0 = s2[0], v1 = s2[1], v2 = s2[2];
+    s1[0] = v0; s1[1] = v1; s1[2] = v2;
+    return;
   }
-  else {
-    /* nothing to do. */
+  case 4: {
+    mrb_value v0 = s2[0], v1 = s2[1], v2 = s2[2], v3 = s2[3];
+    s1[0] = v0; s1[1] = v1; s1[2] = v2; s1[3] = v3;
+    return;
+  }
+  default:
+    memmove(s1, s2, sizeof(mrb_value)*n);
+    return;
   }
 }
 
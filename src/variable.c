@@ -4,11 +4,16 @@
 ** See Copyright Notice in mruby.h
 */
 
+#include <string.h>
+
 #include <mruby.h>
 #include <mruby/array.h>
 #include <mruby/class.h>
+#include <mruby/irep.h>
 #include <mruby/proc.h>
+#include <mruby/data.h>
 #include <mruby/string.h>
+#include <mruby/variable.h>
 
 typedef int (iv_foreach_func)(mrb_state*,mrb_sym,mrb_value,void*);
 
@@ -282,44 +287,145 @@ iv_free(mrb_state *mrb, iv_tbl *t)
 
 #else
 
-#include <mruby/khash.h>
+/* Shape-based ivar storage: objects that gain the same ivar names in
+   the same order share one iv_shape chain mapping each name to a slot,
+   and the table itself is just a flat slot array.  Adding a new name
+   follows (or interns) a transition from the current shape, so layouts
+   are shared for the life of the state and OP_GETIV/OP_SETIV can carry
+   per-site (shape, slot) caches (see mrb_vm_iv_get_cached below).
+   Shapes come from the slab allocator and die with it in
+   mrb_gc_destroy; they are never freed individually. */
+
+typedef struct iv_shape {
+  mrb_sym sym;               /* name this shape adds; 0 for the root */
+  uint32_t slot;             /* slot of that name (its depth - 1) */
+  struct iv_shape *parent;
+  struct iv_shape *child;    /* first transition out of this shape */
+  struct iv_shape *sibling;  /* next transition out of the parent */
+} iv_shape;
 
-#ifndef MRB_IVHASH_INIT_SIZE
-#define MRB_IVHASH_INIT_SIZE 8
+typedef struct iv_tbl {
+  iv_shape *shape;
+  mrb_value *slots;
+  uint32_t capa;
+} iv_tbl;
+
+#ifndef MRB_IV_INITIAL_CAPA
+#define MRB_IV_INITIAL_CAPA 4
 #endif
+/* names collected on the C stack up to this depth (iv_del/iv_foreach) */
+#define IV_NAMES_BUF_MAX 16
 
-KHASH_DECLARE(iv, mrb_sym, mrb_value, TRUE)
-KHASH_DEFINE(iv, mrb_sym, mrb_value, TRUE, kh_int_hash_func, kh_int_hash_equal)
+static iv_shape*
+iv_shape_root(mrb_state *mrb)
+{
+  iv_shape *root = mrb->iv_shapes;
 
-typedef struct iv_tbl {
-  khash_t(iv) h;
-} iv_tbl;
+  if (!root) {
+    root = (iv_shape*)mrb_slab_alloc(mrb, sizeof(iv_shape));
+    memset(root, 0, sizeof(iv_shape));
+    mrb->iv_shapes = root;
+  }
+  return root;
+}
+
+static mrb_int
+iv_depth(iv_tbl *t)
+{
+  return t->shape->sym ? (mrb_int)t->shape->slot + 1 : 0;
+}
+
+/* the shape reached from sh by adding sym, interned on first use */
+static iv_shape*
+iv_shape_transition(mrb_state *mrb, iv_shape *sh, mrb_sym sym)
+{
+  iv_shape *ch;
+
+  for (ch = sh->child; ch; ch = ch->sibling) {
+    if (ch->sym == sym) return ch;
+  }
+  ch = (iv_shape*)mrb_slab_alloc(mrb, sizeof(iv_shape));
+  ch->sym = sym;
+  ch->slot = sh->sym ? sh->slot + 1 : 0;
+  ch->parent = sh;
+  ch->child = NULL;
+  ch->sibling = sh->child;
+  sh->child = ch;
+  return ch;
+}
+
+static iv_shape*
+iv_shape_find(iv_shape *sh, mrb_sym sym)
+{
+  while (sh->sym) {
+    if (sh->sym == sym) return sh;
+    sh = sh->parent;
+  }
+  return NULL;
+}
+
+/* names of all slots in assignment order; buf must hold
+   IV_NAMES_BUF_MAX names, larger chains are collected on the heap */
+static mrb_sym*
+iv_names(mrb_state *mrb, iv_tbl *t, mrb_sym *buf, mrb_int depth)
+{
+  iv_shape *sh;
+  mrb_sym *names = buf;
+
+  if (depth > IV_NAMES_BUF_MAX) {
+    names = (mrb_sym*)mrb_malloc(mrb, sizeof(mrb_sym)*depth);
+  }
+  for (sh = t->shape; sh->sym; sh = sh->parent) {
+    names[sh->slot] = sh->sym;
+  }
+  return names;
+}
 
 static iv_tbl*
 iv_new(mrb_state *mrb)
 {
-  return (iv_tbl*)kh_init_size(iv, mrb, MRB_IVHASH_INIT_SIZE);
+  iv_tbl *t = (iv_tbl*)mrb_slab_alloc(mrb, sizeof(iv_tbl));
+
+  t->shape = iv_shape_root(mrb);
+  t->slots = NULL;
+  t->capa = 0;
+  return t;
+}
+
+static void
+iv_expand(mrb_state *mrb, iv_tbl *t, uint32_t slot)
+{
+  if (slot >= t->capa) {
+    uint32_t capa = t->capa > 0 ? t->capa*2 : MRB_IV_INITIAL_CAPA;
+
+    while (slot >= capa) capa *= 2;
+    t->slots = (mrb_value*)mrb_realloc(mrb, t->slots, sizeof(mrb_value)*capa);
+    t->capa = capa;
+  }
 }
 
 static void
 iv_put(mrb_state *mrb, iv_tbl *t, mrb_sym sym, mrb_value val)
 {
-  khash_t(iv) *h = &t->h;
-  khiter_t k;
+  iv_shape *sh = iv_shape_find(t->shape, sym);
 
-  k = kh_put(iv, mrb, h, sym);
-  kh_value(h, k) = val;
+  if (sh) {
+    t->slots[sh->slot] = val;
+    return;
+  }
+  sh = iv_shape_transition(mrb, t->shape, sym);
+  iv_expand(mrb, t, sh->slot);
+  t->slots[sh->slot] = val;
+  t->shape = sh;
 }
 
 static mrb_bool
 iv_get(mrb_state *mrb, iv_tbl *t, mrb_sym sym, mrb_value *vp)
 {
-  khash_t(iv) *h = &t->h;
-  khiter_t k;
+  iv_shape *sh = iv_shape_find(t->shape, sym);
 
-  k = kh_get(iv, mrb, h, sym);
-  if (k != kh_end(h)) {
-    if (vp) *vp = kh_value(h, k);
+  if (sh) {
+    if (vp) *vp = t->slots[sh->slot];
     return TRUE;
   }
   return FALSE;
@@ -328,79 +434,113 @@ iv_get(mrb_state *mrb, iv_tbl *t, mrb_sym sym, mrb_value *vp)
 static mrb_bool
 iv_del(mrb_state *mrb, iv_tbl *t, mrb_sym sym, mrb_value *vp)
 {
-  khash_t(iv) *h = &t->h;
-  khiter_t k;
-
-  if (h) {
-    k = kh_get(iv, mrb, h, sym);
-    if (k != kh_end(h)) {
-      mrb_value val = kh_value(h, k);
-      kh_del(iv, mrb, h, k);
-      if (vp) *vp = val;
-      return TRUE;
+  iv_shape *del = iv_shape_find(t->shape, sym);
+  iv_shape *nsh;
+  mrb_sym buf[IV_NAMES_BUF_MAX];
+  mrb_sym *names;
+  mrb_int i, depth;
+
+  if (!del) return FALSE;
+  if (vp) *vp = t->slots[del->slot];
+  depth = iv_depth(t);
+  names = iv_names(mrb, t, buf, depth);
+  /* re-intern the chain without sym and close the slot gap; removal
+     yields a fresh shape identity, which keeps per-site caches honest */
+  nsh = iv_shape_root(mrb);
+  for (i = 0; i < depth; i++) {
+    if (names[i] == sym) continue;
+    nsh = iv_shape_transition(mrb, nsh, names[i]);
+    if (i > (mrb_int)del->slot) {
+      t->slots[nsh->slot] = t->slots[i];
     }
   }
-  return FALSE;
+  t->shape = nsh;
+  if (names != buf) mrb_free(mrb, names);
+  return TRUE;
 }
 
 static mrb_bool
 iv_foreach(mrb_state *mrb, iv_tbl *t, iv_foreach_func *func, void *p)
 {
-  khash_t(iv) *h = &t->h;
-  khiter_t k;
+  mrb_sym buf[IV_NAMES_BUF_MAX];
+  mrb_sym *names;
+  mrb_int i, depth = iv_depth(t);
   int n;
-
-  if (h) {
-    for (k = kh_begin(h); k != kh_end(h); k++) {
-      if (kh_exist(h, k)) {
-        n = (*func)(mrb, kh_key(h, k), kh_value(h, k), p);
-        if (n > 0) return FALSE;
-        if (n < 0) {
-          kh_del(iv, mrb, h, k);
-        }
-      }
+  mrb_bool result = TRUE;
+
+  if (depth == 0) return TRUE;
+  names = iv_names(mrb, t, buf, depth);
+  for (i = 0; i < depth; i++) {
+    n = (*func)(mrb, names[i], t->slots[i], p);
+    if (n > 0) {
+      result = FALSE;
+      break;
+    }
+    if (n < 0) {
+      /* deleting shifts the following slots down one */
+      iv_del(mrb, t, names[i], NULL);
+      memmove(names+i, names+i+1, sizeof(mrb_sym)*(depth-i-1));
+      depth--;
+      i--;
     }
   }
-  return TRUE;
+  if (names != buf) mrb_free(mrb, names);
+  return result;
 }
 
 static size_t
 iv_size(mrb_state *mrb, iv_tbl *t)
 {
-  khash_t(iv) *h;
-
-  if (t && (h = &t->h)) {
-    return kh_size(h);
-  }
-  return 0;
+  if (!t) return 0;
+  return (size_t)iv_depth(t);
 }
 
 static iv_tbl*
 iv_copy(mrb_state *mrb, iv_tbl *t)
 {
-  return (iv_tbl*)kh_copy(iv, mrb, &t->h);
+  iv_tbl *t2 = iv_new(mrb);
+  mrb_int depth = iv_depth(t);
+
+  if (depth > 0) {
+    iv_expand(mrb, t2, (uint32_t)depth-1);
+    memcpy(t2->slots, t->slots, sizeof(mrb_value)*depth);
+    t2->shape = t->shape;   /* layouts are interned, so it is shared */
+  }
+  return t2;
 }
 
 static void
 iv_free(mrb_state *mrb, iv_tbl *t)
 {
-  kh_destroy(iv, mrb, &t->h);
+  mrb_free(mrb, t->slots);
+  mrb_slab_free(mrb, t, sizeof(iv_tbl));
 }
 
 #endif
 
+#ifdef MRB_USE_IV_SEGLIST
 static int
 iv_mark_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *p)
 {
   mrb_gc_mark_value(mrb, v);
   return 0;
 }
+#endif
 
 static void
 mark_tbl(mrb_state *mrb, iv_tbl *t)
 {
   if (t) {
+#ifdef MRB_USE_IV_SEGLIST
     iv_foreach(mrb, t, iv_mark_i, 0);
+#else
+    /* names are not needed to mark; walk the slot array directly */
+    mrb_int i, depth = iv_depth(t);
+
+    for (i = 0; i < depth; i++) {
+      mrb_gc_mark_value(mrb, t->slots[i]);
+    }
+#endif
   }
 }
 
@@ -429,6 +569,49 @@ mrb_gc_mark_iv_size(mrb_state *mrb, struct RObject *obj)
   return iv_size(mrb, obj->iv);
 }
 
+/* yields each instance variable; returning >0 from the callback stops
+   the iteration, <0 deletes the current entry */
+MRB_API void
+mrb_iv_foreach(mrb_state *mrb, mrb_value obj, mrb_iv_foreach_func *func, void *data)
+{
+  iv_tbl *t = mrb_obj_ptr(obj)->iv;
+
+  if (!t) return;
+  iv_foreach(mrb, t, func, data);
+}
+
+/* same, over the global variable table */
+MRB_API void
+mrb_gv_foreach(mrb_state *mrb, mrb_iv_foreach_func *func, void *data)
+{
+  if (!mrb->globals) return;
+  iv_foreach(mrb, mrb->globals, func, data);
+}
+
+/* heap bytes held by the instance variable table; shapes are shared
+   across objects for the life of the state and are not charged */
+size_t
+mrb_gc_iv_memsize(mrb_state *mrb, struct RObject *obj)
+{
+  iv_tbl *t = obj->iv;
+  size_t bytes;
+
+  if (!t) return 0;
+  bytes = sizeof(iv_tbl);
+#ifdef MRB_USE_IV_SEGLIST
+  {
+    segment *seg;
+
+    for (seg = t->rootseg; seg; seg = seg->next) {
+      bytes += sizeof(segment);
+    }
+  }
+#else
+  bytes += sizeof(mrb_value)*t->capa;
+#endif
+  return bytes;
+}
+
 void
 mrb_gc_free_iv(mrb_state *mrb, struct RObject *obj)
 {
@@ -457,9 +640,11 @@ obj_iv_p(mrb_value obj)
     case MRB_TT_MODULE:
     case MRB_TT_SCLASS:
     case MRB_TT_HASH:
-    case MRB_TT_DATA:
     case MRB_TT_EXCEPTION:
       return TRUE;
+    case MRB_TT_DATA:
+      /* an inline payload overlays the iv slot */
+      return !mrb_data_inline_p(obj);
     default:
       return FALSE;
   }
@@ -663,6 +848,95 @@ mrb_vm_iv_set(mrb_state *mrb, mrb_sym sym, mrb_value v)
   mrb_iv_set(mrb, mrb->c->stack[0], sym, v);
 }
 
+/* Shape-cached ivar access for OP_GETIV/OP_SETIV.  Shapes are interned
+   and immutable, so matching the table's shape pointer proves the
+   cached slot (or cached miss) is still right; no generation needed. */
+mrb_value
+mrb_vm_iv_get_cached(mrb_state *mrb, mrb_sym sym, mrb_ivsite_cache *ic)
+{
+#ifndef MRB_USE_IV_SEGLIST
+  mrb_value obj = mrb->c->stack[0];
+
+  if (obj_iv_p(obj)) {
+    iv_tbl *t = mrb_obj_ptr(obj)->iv;
+
+    if (t) {
+      iv_shape *sh;
+
+      if (t->shape == ic->shape) {
+        if (ic->slot == MRB_IVCACHE_NONE) return mrb_nil_value();
+        return t->slots[ic->slot];
+      }
+      sh = iv_shape_find(t->shape, sym);
+      ic->shape = t->shape;
+      ic->tshape = NULL;
+      if (sh) {
+        ic->slot = sh->slot;
+        return t->slots[sh->slot];
+      }
+      ic->slot = MRB_IVCACHE_NONE;
+    }
+  }
+  return mrb_nil_value();
+#else
+  (void)ic;
+  return mrb_vm_iv_get(mrb, sym);
+#endif
+}
+
+void
+mrb_vm_iv_set_cached(mrb_state *mrb, mrb_sym sym, mrb_value v, mrb_ivsite_cache *ic)
+{
+#ifndef MRB_USE_IV_SEGLIST
+  mrb_value obj = mrb->c->stack[0];
+
+  if (obj_iv_p(obj)) {
+    struct RObject *o = mrb_obj_ptr(obj);
+    iv_tbl *t = o->iv;
+
+    if (t && t->shape == ic->shape && ic->slot != MRB_IVCACHE_NONE) {
+      mrb_write_barrier(mrb, (struct RBasic*)o);
+      if (ic->tshape) {
+        /* cached transition: the same layout gains the same new slot */
+        iv_expand(mrb, t, ic->slot);
+        t->slots[ic->slot] = v;
+        t->shape = ic->tshape;
+      }
+      else {
+        t->slots[ic->slot] = v;
+      }
+      return;
+    }
+    if (!t) {
+      t = o->iv = iv_new(mrb);
+    }
+    mrb_write_barrier(mrb, (struct RBasic*)o);
+    {
+      iv_shape *pre = t->shape;
+      iv_shape *sh = iv_shape_find(pre, sym);
+
+      if (sh) {
+        ic->tshape = NULL;
+      }
+      else {
+        sh = iv_shape_transition(mrb, pre, sym);
+        iv_expand(mrb, t, sh->slot);
+        t->shape = sh;
+        ic->tshape = sh;
+      }
+      t->slots[sh->slot] = v;
+      ic->shape = pre;
+      ic->slot = sh->slot;
+    }
+    return;
+  }
+  mrb_raise(mrb, E_ARGUMENT_ERROR, "cannot set instance variable");
+#else
+  (void)ic;
+  mrb_vm_iv_set(mrb, sym, v);
+#endif
+}
+
 static int
 iv_i(mrb_state *mrb, mrb_sym sym, mrb_value v, void *p)
 {
@@ -771,7 +1045,7 @@ mrb_mod_cv_get(mrb_state *mrb, struct RClass * c, mrb_sym sym)
     mrb_value klass;
 
     klass = mrb_obj_iv_get(mrb, (struct RObject *)cls,
-                           mrb_intern_lit(mrb, "__attached__"));
+                           MRB_SYM(__attached__));
     c = mrb_class_ptr(klass);
     if (c->tt == MRB_TT_CLASS || c->tt == MRB_TT_MODULE) {
       while (c) {
@@ -879,6 +1153,58 @@ mod_const_check(mrb_state *mrb, mrb_value mod)
   }
 }
 
+/* one initializer deferred until its constant is first looked up */
+struct mrb_lazy_const {
+  mrb_sym sym;
+  void (*init)(mrb_state*);
+};
+
+MRB_API void
+mrb_define_lazy_const(mrb_state *mrb, const char *name, void (*init)(mrb_state*))
+{
+  struct mrb_lazy_const *tbl;
+
+  tbl = (struct mrb_lazy_const*)mrb_realloc(mrb, mrb->lazy_consts,
+          sizeof(struct mrb_lazy_const) * (mrb->lazy_const_len + 1));
+  tbl[mrb->lazy_const_len].sym = mrb_intern_cstr(mrb, name);
+  tbl[mrb->lazy_const_len].init = init;
+  mrb->lazy_consts = tbl;
+  mrb->lazy_const_len++;
+}
+
+MRB_API mrb_bool
+mrb_lazy_const_pending(mrb_state *mrb, const char *name)
+{
+  mrb_sym sym = mrb_intern_cstr(mrb, name);
+  mrb_int i;
+
+  for (i = 0; i < mrb->lazy_const_len; i++) {
+    if (mrb->lazy_consts[i].sym == sym) return TRUE;
+  }
+  return FALSE;
+}
+
+/* runs (and consumes) a pending initializer registered for sym;
+   returns TRUE when one ran so the caller can retry the lookup */
+static mrb_bool
+lazy_const_run(mrb_state *mrb, mrb_sym sym)
+{
+  mrb_int i;
+
+  for (i = 0; i < mrb->lazy_const_len; i++) {
+    if (mrb->lazy_consts[i].sym == sym) {
+      void (*init)(mrb_state*) = mrb->lazy_consts[i].init;
+
+      /* drop the entry first: the initializer looks the name up itself
+         when it reopens the class it defines */
+      mrb->lazy_consts[i] = mrb->lazy_consts[--mrb->lazy_const_len];
+      init(mrb);
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
 static mrb_value
 const_get(mrb_state *mrb, struct RClass *base, mrb_sym sym)
 {
@@ -902,8 +1228,16 @@ L_RETRY:
     retry = TRUE;
     goto L_RETRY;
   }
+  if (lazy_const_run(mrb, sym)) {
+    c = base;
+    retry = FALSE;
+    goto L_RETRY;
+  }
   name = mrb_symbol_value(sym);
-  return mrb_funcall_argv(mrb, mrb_obj_value(base), mrb_intern_lit(mrb, "const_missing"), 1, &name);
+  /* bump the constant generation so per-site constant caches never hit
+     a value produced by const_missing (see OP_GETCONST in vm.c) */
+  mrb_const_cache_clear(mrb);
+  return mrb_funcall_argv(mrb, mrb_obj_value(base), MRB_SYM(const_missing), 1, &name);
 }
 
 MRB_API mrb_value
@@ -929,7 +1263,7 @@ mrb_vm_const_get(mrb_state *mrb, mrb_sym sym)
     if (c->tt == MRB_TT_SCLASS) {
       mrb_value klass;
       klass = mrb_obj_iv_get(mrb, (struct RObject *)c,
-                             mrb_intern_lit(mrb, "__attached__"));
+                             MRB_SYM(__attached__));
       c2 = mrb_class_ptr(klass);
       if (c2->tt == MRB_TT_CLASS)
         c = c2;
@@ -950,6 +1284,7 @@ MRB_API void
 mrb_const_set(mrb_state *mrb, mrb_value mod, mrb_sym sym, mrb_value v)
 {
   mod_const_check(mrb, mod);
+  mrb_const_cache_clear(mrb);
   mrb_iv_set(mrb, mod, sym, v);
 }
 
@@ -959,6 +1294,7 @@ mrb_vm_const_set(mrb_state *mrb, mrb_sym sym, mrb_value v)
   struct RClass *c = mrb->c->ci->proc->target_class;
 
   if (!c) c = mrb->c->ci->target_class;
+  mrb_const_cache_clear(mrb);
   mrb_obj_iv_set(mrb, (struct RObject*)c, sym, v);
 }
 
@@ -966,12 +1302,14 @@ MRB_API void
 mrb_const_remove(mrb_state *mrb, mrb_value mod, mrb_sym sym)
 {
   mod_const_check(mrb, mod);
+  mrb_const_cache_clear(mrb);
   mrb_iv_remove(mrb, mod, sym);
 }
 
 MRB_API void
 mrb_define_const(mrb_state *mrb, struct RClass *mod, const char *name, mrb_value v)
 {
+  mrb_const_cache_clear(mrb);
   mrb_obj_iv_set(mrb, (struct RObject*)mod, mrb_intern_cstr(mrb, name), v);
 }
 
@@ -1164,7 +1502,7 @@ mrb_class_sym(mrb_state *mrb, struct RClass *c, struct RClass *outer)
 {
   mrb_value name;
 
-  name = mrb_obj_iv_get(mrb, (struct RObject*)c, mrb_intern_lit(mrb, "__classid__"));
+  name = mrb_obj_iv_get(mrb, (struct RObject*)c, MRB_SYM(__classid__));
   if (mrb_nil_p(name)) {
 
     if (!outer) return 0;
@@ -19,6 +19,8 @@
 #include <mruby/variable.h>
 #include <mruby/error.h>
 #include <mruby/opcode.h>
+#include <mruby/profile.h>
+#include <mruby/latency.h>
 #include "value_array.h"
 #include <mruby/throw.h>
 
@@ -33,7 +35,6 @@ void abort(void);
 #endif
 
 #define STACK_INIT_SIZE 128
-#define CALLINFO_INIT_SIZE 32
 
 /* Define amount of linear stack growth. */
 #ifndef MRB_STACK_GROWTH
@@ -71,11 +72,18 @@ stack_clear(mrb_value *from, size_t count)
 #endif
 }
 
+/* callers never pass overlapping ranges, so this is a plain memcpy
+   with the dominant small argument counts unrolled */
 static inline void
 stack_copy(mrb_value *dst, const mrb_value *src, size_t size)
 {
-  while (size-- > 0) {
-    *dst++ = *src++;
+  switch (size) {
+  case 0: return;
+  case 1: dst[0] = src[0]; return;
+  case 2: dst[0] = src[0]; dst[1] = src[1]; return;
+  case 3: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; return;
+  case 4: dst[0] = src[0]; dst[1] = src[1]; dst[2] = src[2]; dst[3] = src[3]; return;
+  default: memcpy(dst, src, sizeof(mrb_value)*size); return;
   }
 }
 
@@ -90,9 +98,10 @@ stack_init(mrb_state *mrb)
   c->stack = c->stbase;
 
   /* mrb_assert(ci == NULL); */
-  c->cibase = (mrb_callinfo *)mrb_calloc(mrb, CALLINFO_INIT_SIZE, sizeof(mrb_callinfo));
-  c->ciend = c->cibase + CALLINFO_INIT_SIZE;
-  c->ci = c->cibase;
+  c->ciseg = (mrb_callinfo **)mrb_malloc(mrb, sizeof(mrb_callinfo*));
+  c->ciseg[0] = (mrb_callinfo *)mrb_calloc(mrb, MRB_CALLINFO_SEG_SIZE, sizeof(mrb_callinfo));
+  c->cisegs = 1;
+  c->ci = c->ciseg[0];
   c->ci->target_class = mrb->object_class;
   c->ci->stackent = c->stack;
 }
@@ -100,10 +109,11 @@ stack_init(mrb_state *mrb)
 static inline void
 envadjust(mrb_state *mrb, mrb_value *oldbase, mrb_value *newbase)
 {
-  mrb_callinfo *ci = mrb->c->cibase;
+  int i;
 
   if (newbase == oldbase) return;
-  while (ci <= mrb->c->ci) {
+  for (i=0; i<=mrb->c->ci->ciidx; i++) {
+    mrb_callinfo *ci = mrb_ci_at(mrb->c, i);
     struct REnv *e = ci->env;
     if (e && MRB_ENV_STACK_SHARED_P(e)) {
       ptrdiff_t off = e->stack - oldbase;
@@ -111,7 +121,6 @@ envadjust(mrb_state *mrb, mrb_value *oldbase, mrb_value *newbase)
       e->stack = newbase + off;
     }
     ci->stackent = newbase + (ci->stackent - oldbase);
-    ci++;
   }
 }
 
@@ -187,8 +196,8 @@ is_strict(mrb_state *mrb, struct REnv *e)
 {
   int cioff = e->cioff;
 
-  if (MRB_ENV_STACK_SHARED_P(e) && mrb->c->cibase[cioff].proc &&
-      MRB_PROC_STRICT_P(mrb->c->cibase[cioff].proc)) {
+  if (MRB_ENV_STACK_SHARED_P(e) && mrb_ci_at(mrb->c, cioff)->proc &&
+      MRB_PROC_STRICT_P(mrb_ci_at(mrb->c, cioff)->proc)) {
     return TRUE;
   }
   return FALSE;
@@ -211,6 +220,99 @@ top_env(mrb_state *mrb, struct RProc *proc)
 #define CI_ACC_DIRECT  -2
 #define CI_ACC_RESUMED -3
 
+/* A trivial leaf method (one-line reader/writer/constant body) can be
+   executed directly at the call site without pushing a callinfo or
+   extending the stack. */
+static mrb_bool
+leaf_irep_p(mrb_irep *irep)
+{
+  mrb_code i0, i1, i2;
+
+  if (irep->ilen != 3) return FALSE;
+  i0 = irep->iseq[0];
+  i1 = irep->iseq[1];
+  i2 = irep->iseq[2];
+  if (GET_OPCODE(i0) != OP_ENTER) return FALSE;
+  if (GET_OPCODE(i2) != OP_RETURN || GETARG_B(i2) != OP_R_NORMAL) return FALSE;
+  switch (GET_OPCODE(i1)) {
+  case OP_GETIV:
+  case OP_LOADSELF:
+  case OP_LOADT: case OP_LOADF: case OP_LOADNIL:
+  case OP_LOADI: case OP_LOADSYM: case OP_LOADL:
+    if (GETARG_Ax(i0) != 0) return FALSE;
+    return GETARG_A(i1) == GETARG_A(i2);
+  case OP_SETIV:
+    if (GETARG_Ax(i0) != MRB_ARGS_REQ(1)) return FALSE;
+    return GETARG_A(i1) == 1 && GETARG_A(i2) == 1;
+  default:
+    return FALSE;
+  }
+}
+
+/* marks the leading frame slots of `base` that blocks nested `depth`
+   levels below it can reach through the env chain */
+static void
+capture_scan(mrb_irep *base, mrb_irep *irep, int depth, int *len)
+{
+  size_t r;
+
+  for (r = 0; r < irep->rlen; r++) {
+    mrb_irep *child = irep->reps[r];
+    mrb_code *p, *pend;
+
+    if (!child) {
+      /* lazily loaded rep: assume the whole frame is captured */
+      *len = base->nlocals;
+      return;
+    }
+    p = child->iseq;
+    pend = p + child->ilen;
+    for (; p < pend; p++) {
+      mrb_code c = *p;
+
+      switch (GET_OPCODE(c)) {
+      case OP_GETUPVAR: case OP_SETUPVAR:
+        if (GETARG_C(c) == depth && GETARG_B(c) >= *len) {
+          *len = GETARG_B(c) + 1;
+        }
+        break;
+      case OP_ARGARY: case OP_BLKPUSH:
+        /* replays the frame's argument window (super, block pass);
+           keep every slot rather than model the window layout */
+        if ((GETARG_Bx(c) & 0xf) == depth+1) {
+          *len = base->nlocals;
+          return;
+        }
+        break;
+      default:
+        break;
+      }
+    }
+    if (*len >= base->nlocals) return;
+    capture_scan(base, child, depth+1, len);
+  }
+}
+
+/* How many leading slots of this irep's frame an env must keep alive:
+   self plus every local some descendant block actually captures.
+   Computed on first use and cached; the result only depends on the
+   irep tree, so caching is safe across states sharing static ireps.
+   With mruby-eval loaded (mrb->eval_cache is set at its gem init) the
+   analysis is unsound -- eval compiles new upvar accesses at runtime --
+   so the whole frame is kept. */
+int
+mrb_irep_env_len(mrb_state *mrb, mrb_irep *irep)
+{
+  if (mrb->eval_cache) return irep->nlocals;
+  if (irep->clen == 0) {
+    int len = 1;  /* e->stack[0] (self) is read by the VM itself */
+
+    capture_scan(irep, irep, 0, &len);
+    irep->clen = (uint16_t)len;
+  }
+  return irep->clen;
+}
+
 static mrb_callinfo*
 cipush(mrb_state *mrb)
 {
@@ -219,21 +321,23 @@ cipush(mrb_state *mrb)
 
   int eidx = ci->eidx;
   int ridx = ci->ridx;
+  int idx = ci->ciidx + 1;
 
-  if (ci + 1 == c->ciend) {
-    ptrdiff_t size = ci - c->cibase;
-
-    c->cibase = (mrb_callinfo *)mrb_realloc(mrb, c->cibase, sizeof(mrb_callinfo)*size*2);
-    c->ci = c->cibase + size;
-    c->ciend = c->cibase + size * 2;
+  if (idx >= c->cisegs * MRB_CALLINFO_SEG_SIZE) {
+    /* append a segment; existing records never move */
+    c->ciseg = (mrb_callinfo **)mrb_realloc(mrb, c->ciseg, sizeof(mrb_callinfo*)*(c->cisegs+1));
+    c->ciseg[c->cisegs] = (mrb_callinfo *)mrb_calloc(mrb, MRB_CALLINFO_SEG_SIZE, sizeof(mrb_callinfo));
+    c->cisegs++;
   }
-  ci = ++c->ci;
+  ci = c->ci = mrb_ci_at(c, idx);
+  ci->ciidx = idx;
   ci->eidx = eidx;
   ci->ridx = ridx;
   ci->env = 0;
   ci->pc = 0;
   ci->err = 0;
   ci->proc = 0;
+  ci->arena_idx = mrb_gc_arena_save(mrb);
 
   return ci;
 }
@@ -242,7 +346,7 @@ MRB_API void
 mrb_env_unshare(mrb_state *mrb, struct REnv *e)
 {
   size_t len = (size_t)MRB_ENV_STACK_LEN(e);
-  mrb_value *p = (mrb_value *)mrb_malloc(mrb, sizeof(mrb_value)*len);
+  mrb_value *p = (mrb_value *)mrb_slab_alloc(mrb, sizeof(mrb_value)*len);
 
   MRB_ENV_UNSHARE_STACK(e);
   if (len > 0) {
@@ -257,8 +361,18 @@ cipop(mrb_state *mrb)
 {
   struct mrb_context *c = mrb->c;
   struct REnv *env = c->ci->env;
+  int idx = c->ci->ciidx - 1;
+
+  /* close the frame's arena scope: objects registered during the call
+     are only reachable afterwards if the caller stores or re-protects
+     them.  Never raise the index -- a frame recorded on a suspended
+     fiber may carry a value above the current one. */
+  if (mrb->gc.arena_idx > c->ci->arena_idx) {
+    mrb->gc.arena_idx = c->ci->arena_idx;
+  }
 
-  c->ci--;
+  c->ci = mrb_ci_at(c, idx);
+  if (c->ci_clean > idx) c->ci_clean = idx;
 
   if (env) {
     mrb_env_unshare(mrb, env);
@@ -282,13 +396,13 @@ ecall(mrb_state *mrb, int i)
     mrb->c->ci->eidx = i;
   ci = cipush(mrb);
   ci->stackent = mrb->c->stack;
-  ci->mid = ci[-1].mid;
+  ci->mid = mrb_ci_at(mrb->c, ci->ciidx-1)->mid;
   ci->acc = CI_ACC_SKIP;
   ci->argc = 0;
   ci->proc = p;
   ci->nregs = p->body.irep->nregs;
   ci->target_class = p->target_class;
-  mrb->c->stack = mrb->c->stack + ci[-1].nregs;
+  mrb->c->stack = mrb->c->stack + mrb_ci_at(mrb->c, ci->ciidx-1)->nregs;
   exc = mrb->exc; mrb->exc = 0;
   mrb_run(mrb, p, *self);
   mrb->c->ensure[i] = NULL;
@@ -323,10 +437,19 @@ MRB_API mrb_value
 mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, mrb_int argc, const mrb_value *argv, mrb_value blk)
 {
   mrb_value val;
+  uint64_t lat_begin = 0;
+  mrb_sym lat_mid = 0;
+
+  /* only the dispatching branch below is timed; the jmp-less wrapper
+     delegates to a recursive call that records on its own */
+  if (mrb->lat && mrb->jmp) {
+    lat_begin = mrb_latency_now();
+    lat_mid = mid;
+  }
 
   if (!mrb->jmp) {
     struct mrb_jmpbuf c_jmp;
-    ptrdiff_t nth_ci = mrb->c->ci - mrb->c->cibase;
+    int nth_ci = mrb->c->ci ? mrb->c->ci->ciidx : 0;
 
     MRB_TRY(&c_jmp) {
       mrb->jmp = &c_jmp;
@@ -335,7 +458,7 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, mrb_int argc
       mrb->jmp = 0;
     }
     MRB_CATCH(&c_jmp) { /* error */
-      while (nth_ci < (mrb->c->ci - mrb->c->cibase)) {
+      while (nth_ci < mrb->c->ci->ciidx) {
         mrb->c->stack = mrb->c->ci->stackent;
         cipop(mrb);
       }
@@ -363,7 +486,7 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, mrb_int argc
     p = mrb_method_search_vm(mrb, &c, mid);
     if (!p) {
       undef = mid;
-      mid = mrb_intern_lit(mrb, "method_missing");
+      mid = MRB_SYM(method_missing);
       p = mrb_method_search_vm(mrb, &c, mid);
       n++; argc++;
     }
@@ -401,19 +524,19 @@ mrb_funcall_with_block(mrb_state *mrb, mrb_value self, mrb_sym mid, mrb_int argc
     mrb->c->stack[argc+1] = blk;
 
     if (MRB_PROC_CFUNC_P(p)) {
-      int ai = mrb_gc_arena_save(mrb);
-
       ci->acc = CI_ACC_DIRECT;
       val = p->body.func(mrb, self);
       mrb->c->stack = mrb->c->ci->stackent;
-      cipop(mrb);
-      mrb_gc_arena_restore(mrb, ai);
+      cipop(mrb);  /* restores the arena to the frame's entry index */
     }
     else {
       ci->acc = CI_ACC_SKIP;
       val = mrb_run(mrb, p, self);
     }
   }
+  if (lat_mid) {
+    mrb_latency_record(mrb, lat_mid, mrb_latency_now() - lat_begin);
+  }
   mrb_gc_protect(mrb, val);
   return val;
 }
@@ -424,6 +547,121 @@ mrb_funcall_argv(mrb_state *mrb, mrb_value self, mrb_sym mid, mrb_int argc, cons
   return mrb_funcall_with_block(mrb, self, mid, argc, argv, mrb_nil_value());
 }
 
+MRB_API void
+mrb_funcall_prepare(mrb_state *mrb, mrb_prepared_call *call, struct RClass *c, mrb_sym mid, mrb_int argc)
+{
+  struct RClass *tc = c;
+
+  call->c = c;
+  call->mid = mid;
+  call->argc = argc;
+  call->gen = mrb->cache_gen;
+  call->proc = mrb_method_search_vm(mrb, &tc, mid);
+  call->tc = tc;
+}
+
+MRB_API mrb_value
+mrb_funcall_prepared(mrb_state *mrb, mrb_prepared_call *call, mrb_value self, const mrb_value *argv)
+{
+  mrb_value val;
+  uint64_t lat_begin = 0;
+  mrb_sym lat_mid = 0;
+
+  if (mrb->lat && mrb->jmp) {
+    lat_begin = mrb_latency_now();
+    lat_mid = call->mid;
+  }
+
+  if (!mrb->jmp) {
+    struct mrb_jmpbuf c_jmp;
+    int nth_ci = mrb->c->ci ? mrb->c->ci->ciidx : 0;
+
+    MRB_TRY(&c_jmp) {
+      mrb->jmp = &c_jmp;
+      /* recursive call */
+      val = mrb_funcall_prepared(mrb, call, self, argv);
+      mrb->jmp = 0;
+    }
+    MRB_CATCH(&c_jmp) { /* error */
+      while (nth_ci < mrb->c->ci->ciidx) {
+        mrb->c->stack = mrb->c->ci->stackent;
+        cipop(mrb);
+      }
+      mrb->jmp = 0;
+      val = mrb_obj_value(mrb->exc);
+    }
+    MRB_END_EXC(&c_jmp);
+  }
+  else {
+    struct RProc *p;
+    mrb_callinfo *ci;
+    mrb_int argc = call->argc;
+    int n;
+    ptrdiff_t voff = -1;
+
+    if (!mrb->c->stack) {
+      stack_init(mrb);
+    }
+    if (call->gen != mrb->cache_gen) {
+      /* a method table changed since the handle was resolved */
+      struct RClass *tc = call->c;
+
+      call->gen = mrb->cache_gen;
+      call->proc = mrb_method_search_vm(mrb, &tc, call->mid);
+      call->tc = tc;
+    }
+    p = call->proc;
+    if (!p || mrb_class(mrb, self) != call->c) {
+      /* missing method or a receiver of another class; the generic
+         path handles method_missing */
+      return mrb_funcall_argv(mrb, self, call->mid, argc, argv);
+    }
+    n = mrb->c->ci->nregs;
+    ci = cipush(mrb);
+    ci->mid = call->mid;
+    ci->proc = p;
+    ci->stackent = mrb->c->stack;
+    ci->argc = argc;
+    ci->target_class = call->tc;
+    mrb->c->stack = mrb->c->stack + n;
+    if (mrb->c->stbase <= argv && argv < mrb->c->stend) {
+      voff = argv - mrb->c->stbase;
+    }
+    if (MRB_PROC_CFUNC_P(p)) {
+      ci->nregs = argc + 2;
+      stack_extend(mrb, ci->nregs, 0);
+    }
+    else {
+      ci->nregs = p->body.irep->nregs + n;
+      stack_extend(mrb, ci->nregs, argc+2);
+    }
+    if (voff >= 0) {
+      argv = mrb->c->stbase + voff;
+    }
+    mrb->c->stack[0] = self;
+    if (argc > 0) {
+      stack_copy(mrb->c->stack+1, argv, argc);
+    }
+    mrb->c->stack[argc+1] = mrb_nil_value();
+
+    if (MRB_PROC_CFUNC_P(p)) {
+      ci->acc = CI_ACC_DIRECT;
+      val = p->body.func(mrb, self);
+      mrb->c->stack = mrb->c->ci->stackent;
+      cipop(mrb);  /* restores the arena to the frame's entry index */
+    }
+    else {
+      ci->acc = CI_ACC_SKIP;
+      val = mrb_run(mrb, p, self);
+    }
+  }
+  if (lat_mid) {
+    mrb_latency_record(mrb, lat_mid, mrb_latency_now() - lat_begin);
+  }
+  mrb_gc_protect(mrb, val);
+  return val;
+}
+
 /* 15.3.1.3.4  */
 /* 15.3.1.3.44 */
 /*
@@ -651,6 +889,7 @@ mrb_yield_with_class(mrb_state *mrb, mrb_value b, mrb_int argc, const mrb_value
   else {
     val = mrb_run(mrb, p, self);
   }
+  mrb_gc_protect(mrb, val);  /* popping the frame closed its arena scope */
   return val;
 }
 
@@ -658,16 +897,49 @@ MRB_API mrb_value
 mrb_yield_argv(mrb_state *mrb, mrb_value b, mrb_int argc, const mrb_value *argv)
 {
   struct RProc *p = mrb_proc_ptr(b);
+  mrb_value self = p->env ? p->env->stack[0] : mrb->c->stack[0];
 
-  return mrb_yield_with_class(mrb, b, argc, argv, p->env->stack[0], p->target_class);
+  return mrb_yield_with_class(mrb, b, argc, argv, self, p->target_class);
 }
 
 MRB_API mrb_value
 mrb_yield(mrb_state *mrb, mrb_value b, mrb_value arg)
 {
   struct RProc *p = mrb_proc_ptr(b);
+  mrb_value self = p->env ? p->env->stack[0] : mrb->c->stack[0];
+
+  return mrb_yield_with_class(mrb, b, 1, &arg, self, p->target_class);
+}
+
+static mrb_bool
+irep_block_return_p(mrb_irep *irep)
+{
+  size_t i;
+
+  for (i = 0; i < irep->ilen; i++) {
+    mrb_code c = irep->iseq[i];
 
-  return mrb_yield_with_class(mrb, b, 1, &arg, p->env->stack[0], p->target_class);
+    if (GET_OPCODE(c) == OP_RETURN && GETARG_B(c) == OP_R_RETURN) return TRUE;
+  }
+  for (i = 0; i < irep->rlen; i++) {
+    /* an unread lazy child could contain anything; assume it returns */
+    if (!irep->reps[i] || irep_block_return_p(irep->reps[i])) return TRUE;
+  }
+  return FALSE;
+}
+
+/*
+ * TRUE if the block may execute a block-`return` (OP_R_RETURN), which
+ * has to unwind the enclosing method and therefore cannot cross a C
+ * frame.  C loops that drive a block with mrb_yield check this and
+ * decline such blocks; a `break` in contrast is stopped at the C
+ * boundary by OP_RETURN and handed to the caller through break_proc.
+ */
+mrb_bool
+mrb_proc_block_return_p(mrb_state *mrb, struct RProc *p)
+{
+  if (MRB_PROC_CFUNC_P(p)) return FALSE;
+  return irep_block_return_p(p->body.irep);
 }
 
 typedef enum {
@@ -711,6 +983,166 @@ argnum_error(mrb_state *mrb, mrb_int num)
   mrb_exc_set(mrb, exc);
 }
 
+#ifdef MRB_VM_OPCODE_PROFILE
+
+#include <time.h>
+
+/* per-opcode execution and cycle accounting (MRB_VM_OPCODE_PROFILE).
+   Every dispatch charges the cycles elapsed since the previous dispatch
+   to the opcode that just finished and counts the pair transition, so
+   the cost of a C function invoked by a send lands on that send.  A
+   nested mrb_vm_exec shares the table; cycles spanning the nesting
+   boundary are smeared onto the innermost opcode, which is noise at
+   this granularity.  mrb_close prints the table to stderr. */
+typedef struct mrb_opprof {
+  uint64_t count[OP_MAXOPCODE];
+  uint64_t cycles[OP_MAXOPCODE];
+  uint64_t pair[OP_MAXOPCODE][OP_MAXOPCODE];
+  uint64_t last_tick;
+  int last_op;                  /* -1 before the first dispatch */
+} mrb_opprof;
+
+static uint64_t
+opprof_tick(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+  __asm__ __volatile__ ("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#elif defined(__aarch64__)
+  uint64_t t;
+  __asm__ __volatile__ ("mrs %0, cntvct_el0" : "=r"(t));
+  return t;
+#else
+  /* no cheap cycle counter on this target; nanoseconds keep the
+     ratios in the dumped table meaningful */
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void
+opprof_step(mrb_state *mrb, int op)
+{
+  mrb_opprof *p = mrb->opprof;
+  uint64_t now = opprof_tick();
+
+  if (!p) {
+    p = (mrb_opprof*)mrb_calloc(mrb, 1, sizeof(mrb_opprof));
+    p->last_op = -1;
+    mrb->opprof = p;
+  }
+  if (p->last_op >= 0) {
+    p->cycles[p->last_op] += now - p->last_tick;
+    p->pair[p->last_op][op]++;
+  }
+  p->count[op]++;
+  p->last_op = op;
+  /* re-read so the bookkeeping above is not charged to this opcode */
+  p->last_tick = opprof_tick();
+}
+
+static const char *const opprof_names[OP_MAXOPCODE] = {
+  "NOP", "MOVE", "LOADL", "LOADI", "LOADSYM", "LOADNIL",
+  "LOADSELF", "LOADT", "LOADF",
+  "GETGLOBAL", "SETGLOBAL", "GETSPECIAL", "SETSPECIAL",
+  "GETIV", "SETIV", "GETCV", "SETCV",
+  "GETCONST", "SETCONST", "GETMCNST", "SETMCNST",
+  "GETUPVAR", "SETUPVAR",
+  "JMP", "JMPIF", "JMPNOT",
+  "ONERR", "RESCUE", "POPERR", "RAISE", "EPUSH", "EPOP",
+  "SEND", "SENDB", "FSEND",
+  "CALL", "SUPER", "ARGARY", "ENTER",
+  "KARG", "KDICT", "RETURN", "TAILCALL", "BLKPUSH",
+  "ADD", "ADDI", "SUB", "SUBI", "MUL", "DIV",
+  "EQ", "LT", "LE", "GT", "GE",
+  "ARRAY", "ARYCAT", "ARYPUSH", "AREF", "ASET", "APOST",
+  "STRING", "STRCAT", "HASH",
+  "LAMBDA", "RANGE", "OCLASS",
+  "CLASS", "MODULE", "EXEC",
+  "METHOD", "SCLASS", "TCLASS",
+  "DEBUG", "STOP", "ERR",
+  "SENDC", "SELFSEND", "MOVESEND", "IVSEND",
+  "FROZSTR",
+  "JMPLT", "JMPLE", "JMPGT", "JMPGE", "JMPEQ",
+  "SENDL", "UPDIDX", "TRAP",
+  "RSVD2", "RSVD3", "RSVD4", "RSVD5",
+};
+
+void
+mrb_opprof_dump(mrb_state *mrb)
+{
+  mrb_opprof *p = mrb->opprof;
+
+  if (!p) return;
+#ifndef MRB_DISABLE_STDIO
+  {
+    int order[OP_MAXOPCODE];
+    uint64_t total_cycles = 0;
+    uint64_t total_count = 0;
+    int n, m, k;
+
+    for (n = 0; n < OP_MAXOPCODE; n++) {
+      order[n] = n;
+      total_cycles += p->cycles[n];
+      total_count += p->count[n];
+    }
+    for (n = 1; n < OP_MAXOPCODE; n++) {
+      k = order[n];
+      for (m = n; m > 0 && p->cycles[order[m-1]] < p->cycles[k]; m--) {
+        order[m] = order[m-1];
+      }
+      order[m] = k;
+    }
+
+    fprintf(stderr, "== opcode profile: %llu dispatches, %llu cycles\n",
+            (unsigned long long)total_count, (unsigned long long)total_cycles);
+    fprintf(stderr, "%-12s %12s %16s %9s %7s\n",
+            "opcode", "count", "cycles", "cyc/op", "%");
+    for (n = 0; n < OP_MAXOPCODE; n++) {
+      k = order[n];
+      if (p->count[k] == 0) continue;
+      fprintf(stderr, "%-12s %12llu %16llu %9.1f %6.2f%%\n",
+              opprof_names[k],
+              (unsigned long long)p->count[k],
+              (unsigned long long)p->cycles[k],
+              (double)p->cycles[k] / (double)p->count[k],
+              total_cycles ? 100.0 * (double)p->cycles[k] / (double)total_cycles : 0.0);
+    }
+
+    fprintf(stderr, "== top opcode transitions\n");
+    for (n = 0; n < 20; n++) {
+      int bi = -1, bj = -1;
+      uint64_t best = 0;
+
+      for (m = 0; m < OP_MAXOPCODE; m++) {
+        for (k = 0; k < OP_MAXOPCODE; k++) {
+          if (p->pair[m][k] > best) {
+            best = p->pair[m][k];
+            bi = m;
+            bj = k;
+          }
+        }
+      }
+      if (bi < 0) break;
+      fprintf(stderr, "%-12s -> %-12s %12llu %6.2f%%\n",
+              opprof_names[bi], opprof_names[bj],
+              (unsigned long long)best,
+              total_count ? 100.0 * (double)best / (double)total_count : 0.0);
+      p->pair[bi][bj] = 0;
+    }
+  }
+#endif
+  mrb_free(mrb, p);
+  mrb->opprof = NULL;
+}
+
+#define OPCODE_PROF_HOOK(mrb, i) opprof_step((mrb), GET_OPCODE(i))
+#else
+#define OPCODE_PROF_HOOK(mrb, i)
+#endif
+
 #define ERR_PC_SET(mrb, pc) mrb->c->ci->err = pc;
 #define ERR_PC_CLR(mrb)     mrb->c->ci->err = 0;
 #ifdef MRB_ENABLE_DEBUG_HOOK
@@ -725,7 +1157,12 @@ argnum_error(mrb_state *mrb, mrb_int num)
 
 #ifndef DIRECT_THREADED
 
-#define INIT_DISPATCH for (;;) { i = *pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); switch (GET_OPCODE(i)) {
+#ifdef MRB_ENABLE_DEBUG_HOOK
+#define INIT_DISPATCH for (;;) { i = *pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); OPCODE_PROF_HOOK(mrb, i); L_DISPATCH: switch (GET_OPCODE(i)) {
+#define REDISPATCH goto L_DISPATCH
+#else
+#define INIT_DISPATCH for (;;) { i = *pc; OPCODE_PROF_HOOK(mrb, i); switch (GET_OPCODE(i)) {
+#endif
 #define CASE(op) case op:
 #define NEXT pc++; break
 #define JUMP break
@@ -735,8 +1172,9 @@ argnum_error(mrb_state *mrb, mrb_int num)
 
 #define INIT_DISPATCH JUMP; return mrb_nil_value();
 #define CASE(op) L_ ## op:
-#define NEXT i=*++pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
-#define JUMP i=*pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); goto *optable[GET_OPCODE(i)]
+#define NEXT i=*++pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); OPCODE_PROF_HOOK(mrb, i); goto *optable[GET_OPCODE(i)]
+#define JUMP i=*pc; CODE_FETCH_HOOK(mrb, irep, pc, regs); OPCODE_PROF_HOOK(mrb, i); goto *optable[GET_OPCODE(i)]
+#define REDISPATCH goto *optable[GET_OPCODE(i)]
 
 #define END_DISPATCH
 
@@ -756,6 +1194,16 @@ mrb_vm_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int stac
   }
   stack_extend(mrb, irep->nregs, stack_keep);
   mrb->c->stack[0] = self;
+  /* time outermost entries only (no enclosing VM frame to record
+     them); nested runs are covered by the funcall boundaries */
+  if (mrb->lat && !mrb->jmp) {
+    uint64_t lat_begin = mrb_latency_now();
+    mrb_value val = mrb_vm_exec(mrb, proc, irep->iseq);
+
+    mrb_latency_record(mrb, mrb->c->ci ? mrb->c->ci->mid : 0,
+                       mrb_latency_now() - lat_begin);
+    return val;
+  }
   return mrb_vm_exec(mrb, proc, irep->iseq);
 }
 
@@ -770,6 +1218,7 @@ mrb_vm_exec(mrb_state *mrb, struct RProc *proc, mrb_code *pc)
   int ai = mrb_gc_arena_save(mrb);
   struct mrb_jmpbuf *prev_jmp = mrb->jmp;
   struct mrb_jmpbuf c_jmp;
+  mrb_value break_value;  /* carries the value of a break resumed at L_BREAK */
 
 #ifdef DIRECT_THREADED
   static void *optable[] = {
@@ -793,6 +1242,10 @@ mrb_vm_exec(mrb_state *mrb, struct RProc *proc, mrb_code *pc)
     &&L_OP_CLASS, &&L_OP_MODULE, &&L_OP_EXEC,
     &&L_OP_METHOD, &&L_OP_SCLASS, &&L_OP_TCLASS,
     &&L_OP_DEBUG, &&L_OP_STOP, &&L_OP_ERR,
+    &&L_OP_SENDC, &&L_OP_SELFSEND, &&L_OP_MOVESEND, &&L_OP_IVSEND,
+    &&L_OP_FROZSTR,
+    &&L_OP_JMPLT, &&L_OP_JMPLE, &&L_OP_JMPGT, &&L_OP_JMPGE, &&L_OP_JMPEQ,
+    &&L_OP_SENDL, &&L_OP_UPDIDX, &&L_OP_TRAP,
   };
 #endif
 
@@ -884,13 +1337,20 @@ RETRY_TRY_BLOCK:
 
     CASE(OP_GETIV) {
       /* A Bx   R(A) := ivget(Bx) */
-      regs[GETARG_A(i)] = mrb_vm_iv_get(mrb, syms[GETARG_Bx(i)]);
+      /* per-site shape cache (see mrb_vm_iv_get_cached in variable.c) */
+      if (!irep->icache) {
+        irep->icache = (mrb_ivsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_ivsite_cache));
+      }
+      regs[GETARG_A(i)] = mrb_vm_iv_get_cached(mrb, syms[GETARG_Bx(i)], &irep->icache[pc - irep->iseq]);
       NEXT;
     }
 
     CASE(OP_SETIV) {
       /* ivset(Syms(Bx),R(A)) */
-      mrb_vm_iv_set(mrb, syms[GETARG_Bx(i)], regs[GETARG_A(i)]);
+      if (!irep->icache) {
+        irep->icache = (mrb_ivsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_ivsite_cache));
+      }
+      mrb_vm_iv_set_cached(mrb, syms[GETARG_Bx(i)], regs[GETARG_A(i)], &irep->icache[pc - irep->iseq]);
       NEXT;
     }
 
@@ -911,10 +1371,34 @@ RETRY_TRY_BLOCK:
     CASE(OP_GETCONST) {
       /* A Bx    R(A) := constget(Syms(Bx)) */
       mrb_value val;
+      mrb_constsite_cache *kc;
+      struct RClass *ck = proc->target_class;
+
+      /* per-site constant cache, keyed on the class providing the
+         lexical scope (the whole lookup in mrb_vm_const_get depends
+         only on it); invalidated by generation bump on any constant
+         table modification or class free */
+      if (!ck) ck = mrb->c->ci->target_class;
+      if (!irep->kcache) {
+        irep->kcache = (mrb_constsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_constsite_cache));
+      }
+      kc = &irep->kcache[pc - irep->iseq];
+      if (ck && kc->key == (void*)ck && kc->gen == mrb->const_gen) {
+        regs[GETARG_A(i)] = kc->v;
+        NEXT;
+      }
+      {
+        /* fill with the pre-lookup generation so a result produced by
+           const_missing (which bumps the generation) is never hit */
+        uint32_t gen = mrb->const_gen;
 
-      ERR_PC_SET(mrb, pc);
-      val = mrb_vm_const_get(mrb, syms[GETARG_Bx(i)]);
-      ERR_PC_CLR(mrb);
+        ERR_PC_SET(mrb, pc);
+        val = mrb_vm_const_get(mrb, syms[GETARG_Bx(i)]);
+        ERR_PC_CLR(mrb);
+        kc->key = (void*)ck;
+        kc->v = val;
+        kc->gen = gen;
+      }
       regs[GETARG_A(i)] = val;
       NEXT;
     }
@@ -929,10 +1413,31 @@ RETRY_TRY_BLOCK:
       /* A Bx   R(A) := R(A)::Syms(Bx) */
       mrb_value val;
       int a = GETARG_A(i);
+      mrb_constsite_cache *kc;
 
-      ERR_PC_SET(mrb, pc);
-      val = mrb_const_get(mrb, regs[a], syms[GETARG_Bx(i)]);
-      ERR_PC_CLR(mrb);
+      /* per-site constant cache, keyed on the receiver class */
+      if (!irep->kcache) {
+        irep->kcache = (mrb_constsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_constsite_cache));
+      }
+      kc = &irep->kcache[pc - irep->iseq];
+      if ((mrb_type(regs[a]) == MRB_TT_CLASS || mrb_type(regs[a]) == MRB_TT_MODULE ||
+           mrb_type(regs[a]) == MRB_TT_SCLASS) &&
+          kc->key == mrb_ptr(regs[a]) && kc->gen == mrb->const_gen) {
+        regs[a] = kc->v;
+        NEXT;
+      }
+      {
+        uint32_t gen = mrb->const_gen;
+
+        ERR_PC_SET(mrb, pc);
+        val = mrb_const_get(mrb, regs[a], syms[GETARG_Bx(i)]);
+        ERR_PC_CLR(mrb);
+        /* mrb_const_get raises unless the receiver is a class or
+           module, so its pointer is a sound key here */
+        kc->key = mrb_ptr(regs[a]);
+        kc->v = val;
+        kc->gen = gen;
+      }
       regs[a] = val;
       NEXT;
     }
@@ -1038,8 +1543,10 @@ RETRY_TRY_BLOCK:
     CASE(OP_EPUSH) {
       /* Bx     ensure_push(SEQ[Bx]) */
       struct RProc *p;
+      mrb_irep *rep = irep->reps[GETARG_Bx(i)];
 
-      p = mrb_closure_new(mrb, irep->reps[GETARG_Bx(i)]);
+      if (!rep) rep = mrb_irep_read_rep(mrb, irep, GETARG_Bx(i)); /* lazily loaded */
+      p = mrb_closure_new(mrb, rep);
       /* push ensure_stack */
       if (mrb->c->esize <= mrb->c->ci->eidx) {
         if (mrb->c->esize == 0) mrb->c->esize = 16;
@@ -1057,7 +1564,7 @@ RETRY_TRY_BLOCK:
       mrb_callinfo *ci = mrb->c->ci;
       int n, eidx = ci->eidx;
 
-      for (n=0; n<a && (ci == mrb->c->cibase || eidx > ci[-1].eidx); n++) {
+      for (n=0; n<a && (ci->ciidx == 0 || eidx > mrb_ci_at(mrb->c, ci->ciidx-1)->eidx); n++) {
         ecall(mrb, --eidx);
         ARENA_RESTORE(mrb, ai);
       }
@@ -1088,6 +1595,9 @@ RETRY_TRY_BLOCK:
       mrb_value recv, result;
       mrb_sym mid = syms[GETARG_B(i)];
 
+      if (mrb->prof && --mrb->prof->countdown == 0) {
+        mrb_profile_sample_stack(mrb, pc);
+      }
       recv = regs[a];
       if (GET_OPCODE(i) != OP_SENDB) {
         if (n == CALL_MAXARGS) {
@@ -1098,10 +1608,43 @@ RETRY_TRY_BLOCK:
         }
       }
       c = mrb_class(mrb, recv);
-      m = mrb_method_search_vm(mrb, &c, mid);
+      {
+        /* monomorphic inline cache, one entry per call site */
+        mrb_callsite_cache *cc;
+
+        if (!irep->ccache) {
+          irep->ccache = (mrb_callsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_callsite_cache));
+        }
+        cc = &irep->ccache[pc - irep->iseq];
+        if (cc->c == c && cc->gen == mrb->cache_gen) {
+          c = cc->tc;
+          m = cc->m;
+        }
+        else {
+          struct RClass *rc = c;
+          mrb_bool first = (cc->c == NULL);
+
+          m = mrb_method_search_vm(mrb, &c, mid);
+          if (m) {
+            cc->c = rc;
+            cc->tc = c;
+            cc->m = m;
+            cc->gen = mrb->cache_gen;
+            /* quicken call sites that resolve to a C function on their
+               first execution; OP_SENDC deoptimizes itself when the
+               cache entry goes stale */
+            if (first && MRB_PROC_CFUNC_P(m) &&
+                m->body.func != mrb_instance_new &&  /* keeps the new fast path below reachable */
+                GET_OPCODE(*pc) == OP_SEND &&
+                !(irep->flags & MRB_ISEQ_NO_FREE)) {
+              *pc = MKOP_ABC(OP_SENDC, a, GETARG_B(i), GETARG_C(i));
+            }
+          }
+        }
+      }
       if (!m) {
         mrb_value sym = mrb_symbol_value(mid);
-        mrb_sym missing = mrb_intern_lit(mrb, "method_missing");
+        mrb_sym missing = MRB_SYM(method_missing);
 
         m = mrb_method_search_vm(mrb, &c, missing);
         if (!m) {
@@ -1125,6 +1668,121 @@ RETRY_TRY_BLOCK:
         }
       }
 
+      /* recognized fast path for Class#new: allocate the instance
+         inline and enter #initialize -- resolved through the method
+         cache, so redefinition invalidates via the cache serial --
+         without going through mrb_instance_new's funcall */
+      if (MRB_PROC_CFUNC_P(m) && m->body.func == mrb_instance_new &&
+          GET_OPCODE(i) != OP_SENDB && n != CALL_MAXARGS &&
+          mrb_type(recv) == MRB_TT_CLASS) {
+        struct RClass *k = mrb_class_ptr(recv);
+        struct RClass *itc = k;
+        struct RProc *im = mrb_method_search_vm(mrb, &itc, MRB_SYM(initialize));
+        enum mrb_vtype ttype = MRB_INSTANCE_TT(k);
+
+        if (ttype == 0) ttype = MRB_TT_OBJECT;
+        if (im && MRB_PROC_CFUNC_P(im) && im->body.func == mrb_bob_init) {
+          /* default initialize is a no-op; skip the call entirely */
+          regs[a] = mrb_obj_value(mrb_obj_alloc(mrb, ttype, k));
+          NEXT;
+        }
+        if (im && !MRB_PROC_CFUNC_P(im)) {
+          /* the new object is both new's result and initialize's self:
+             it sits in regs[a], the callee's self slot, which compiled
+             code never writes.  acc points at a dead temporary so the
+             value initialize returns is discarded. */
+          regs[a] = mrb_obj_value(mrb_obj_alloc(mrb, ttype, k));
+          ci = cipush(mrb);
+          ci->mid = MRB_SYM(initialize);
+          ci->stackent = mrb->c->stack;
+          ci->target_class = itc;
+          ci->pc = pc + 1;
+          ci->acc = a+1;
+          ci->argc = n;
+          mrb->c->stack += a;
+          proc = mrb->c->ci->proc = im;
+          irep = im->body.irep;
+          pool = irep->pool;
+          syms = irep->syms;
+          ci->nregs = irep->nregs;
+          stack_extend(mrb, irep->nregs, n+2);
+          pc = irep->iseq;
+          JUMP;
+        }
+        /* a C-function initialize takes the generic path below */
+      }
+
+      /* frame-free execution of trivial leaf methods */
+      if (!MRB_PROC_CFUNC_P(m) && n != CALL_MAXARGS) {
+        mrb_irep *mirep = m->body.irep;
+
+        if (!(mirep->flags & MRB_IREP_LEAF_CHECKED)) {
+          mirep->flags |= MRB_IREP_LEAF_CHECKED;
+          if (leaf_irep_p(mirep)) mirep->flags |= MRB_IREP_LEAF;
+        }
+        if (mirep->flags & MRB_IREP_LEAF) {
+          mrb_code li = mirep->iseq[1];
+
+          /* quicken the site so later executions skip the lookup and the
+             leaf test; OP_SENDL deoptimizes itself when the cache entry
+             goes stale, like OP_SENDC.  Skipped when the resolution came
+             from method_missing (the cache entry then names a different
+             method than the one executing). */
+          if (n == (GET_OPCODE(li) == OP_SETIV ? 1 : 0) &&
+              GET_OPCODE(*pc) == OP_SEND &&
+              !(irep->flags & MRB_ISEQ_NO_FREE) &&
+              irep->ccache[pc - irep->iseq].m == m) {
+            *pc = MKOP_ABC(OP_SENDL, a, GETARG_B(i), n);
+          }
+          switch (GET_OPCODE(li)) {
+          case OP_GETIV:
+            if (n == 0) {
+              regs[a] = mrb_iv_get(mrb, recv, mirep->syms[GETARG_Bx(li)]);
+              NEXT;
+            }
+            break;
+          case OP_SETIV:
+            if (n == 1) {
+              mrb_iv_set(mrb, recv, mirep->syms[GETARG_Bx(li)], regs[a+1]);
+              regs[a] = regs[a+1];
+              NEXT;
+            }
+            break;
+          case OP_LOADSELF:
+            if (n == 0) { regs[a] = recv; NEXT; }
+            break;
+          case OP_LOADT:
+            if (n == 0) { SET_TRUE_VALUE(regs[a]); NEXT; }
+            break;
+          case OP_LOADF:
+            if (n == 0) { SET_FALSE_VALUE(regs[a]); NEXT; }
+            break;
+          case OP_LOADNIL:
+            if (n == 0) { SET_NIL_VALUE(regs[a]); NEXT; }
+            break;
+          case OP_LOADI:
+            if (n == 0) { SET_INT_VALUE(regs[a], GETARG_sBx(li)); NEXT; }
+            break;
+          case OP_LOADSYM:
+            if (n == 0) { SET_SYM_VALUE(regs[a], mirep->syms[GETARG_Bx(li)]); NEXT; }
+            break;
+          case OP_LOADL:
+            if (n == 0) { regs[a] = mirep->pool[GETARG_Bx(li)]; NEXT; }
+            break;
+          default:
+            break;
+          }
+        }
+      }
+
+      /* hand hot methods to the JIT backend; it executes without a frame
+         and returns FALSE when the method is not (or cannot be) compiled
+         or its entry guards fail */
+      if (mrb->jit && !MRB_PROC_CFUNC_P(m) && n != CALL_MAXARGS &&
+          mrb->jit->call(mrb, m, regs+a, n, &regs[a])) {
+        NEXT;
+      }
+
       /* push callinfo */
       ci = cipush(mrb);
       ci->mid = mid;
@@ -1150,6 +1808,14 @@ RETRY_TRY_BLOCK:
         result = m->body.func(mrb, recv);
         mrb_gc_arena_restore(mrb, ai);
         if (mrb->exc) goto L_RAISE;
+        if (mrb->break_proc) {
+          /* a break for a block further up the stack stopped at a C
+             boundary inside this call; resume unwinding it from here */
+          proc = mrb->break_proc;
+          mrb->break_proc = NULL;
+          break_value = result;
+          goto L_BREAK;
+        }
         /* pop stackpos */
         ci = mrb->c->ci;
         if (!ci->target_class) { /* return from context modifying method (resume/yield) */
@@ -1158,8 +1824,8 @@ RETRY_TRY_BLOCK:
             return result;
           }
           else {
-            mrb_assert(!MRB_PROC_CFUNC_P(ci[-1].proc));
-            proc = ci[-1].proc;
+            mrb_assert(!MRB_PROC_CFUNC_P(mrb_ci_at(mrb->c, ci->ciidx-1)->proc));
+            proc = mrb_ci_at(mrb->c, ci->ciidx-1)->proc;
             irep = proc->body.irep;
             pool = irep->pool;
             syms = irep->syms;
@@ -1191,6 +1857,273 @@ RETRY_TRY_BLOCK:
       }
     }
 
+    CASE(OP_SENDC) {
+      /* A B C  R(A) := call(R(A),Syms(B),R(A+1),...,R(A+C))
+         quickened OP_SEND whose call site resolved to a C function */
+      int a = GETARG_A(i);
+      int n = GETARG_C(i);
+      struct RProc *m;
+      struct RClass *c;
+      mrb_callinfo *ci;
+      mrb_value recv, result;
+      mrb_sym mid = syms[GETARG_B(i)];
+      mrb_callsite_cache *cc;
+
+      if (mrb->prof && --mrb->prof->countdown == 0) {
+        mrb_profile_sample_stack(mrb, pc);
+      }
+      recv = regs[a];
+      c = mrb_class(mrb, recv);
+      cc = irep->ccache ? &irep->ccache[pc - irep->iseq] : NULL;
+      if (!cc || cc->c != c || cc->gen != mrb->cache_gen) {
+        /* deoptimize: method tables changed or the site went polymorphic */
+        i = MKOP_ABC(OP_SEND, a, GETARG_B(i), n);
+        *pc = i;
+        goto L_SEND;
+      }
+      m = cc->m;
+      c = cc->tc;
+      if (n == CALL_MAXARGS) {
+        SET_NIL_VALUE(regs[a+2]);
+      }
+      else {
+        SET_NIL_VALUE(regs[a+n+1]);
+      }
+
+      /* push callinfo */
+      ci = cipush(mrb);
+      ci->mid = mid;
+      ci->proc = m;
+      ci->stackent = mrb->c->stack;
+      ci->target_class = c;
+      ci->pc = pc + 1;
+      ci->acc = a;
+
+      /* prepare stack */
+      mrb->c->stack += a;
+
+      if (n == CALL_MAXARGS) {
+        ci->argc = -1;
+        ci->nregs = 3;
+      }
+      else {
+        ci->argc = n;
+        ci->nregs = n + 2;
+      }
+      result = m->body.func(mrb, recv);
+      mrb_gc_arena_restore(mrb, ai);
+      if (mrb->exc) goto L_RAISE;
+      if (mrb->break_proc) {
+        /* see the twin check on the generic send path */
+        proc = mrb->break_proc;
+        mrb->break_proc = NULL;
+        break_value = result;
+        goto L_BREAK;
+      }
+      /* pop stackpos */
+      ci = mrb->c->ci;
+      if (!ci->target_class) { /* return from context modifying method (resume/yield) */
+        if (ci->acc == CI_ACC_RESUMED) {
+          mrb->jmp = prev_jmp;
+          return result;
+        }
+        else {
+          mrb_assert(!MRB_PROC_CFUNC_P(mrb_ci_at(mrb->c, ci->ciidx-1)->proc));
+          proc = mrb_ci_at(mrb->c, ci->ciidx-1)->proc;
+          irep = proc->body.irep;
+          pool = irep->pool;
+          syms = irep->syms;
+        }
+      }
+      mrb->c->stack[0] = result;
+      mrb->c->stack = ci->stackent;
+      pc = ci->pc;
+      cipop(mrb);
+      JUMP;
+    }
+
+    CASE(OP_SENDL) {
+      /* A B C  R(A) := call(R(A),Syms(B),R(A+1),...,R(A+C))
+         quickened OP_SEND resolved to a trivial leaf method; the body
+         executes here with no callinfo push or stack extension */
+      int a = GETARG_A(i);
+      int n = GETARG_C(i);
+      struct RClass *c;
+      mrb_value recv;
+      mrb_callsite_cache *cc;
+      mrb_irep *mirep;
+      mrb_code li;
+
+      if (mrb->prof && --mrb->prof->countdown == 0) {
+        mrb_profile_sample_stack(mrb, pc);
+      }
+      recv = regs[a];
+      c = mrb_class(mrb, recv);
+      cc = irep->ccache ? &irep->ccache[pc - irep->iseq] : NULL;
+      if (!cc || cc->c != c || cc->gen != mrb->cache_gen ||
+          MRB_PROC_CFUNC_P(cc->m) ||
+          !(cc->m->body.irep->flags & MRB_IREP_LEAF)) {
+        /* deoptimize: method tables changed or the site went polymorphic */
+        i = MKOP_ABC(OP_SEND, a, GETARG_B(i), n);
+        *pc = i;
+        goto L_SEND;
+      }
+      mirep = cc->m->body.irep;
+      li = mirep->iseq[1];
+      switch (GET_OPCODE(li)) {
+      case OP_GETIV:
+        if (n == 0) {
+          regs[a] = mrb_iv_get(mrb, recv, mirep->syms[GETARG_Bx(li)]);
+          NEXT;
+        }
+        break;
+      case OP_SETIV:
+        if (n == 1) {
+          mrb_iv_set(mrb, recv, mirep->syms[GETARG_Bx(li)], regs[a+1]);
+          regs[a] = regs[a+1];
+          NEXT;
+        }
+        break;
+      case OP_LOADSELF:
+        if (n == 0) { regs[a] = recv; NEXT; }
+        break;
+      case OP_LOADT:
+        if (n == 0) { SET_TRUE_VALUE(regs[a]); NEXT; }
+        break;
+      case OP_LOADF:
+        if (n == 0) { SET_FALSE_VALUE(regs[a]); NEXT; }
+        break;
+      case OP_LOADNIL:
+        if (n == 0) { SET_NIL_VALUE(regs[a]); NEXT; }
+        break;
+      case OP_LOADI:
+        if (n == 0) { SET_INT_VALUE(regs[a], GETARG_sBx(li)); NEXT; }
+        break;
+      case OP_LOADSYM:
+        if (n == 0) { SET_SYM_VALUE(regs[a], mirep->syms[GETARG_Bx(li)]); NEXT; }
+        break;
+      case OP_LOADL:
+        if (n == 0) { regs[a] = mirep->pool[GETARG_Bx(li)]; NEXT; }
+        break;
+      default:
+        break;
+      }
+      /* the cache was refilled with a leaf of a different shape */
+      i = MKOP_ABC(OP_SEND, a, GETARG_B(i), n);
+      *pc = i;
+      goto L_SEND;
+    }
+
+    CASE(OP_UPDIDX) {
+      /* A B    R(A) := R(A)[R(A+1)].send(Syms(B),R(A+2)), stored back
+         with []=.  Emitted for `recv[key] op= operand` with a pure
+         operand; plain Hash/Array receivers update in place, anything
+         else goes through real dispatch below */
+      int a = GETARG_A(i);
+      mrb_value recv = regs[a];
+      mrb_value key = regs[a+1];
+      mrb_value opnd = regs[a+2];
+      mrb_value v;
+      struct RClass *c;
+      mrb_callsite_cache *cc;
+
+      c = mrb_class(mrb, recv);
+      if (!irep->ccache) {
+        irep->ccache = (mrb_callsite_cache*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_callsite_cache));
+      }
+      cc = &irep->ccache[pc - irep->iseq];
+      if (cc->c != c || cc->gen != mrb->cache_gen) {
+        /* revalidate: the inline path stands in for Hash/Array#[] and
+           #[]=, so both must still resolve to the builtin C functions */
+        struct RClass *rc;
+        struct RProc *mget, *mset;
+
+        cc->c = c;
+        cc->gen = mrb->cache_gen;
+        cc->tc = NULL;
+        cc->m = NULL;
+        if (c == mrb->hash_class || c == mrb->array_class) {
+          rc = c;
+          mget = mrb_method_search_vm(mrb, &rc, mrb_intern_lit(mrb, "[]"));
+          rc = c;
+          mset = mrb_method_search_vm(mrb, &rc, mrb_intern_lit(mrb, "[]="));
+          if (mget && mset && MRB_PROC_CFUNC_P(mget) && MRB_PROC_CFUNC_P(mset)) {
+            cc->tc = c;         /* site may take the inline path */
+          }
+        }
+      }
+      if (cc->tc && mrb_fixnum_p(opnd)) {
+        mrb_sym ops = syms[GETARG_B(i)];
+        mrb_bool add = (ops == mrb_intern_lit(mrb, "+"));
+
+        if (add || ops == mrb_intern_lit(mrb, "-")) {
+          mrb_int x = mrb_fixnum(opnd);
+          mrb_int z;
+
+          if (mrb_type(recv) == MRB_TT_HASH && !MRB_RHASH_DEFAULT_P(recv)) {
+            mrb_value *slot = mrb_hash_value_slot(mrb, recv, key);
+
+            if (slot && mrb_fixnum_p(*slot) &&
+                !(add ? mrb_int_add_overflow(mrb_fixnum(*slot), x, &z)
+                      : mrb_int_sub_overflow(mrb_fixnum(*slot), x, &z))) {
+              SET_INT_VALUE(*slot, z);
+              SET_INT_VALUE(regs[a], z);
+              NEXT;
+            }
+          }
+          else if (mrb_type(recv) == MRB_TT_ARRAY && mrb_fixnum_p(key)) {
+            v = mrb_ary_ref(mrb, recv, mrb_fixnum(key));
+            if (mrb_fixnum_p(v) &&
+                !(add ? mrb_int_add_overflow(mrb_fixnum(v), x, &z)
+                      : mrb_int_sub_overflow(mrb_fixnum(v), x, &z))) {
+              mrb_value zv;
+
+              SET_INT_VALUE(zv, z);
+              mrb_ary_set(mrb, recv, mrb_fixnum(key), zv);
+              regs[a] = zv;
+              NEXT;
+            }
+          }
+        }
+      }
+      /* full dispatch: subclasses, redefined indexers, hash defaults,
+         non-fixnum values, absent keys, overflow */
+      {
+        mrb_value args2[2];
+
+        v = mrb_funcall_argv(mrb, recv, mrb_intern_lit(mrb, "[]"), 1, &key);
+        v = mrb_funcall_argv(mrb, v, syms[GETARG_B(i)], 1, &opnd);
+        args2[0] = key;
+        args2[1] = v;
+        mrb_funcall_argv(mrb, recv, mrb_intern_lit(mrb, "[]="), 2, args2);
+        regs[a] = v;
+        mrb_gc_arena_restore(mrb, ai);
+        if (mrb->exc) goto L_RAISE;
+      }
+      NEXT;
+    }
+
+    CASE(OP_SELFSEND) {
+      /* A      R(A) := self; then execute the following OP_SEND */
+      regs[GETARG_A(i)] = regs[0];
+      i = *++pc;
+      goto L_SEND;
+    }
+
+    CASE(OP_MOVESEND) {
+      /* A B    R(A) := R(B); then execute the following OP_SEND */
+      regs[GETARG_A(i)] = regs[GETARG_B(i)];
+      i = *++pc;
+      goto L_SEND;
+    }
+
+    CASE(OP_IVSEND) {
+      /* A Bx   R(A) := ivget(Bx); then execute the following OP_SEND */
+      regs[GETARG_A(i)] = mrb_vm_iv_get(mrb, syms[GETARG_Bx(i)]);
+      i = *++pc;
+      goto L_SEND;
+    }
+
     CASE(OP_FSEND) {
       /* A B C  R(A) := fcall(R(A),Syms(B),R(A+1),... ,R(A+C-1)) */
       NEXT;
@@ -1248,7 +2181,9 @@ RETRY_TRY_BLOCK:
         else {
           stack_extend(mrb, irep->nregs, ci->argc+2);
         }
-        regs[0] = m->env->stack[0];
+        if (m->env) {
+          regs[0] = m->env->stack[0];
+        }
         pc = irep->iseq;
         JUMP;
       }
@@ -1275,7 +2210,7 @@ RETRY_TRY_BLOCK:
       c = mrb->c->ci->target_class->super;
       m = mrb_method_search_vm(mrb, &c, mid);
       if (!m) {
-        mid = mrb_intern_lit(mrb, "method_missing");
+        mid = MRB_SYM(method_missing);
         m = mrb_method_search_vm(mrb, &c, mid);
         if (n == CALL_MAXARGS) {
           mrb_ary_unshift(mrb, regs[a+1], mrb_symbol_value(ci->mid));
@@ -1373,21 +2308,21 @@ RETRY_TRY_BLOCK:
         if (mrb_array_p(stack[m1])) {
           struct RArray *ary = mrb_ary_ptr(stack[m1]);
 
-          pp = ary->ptr;
-          len = ary->len;
+          pp = ARY_PTR(ary);
+          len = ARY_LEN(ary);
         }
         regs[a] = mrb_ary_new_capa(mrb, m1+len+m2);
         rest = mrb_ary_ptr(regs[a]);
         if (m1 > 0) {
-          stack_copy(rest->ptr, stack, m1);
+          stack_copy(ARY_PTR(rest), stack, m1);
         }
         if (len > 0) {
-          stack_copy(rest->ptr+m1, pp, len);
+          stack_copy(ARY_PTR(rest)+m1, pp, len);
         }
         if (m2 > 0) {
-          stack_copy(rest->ptr+m1+len, stack+m1+1, m2);
+          stack_copy(ARY_PTR(rest)+m1+len, stack+m1+1, m2);
         }
-        rest->len = m1+len+m2;
+        ARY_SET_LEN(rest, m1+len+m2);
       }
       regs[a+1] = stack[m1+r+m2];
       ARENA_RESTORE(mrb, ai);
@@ -1416,10 +2351,18 @@ RETRY_TRY_BLOCK:
       if (!mrb_nil_p(*blk) && mrb_type(*blk) != MRB_TT_PROC) {
         *blk = mrb_convert_type(mrb, *blk, MRB_TT_PROC, "Proc", "to_proc");
       }
+      /* fast path: a fixed-arity method (no optional, rest, post or
+         keyword parameters) called with exactly the declared number of
+         arguments is already laid out correctly, block included, and no
+         OP_JMPs follow; skip the argument shuffle entirely */
+      if (argc == len && o == 0 && r == 0 && m2 == 0 && (ax & 0x7e) == 0) {
+        pc++;
+        JUMP;
+      }
       if (argc < 0) {
         struct RArray *ary = mrb_ary_ptr(regs[1]);
-        argv = ary->ptr;
-        argc = ary->len;
+        argv = ARY_PTR(ary);
+        argc = ARY_LEN(ary);
         mrb_gc_protect(mrb, regs[1]);
       }
       if (mrb->c->ci->proc && MRB_PROC_STRICT_P(mrb->c->ci->proc)) {
@@ -1432,8 +2375,8 @@ RETRY_TRY_BLOCK:
       }
       else if (len > 1 && argc == 1 && mrb_array_p(argv[0])) {
         mrb_gc_protect(mrb, argv[0]);
-        argc = mrb_ary_ptr(argv[0])->len;
-        argv = mrb_ary_ptr(argv[0])->ptr;
+        argc = RARRAY_LEN(argv[0]);
+        argv = ARY_PTR(mrb_ary_ptr(argv[0]));
       }
       mrb->c->ci->argc = len;
       if (argc < len) {
@@ -1505,22 +2448,22 @@ RETRY_TRY_BLOCK:
 
       L_RAISE:
         ci = mrb->c->ci;
-        mrb_obj_iv_ifnone(mrb, mrb->exc, mrb_intern_lit(mrb, "lastpc"), mrb_cptr_value(mrb, pc));
-        mrb_obj_iv_ifnone(mrb, mrb->exc, mrb_intern_lit(mrb, "ciidx"), mrb_fixnum_value(ci - mrb->c->cibase));
+        mrb_obj_iv_ifnone(mrb, mrb->exc, MRB_SYM(lastpc), mrb_cptr_value(mrb, pc));
+        mrb_obj_iv_ifnone(mrb, mrb->exc, MRB_SYM(ciidx), mrb_fixnum_value(ci->ciidx));
         eidx = ci->eidx;
-        if (ci == mrb->c->cibase) {
+        if (ci->ciidx == 0) {
           if (ci->ridx == 0) goto L_STOP;
           goto L_RESCUE;
         }
-        while (ci[0].ridx == ci[-1].ridx) {
+        while (ci->ridx == mrb_ci_at(mrb->c, ci->ciidx-1)->ridx) {
           cipop(mrb);
           ci = mrb->c->ci;
-          mrb->c->stack = ci[1].stackent;
-          if (ci[1].acc == CI_ACC_SKIP && prev_jmp) {
+          mrb->c->stack = mrb_ci_at(mrb->c, ci->ciidx+1)->stackent;
+          if (mrb_ci_at(mrb->c, ci->ciidx+1)->acc == CI_ACC_SKIP && prev_jmp) {
             mrb->jmp = prev_jmp;
             MRB_THROW(prev_jmp);
           }
-          if (ci == mrb->c->cibase) {
+          if (ci->ciidx == 0) {
             while (eidx > 0) {
               ecall(mrb, --eidx);
             }
@@ -1540,8 +2483,8 @@ RETRY_TRY_BLOCK:
             break;
           }
           /* call ensure only when we skip this callinfo */
-          if (ci[0].ridx == ci[-1].ridx) {
-            while (eidx > ci[-1].eidx) {
+          if (ci->ridx == mrb_ci_at(mrb->c, ci->ciidx-1)->ridx) {
+            while (eidx > mrb_ci_at(mrb->c, ci->ciidx-1)->eidx) {
               ecall(mrb, --eidx);
             }
           }
@@ -1552,7 +2495,7 @@ RETRY_TRY_BLOCK:
         irep = proc->body.irep;
         pool = irep->pool;
         syms = irep->syms;
-        mrb->c->stack = ci[1].stackent;
+        mrb->c->stack = mrb_ci_at(mrb->c, ci->ciidx+1)->stackent;
         pc = mrb->c->rescue[--ci->ridx];
       }
       else {
@@ -1570,40 +2513,62 @@ RETRY_TRY_BLOCK:
               localjump_error(mrb, LOCALJUMP_ERROR_RETURN);
               goto L_RAISE;
             }
-            ci = mrb->c->cibase + e->cioff;
-            if (ci == mrb->c->cibase) {
+            ci = mrb_ci_at(mrb->c, e->cioff);
+            if (ci->ciidx == 0) {
               localjump_error(mrb, LOCALJUMP_ERROR_RETURN);
               goto L_RAISE;
             }
             mrb->c->stack = mrb->c->ci->stackent;
             mrb->c->ci = ci;
+            if (mrb->c->ci_clean > ci->ciidx) mrb->c->ci_clean = ci->ciidx;
             break;
           }
         case OP_R_NORMAL:
-          if (ci == mrb->c->cibase) {
+          if (ci->ciidx == 0) {
             if (!mrb->c->prev) { /* toplevel return */
               localjump_error(mrb, LOCALJUMP_ERROR_RETURN);
               goto L_RAISE;
             }
-            if (mrb->c->prev->ci == mrb->c->prev->cibase) {
+            if (mrb->c->prev->ci->ciidx == 0) {
               mrb_value exc = mrb_exc_new_str_lit(mrb, E_FIBER_ERROR, "double resume");
               mrb_exc_set(mrb, exc);
               goto L_RAISE;
             }
             /* automatic yield at the end */
             mrb->c->status = MRB_FIBER_TERMINATED;
+            if (mrb->c->vmexec) {
+              /* the fiber was resumed from C (mrb_fiber_resume); hand
+                 the value back to that caller instead of unwinding the
+                 previous context's callinfo, which is parked inside the
+                 resuming C function */
+              mrb->c->vmexec = FALSE;
+              mrb->c = mrb->c->prev;
+              mrb->c->status = MRB_FIBER_RUNNING;
+              mrb->jmp = prev_jmp;
+              return v;
+            }
             mrb->c = mrb->c->prev;
             mrb->c->status = MRB_FIBER_RUNNING;
           }
           ci = mrb->c->ci;
           break;
         case OP_R_BREAK:
+          if (0) {
+        L_BREAK:
+            /* entered from a C call that returned with break_proc set:
+               `proc` is the breaking block and break_value its value;
+               the locals initialized at the top of OP_RETURN were
+               bypassed, so set them here */
+            ci = mrb->c->ci;
+            eidx = ci->eidx;
+            v = break_value;
+          }
           if (!proc->env || !MRB_ENV_STACK_SHARED_P(proc->env)) {
             localjump_error(mrb, LOCALJUMP_ERROR_BREAK);
             goto L_RAISE;
           }
           /* break from fiber block */
-          if (mrb->c->ci == mrb->c->cibase && mrb->c->ci->pc) {
+          if (mrb->c->ci->ciidx == 0 && mrb->c->ci->pc) {
             struct mrb_context *c = mrb->c;
 
             mrb->c = c->prev;
@@ -1611,20 +2576,26 @@ RETRY_TRY_BLOCK:
           }
           ci = mrb->c->ci;
           mrb->c->stack = ci->stackent;
-          mrb->c->ci = mrb->c->cibase + proc->env->cioff + 1;
-          while (ci > mrb->c->ci) {
-            if (ci[-1].acc == CI_ACC_SKIP) {
+          mrb->c->ci = mrb_ci_at(mrb->c, proc->env->cioff + 1);
+          while (ci->ciidx > mrb->c->ci->ciidx) {
+            if (ci->acc == CI_ACC_SKIP ||
+                mrb_ci_at(mrb->c, ci->ciidx-1)->acc == CI_ACC_SKIP) {
+              /* unwinding further would pop the frame of a C function that
+                 entered the VM with mrb_yield; stop at the boundary and
+                 record the break so the C caller can pick it up */
+              mrb->break_proc = proc;
               mrb->c->ci = ci;
               break;
             }
-            ci--;
+            ci = mrb_ci_at(mrb->c, ci->ciidx-1);
           }
+          if (mrb->c->ci_clean > mrb->c->ci->ciidx) mrb->c->ci_clean = mrb->c->ci->ciidx;
           break;
         default:
           /* cannot happen */
           break;
         }
-        while (eidx > mrb->c->ci[-1].eidx) {
+        while (eidx > mrb_ci_at(mrb->c, mrb->c->ci->ciidx-1)->eidx) {
           ecall(mrb, --eidx);
         }
         if (mrb->c->vmexec && !mrb->c->ci->target_class) {
@@ -1661,26 +2632,32 @@ RETRY_TRY_BLOCK:
       mrb_value recv;
       mrb_sym mid = syms[GETARG_B(i)];
 
+      /* the current frame cannot be replaced when it was entered from C
+         or when a closure captured its registers; call normally and
+         return through the OP_RETURN that follows this instruction */
+      if (mrb->c->ci->acc < 0 || mrb->c->ci->env) {
+        goto L_SEND;
+      }
       recv = regs[a];
+      if (n == CALL_MAXARGS) {
+        SET_NIL_VALUE(regs[a+2]);
+      }
+      else {
+        SET_NIL_VALUE(regs[a+n+1]);
+      }
       c = mrb_class(mrb, recv);
       m = mrb_method_search_vm(mrb, &c, mid);
-      if (!m) {
-        mrb_value sym = mrb_symbol_value(mid);
-
-        mid = mrb_intern_lit(mrb, "method_missing");
-        m = mrb_method_search_vm(mrb, &c, mid);
-        if (n == CALL_MAXARGS) {
-          mrb_ary_unshift(mrb, regs[a+1], sym);
-        }
-        else {
-          value_move(regs+a+2, regs+a+1, ++n);
-          regs[a+1] = sym;
-        }
+      if (!m || MRB_PROC_CFUNC_P(m)) {
+        /* C functions may inspect the caller's callinfo (__method__,
+           block_given?), and method_missing deserves a real frame;
+           neither gains anything from frame reuse */
+        goto L_SEND;
       }
 
       /* replace callinfo */
       ci = mrb->c->ci;
       ci->mid = mid;
+      ci->proc = m;
       ci->target_class = c;
       if (n == CALL_MAXARGS) {
         ci->argc = -1;
@@ -1689,27 +2666,27 @@ RETRY_TRY_BLOCK:
         ci->argc = n;
       }
 
-      /* move stack */
-      value_move(mrb->c->stack, &regs[a], ci->argc+1);
+      /* move stack; receiver, arguments and block slide to the frame base */
+      if (ci->argc < 0) {
+        value_move(mrb->c->stack, &regs[a], 3);
+      }
+      else {
+        value_move(mrb->c->stack, &regs[a], ci->argc+2);
+      }
 
-      if (MRB_PROC_CFUNC_P(m)) {
-        mrb->c->stack[0] = m->body.func(mrb, recv);
-        mrb_gc_arena_restore(mrb, ai);
-        goto L_RETURN;
+      /* setup environment for calling method */
+      proc = m;
+      irep = m->body.irep;
+      pool = irep->pool;
+      syms = irep->syms;
+      ci->nregs = irep->nregs;
+      if (ci->argc < 0) {
+        stack_extend(mrb, (irep->nregs < 3) ? 3 : irep->nregs, 3);
       }
       else {
-        /* setup environment for calling method */
-        irep = m->body.irep;
-        pool = irep->pool;
-        syms = irep->syms;
-        if (ci->argc < 0) {
-          stack_extend(mrb, (irep->nregs < 3) ? 3 : irep->nregs, 3);
-        }
-        else {
-          stack_extend(mrb, irep->nregs, ci->argc+2);
-        }
-        pc = irep->iseq;
+        stack_extend(mrb, irep->nregs, ci->argc+2);
       }
+      pc = irep->iseq;
       JUMP;
     }
 
@@ -2106,6 +3083,85 @@ RETRY_TRY_BLOCK:
       NEXT;
     }
 
+/* as OP_CMP, but instead of materializing the boolean, apply the
+   OP_JMPIF/OP_JMPNOT that follows in the iseq.  The dispatch fallback
+   leaves pc on the fused instruction, so the send returns to that very
+   jump, which then reads the result register as usual. */
+#define OP_CMP_JMP(op) do {\
+  int result;\
+  mrb_code i2;\
+  switch (TYPES2(mrb_type(regs[a]),mrb_type(regs[a+1]))) {\
+  case TYPES2(MRB_TT_FIXNUM,MRB_TT_FIXNUM):\
+    result = OP_CMP_BODY(op,mrb_fixnum,mrb_fixnum);\
+    break;\
+  case TYPES2(MRB_TT_FIXNUM,MRB_TT_FLOAT):\
+    result = OP_CMP_BODY(op,mrb_fixnum,mrb_float);\
+    break;\
+  case TYPES2(MRB_TT_FLOAT,MRB_TT_FIXNUM):\
+    result = OP_CMP_BODY(op,mrb_float,mrb_fixnum);\
+    break;\
+  case TYPES2(MRB_TT_FLOAT,MRB_TT_FLOAT):\
+    result = OP_CMP_BODY(op,mrb_float,mrb_float);\
+    break;\
+  default:\
+    goto L_SEND;\
+  }\
+  i2 = pc[1];\
+  if (result == (GET_OPCODE(i2) == OP_JMPIF)) {\
+    pc += 1 + GETARG_sBx(i2);\
+  }\
+  else {\
+    pc += 2;\
+  }\
+} while(0)
+
+    CASE(OP_JMPLT) {
+      /* A B C  branch per pc[1] on R(A)<R(A+1) (Syms[B]=:<,C=1)*/
+      int a = GETARG_A(i);
+      OP_CMP_JMP(<);
+      JUMP;
+    }
+
+    CASE(OP_JMPLE) {
+      /* A B C  branch per pc[1] on R(A)<=R(A+1) (Syms[B]=:<=,C=1)*/
+      int a = GETARG_A(i);
+      OP_CMP_JMP(<=);
+      JUMP;
+    }
+
+    CASE(OP_JMPGT) {
+      /* A B C  branch per pc[1] on R(A)>R(A+1) (Syms[B]=:>,C=1)*/
+      int a = GETARG_A(i);
+      OP_CMP_JMP(>);
+      JUMP;
+    }
+
+    CASE(OP_JMPGE) {
+      /* A B C  branch per pc[1] on R(A)>=R(A+1) (Syms[B]=:>=,C=1)*/
+      int a = GETARG_A(i);
+      OP_CMP_JMP(>=);
+      JUMP;
+    }
+
+    CASE(OP_JMPEQ) {
+      /* A B C  branch per pc[1] on R(A)==R(A+1) (Syms[B]=:==,C=1)*/
+      int a = GETARG_A(i);
+      if (mrb_obj_eq(mrb, regs[a], regs[a+1])) {
+        mrb_code i2 = pc[1];
+
+        if (GET_OPCODE(i2) == OP_JMPIF) {
+          pc += 1 + GETARG_sBx(i2);
+        }
+        else {
+          pc += 2;
+        }
+      }
+      else {
+        OP_CMP_JMP(==);
+      }
+      JUMP;
+    }
+
     CASE(OP_ARRAY) {
       /* A B C          R(A) := ary_new(R(B),R(B+1)..R(B+C)) */
       regs[GETARG_A(i)] = mrb_ary_new_from_values(mrb, GETARG_C(i), &regs[GETARG_B(i)]);
@@ -2115,8 +3171,8 @@ RETRY_TRY_BLOCK:
 
     CASE(OP_ARYCAT) {
       /* A B            mrb_ary_concat(R(A),R(B)) */
-      mrb_ary_concat(mrb, regs[GETARG_A(i)],
-                     mrb_ary_splat(mrb, regs[GETARG_B(i)]));
+      mrb_value splat = mrb_ary_splat(mrb, regs[GETARG_B(i)]);
+      mrb_ary_cat(mrb, regs[GETARG_A(i)], RARRAY_PTR(splat), RARRAY_LEN(splat));
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
@@ -2167,17 +3223,17 @@ RETRY_TRY_BLOCK:
         v = mrb_ary_new_from_values(mrb, 1, &regs[a]);
       }
       ary = mrb_ary_ptr(v);
-      len = ary->len;
+      len = ARY_LEN(ary);
       if (len > pre + post) {
-        regs[a++] = mrb_ary_new_from_values(mrb, len - pre - post, ary->ptr+pre);
+        regs[a++] = mrb_ary_new_from_values(mrb, len - pre - post, ARY_PTR(ary)+pre);
         while (post--) {
-          regs[a++] = ary->ptr[len-post-1];
+          regs[a++] = ARY_PTR(ary)[len-post-1];
         }
       }
       else {
         regs[a++] = mrb_ary_new_capa(mrb, 0);
         for (idx=0; idx+pre<len; idx++) {
-          regs[a+idx] = ary->ptr[pre+idx];
+          regs[a+idx] = ARY_PTR(ary)[pre+idx];
         }
         while (idx < post) {
           SET_NIL_VALUE(regs[a+idx]);
@@ -2195,6 +3251,29 @@ RETRY_TRY_BLOCK:
       NEXT;
     }
 
+    CASE(OP_FROZSTR) {
+      /* A Bx           R(A) := frozen_str_dedup(Lit(Bx)) */
+      mrb_value *lc;
+
+      if (!irep->lcache) {
+        irep->lcache = (mrb_value*)mrb_calloc(mrb, irep->ilen, sizeof(mrb_value));
+      }
+      lc = &irep->lcache[pc - irep->iseq];
+      if (!mrb_string_p(*lc)) {
+        /* first execution of this site: make the frozen copy once and
+           root it so it survives collection and even irep teardown
+           (hash tables store frozen keys without duplicating them) */
+        mrb_value str = mrb_str_dup(mrb, pool[GETARG_Bx(i)]);
+
+        RSTR_SET_FROZEN_FLAG(mrb_str_ptr(str));
+        mrb_gc_register(mrb, str);
+        *lc = str;
+        ARENA_RESTORE(mrb, ai);
+      }
+      regs[GETARG_A(i)] = *lc;
+      NEXT;
+    }
+
     CASE(OP_STRCAT) {
       /* A B    R(A).concat(R(B)) */
       mrb_str_concat(mrb, regs[GETARG_A(i)], regs[GETARG_B(i)]);
@@ -2205,14 +3284,8 @@ RETRY_TRY_BLOCK:
       /* A B C   R(A) := hash_new(R(B),R(B+1)..R(B+C)) */
       int b = GETARG_B(i);
       int c = GETARG_C(i);
-      int lim = b+c*2;
-      mrb_value hash = mrb_hash_new_capa(mrb, c);
 
-      while (b < lim) {
-        mrb_hash_set(mrb, hash, regs[b], regs[b+1]);
-        b+=2;
-      }
-      regs[GETARG_A(i)] = hash;
+      regs[GETARG_A(i)] = mrb_hash_new_from_values(mrb, c*2, &regs[b]);
       ARENA_RESTORE(mrb, ai);
       NEXT;
     }
@@ -2221,12 +3294,14 @@ RETRY_TRY_BLOCK:
       /* A b c  R(A) := lambda(SEQ[b],c) (b:c = 14:2) */
       struct RProc *p;
       int c = GETARG_c(i);
+      mrb_irep *rep = irep->reps[GETARG_b(i)];
 
+      if (!rep) rep = mrb_irep_read_rep(mrb, irep, GETARG_b(i)); /* lazily loaded */
       if (c & OP_L_CAPTURE) {
-        p = mrb_closure_new(mrb, irep->reps[GETARG_b(i)]);
+        p = mrb_closure_new(mrb, rep);
       }
       else {
-        p = mrb_proc_new(mrb, irep->reps[GETARG_b(i)]);
+        p = mrb_proc_new(mrb, rep);
       }
       if (c & OP_L_STRICT) p->flags |= MRB_PROC_STRICT;
       regs[GETARG_A(i)] = mrb_obj_value(p);
@@ -2281,6 +3356,9 @@ RETRY_TRY_BLOCK:
       mrb_callinfo *ci;
       mrb_value recv = regs[a];
       struct RProc *p;
+      mrb_irep *rep = irep->reps[GETARG_Bx(i)];
+
+      if (!rep) rep = mrb_irep_read_rep(mrb, irep, GETARG_Bx(i)); /* lazily loaded */
 
       /* prepare stack */
       ci = cipush(mrb);
@@ -2294,7 +3372,7 @@ RETRY_TRY_BLOCK:
       /* prepare stack */
       mrb->c->stack += a;
 
-      p = mrb_proc_new(mrb, irep->reps[GETARG_Bx(i)]);
+      p = mrb_proc_new(mrb, rep);
       p->target_class = ci->target_class;
       ci->proc = p;
 
@@ -2370,11 +3448,27 @@ RETRY_TRY_BLOCK:
       NEXT;
     }
 
+    CASE(OP_TRAP) {
+      /* Ax     breakpoint trap patched over another instruction by a
+                debugger; the hook stops as it sees fit and returns the
+                displaced instruction, which executes at this very pc.
+                A stray trap without an owner behaves like OP_NOP. */
+#ifdef MRB_ENABLE_DEBUG_HOOK
+      if (mrb->breakpoint_hook) {
+        i = mrb->breakpoint_hook(mrb, irep, pc, regs);
+        if (GET_OPCODE(i) != OP_TRAP) {
+          REDISPATCH;
+        }
+      }
+#endif
+      NEXT;
+    }
+
     CASE(OP_STOP) {
       /*        stop VM */
     L_STOP:
       {
-        int eidx_stop = mrb->c->ci == mrb->c->cibase ? 0 : mrb->c->ci[-1].eidx;
+        int eidx_stop = mrb->c->ci->ciidx == 0 ? 0 : mrb_ci_at(mrb->c, mrb->c->ci->ciidx-1)->eidx;
         int eidx = mrb->c->ci->eidx;
         while (eidx > eidx_stop) {
           ecall(mrb, --eidx);
@@ -2426,15 +3520,25 @@ mrb_top_run(mrb_state *mrb, struct RProc *proc, mrb_value self, unsigned int sta
   mrb_callinfo *ci;
   mrb_value v;
 
-  if (!mrb->c->cibase || mrb->c->ci == mrb->c->cibase) {
+  int nregs;
+
+  if (!mrb->jmp && (!mrb->c->ciseg || mrb->c->ci->ciidx == 0)) {
     return mrb_vm_run(mrb, proc, self, stack_keep);
   }
+  /* entered mid-execution (mrb->jmp is armed while the VM runs, even
+     at callinfo depth 0): shift past the interrupted frame's live
+     registers so the toplevel code cannot clobber them */
+  nregs = mrb->c->ci->nregs;
   ci = cipush(mrb);
   ci->nregs = 1;   /* protect the receiver */
   ci->acc = CI_ACC_SKIP;
   ci->target_class = mrb->object_class;
+  ci->stackent = mrb->c->stack;
+  mrb->c->stack += nregs;
   v = mrb_vm_run(mrb, proc, self, stack_keep);
+  mrb->c->stack = mrb->c->ci->stackent;
   cipop(mrb);
+  mrb_gc_protect(mrb, v);
 
   return v;
 }
@@ -0,0 +1,139 @@
+#!/usr/bin/env ruby
+# Scans the core and bundled gem C sources for symbol names that are
+# known at build time and (re)generates the checked-in files
+#
+#   src/presym.inc         - preloaded symbol names, in ID order
+#   include/mruby/presym.h - MRB_SYM()-style compile-time symbol IDs
+#
+# Run from the repository root after adding or renaming any C-level
+# method, class, constant or mrb_intern_lit() name:
+#
+#   ruby tasks/gen_presym.rb
+#
+# Every scanned name is preloaded into the symbol table by
+# mrb_init_symtbl, so the generated enum constants are valid mrb_sym
+# values from mrb_open on and C code can use them without a runtime
+# intern.
+
+SCAN_DIRS = %w[src include mrbgems mrblib]
+
+# method names that are not C identifiers get stable spelled-out enum
+# names, referenced as MRB_OPSYM(add) etc.
+OPERATORS = {
+  "!" => "not", "!=" => "neq", "!~" => "nmatch", "%" => "mod",
+  "&" => "and", "&&" => "andand", "*" => "mul", "**" => "pow",
+  "+" => "add", "+@" => "plus", "-" => "sub", "-@" => "minus",
+  "/" => "div", "<" => "lt", "<=" => "le", "<<" => "lshift",
+  "<=>" => "cmp", "==" => "eq", "===" => "eqq", "=~" => "match",
+  ">" => "gt", ">=" => "ge", ">>" => "rshift", "[]" => "aref",
+  "[]=" => "aset", "^" => "xor", "`" => "tick", "|" => "or",
+  "||" => "oror", "~" => "neg",
+}
+
+PATTERNS = [
+  /mrb_intern_lit\s*\(\s*[A-Za-z_][A-Za-z0-9_]*\s*,\s*"((?:[^"\\]|\\.)*)"/,
+  /mrb_funcall\s*\(\s*[^,]+,[^,]+,\s*"((?:[^"\\]|\\.)*)"/,
+  /mrb_define_\w+\s*\([^;()"]*?"((?:[^"\\]|\\.)*)"/,
+]
+
+# converted call sites reference symbols through the macros, so scan
+# those too or a regeneration would drop them
+MACRO_SUFFIX = {
+  "MRB_SYM" => "", "MRB_SYM_Q" => "?", "MRB_SYM_B" => "!", "MRB_SYM_E" => "=",
+}
+MACRO_PATTERN = /\b(MRB_SYM(?:_[QBE])?|MRB_IVSYM|MRB_CVSYM|MRB_OPSYM)\s*\(\s*([A-Za-z_][A-Za-z0-9_]*)\s*\)/
+
+names = {}
+SCAN_DIRS.each do |dir|
+  Dir.glob("#{dir}/**/*.{c,h,y,inc}").sort.each do |file|
+    next if file.end_with?("src/presym.inc", "include/mruby/presym.h")
+    src = File.read(file)
+    PATTERNS.each do |pat|
+      # skip escapes and anything with whitespace (the latter are format
+      # strings that merely mention one of the scanned functions)
+      src.scan(pat) { |(name)| names[name] = true unless name.empty? || name.include?("\\") || name =~ /\s/ }
+    end
+    src.scan(MACRO_PATTERN) do |macro, arg|
+      case macro
+      when "MRB_IVSYM" then names["@#{arg}"] = true
+      when "MRB_CVSYM" then names["@@#{arg}"] = true
+      when "MRB_OPSYM" then names[OPERATORS.key(arg)] = true if OPERATORS.key(arg)
+      else names["#{arg}#{MACRO_SUFFIX[macro]}"] = true
+      end
+    end
+  end
+end
+
+names = names.keys.sort
+
+def enum_name(name)
+  if op = OPERATORS[name]
+    "MRB_PRESYM_OP__#{op}"
+  elsif name =~ /\A[A-Za-z_][A-Za-z0-9_]*\z/
+    "MRB_PRESYM__#{name}"
+  elsif name =~ /\A([A-Za-z_][A-Za-z0-9_]*)\?\z/
+    "MRB_PRESYM_Q__#{$1}"
+  elsif name =~ /\A([A-Za-z_][A-Za-z0-9_]*)!\z/
+    "MRB_PRESYM_B__#{$1}"
+  elsif name =~ /\A([A-Za-z_][A-Za-z0-9_]*)=\z/
+    "MRB_PRESYM_E__#{$1}"
+  elsif name =~ /\A@([A-Za-z_][A-Za-z0-9_]*)\z/
+    "MRB_PRESYM_IV__#{$1}"
+  elsif name =~ /\A@@([A-Za-z_][A-Za-z0-9_]*)\z/
+    "MRB_PRESYM_CV__#{$1}"
+  else
+    nil    # preloaded, but not addressable through a macro
+  end
+end
+
+banner = "Generated by tasks/gen_presym.rb; do not edit by hand."
+
+File.open("src/presym.inc", "w") do |f|
+  f.puts "/* src/presym.inc - preloaded symbol names, in ID order."
+  f.puts "   #{banner} */"
+  f.puts
+  f.puts "static const struct presym_name {"
+  f.puts "  uint16_t len;"
+  f.puts "  const char *name;"
+  f.puts "} presym_table[] = {"
+  names.each do |name|
+    f.puts "  {#{name.bytesize}, \"#{name.gsub('"', '\"')}\"},"
+  end
+  f.puts "};"
+end
+
+File.open("include/mruby/presym.h", "w") do |f|
+  f.puts "/*"
+  f.puts "** mruby/presym.h - build-time interned symbols"
+  f.puts "**"
+  f.puts "** #{banner}"
+  f.puts "** See Copyright Notice in mruby.h"
+  f.puts "*/"
+  f.puts
+  f.puts "#ifndef MRUBY_PRESYM_H"
+  f.puts "#define MRUBY_PRESYM_H"
+  f.puts
+  f.puts "/* Compile-time mrb_sym values for the symbols preloaded by"
+  f.puts "   mrb_open (see mrb_init_symtbl in src/symbol.c); usable wherever"
+  f.puts "   an interned symbol is needed, without a runtime mrb_intern. */"
+  f.puts "#define MRB_SYM(x)   MRB_PRESYM__##x"
+  f.puts "#define MRB_SYM_Q(x) MRB_PRESYM_Q__##x   /* x? */"
+  f.puts "#define MRB_SYM_B(x) MRB_PRESYM_B__##x   /* x! */"
+  f.puts "#define MRB_SYM_E(x) MRB_PRESYM_E__##x   /* x= */"
+  f.puts "#define MRB_IVSYM(x) MRB_PRESYM_IV__##x  /* @x */"
+  f.puts "#define MRB_CVSYM(x) MRB_PRESYM_CV__##x  /* @@x */"
+  f.puts "#define MRB_OPSYM(x) MRB_PRESYM_OP__##x  /* spelled-out operator */"
+  f.puts
+  f.puts "#define MRB_PRESYM_MAX #{names.size}"
+  f.puts
+  f.puts "enum mruby_presym {"
+  names.each_with_index do |name, i|
+    en = enum_name(name)
+    f.puts "  #{en} = #{i+1}," if en
+  end
+  f.puts "};"
+  f.puts
+  f.puts "#endif  /* MRUBY_PRESYM_H */"
+end
+
+$stderr.puts "presym: #{names.size} symbols"
@@ -347,3 +347,26 @@ assert("Array (Longish inline array)") do
   ary.each {|p| h[p.class] += 1}
   assert_equal({Array=>200}, h)
 end
+
+assert("Array#sort") do
+  assert_equal [1, 2, 3], [3, 1, 2].sort
+  assert_equal [3, 2, 1], [3, 1, 2].sort { |a, b| b <=> a }
+  assert_equal [1, 1.5, 2], [2, 1.5, 1].sort
+  assert_equal %w[a b c], %w[c a b].sort
+  assert_equal [], [].sort
+  ary = (1..1000).to_a.reverse
+  assert_equal (1..1000).to_a, ary.sort
+end
+
+assert("Array slices are independent of their source") do
+  a = (0...32).to_a
+  b = a[4, 24]
+  c = a.first(16)
+  d = a.last(16)
+  a[10] = :x
+  assert_equal 10, b[6]
+  assert_equal (0...16).to_a, c
+  assert_equal (16...32).to_a, d
+  b[0] = :y
+  assert_equal 4, a[4]
+end
@@ -132,3 +132,28 @@ end
 assert('Enumerable#to_a', '15.3.2.2.20') do
   assert_equal [1], [1].to_a
 end
+
+assert('Enumerable native iteration: break value') do
+  assert_equal :stop, [1,2,3].map { |i| break :stop if i == 2; i }
+  assert_equal :stop, [1,2,3].select { |i| break :stop }
+  assert_equal :stop, [1,2,3].inject { |a,b| break :stop }
+  assert_equal :stop, (1..3).detect { |i| break :stop }
+end
+
+assert('Enumerable native iteration: outer break') do
+  r = [[1],[2]].each { |a| a.map { |x| break :inner }; break :outer }
+  assert_equal :outer, r
+end
+
+assert('Enumerable native iteration over Hash yields pairs') do
+  h = { 1 => 10, 2 => 20 }
+  assert_equal [[1,10],[2,20]], h.map { |k,v| [k,v] }
+  assert_equal [[2,20]], h.find_all { |kv| kv[1] > 10 }
+  assert_true h.all? { |k,v| v == k * 10 }
+  assert_equal 30, h.inject(0) { |s,kv| s + kv[1] }
+end
+
+assert('Enumerable native iteration over Range') do
+  assert_equal [2,4,6], (1..3).map { |i| i * 2 }
+  assert_equal 6, (1..3).inject(:+)
+end
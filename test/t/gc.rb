@@ -43,3 +43,40 @@ assert('GC.generational_mode=') do
     GC.generational_mode = origin
   end
 end
+
+assert('GC.stat') do
+  GC.start
+  stat = GC.stat
+  assert_kind_of Hash, stat
+  assert_true stat[:major_count] >= 1
+  assert_true stat[:live] > 0
+  assert_true stat[:live_by_type][:string] > 0
+end
+
+assert('GC.max_pause=') do
+  begin
+    GC.generational_mode = false
+    GC.max_pause = 200
+    assert_equal 200, GC.max_pause
+    10000.times { "pause" + "budget" }
+    assert_true true
+  ensure
+    GC.max_pause = 0
+    GC.generational_mode = true
+  end
+  assert_equal 0, GC.max_pause
+end
+
+assert('GC.autotune=') do
+  begin
+    assert_false GC.autotune?
+    assert_true (GC.autotune = true)
+    assert_true GC.autotune?
+    10000.times { "auto" + "tune" }
+    GC.start
+    assert_true GC.step_ratio > 0
+  ensure
+    GC.autotune = false
+  end
+  assert_false GC.autotune?
+end